@@ -388,30 +388,38 @@ fail:
 	return rc;
 }
 
-BOOL drive_file_seek(DRIVE_FILE* file, UINT64 Offset)
+/**
+ * Reads and writes are positional and never move the file pointer, so
+ * several of them may be in flight on the same file at once.
+ */
+static BOOL drive_file_set_offset(LPOVERLAPPED overlapped, UINT64 Offset)
 {
-	LARGE_INTEGER loffset;
-
-	if (!file)
-		return FALSE;
-
 	if (Offset > INT64_MAX)
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
 		return FALSE;
+	}
 
-	loffset.QuadPart = (LONGLONG)Offset;
-	return SetFilePointerEx(file->file_handle, loffset, NULL, FILE_BEGIN);
+	ZeroMemory(overlapped, sizeof(OVERLAPPED));
+	overlapped->Offset = (DWORD)(Offset & 0xFFFFFFFF);
+	overlapped->OffsetHigh = (DWORD)(Offset >> 32);
+	return TRUE;
 }
 
-BOOL drive_file_read(DRIVE_FILE* file, BYTE* buffer, UINT32* Length)
+BOOL drive_file_read(DRIVE_FILE* file, UINT64 Offset, BYTE* buffer, UINT32* Length)
 {
 	UINT32 read;
+	OVERLAPPED overlapped;
 
 	if (!file || !buffer || !Length)
 		return FALSE;
 
 	DEBUG_WSTR("Read file %s", file->fullpath);
 
-	if (ReadFile(file->file_handle, buffer, *Length, &read, NULL))
+	if (!drive_file_set_offset(&overlapped, Offset))
+		return FALSE;
+
+	if (ReadFile(file->file_handle, buffer, *Length, &read, &overlapped))
 	{
 		*Length = read;
 		return TRUE;
@@ -420,9 +428,10 @@ BOOL drive_file_read(DRIVE_FILE* file, BYTE* buffer, UINT32* Length)
 	return FALSE;
 }
 
-BOOL drive_file_write(DRIVE_FILE* file, BYTE* buffer, UINT32 Length)
+BOOL drive_file_write(DRIVE_FILE* file, UINT64 Offset, BYTE* buffer, UINT32 Length)
 {
 	UINT32 written;
+	OVERLAPPED overlapped;
 
 	if (!file || !buffer)
 		return FALSE;
@@ -431,11 +440,15 @@ BOOL drive_file_write(DRIVE_FILE* file, BYTE* buffer, UINT32 Length)
 
 	while (Length > 0)
 	{
-		if (!WriteFile(file->file_handle, buffer, Length, &written, NULL))
+		if (!drive_file_set_offset(&overlapped, Offset))
+			return FALSE;
+
+		if (!WriteFile(file->file_handle, buffer, Length, &written, &overlapped))
 			return FALSE;
 
 		Length -= written;
 		buffer += written;
+		Offset += written;
 	}
 
 	return TRUE;
@@ -46,6 +46,9 @@
 
 #include "drive_file.h"
 
+/* IRPs are processed by a small pool, most of the time they wait for I/O */
+#define DRIVE_WORKER_THREADS	4
+
 typedef struct _DRIVE_DEVICE DRIVE_DEVICE;
 
 struct _DRIVE_DEVICE
@@ -57,9 +60,12 @@ struct _DRIVE_DEVICE
 	UINT32 PathLength;
 	wListDictionary* files;
 
-	HANDLE thread;
+	HANDLE threads[DRIVE_WORKER_THREADS];
 	wMessageQueue* IrpQueue;
 
+	CRITICAL_SECTION lock;
+	wListDictionary* queues;
+
 	DEVMAN* devman;
 
 	rdpContext* rdpcontext;
@@ -183,7 +189,9 @@ static UINT drive_process_irp_create(DRIVE_DEVICE* drive, IRP* irp)
 		return ERROR_INVALID_DATA;
 
 	path = (WCHAR*) Stream_Pointer(irp->input);
+	EnterCriticalSection(&drive->lock);
 	FileId = irp->devman->id_sequence++;
+	LeaveCriticalSection(&drive->lock);
 	file = drive_file_new(drive->path, path, PathLength, FileId, DesiredAccess, CreateDisposition,
 	                      CreateOptions, FileAttributes, SharedAccess);
 
@@ -289,11 +297,6 @@ static UINT drive_process_irp_read(DRIVE_DEVICE* drive, IRP* irp)
 		irp->IoStatus = STATUS_UNSUCCESSFUL;
 		Length = 0;
 	}
-	else if (!drive_file_seek(file, Offset))
-	{
-		irp->IoStatus = drive_map_windows_err(GetLastError());
-		Length = 0;
-	}
 
 	if (!Stream_EnsureRemainingCapacity(irp->output, Length + 4))
 	{
@@ -306,7 +309,7 @@ static UINT drive_process_irp_read(DRIVE_DEVICE* drive, IRP* irp)
 	{
 		BYTE* buffer = Stream_Pointer(irp->output) + sizeof(UINT32);
 
-		if (!drive_file_read(file, buffer, &Length))
+		if (!drive_file_read(file, Offset, buffer, &Length))
 		{
 			irp->IoStatus = drive_map_windows_err(GetLastError());
 			Stream_Write_UINT32(irp->output, 0);
@@ -348,12 +351,7 @@ static UINT drive_process_irp_write(DRIVE_DEVICE* drive, IRP* irp)
 		irp->IoStatus = STATUS_UNSUCCESSFUL;
 		Length = 0;
 	}
-	else if (!drive_file_seek(file, Offset))
-	{
-		irp->IoStatus = drive_map_windows_err(GetLastError());
-		Length = 0;
-	}
-	else if (!drive_file_write(file, Stream_Pointer(irp->input), Length))
+	else if (!drive_file_write(file, Offset, Stream_Pointer(irp->input), Length))
 	{
 		irp->IoStatus = drive_map_windows_err(GetLastError());
 		Length = 0;
@@ -750,6 +748,209 @@ static UINT drive_process_irp(DRIVE_DEVICE* drive, IRP* irp)
 	return error;
 }
 
+/**
+ * IRPs of one file are kept in order, except that reads and writes may run
+ * next to each other as long as they don't touch the same bytes: reads
+ * share with reads, and writes with reads and writes of other ranges.
+ * Everything else (close, information, directory queries, ...) waits for the
+ * IRPs before it and blocks the ones after it. Creates have no file yet and
+ * are never held back.
+ */
+struct _DRIVE_FILE_IO
+{
+	UINT32 sequence;
+	BOOL write;
+	UINT64 offset;
+	UINT32 length;
+};
+typedef struct _DRIVE_FILE_IO DRIVE_FILE_IO;
+
+struct _DRIVE_FILE_QUEUE
+{
+	BOOL exclusive;
+	UINT32 sequence;
+	wQueue* pending;
+
+	/* the IRPs handed to the workers */
+	DRIVE_FILE_IO* active;
+	size_t activeCount;
+	size_t activeSize;
+};
+typedef struct _DRIVE_FILE_QUEUE DRIVE_FILE_QUEUE;
+
+static BOOL drive_irp_is_ordered(IRP* irp)
+{
+	return irp->MajorFunction != IRP_MJ_CREATE;
+}
+
+/* Fills io with the range of a read or write, other IRPs are not shared */
+static BOOL drive_irp_is_shared(IRP* irp, DRIVE_FILE_IO* io)
+{
+	size_t position;
+
+	if ((irp->MajorFunction != IRP_MJ_READ) && (irp->MajorFunction != IRP_MJ_WRITE))
+		return FALSE;
+
+	/* malformed requests are failed by the worker, one at a time */
+	if (Stream_GetRemainingLength(irp->input) < 12)
+		return FALSE;
+
+	position = Stream_GetPosition(irp->input);
+	Stream_Read_UINT32(irp->input, io->length);
+	Stream_Read_UINT64(irp->input, io->offset);
+	Stream_SetPosition(irp->input, position);
+	io->write = (irp->MajorFunction == IRP_MJ_WRITE);
+	return TRUE;
+}
+
+static BOOL drive_file_io_conflicts(const DRIVE_FILE_IO* a, const DRIVE_FILE_IO* b)
+{
+	if (!a->write && !b->write)
+		return FALSE;
+
+	if (a->offset <= b->offset)
+		return (b->offset - a->offset) < a->length;
+
+	return (a->offset - b->offset) < b->length;
+}
+
+static void drive_file_queue_free(void* obj)
+{
+	IRP* irp;
+	DRIVE_FILE_QUEUE* queue = (DRIVE_FILE_QUEUE*) obj;
+
+	if (!queue)
+		return;
+
+	while ((irp = (IRP*) Queue_Dequeue(queue->pending)))
+		irp->Discard(irp);
+
+	Queue_Free(queue->pending);
+	free(queue->active);
+	free(queue);
+}
+
+static DRIVE_FILE_QUEUE* drive_file_queue_new(void)
+{
+	DRIVE_FILE_QUEUE* queue = (DRIVE_FILE_QUEUE*) calloc(1, sizeof(DRIVE_FILE_QUEUE));
+
+	if (!queue)
+		return NULL;
+
+	if (!(queue->pending = Queue_New(FALSE, -1, -1)))
+	{
+		free(queue);
+		return NULL;
+	}
+
+	return queue;
+}
+
+static BOOL drive_file_queue_can_start(DRIVE_FILE_QUEUE* queue, BOOL shared,
+                                       const DRIVE_FILE_IO* io)
+{
+	size_t i;
+
+	if (!shared)
+		return queue->activeCount == 0;
+
+	for (i = 0; i < queue->activeCount; i++)
+	{
+		if (drive_file_io_conflicts(&queue->active[i], io))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void drive_file_queue_remove(DRIVE_FILE_QUEUE* queue, UINT32 sequence)
+{
+	size_t i;
+
+	for (i = 0; i < queue->activeCount; i++)
+	{
+		if (queue->active[i].sequence == sequence)
+		{
+			queue->active[i] = queue->active[--queue->activeCount];
+			break;
+		}
+	}
+
+	queue->exclusive = FALSE;
+}
+
+/**
+ * Hands the IRPs at the head of the file queue to the workers, as far as
+ * the ordering allows. Must be called with drive->lock held.
+ */
+static UINT drive_file_queue_dispatch(DRIVE_DEVICE* drive, DRIVE_FILE_QUEUE* queue)
+{
+	IRP* irp;
+
+	while (!queue->exclusive && (irp = (IRP*) Queue_Peek(queue->pending)))
+	{
+		DRIVE_FILE_IO io = { 0 };
+		const BOOL shared = drive_irp_is_shared(irp, &io);
+
+		if (!drive_file_queue_can_start(queue, shared, &io))
+			break;
+
+		if (queue->activeCount == queue->activeSize)
+		{
+			const size_t size = queue->activeSize ? queue->activeSize * 2 : 4;
+			DRIVE_FILE_IO* active = (DRIVE_FILE_IO*) realloc(queue->active,
+			                        size * sizeof(DRIVE_FILE_IO));
+
+			if (!active)
+				return CHANNEL_RC_NO_MEMORY;
+
+			queue->active = active;
+			queue->activeSize = size;
+		}
+
+		io.sequence = queue->sequence++;
+		queue->active[queue->activeCount++] = io;
+		queue->exclusive = !shared;
+		Queue_Dequeue(queue->pending);
+
+		if (!MessageQueue_Post(drive->IrpQueue, NULL, 0, (void*) irp,
+		                       (void*)(size_t) io.sequence))
+		{
+			WLog_ERR(TAG, "MessageQueue_Post failed!");
+			/* the IRP is off the queue already, don't leave the file blocked */
+			drive_file_queue_remove(queue, io.sequence);
+			irp->Discard(irp);
+			return ERROR_INTERNAL_ERROR;
+		}
+	}
+
+	return CHANNEL_RC_OK;
+}
+
+/**
+ * Called by a worker when an ordered IRP of FileId has been processed.
+ */
+static UINT drive_file_queue_done(DRIVE_DEVICE* drive, UINT32 FileId, UINT32 sequence)
+{
+	UINT error = CHANNEL_RC_OK;
+	void* key = (void*)(size_t) FileId;
+	DRIVE_FILE_QUEUE* queue;
+	EnterCriticalSection(&drive->lock);
+	queue = (DRIVE_FILE_QUEUE*) ListDictionary_GetItemValue(drive->queues, key);
+
+	if (queue)
+	{
+		drive_file_queue_remove(queue, sequence);
+		error = drive_file_queue_dispatch(drive, queue);
+
+		if ((queue->activeCount == 0) && (Queue_Count(queue->pending) == 0))
+			ListDictionary_Remove(drive->queues, key);
+	}
+
+	LeaveCriticalSection(&drive->lock);
+	return error;
+}
+
 static DWORD WINAPI drive_thread_func(LPVOID arg)
 {
 	IRP* irp;
@@ -772,12 +973,9 @@ static DWORD WINAPI drive_thread_func(LPVOID arg)
 			break;
 		}
 
+		/* another worker may have been faster */
 		if (!MessageQueue_Peek(drive->IrpQueue, &message, TRUE))
-		{
-			WLog_ERR(TAG, "MessageQueue_Peek failed!");
-			error = ERROR_INTERNAL_ERROR;
-			break;
-		}
+			continue;
 
 		if (message.id == WMQ_QUIT)
 			break;
@@ -786,11 +984,19 @@ static DWORD WINAPI drive_thread_func(LPVOID arg)
 
 		if (irp)
 		{
+			/* the IRP is gone once it is completed */
+			const UINT32 FileId = irp->FileId;
+			const UINT32 sequence = (UINT32)(size_t) message.lParam;
+			const BOOL ordered = drive_irp_is_ordered(irp);
+
 			if ((error = drive_process_irp(drive, irp)))
 			{
 				WLog_ERR(TAG, "drive_process_irp failed with error %"PRIu32"!", error);
 				break;
 			}
+
+			if (ordered && (error = drive_file_queue_done(drive, FileId, sequence)))
+				break;
 		}
 	}
 
@@ -810,30 +1016,75 @@ fail:
  */
 static UINT drive_irp_request(DEVICE* device, IRP* irp)
 {
+	UINT error;
+	void* key;
+	DRIVE_FILE_QUEUE* queue;
 	DRIVE_DEVICE* drive = (DRIVE_DEVICE*) device;
 
-	if (!drive)
+	if (!drive || !irp)
 		return ERROR_INVALID_PARAMETER;
 
-	if (!MessageQueue_Post(drive->IrpQueue, NULL, 0, (void*) irp, NULL))
+	if (!drive_irp_is_ordered(irp))
 	{
-		WLog_ERR(TAG, "MessageQueue_Post failed!");
-		return ERROR_INTERNAL_ERROR;
+		if (!MessageQueue_Post(drive->IrpQueue, NULL, 0, (void*) irp, NULL))
+		{
+			WLog_ERR(TAG, "MessageQueue_Post failed!");
+			return ERROR_INTERNAL_ERROR;
+		}
+
+		return CHANNEL_RC_OK;
 	}
 
-	return CHANNEL_RC_OK;
+	key = (void*)(size_t) irp->FileId;
+	EnterCriticalSection(&drive->lock);
+	queue = (DRIVE_FILE_QUEUE*) ListDictionary_GetItemValue(drive->queues, key);
+
+	if (!queue)
+	{
+		if (!(queue = drive_file_queue_new()))
+		{
+			error = CHANNEL_RC_NO_MEMORY;
+			goto out;
+		}
+
+		if (!ListDictionary_Add(drive->queues, key, queue))
+		{
+			drive_file_queue_free(queue);
+			error = ERROR_INTERNAL_ERROR;
+			goto out;
+		}
+	}
+
+	if (!Queue_Enqueue(queue->pending, irp))
+	{
+		if ((queue->activeCount == 0) && (Queue_Count(queue->pending) == 0))
+			ListDictionary_Remove(drive->queues, key);
+
+		error = CHANNEL_RC_NO_MEMORY;
+		goto out;
+	}
+
+	error = drive_file_queue_dispatch(drive, queue);
+out:
+	LeaveCriticalSection(&drive->lock);
+	return error;
 }
 
 static UINT drive_free_int(DRIVE_DEVICE* drive)
 {
+	size_t i;
 	UINT error = CHANNEL_RC_OK;
 
 	if (!drive)
 		return ERROR_INVALID_PARAMETER;
 
-	CloseHandle(drive->thread);
+	for (i = 0; i < ARRAYSIZE(drive->threads); i++)
+		CloseHandle(drive->threads[i]);
+
+	ListDictionary_Free(drive->queues);
 	ListDictionary_Free(drive->files);
 	MessageQueue_Free(drive->IrpQueue);
+	DeleteCriticalSection(&drive->lock);
 	Stream_Free(drive->device.data, TRUE);
 	free(drive->path);
 	free(drive);
@@ -847,18 +1098,28 @@ static UINT drive_free_int(DRIVE_DEVICE* drive)
  */
 static UINT drive_free(DEVICE* device)
 {
+	size_t i;
 	DRIVE_DEVICE* drive = (DRIVE_DEVICE*) device;
 	UINT error = CHANNEL_RC_OK;
 
 	if (!drive)
 		return ERROR_INVALID_PARAMETER;
 
-	if (MessageQueue_PostQuit(drive->IrpQueue, 0)
-	    && (WaitForSingleObject(drive->thread, INFINITE) == WAIT_FAILED))
+	/* one quit message per worker, each consumes exactly one */
+	for (i = 0; i < ARRAYSIZE(drive->threads); i++)
+	{
+		if (drive->threads[i] && !MessageQueue_PostQuit(drive->IrpQueue, 0))
+			break;
+	}
+
+	for (i = 0; i < ARRAYSIZE(drive->threads); i++)
 	{
-		error = GetLastError();
-		WLog_ERR(TAG, "WaitForSingleObject failed with error %"PRIu32"", error);
-		return error;
+		if (drive->threads[i] && (WaitForSingleObject(drive->threads[i], INFINITE) == WAIT_FAILED))
+		{
+			error = GetLastError();
+			WLog_ERR(TAG, "WaitForSingleObject failed with error %"PRIu32"", error);
+			return error;
+		}
 	}
 
 	return drive_free_int(drive);
@@ -901,6 +1162,13 @@ static UINT drive_register_drive_path(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints,
 		drive->device.Free = drive_free;
 		drive->rdpcontext = pEntryPoints->rdpcontext;
 		drive->automount = automount;
+
+		if (!InitializeCriticalSectionAndSpinCount(&drive->lock, 4000))
+		{
+			free(drive);
+			return CHANNEL_RC_NO_MEMORY;
+		}
+
 		length = strlen(name);
 		drive->device.data = Stream_New(NULL, length + 1);
 
@@ -943,6 +1211,17 @@ static UINT drive_register_drive_path(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints,
 			goto out_error;
 		}
 
+		drive->queues = ListDictionary_New(FALSE);
+
+		if (!drive->queues)
+		{
+			WLog_ERR(TAG, "ListDictionary_New failed!");
+			error = CHANNEL_RC_NO_MEMORY;
+			goto out_error;
+		}
+
+		ListDictionary_ValueObject(drive->queues)->fnObjectFree = drive_file_queue_free;
+
 		if ((error = pEntryPoints->RegisterDevice(pEntryPoints->devman,
 		             (DEVICE*) drive)))
 		{
@@ -950,14 +1229,19 @@ static UINT drive_register_drive_path(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints,
 			goto out_error;
 		}
 
-		if (!(drive->thread = CreateThread(NULL, 0, drive_thread_func, drive,
-		                                   CREATE_SUSPENDED, NULL)))
+		for (i = 0; i < ARRAYSIZE(drive->threads); i++)
 		{
-			WLog_ERR(TAG, "CreateThread failed!");
-			goto out_error;
+			if (!(drive->threads[i] = CreateThread(NULL, 0, drive_thread_func, drive,
+			                                       CREATE_SUSPENDED, NULL)))
+			{
+				WLog_ERR(TAG, "CreateThread failed!");
+				error = ERROR_INTERNAL_ERROR;
+				goto out_error;
+			}
 		}
 
-		ResumeThread(drive->thread);
+		for (i = 0; i < ARRAYSIZE(drive->threads); i++)
+			ResumeThread(drive->threads[i]);
 	}
 
 	return CHANNEL_RC_OK;
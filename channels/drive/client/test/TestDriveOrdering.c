@@ -0,0 +1,364 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/path.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/settings.h>
+#include <freerdp/channels/rdpdr.h>
+
+#ifdef BUILTIN_CHANNELS
+#define drive_entry drive_DeviceServiceEntry
+#else
+#define drive_entry DeviceServiceEntry
+#endif
+
+UINT drive_entry(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints);
+
+#define TEST_RANGES 4
+#define TEST_BLOCK_SIZE (64 * 1024)
+#define TEST_ROUNDS 256
+#define TEST_TIMEOUT 30000
+
+struct test_irp
+{
+	IRP irp;
+	UINT32 length;
+	BYTE value;
+};
+typedef struct test_irp TEST_IRP;
+
+struct test_state
+{
+	DEVICE* device;
+	HANDLE done;
+	UINT32 fileId;
+	LONG pending;
+	BOOL valid;
+};
+
+static struct test_state state;
+
+static UINT test_register_device(DEVMAN* devman, DEVICE* device)
+{
+	WINPR_UNUSED(devman);
+	state.device = device;
+	return CHANNEL_RC_OK;
+}
+
+static void test_irp_free(TEST_IRP* test)
+{
+	Stream_Free(test->irp.input, TRUE);
+	Stream_Free(test->irp.output, TRUE);
+	free(test);
+
+	if (InterlockedDecrement(&state.pending) == 0)
+		SetEvent(state.done);
+}
+
+static BOOL test_check_output(TEST_IRP* test)
+{
+	size_t i;
+	UINT32 length;
+	wStream* s = test->irp.output;
+	Stream_SealLength(s);
+	Stream_SetPosition(s, 0);
+
+	if (test->irp.IoStatus != STATUS_SUCCESS)
+		return FALSE;
+
+	switch (test->irp.MajorFunction)
+	{
+		case IRP_MJ_CREATE:
+			if (Stream_GetRemainingLength(s) < 5)
+				return FALSE;
+
+			Stream_Read_UINT32(s, state.fileId);
+			return TRUE;
+
+		case IRP_MJ_WRITE:
+			if (Stream_GetRemainingLength(s) < 4)
+				return FALSE;
+
+			Stream_Read_UINT32(s, length);
+			return length == test->length;
+
+		case IRP_MJ_READ:
+			if (Stream_GetRemainingLength(s) < 4)
+				return FALSE;
+
+			Stream_Read_UINT32(s, length);
+
+			if ((length != test->length) || (Stream_GetRemainingLength(s) < length))
+				return FALSE;
+
+			/* the read must see the last write queued before it */
+			for (i = 0; i < length; i++)
+			{
+				if (Stream_Pointer(s)[i] != test->value)
+					return FALSE;
+			}
+
+			return TRUE;
+
+		default:
+			return TRUE;
+	}
+}
+
+static UINT test_irp_complete(IRP* irp)
+{
+	TEST_IRP* test = (TEST_IRP*) irp;
+
+	if (!test_check_output(test))
+	{
+		fprintf(stderr, "IRP %"PRIu32" (major 0x%02"PRIx32") failed\n", irp->CompletionId,
+		        irp->MajorFunction);
+		state.valid = FALSE;
+	}
+
+	test_irp_free(test);
+	return CHANNEL_RC_OK;
+}
+
+static UINT test_irp_discard(IRP* irp)
+{
+	fprintf(stderr, "IRP %"PRIu32" discarded\n", irp->CompletionId);
+	state.valid = FALSE;
+	test_irp_free((TEST_IRP*) irp);
+	return CHANNEL_RC_OK;
+}
+
+static TEST_IRP* test_irp_new(DEVMAN* devman, UINT32 major, size_t size)
+{
+	static UINT32 completionId = 0;
+	TEST_IRP* test = (TEST_IRP*) calloc(1, sizeof(TEST_IRP));
+
+	if (!test)
+		return NULL;
+
+	test->irp.device = state.device;
+	test->irp.devman = devman;
+	test->irp.FileId = state.fileId;
+	test->irp.CompletionId = completionId++;
+	test->irp.MajorFunction = major;
+	test->irp.Complete = test_irp_complete;
+	test->irp.Discard = test_irp_discard;
+	test->irp.input = Stream_New(NULL, size + 32);
+	test->irp.output = Stream_New(NULL, 64);
+
+	if (!test->irp.input || !test->irp.output)
+	{
+		Stream_Free(test->irp.input, TRUE);
+		Stream_Free(test->irp.output, TRUE);
+		free(test);
+		return NULL;
+	}
+
+	return test;
+}
+
+static BOOL test_irp_request(TEST_IRP* test)
+{
+	Stream_SealLength(test->irp.input);
+	Stream_SetPosition(test->irp.input, 0);
+	InterlockedIncrement(&state.pending);
+	ResetEvent(state.done);
+
+	if (state.device->IRPRequest(state.device, &test->irp) != CHANNEL_RC_OK)
+	{
+		state.valid = FALSE;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL test_wait(void)
+{
+	if ((state.pending > 0) && (WaitForSingleObject(state.done, TEST_TIMEOUT) != WAIT_OBJECT_0))
+	{
+		fprintf(stderr, "%"PRId32" IRPs not completed\n", state.pending);
+		return FALSE;
+	}
+
+	return state.valid;
+}
+
+static BOOL test_create(DEVMAN* devman)
+{
+	int length;
+	WCHAR* path = NULL;
+	TEST_IRP* test;
+
+	if ((length = ConvertToUnicode(CP_UTF8, 0, "\\ordering.bin", -1, &path, 0)) <= 0)
+		return FALSE;
+
+	if (!(test = test_irp_new(devman, IRP_MJ_CREATE, length * sizeof(WCHAR) + 32)))
+	{
+		free(path);
+		return FALSE;
+	}
+
+	Stream_Write_UINT32(test->irp.input, GENERIC_READ | GENERIC_WRITE); /* DesiredAccess */
+	Stream_Write_UINT64(test->irp.input, 0); /* AllocationSize */
+	Stream_Write_UINT32(test->irp.input, FILE_ATTRIBUTE_NORMAL); /* FileAttributes */
+	Stream_Write_UINT32(test->irp.input, FILE_SHARE_READ | FILE_SHARE_WRITE); /* SharedAccess */
+	Stream_Write_UINT32(test->irp.input, FILE_OVERWRITE_IF); /* CreateDisposition */
+	Stream_Write_UINT32(test->irp.input, FILE_NON_DIRECTORY_FILE); /* CreateOptions */
+	Stream_Write_UINT32(test->irp.input, length * sizeof(WCHAR)); /* PathLength */
+	Stream_Write(test->irp.input, path, length * sizeof(WCHAR));
+	free(path);
+	return test_irp_request(test) && test_wait() && (state.fileId != 0);
+}
+
+static BOOL test_io(DEVMAN* devman, UINT32 major, UINT32 range, BYTE value)
+{
+	const size_t size = (major == IRP_MJ_WRITE) ? TEST_BLOCK_SIZE : 0;
+	TEST_IRP* test = test_irp_new(devman, major, size);
+
+	if (!test)
+		return FALSE;
+
+	test->length = TEST_BLOCK_SIZE;
+	test->value = value;
+	Stream_Write_UINT32(test->irp.input, TEST_BLOCK_SIZE); /* Length */
+	Stream_Write_UINT64(test->irp.input, (UINT64) range * TEST_BLOCK_SIZE); /* Offset */
+	Stream_Zero(test->irp.input, 20); /* Padding */
+
+	if (size > 0)
+	{
+		memset(Stream_Pointer(test->irp.input), value, size);
+		Stream_Seek(test->irp.input, size);
+	}
+
+	return test_irp_request(test);
+}
+
+static BOOL test_close(DEVMAN* devman)
+{
+	TEST_IRP* test = test_irp_new(devman, IRP_MJ_CLOSE, 32);
+
+	if (!test)
+		return FALSE;
+
+	Stream_Zero(test->irp.input, 32); /* Padding */
+	return test_irp_request(test) && test_wait();
+}
+
+/**
+ * Queues writes and reads on a few ranges of one file without waiting: each
+ * read must return what the writes queued before it stored, while IRPs on
+ * other ranges may be processed next to it.
+ */
+static BOOL test_ordering(DEVMAN* devman)
+{
+	UINT32 round;
+	BYTE values[TEST_RANGES];
+
+	for (round = 0; round < TEST_RANGES; round++)
+	{
+		values[round] = 0xEE;
+
+		if (!test_io(devman, IRP_MJ_WRITE, round, values[round]))
+			return FALSE;
+	}
+
+	for (round = 0; round < TEST_ROUNDS; round++)
+	{
+		const UINT32 range = round % TEST_RANGES;
+		const BYTE first = (BYTE)(round * 2 + 1);
+		const BYTE second = (BYTE)(round * 2 + 2);
+
+		/* two writes to the same range must land in order */
+		if (!test_io(devman, IRP_MJ_WRITE, range, first) ||
+		    !test_io(devman, IRP_MJ_WRITE, range, second) ||
+		    !test_io(devman, IRP_MJ_READ, range, second))
+			return FALSE;
+
+		values[range] = second;
+
+		/* reads of the other ranges may run concurrently */
+		if (!test_io(devman, IRP_MJ_READ, (range + 1) % TEST_RANGES,
+		             values[(range + 1) % TEST_RANGES]) ||
+		    !test_io(devman, IRP_MJ_READ, (range + 1) % TEST_RANGES,
+		             values[(range + 1) % TEST_RANGES]))
+			return FALSE;
+	}
+
+	return test_wait();
+}
+
+int TestDriveOrdering(int argc, char* argv[])
+{
+	int rc = -1;
+	char name[64];
+	char* temp = NULL;
+	char* path = NULL;
+	DEVMAN devman = { 0 };
+	RDPDR_DRIVE drive = { 0 };
+	DEVICE_SERVICE_ENTRY_POINTS entry = { 0 };
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+	ZeroMemory(&state, sizeof(state));
+	state.valid = TRUE;
+	sprintf_s(name, sizeof(name), "TestDriveOrdering_%"PRIu32"", GetCurrentProcessId());
+
+	if (!(temp = GetKnownPath(KNOWN_PATH_TEMP)) || !(path = GetCombinedPath(temp, name)))
+		goto fail;
+
+	if (!PathFileExistsA(path) && !CreateDirectoryA(path, NULL))
+		goto fail;
+
+	if (!(state.done = CreateEvent(NULL, TRUE, TRUE, NULL)))
+		goto fail;
+
+	devman.id_sequence = 1;
+	drive.Type = RDPDR_DTYP_FILESYSTEM;
+	drive.Name = "test";
+	drive.Path = path;
+	entry.devman = &devman;
+	entry.RegisterDevice = test_register_device;
+	entry.device = (RDPDR_DEVICE*) &drive;
+
+	if ((drive_entry(&entry) != CHANNEL_RC_OK) || !state.device)
+		goto fail;
+
+	if (!test_create(&devman))
+		fprintf(stderr, "create failed\n");
+	else if (!test_ordering(&devman))
+		fprintf(stderr, "reads and writes out of order\n");
+	else if (!test_close(&devman))
+		fprintf(stderr, "close failed\n");
+	else
+		rc = 0;
+
+	/* waits for the workers */
+	test_wait();
+	state.device->Free(state.device);
+fail:
+
+	if (path)
+	{
+		char* file = GetCombinedPath(path, "ordering.bin");
+
+		if (file)
+			DeleteFileA(file);
+
+		free(file);
+		RemoveDirectoryA(path);
+	}
+
+	if (state.done)
+		CloseHandle(state.done);
+
+	free(path);
+	free(temp);
+	return rc;
+}
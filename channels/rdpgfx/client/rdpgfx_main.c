@@ -1667,7 +1667,13 @@ static UINT rdpgfx_on_data_received(IWTSVirtualChannelCallback*
 	BYTE* pDstData = NULL;
 	RDPGFX_CHANNEL_CALLBACK* callback = (RDPGFX_CHANNEL_CALLBACK*) pChannelCallback;
 	RDPGFX_PLUGIN* gfx = (RDPGFX_PLUGIN*) callback->plugin;
+	RdpgfxClientContext* context = (RdpgfxClientContext*) gfx->iface.pInterface;
 	UINT error = CHANNEL_RC_OK;
+
+	/* Passthrough consumers (e.g. the proxy) forward the compressed data as is */
+	if (context && context->OnDataReceived)
+		return context->OnDataReceived(context, data);
+
 	status = zgfx_decompress(gfx->zgfx, Stream_Pointer(data), Stream_GetRemainingLength(data),
 	                         &pDstData, &DstSize, 0);
 
@@ -142,6 +142,35 @@ out:
 	return error;
 }
 
+/**
+ * Function description
+ * Write data that is already compressed according to [MS-RDPEGFX]
+ * to the channel without touching it.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT rdpgfx_server_send_data(RdpgfxServerContext* context, const BYTE* data,
+                                    UINT32 length)
+{
+	ULONG written;
+
+	if (!context->priv->isOpened)
+		return ERROR_INVALID_STATE;
+
+	if (!WTSVirtualChannelWrite(context->priv->rdpgfx_channel, (PCHAR) data, length, &written))
+	{
+		WLog_ERR(TAG, "WTSVirtualChannelWrite failed!");
+		return ERROR_INTERNAL_ERROR;
+	}
+
+	if (written < length)
+	{
+		WLog_WARN(TAG, "Unexpected bytes written: %"PRIu32"/%"PRIu32"", written, length);
+	}
+
+	return CHANNEL_RC_OK;
+}
+
 /**
  * Function description
  * Create new stream for single rdpgfx packet. The new stream length
@@ -1589,6 +1618,7 @@ RdpgfxServerContext* rdpgfx_server_context_new(HANDLE vcm)
 	context->CapsConfirm = rdpgfx_send_caps_confirm_pdu;
 	context->FrameAcknowledge = NULL;
 	context->QoeFrameAcknowledge = NULL;
+	context->SendData = rdpgfx_server_send_data;
 	context->priv = priv = (RdpgfxServerPrivate*)
 	                       calloc(1, sizeof(RdpgfxServerPrivate));
 
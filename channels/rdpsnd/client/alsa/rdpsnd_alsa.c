@@ -59,6 +59,8 @@ struct rdpsnd_alsa_plugin
 
 	snd_pcm_uframes_t buffer_size;
 	snd_pcm_uframes_t period_size;
+
+	UINT64 written;
 };
 
 #define SND_PCM_CHECK(_func, _status) \
@@ -292,6 +294,7 @@ static BOOL rdpsnd_alsa_open(rdpsndDevicePlugin* device, const AUDIO_FORMAT* for
 	int mode;
 	int status;
 	rdpsndAlsaPlugin* alsa = (rdpsndAlsaPlugin*) device;
+	alsa->written = 0;
 
 	if (alsa->pcm_handle)
 		return TRUE;
@@ -438,13 +441,17 @@ static UINT rdpsnd_alsa_play(rdpsndDevicePlugin* device, const BYTE* data, size_
 
 		if (status < 0)
 		{
+			/* the pcm stays open, keep counting what was written to it */
+			const UINT64 written = alsa->written;
 			WLog_ERR(TAG,  "status: %d\n", status);
 			rdpsnd_alsa_close(device);
 			rdpsnd_alsa_open(device, NULL, alsa->latency);
+			alsa->written = written;
 			break;
 		}
 
 		offset += status * frame_size;
+		alsa->written += status * frame_size;
 	}
 
 	{
@@ -462,6 +469,27 @@ static UINT rdpsnd_alsa_play(rdpsndDevicePlugin* device, const BYTE* data, size_
 	return latency + alsa->latency;
 }
 
+static BOOL rdpsnd_alsa_get_position(rdpsndDevicePlugin* device, UINT64* position)
+{
+	UINT64 queued;
+	snd_pcm_sframes_t delay;
+	rdpsndAlsaPlugin* alsa = (rdpsndAlsaPlugin*) device;
+
+	if (!alsa || !position || !alsa->pcm_handle)
+		return FALSE;
+
+	if (snd_pcm_delay(alsa->pcm_handle, &delay) != 0)
+		return FALSE;
+
+	/* some drivers report a negative delay after an underrun */
+	if (delay < 0)
+		delay = 0;
+
+	queued = (UINT64) delay * alsa->actual_channels * alsa->aformat.wBitsPerSample / 8;
+	*position = (alsa->written > queued) ? alsa->written - queued : 0;
+	return TRUE;
+}
+
 static COMMAND_LINE_ARGUMENT_A rdpsnd_alsa_args[] =
 {
 	{ "dev", COMMAND_LINE_VALUE_REQUIRED, "<device>", NULL, NULL, -1, NULL, "device" },
@@ -540,6 +568,7 @@ UINT freerdp_rdpsnd_client_subsystem_entry(PFREERDP_RDPSND_DEVICE_ENTRY_POINTS p
 	alsa->device.GetVolume = rdpsnd_alsa_get_volume;
 	alsa->device.SetVolume = rdpsnd_alsa_set_volume;
 	alsa->device.Play = rdpsnd_alsa_play;
+	alsa->device.GetPosition = rdpsnd_alsa_get_position;
 	alsa->device.Close = rdpsnd_alsa_close;
 	alsa->device.Free = rdpsnd_alsa_free;
 	args = pEntryPoints->args;
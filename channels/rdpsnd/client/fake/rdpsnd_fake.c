@@ -29,20 +29,54 @@
 #include <winpr/crt.h>
 #include <winpr/stream.h>
 #include <winpr/cmdline.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/types.h>
 
 #include "rdpsnd_main.h"
 
+#define RDPSND_FAKE_DEFAULT_LATENCY 50
+
 typedef struct rdpsnd_fake_plugin rdpsndFakePlugin;
 
+/**
+ * The fake device consumes audio in real time and blocks in Play while its
+ * buffer is full, like a sound card would.
+ */
 struct rdpsnd_fake_plugin
 {
 	rdpsndDevicePlugin device;
+
+	UINT32 bytesPerSecond;
+	UINT64 bufferSize;
+	UINT64 written;
+	UINT64 played;
+	UINT64 lastUpdate;
 };
 
+static void rdpsnd_fake_update(rdpsndFakePlugin* fake)
+{
+	const UINT64 now = GetTickCount64();
+	fake->played += (now - fake->lastUpdate) * fake->bytesPerSecond / 1000;
+	fake->lastUpdate = now;
+
+	if (fake->played > fake->written)
+		fake->played = fake->written;
+}
+
 static BOOL rdpsnd_fake_open(rdpsndDevicePlugin* device, const AUDIO_FORMAT* format, UINT32 latency)
 {
+	rdpsndFakePlugin* fake = (rdpsndFakePlugin*) device;
+
+	if (!fake || !format)
+		return FALSE;
+
+	fake->bytesPerSecond = format->nAvgBytesPerSec;
+	fake->bufferSize = (UINT64)(latency ? latency : RDPSND_FAKE_DEFAULT_LATENCY) *
+	                   fake->bytesPerSecond / 1000;
+	fake->written = 0;
+	fake->played = 0;
+	fake->lastUpdate = GetTickCount64();
 	return TRUE;
 }
 
@@ -78,7 +112,34 @@ static BOOL rdpsnd_fake_set_format(rdpsndDevicePlugin* device, const AUDIO_FORMA
 
 static UINT rdpsnd_fake_play(rdpsndDevicePlugin* device, const BYTE* data, size_t size)
 {
-	return CHANNEL_RC_OK;
+	rdpsndFakePlugin* fake = (rdpsndFakePlugin*) device;
+
+	if (!fake || (fake->bytesPerSecond == 0))
+		return 0;
+
+	rdpsnd_fake_update(fake);
+	fake->written += size;
+
+	while (fake->written - fake->played > fake->bufferSize)
+	{
+		const UINT64 excess = fake->written - fake->played - fake->bufferSize;
+		Sleep((DWORD)(excess * 1000 / fake->bytesPerSecond) + 1);
+		rdpsnd_fake_update(fake);
+	}
+
+	return (UINT)((fake->written - fake->played) * 1000 / fake->bytesPerSecond);
+}
+
+static BOOL rdpsnd_fake_get_position(rdpsndDevicePlugin* device, UINT64* position)
+{
+	rdpsndFakePlugin* fake = (rdpsndFakePlugin*) device;
+
+	if (!fake || !position)
+		return FALSE;
+
+	rdpsnd_fake_update(fake);
+	*position = fake->played;
+	return TRUE;
 }
 
 static void rdpsnd_fake_start(rdpsndDevicePlugin* device)
@@ -150,6 +211,7 @@ UINT freerdp_rdpsnd_client_subsystem_entry(PFREERDP_RDPSND_DEVICE_ENTRY_POINTS p
 	fake->device.Start = rdpsnd_fake_start;
 	fake->device.Close = rdpsnd_fake_close;
 	fake->device.Free = rdpsnd_fake_free;
+	fake->device.GetPosition = rdpsnd_fake_get_position;
 	args = pEntryPoints->args;
 
 	if (args->argc > 1)
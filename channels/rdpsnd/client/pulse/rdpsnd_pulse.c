@@ -507,6 +507,27 @@ static UINT rdpsnd_pulse_play(rdpsndDevicePlugin* device, const BYTE* data, size
 	return latency / 1000;
 }
 
+static BOOL rdpsnd_pulse_get_position(rdpsndDevicePlugin* device, UINT64* position)
+{
+	int status;
+	pa_usec_t usec = 0;
+	rdpsndPulsePlugin* pulse = (rdpsndPulsePlugin*) device;
+
+	if (!pulse || !position || !pulse->stream)
+		return FALSE;
+
+	/* the stream is created on open, its playback time starts at zero there */
+	pa_threaded_mainloop_lock(pulse->mainloop);
+	status = pa_stream_get_time(pulse->stream, &usec);
+	pa_threaded_mainloop_unlock(pulse->mainloop);
+
+	if (status != 0)
+		return FALSE;
+
+	*position = pa_usec_to_bytes(usec, &pulse->sample_spec);
+	return TRUE;
+}
+
 static void rdpsnd_pulse_start(rdpsndDevicePlugin* device)
 {
 	rdpsndPulsePlugin* pulse = (rdpsndPulsePlugin*) device;
@@ -591,6 +612,7 @@ UINT freerdp_rdpsnd_client_subsystem_entry(PFREERDP_RDPSND_DEVICE_ENTRY_POINTS p
 	pulse->device.GetVolume = rdpsnd_pulse_get_volume;
 	pulse->device.SetVolume = rdpsnd_pulse_set_volume;
 	pulse->device.Play = rdpsnd_pulse_play;
+	pulse->device.GetPosition = rdpsnd_pulse_get_position;
 	pulse->device.Start = rdpsnd_pulse_start;
 	pulse->device.Close = rdpsnd_pulse_close;
 	pulse->device.Free = rdpsnd_pulse_free;
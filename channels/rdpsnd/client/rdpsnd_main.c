@@ -49,6 +49,7 @@
 
 #include "rdpsnd_common.h"
 #include "rdpsnd_main.h"
+#include "rdpsnd_playback.h"
 
 struct rdpsnd_plugin
 {
@@ -93,6 +94,7 @@ struct rdpsnd_plugin
 
 	/* Device plugin */
 	rdpsndDevicePlugin* device;
+	rdpsndPlayback* playback;
 	rdpContext* rdpcontext;
 
 	wQueue* queue;
@@ -350,6 +352,8 @@ static BOOL rdpsnd_ensure_device_is_open(rdpsndPlugin* rdpsnd, UINT32 wFormatNo,
 		{
 			deviceFormat.wFormatTag = WAVE_FORMAT_PCM;
 			deviceFormat.wBitsPerSample = 16;
+			deviceFormat.nBlockAlign = 2 * deviceFormat.nChannels;
+			deviceFormat.nAvgBytesPerSec = deviceFormat.nBlockAlign * deviceFormat.nSamplesPerSec;
 			deviceFormat.cbSize = 0;
 		}
 
@@ -367,6 +371,7 @@ static BOOL rdpsnd_ensure_device_is_open(rdpsndPlugin* rdpsnd, UINT32 wFormatNo,
 				return FALSE;
 		}
 
+		rdpsnd_playback_set_format(rdpsnd->playback, &deviceFormat);
 		rdpsnd->isOpen = TRUE;
 		rdpsnd->wCurrentFormatNo = wFormatNo;
 	}
@@ -436,13 +441,20 @@ static UINT rdpsnd_send_wave_confirm_pdu(rdpsndPlugin* rdpsnd,
 	return rdpsnd_virtual_channel_write(rdpsnd, pdu);
 }
 
+static UINT rdpsnd_playback_confirm(void* context, UINT16 wTimeStamp, BYTE cBlockNo)
+{
+	return rdpsnd_send_wave_confirm_pdu((rdpsndPlugin*) context, wTimeStamp, cBlockNo);
+}
+
+/**
+ * Decodes the wave and queues it for the playback thread, which sends the
+ * confirm once the block is handed to the device.
+ */
 static UINT rdpsnd_treat_wave(rdpsndPlugin* rdpsnd, wStream* s, size_t size)
 {
 	BYTE* data;
+	wStream* pcmData;
 	AUDIO_FORMAT* format;
-	DWORD end;
-	DWORD diffMS;
-	UINT latency = 0;
 
 	if (Stream_GetRemainingLength(s) < size)
 		return ERROR_BAD_LENGTH;
@@ -451,32 +463,35 @@ static UINT rdpsnd_treat_wave(rdpsndPlugin* rdpsnd, wStream* s, size_t size)
 	format = &rdpsnd->ClientFormats[rdpsnd->wCurrentFormatNo];
 	WLog_Print(rdpsnd->log, WLOG_DEBUG, "Wave: cBlockNo: %"PRIu8" wTimeStamp: %"PRIu16", size: %"PRIdz,
 	           rdpsnd->cBlockNo, rdpsnd->wTimeStamp, size);
+	pcmData = StreamPool_Take(rdpsnd->pool, 4096);
+
+	if (!pcmData)
+		return CHANNEL_RC_NO_MEMORY;
 
+	/* a detached channel queues an empty block to keep the confirms in order */
 	if (rdpsnd->device && rdpsnd->attached)
 	{
-		UINT status = CHANNEL_RC_OK;
-		wStream* pcmData = StreamPool_Take(rdpsnd->pool, 4096);
-
 		if (rdpsnd->device->FormatSupported(rdpsnd->device, format))
-			latency = IFCALLRESULT(0, rdpsnd->device->Play, rdpsnd->device, data, size);
-		else if (freerdp_dsp_decode(rdpsnd->dsp_context, format, data, size, pcmData))
 		{
-			Stream_SealLength(pcmData);
-			latency = IFCALLRESULT(0, rdpsnd->device->Play, rdpsnd->device, Stream_Buffer(pcmData),
-			                       Stream_Length(pcmData));
+			if (!Stream_EnsureRemainingCapacity(pcmData, size))
+				goto fail;
+
+			Stream_Write(pcmData, data, size);
 		}
-		else
-			status = ERROR_INTERNAL_ERROR;
+		else if (!freerdp_dsp_decode(rdpsnd->dsp_context, format, data, size, pcmData))
+			goto fail;
+	}
 
-		StreamPool_Return(rdpsnd->pool, pcmData);
+	Stream_SealLength(pcmData);
 
-		if (status != CHANNEL_RC_OK)
-			return status;
-	}
+	if (!rdpsnd_playback_push(rdpsnd->playback, pcmData, rdpsnd->wTimeStamp, rdpsnd->cBlockNo,
+	                          rdpsnd->wArrivalTime))
+		goto fail;
 
-	end = GetTickCount();
-	diffMS = end - rdpsnd->wArrivalTime + latency;
-	return rdpsnd_send_wave_confirm_pdu(rdpsnd, rdpsnd->wTimeStamp + diffMS, rdpsnd->cBlockNo);
+	return CHANNEL_RC_OK;
+fail:
+	StreamPool_Return(rdpsnd->pool, pcmData);
+	return ERROR_INTERNAL_ERROR;
 }
 
 
@@ -532,6 +547,17 @@ static void rdpsnd_recv_close_pdu(rdpsndPlugin* rdpsnd)
 {
 	if (rdpsnd->isOpen)
 	{
+		if (rdpsnd->playback)
+		{
+			RDPSND_PLAYBACK_STATS stats;
+			rdpsnd_playback_drain(rdpsnd->playback);
+			rdpsnd_playback_get_stats(rdpsnd->playback, &stats);
+			WLog_Print(rdpsnd->log, WLOG_DEBUG,
+			           "Playback: %"PRIu32" blocks, %"PRIu32" underruns, %"PRIu32" dropped, "
+			           "max latency %"PRIu32" ms", stats.blocks, stats.underruns, stats.dropped,
+			           stats.maxLatency);
+		}
+
 		WLog_Print(rdpsnd->log, WLOG_DEBUG, "Closing device");
 		IFCALL(rdpsnd->device->Close, rdpsnd->device);
 		rdpsnd->isOpen = FALSE;
@@ -892,11 +918,20 @@ static UINT rdpsnd_process_connect(rdpsndPlugin* rdpsnd)
 			return CHANNEL_RC_INITIALIZATION_ERROR;
 	}
 
+	rdpsnd->playback = rdpsnd_playback_new(rdpsnd->device, rdpsnd->pool, rdpsnd->latency,
+	                                       rdpsnd_playback_confirm, rdpsnd);
+
+	if (!rdpsnd->playback)
+		return CHANNEL_RC_NO_MEMORY;
+
 	return CHANNEL_RC_OK;
 }
 
 static void rdpsnd_process_disconnect(rdpsndPlugin* rdpsnd)
 {
+	/* pending audio is discarded, the server does not expect confirms anymore */
+	rdpsnd_playback_free(rdpsnd->playback);
+	rdpsnd->playback = NULL;
 	rdpsnd_recv_close_pdu(rdpsnd);
 }
 
@@ -0,0 +1,413 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Audio Output Virtual Channel
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+
+#include "rdpsnd_main.h"
+#include "rdpsnd_playback.h"
+
+/* cBlockNo is a BYTE, the server never has more blocks in flight */
+#define RDPSND_PLAYBACK_MAX_BLOCKS 256
+
+/* the jitter buffer holds at most this multiple of the target latency */
+#define RDPSND_PLAYBACK_LIMIT_FACTOR 4
+
+struct rdpsnd_playback_block
+{
+	wStream* pcm;
+	UINT16 wTimeStamp;
+	BYTE cBlockNo;
+	UINT32 arrivalTime;
+};
+typedef struct rdpsnd_playback_block RDPSND_PLAYBACK_BLOCK;
+
+/**
+ * The channel thread decodes incoming waves and pushes the PCM into a bounded
+ * jitter buffer. A dedicated thread feeds the device from that buffer, so a
+ * blocking backend write never stalls channel processing.
+ *
+ * Playback starts once the target latency is buffered (or the oldest block
+ * waited that long) and restarts the same way after the buffer ran dry.
+ * Wave confirms are sent when a block is handed to the device, with the
+ * time still queued in the device added from its reported position.
+ */
+struct rdpsnd_playback
+{
+	rdpsndDevicePlugin* device;
+	wStreamPool* pool;
+	pcPlaybackConfirm confirm;
+	void* context;
+
+	HANDLE thread;
+	HANDLE stopEvent;
+	HANDLE dataEvent;
+	HANDLE idleEvent;
+	CRITICAL_SECTION lock;
+
+	RDPSND_PLAYBACK_BLOCK blocks[RDPSND_PLAYBACK_MAX_BLOCKS];
+	size_t head;
+	size_t count;
+
+	UINT32 latency;
+	UINT32 bytesPerSecond;
+	size_t buffered;
+	size_t limit;
+
+	BOOL prefilling;
+	BOOL resumed;
+	BOOL draining;
+	UINT64 written;
+
+	RDPSND_PLAYBACK_STATS stats;
+};
+
+static UINT32 rdpsnd_playback_bytes_to_ms(const rdpsndPlayback* playback, UINT64 bytes)
+{
+	if (playback->bytesPerSecond == 0)
+		return 0;
+
+	return (UINT32)(bytes * 1000 / playback->bytesPerSecond);
+}
+
+/* Time the data already written to the device needs until it is audible. */
+static BOOL rdpsnd_playback_device_delay(rdpsndPlayback* playback, UINT32* delay)
+{
+	UINT64 position = 0;
+	rdpsndDevicePlugin* device = playback->device;
+
+	if (!device || !device->GetPosition || !device->GetPosition(device, &position))
+		return FALSE;
+
+	if (position > playback->written)
+		position = playback->written;
+
+	*delay = rdpsnd_playback_bytes_to_ms(playback, playback->written - position);
+	return TRUE;
+}
+
+static void rdpsnd_playback_pop(rdpsndPlayback* playback, RDPSND_PLAYBACK_BLOCK* block)
+{
+	*block = playback->blocks[playback->head];
+	playback->blocks[playback->head].pcm = NULL;
+	playback->head = (playback->head + 1) % RDPSND_PLAYBACK_MAX_BLOCKS;
+	playback->count--;
+
+	if (block->pcm)
+		playback->buffered -= Stream_Length(block->pcm);
+}
+
+static void rdpsnd_playback_confirm(rdpsndPlayback* playback, RDPSND_PLAYBACK_BLOCK* block,
+                                    UINT32 delay)
+{
+	const UINT32 latency = GetTickCount() - block->arrivalTime + delay;
+	EnterCriticalSection(&playback->lock);
+	playback->stats.blocks++;
+	playback->stats.totalLatency += latency;
+
+	if (latency > playback->stats.maxLatency)
+		playback->stats.maxLatency = latency;
+
+	LeaveCriticalSection(&playback->lock);
+	IFCALL(playback->confirm, playback->context, (UINT16)(block->wTimeStamp + latency),
+	       block->cBlockNo);
+	StreamPool_Return(playback->pool, block->pcm);
+	block->pcm = NULL;
+}
+
+/* Must be called with the lock held, returns FALSE if nothing is to be played yet. */
+static BOOL rdpsnd_playback_next(rdpsndPlayback* playback, RDPSND_PLAYBACK_BLOCK* block,
+                                 DWORD* timeout)
+{
+	*timeout = INFINITE;
+
+	if (playback->count == 0)
+	{
+		if (!playback->prefilling)
+		{
+			playback->prefilling = TRUE;
+			playback->resumed = (playback->written > 0);
+		}
+
+		ResetEvent(playback->dataEvent);
+		SetEvent(playback->idleEvent);
+		return FALSE;
+	}
+
+	if (playback->prefilling && !playback->draining)
+	{
+		UINT32 queued = 0;
+		const UINT32 waited = GetTickCount() - playback->blocks[playback->head].arrivalTime;
+
+		/* audio still queued in the device counts towards the target */
+		if (playback->resumed)
+			rdpsnd_playback_device_delay(playback, &queued);
+
+		queued += rdpsnd_playback_bytes_to_ms(playback, playback->buffered);
+
+		if ((queued < playback->latency) && (waited < playback->latency))
+		{
+			*timeout = playback->latency - MAX(queued, waited);
+			ResetEvent(playback->dataEvent);
+			return FALSE;
+		}
+	}
+
+	playback->prefilling = FALSE;
+	rdpsnd_playback_pop(playback, block);
+	return TRUE;
+}
+
+static void rdpsnd_playback_play(rdpsndPlayback* playback, RDPSND_PLAYBACK_BLOCK* block,
+                                 BOOL resumed)
+{
+	UINT32 delay = 0;
+	rdpsndDevicePlugin* device = playback->device;
+	const size_t size = block->pcm ? Stream_Length(block->pcm) : 0;
+
+	if (device && (size > 0))
+	{
+		if (resumed)
+		{
+			UINT32 queued = 0;
+
+			/* without a position assume the device ran dry with the buffer */
+			if (!rdpsnd_playback_device_delay(playback, &queued) || (queued == 0))
+			{
+				EnterCriticalSection(&playback->lock);
+				playback->stats.underruns++;
+				LeaveCriticalSection(&playback->lock);
+			}
+		}
+
+		delay = IFCALLRESULT(0, device->Play, device, Stream_Buffer(block->pcm), size);
+		playback->written += size;
+		rdpsnd_playback_device_delay(playback, &delay);
+	}
+
+	rdpsnd_playback_confirm(playback, block, delay);
+}
+
+static DWORD WINAPI rdpsnd_playback_thread(LPVOID arg)
+{
+	DWORD timeout = INFINITE;
+	rdpsndPlayback* playback = (rdpsndPlayback*) arg;
+	HANDLE events[2];
+	events[0] = playback->stopEvent;
+	events[1] = playback->dataEvent;
+
+	while (TRUE)
+	{
+		BOOL resumed;
+		RDPSND_PLAYBACK_BLOCK block;
+		const DWORD status = WaitForMultipleObjects(ARRAYSIZE(events), events, FALSE, timeout);
+
+		if ((status != WAIT_OBJECT_0 + 1) && (status != WAIT_TIMEOUT))
+			break;
+
+		EnterCriticalSection(&playback->lock);
+
+		if (!rdpsnd_playback_next(playback, &block, &timeout))
+		{
+			LeaveCriticalSection(&playback->lock);
+			continue;
+		}
+
+		resumed = playback->resumed;
+		playback->resumed = FALSE;
+		LeaveCriticalSection(&playback->lock);
+		rdpsnd_playback_play(playback, &block, resumed);
+	}
+
+	ExitThread(0);
+	return 0;
+}
+
+/**
+ * Updates the byte rate of the device format, called after the device was (re)opened.
+ */
+void rdpsnd_playback_set_format(rdpsndPlayback* playback, const AUDIO_FORMAT* format)
+{
+	if (!playback || !format)
+		return;
+
+	EnterCriticalSection(&playback->lock);
+	playback->bytesPerSecond = format->nAvgBytesPerSec;
+	playback->limit = (size_t) playback->latency * RDPSND_PLAYBACK_LIMIT_FACTOR *
+	                  playback->bytesPerSecond / 1000;
+	playback->written = 0;
+	playback->prefilling = TRUE;
+	playback->resumed = FALSE;
+	LeaveCriticalSection(&playback->lock);
+}
+
+/**
+ * Queues a block for playback, on success the stream is returned to the pool once played.
+ * If the jitter buffer is full the oldest blocks are dropped (and confirmed).
+ */
+BOOL rdpsnd_playback_push(rdpsndPlayback* playback, wStream* pcm, UINT16 wTimeStamp,
+                          BYTE cBlockNo, UINT32 arrivalTime)
+{
+	size_t index;
+	RDPSND_PLAYBACK_BLOCK* block;
+	const size_t size = pcm ? Stream_Length(pcm) : 0;
+
+	if (!playback)
+		return FALSE;
+
+	EnterCriticalSection(&playback->lock);
+
+	while ((playback->count == RDPSND_PLAYBACK_MAX_BLOCKS) ||
+	       ((playback->count > 0) && (playback->limit > 0) &&
+	        (playback->buffered + size > playback->limit)))
+	{
+		RDPSND_PLAYBACK_BLOCK dropped;
+		rdpsnd_playback_pop(playback, &dropped);
+		playback->stats.dropped++;
+		LeaveCriticalSection(&playback->lock);
+		rdpsnd_playback_confirm(playback, &dropped, 0);
+		EnterCriticalSection(&playback->lock);
+	}
+
+	index = (playback->head + playback->count) % RDPSND_PLAYBACK_MAX_BLOCKS;
+	block = &playback->blocks[index];
+	block->pcm = pcm;
+	block->wTimeStamp = wTimeStamp;
+	block->cBlockNo = cBlockNo;
+	block->arrivalTime = arrivalTime;
+	playback->count++;
+	playback->buffered += size;
+	ResetEvent(playback->idleEvent);
+	SetEvent(playback->dataEvent);
+	LeaveCriticalSection(&playback->lock);
+	return TRUE;
+}
+
+/**
+ * Blocks until all queued audio was handed to the device, used before the
+ * device is closed or reopened with a different format.
+ */
+BOOL rdpsnd_playback_drain(rdpsndPlayback* playback)
+{
+	DWORD status;
+
+	if (!playback)
+		return FALSE;
+
+	EnterCriticalSection(&playback->lock);
+	playback->draining = TRUE;
+
+	if (playback->count > 0)
+		SetEvent(playback->dataEvent);
+
+	LeaveCriticalSection(&playback->lock);
+	status = WaitForSingleObject(playback->idleEvent, INFINITE);
+	EnterCriticalSection(&playback->lock);
+	playback->draining = FALSE;
+	LeaveCriticalSection(&playback->lock);
+	return status == WAIT_OBJECT_0;
+}
+
+void rdpsnd_playback_get_stats(rdpsndPlayback* playback, RDPSND_PLAYBACK_STATS* stats)
+{
+	if (!playback || !stats)
+		return;
+
+	EnterCriticalSection(&playback->lock);
+	*stats = playback->stats;
+	LeaveCriticalSection(&playback->lock);
+}
+
+rdpsndPlayback* rdpsnd_playback_new(rdpsndDevicePlugin* device, wStreamPool* pool,
+                                    UINT32 latency, pcPlaybackConfirm confirm, void* context)
+{
+	rdpsndPlayback* playback = (rdpsndPlayback*) calloc(1, sizeof(rdpsndPlayback));
+
+	if (!playback)
+		return NULL;
+
+	playback->device = device;
+	playback->pool = pool;
+	playback->confirm = confirm;
+	playback->context = context;
+	playback->latency = latency ? latency : RDPSND_PLAYBACK_DEFAULT_LATENCY;
+	playback->prefilling = TRUE;
+
+	if (!InitializeCriticalSectionAndSpinCount(&playback->lock, 4000))
+	{
+		free(playback);
+		return NULL;
+	}
+
+	if (!(playback->stopEvent = CreateEventA(NULL, TRUE, FALSE, NULL)))
+		goto fail;
+
+	if (!(playback->dataEvent = CreateEventA(NULL, TRUE, FALSE, NULL)))
+		goto fail;
+
+	if (!(playback->idleEvent = CreateEventA(NULL, TRUE, TRUE, NULL)))
+		goto fail;
+
+	if (!(playback->thread = CreateThread(NULL, 0, rdpsnd_playback_thread, playback, 0, NULL)))
+		goto fail;
+
+	return playback;
+fail:
+	rdpsnd_playback_free(playback);
+	return NULL;
+}
+
+/**
+ * Stops the playback thread, audio still queued is discarded without confirm.
+ */
+void rdpsnd_playback_free(rdpsndPlayback* playback)
+{
+	if (!playback)
+		return;
+
+	if (playback->thread)
+	{
+		SetEvent(playback->stopEvent);
+		WaitForSingleObject(playback->thread, INFINITE);
+		CloseHandle(playback->thread);
+	}
+
+	while (playback->count > 0)
+	{
+		RDPSND_PLAYBACK_BLOCK block;
+		rdpsnd_playback_pop(playback, &block);
+		StreamPool_Return(playback->pool, block.pcm);
+	}
+
+	if (playback->stopEvent)
+		CloseHandle(playback->stopEvent);
+
+	if (playback->dataEvent)
+		CloseHandle(playback->dataEvent);
+
+	if (playback->idleEvent)
+		CloseHandle(playback->idleEvent);
+
+	DeleteCriticalSection(&playback->lock);
+	free(playback);
+}
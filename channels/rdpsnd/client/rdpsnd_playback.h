@@ -0,0 +1,64 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Audio Output Virtual Channel
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CHANNEL_RDPSND_CLIENT_PLAYBACK_H
+#define FREERDP_CHANNEL_RDPSND_CLIENT_PLAYBACK_H
+
+#include <winpr/stream.h>
+
+#include <freerdp/api.h>
+#include <freerdp/client/rdpsnd.h>
+
+#define RDPSND_PLAYBACK_DEFAULT_LATENCY 40
+
+typedef struct rdpsnd_playback rdpsndPlayback;
+
+/* Called once a block was handed to the device (or dropped), in block order.
+ * wTimeStamp already includes the time until the block becomes audible. */
+typedef UINT (*pcPlaybackConfirm)(void* context, UINT16 wTimeStamp, BYTE cBlockNo);
+
+struct rdpsnd_playback_stats
+{
+	UINT32 blocks;
+	UINT32 underruns;
+	UINT32 dropped;
+	UINT32 maxLatency;
+	UINT64 totalLatency;
+};
+typedef struct rdpsnd_playback_stats RDPSND_PLAYBACK_STATS;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FREERDP_LOCAL rdpsndPlayback* rdpsnd_playback_new(rdpsndDevicePlugin* device, wStreamPool* pool,
+        UINT32 latency, pcPlaybackConfirm confirm, void* context);
+FREERDP_LOCAL void rdpsnd_playback_free(rdpsndPlayback* playback);
+
+FREERDP_LOCAL void rdpsnd_playback_set_format(rdpsndPlayback* playback,
+        const AUDIO_FORMAT* format);
+FREERDP_LOCAL BOOL rdpsnd_playback_push(rdpsndPlayback* playback, wStream* pcm,
+                                        UINT16 wTimeStamp, BYTE cBlockNo, UINT32 arrivalTime);
+FREERDP_LOCAL BOOL rdpsnd_playback_drain(rdpsndPlayback* playback);
+FREERDP_LOCAL void rdpsnd_playback_get_stats(rdpsndPlayback* playback,
+        RDPSND_PLAYBACK_STATS* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_CHANNEL_RDPSND_CLIENT_PLAYBACK_H */
@@ -0,0 +1,249 @@
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/client/rdpsnd.h>
+
+#include "rdpsnd_playback.h"
+
+#ifdef BUILTIN_CHANNELS
+#define rdpsnd_fake_entry fake_freerdp_rdpsnd_client_subsystem_entry
+#else
+#define rdpsnd_fake_entry freerdp_rdpsnd_client_subsystem_entry
+#endif
+
+UINT rdpsnd_fake_entry(PFREERDP_RDPSND_DEVICE_ENTRY_POINTS pEntryPoints);
+
+#define TEST_LATENCY 40
+#define TEST_BLOCK_MS 20
+#define TEST_MAX_BLOCKS 256
+
+struct test_context
+{
+	CRITICAL_SECTION lock;
+	UINT32 count;
+	UINT32 confirmed[TEST_MAX_BLOCKS];
+	UINT32 sent[TEST_MAX_BLOCKS];
+	UINT16 timestamps[TEST_MAX_BLOCKS];
+	BOOL latencyOk;
+};
+
+static rdpsndDevicePlugin* test_device = NULL;
+
+static void test_register_device(rdpsndPlugin* rdpsnd, rdpsndDevicePlugin* device)
+{
+	WINPR_UNUSED(rdpsnd);
+	test_device = device;
+}
+
+static UINT test_confirm(void* context, UINT16 wTimeStamp, BYTE cBlockNo)
+{
+	struct test_context* test = (struct test_context*) context;
+	const UINT32 tick = GetTickCount();
+	const UINT16 latency = wTimeStamp - test->timestamps[cBlockNo];
+	const UINT16 elapsed = (UINT16)(tick - test->sent[cBlockNo]);
+	EnterCriticalSection(&test->lock);
+
+	/* the confirm must include at least the time the block already waited */
+	if (latency < elapsed)
+	{
+		printf("block %"PRIu8" confirmed with %"PRIu16" ms, but waited %"PRIu16" ms\n",
+		       cBlockNo, latency, elapsed);
+		test->latencyOk = FALSE;
+	}
+
+	test->confirmed[cBlockNo]++;
+	test->count++;
+	LeaveCriticalSection(&test->lock);
+	return CHANNEL_RC_OK;
+}
+
+static BOOL test_push(rdpsndPlayback* playback, wStreamPool* pool, struct test_context* test,
+                      BYTE cBlockNo, size_t size)
+{
+	wStream* s = StreamPool_Take(pool, size);
+
+	if (!s)
+		return FALSE;
+
+	ZeroMemory(Stream_Buffer(s), size);
+	Stream_Seek(s, size);
+	Stream_SealLength(s);
+	EnterCriticalSection(&test->lock);
+	test->timestamps[cBlockNo] = (UINT16)(cBlockNo * 7);
+	test->sent[cBlockNo] = GetTickCount();
+	LeaveCriticalSection(&test->lock);
+
+	if (!rdpsnd_playback_push(playback, s, test->timestamps[cBlockNo], cBlockNo,
+	                          test->sent[cBlockNo]))
+	{
+		StreamPool_Return(pool, s);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Sends blocks at real time pace, delivery is delayed by up to 15 ms of jitter. */
+static BOOL test_stream(rdpsndPlayback* playback, wStreamPool* pool, struct test_context* test,
+                        BYTE first, UINT32 count, size_t size)
+{
+	UINT32 i;
+	const UINT32 jitter[] = { 0, 15, 5, 10, 0, 12 };
+	const UINT64 start = GetTickCount64();
+
+	for (i = 0; i < count; i++)
+	{
+		const UINT64 due = start + i * TEST_BLOCK_MS + jitter[i % ARRAYSIZE(jitter)];
+		const UINT64 now = GetTickCount64();
+
+		if (due > now)
+			Sleep((DWORD)(due - now));
+
+		if (!test_push(playback, pool, test, (BYTE)(first + i), size))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void test_print_stats(const char* name, rdpsndPlayback* playback)
+{
+	RDPSND_PLAYBACK_STATS stats;
+	rdpsnd_playback_get_stats(playback, &stats);
+	printf("%s: %"PRIu32" blocks, %"PRIu32" underruns, %"PRIu32" dropped, "
+	       "latency avg %"PRIu64" ms max %"PRIu32" ms\n", name, stats.blocks, stats.underruns,
+	       stats.dropped, stats.blocks ? stats.totalLatency / stats.blocks : 0, stats.maxLatency);
+}
+
+int TestRdpsndPlayback(int argc, char* argv[])
+{
+	int rc = -1;
+	UINT32 i;
+	size_t blockSize;
+	AUDIO_FORMAT format = { 0 };
+	ADDIN_ARGV args = { 0 };
+	RDPSND_PLAYBACK_STATS stats;
+	FREERDP_RDPSND_DEVICE_ENTRY_POINTS entryPoints = { 0 };
+	struct test_context test = { 0 };
+	wStreamPool* pool = NULL;
+	rdpsndPlayback* playback = NULL;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+	InitializeCriticalSection(&test.lock);
+	test.latencyOk = TRUE;
+	entryPoints.pRegisterRdpsndDevice = test_register_device;
+	entryPoints.args = &args;
+
+	if ((rdpsnd_fake_entry(&entryPoints) != CHANNEL_RC_OK) || !test_device)
+	{
+		printf("failed to load the fake backend\n");
+		goto fail;
+	}
+
+	format.wFormatTag = WAVE_FORMAT_PCM;
+	format.nChannels = 2;
+	format.nSamplesPerSec = 44100;
+	format.wBitsPerSample = 16;
+	format.nBlockAlign = 4;
+	format.nAvgBytesPerSec = format.nSamplesPerSec * format.nBlockAlign;
+	blockSize = format.nAvgBytesPerSec * TEST_BLOCK_MS / 1000;
+
+	if (!(pool = StreamPool_New(TRUE, 4096)))
+		goto fail;
+
+	if (!test_device->Open(test_device, &format, 0))
+		goto fail;
+
+	if (!(playback = rdpsnd_playback_new(test_device, pool, TEST_LATENCY, test_confirm, &test)))
+		goto fail;
+
+	rdpsnd_playback_set_format(playback, &format);
+
+	/* jitter below the target latency must not starve the device */
+	if (!test_stream(playback, pool, &test, 0, 50, blockSize) || !rdpsnd_playback_drain(playback))
+		goto fail;
+
+	test_print_stats("jitter", playback);
+	rdpsnd_playback_get_stats(playback, &stats);
+
+	/* allow for a scheduler hiccup on loaded machines */
+	if ((stats.blocks != 50) || (stats.underruns > 1) || (stats.dropped != 0))
+	{
+		printf("unexpected underruns or drops with jitter below the target latency\n");
+		goto fail;
+	}
+
+	if (stats.totalLatency / stats.blocks > TEST_LATENCY + 100)
+	{
+		printf("end-to-end latency too high\n");
+		goto fail;
+	}
+
+	/* a gap longer than everything buffered is an underrun */
+	Sleep(200);
+
+	if (!test_stream(playback, pool, &test, 50, 10, blockSize) || !rdpsnd_playback_drain(playback))
+		goto fail;
+
+	test_print_stats("gap", playback);
+	rdpsnd_playback_get_stats(playback, &stats);
+
+	if (stats.underruns < 1)
+	{
+		printf("gap was not counted as underrun\n");
+		goto fail;
+	}
+
+	/* a burst beyond the jitter buffer bound drops the oldest blocks */
+	for (i = 60; i < 100; i++)
+	{
+		if (!test_push(playback, pool, &test, (BYTE) i, blockSize))
+			goto fail;
+	}
+
+	if (!rdpsnd_playback_drain(playback))
+		goto fail;
+
+	test_print_stats("burst", playback);
+	rdpsnd_playback_get_stats(playback, &stats);
+
+	if ((stats.dropped == 0) || (stats.blocks != 100))
+	{
+		printf("burst was not bounded\n");
+		goto fail;
+	}
+
+	for (i = 0; i < 100; i++)
+	{
+		if (test.confirmed[i] != 1)
+		{
+			printf("block %"PRIu32" confirmed %"PRIu32" times\n", i, test.confirmed[i]);
+			goto fail;
+		}
+	}
+
+	if (!test.latencyOk)
+		goto fail;
+
+	rc = 0;
+fail:
+	rdpsnd_playback_free(playback);
+
+	if (test_device)
+	{
+		IFCALL(test_device->Close, test_device);
+		IFCALL(test_device->Free, test_device);
+	}
+
+	StreamPool_Free(pool);
+	DeleteCriticalSection(&test.lock);
+	return rc;
+}
@@ -915,6 +915,125 @@ static BOOL xf_gdi_polygon_cb(rdpContext* context,
 	return ret;
 }
 
+/**
+ * Draws the ellipse inscribed in the inclusive bounds with the current GC,
+ * filled when fillMode is set and as an outline otherwise.
+ */
+static BOOL xf_gdi_draw_ellipse(xfContext* xfc, INT32 leftRect, INT32 topRect,
+                                INT32 rightRect, INT32 bottomRect, UINT32 fillMode)
+{
+	const INT32 left = MIN(leftRect, rightRect);
+	const INT32 top = MIN(topRect, bottomRect);
+	const INT32 width = MAX(leftRect, rightRect) - left;
+	const INT32 height = MAX(topRect, bottomRect) - top;
+
+	if (fillMode)
+		XFillArc(xfc->display, xfc->drawing, xfc->gc, left, top, (unsigned int) width + 1,
+		         (unsigned int) height + 1, 0, 360 * 64);
+	else
+		XDrawArc(xfc->display, xfc->drawing, xfc->gc, left, top, (unsigned int) width,
+		         (unsigned int) height, 0, 360 * 64);
+
+	if (xfc->drawing != xfc->primary)
+		return TRUE;
+
+	return gdi_InvalidateRegion(xfc->hdc, left, top, width + 1, height + 1);
+}
+
+static BOOL xf_gdi_ellipse_sc(rdpContext* context, const ELLIPSE_SC_ORDER* ellipse_sc)
+{
+	XColor color;
+	BOOL ret;
+	xfContext* xfc = (xfContext*) context;
+
+	if (!xf_decode_color(xfc, ellipse_sc->color, &color))
+		return FALSE;
+
+	xf_lock_x11(xfc, FALSE);
+	xf_set_rop2(xfc, ellipse_sc->bRop2);
+	XSetFillStyle(xfc->display, xfc->gc, FillSolid);
+	XSetForeground(xfc->display, xfc->gc, color.pixel);
+	ret = xf_gdi_draw_ellipse(xfc, ellipse_sc->leftRect, ellipse_sc->topRect,
+	                          ellipse_sc->rightRect, ellipse_sc->bottomRect, ellipse_sc->fillMode);
+	XSetFunction(xfc->display, xfc->gc, GXcopy);
+	xf_unlock_x11(xfc, FALSE);
+	return ret;
+}
+
+static BOOL xf_gdi_ellipse_cb(rdpContext* context, const ELLIPSE_CB_ORDER* ellipse_cb)
+{
+	XColor foreColor;
+	XColor backColor;
+	Pixmap pattern = 0;
+	BOOL ret = FALSE;
+	const rdpBrush* brush = &ellipse_cb->brush;
+	xfContext* xfc = (xfContext*) context;
+
+	if (!xf_decode_color(xfc, ellipse_cb->foreColor, &foreColor))
+		return FALSE;
+
+	if (!xf_decode_color(xfc, ellipse_cb->backColor, &backColor))
+		return FALSE;
+
+	xf_lock_x11(xfc, FALSE);
+	xf_set_rop2(xfc, ellipse_cb->bRop2);
+	XSetForeground(xfc->display, xfc->gc, foreColor.pixel);
+	XSetBackground(xfc->display, xfc->gc, backColor.pixel);
+
+	/* the outline is drawn with a solid pen of the foreground color */
+	if (!ellipse_cb->fillMode || (brush->style == GDI_BS_SOLID))
+		XSetFillStyle(xfc->display, xfc->gc, FillSolid);
+	else if (brush->style == GDI_BS_HATCHED)
+	{
+		pattern = xf_mono_bitmap_new(xfc, 8, 8, &GDI_BS_HATCHED_PATTERNS[8 * brush->hatch]);
+		XSetFillStyle(xfc->display, xfc->gc, FillOpaqueStippled);
+		XSetStipple(xfc->display, xfc->gc, pattern);
+	}
+	else if ((brush->style == GDI_BS_PATTERN) && (brush->bpp > 1))
+	{
+		UINT32 bpp = brush->bpp;
+
+		if ((bpp == 16) && (context->settings->ColorDepth == 15))
+			bpp = 15;
+
+		pattern = xf_brush_new(xfc, 8, 8, bpp, brush->data);
+		XSetFillStyle(xfc->display, xfc->gc, FillTiled);
+		XSetTile(xfc->display, xfc->gc, pattern);
+	}
+	else if (brush->style == GDI_BS_PATTERN)
+	{
+		pattern = xf_mono_bitmap_new(xfc, 8, 8, brush->data);
+		XSetForeground(xfc->display, xfc->gc, backColor.pixel);
+		XSetBackground(xfc->display, xfc->gc, foreColor.pixel);
+		XSetFillStyle(xfc->display, xfc->gc, FillOpaqueStippled);
+		XSetStipple(xfc->display, xfc->gc, pattern);
+	}
+	else
+	{
+		WLog_ERR(TAG, "EllipseCB unimplemented brush style:%"PRIu32"", brush->style);
+		goto fail;
+	}
+
+	XSetTSOrigin(xfc->display, xfc->gc, brush->x, brush->y);
+	ret = xf_gdi_draw_ellipse(xfc, ellipse_cb->leftRect, ellipse_cb->topRect,
+	                          ellipse_cb->rightRect, ellipse_cb->bottomRect, ellipse_cb->fillMode);
+	XSetFillStyle(xfc->display, xfc->gc, FillSolid);
+	XSetTSOrigin(xfc->display, xfc->gc, 0, 0);
+
+	if (pattern)
+	{
+		if (brush->bpp > 1)
+			XSetTile(xfc->display, xfc->gc, xfc->primary);
+
+		XFreePixmap(xfc->display, pattern);
+	}
+
+fail:
+	XSetFunction(xfc->display, xfc->gc, GXcopy);
+	xf_unlock_x11(xfc, FALSE);
+	return ret;
+}
+
 static BOOL xf_gdi_surface_frame_marker(rdpContext* context,
                                         const SURFACE_FRAME_MARKER* surface_frame_marker)
 {
@@ -1125,6 +1244,8 @@ void xf_gdi_register_update_callbacks(rdpUpdate* update)
 	primary->Mem3Blt = xf_gdi_mem3blt;
 	primary->PolygonSC = xf_gdi_polygon_sc;
 	primary->PolygonCB = xf_gdi_polygon_cb;
+	primary->EllipseSC = xf_gdi_ellipse_sc;
+	primary->EllipseCB = xf_gdi_ellipse_cb;
 	update->SurfaceBits = xf_gdi_surface_bits;
 	update->SurfaceFrameMarker = xf_gdi_surface_frame_marker;
 }
@@ -2741,6 +2741,26 @@ int freerdp_client_settings_parse_command_line_arguments(rdpSettings* settings,
 		{
 			settings->BitmapCacheEnabled = enable;
 		}
+		CommandLineSwitchCase(arg, "persist-cache")
+		{
+			UINT32 i;
+			settings->BitmapCachePersistEnabled = enable;
+
+			for (i = 0; i < settings->BitmapCacheV2NumCells; i++)
+				settings->BitmapCacheV2CellInfo[i].persistent = enable;
+		}
+		CommandLineSwitchCase(arg, "persist-cache-file")
+		{
+			UINT32 i;
+
+			if (!copy_value(arg->Value, &settings->BitmapCachePersistFile))
+				return COMMAND_LINE_ERROR_MEMORY;
+
+			settings->BitmapCachePersistEnabled = TRUE;
+
+			for (i = 0; i < settings->BitmapCacheV2NumCells; i++)
+				settings->BitmapCacheV2CellInfo[i].persistent = TRUE;
+		}
 		CommandLineSwitchCase(arg, "offscreen-cache")
 		{
 			settings->OffscreenSupportLevel = (UINT32)enable;
@@ -31,11 +31,13 @@ typedef struct _BITMAP_V2_CELL BITMAP_V2_CELL;
 typedef struct rdp_bitmap_cache rdpBitmapCache;
 
 #include <freerdp/cache/cache.h>
+#include <freerdp/cache/persistent.h>
 
 struct _BITMAP_V2_CELL
 {
 	UINT32 number;
 	rdpBitmap** entries;
+	UINT64* keys; /* persistent cells only */
 };
 
 struct rdp_bitmap_cache
@@ -56,6 +58,10 @@ struct rdp_bitmap_cache
 	rdpUpdate* update;
 	rdpContext* context;
 	rdpSettings* settings;
+
+	rdpPersistentCache* persistent;
+	BOOL persistentLoaded;
+	BYTE* persistentBuffer;
 };
 
 #ifdef __cplusplus
@@ -0,0 +1,72 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Persistent Bitmap Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_PERSISTENT_CACHE_H
+#define FREERDP_PERSISTENT_CACHE_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+
+/**
+ * The cache file uses the .bmc (bitmap cache v2) record layout: every slot
+ * holds a 20 byte header followed by room for a 64x64 32bpp bitmap.
+ */
+#define PERSIST_CACHE_ENTRY_HEADER_SIZE		20
+#define PERSIST_CACHE_ENTRY_MAX_WIDTH		64
+#define PERSIST_CACHE_ENTRY_MAX_HEIGHT		64
+#define PERSIST_CACHE_ENTRY_DATA_SIZE		(PERSIST_CACHE_ENTRY_MAX_WIDTH * \
+        PERSIST_CACHE_ENTRY_MAX_HEIGHT * 4)
+#define PERSIST_CACHE_ENTRY_SIZE		(PERSIST_CACHE_ENTRY_HEADER_SIZE + \
+        PERSIST_CACHE_ENTRY_DATA_SIZE)
+
+typedef struct rdp_persistent_cache rdpPersistentCache;
+
+struct _PERSISTENT_CACHE_ENTRY
+{
+	UINT64 key64;
+	UINT16 width;
+	UINT16 height;
+	UINT32 size;
+	UINT32 flags;
+	BYTE* data;
+};
+typedef struct _PERSISTENT_CACHE_ENTRY PERSISTENT_CACHE_ENTRY;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FREERDP_API BOOL persistent_cache_open(rdpPersistentCache* persistent, const char* filename,
+                                       UINT32 count);
+FREERDP_API void persistent_cache_close(rdpPersistentCache* persistent);
+
+FREERDP_API UINT32 persistent_cache_get_count(rdpPersistentCache* persistent);
+
+FREERDP_API BOOL persistent_cache_read_entry(rdpPersistentCache* persistent, UINT32 index,
+        PERSISTENT_CACHE_ENTRY* entry);
+FREERDP_API BOOL persistent_cache_write_entry(rdpPersistentCache* persistent, UINT32 index,
+        const PERSISTENT_CACHE_ENTRY* entry);
+FREERDP_API BOOL persistent_cache_clear_entry(rdpPersistentCache* persistent, UINT32 index);
+
+FREERDP_API rdpPersistentCache* persistent_cache_new(void);
+FREERDP_API void persistent_cache_free(rdpPersistentCache* persistent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_PERSISTENT_CACHE_H */
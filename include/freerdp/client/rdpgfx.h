@@ -94,6 +94,7 @@ typedef UINT(*pcRdpgfxFrameAcknowledge)(RdpgfxClientContext* context,
                                         const RDPGFX_FRAME_ACKNOWLEDGE_PDU* frameAcknowledge);
 typedef UINT(*pcRdpgfxQoeFrameAcknowledge)(RdpgfxClientContext* context,
                                         const RDPGFX_QOE_FRAME_ACKNOWLEDGE_PDU* qoeFrameAcknowledge);
+typedef UINT(*pcRdpgfxOnDataReceived)(RdpgfxClientContext* context, wStream* s);
 
 typedef UINT(*pcRdpgfxMapWindowForSurface)(RdpgfxClientContext* context, UINT16 surfaceID,
         UINT64 windowID);
@@ -137,6 +138,9 @@ struct _rdpgfx_client_context
 	pcRdpgfxCapsConfirm CapsConfirm;
 	pcRdpgfxFrameAcknowledge FrameAcknowledge;
 	pcRdpgfxQoeFrameAcknowledge QoeFrameAcknowledge;
+	/* If set, receives the still ZGFX compressed channel data instead of
+	 * the plugin decompressing and parsing it. */
+	pcRdpgfxOnDataReceived OnDataReceived;
 
 	/* No locking required */
 	pcRdpgfxUpdateSurfaces UpdateSurfaces;
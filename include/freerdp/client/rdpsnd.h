@@ -38,6 +38,7 @@ typedef UINT (*pcPlay)(rdpsndDevicePlugin* device, const BYTE* data, size_t size
 typedef void (*pcStart)(rdpsndDevicePlugin* device);
 typedef void (*pcClose)(rdpsndDevicePlugin* device);
 typedef void (*pcFree)(rdpsndDevicePlugin* device);
+typedef BOOL (*pcGetPosition)(rdpsndDevicePlugin* device, UINT64* position);
 
 struct rdpsnd_device_plugin
 {
@@ -51,6 +52,9 @@ struct rdpsnd_device_plugin
 	pcStart Start;
 	pcClose Close;
 	pcFree Free;
+
+	/* optional: number of bytes the device has played since it was opened */
+	pcGetPosition GetPosition;
 };
 
 #define RDPSND_DEVICE_EXPORT_FUNC_NAME "freerdp_rdpsnd_client_subsystem_entry"
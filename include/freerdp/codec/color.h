@@ -915,6 +915,34 @@ FREERDP_API BOOL freerdp_image_scale(BYTE* pDstData, DWORD DstFormat,
                                      UINT32 nSrcStep, UINT32 nXSrc, UINT32 nYSrc,
                                      UINT32 nSrcWidth, UINT32 nSrcHeight);
 
+typedef struct _FREERDP_IMAGE_SCALER FREERDP_IMAGE_SCALER;
+
+/***
+ *
+ * A scaler keeps the filter state for its last source and destination size
+ * and format, so scaling frames of the same size over and over again only
+ * builds it once. freerdp_image_scale uses a small internal set of scalers,
+ * callers with their own scaler avoid sharing it with other threads.
+ *
+ * A scaler must not be used by more than one thread at a time.
+ */
+FREERDP_API FREERDP_IMAGE_SCALER* freerdp_image_scaler_new(void);
+FREERDP_API void freerdp_image_scaler_free(FREERDP_IMAGE_SCALER* scaler);
+
+/***
+ *
+ * Same as freerdp_image_scale with an explicit scaler.
+ *
+ * @return          TRUE if success, FALSE otherwise
+ */
+FREERDP_API BOOL freerdp_image_scaler_scale(FREERDP_IMAGE_SCALER* scaler,
+        BYTE* pDstData, DWORD DstFormat,
+        UINT32 nDstStep, UINT32 nXDst, UINT32 nYDst,
+        UINT32 nDstWidth, UINT32 nDstHeight,
+        const BYTE* pSrcData, DWORD SrcFormat,
+        UINT32 nSrcStep, UINT32 nXSrc, UINT32 nYSrc,
+        UINT32 nSrcWidth, UINT32 nSrcHeight);
+
 /***
  *
  * @param pDstData  destionation buffer
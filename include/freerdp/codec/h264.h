@@ -54,6 +54,36 @@ enum _H264_RATECONTROL_MODE
 };
 typedef enum _H264_RATECONTROL_MODE H264_RATECONTROL_MODE;
 
+/**
+ * Adaptive rate control, see h264_context_enable_rate_control.
+ * The limits may be set by the caller, zero values are filled in from
+ * the context settings when the controller is enabled.
+ */
+struct _H264_RATECONTROL
+{
+	BOOL Enabled;
+
+	/* Limits */
+	UINT32 MinBitRate;
+	UINT32 MaxBitRate;
+	FLOAT MinFrameRate;
+	FLOAT MaxFrameRate;
+	UINT32 MinQP;
+	UINT32 MaxQP;
+
+	/* Network feedback */
+	UINT32 Bandwidth; /* kbit/s, 0 if not measured */
+	UINT32 RTT; /* ms, 0 if not measured */
+	UINT32 BaseRTT; /* lowest RTT seen */
+	UINT32 QueueDepth; /* frames sent but not acknowledged */
+
+	/* Controller state */
+	UINT32 TargetBitRate;
+	INT64 Buffer; /* bits sent beyond the budget */
+	double Complexity; /* encoded size relative to the QP model */
+};
+typedef struct _H264_RATECONTROL H264_RATECONTROL;
+
 struct _H264_CONTEXT
 {
 	BOOL Compressor;
@@ -80,6 +110,8 @@ struct _H264_CONTEXT
 
 	void* lumaData;
 	wLog* log;
+
+	H264_RATECONTROL RateControl;
 };
 #ifdef __cplusplus
 extern "C" {
@@ -113,6 +145,11 @@ FREERDP_API INT32 avc444_decompress(H264_CONTEXT* h264, BYTE op,
 
 FREERDP_API BOOL h264_context_reset(H264_CONTEXT* h264, UINT32 width, UINT32 height);
 
+FREERDP_API BOOL h264_context_enable_rate_control(H264_CONTEXT* h264, BOOL enable);
+FREERDP_API BOOL h264_context_update_network(H264_CONTEXT* h264, UINT32 bandwidth, UINT32 rtt);
+FREERDP_API BOOL h264_context_update_queue_depth(H264_CONTEXT* h264, UINT32 queueDepth);
+FREERDP_API BOOL h264_context_rate_control(H264_CONTEXT* h264, UINT32 lastFrameSize);
+
 FREERDP_API H264_CONTEXT* h264_context_new(BOOL Compressor);
 FREERDP_API void h264_context_free(H264_CONTEXT* h264);
 
@@ -25,6 +25,7 @@
 #include <winpr/crt.h>
 
 typedef struct _BITMAP_PLANAR_CONTEXT BITMAP_PLANAR_CONTEXT;
+typedef struct _BITMAP_PLANAR_CONTEXT_PRIV BITMAP_PLANAR_CONTEXT_PRIV;
 
 #include <freerdp/codec/color.h>
 #include <freerdp/codec/bitmap.h>
@@ -97,6 +98,8 @@ struct _BITMAP_PLANAR_CONTEXT
 
 	BYTE* pTempData;
 	UINT32 nTempStep;
+
+	BITMAP_PLANAR_CONTEXT_PRIV* priv;
 };
 
 #ifdef __cplusplus
@@ -37,7 +37,14 @@ extern "C" {
 #endif
 
 FREERDP_API int progressive_compress(PROGRESSIVE_CONTEXT* progressive,
-                                    const BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize);
+                                     const BYTE* pSrcData, UINT32 SrcSize, UINT32 SrcFormat,
+                                     UINT32 Width, UINT32 Height, UINT32 ScanLine,
+                                     const REGION16* invalidRegion, UINT16 surfaceId,
+                                     BYTE** ppDstData, UINT32* pDstSize);
+FREERDP_API int progressive_compress_upgrade(PROGRESSIVE_CONTEXT* progressive,
+        UINT16 surfaceId, BYTE** ppDstData, UINT32* pDstSize);
+FREERDP_API BOOL progressive_compress_pending(PROGRESSIVE_CONTEXT* progressive,
+        UINT16 surfaceId);
 
 FREERDP_API INT32 progressive_decompress(PROGRESSIVE_CONTEXT* progressive,
         const BYTE* pSrcData, UINT32 SrcSize,
@@ -446,6 +446,13 @@ struct _GDI_BRUSH
 	UINT32 color;
 	INT32 nXOrg;
 	INT32 nYOrg;
+
+	/* pattern converted to a drawing format, see gdi_brush_expand */
+	BYTE* expanded;
+	HGDI_BITMAP expandedPattern;
+	UINT32 expandedFormat;
+	UINT32 expandedBkColor;
+	UINT32 expandedTextColor;
 };
 typedef struct _GDI_BRUSH GDI_BRUSH;
 typedef GDI_BRUSH* HGDI_BRUSH;
@@ -472,6 +479,7 @@ struct _GDI_DC
 	HGDI_WND hwnd;
 	INT32 drawMode;
 	INT32 bkMode;
+	INT32 polyFillMode;
 };
 typedef struct _GDI_DC GDI_DC;
 typedef GDI_DC* HGDI_DC;
@@ -147,6 +147,8 @@ FREERDP_API void freerdp_peer_context_free(freerdp_peer* client);
 FREERDP_API freerdp_peer* freerdp_peer_new(int sockfd);
 FREERDP_API void freerdp_peer_free(freerdp_peer* client);
 
+FREERDP_API BOOL freerdp_peer_initiate_multitransport(freerdp_peer* client, BOOL lossy);
+
 #ifdef __cplusplus
 }
 #endif
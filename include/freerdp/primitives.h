@@ -257,6 +257,22 @@ typedef struct
 	__RGBToAVC444YUV_t RGBToAVC444YUVv2;
 } primitives_t;
 
+/* Implementation tiers the autotuner chooses from */
+typedef enum
+{
+	PRIMITIVES_IMPL_GENERIC,
+	PRIMITIVES_IMPL_OPTIMIZED,		/* SSE, NEON or IPP */
+	PRIMITIVES_IMPL_AVX2,
+	PRIMITIVES_IMPL_COUNT
+} primitives_impl_t;
+
+typedef struct
+{
+	const char* name;					/* primitives_t member */
+	primitives_impl_t selected;			/* implementation currently installed */
+	UINT64 nanoseconds[PRIMITIVES_IMPL_COUNT];	/* best run, 0 if not measured or unavailable */
+} primitives_tuning_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -264,6 +280,16 @@ extern "C" {
 FREERDP_API primitives_t* primitives_get(void);
 FREERDP_API primitives_t* primitives_get_generic(void);
 
+/**
+ * Times every available implementation of the tuned primitives on this host
+ * and installs the fastest one into the primitives_get() table. This is done
+ * on startup if the environment variable FREERDP_PRIMITIVES_AUTOTUNE is set.
+ * Call it before the primitives are used by other threads.
+ */
+FREERDP_API BOOL primitives_autotune(void);
+FREERDP_API const primitives_tuning_t* primitives_get_tuning(UINT32* count);
+FREERDP_API const char* primitives_impl_name(primitives_impl_t impl);
+
 #ifdef __cplusplus
 }
 #endif
@@ -75,6 +75,7 @@ typedef UINT(*psRdpgfxFrameAcknowledge)(RdpgfxServerContext* context,
                                         const RDPGFX_FRAME_ACKNOWLEDGE_PDU* frameAcknowledge);
 typedef UINT(*psRdpgfxQoeFrameAcknowledge)(RdpgfxServerContext* context,
         const RDPGFX_QOE_FRAME_ACKNOWLEDGE_PDU* qoeFrameAcknowledge);
+typedef UINT(*psRdpgfxSendData)(RdpgfxServerContext* context, const BYTE* data, UINT32 length);
 
 struct _rdpgfx_server_context
 {
@@ -107,6 +108,8 @@ struct _rdpgfx_server_context
 	psRdpgfxCapsConfirm CapsConfirm;
 	psRdpgfxFrameAcknowledge FrameAcknowledge;
 	psRdpgfxQoeFrameAcknowledge QoeFrameAcknowledge;
+	/* Writes already ZGFX compressed data to the channel as is */
+	psRdpgfxSendData SendData;
 
 	RdpgfxServerPrivate* priv;
 	rdpContext* rdpcontext;
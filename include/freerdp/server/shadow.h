@@ -47,11 +47,19 @@ typedef struct rdp_shadow_server rdpShadowServer;
 typedef struct rdp_shadow_screen rdpShadowScreen;
 typedef struct rdp_shadow_surface rdpShadowSurface;
 typedef struct rdp_shadow_encoder rdpShadowEncoder;
+typedef struct rdp_shadow_encode_cache rdpShadowEncodeCache;
 typedef struct rdp_shadow_capture rdpShadowCapture;
 typedef struct rdp_shadow_subsystem rdpShadowSubsystem;
 typedef struct rdp_shadow_multiclient_event rdpShadowMultiClientEvent;
 
 typedef struct _RDP_SHADOW_ENTRY_POINTS RDP_SHADOW_ENTRY_POINTS;
+
+/* Frame differences are detected on a grid of square tiles */
+#define SHADOW_CAPTURE_TILE_SIZE	16
+#define SHADOW_CAPTURE_TILE_COUNT(_width, _height) \
+	((((_width) + SHADOW_CAPTURE_TILE_SIZE - 1) / SHADOW_CAPTURE_TILE_SIZE) * \
+	 (((_height) + SHADOW_CAPTURE_TILE_SIZE - 1) / SHADOW_CAPTURE_TILE_SIZE))
+
 typedef int (*pfnShadowSubsystemEntry)(RDP_SHADOW_ENTRY_POINTS* pEntryPoints);
 
 typedef rdpShadowSubsystem* (*pfnShadowSubsystemNew)(void);
@@ -145,6 +153,7 @@ struct rdp_shadow_server
 	UINT32 h264BitRate;
 	FLOAT h264FrameRate;
 	UINT32 h264QP;
+	BOOL h264AdaptiveRateControl;
 
 	char* ipcSocket;
 	char* ConfigPath;
@@ -198,6 +207,8 @@ struct rdp_shadow_subsystem
 	/* such as screen update and resize. It should not be */
 	/* used by subsystem implementation directly */
 	rdpShadowMultiClientEvent* updateEvent;
+	/* Encoded output shared by the clients handling updateEvent */
+	rdpShadowEncodeCache* encodeCache;
 
 	wMessagePipe* MsgPipe;
 	UINT32 pointerX;
@@ -315,6 +326,11 @@ FREERDP_API int shadow_capture_align_clip_rect(RECTANGLE_16* rect,
         RECTANGLE_16* clip);
 FREERDP_API int shadow_capture_compare(BYTE* pData1, UINT32 nStep1, UINT32 nWidth,
                                        UINT32 nHeight, BYTE* pData2, UINT32 nStep2, RECTANGLE_16* rect);
+FREERDP_API UINT32 shadow_capture_compare_tiles(const BYTE* pData1, UINT32 nStep1,
+        UINT32 nWidth, UINT32 nHeight, const BYTE* pData2, UINT32 nStep2,
+        BYTE* tiles, RECTANGLE_16* rect);
+FREERDP_API BOOL shadow_capture_tiles_to_region(const BYTE* tiles, UINT32 nWidth,
+        UINT32 nHeight, REGION16* region);
 
 FREERDP_API void shadow_subsystem_frame_update(rdpShadowSubsystem* subsystem);
 
@@ -22,8 +22,10 @@
 #endif
 
 #include <stdio.h>
+#include <ctype.h>
 
 #include <winpr/crt.h>
+#include <winpr/path.h>
 
 #include <freerdp/freerdp.h>
 #include <freerdp/constants.h>
@@ -34,6 +36,7 @@
 #include <freerdp/gdi/bitmap.h>
 
 #include "../gdi/gdi.h"
+#include "../core/rdp.h"
 #include "../core/graphics.h"
 
 #include "bitmap.h"
@@ -44,6 +47,8 @@ static rdpBitmap* bitmap_cache_get(rdpBitmapCache* bitmapCache, UINT32 id,
                                    UINT32 index);
 static BOOL bitmap_cache_put(rdpBitmapCache* bitmap_cache, UINT32 id,
                              UINT32 index, rdpBitmap* bitmap);
+static void bitmap_cache_persist(rdpBitmapCache* bitmapCache, UINT32 id, UINT32 index,
+                                 const rdpBitmap* bitmap, UINT64 key64);
 
 static BOOL update_gdi_memblt(rdpContext* context,
                               MEMBLT_ORDER* memblt)
@@ -135,9 +140,14 @@ static BOOL update_gdi_cache_bitmap(rdpContext* context,
 	prevBitmap = bitmap_cache_get(cache->bitmap, cacheBitmap->cacheId,
 	                              cacheBitmap->cacheIndex);
 	Bitmap_Free(context, prevBitmap);
-	return bitmap_cache_put(cache->bitmap, cacheBitmap->cacheId,
-	                        cacheBitmap->cacheIndex,
-	                        bitmap);
+
+	if (!bitmap_cache_put(cache->bitmap, cacheBitmap->cacheId, cacheBitmap->cacheIndex,
+	                      bitmap))
+		return FALSE;
+
+	bitmap_cache_persist(cache->bitmap, cacheBitmap->cacheId, cacheBitmap->cacheIndex,
+	                     bitmap, 0);
+	return TRUE;
 }
 
 static BOOL update_gdi_cache_bitmap_v2(rdpContext* context,
@@ -146,6 +156,7 @@ static BOOL update_gdi_cache_bitmap_v2(rdpContext* context,
 {
 	rdpBitmap* bitmap;
 	rdpBitmap* prevBitmap;
+	UINT64 key64 = 0;
 	rdpCache* cache = context->cache;
 	rdpSettings* settings = context->settings;
 	bitmap = Bitmap_Alloc(context);
@@ -185,8 +196,17 @@ static BOOL update_gdi_cache_bitmap_v2(rdpContext* context,
 	}
 
 	Bitmap_Free(context, prevBitmap);
-	return bitmap_cache_put(cache->bitmap, cacheBitmapV2->cacheId,
-	                        cacheBitmapV2->cacheIndex, bitmap);
+
+	if (!bitmap_cache_put(cache->bitmap, cacheBitmapV2->cacheId, cacheBitmapV2->cacheIndex,
+	                      bitmap))
+		return FALSE;
+
+	if (cacheBitmapV2->flags & CBR2_PERSISTENT_KEY_PRESENT)
+		key64 = ((UINT64) cacheBitmapV2->key2 << 32) | cacheBitmapV2->key1;
+
+	bitmap_cache_persist(cache->bitmap, cacheBitmapV2->cacheId, cacheBitmapV2->cacheIndex,
+	                     bitmap, key64);
+	return TRUE;
 }
 
 static BOOL update_gdi_cache_bitmap_v3(rdpContext* context,
@@ -227,8 +247,14 @@ static BOOL update_gdi_cache_bitmap_v3(rdpContext* context,
 	prevBitmap = bitmap_cache_get(cache->bitmap, cacheBitmapV3->cacheId,
 	                              cacheBitmapV3->cacheIndex);
 	Bitmap_Free(context, prevBitmap);
-	return bitmap_cache_put(cache->bitmap, cacheBitmapV3->cacheId,
-	                        cacheBitmapV3->cacheIndex, bitmap);
+
+	if (!bitmap_cache_put(cache->bitmap, cacheBitmapV3->cacheId, cacheBitmapV3->cacheIndex,
+	                      bitmap))
+		return FALSE;
+
+	bitmap_cache_persist(cache->bitmap, cacheBitmapV3->cacheId, cacheBitmapV3->cacheIndex,
+	                     bitmap, 0);
+	return TRUE;
 }
 
 rdpBitmap* bitmap_cache_get(rdpBitmapCache* bitmapCache, UINT32 id,
@@ -242,6 +268,9 @@ rdpBitmap* bitmap_cache_get(rdpBitmapCache* bitmapCache, UINT32 id,
 		return NULL;
 	}
 
+	/* the persistent bitmaps are needed from the first order on */
+	bitmap_cache_persist_load(bitmapCache);
+
 	if (index == BITMAP_CACHE_WAITING_LIST_INDEX)
 	{
 		index = bitmapCache->cells[id].number;
@@ -265,6 +294,8 @@ BOOL bitmap_cache_put(rdpBitmapCache* bitmapCache, UINT32 id, UINT32 index,
 		return FALSE;
 	}
 
+	bitmap_cache_persist_load(bitmapCache);
+
 	if (index == BITMAP_CACHE_WAITING_LIST_INDEX)
 	{
 		index = bitmapCache->cells[id].number;
@@ -279,6 +310,398 @@ BOOL bitmap_cache_put(rdpBitmapCache* bitmapCache, UINT32 id, UINT32 index,
 	return TRUE;
 }
 
+static UINT32 bitmap_cache_persist_slot(rdpSettings* settings, UINT32 id, UINT32 index)
+{
+	UINT32 i;
+	UINT32 slot = index;
+
+	/* persistent cells are stored one after the other in the cache file */
+	for (i = 0; i < id; i++)
+	{
+		if (settings->BitmapCacheV2CellInfo[i].persistent)
+			slot += settings->BitmapCacheV2CellInfo[i].numEntries;
+	}
+
+	return slot;
+}
+
+static BOOL bitmap_cache_persist_move(rdpPersistentCache* persistent, UINT32 from, UINT32 to)
+{
+	PERSISTENT_CACHE_ENTRY entry;
+	return persistent_cache_read_entry(persistent, from, &entry) &&
+	       persistent_cache_write_entry(persistent, to, &entry) &&
+	       persistent_cache_clear_entry(persistent, from);
+}
+
+static void bitmap_cache_persist(rdpBitmapCache* bitmapCache, UINT32 id, UINT32 index,
+                                 const rdpBitmap* bitmap, UINT64 key64)
+{
+	UINT32 slot;
+	BITMAP_V2_CELL* cell;
+	PERSISTENT_CACHE_ENTRY entry = { 0 };
+	rdpGdi* gdi = bitmapCache->context->gdi;
+
+	if (!bitmapCache->persistent || (id >= bitmapCache->maxCells))
+		return;
+
+	cell = &bitmapCache->cells[id];
+
+	if (!cell->keys || (index >= cell->number))
+		return;
+
+	slot = bitmap_cache_persist_slot(bitmapCache->settings, id, index);
+
+	if ((key64 == 0) || !bitmap || !bitmap->data ||
+	    (bitmap->width > PERSIST_CACHE_ENTRY_MAX_WIDTH) ||
+	    (bitmap->height > PERSIST_CACHE_ENTRY_MAX_HEIGHT))
+	{
+		if (cell->keys[index] == 0)
+			return;
+
+		cell->keys[index] = 0;
+
+		if (!persistent_cache_clear_entry(bitmapCache->persistent, slot))
+			WLog_WARN(TAG, "failed to clear persistent bitmap %"PRIu32":%"PRIu32"", id, index);
+
+		return;
+	}
+
+	/* stored as an uncompressed 32bpp bitmap, bottom-up like on the wire */
+	entry.key64 = key64;
+	entry.width = (UINT16) bitmap->width;
+	entry.height = (UINT16) bitmap->height;
+	entry.size = bitmap->width * bitmap->height * 4;
+	entry.data = bitmapCache->persistentBuffer;
+
+	if (!freerdp_image_copy(entry.data, gdi_get_pixel_format(32), bitmap->width * 4, 0, 0,
+	                        bitmap->width, bitmap->height, bitmap->data, bitmap->format, 0, 0, 0,
+	                        gdi ? &gdi->palette : NULL, FREERDP_FLIP_VERTICAL))
+		return;
+
+	cell->keys[index] = key64;
+
+	if (!persistent_cache_write_entry(bitmapCache->persistent, slot, &entry))
+		WLog_WARN(TAG, "failed to write persistent bitmap %"PRIu32":%"PRIu32"", id, index);
+}
+
+static rdpBitmap* bitmap_cache_persist_create(rdpContext* context,
+        const PERSISTENT_CACHE_ENTRY* entry)
+{
+	rdpBitmap* bitmap = Bitmap_Alloc(context);
+
+	if (!bitmap)
+		return NULL;
+
+	Bitmap_SetDimensions(bitmap, entry->width, entry->height);
+
+	if (!bitmap->Decompress(context, bitmap, entry->data, entry->width, entry->height, 32,
+	                        entry->size, FALSE, RDP_CODEC_ID_NONE) ||
+	    !bitmap->New(context, bitmap))
+	{
+		Bitmap_Free(context, bitmap);
+		return NULL;
+	}
+
+	return bitmap;
+}
+
+/**
+ * Moves the bitmaps with a persistent key to the front of the cell. The server
+ * assigns the keys of the persistent key list to consecutive cache indices.
+ */
+static void bitmap_cache_persist_compact(rdpBitmapCache* bitmapCache, UINT32 id)
+{
+	UINT32 index;
+	UINT32 count = 0;
+	BITMAP_V2_CELL* cell = &bitmapCache->cells[id];
+	const UINT32 base = bitmap_cache_persist_slot(bitmapCache->settings, id, 0);
+
+	for (index = 0; index < cell->number; index++)
+	{
+		if (cell->keys[index] == 0)
+		{
+			Bitmap_Free(bitmapCache->context, cell->entries[index]);
+			cell->entries[index] = NULL;
+			continue;
+		}
+
+		if (index != count)
+		{
+			cell->entries[count] = cell->entries[index];
+			cell->keys[count] = cell->keys[index];
+			cell->entries[index] = NULL;
+			cell->keys[index] = 0;
+
+			if (!bitmap_cache_persist_move(bitmapCache->persistent, base + index, base + count))
+				WLog_WARN(TAG, "failed to move persistent bitmap %"PRIu32":%"PRIu32"", id, index);
+		}
+
+		count++;
+	}
+}
+
+static char* bitmap_cache_persist_default_file(rdpSettings* settings)
+{
+	char* p;
+	char* path;
+	char* file;
+	char name[256];
+
+	if (!settings->ConfigPath || !settings->ServerHostname)
+		return NULL;
+
+	sprintf_s(name, sizeof(name), "bcache2_%s_%"PRIu32".bmc", settings->ServerHostname,
+	          settings->ServerPort);
+
+	/* IPv6 addresses and the like are no valid file names everywhere */
+	for (p = name; *p; p++)
+	{
+		if (!isalnum((unsigned char) *p) && (*p != '.') && (*p != '-'))
+			*p = '_';
+	}
+
+	path = GetCombinedPath(settings->ConfigPath, "cache");
+
+	if (!path)
+		return NULL;
+
+	if (!PathFileExistsA(path) && !PathMakePathA(path, NULL))
+	{
+		WLog_ERR(TAG, "failed to create directory %s", path);
+		free(path);
+		return NULL;
+	}
+
+	file = GetCombinedPath(path, name);
+	free(path);
+	return file;
+}
+
+static char* bitmap_cache_persist_file(rdpSettings* settings)
+{
+	if (settings->BitmapCachePersistFile)
+		return _strdup(settings->BitmapCachePersistFile);
+
+	return bitmap_cache_persist_default_file(settings);
+}
+
+static UINT32 bitmap_cache_persist_count(rdpSettings* settings)
+{
+	UINT32 i;
+	UINT32 count = 0;
+
+	for (i = 0; i < settings->BitmapCacheV2NumCells; i++)
+	{
+		if (settings->BitmapCacheV2CellInfo[i].persistent)
+			count += settings->BitmapCacheV2CellInfo[i].numEntries;
+	}
+
+	return count;
+}
+
+static BOOL bitmap_cache_persist_open(rdpBitmapCache* bitmapCache)
+{
+	UINT32 i;
+	UINT32 count = 0;
+	char* file = NULL;
+	rdpSettings* settings = bitmapCache->settings;
+
+	if (!settings->BitmapCachePersistEnabled)
+		return TRUE;
+
+	for (i = 0; i < bitmapCache->maxCells; i++)
+	{
+		if (!settings->BitmapCacheV2CellInfo[i].persistent)
+			continue;
+
+		bitmapCache->cells[i].keys = (UINT64*) calloc(bitmapCache->cells[i].number + 1,
+		                             sizeof(UINT64));
+
+		if (!bitmapCache->cells[i].keys)
+			return FALSE;
+
+		count += bitmapCache->cells[i].number;
+	}
+
+	if (count == 0)
+		return TRUE;
+
+	file = bitmap_cache_persist_file(settings);
+	bitmapCache->persistent = persistent_cache_new();
+	bitmapCache->persistentBuffer = (BYTE*) malloc(PERSIST_CACHE_ENTRY_DATA_SIZE);
+
+	if (!file || !bitmapCache->persistent || !bitmapCache->persistentBuffer ||
+	    !persistent_cache_open(bitmapCache->persistent, file, count))
+	{
+		/* the session works fine without, it is only slower to start */
+		WLog_WARN(TAG, "persistent bitmap cache disabled");
+		persistent_cache_free(bitmapCache->persistent);
+		bitmapCache->persistent = NULL;
+	}
+
+	free(file);
+	return TRUE;
+}
+
+/**
+ * Reads the keys for the persistent key list from the cache file, the bitmap
+ * cache is only created after the connection is established. The bitmaps of
+ * each cell are moved to the front of the cell where the server expects them.
+ */
+BOOL bitmap_cache_persist_read_keys(rdpSettings* settings, UINT64** keys, UINT32* counts,
+                                    UINT32 maxCells)
+{
+	UINT32 id, index;
+	BOOL rc = FALSE;
+	char* file = NULL;
+	rdpPersistentCache* persistent = NULL;
+	const UINT32 count = bitmap_cache_persist_count(settings);
+
+	for (id = 0; id < maxCells; id++)
+	{
+		keys[id] = NULL;
+		counts[id] = 0;
+	}
+
+	if (!settings->BitmapCachePersistEnabled || (count == 0))
+		return TRUE;
+
+	file = bitmap_cache_persist_file(settings);
+	persistent = persistent_cache_new();
+
+	if (!file || !persistent || !persistent_cache_open(persistent, file, count))
+		goto fail;
+
+	for (id = 0; (id < maxCells) && (id < settings->BitmapCacheV2NumCells); id++)
+	{
+		const BITMAP_CACHE_V2_CELL_INFO* info = &settings->BitmapCacheV2CellInfo[id];
+		const UINT32 base = bitmap_cache_persist_slot(settings, id, 0);
+
+		if (!info->persistent)
+			continue;
+
+		keys[id] = (UINT64*) calloc(info->numEntries + 1, sizeof(UINT64));
+
+		if (!keys[id])
+			goto fail;
+
+		for (index = 0; index < info->numEntries; index++)
+		{
+			PERSISTENT_CACHE_ENTRY entry;
+
+			if (!persistent_cache_read_entry(persistent, base + index, &entry))
+				goto fail;
+
+			if ((entry.key64 == 0) || (entry.size == 0))
+				continue;
+
+			if ((index != counts[id]) &&
+			    !bitmap_cache_persist_move(persistent, base + index, base + counts[id]))
+				goto fail;
+
+			keys[id][counts[id]++] = entry.key64;
+		}
+	}
+
+	rc = TRUE;
+fail:
+
+	if (!rc)
+	{
+		WLog_WARN(TAG, "persistent bitmap cache keys not available");
+
+		for (id = 0; id < maxCells; id++)
+		{
+			free(keys[id]);
+			keys[id] = NULL;
+			counts[id] = 0;
+		}
+	}
+
+	persistent_cache_free(persistent);
+	free(file);
+	return rc;
+}
+
+/**
+ * Fills the persistent cells with the bitmaps of the persistent key list on
+ * first use, the graphics callbacks are not registered when the cache is created.
+ */
+BOOL bitmap_cache_persist_load(rdpBitmapCache* bitmapCache)
+{
+	UINT32 id, index;
+	rdpRdp* rdp;
+
+	if (!bitmapCache || !bitmapCache->persistent)
+		return FALSE;
+
+	if (bitmapCache->persistentLoaded)
+		return TRUE;
+
+	bitmapCache->persistentLoaded = TRUE;
+	rdp = bitmapCache->context->rdp;
+
+	for (id = 0; (id < bitmapCache->maxCells) && (id < PERSIST_MAX_CACHES); id++)
+	{
+		BITMAP_V2_CELL* cell = &bitmapCache->cells[id];
+		const UINT64* keys = rdp->persistentKeys[id];
+		const UINT32 count = MIN(rdp->persistentKeyCount[id], cell->number);
+		const UINT32 base = bitmap_cache_persist_slot(bitmapCache->settings, id, 0);
+
+		if (!cell->keys || !keys)
+			continue;
+
+		for (index = 0; index < count; index++)
+		{
+			PERSISTENT_CACHE_ENTRY entry;
+			rdpBitmap* bitmap = NULL;
+
+			if (persistent_cache_read_entry(bitmapCache->persistent, base + index, &entry) &&
+			    (entry.key64 == keys[index]) && (entry.size > 0))
+				bitmap = bitmap_cache_persist_create(bitmapCache->context, &entry);
+
+			if (!bitmap)
+			{
+				WLog_WARN(TAG, "failed to load persistent bitmap %"PRIu32":%"PRIu32"", id, index);
+				continue;
+			}
+
+			Bitmap_Free(bitmapCache->context, cell->entries[index]);
+			cell->entries[index] = bitmap;
+			cell->keys[index] = keys[index];
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * Packs the keys of a persistent cell to the front for the persistent key list
+ * of a reconnect, while the bitmap cache owns the cache file.
+ */
+UINT32 bitmap_cache_persist_get_keys(rdpBitmapCache* bitmapCache, UINT32 id,
+                                     const UINT64** keys)
+{
+	UINT32 count = 0;
+	BITMAP_V2_CELL* cell;
+
+	if (!bitmap_cache_persist_load(bitmapCache) || (id >= bitmapCache->maxCells) || !keys)
+		return 0;
+
+	cell = &bitmapCache->cells[id];
+
+	if (!cell->keys)
+		return 0;
+
+	bitmap_cache_persist_compact(bitmapCache, id);
+
+	while ((count < cell->number) && (cell->keys[count] != 0))
+		count++;
+
+	*keys = cell->keys;
+	return count;
+}
+
 void bitmap_cache_register_callbacks(rdpUpdate* update)
 {
 	rdpCache* cache = update->context->cache;
@@ -322,15 +745,22 @@ rdpBitmapCache* bitmap_cache_new(rdpSettings* settings)
 			goto fail;
 	}
 
+	if (!bitmap_cache_persist_open(bitmapCache))
+		goto fail;
+
 	return bitmapCache;
 fail:
 
 	if (bitmapCache->cells)
 	{
 		for (i = 0; i < (int) bitmapCache->maxCells; i++)
+		{
 			free(bitmapCache->cells[i].entries);
+			free(bitmapCache->cells[i].keys);
+		}
 	}
 
+	free(bitmapCache->cells);
 	free(bitmapCache);
 	return NULL;
 }
@@ -351,8 +781,11 @@ void bitmap_cache_free(rdpBitmapCache* bitmapCache)
 			}
 
 			free(bitmapCache->cells[i].entries);
+			free(bitmapCache->cells[i].keys);
 		}
 
+		persistent_cache_free(bitmapCache->persistent);
+		free(bitmapCache->persistentBuffer);
 		free(bitmapCache->cells);
 		free(bitmapCache);
 	}
@@ -22,6 +22,13 @@
 
 #include <freerdp/api.h>
 #include <freerdp/update.h>
+#include <freerdp/cache/bitmap.h>
+
+FREERDP_LOCAL BOOL bitmap_cache_persist_read_keys(rdpSettings* settings, UINT64** keys,
+        UINT32* counts, UINT32 maxCells);
+FREERDP_LOCAL BOOL bitmap_cache_persist_load(rdpBitmapCache* bitmapCache);
+FREERDP_LOCAL UINT32 bitmap_cache_persist_get_keys(rdpBitmapCache* bitmapCache, UINT32 id,
+        const UINT64** keys);
 
 FREERDP_LOCAL BITMAP_UPDATE* copy_bitmap_update(rdpContext* context, const BITMAP_UPDATE* pointer);
 FREERDP_LOCAL void free_bitmap_update(rdpContext* context, BITMAP_UPDATE* pointer);
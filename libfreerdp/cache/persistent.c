@@ -0,0 +1,258 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Persistent Bitmap Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+
+#include <freerdp/log.h>
+#include <freerdp/cache/persistent.h>
+
+#define TAG FREERDP_TAG("cache.persistent")
+
+/*
+ * Slots are written whenever the server caches a keyed bitmap, so the file is
+ * only flushed every so many writes and on close. A crash loses at most the
+ * last few slots, which the server simply sends again.
+ */
+#define PERSIST_CACHE_FLUSH_INTERVAL	64
+
+struct rdp_persistent_cache
+{
+	FILE* fp;
+	char* filename;
+	UINT32 count;
+	UINT32 unflushed;
+	BYTE* buffer;
+};
+
+static BOOL persistent_cache_seek(rdpPersistentCache* persistent, UINT32 index)
+{
+	const INT64 offset = (INT64) index * PERSIST_CACHE_ENTRY_SIZE;
+
+	if (!persistent || !persistent->fp || (index >= persistent->count))
+		return FALSE;
+
+	if (_fseeki64(persistent->fp, offset, SEEK_SET) != 0)
+	{
+		WLog_ERR(TAG, "failed to seek to entry %"PRIu32" in %s", index, persistent->filename);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+BOOL persistent_cache_open(rdpPersistentCache* persistent, const char* filename, UINT32 count)
+{
+	INT64 size;
+
+	if (!persistent || !filename || (count == 0))
+		return FALSE;
+
+	persistent_cache_close(persistent);
+	persistent->filename = _strdup(filename);
+
+	if (!persistent->filename)
+		return FALSE;
+
+	persistent->fp = fopen(filename, "r+b");
+
+	if (!persistent->fp)
+		persistent->fp = fopen(filename, "w+b");
+
+	if (!persistent->fp)
+	{
+		WLog_ERR(TAG, "failed to open persistent bitmap cache %s", filename);
+		goto fail;
+	}
+
+	if (_fseeki64(persistent->fp, 0, SEEK_END) != 0)
+		goto fail;
+
+	size = _ftelli64(persistent->fp);
+
+	if (size < 0)
+		goto fail;
+
+	/* Slots past the end of a shorter (or new) file read as empty */
+	persistent->count = count;
+	WLog_DBG(TAG, "%s: %"PRIu32" slots, %"PRId64" bytes", filename, count, size);
+	return TRUE;
+fail:
+	persistent_cache_close(persistent);
+	return FALSE;
+}
+
+void persistent_cache_close(rdpPersistentCache* persistent)
+{
+	if (!persistent)
+		return;
+
+	if (persistent->fp)
+	{
+		if (fclose(persistent->fp) != 0)
+			WLog_WARN(TAG, "failed to write back %s", persistent->filename);
+	}
+
+	free(persistent->filename);
+	persistent->fp = NULL;
+	persistent->filename = NULL;
+	persistent->count = 0;
+	persistent->unflushed = 0;
+}
+
+UINT32 persistent_cache_get_count(rdpPersistentCache* persistent)
+{
+	if (!persistent || !persistent->fp)
+		return 0;
+
+	return persistent->count;
+}
+
+/**
+ * Reads the slot at index. On success entry->data points to an internal
+ * buffer that stays valid until the next read. Empty slots have a zero key.
+ */
+BOOL persistent_cache_read_entry(rdpPersistentCache* persistent, UINT32 index,
+                                 PERSISTENT_CACHE_ENTRY* entry)
+{
+	wStream* s;
+	size_t status;
+
+	if (!entry || !persistent_cache_seek(persistent, index))
+		return FALSE;
+
+	ZeroMemory(entry, sizeof(PERSISTENT_CACHE_ENTRY));
+	status = fread(persistent->buffer, 1, PERSIST_CACHE_ENTRY_SIZE, persistent->fp);
+
+	/* a short read is a slot that was never written */
+	if (status < PERSIST_CACHE_ENTRY_SIZE)
+	{
+		clearerr(persistent->fp);
+		return TRUE;
+	}
+
+	s = Stream_New(persistent->buffer, PERSIST_CACHE_ENTRY_HEADER_SIZE);
+
+	if (!s)
+		return FALSE;
+
+	Stream_Read_UINT64(s, entry->key64); /* key64 (8 bytes) */
+	Stream_Read_UINT16(s, entry->width); /* width (2 bytes) */
+	Stream_Read_UINT16(s, entry->height); /* height (2 bytes) */
+	Stream_Read_UINT32(s, entry->size); /* size (4 bytes) */
+	Stream_Read_UINT32(s, entry->flags); /* flags (4 bytes) */
+	Stream_Free(s, FALSE);
+
+	if ((entry->width > PERSIST_CACHE_ENTRY_MAX_WIDTH) ||
+	    (entry->height > PERSIST_CACHE_ENTRY_MAX_HEIGHT) ||
+	    (entry->size != entry->width * entry->height * 4U))
+	{
+		WLog_WARN(TAG, "ignoring corrupt entry %"PRIu32" in %s", index, persistent->filename);
+		ZeroMemory(entry, sizeof(PERSISTENT_CACHE_ENTRY));
+		return TRUE;
+	}
+
+	entry->data = &persistent->buffer[PERSIST_CACHE_ENTRY_HEADER_SIZE];
+	return TRUE;
+}
+
+BOOL persistent_cache_write_entry(rdpPersistentCache* persistent, UINT32 index,
+                                  const PERSISTENT_CACHE_ENTRY* entry)
+{
+	wStream* s;
+
+	if (!entry || (entry->width > PERSIST_CACHE_ENTRY_MAX_WIDTH) ||
+	    (entry->height > PERSIST_CACHE_ENTRY_MAX_HEIGHT) ||
+	    (entry->size != entry->width * entry->height * 4U))
+		return FALSE;
+
+	if (!persistent_cache_seek(persistent, index))
+		return FALSE;
+
+	s = Stream_New(persistent->buffer, PERSIST_CACHE_ENTRY_SIZE);
+
+	if (!s)
+		return FALSE;
+
+	Stream_Write_UINT64(s, entry->key64); /* key64 (8 bytes) */
+	Stream_Write_UINT16(s, entry->width); /* width (2 bytes) */
+	Stream_Write_UINT16(s, entry->height); /* height (2 bytes) */
+	Stream_Write_UINT32(s, entry->size); /* size (4 bytes) */
+	Stream_Write_UINT32(s, entry->flags); /* flags (4 bytes) */
+
+	/* entries returned by persistent_cache_read_entry are already in place */
+	if ((entry->size > 0) && (entry->data != Stream_Pointer(s)))
+		Stream_Write(s, entry->data, entry->size);
+	else
+		Stream_Seek(s, entry->size);
+
+	Stream_Zero(s, Stream_GetRemainingCapacity(s));
+	Stream_Free(s, FALSE);
+
+	if (fwrite(persistent->buffer, 1, PERSIST_CACHE_ENTRY_SIZE,
+	           persistent->fp) != PERSIST_CACHE_ENTRY_SIZE)
+	{
+		WLog_ERR(TAG, "failed to write entry %"PRIu32" to %s", index, persistent->filename);
+		return FALSE;
+	}
+
+	if (++persistent->unflushed < PERSIST_CACHE_FLUSH_INTERVAL)
+		return TRUE;
+
+	persistent->unflushed = 0;
+	return fflush(persistent->fp) == 0;
+}
+
+BOOL persistent_cache_clear_entry(rdpPersistentCache* persistent, UINT32 index)
+{
+	const PERSISTENT_CACHE_ENTRY entry = { 0 };
+	return persistent_cache_write_entry(persistent, index, &entry);
+}
+
+rdpPersistentCache* persistent_cache_new(void)
+{
+	rdpPersistentCache* persistent = (rdpPersistentCache*) calloc(1, sizeof(rdpPersistentCache));
+
+	if (!persistent)
+		return NULL;
+
+	persistent->buffer = (BYTE*) malloc(PERSIST_CACHE_ENTRY_SIZE);
+
+	if (!persistent->buffer)
+	{
+		free(persistent);
+		return NULL;
+	}
+
+	return persistent;
+}
+
+void persistent_cache_free(rdpPersistentCache* persistent)
+{
+	if (!persistent)
+		return;
+
+	persistent_cache_close(persistent);
+	free(persistent->buffer);
+	free(persistent);
+}
@@ -71,6 +71,13 @@ struct _CLEAR_CONTEXT
 	CLEAR_VBAR_ENTRY VBarStorage[CLEARCODEC_VBAR_SIZE];
 	UINT32 ShortVBarStorageCursor;
 	CLEAR_VBAR_ENTRY ShortVBarStorage[CLEARCODEC_VBAR_SHORT_SIZE];
+
+	wStream* buffer;
+	BOOL CacheResetPending;
+	UINT32 GlyphCursor;
+	UINT32* GlyphHash;
+	UINT32* VBarHash;
+	UINT32* ShortVBarHash;
 };
 
 static const UINT32 CLEAR_LOG2_FLOOR[256] =
@@ -1173,18 +1180,833 @@ fail:
 	return rc;
 }
 
-int clear_compress(CLEAR_CONTEXT* clear, const BYTE* pSrcData, UINT32 SrcSize,
+#define CLEAR_ENCODE_GLYPH_MAX_PIXELS 1024
+#define CLEAR_ENCODE_STRIP_HEIGHT 52
+#define CLEAR_ENCODE_RLEX_MAX_COLORS 127
+#define CLEAR_ENCODE_COLOR_TABLE_SIZE 1024
+#define CLEAR_ENCODE_MAX_COLORS 512
+#define CLEAR_ENCODE_GLYPH_HASH_SIZE 8192
+#define CLEAR_ENCODE_VBAR_HASH_SIZE 65536
+#define CLEAR_ENCODE_SHORT_VBAR_HASH_SIZE 32768
+
+enum CLEAR_ENCODE_STRIP_MODE
+{
+	CLEAR_ENCODE_RESIDUAL = 0,
+	CLEAR_ENCODE_BANDS,
+	CLEAR_ENCODE_RLEX,
+	CLEAR_ENCODE_IMAGE
+};
+
+struct _CLEAR_ENCODE_COLOR
+{
+	UINT32 color;
+	UINT32 count;
+	UINT32 index;
+};
+typedef struct _CLEAR_ENCODE_COLOR CLEAR_ENCODE_COLOR;
+
+struct _CLEAR_ENCODE_STRIP
+{
+	UINT32 mode;
+	UINT32 colorBkg;
+	UINT32 numColors;
+	UINT32 palette[CLEAR_ENCODE_RLEX_MAX_COLORS];
+};
+typedef struct _CLEAR_ENCODE_STRIP CLEAR_ENCODE_STRIP;
+
+static INLINE UINT32 clear_encode_hash(const UINT32* pixels, UINT32 count, UINT32 step)
+{
+	UINT32 i;
+	UINT32 hash = 2166136261UL ^ count;
+
+	for (i = 0; i < count; i++)
+	{
+		hash ^= pixels[i * step];
+		hash *= 16777619UL;
+	}
+
+	return hash ^ (hash >> 15);
+}
+
+static BOOL clear_encode_entry_equal(CLEAR_CONTEXT* clear, const BYTE* data, UINT32 entryCount,
+                                     const UINT32* pixels, UINT32 count, UINT32 step)
+{
+	UINT32 i;
+	const UINT32 bpp = GetBytesPerPixel(clear->format);
+
+	if (!data || (entryCount != count))
+		return FALSE;
+
+	for (i = 0; i < count; i++)
+	{
+		if (ReadColor(&data[i * bpp], clear->format) != pixels[i * step])
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void clear_encode_entry_store(CLEAR_CONTEXT* clear, BYTE* data, const UINT32* pixels,
+                                     UINT32 count, UINT32 step)
+{
+	UINT32 i;
+	const UINT32 bpp = GetBytesPerPixel(clear->format);
+
+	for (i = 0; i < count; i++)
+		WriteColor(&data[i * bpp], clear->format, pixels[i * step]);
+}
+
+/**
+ * Forget everything the encoder knows about the decoder caches.
+ * The next message carries CLEARCODEC_FLAG_CACHE_RESET so that both sides
+ * agree on the vBar storage cursors again.
+ */
+static void clear_encode_reset_caches(CLEAR_CONTEXT* clear)
+{
+	if (!clear->Compressor)
+		return;
+
+	if (clear->GlyphHash)
+		ZeroMemory(clear->GlyphHash, CLEAR_ENCODE_GLYPH_HASH_SIZE * sizeof(UINT32));
+
+	if (clear->VBarHash)
+		ZeroMemory(clear->VBarHash, CLEAR_ENCODE_VBAR_HASH_SIZE * sizeof(UINT32));
+
+	if (clear->ShortVBarHash)
+		ZeroMemory(clear->ShortVBarHash, CLEAR_ENCODE_SHORT_VBAR_HASH_SIZE * sizeof(UINT32));
+
+	clear->GlyphCursor = 0;
+	clear->VBarStorageCursor = 0;
+	clear->ShortVBarStorageCursor = 0;
+	clear->CacheResetPending = TRUE;
+}
+
+static BOOL clear_write_run_length(wStream* s, UINT32 runLengthFactor)
+{
+	if (!Stream_EnsureRemainingCapacity(s, 7))
+		return FALSE;
+
+	if (runLengthFactor < 0xFF)
+	{
+		Stream_Write_UINT8(s, runLengthFactor);
+		return TRUE;
+	}
+
+	Stream_Write_UINT8(s, 0xFF);
+
+	if (runLengthFactor < 0xFFFF)
+	{
+		Stream_Write_UINT16(s, runLengthFactor);
+		return TRUE;
+	}
+
+	Stream_Write_UINT16(s, 0xFFFF);
+	Stream_Write_UINT32(s, runLengthFactor);
+	return TRUE;
+}
+
+static INLINE void clear_write_color(wStream* s, UINT32 color)
+{
+	Stream_Write_UINT8(s, (BYTE)(color >> 24)); /* b */
+	Stream_Write_UINT8(s, (BYTE)(color >> 16)); /* g */
+	Stream_Write_UINT8(s, (BYTE)(color >> 8)); /* r */
+}
+
+static CLEAR_ENCODE_COLOR* clear_encode_color_lookup(CLEAR_ENCODE_COLOR* table, UINT32 color)
+{
+	UINT32 slot = ((color * 2654435761UL) >> 22) & (CLEAR_ENCODE_COLOR_TABLE_SIZE - 1);
+
+	/* count == 0 marks an empty slot, the table is never filled completely */
+	while (table[slot].count && (table[slot].color != color))
+		slot = (slot + 1) & (CLEAR_ENCODE_COLOR_TABLE_SIZE - 1);
+
+	return &table[slot];
+}
+
+static UINT32 clear_encode_vbar_lookup(CLEAR_CONTEXT* clear, const UINT32* pixels, UINT32 count)
+{
+	const UINT32 hash = clear_encode_hash(pixels, count, 1);
+	const UINT32 index = clear->VBarHash[hash & (CLEAR_ENCODE_VBAR_HASH_SIZE - 1)];
+	CLEAR_VBAR_ENTRY* vBarEntry;
+
+	if (!index)
+		return 0;
+
+	vBarEntry = &clear->VBarStorage[index - 1];
+
+	if (!clear_encode_entry_equal(clear, vBarEntry->pixels, vBarEntry->count, pixels, count, 1))
+		return 0;
+
+	return index;
+}
+
+static UINT32 clear_encode_short_vbar_lookup(CLEAR_CONTEXT* clear, const UINT32* pixels,
+        UINT32 count)
+{
+	const UINT32 hash = clear_encode_hash(pixels, count, 1);
+	const UINT32 index = clear->ShortVBarHash[hash & (CLEAR_ENCODE_SHORT_VBAR_HASH_SIZE - 1)];
+	CLEAR_VBAR_ENTRY* vBarShortEntry;
+
+	if (!index)
+		return 0;
+
+	vBarShortEntry = &clear->ShortVBarStorage[index - 1];
+
+	if (!clear_encode_entry_equal(clear, vBarShortEntry->pixels, vBarShortEntry->count, pixels,
+	                              count, 1))
+		return 0;
+
+	return index;
+}
+
+static void clear_encode_vbar_extent(const UINT32* column, UINT32 count, UINT32 colorBkg,
+                                     UINT32* pYOn, UINT32* pYOff)
+{
+	UINT32 yOn = 0;
+	UINT32 yOff = count;
+
+	while ((yOn < count) && (column[yOn] == colorBkg))
+		yOn++;
+
+	if (yOn == count)
+	{
+		*pYOn = *pYOff = 0;
+		return;
+	}
+
+	while (column[yOff - 1] == colorBkg)
+		yOff--;
+
+	*pYOn = yOn;
+	*pYOff = yOff;
+}
+
+static BOOL clear_encode_seen(UINT32* seen, UINT32 mask, UINT32 hash)
+{
+	UINT32 slot = hash & mask;
+
+	hash |= 1;
+
+	while (seen[slot] && (seen[slot] != hash))
+		slot = (slot + 1) & mask;
+
+	if (seen[slot])
+		return TRUE;
+
+	seen[slot] = hash;
+	return FALSE;
+}
+
+/**
+ * Chooses how a strip of at most 52 rows is transmitted by estimating the
+ * size of every applicable encoding.
+ *
+ * seen is scratch space of mask + 1 entries used to account for vBars that
+ * repeat within the strip and become cache hits once the strip is encoded.
+ */
+static void clear_encode_plan_strip(CLEAR_CONTEXT* clear, const UINT32* pixels, UINT32 nWidth,
+                                    UINT32 nHeight, BOOL allowImage, UINT32* seen, UINT32 mask,
+                                    CLEAR_ENCODE_STRIP* strip)
+{
+	UINT32 x, y, i;
+	UINT32 runs = 1;
+	UINT32 numColors = 0;
+	UINT32 bkgCount = 0;
+	UINT32 column[CLEAR_ENCODE_STRIP_HEIGHT];
+	const UINT32 pixelCount = nWidth * nHeight;
+	UINT32 costResidual, costBands, costRlex, costRaw;
+	CLEAR_ENCODE_COLOR table[CLEAR_ENCODE_COLOR_TABLE_SIZE] = { { 0 } };
+
+	for (i = 0; i < pixelCount; i++)
+	{
+		CLEAR_ENCODE_COLOR* entry;
+
+		if (i && (pixels[i] != pixels[i - 1]))
+			runs++;
+
+		entry = clear_encode_color_lookup(table, pixels[i]);
+
+		if (!entry->count)
+		{
+			if (numColors >= CLEAR_ENCODE_MAX_COLORS)
+				continue;
+
+			if (numColors < CLEAR_ENCODE_RLEX_MAX_COLORS)
+				strip->palette[numColors] = pixels[i];
+
+			entry->color = pixels[i];
+			entry->index = numColors++;
+		}
+
+		if (++entry->count > bkgCount)
+		{
+			bkgCount = entry->count;
+			strip->colorBkg = entry->color;
+		}
+	}
+
+	strip->numColors = numColors;
+	costResidual = runs * 4;
+	costRaw = 13 + pixelCount * 3;
+	costRlex = (numColors <= CLEAR_ENCODE_RLEX_MAX_COLORS) ?
+	           (14 + numColors * 3 + runs * 2) : UINT32_MAX;
+	costBands = 11;
+	ZeroMemory(seen, (mask + 1) * sizeof(UINT32));
+
+	for (x = 0; x < nWidth; x++)
+	{
+		UINT32 yOn, yOff;
+
+		for (y = 0; y < nHeight; y++)
+			column[y] = pixels[y * nWidth + x];
+
+		if (clear_encode_seen(seen, mask, clear_encode_hash(column, nHeight, 1)) ||
+		    clear_encode_vbar_lookup(clear, column, nHeight))
+		{
+			costBands += 2;
+			continue;
+		}
+
+		clear_encode_vbar_extent(column, nHeight, strip->colorBkg, &yOn, &yOff);
+
+		if (clear_encode_short_vbar_lookup(clear, &column[yOn], yOff - yOn))
+			costBands += 3;
+		else
+			costBands += 2 + (yOff - yOn) * 3;
+	}
+
+	strip->mode = CLEAR_ENCODE_RESIDUAL;
+
+	if (costBands < costResidual)
+	{
+		strip->mode = CLEAR_ENCODE_BANDS;
+		costResidual = costBands;
+	}
+
+	if (costRlex < costResidual)
+	{
+		strip->mode = CLEAR_ENCODE_RLEX;
+		costResidual = costRlex;
+	}
+
+	if (allowImage && (costRaw <= costResidual))
+		strip->mode = CLEAR_ENCODE_IMAGE;
+}
+
+static BOOL clear_encode_residual(wStream* s, const UINT32* pixels, UINT32 nWidth,
+                                  UINT32 nHeight, const CLEAR_ENCODE_STRIP* strips)
+{
+	UINT32 y, i;
+	UINT32 color = pixels[0];
+	UINT32 runLengthFactor = 0;
+
+	for (y = 0; y < nHeight; y += CLEAR_ENCODE_STRIP_HEIGHT)
+	{
+		const UINT32 stripHeight = MIN(CLEAR_ENCODE_STRIP_HEIGHT, nHeight - y);
+		const UINT32 pixelCount = stripHeight * nWidth;
+		const UINT32* src = &pixels[y * nWidth];
+
+		/* pixels covered by bands or subcodecs are overdrawn, extend the current run */
+		if (strips[y / CLEAR_ENCODE_STRIP_HEIGHT].mode != CLEAR_ENCODE_RESIDUAL)
+		{
+			runLengthFactor += pixelCount;
+			continue;
+		}
+
+		for (i = 0; i < pixelCount; i++)
+		{
+			if (src[i] == color)
+			{
+				runLengthFactor++;
+				continue;
+			}
+
+			if (runLengthFactor)
+			{
+				if (!Stream_EnsureRemainingCapacity(s, 3))
+					return FALSE;
+
+				clear_write_color(s, color);
+
+				if (!clear_write_run_length(s, runLengthFactor))
+					return FALSE;
+			}
+
+			color = src[i];
+			runLengthFactor = 1;
+		}
+	}
+
+	if (!Stream_EnsureRemainingCapacity(s, 3))
+		return FALSE;
+
+	clear_write_color(s, color);
+	return clear_write_run_length(s, runLengthFactor);
+}
+
+static BOOL clear_encode_bands(CLEAR_CONTEXT* clear, wStream* s, const UINT32* pixels,
+                               UINT32 nWidth, UINT32 yStart, UINT32 nHeight, UINT32 colorBkg)
+{
+	UINT32 x, y;
+	UINT32 column[CLEAR_ENCODE_STRIP_HEIGHT];
+
+	if (!Stream_EnsureRemainingCapacity(s, 11))
+		return FALSE;
+
+	Stream_Write_UINT16(s, 0); /* xStart (2 bytes) */
+	Stream_Write_UINT16(s, nWidth - 1); /* xEnd (2 bytes) */
+	Stream_Write_UINT16(s, yStart); /* yStart (2 bytes) */
+	Stream_Write_UINT16(s, yStart + nHeight - 1); /* yEnd (2 bytes) */
+	clear_write_color(s, colorBkg);
+
+	for (x = 0; x < nWidth; x++)
+	{
+		UINT32 index;
+		UINT32 yOn, yOff;
+		CLEAR_VBAR_ENTRY* vBarEntry;
+		CLEAR_VBAR_ENTRY* vBarShortEntry;
+
+		for (y = 0; y < nHeight; y++)
+			column[y] = pixels[y * nWidth + x];
+
+		if (!Stream_EnsureRemainingCapacity(s, 3 + CLEAR_ENCODE_STRIP_HEIGHT * 3))
+			return FALSE;
+
+		index = clear_encode_vbar_lookup(clear, column, nHeight);
+
+		if (index)
+		{
+			Stream_Write_UINT16(s, 0x8000 | (index - 1)); /* VBAR_CACHE_HIT */
+			continue;
+		}
+
+		clear_encode_vbar_extent(column, nHeight, colorBkg, &yOn, &yOff);
+		index = clear_encode_short_vbar_lookup(clear, &column[yOn], yOff - yOn);
+
+		if (index)
+		{
+			Stream_Write_UINT16(s, 0x4000 | (index - 1)); /* SHORT_VBAR_CACHE_HIT */
+			Stream_Write_UINT8(s, yOn);
+		}
+		else
+		{
+			Stream_Write_UINT16(s, (yOff << 8) | yOn); /* SHORT_VBAR_CACHE_MISS */
+
+			for (y = yOn; y < yOff; y++)
+				clear_write_color(s, column[y]);
+
+			vBarShortEntry = &clear->ShortVBarStorage[clear->ShortVBarStorageCursor];
+			vBarShortEntry->count = yOff - yOn;
+
+			if (!resize_vbar_entry(clear, vBarShortEntry))
+				return FALSE;
+
+			clear_encode_entry_store(clear, vBarShortEntry->pixels, &column[yOn], yOff - yOn, 1);
+			clear->ShortVBarHash[clear_encode_hash(&column[yOn], yOff - yOn, 1) &
+			                     (CLEAR_ENCODE_SHORT_VBAR_HASH_SIZE - 1)] =
+			                         clear->ShortVBarStorageCursor + 1;
+			clear->ShortVBarStorageCursor =
+			    (clear->ShortVBarStorageCursor + 1) % CLEARCODEC_VBAR_SHORT_SIZE;
+		}
+
+		/* both short vBar variants create a new full vBar, mirror the decoder */
+		vBarEntry = &clear->VBarStorage[clear->VBarStorageCursor];
+		vBarEntry->count = nHeight;
+
+		if (!resize_vbar_entry(clear, vBarEntry))
+			return FALSE;
+
+		clear_encode_entry_store(clear, vBarEntry->pixels, column, nHeight, 1);
+		clear->VBarHash[clear_encode_hash(column, nHeight, 1) & (CLEAR_ENCODE_VBAR_HASH_SIZE - 1)] =
+		    clear->VBarStorageCursor + 1;
+		clear->VBarStorageCursor = (clear->VBarStorageCursor + 1) % CLEARCODEC_VBAR_SIZE;
+	}
+
+	return TRUE;
+}
+
+static BOOL clear_encode_subcodec_rlex(wStream* s, const UINT32* pixels, UINT32 pixelCount,
+                                       const CLEAR_ENCODE_STRIP* strip)
+{
+	UINT32 i;
+	const UINT32 numBits = CLEAR_LOG2_FLOOR[strip->numColors - 1] + 1;
+	const UINT32 maxDepth = CLEAR_8BIT_MASKS[8 - numBits];
+	CLEAR_ENCODE_COLOR table[CLEAR_ENCODE_COLOR_TABLE_SIZE] = { { 0 } };
+
+	if (!Stream_EnsureRemainingCapacity(s, 1 + strip->numColors * 3))
+		return FALSE;
+
+	Stream_Write_UINT8(s, strip->numColors); /* paletteCount (1 byte) */
+
+	for (i = 0; i < strip->numColors; i++)
+	{
+		CLEAR_ENCODE_COLOR* entry = clear_encode_color_lookup(table, strip->palette[i]);
+		entry->color = strip->palette[i];
+		entry->index = i;
+		entry->count = 1;
+		clear_write_color(s, strip->palette[i]);
+	}
+
+	i = 0;
+
+	while (i < pixelCount)
+	{
+		UINT32 suiteDepth = 0;
+		UINT32 runLengthFactor = 0;
+		const UINT32 startIndex = clear_encode_color_lookup(table, pixels[i])->index;
+
+		/* a segment is a run of the start color followed by a suite of ascending indices */
+		while ((i + runLengthFactor + 1 < pixelCount) &&
+		       (pixels[i + runLengthFactor + 1] == pixels[i]))
+			runLengthFactor++;
+
+		i += runLengthFactor + 1;
+
+		while ((i < pixelCount) && (suiteDepth < maxDepth) &&
+		       (startIndex + suiteDepth + 1 < strip->numColors) &&
+		       (pixels[i] == strip->palette[startIndex + suiteDepth + 1]))
+		{
+			suiteDepth++;
+			i++;
+		}
+
+		if (!Stream_EnsureRemainingCapacity(s, 1))
+			return FALSE;
+
+		Stream_Write_UINT8(s, (startIndex + suiteDepth) | (suiteDepth << numBits));
+
+		if (!clear_write_run_length(s, runLengthFactor))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL clear_encode_subcodec_nscodec(CLEAR_CONTEXT* clear, wStream* s,
+        const UINT32* pixels, UINT32 nWidth, UINT32 nHeight)
+{
+	UINT32 x, y;
+	BOOL rc;
+	BYTE* data;
+	const UINT32 bpp = GetBytesPerPixel(clear->format);
+	/* the SSE2 encoder processes 8 pixels at a time */
+	const UINT32 nStep = ((nWidth + 7) & ~7) * bpp;
+
+	data = (BYTE*) calloc(nHeight, nStep);
+
+	if (!data)
+		return FALSE;
+
+	/* the NSCodec encoder expects bottom-up images */
+	for (y = 0; y < nHeight; y++)
+	{
+		BYTE* dst = &data[(nHeight - 1 - y) * nStep];
+
+		for (x = 0; x < nWidth; x++)
+			WriteColor(&dst[x * bpp], clear->format, pixels[y * nWidth + x]);
+	}
+
+	rc = nsc_compose_message(clear->nsc, s, data, nWidth, nHeight, nStep);
+	free(data);
+	return rc;
+}
+
+static BOOL clear_encode_subcodec(CLEAR_CONTEXT* clear, wStream* s, const UINT32* pixels,
+                                  UINT32 nWidth, UINT32 yStart, UINT32 nHeight,
+                                  const CLEAR_ENCODE_STRIP* strip)
+{
+	UINT32 i;
+	BYTE subcodecId;
+	size_t headerPos;
+	size_t bitmapDataByteCount;
+	const UINT32 pixelCount = nWidth * nHeight;
+
+	if (!Stream_EnsureRemainingCapacity(s, 13))
+		return FALSE;
+
+	Stream_Write_UINT16(s, 0); /* xStart (2 bytes) */
+	Stream_Write_UINT16(s, yStart); /* yStart (2 bytes) */
+	Stream_Write_UINT16(s, nWidth); /* width (2 bytes) */
+	Stream_Write_UINT16(s, nHeight); /* height (2 bytes) */
+	headerPos = Stream_GetPosition(s);
+	Stream_Seek(s, 5);
+
+	if (strip->mode == CLEAR_ENCODE_RLEX)
+	{
+		subcodecId = 2;
+
+		if (!clear_encode_subcodec_rlex(s, pixels, pixelCount, strip))
+			return FALSE;
+	}
+	else
+	{
+		subcodecId = 1;
+
+		/* NSCodec does not pay off for every image, fall back to raw pixels */
+		if (!clear_encode_subcodec_nscodec(clear, s, pixels, nWidth, nHeight) ||
+		    (Stream_GetPosition(s) - headerPos - 5 >= pixelCount * 3))
+		{
+			subcodecId = 0;
+			Stream_SetPosition(s, headerPos + 5);
+
+			if (!Stream_EnsureRemainingCapacity(s, pixelCount * 3))
+				return FALSE;
+
+			for (i = 0; i < pixelCount; i++)
+				clear_write_color(s, pixels[i]);
+		}
+	}
+
+	bitmapDataByteCount = Stream_GetPosition(s) - headerPos - 5;
+	Stream_SetPosition(s, headerPos);
+	Stream_Write_UINT32(s, (UINT32) bitmapDataByteCount); /* bitmapDataByteCount (4 bytes) */
+	Stream_Write_UINT8(s, subcodecId); /* subcodecId (1 byte) */
+	Stream_Seek(s, bitmapDataByteCount);
+	return TRUE;
+}
+
+static BOOL clear_encode_glyph(CLEAR_CONTEXT* clear, const UINT32* pixels, UINT32 pixelCount,
+                               UINT16* pGlyphIndex, BOOL* pHit)
+{
+	CLEAR_GLYPH_ENTRY* glyphEntry;
+	UINT32* slot = &clear->GlyphHash[clear_encode_hash(pixels, pixelCount, 1) &
+	                                 (CLEAR_ENCODE_GLYPH_HASH_SIZE - 1)];
+
+	if (*slot)
+	{
+		glyphEntry = &clear->GlyphCache[*slot - 1];
+
+		if (clear_encode_entry_equal(clear, (const BYTE*) glyphEntry->pixels, glyphEntry->count,
+		                             pixels, pixelCount, 1))
+		{
+			*pGlyphIndex = (UINT16)(*slot - 1);
+			*pHit = TRUE;
+			return TRUE;
+		}
+	}
+
+	/* the decoder stores the decoded glyph at glyphIndex, keep an identical copy */
+	glyphEntry = &clear->GlyphCache[clear->GlyphCursor];
+
+	if (pixelCount > glyphEntry->size)
+	{
+		UINT32* tmp = (UINT32*) realloc(glyphEntry->pixels,
+		                                pixelCount * GetBytesPerPixel(clear->format));
+
+		if (!tmp)
+			return FALSE;
+
+		glyphEntry->size = pixelCount;
+		glyphEntry->pixels = tmp;
+	}
+
+	glyphEntry->count = pixelCount;
+	clear_encode_entry_store(clear, (BYTE*) glyphEntry->pixels, pixels, pixelCount, 1);
+	*slot = clear->GlyphCursor + 1;
+	*pGlyphIndex = (UINT16) clear->GlyphCursor;
+	*pHit = FALSE;
+	clear->GlyphCursor = (clear->GlyphCursor + 1) % 4000;
+	return TRUE;
+}
+
+static BOOL clear_encode_message(CLEAR_CONTEXT* clear, wStream* s, const UINT32* pixels,
+                                 UINT32 nWidth, UINT32 nHeight)
+{
+	UINT32 y;
+	BYTE glyphFlags = 0;
+	UINT16 glyphIndex = 0;
+	BOOL glyphHit = FALSE;
+	BOOL hasResidual = FALSE;
+	size_t countPos, startPos;
+	UINT32 residualByteCount = 0;
+	UINT32 bandsByteCount = 0;
+	UINT32 subcodecByteCount = 0;
+	UINT32 mask = 1;
+	UINT32* seen = NULL;
+	CLEAR_ENCODE_STRIP* strips;
+	const UINT32 numStrips = (nHeight + CLEAR_ENCODE_STRIP_HEIGHT - 1) / CLEAR_ENCODE_STRIP_HEIGHT;
+	const UINT32 pixelCount = nWidth * nHeight;
+	const BOOL glyph = (pixelCount <= CLEAR_ENCODE_GLYPH_MAX_PIXELS);
+
+	if (clear->CacheResetPending || (clear->seqNumber == 0))
+	{
+		glyphFlags |= CLEARCODEC_FLAG_CACHE_RESET;
+		clear->VBarStorageCursor = 0;
+		clear->ShortVBarStorageCursor = 0;
+		clear->CacheResetPending = FALSE;
+	}
+
+	if (glyph)
+	{
+		if (!clear_encode_glyph(clear, pixels, pixelCount, &glyphIndex, &glyphHit))
+			return FALSE;
+
+		glyphFlags |= CLEARCODEC_FLAG_GLYPH_INDEX;
+
+		if (glyphHit)
+			glyphFlags |= CLEARCODEC_FLAG_GLYPH_HIT;
+	}
+
+	if (!Stream_EnsureRemainingCapacity(s, 16))
+		return FALSE;
+
+	Stream_Write_UINT8(s, glyphFlags); /* glyphFlags (1 byte) */
+	Stream_Write_UINT8(s, clear->seqNumber); /* seqNumber (1 byte) */
+	clear->seqNumber = (clear->seqNumber + 1) % 256;
+
+	if (glyphFlags & CLEARCODEC_FLAG_GLYPH_INDEX)
+		Stream_Write_UINT16(s, glyphIndex); /* glyphIndex (2 bytes) */
+
+	/* a glyph hit is fully described by the glyph cache, no composition payload */
+	if (glyphHit)
+		return TRUE;
+
+	while (mask < nWidth * 2)
+		mask <<= 1;
+
+	mask--;
+	seen = (UINT32*) calloc(mask + 1, sizeof(UINT32));
+	strips = (CLEAR_ENCODE_STRIP*) calloc(numStrips, sizeof(CLEAR_ENCODE_STRIP));
+
+	if (!strips || !seen)
+		goto fail;
+
+	for (y = 0; y < numStrips; y++)
+	{
+		const UINT32 yStart = y * CLEAR_ENCODE_STRIP_HEIGHT;
+		/* glyph cache entries must be exact, never use the lossy NSCodec for them */
+		clear_encode_plan_strip(clear, &pixels[yStart * nWidth], nWidth,
+		                        MIN(CLEAR_ENCODE_STRIP_HEIGHT, nHeight - yStart), !glyph, seen, mask,
+		                        &strips[y]);
+
+		if (strips[y].mode == CLEAR_ENCODE_RESIDUAL)
+			hasResidual = TRUE;
+	}
+
+	countPos = Stream_GetPosition(s);
+	Stream_Seek(s, 12);
+	startPos = Stream_GetPosition(s);
+
+	if (hasResidual)
+	{
+		if (!clear_encode_residual(s, pixels, nWidth, nHeight, strips))
+			goto fail;
+
+		residualByteCount = (UINT32)(Stream_GetPosition(s) - startPos);
+	}
+
+	startPos = Stream_GetPosition(s);
+
+	for (y = 0; y < numStrips; y++)
+	{
+		const UINT32 yStart = y * CLEAR_ENCODE_STRIP_HEIGHT;
+
+		if (strips[y].mode != CLEAR_ENCODE_BANDS)
+			continue;
+
+		if (!clear_encode_bands(clear, s, &pixels[yStart * nWidth], nWidth, yStart,
+		                        MIN(CLEAR_ENCODE_STRIP_HEIGHT, nHeight - yStart), strips[y].colorBkg))
+			goto fail;
+	}
+
+	bandsByteCount = (UINT32)(Stream_GetPosition(s) - startPos);
+	startPos = Stream_GetPosition(s);
+
+	for (y = 0; y < numStrips; y++)
+	{
+		const UINT32 yStart = y * CLEAR_ENCODE_STRIP_HEIGHT;
+
+		if ((strips[y].mode != CLEAR_ENCODE_RLEX) && (strips[y].mode != CLEAR_ENCODE_IMAGE))
+			continue;
+
+		if (!clear_encode_subcodec(clear, s, &pixels[yStart * nWidth], nWidth, yStart,
+		                           MIN(CLEAR_ENCODE_STRIP_HEIGHT, nHeight - yStart), &strips[y]))
+			goto fail;
+	}
+
+	subcodecByteCount = (UINT32)(Stream_GetPosition(s) - startPos);
+	startPos = Stream_GetPosition(s);
+	Stream_SetPosition(s, countPos);
+	Stream_Write_UINT32(s, residualByteCount); /* residualByteCount (4 bytes) */
+	Stream_Write_UINT32(s, bandsByteCount); /* bandsByteCount (4 bytes) */
+	Stream_Write_UINT32(s, subcodecByteCount); /* subcodecByteCount (4 bytes) */
+	Stream_SetPosition(s, startPos);
+	free(seen);
+	free(strips);
+	return TRUE;
+fail:
+	free(seen);
+	free(strips);
+	return FALSE;
+}
+
+/**
+ * Encodes a bitmap as a ClearCodec message.
+ *
+ * Rows are processed in strips of 52 pixels (the maximum vBar height), each
+ * strip is sent as residual data, bands or subcodec (RLEX, NSCodec or raw)
+ * depending on which is estimated to be the smallest. Bitmaps up to 1024
+ * pixels are placed in the glyph cache and repeats are sent as glyph hits.
+ *
+ * The returned buffer is owned by the context and valid until the next call.
+ */
+int clear_compress(CLEAR_CONTEXT* clear, const BYTE* pSrcData, UINT32 SrcFormat,
+                   UINT32 nSrcStep, UINT32 nWidth, UINT32 nHeight,
                    BYTE** ppDstData, UINT32* pDstSize)
 {
-	WLog_ERR(TAG, "TODO: %s not implemented!", __FUNCTION__);
+	UINT32 i;
+	UINT32* pixels;
+	wStream* s;
+
+	if (!clear || !clear->Compressor || !pSrcData || !ppDstData || !pDstSize)
+		return -1;
+
+	if ((nWidth == 0) || (nHeight == 0) || (nWidth > 0xFFFF) || (nHeight > 0xFFFF))
+		return -1;
+
+	if (nSrcStep == 0)
+		nSrcStep = nWidth * GetBytesPerPixel(SrcFormat);
+
+	if (!clear_resize_buffer(clear, nWidth, nHeight))
+		return -1;
+
+	pixels = (UINT32*) clear->TempBuffer;
+
+	if (!freerdp_image_copy(clear->TempBuffer, clear->format, nWidth * 4, 0, 0, nWidth, nHeight,
+	                        pSrcData, SrcFormat, nSrcStep, 0, 0, NULL, FREERDP_FLIP_NONE))
+		return -1;
+
+	/* work on canonical colors, the alpha channel is not transmitted */
+	for (i = 0; i < nWidth * nHeight; i++)
+	{
+		const UINT32 color = ReadColor(&clear->TempBuffer[i * 4], clear->format);
+		pixels[i] = FreeRDPGetColor(clear->format, (BYTE)(color >> 8), (BYTE)(color >> 16),
+		                            (BYTE)(color >> 24), 0xFF);
+	}
+
+	s = clear->buffer;
+	Stream_SetPosition(s, 0);
+
+	if (!clear_encode_message(clear, s, pixels, nWidth, nHeight))
+	{
+		/* the decoder caches no longer match what the encoder assumes */
+		clear_encode_reset_caches(clear);
+		return -1;
+	}
+
+	Stream_SealLength(s);
+	*ppDstData = Stream_Buffer(s);
+	*pDstSize = (UINT32) Stream_Length(s);
 	return 1;
 }
+
 BOOL clear_context_reset(CLEAR_CONTEXT* clear)
 {
 	if (!clear)
 		return FALSE;
 
 	clear->seqNumber = 0;
+	clear_encode_reset_caches(clear);
 	return TRUE;
 }
 CLEAR_CONTEXT* clear_context_new(BOOL Compressor)
@@ -1204,6 +2026,17 @@ CLEAR_CONTEXT* clear_context_new(BOOL Compressor)
 	if (!updateContextFormat(clear, PIXEL_FORMAT_BGRX32))
 		goto error_nsc;
 
+	if (Compressor)
+	{
+		clear->buffer = Stream_New(NULL, 4096);
+		clear->GlyphHash = (UINT32*) calloc(CLEAR_ENCODE_GLYPH_HASH_SIZE, sizeof(UINT32));
+		clear->VBarHash = (UINT32*) calloc(CLEAR_ENCODE_VBAR_HASH_SIZE, sizeof(UINT32));
+		clear->ShortVBarHash = (UINT32*) calloc(CLEAR_ENCODE_SHORT_VBAR_HASH_SIZE, sizeof(UINT32));
+
+		if (!clear->buffer || !clear->GlyphHash || !clear->VBarHash || !clear->ShortVBarHash)
+			goto error_nsc;
+	}
+
 	if (!clear_resize_buffer(clear, 512, 512))
 		goto error_nsc;
 
@@ -1227,6 +2060,10 @@ void clear_context_free(CLEAR_CONTEXT* clear)
 
 	nsc_context_free(clear->nsc);
 	free(clear->TempBuffer);
+	Stream_Free(clear->buffer, TRUE);
+	free(clear->GlyphHash);
+	free(clear->VBarHash);
+	free(clear->ShortVBarHash);
 
 	for (i = 0; i < 4000; i++)
 		free(clear->GlyphCache[i].pixels);
@@ -33,14 +33,6 @@
 #include <freerdp/freerdp.h>
 #include <freerdp/primitives.h>
 
-#if defined(CAIRO_FOUND)
-#include <cairo.h>
-#endif
-
-#if defined(SWSCALE_FOUND)
-#include <libswscale/swscale.h>
-#endif
-
 #define TAG FREERDP_TAG("color")
 
 BYTE* freerdp_glyph_convert(UINT32 width, UINT32 height, const BYTE* data)
@@ -723,113 +715,3 @@ BOOL freerdp_image_fill(BYTE* pDstData, DWORD DstFormat,
 
 	return TRUE;
 }
-
-#if defined(SWSCALE_FOUND)
-static int av_format_for_buffer(UINT32 format)
-{
-	switch (format)
-	{
-		case PIXEL_FORMAT_ARGB32:
-			return AV_PIX_FMT_BGRA;
-
-		case PIXEL_FORMAT_XRGB32:
-			return AV_PIX_FMT_BGR0;
-
-		case PIXEL_FORMAT_BGRA32:
-			return AV_PIX_FMT_RGBA;
-
-		case PIXEL_FORMAT_BGRX32:
-			return AV_PIX_FMT_RGB0;
-
-		default:
-			return AV_PIX_FMT_NONE;
-	}
-}
-#endif
-
-BOOL freerdp_image_scale(BYTE* pDstData, DWORD DstFormat, UINT32 nDstStep,
-                         UINT32 nXDst, UINT32 nYDst, UINT32 nDstWidth, UINT32 nDstHeight,
-                         const BYTE* pSrcData, DWORD SrcFormat, UINT32 nSrcStep,
-                         UINT32 nXSrc, UINT32 nYSrc, UINT32 nSrcWidth, UINT32 nSrcHeight)
-{
-	BOOL rc = FALSE;
-	const BYTE* src = &pSrcData[nXSrc * GetBytesPerPixel(SrcFormat) + nYSrc * nSrcStep];
-	BYTE* dst = &pDstData[nXDst * GetBytesPerPixel(DstFormat) + nYDst * nDstStep];
-
-	/* direct copy is much faster than scaling, so check if we can simply copy... */
-	if ((nDstWidth == nSrcWidth) && (nDstHeight == nSrcHeight))
-	{
-		return freerdp_image_copy(pDstData, DstFormat, nDstStep, nXDst, nYDst, nDstWidth, nDstHeight,
-		                          pSrcData, SrcFormat, nSrcStep, nXSrc, nYSrc,
-		                          NULL, FREERDP_FLIP_NONE);
-	}
-	else
-#if defined(SWSCALE_FOUND)
-	{
-		int res;
-		struct SwsContext* resize;
-		int srcFormat = av_format_for_buffer(SrcFormat);
-		int dstFormat = av_format_for_buffer(DstFormat);
-		const int srcStep[1] = { (int)nSrcStep };
-		const int dstStep[1] = { (int)nDstStep };
-
-		if ((srcFormat == AV_PIX_FMT_NONE) || (dstFormat == AV_PIX_FMT_NONE))
-			return FALSE;
-
-		resize = sws_getContext((int)nSrcWidth, (int)nSrcHeight, srcFormat,
-		                        (int)nDstWidth, (int)nDstHeight, dstFormat,
-		                        SWS_BILINEAR, NULL, NULL, NULL);
-
-		if (!resize)
-			goto fail;
-
-		res = sws_scale(resize, &src, srcStep, 0, (int)nSrcHeight, &dst, dstStep);
-		rc = (res == ((int)nDstHeight));
-	fail:
-		sws_freeContext(resize);
-	}
-
-#elif defined(CAIRO_FOUND)
-	{
-		const double sx = (double)nDstWidth / (double)nSrcWidth;
-		const double sy = (double)nDstHeight / (double)nSrcHeight;
-		cairo_t* cairo_context;
-		cairo_surface_t* csrc, *cdst;
-
-		if ((nSrcWidth > INT_MAX) || (nSrcHeight > INT_MAX) || (nSrcStep > INT_MAX))
-			return FALSE;
-
-		if ((nDstWidth > INT_MAX) || (nDstHeight > INT_MAX) || (nDstStep > INT_MAX))
-			return FALSE;
-
-		csrc = cairo_image_surface_create_for_data((void*)src,
-		        CAIRO_FORMAT_ARGB32, (int)nSrcWidth, (int)nSrcHeight, (int)nSrcStep);
-		cdst = cairo_image_surface_create_for_data(dst,
-		        CAIRO_FORMAT_ARGB32, (int)nDstWidth, (int)nDstHeight, (int)nDstStep);
-
-		if (!csrc || !cdst)
-			goto fail;
-
-		cairo_context = cairo_create(cdst);
-
-		if (!cairo_context)
-			goto fail2;
-
-		cairo_scale(cairo_context, sx, sy);
-		cairo_set_operator(cairo_context, CAIRO_OPERATOR_SOURCE);
-		cairo_set_source_surface(cairo_context, csrc, 0, 0);
-		cairo_paint(cairo_context);
-		rc = TRUE;
-	fail2:
-		cairo_destroy(cairo_context);
-	fail:
-		cairo_surface_destroy(csrc);
-		cairo_surface_destroy(cdst);
-	}
-#else
-	{
-		WLog_WARN(TAG, "SmartScaling requested but compiled without libcairo support!");
-	}
-#endif
-	return rc;
-}
@@ -218,8 +218,14 @@ INT32 avc420_compress(H264_CONTEXT* h264, const BYTE* pSrcData, DWORD SrcFormat,
 		return -1;
 
 	{
+		INT32 rc;
 		const BYTE* pYUVData[3] = {h264->pYUVData[0], h264->pYUVData[1], h264->pYUVData[2]};
-		return h264->subsystem->Compress(h264, pYUVData, h264->iStride, ppDstData, pDstSize);
+		rc = h264->subsystem->Compress(h264, pYUVData, h264->iStride, ppDstData, pDstSize);
+
+		if (rc >= 0)
+			h264_context_rate_control(h264, *pDstSize);
+
+		return rc;
 	}
 }
 
@@ -287,6 +293,7 @@ INT32 avc444_compress(H264_CONTEXT* h264, const BYTE* pSrcData, DWORD SrcFormat,
 	*ppAuxDstData = coded;
 	*pAuxDstSize = codedSize;
 	*op = 0;
+	h264_context_rate_control(h264, *pDstSize + *pAuxDstSize);
 	return 0;
 }
 
@@ -576,6 +583,256 @@ BOOL h264_context_reset(H264_CONTEXT* h264, UINT32 width, UINT32 height)
 	return TRUE;
 }
 
+/* Share of the measured bandwidth the video stream may use */
+#define H264_RC_HEADROOM_PERCENT 80
+/* Frames the client may have in flight on top of the ones on the wire */
+#define H264_RC_QUEUE_SLACK 2
+/* Bits per pixel an average frame needs at H264_RC_REF_QP, in 1/1000 */
+#define H264_RC_REF_QP 26
+#define H264_RC_REF_MBPP 100
+/* Below this many bits per pixel the frame rate is lowered instead, in 1/1000 */
+#define H264_RC_MIN_MBPP 50
+#define H264_RC_MIN_BITRATE 100000
+#define H264_RC_MIN_FRAMERATE 5
+#define H264_RC_MIN_QP 18
+#define H264_RC_MAX_QP 45
+
+/* 2^(n/6) for n = 1..5, six QP steps double the quantizer step size */
+static const double h264_rc_qp_steps[] = { 1.12246, 1.25992, 1.41421, 1.58740, 1.78180 };
+
+/* QP difference that scales the encoded size down by ratio */
+static INT32 h264_rate_control_qp_delta(double ratio)
+{
+	size_t i;
+	INT32 delta = 0;
+
+	if (ratio <= 0.0)
+		return 0;
+
+	for (; ratio >= 2.0; ratio /= 2.0)
+		delta += 6;
+
+	for (; ratio < 1.0; ratio *= 2.0)
+		delta -= 6;
+
+	for (i = 0; (i < ARRAYSIZE(h264_rc_qp_steps)) && (ratio >= h264_rc_qp_steps[i]); i++)
+		delta++;
+
+	return delta;
+}
+
+/* Size scale of a QP difference, inverse of h264_rate_control_qp_delta */
+static double h264_rate_control_qp_scale(INT32 delta)
+{
+	double scale = 1.0;
+
+	for (; delta >= 6; delta -= 6)
+		scale /= 2.0;
+
+	for (; delta < 0; delta += 6)
+		scale *= 2.0;
+
+	if (delta > 0)
+		scale /= h264_rc_qp_steps[delta - 1];
+
+	return scale;
+}
+
+/**
+ * Enables the adaptive rate control. BitRate, FrameRate and QP are then
+ * derived for every frame from the network feedback given with
+ * h264_context_update_network and h264_context_update_queue_depth.
+ * The current settings become the upper limits unless the caller
+ * already set limits in RateControl.
+ */
+BOOL h264_context_enable_rate_control(H264_CONTEXT* h264, BOOL enable)
+{
+	H264_RATECONTROL* rc;
+
+	if (!h264 || !h264->Compressor)
+		return FALSE;
+
+	rc = &h264->RateControl;
+
+	if (enable && !rc->Enabled)
+	{
+		if (rc->MaxBitRate == 0)
+			rc->MaxBitRate = h264->BitRate;
+
+		if (rc->MinBitRate == 0)
+			rc->MinBitRate = MIN(H264_RC_MIN_BITRATE, rc->MaxBitRate);
+
+		if (rc->MaxFrameRate <= 0)
+			rc->MaxFrameRate = h264->FrameRate;
+
+		if (rc->MinFrameRate <= 0)
+			rc->MinFrameRate = MIN(H264_RC_MIN_FRAMERATE, rc->MaxFrameRate);
+
+		if (rc->MaxQP == 0)
+			rc->MaxQP = H264_RC_MAX_QP;
+
+		if (rc->MinQP == 0)
+			rc->MinQP = MIN(H264_RC_MIN_QP, rc->MaxQP);
+
+		if ((rc->MaxBitRate == 0) || (rc->MaxFrameRate <= 0) || (rc->MinBitRate > rc->MaxBitRate) ||
+		    (rc->MinFrameRate > rc->MaxFrameRate) || (rc->MinQP > rc->MaxQP))
+			return FALSE;
+
+		rc->TargetBitRate = rc->MaxBitRate;
+		rc->Buffer = 0;
+		rc->Complexity = 1.0;
+	}
+
+	rc->Enabled = enable;
+	return TRUE;
+}
+
+/**
+ * Network characteristics as measured by the auto-detection,
+ * bandwidth in kbit/s and rtt in ms. Zero values are ignored.
+ */
+BOOL h264_context_update_network(H264_CONTEXT* h264, UINT32 bandwidth, UINT32 rtt)
+{
+	H264_RATECONTROL* rc;
+
+	if (!h264)
+		return FALSE;
+
+	rc = &h264->RateControl;
+
+	if (bandwidth > 0)
+		rc->Bandwidth = bandwidth;
+
+	if (rtt > 0)
+	{
+		rc->RTT = rtt;
+
+		if ((rc->BaseRTT == 0) || (rtt < rc->BaseRTT))
+			rc->BaseRTT = rtt;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Number of frames sent but not yet acknowledged by the client.
+ */
+BOOL h264_context_update_queue_depth(H264_CONTEXT* h264, UINT32 queueDepth)
+{
+	if (!h264)
+		return FALSE;
+
+	h264->RateControl.QueueDepth = queueDepth;
+	return TRUE;
+}
+
+/**
+ * Accounts a frame of lastFrameSize bytes that was just encoded and
+ * updates BitRate, FrameRate and QP for the next one.
+ * avc420_compress and avc444_compress call this for every frame.
+ */
+BOOL h264_context_rate_control(H264_CONTEXT* h264, UINT32 lastFrameSize)
+{
+	H264_RATECONTROL* rc;
+	UINT64 available;
+	UINT64 target;
+	UINT64 pixels;
+	UINT32 allowedQueue;
+	double frameRate;
+	double frameBits;
+	double refBits;
+	INT32 qp;
+	BOOL congested;
+
+	if (!h264)
+		return FALSE;
+
+	rc = &h264->RateControl;
+
+	if (!rc->Enabled)
+		return TRUE;
+
+	pixels = (UINT64) h264->width * h264->height;
+
+	if ((pixels == 0) || (h264->FrameRate <= 0))
+		return FALSE;
+
+	/* Leaky bucket of what was sent beyond the budget of the last frame */
+	frameBits = (double) rc->TargetBitRate / h264->FrameRate;
+	refBits = (double) pixels * H264_RC_REF_MBPP / 1000.0;
+
+	if (lastFrameSize > 0)
+	{
+		rc->Buffer += (INT64)(lastFrameSize * 8.0 - frameBits);
+
+		if (rc->Buffer < 0)
+			rc->Buffer = 0;
+
+		/* How the content compares to the QP model, only meaningful with a fixed QP */
+		if ((h264->RateControlMode == H264_RATECONTROL_CQP) && (h264->QP > 0))
+		{
+			const double expected = refBits * h264_rate_control_qp_scale((INT32) h264->QP -
+			                        H264_RC_REF_QP);
+			rc->Complexity = (rc->Complexity * 7.0 + lastFrameSize * 8.0 / expected) / 8.0;
+		}
+	}
+
+	/* Bit rate: back off fast on congestion, approach the link capacity slowly */
+	if (rc->Bandwidth > 0)
+		available = (UINT64) rc->Bandwidth * 1000 * H264_RC_HEADROOM_PERCENT / 100;
+	else
+		available = rc->MaxBitRate;
+
+	allowedQueue = H264_RC_QUEUE_SLACK + (UINT32)(rc->RTT * h264->FrameRate / 1000);
+	congested = (rc->QueueDepth > allowedQueue);
+
+	if ((rc->BaseRTT > 0) && (rc->RTT > 2 * rc->BaseRTT + 50))
+		congested = TRUE;
+
+	target = rc->TargetBitRate;
+
+	if (congested)
+		target = target * 85 / 100;
+	else if (target < available)
+		target += (available - target) / 8 + 1;
+
+	target = MIN(target, available);
+	target = MAX(target, rc->MinBitRate);
+	target = MIN(target, rc->MaxBitRate);
+	rc->TargetBitRate = (UINT32) target;
+
+	/* Frame rate: fewer frames rather than frames without any detail.
+	 * Only whole frame rates and changes of at least 20% to avoid
+	 * encoder reconfiguration on every frame. */
+	frameRate = (double) target * 1000.0 / ((double) pixels * H264_RC_MIN_MBPP);
+	frameRate = MIN(frameRate, rc->MaxFrameRate);
+	frameRate = MAX(frameRate, rc->MinFrameRate);
+	frameRate = (double)(UINT32)(frameRate + 0.5);
+
+	if ((frameRate >= h264->FrameRate * 1.2) || (frameRate <= h264->FrameRate * 0.8) ||
+	    (frameRate >= rc->MaxFrameRate) || (frameRate <= rc->MinFrameRate))
+		h264->FrameRate = (FLOAT) frameRate;
+
+	/* QP: the QP model, corrected by the measured complexity and one
+	 * step per frame worth of bits that is still in the bucket */
+	frameBits = MAX(1.0, (double) target / h264->FrameRate);
+	qp = H264_RC_REF_QP + h264_rate_control_qp_delta(refBits * rc->Complexity / frameBits);
+	qp += (INT32) MIN(6, rc->Buffer / (INT64) frameBits);
+	qp = MAX(qp, (INT32) rc->MinQP);
+	qp = MIN(qp, (INT32) rc->MaxQP);
+
+	/* Limit the change per frame to avoid visible pumping */
+	if (h264->QP > 0)
+	{
+		qp = MIN(qp, (INT32) h264->QP + 2);
+		qp = MAX(qp, (INT32) h264->QP - 2);
+	}
+
+	h264->BitRate = rc->TargetBitRate;
+	h264->QP = (UINT32) qp;
+	return TRUE;
+}
+
 H264_CONTEXT* h264_context_new(BOOL Compressor)
 {
 	H264_CONTEXT* h264;
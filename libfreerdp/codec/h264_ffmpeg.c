@@ -131,10 +131,32 @@ static BOOL libavcodec_create_encoder(H264_CONTEXT* h264)
 		if ((sys->codecEncoderContext->width != (int)h264->width) ||
 		    (sys->codecEncoderContext->height != (int)h264->height))
 			recreate = TRUE;
+
+		/* The time base of an open encoder can not be changed */
+		if (sys->codecEncoderContext->time_base.den != (int)h264->FrameRate)
+			recreate = TRUE;
 	}
 
 	if (!recreate)
+	{
+		/* Encoders that support reconfiguration (libx264) pick up
+		 * changed rate control settings with the next frame. */
+		switch (h264->RateControlMode)
+		{
+			case H264_RATECONTROL_VBR:
+				sys->codecEncoderContext->bit_rate = h264->BitRate;
+				break;
+
+			case H264_RATECONTROL_CQP:
+				av_opt_set_int(sys->codecEncoderContext, "qp", h264->QP, AV_OPT_SEARCH_CHILDREN);
+				break;
+
+			default:
+				break;
+		}
+
 		return TRUE;
+	}
 
 	libavcodec_destroy_encoder(h264);
 	sys->codecEncoder = avcodec_find_encoder(AV_CODEC_ID_H264);
@@ -154,7 +176,7 @@ static BOOL libavcodec_create_encoder(H264_CONTEXT* h264)
 			break;
 
 		case H264_RATECONTROL_CQP:
-			/* TODO: sys->codecEncoderContext-> = h264->QP; */
+			av_opt_set_int(sys->codecEncoderContext, "qp", h264->QP, AV_OPT_SEARCH_CHILDREN);
 			break;
 
 		default:
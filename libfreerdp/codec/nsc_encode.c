@@ -110,10 +110,10 @@ static BOOL nsc_encode_argb_to_aycocg(NSC_CONTEXT* context, const BYTE* data,
 	rw = (context->ChromaSubsamplingLevel ? tempWidth : context->width);
 	ccl = context->ColorLossLevel;
 
-	if (context->priv->PlaneBuffersLength < rw * scanline)
+	if (context->priv->PlaneBuffersLength < rw * context->height)
 		return FALSE;
 
-	if (rw < scanline * 2)
+	if (scanline < context->width * GetBytesPerPixel(context->format))
 		return FALSE;
 
 	for (y = 0; y < context->height; y++)
@@ -616,7 +616,12 @@ BOOL nsc_compose_message(NSC_CONTEXT* context, wStream* s, const BYTE* data,
 
 	/* ARGB to AYCoCg conversion, chroma subsampling and colorloss reduction */
 	PROFILER_ENTER(context->priv->prof_nsc_encode)
-	context->encode(context, data, scanline);
+	if (!context->encode(context, data, scanline))
+	{
+		PROFILER_EXIT(context->priv->prof_nsc_encode)
+		return FALSE;
+	}
+
 	PROFILER_EXIT(context->priv->prof_nsc_encode)
 	/* RLE encode */
 	PROFILER_ENTER(context->priv->prof_nsc_rle_compress_data)
@@ -63,10 +63,10 @@ static BOOL nsc_encode_argb_to_aycocg_sse2(NSC_CONTEXT* context,
 	rw = (context->ChromaSubsamplingLevel > 0 ? tempWidth : context->width);
 	ccl = context->ColorLossLevel;
 
-	if (context->priv->PlaneBuffersLength < rw * scanline)
+	if (context->priv->PlaneBuffersLength < rw * context->height)
 		return FALSE;
 
-	if (rw < scanline * 2)
+	if (scanline < context->width * GetBytesPerPixel(context->format))
 		return FALSE;
 
 	for (y = 0; y < context->height; y++)
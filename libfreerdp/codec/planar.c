@@ -25,19 +25,163 @@
 
 #include <winpr/crt.h>
 #include <winpr/print.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
 
 #include <freerdp/primitives.h>
 #include <freerdp/log.h>
 #include <freerdp/codec/bitmap.h>
 #include <freerdp/codec/planar.h>
 
+#include "planar.h"
+
 #define TAG FREERDP_TAG("codec")
 
-static INLINE BOOL freerdp_bitmap_planar_compress_plane_rle(const BYTE* plane, UINT32 width,
-                                                            UINT32 height, BYTE* outPlane,
-                                                            UINT32* dstSize);
-static INLINE BYTE* freerdp_bitmap_planar_delta_encode_plane(const BYTE* inPlane, UINT32 width,
-                                                             UINT32 height, BYTE* outPlane);
+/* bitmaps with fewer pixels are not worth splitting into bands */
+#define PLANAR_BAND_MIN_PIXELS (256 * 256)
+#define PLANAR_BAND_HEIGHT 64
+
+static FREERDP_PLANAR_KERNELS planar_kernels;
+static INIT_ONCE planar_init_once = INIT_ONCE_STATIC_INIT;
+
+static void planar_delta_encode_c(BYTE* pDst, const BYTE* pSrc, const BYTE* pPrev, UINT32 width)
+{
+	UINT32 x;
+
+	for (x = 0; x < width; x++)
+	{
+		const INT8 d = (INT8)(pSrc[x] - pPrev[x]);
+		pDst[x] = (BYTE)((d << 1) ^ (d >> 7));
+	}
+}
+
+static void planar_delta_decode_c(BYTE* pDst, const BYTE* pSrc, const BYTE* pPrev, UINT32 width)
+{
+	UINT32 x;
+
+	for (x = 0; x < width; x++)
+	{
+		const BYTE v = pSrc[x];
+		pDst[x] = (BYTE)(pPrev[x] + ((v >> 1) ^ (0 - (v & 1))));
+	}
+}
+
+static void planar_split32_c(const BYTE* pSrc, BYTE* pDst[4], UINT32 width)
+{
+	UINT32 x, c;
+
+	for (c = 0; c < 4; c++)
+	{
+		BYTE* plane = pDst[c];
+
+		if (!plane)
+			continue;
+
+		for (x = 0; x < width; x++)
+			plane[x] = pSrc[x * 4 + c];
+	}
+}
+
+static void planar_merge32_c(BYTE* pDst, const BYTE* pSrc[4], UINT32 width)
+{
+	UINT32 x, c;
+
+	for (c = 0; c < 4; c++)
+	{
+		const BYTE* plane = pSrc[c];
+
+		if (plane)
+		{
+			for (x = 0; x < width; x++)
+				pDst[x * 4 + c] = plane[x];
+		}
+		else
+		{
+			for (x = 0; x < width; x++)
+				pDst[x * 4 + c] = 0xFF;
+		}
+	}
+}
+
+static BOOL CALLBACK planar_init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	WINPR_UNUSED(once);
+	WINPR_UNUSED(param);
+	WINPR_UNUSED(context);
+	planar_kernels.DeltaEncode = planar_delta_encode_c;
+	planar_kernels.DeltaDecode = planar_delta_decode_c;
+	planar_kernels.Split32 = planar_split32_c;
+	planar_kernels.Merge32 = planar_merge32_c;
+#if defined(WITH_SSE2)
+	freerdp_planar_init_sse2(&planar_kernels);
+#endif
+	return TRUE;
+}
+
+/**
+ * Runs callback for every index, on the worker pool if there is one.
+ * The pool is only created once a bitmap is large enough to be split.
+ */
+static BOOL planar_parallel_for(BITMAP_PLANAR_CONTEXT* planar, ULONG count,
+                                PTP_PARALLEL_CALLBACK callback, PVOID context)
+{
+	ULONG index;
+	BITMAP_PLANAR_CONTEXT_PRIV* priv = planar->priv;
+
+	if ((count > 1) && (priv->numWorkers > 1) && !priv->ThreadPool)
+	{
+		/* initialize the primitives before they are used from the pool threads */
+		primitives_get();
+
+		if (!(priv->ThreadPool = CreateThreadpool(NULL)))
+			return FALSE;
+
+		InitializeThreadpoolEnvironment(&priv->ThreadPoolEnv);
+		SetThreadpoolCallbackPool(&priv->ThreadPoolEnv, priv->ThreadPool);
+		SetThreadpoolThreadMaximum(priv->ThreadPool, priv->numWorkers);
+
+		if (!(priv->Parallel = CreateThreadpoolParallel(&priv->ThreadPoolEnv, priv->numWorkers)))
+		{
+			CloseThreadpool(priv->ThreadPool);
+			priv->ThreadPool = NULL;
+			return FALSE;
+		}
+	}
+
+	if ((count > 1) && priv->Parallel)
+		return ThreadpoolParallelFor(priv->Parallel, count, callback, context);
+
+	for (index = 0; index < count; index++)
+		callback(context, index);
+
+	return TRUE;
+}
+
+static UINT32 planar_band_count(UINT32 width, UINT32 height)
+{
+	if ((width * height < PLANAR_BAND_MIN_PIXELS) || (height < PLANAR_BAND_HEIGHT * 2))
+		return 1;
+
+	return (height + PLANAR_BAND_HEIGHT - 1) / PLANAR_BAND_HEIGHT;
+}
+
+static BOOL planar_resize_buffer(BYTE** ppBuffer, size_t* pSize, size_t size)
+{
+	BYTE* buffer;
+
+	if (*pSize >= size)
+		return TRUE;
+
+	buffer = (BYTE*)_aligned_malloc(size, 16);
+
+	if (!buffer)
+		return FALSE;
+
+	_aligned_free(*ppBuffer);
+	*ppBuffer = buffer;
+	*pSize = size;
+	return TRUE;
+}
 
 static INLINE INT32 planar_skip_plane_rle(const BYTE* pSrcData, UINT32 SrcSize, UINT32 nWidth,
                                           UINT32 nHeight)
@@ -87,57 +231,38 @@ static INLINE INT32 planar_skip_plane_rle(const BYTE* pSrcData, UINT32 SrcSize,
 	return (INT32)(pRLE - pSrcData);
 }
 
-static INLINE INT32 planar_decompress_plane_rle(const BYTE* pSrcData, UINT32 SrcSize,
-                                                BYTE* pDstData, INT32 nDstStep, UINT32 nXDst,
-                                                UINT32 nYDst, UINT32 nWidth, UINT32 nHeight,
-                                                UINT32 nChannel, BOOL vFlip)
+/**
+ * Expands one RLE plane into nWidth * nHeight bytes at pDstData.
+ * Runs repeat the last raw byte of the scanline, which works the same for
+ * absolute values and deltas, so the deltas are resolved per scanline after.
+ */
+static INLINE BOOL planar_decompress_plane_rle(const BYTE* pSrcData, UINT32 SrcSize,
+                                               BYTE* pDstData, UINT32 nWidth, UINT32 nHeight)
 {
-	INT32 x, y;
-	UINT32 pixel;
-	UINT32 cRawBytes;
-	UINT32 nRunLength;
-	INT32 deltaValue;
-	INT32 beg, end, inc;
-	BYTE controlByte;
-	BYTE* currentScanline;
-	BYTE* previousScanline;
+	UINT32 y;
 	const BYTE* srcp = pSrcData;
+	const BYTE* pEnd = &pSrcData[SrcSize];
+	const BYTE* previousScanline = NULL;
 
-	if ((nHeight > INT32_MAX) || (nWidth > INT32_MAX) || (nDstStep > INT32_MAX))
-		return -1;
-
-	previousScanline = NULL;
-
-	if (vFlip)
-	{
-		beg = (INT32)nHeight - 1;
-		end = -1;
-		inc = -1;
-	}
-	else
-	{
-		beg = 0;
-		end = (INT32)nHeight;
-		inc = 1;
-	}
-
-	for (y = beg; y != end; y += inc)
+	for (y = 0; y < nHeight; y++)
 	{
-		BYTE* dstp = &pDstData[((nYDst + y) * (INT32)nDstStep) + (nXDst * 4) + nChannel];
-		pixel = 0;
-		currentScanline = dstp;
+		UINT32 x = 0;
+		BYTE value = 0;
+		BYTE* currentScanline = &pDstData[y * nWidth];
 
-		for (x = 0; x < (INT32)nWidth;)
+		while (x < nWidth)
 		{
-			controlByte = *srcp;
-			srcp++;
+			BYTE controlByte;
+			UINT32 cRawBytes;
+			UINT32 nRunLength;
 
-			if ((srcp - pSrcData) > SrcSize)
+			if (srcp >= pEnd)
 			{
 				WLog_ERR(TAG, "error reading input buffer");
-				return -1;
+				return FALSE;
 			}
 
+			controlByte = *srcp++;
 			nRunLength = PLANAR_CONTROL_BYTE_RUN_LENGTH(controlByte);
 			cRawBytes = PLANAR_CONTROL_BYTE_RAW_BYTES(controlByte);
 
@@ -152,207 +277,169 @@ static INLINE INT32 planar_decompress_plane_rle(const BYTE* pSrcData, UINT32 Src
 				cRawBytes = 0;
 			}
 
-			if (((dstp + (cRawBytes + nRunLength)) - currentScanline) > nWidth * 4)
+			if ((cRawBytes + nRunLength > nWidth - x) || (cRawBytes > (size_t)(pEnd - srcp)))
 			{
 				WLog_ERR(TAG, "too many pixels in scanline");
-				return -1;
+				return FALSE;
 			}
 
-			if (!previousScanline)
+			if (cRawBytes > 0)
 			{
-				/* first scanline, absolute values */
-				while (cRawBytes > 0)
-				{
-					pixel = *srcp;
-					srcp++;
-					*dstp = pixel;
-					dstp += 4;
-					x++;
-					cRawBytes--;
-				}
-
-				while (nRunLength > 0)
-				{
-					*dstp = pixel;
-					dstp += 4;
-					x++;
-					nRunLength--;
-				}
+				CopyMemory(&currentScanline[x], srcp, cRawBytes);
+				srcp += cRawBytes;
+				x += cRawBytes;
+				value = currentScanline[x - 1];
 			}
-			else
-			{
-				/* delta values relative to previous scanline */
-				while (cRawBytes > 0)
-				{
-					deltaValue = *srcp;
-					srcp++;
-
-					if (deltaValue & 1)
-					{
-						deltaValue = deltaValue >> 1;
-						deltaValue = deltaValue + 1;
-						pixel = -deltaValue;
-					}
-					else
-					{
-						deltaValue = deltaValue >> 1;
-						pixel = deltaValue;
-					}
-
-					deltaValue = previousScanline[x * 4] + pixel;
-					*dstp = deltaValue;
-					dstp += 4;
-					x++;
-					cRawBytes--;
-				}
 
-				while (nRunLength > 0)
-				{
-					deltaValue = previousScanline[x * 4] + pixel;
-					*dstp = deltaValue;
-					dstp += 4;
-					x++;
-					nRunLength--;
-				}
-			}
+			FillMemory(&currentScanline[x], nRunLength, value);
+			x += nRunLength;
 		}
 
+		/* the first scanline has absolute values, the others deltas to the one above */
+		if (previousScanline)
+			planar_kernels.DeltaDecode(currentScanline, currentScanline, previousScanline, nWidth);
+
 		previousScanline = currentScanline;
 	}
 
-	return (INT32)(srcp - pSrcData);
+	return TRUE;
 }
 
-static INLINE INT32 planar_set_plane(BYTE bValue, BYTE* pDstData, INT32 nDstStep, UINT32 nXDst,
-                                     UINT32 nYDst, UINT32 nWidth, UINT32 nHeight, UINT32 nChannel,
-                                     BOOL vFlip)
+struct _PLANAR_DECODE_PARAM
 {
-	INT32 x, y;
-	INT32 beg, end, inc;
-
-	if ((nHeight > INT32_MAX) || (nWidth > INT32_MAX) || (nDstStep > INT32_MAX))
-		return -1;
-
-	if (vFlip)
-	{
-		beg = (INT32)nHeight - 1;
-		end = -1;
-		inc = -1;
-	}
-	else
-	{
-		beg = 0;
-		end = (INT32)nHeight;
-		inc = 1;
-	}
-
-	for (y = beg; y != end; y += inc)
-	{
-		BYTE* dstp = &pDstData[((nYDst + y) * (INT32)nDstStep) + (nXDst * 4) + nChannel];
+	const BYTE* rlePlanes[4];
+	UINT32 rleSizes[4];
+	BYTE* planes[4];
+	UINT32 nWidth;
+	UINT32 nHeight;
+	LONG status;
+};
+typedef struct _PLANAR_DECODE_PARAM PLANAR_DECODE_PARAM;
+
+static void CALLBACK planar_decode_plane_callback(PVOID context, ULONG index)
+{
+	PLANAR_DECODE_PARAM* param = (PLANAR_DECODE_PARAM*)context;
 
-		for (x = 0; x < (INT32)nWidth; ++x)
-		{
-			*dstp = bValue;
-			dstp += 4;
-		}
-	}
+	if (!param->rlePlanes[index])
+		return;
 
-	return 0;
+	if (!planar_decompress_plane_rle(param->rlePlanes[index], param->rleSizes[index],
+	                                 param->planes[index], param->nWidth, param->nHeight))
+		InterlockedExchange(&param->status, -1);
 }
 
-static INLINE BOOL writeLine(BYTE** ppRgba, UINT32 DstFormat, UINT32 width, const BYTE** ppR,
-                             const BYTE** ppG, const BYTE** ppB, const BYTE** ppA)
+struct _PLANAR_MERGE_PARAM
 {
-	UINT32 x;
-
-	if (!ppRgba || !ppR || !ppG || !ppB)
-		return FALSE;
+	const BYTE* planes[4]; /* in the byte order of PIXEL_FORMAT_BGRA32 */
+	BYTE* pDstData;
+	UINT32 nDstStep;
+	UINT32 nXDst;
+	UINT32 nYDst;
+	UINT32 nWidth;
+	UINT32 nHeight;
+	UINT32 nBandHeight;
+	BOOL vFlip;
+};
+typedef struct _PLANAR_MERGE_PARAM PLANAR_MERGE_PARAM;
+
+static void CALLBACK planar_merge_band_callback(PVOID context, ULONG index)
+{
+	UINT32 y, c;
+	const PLANAR_MERGE_PARAM* param = (const PLANAR_MERGE_PARAM*)context;
+	const UINT32 first = index * param->nBandHeight;
+	const UINT32 last = MIN(first + param->nBandHeight, param->nHeight);
 
-	switch (DstFormat)
+	for (y = first; y < last; y++)
 	{
-	case PIXEL_FORMAT_BGRA32:
-		for (x = 0; x < width; x++)
-		{
-			*(*ppRgba)++ = *(*ppB)++;
-			*(*ppRgba)++ = *(*ppG)++;
-			*(*ppRgba)++ = *(*ppR)++;
-			*(*ppRgba)++ = *(*ppA)++;
-		}
+		const BYTE* planes[4];
+		const UINT32 row = param->vFlip ? param->nHeight - 1 - y : y;
+		BYTE* pDst = &param->pDstData[(param->nYDst + row) * param->nDstStep + param->nXDst * 4];
 
-		return TRUE;
+		for (c = 0; c < 4; c++)
+			planes[c] = param->planes[c] ? &param->planes[c][y * param->nWidth] : NULL;
 
-	case PIXEL_FORMAT_BGRX32:
-		for (x = 0; x < width; x++)
-		{
-			*(*ppRgba)++ = *(*ppB)++;
-			*(*ppRgba)++ = *(*ppG)++;
-			*(*ppRgba)++ = *(*ppR)++;
-			*(*ppRgba)++ = 0xFF;
-		}
-
-		return TRUE;
-
-	default:
-		if (ppA)
-		{
-			for (x = 0; x < width; x++)
-			{
-				BYTE alpha = *(*ppA)++;
-				UINT32 color = FreeRDPGetColor(DstFormat, *(*ppR)++, *(*ppG)++, *(*ppB)++, alpha);
-				WriteColor(*ppRgba, DstFormat, color);
-				*ppRgba += GetBytesPerPixel(DstFormat);
-			}
-		}
-		else
-		{
-			const BYTE alpha = 0xFF;
-
-			for (x = 0; x < width; x++)
-			{
-				UINT32 color = FreeRDPGetColor(DstFormat, *(*ppR)++, *(*ppG)++, *(*ppB)++, alpha);
-				WriteColor(*ppRgba, DstFormat, color);
-				*ppRgba += GetBytesPerPixel(DstFormat);
-			}
-		}
-
-		return TRUE;
+		planar_kernels.Merge32(pDst, planes, param->nWidth);
 	}
 }
 
-static INLINE BOOL planar_decompress_planes_raw(const BYTE* pSrcData[4], BYTE* pDstData,
-                                                UINT32 DstFormat, UINT32 nDstStep, UINT32 nXDst,
-                                                UINT32 nYDst, UINT32 nWidth, UINT32 nHeight,
-                                                BOOL vFlip)
+/**
+ * Interleaves the planes LumaOrRed, OrangeChromaOrGreen, GreenChromaOrBlue
+ * and Alpha to 32bpp pixels in the channel order of PIXEL_FORMAT_BGRA32.
+ * The planes are stored in scanline order, bottom up if vFlip is set.
+ */
+static BOOL planar_merge_planes(BITMAP_PLANAR_CONTEXT* planar, const BYTE* planes[4],
+                                BYTE* pDstData, UINT32 nDstStep, UINT32 nXDst, UINT32 nYDst,
+                                UINT32 nWidth, UINT32 nHeight, BOOL vFlip)
+{
+	PLANAR_MERGE_PARAM param;
+	const UINT32 bands = planar_band_count(nWidth, nHeight);
+	param.planes[0] = planes[2];
+	param.planes[1] = planes[1];
+	param.planes[2] = planes[0];
+	param.planes[3] = planes[3];
+	param.pDstData = pDstData;
+	param.nDstStep = nDstStep;
+	param.nXDst = nXDst;
+	param.nYDst = nYDst;
+	param.nWidth = nWidth;
+	param.nHeight = nHeight;
+	param.nBandHeight = (nHeight + bands - 1) / bands;
+	param.vFlip = vFlip;
+	return planar_parallel_for(planar, bands, planar_merge_band_callback, &param);
+}
+
+/**
+ * Decodes the RLE planes to planar->planes, growing the scratch buffer for
+ * bitmaps that are larger than the context was created for.
+ */
+static BOOL planar_decompress_planes_rle(BITMAP_PLANAR_CONTEXT* planar, const BYTE* rlePlanes[4],
+                                         const INT32 rleSizes[4], UINT32 nWidth, UINT32 nHeight,
+                                         BYTE* planes[4])
 {
-	INT32 y;
-	INT32 beg, end, inc;
-	const BYTE* pR = pSrcData[0];
-	const BYTE* pG = pSrcData[1];
-	const BYTE* pB = pSrcData[2];
-	const BYTE* pA = pSrcData[3];
-
-	if (vFlip)
+	UINT32 i;
+	PLANAR_DECODE_PARAM param;
+	const size_t planeSize = (size_t)nWidth * nHeight;
+
+	if (planeSize <= planar->maxPlaneSize)
 	{
-		beg = nHeight - 1;
-		end = -1;
-		inc = -1;
+		for (i = 0; i < 4; i++)
+			planes[i] = planar->planes[i];
 	}
 	else
 	{
-		beg = 0;
-		end = nHeight;
-		inc = 1;
+		BITMAP_PLANAR_CONTEXT_PRIV* priv = planar->priv;
+
+		if (!planar_resize_buffer(&priv->decodeBuffer, &priv->decodeBufferSize, planeSize * 4))
+			return FALSE;
+
+		for (i = 0; i < 4; i++)
+			planes[i] = &priv->decodeBuffer[planeSize * i];
 	}
 
-	for (y = beg; y != end; y += inc)
+	for (i = 0; i < 4; i++)
 	{
-		BYTE* pRGB = &pDstData[((nYDst + y) * nDstStep) + (nXDst * GetBytesPerPixel(DstFormat))];
+		param.rlePlanes[i] = rlePlanes[i];
+		param.rleSizes[i] = (UINT32)rleSizes[i];
+		param.planes[i] = planes[i];
+	}
 
-		if (!writeLine(&pRGB, DstFormat, nWidth, &pR, &pG, &pB, &pA))
+	param.nWidth = nWidth;
+	param.nHeight = nHeight;
+	param.status = 0;
+
+	/* a plane per task, only large bitmaps are worth the hand over */
+	if (planar_band_count(nWidth, nHeight) > 1)
+	{
+		if (!planar_parallel_for(planar, 4, planar_decode_plane_callback, &param))
 			return FALSE;
 	}
+	else
+	{
+		for (i = 0; i < 4; i++)
+			planar_decode_plane_callback(&param, i);
+	}
 
-	return TRUE;
+	return param.status == 0;
 }
 
 BOOL planar_decompress(BITMAP_PLANAR_CONTEXT* planar, const BYTE* pSrcData, UINT32 SrcSize,
@@ -365,7 +452,9 @@ BOOL planar_decompress(BITMAP_PLANAR_CONTEXT* planar, const BYTE* pSrcData, UINT
 	UINT32 cll;
 	BOOL alpha;
 	BOOL useAlpha = FALSE;
-	INT32 status;
+	UINT32 TempFormat;
+	BYTE* pTempData;
+	UINT32 nTempStep;
 	const BYTE* srcp;
 	UINT32 subSize;
 	UINT32 subWidth;
@@ -508,79 +597,97 @@ BOOL planar_decompress(BITMAP_PLANAR_CONTEXT* planar, const BYTE* pSrcData, UINT
 			return FALSE;
 	}
 
-	if (!cll) /* RGB */
+	if (cll && cs)
 	{
-		UINT32 TempFormat;
-		BYTE* pTempData = pDstData;
-		UINT32 nTempStep = nDstStep;
+		WLog_ERR(TAG, "Chroma subsampling unimplemented");
+		return FALSE;
+	}
 
-		if (useAlpha)
-			TempFormat = PIXEL_FORMAT_BGRA32;
-		else
-			TempFormat = PIXEL_FORMAT_BGRX32;
+	if (useAlpha)
+		TempFormat = PIXEL_FORMAT_BGRA32;
+	else
+		TempFormat = PIXEL_FORMAT_BGRX32;
+
+	if (!cll) /* RGB */
+	{
+		pTempData = pDstData;
+		nTempStep = nDstStep;
 
 		if ((TempFormat != DstFormat) || (nSrcWidth != nDstWidth) || (nSrcHeight != nDstHeight))
 		{
 			pTempData = planar->pTempData;
 			nTempStep = planar->nTempStep;
 		}
+	}
+	else /* YCoCg */
+	{
+		pTempData = planar->pTempData;
+		nTempStep = planar->nTempStep;
+	}
 
-		if (!rle) /* RAW */
-		{
-			if (!planar_decompress_planes_raw(planes, pTempData, TempFormat, nTempStep, nXDst,
-			                                  nYDst, nSrcWidth, nSrcHeight, vFlip))
-				return FALSE;
-
-			if (alpha)
-				srcp += rawSizes[0] + rawSizes[1] + rawSizes[2] + rawSizes[3];
-			else /* NoAlpha */
-				srcp += rawSizes[0] + rawSizes[1] + rawSizes[2];
+	/* the temporary buffer only covers the size the context was created for */
+	if ((pTempData == planar->pTempData) &&
+	    ((nXDst + nSrcWidth > planar->maxWidth) || (nYDst + nSrcHeight > planar->maxHeight)))
+	{
+		if (!freerdp_bitmap_planar_context_reset(planar,
+		                                         MAX(planar->maxWidth, nXDst + nSrcWidth),
+		                                         MAX(planar->maxHeight, nYDst + nSrcHeight)))
+			return FALSE;
 
-			if ((SrcSize - (srcp - pSrcData)) == 1)
-				srcp++; /* pad */
-		}
-		else /* RLE */
-		{
-			status =
-			    planar_decompress_plane_rle(planes[0], rleSizes[0], pTempData, nTempStep, nXDst,
-			                                nYDst, nSrcWidth, nSrcHeight, 2, vFlip); /* RedPlane */
+		pTempData = planar->pTempData;
+		nTempStep = planar->nTempStep;
+	}
 
-			if (status < 0)
-				return FALSE;
+	if (!pTempData)
+		return FALSE;
 
-			status = planar_decompress_plane_rle(planes[1], rleSizes[1], pTempData, nTempStep,
-			                                     nXDst, nYDst, nSrcWidth, nSrcHeight, 1,
-			                                     vFlip); /* GreenPlane */
+	if (!rle) /* RAW */
+	{
+		if (!useAlpha)
+			planes[3] = NULL;
 
-			if (status < 0)
-				return FALSE;
+		if (!planar_merge_planes(planar, planes, pTempData, nTempStep, nXDst, nYDst, nSrcWidth,
+		                         nSrcHeight, vFlip))
+			return FALSE;
 
-			status =
-			    planar_decompress_plane_rle(planes[2], rleSizes[2], pTempData, nTempStep, nXDst,
-			                                nYDst, nSrcWidth, nSrcHeight, 0, vFlip); /* BluePlane */
+		if (alpha)
+			srcp += rawSizes[0] + rawSizes[1] + rawSizes[2] + rawSizes[3];
+		else /* NoAlpha */
+			srcp += rawSizes[0] + rawSizes[1] + rawSizes[2];
 
-			if (status < 0)
-				return FALSE;
+		if ((SrcSize - (srcp - pSrcData)) == 1)
+			srcp++; /* pad */
+	}
+	else /* RLE */
+	{
+		BYTE* decoded[4];
+		const BYTE* rlePlanes[4];
+		rlePlanes[0] = planes[0]; /* LumaOrRedPlane */
+		rlePlanes[1] = planes[1]; /* OrangeChromaOrGreenPlane */
+		rlePlanes[2] = planes[2]; /* GreenChromaOrBluePlane */
+		rlePlanes[3] = useAlpha ? planes[3] : NULL; /* AlphaPlane */
+
+		if (!planar_decompress_planes_rle(planar, rlePlanes, rleSizes, nSrcWidth, nSrcHeight,
+		                                  decoded))
+			return FALSE;
 
-			srcp += rleSizes[0] + rleSizes[1] + rleSizes[2];
+		planes[0] = decoded[0];
+		planes[1] = decoded[1];
+		planes[2] = decoded[2];
+		planes[3] = useAlpha ? decoded[3] : NULL;
 
-			if (useAlpha)
-			{
-				status = planar_decompress_plane_rle(planes[3], rleSizes[3], pTempData, nTempStep,
-				                                     nXDst, nYDst, nSrcWidth, nSrcHeight, 3,
-				                                     vFlip); /* AlphaPlane */
-			}
-			else
-				status = planar_set_plane(0xFF, pTempData, nTempStep, nXDst, nYDst, nSrcWidth,
-				                          nSrcHeight, 3, vFlip);
+		if (!planar_merge_planes(planar, planes, pTempData, nTempStep, nXDst, nYDst, nSrcWidth,
+		                         nSrcHeight, vFlip))
+			return FALSE;
 
-			if (status < 0)
-				return FALSE;
+		srcp += rleSizes[0] + rleSizes[1] + rleSizes[2];
 
-			if (alpha)
-				srcp += rleSizes[3];
-		}
+		if (alpha)
+			srcp += rleSizes[3];
+	}
 
+	if (!cll) /* RGB */
+	{
 		if (pTempData != pDstData)
 		{
 			if (!freerdp_image_copy(pDstData, DstFormat, nDstStep, nXDst, nYDst, w, h, pTempData,
@@ -590,112 +697,126 @@ BOOL planar_decompress(BITMAP_PLANAR_CONTEXT* planar, const BYTE* pSrcData, UINT
 	}
 	else /* YCoCg */
 	{
-		UINT32 TempFormat;
-		BYTE* pTempData = planar->pTempData;
-		UINT32 nTempStep = planar->nTempStep;
-
-		if (useAlpha)
-			TempFormat = PIXEL_FORMAT_BGRA32;
-		else
-			TempFormat = PIXEL_FORMAT_BGRX32;
-
-		if (!pTempData)
-			return FALSE;
-
-		if (cs)
-		{
-			WLog_ERR(TAG, "Chroma subsampling unimplemented");
+		if (prims->YCoCgToRGB_8u_AC4R(pTempData, nTempStep, pDstData, DstFormat, nDstStep, w, h,
+		                              cll, useAlpha) != PRIMITIVES_SUCCESS)
 			return FALSE;
-		}
+	}
 
-		if (!rle) /* RAW */
-		{
-			if (!planar_decompress_planes_raw(planes, pTempData, TempFormat, nTempStep, nXDst,
-			                                  nYDst, nSrcWidth, nSrcHeight, vFlip))
-				return FALSE;
+	return (SrcSize == (srcp - pSrcData)) ? TRUE : FALSE;
+}
 
-			if (alpha)
-				srcp += rawSizes[0] + rawSizes[1] + rawSizes[2] + rawSizes[3];
-			else /* NoAlpha */
-				srcp += rawSizes[0] + rawSizes[1] + rawSizes[2];
+/**
+ * Finds the byte of a 32bpp pixel holding each channel, in the plane order
+ * Alpha, Red, Green, Blue. Alpha is -1 if the format has none.
+ */
+static BOOL planar_get_channel_offsets(UINT32 format, INT32 offsets[4])
+{
+	size_t i;
+	BYTE channels[4];
+	const BYTE pixel[4] = { 0x10, 0x20, 0x30, 0x40 };
 
-			if ((SrcSize - (srcp - pSrcData)) == 1)
-				srcp++; /* pad */
-		}
-		else /* RLE */
-		{
-			if (useAlpha)
-			{
-				status = planar_decompress_plane_rle(planes[3], rleSizes[3], pTempData, nTempStep,
-				                                     nXDst, nYDst, nSrcWidth, nSrcHeight, 3,
-				                                     vFlip); /* AlphaPlane */
+	if (GetBitsPerPixel(format) != 32)
+		return FALSE;
 
-				if (status < 0)
-					return FALSE;
-			}
+	SplitColor(ReadColor(pixel, format), format, &channels[1], &channels[2], &channels[3],
+	           &channels[0], NULL);
 
-			if (alpha)
-				srcp += rleSizes[3];
+	for (i = 0; i < 4; i++)
+	{
+		const BYTE value = channels[i];
 
-			status =
-			    planar_decompress_plane_rle(planes[0], rleSizes[0], pTempData, nTempStep, nXDst,
-			                                nYDst, nSrcWidth, nSrcHeight, 2, vFlip); /* LumaPlane */
+		if ((i == 0) && (value == 0xFF))
+			offsets[i] = -1;
+		else if (((value & 0x0F) == 0) && (value >= 0x10) && (value <= 0x40))
+			offsets[i] = (value >> 4) - 1;
+		else
+			return FALSE;
+	}
 
-			if (status < 0)
-				return FALSE;
+	return TRUE;
+}
 
-			status = planar_decompress_plane_rle(planes[1], rleSizes[1], pTempData, nTempStep,
-			                                     nXDst, nYDst, nSrcWidth, nSrcHeight, 1,
-			                                     vFlip); /* OrangeChromaPlane */
+struct _PLANAR_SPLIT_PARAM
+{
+	const BYTE* data;
+	UINT32 format;
+	UINT32 width;
+	UINT32 height;
+	UINT32 scanline;
+	UINT32 nBandHeight;
+	BOOL direct;
+	INT32 offsets[4];
+	BOOL skipAlpha;
+	BYTE** planes;
+};
+typedef struct _PLANAR_SPLIT_PARAM PLANAR_SPLIT_PARAM;
+
+static void CALLBACK planar_split_band_callback(PVOID context, ULONG index)
+{
+	UINT32 i, j;
+	const PLANAR_SPLIT_PARAM* param = (const PLANAR_SPLIT_PARAM*)context;
+	const UINT32 first = index * param->nBandHeight;
+	const UINT32 last = MIN(first + param->nBandHeight, param->height);
+	const UINT32 bpp = GetBytesPerPixel(param->format);
+
+	/* the planes are stored bottom up */
+	for (i = first; i < last; i++)
+	{
+		const size_t k = (size_t)i * param->width;
+		const BYTE* pixel = &param->data[(size_t)param->scanline * (param->height - 1 - i)];
 
-			if (status < 0)
-				return FALSE;
+		if (param->direct)
+		{
+			BYTE* dst[4] = { NULL, NULL, NULL, NULL };
 
-			status = planar_decompress_plane_rle(planes[2], rleSizes[2], pTempData, nTempStep,
-			                                     nXDst, nYDst, nSrcWidth, nSrcHeight, 0,
-			                                     vFlip); /* GreenChromaPlane */
+			for (j = 0; j < 4; j++)
+			{
+				if ((param->offsets[j] >= 0) && ((j != 0) || !param->skipAlpha))
+					dst[param->offsets[j]] = &param->planes[j][k];
+			}
 
-			if (status < 0)
-				return FALSE;
+			planar_kernels.Split32(pixel, dst, param->width);
 
-			srcp += rleSizes[0] + rleSizes[1] + rleSizes[2];
+			if ((param->offsets[0] < 0) && !param->skipAlpha)
+				FillMemory(&param->planes[0][k], param->width, 0xFF);
+		}
+		else
+		{
+			for (j = 0; j < param->width; j++)
+			{
+				const UINT32 color = ReadColor(pixel, param->format);
+				pixel += bpp;
+				SplitColor(color, param->format, &param->planes[1][k + j],
+				           &param->planes[2][k + j], &param->planes[3][k + j],
+				           &param->planes[0][k + j], NULL);
+			}
 		}
-
-		if (prims->YCoCgToRGB_8u_AC4R(pTempData, nTempStep, pDstData, DstFormat, nDstStep, w, h,
-		                              cll, useAlpha) != PRIMITIVES_SUCCESS)
-			return FALSE;
 	}
-
-	return (SrcSize == (srcp - pSrcData)) ? TRUE : FALSE;
 }
 
-static INLINE BOOL freerdp_split_color_planes(const BYTE* data, UINT32 format, UINT32 width,
-                                              UINT32 height, UINT32 scanline, BYTE* planes[4])
+static INLINE BOOL freerdp_split_color_planes(BITMAP_PLANAR_CONTEXT* planar, const BYTE* data,
+                                              UINT32 format, UINT32 width, UINT32 height,
+                                              UINT32 scanline, BYTE* planes[4], BOOL skipAlpha)
 {
-	INT32 i, j, k;
+	PLANAR_SPLIT_PARAM param;
+	const UINT32 bands = planar_band_count(width, height);
+
 	if ((width > INT32_MAX) || (height > INT32_MAX) || (scanline > INT32_MAX))
 		return FALSE;
 
-	k = 0;
-
 	if (scanline == 0)
 		scanline = width * GetBytesPerPixel(format);
 
-	for (i = (INT32)height - 1; i >= 0; i--)
-	{
-		const BYTE* pixel = &data[(INT32)scanline * i];
-
-		for (j = 0; j < (INT32)width; j++)
-		{
-			const UINT32 color = ReadColor(pixel, format);
-			pixel += GetBytesPerPixel(format);
-			SplitColor(color, format, &planes[1][k], &planes[2][k], &planes[3][k], &planes[0][k],
-			           NULL);
-			k++;
-		}
-	}
-
-	return TRUE;
+	param.data = data;
+	param.format = format;
+	param.width = width;
+	param.height = height;
+	param.scanline = scanline;
+	param.nBandHeight = (height + bands - 1) / bands;
+	param.direct = planar_get_channel_offsets(format, param.offsets);
+	param.skipAlpha = skipAlpha;
+	param.planes = planes;
+	return planar_parallel_for(planar, bands, planar_split_band_callback, &param);
 }
 
 static INLINE UINT32 freerdp_bitmap_planar_write_rle_bytes(const BYTE* pInBuffer, UINT32 cRawBytes,
@@ -891,148 +1012,146 @@ static INLINE UINT32 freerdp_bitmap_planar_encode_rle_bytes(const BYTE* pInBuffe
 	return nTotalBytesWritten;
 }
 
-BOOL freerdp_bitmap_planar_compress_plane_rle(const BYTE* inPlane, UINT32 width, UINT32 height,
-                                              BYTE* outPlane, UINT32* dstSize)
+/**
+ * Delta and run length encodes the scanlines [first, last) of all planes.
+ * Scanlines are encoded independently, so bands can be encoded in any order
+ * and concatenated afterwards.
+ */
+static BOOL freerdp_bitmap_planar_compress_band_rle(BITMAP_PLANAR_CONTEXT* context, UINT32 width,
+                                                    UINT32 first, UINT32 last, BOOL skipAlpha,
+                                                    BYTE* outPlanes, UINT32 outPlanesSize,
+                                                    UINT32 dstSizes[4])
 {
-	UINT32 index;
-	const BYTE* pInput;
-	BYTE* pOutput;
-	UINT32 outBufferSize;
-	UINT32 nBytesWritten;
-	UINT32 nTotalBytesWritten;
+	UINT32 i, y;
 
-	if (!outPlane)
-		return FALSE;
+	for (i = 0; i < 4; i++)
+	{
+		const BYTE* plane = context->planes[i];
+		BYTE* deltaPlane = context->deltaPlanes[i];
+		dstSizes[i] = 0;
 
-	index = 0;
-	pInput = inPlane;
-	pOutput = outPlane;
-	outBufferSize = *dstSize;
-	nTotalBytesWritten = 0;
+		/* AlphaPlane */
+		if ((i == 0) && skipAlpha)
+			continue;
 
-	while (outBufferSize)
-	{
-		nBytesWritten =
-		    freerdp_bitmap_planar_encode_rle_bytes(pInput, width, pOutput, outBufferSize);
+		for (y = first; y < last; y++)
+		{
+			UINT32 nBytesWritten;
+			const BYTE* pInput = &plane[y * width];
 
-		if ((!nBytesWritten) || (nBytesWritten > outBufferSize))
-			return FALSE;
+			/* the first scanline is sent as is */
+			if (y > 0)
+			{
+				BYTE* pDelta = &deltaPlane[y * width];
+				planar_kernels.DeltaEncode(pDelta, pInput, &plane[(y - 1) * width], width);
+				pInput = pDelta;
+			}
 
-		outBufferSize -= nBytesWritten;
-		nTotalBytesWritten += nBytesWritten;
-		pOutput += nBytesWritten;
-		pInput += width;
-		index++;
+			nBytesWritten =
+			    freerdp_bitmap_planar_encode_rle_bytes(pInput, width, outPlanes, outPlanesSize);
 
-		if (index >= height)
-			break;
+			if ((!nBytesWritten) || (nBytesWritten > outPlanesSize))
+				return FALSE;
+
+			outPlanes += nBytesWritten;
+			outPlanesSize -= nBytesWritten;
+			dstSizes[i] += nBytesWritten;
+		}
 	}
 
-	*dstSize = nTotalBytesWritten;
 	return TRUE;
 }
 
-static INLINE BOOL freerdp_bitmap_planar_compress_planes_rle(BYTE* inPlanes[4], UINT32 width,
-                                                             UINT32 height, BYTE* outPlanes,
-                                                             UINT32* dstSizes, BOOL skipAlpha)
+struct _PLANAR_ENCODE_PARAM
 {
-	UINT32 outPlanesSize = width * height * 4;
-
-	/* AlphaPlane */
-	if (skipAlpha)
-	{
-		dstSizes[0] = 0;
-	}
-	else
-	{
-		dstSizes[0] = outPlanesSize;
-
-		if (!freerdp_bitmap_planar_compress_plane_rle(inPlanes[0], width, height, outPlanes,
-		                                              &dstSizes[0]))
-			return FALSE;
-
-		outPlanes += dstSizes[0];
-		outPlanesSize -= dstSizes[0];
-	}
-
-	/* LumaOrRedPlane */
-	dstSizes[1] = outPlanesSize;
+	BITMAP_PLANAR_CONTEXT* context;
+	UINT32 width;
+	UINT32 height;
+	UINT32 nBandHeight;
+	BOOL skipAlpha;
+	BYTE* buffer;
+	UINT32 bandSize;
+	UINT32* dstSizes;
+	LONG status;
+};
+typedef struct _PLANAR_ENCODE_PARAM PLANAR_ENCODE_PARAM;
+
+static void CALLBACK planar_encode_band_callback(PVOID context, ULONG index)
+{
+	PLANAR_ENCODE_PARAM* param = (PLANAR_ENCODE_PARAM*)context;
+	const UINT32 first = index * param->nBandHeight;
+	const UINT32 last = MIN(first + param->nBandHeight, param->height);
+
+	if (!freerdp_bitmap_planar_compress_band_rle(
+	        param->context, param->width, first, last, param->skipAlpha,
+	        &param->buffer[(size_t)param->bandSize * index], param->bandSize,
+	        &param->dstSizes[index * 4]))
+		InterlockedExchange(&param->status, -1);
+}
 
-	if (!freerdp_bitmap_planar_compress_plane_rle(inPlanes[1], width, height, outPlanes,
-	                                              &dstSizes[1]))
+static INLINE BOOL freerdp_bitmap_planar_compress_planes_rle(BITMAP_PLANAR_CONTEXT* context,
+                                                             UINT32 width, UINT32 height,
+                                                             BYTE* outPlanes, UINT32* dstSizes,
+                                                             BOOL skipAlpha)
+{
+	UINT32 i, band;
+	size_t bufferSize;
+	PLANAR_ENCODE_PARAM param;
+	BITMAP_PLANAR_CONTEXT_PRIV* priv = context->priv;
+	UINT32 outPlanesSize = width * height * 4;
+	const UINT32 bands = planar_band_count(width, height);
+
+	if (bands < 2)
+		return freerdp_bitmap_planar_compress_band_rle(context, width, 0, height, skipAlpha,
+		                                               outPlanes, outPlanesSize, dstSizes);
+
+	/**
+	 * Every band gets room for the worst case of all its planes, the size
+	 * of a run length encoded scanline is below width * 16 / 15 + 2.
+	 */
+	param.context = context;
+	param.width = width;
+	param.height = height;
+	param.nBandHeight = (height + bands - 1) / bands;
+	param.skipAlpha = skipAlpha;
+	param.bandSize = param.nBandHeight * (width + width / 8 + 4) * 4;
+	param.status = 0;
+	bufferSize = (size_t)param.bandSize * bands + bands * 4 * sizeof(UINT32);
+
+	if (!planar_resize_buffer(&priv->bandBuffer, &priv->bandBufferSize, bufferSize))
 		return FALSE;
 
-	outPlanes += dstSizes[1];
-	outPlanesSize -= dstSizes[1];
-	/* OrangeChromaOrGreenPlane */
-	dstSizes[2] = outPlanesSize;
+	param.buffer = priv->bandBuffer;
+	param.dstSizes = (UINT32*)&priv->bandBuffer[(size_t)param.bandSize * bands];
 
-	if (!freerdp_bitmap_planar_compress_plane_rle(inPlanes[2], width, height, outPlanes,
-	                                              &dstSizes[2]))
+	if (!planar_parallel_for(context, bands, planar_encode_band_callback, &param))
 		return FALSE;
 
-	outPlanes += dstSizes[2];
-	outPlanesSize -= dstSizes[2];
-	/* GreenChromeOrBluePlane */
-	dstSizes[3] = outPlanesSize;
-
-	if (!freerdp_bitmap_planar_compress_plane_rle(inPlanes[3], width, height, outPlanes,
-	                                              &dstSizes[3]))
+	if (param.status != 0)
 		return FALSE;
 
-	return TRUE;
-}
-
-BYTE* freerdp_bitmap_planar_delta_encode_plane(const BYTE* inPlane, UINT32 width, UINT32 height,
-                                               BYTE* outPlane)
-{
-	char s2c;
-	INT32 delta;
-	UINT32 y, x;
-	BYTE* outPtr;
-	const BYTE *srcPtr, *prevLinePtr;
-
-	if (!outPlane)
+	/* concatenate the bands plane by plane */
+	for (i = 0; i < 4; i++)
 	{
-		if (width * height == 0)
-			return NULL;
-
-		if (!(outPlane = (BYTE*)calloc(height, width)))
-			return NULL;
-	}
-
-	// first line is copied as is
-	CopyMemory(outPlane, inPlane, width);
-	outPtr = outPlane + width;
-	srcPtr = inPlane + width;
-	prevLinePtr = inPlane;
+		dstSizes[i] = 0;
 
-	for (y = 1; y < height; y++)
-	{
-		for (x = 0; x < width; x++, outPtr++, srcPtr++, prevLinePtr++)
+		for (band = 0; band < bands; band++)
 		{
-			delta = *srcPtr - *prevLinePtr;
-			s2c = (delta >= 0) ? (char)delta : (char)(~((BYTE)(-delta)) + 1);
-			s2c = (s2c >= 0) ? (s2c << 1) : (char)(((~((BYTE)s2c) + 1) << 1) - 1);
-			*outPtr = (BYTE)s2c;
-		}
-	}
+			UINT32 j;
+			const UINT32* bandSizes = &param.dstSizes[band * 4];
+			const BYTE* pBand = &param.buffer[(size_t)param.bandSize * band];
 
-	return outPlane;
-}
+			for (j = 0; j < i; j++)
+				pBand += bandSizes[j];
 
-static INLINE BOOL freerdp_bitmap_planar_delta_encode_planes(BYTE* inPlanes[4], UINT32 width,
-                                                             UINT32 height, BYTE* outPlanes[4])
-{
-	UINT32 i;
-
-	for (i = 0; i < 4; i++)
-	{
-		outPlanes[i] =
-		    freerdp_bitmap_planar_delta_encode_plane(inPlanes[i], width, height, outPlanes[i]);
+			if (bandSizes[i] > outPlanesSize)
+				return FALSE;
 
-		if (!outPlanes[i])
-			return FALSE;
+			CopyMemory(outPlanes, pBand, bandSizes[i]);
+			outPlanes += bandSizes[i];
+			outPlanesSize -= bandSizes[i];
+			dstSizes[i] += bandSizes[i];
+		}
 	}
 
 	return TRUE;
@@ -1056,16 +1175,13 @@ BYTE* freerdp_bitmap_compress_planar(BITMAP_PLANAR_CONTEXT* context, const BYTE*
 
 	planeSize = width * height;
 
-	if (!freerdp_split_color_planes(data, format, width, height, scanline, context->planes))
+	if (!freerdp_split_color_planes(context, data, format, width, height, scanline,
+	                                context->planes, context->AllowSkipAlpha))
 		return NULL;
 
 	if (context->AllowRunLengthEncoding)
 	{
-		if (!freerdp_bitmap_planar_delta_encode_planes(context->planes, width, height,
-		                                               context->deltaPlanes))
-			return NULL;
-
-		if (!freerdp_bitmap_planar_compress_planes_rle(context->deltaPlanes, width, height,
+		if (!freerdp_bitmap_planar_compress_planes_rle(context, width, height,
 		                                               context->rlePlanesBuffer, dstSizes,
 		                                               context->AllowSkipAlpha))
 			return NULL;
@@ -1243,11 +1359,27 @@ BITMAP_PLANAR_CONTEXT* freerdp_bitmap_planar_context_new(DWORD flags, UINT32 max
                                                          UINT32 maxHeight)
 {
 	BITMAP_PLANAR_CONTEXT* context;
+	SYSTEM_INFO sysinfo;
+
+	if (!InitOnceExecuteOnce(&planar_init_once, planar_init, NULL, NULL))
+		return NULL;
+
 	context = (BITMAP_PLANAR_CONTEXT*)calloc(1, sizeof(BITMAP_PLANAR_CONTEXT));
 
 	if (!context)
 		return NULL;
 
+	context->priv = (BITMAP_PLANAR_CONTEXT_PRIV*)calloc(1, sizeof(BITMAP_PLANAR_CONTEXT_PRIV));
+
+	if (!context->priv)
+	{
+		free(context);
+		return NULL;
+	}
+
+	GetNativeSystemInfo(&sysinfo);
+	context->priv->numWorkers = sysinfo.dwNumberOfProcessors;
+
 	if (flags & PLANAR_FORMAT_HEADER_NA)
 		context->AllowSkipAlpha = TRUE;
 
@@ -1280,5 +1412,19 @@ void freerdp_bitmap_planar_context_free(BITMAP_PLANAR_CONTEXT* context)
 	free(context->planesBuffer);
 	free(context->deltaPlanesBuffer);
 	free(context->rlePlanesBuffer);
+
+	if (context->priv)
+	{
+		if (context->priv->ThreadPool)
+		{
+			CloseThreadpoolParallel(context->priv->Parallel);
+			CloseThreadpool(context->priv->ThreadPool);
+		}
+
+		_aligned_free(context->priv->decodeBuffer);
+		_aligned_free(context->priv->bandBuffer);
+		free(context->priv);
+	}
+
 	free(context);
 }
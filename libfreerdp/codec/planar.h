@@ -0,0 +1,80 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RDP6 Planar Codec
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CODEC_PLANAR_H
+#define FREERDP_LIB_CODEC_PLANAR_H
+
+#include <winpr/pool.h>
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/codec/planar.h>
+
+/**
+ * Row kernels of the planar codec.
+ *
+ * Delta planes store each byte of a scanline as the difference to the byte
+ * above it, folded to an unsigned value (0, -1, 1, -2, ... become 0, 1, 2, 3, ...).
+ * DeltaDecode may be called with pDst == pSrc.
+ *
+ * Split32 and Merge32 convert between 32bpp pixels and one plane per byte of
+ * the pixel. A NULL plane is skipped by Split32 and read as 0xFF by Merge32.
+ */
+typedef void (*pfnPlanarDeltaEncode)(BYTE* pDst, const BYTE* pSrc, const BYTE* pPrev,
+                                     UINT32 width);
+typedef void (*pfnPlanarDeltaDecode)(BYTE* pDst, const BYTE* pSrc, const BYTE* pPrev,
+                                     UINT32 width);
+typedef void (*pfnPlanarSplit32)(const BYTE* pSrc, BYTE* pDst[4], UINT32 width);
+typedef void (*pfnPlanarMerge32)(BYTE* pDst, const BYTE* pSrc[4], UINT32 width);
+
+struct _FREERDP_PLANAR_KERNELS
+{
+	pfnPlanarDeltaEncode DeltaEncode;
+	pfnPlanarDeltaDecode DeltaDecode;
+	pfnPlanarSplit32 Split32;
+	pfnPlanarMerge32 Merge32;
+};
+typedef struct _FREERDP_PLANAR_KERNELS FREERDP_PLANAR_KERNELS;
+
+struct _BITMAP_PLANAR_CONTEXT_PRIV
+{
+	/* decoded planes, grown on demand */
+	BYTE* decodeBuffer;
+	size_t decodeBufferSize;
+
+	/* per band RLE output of the encoder */
+	BYTE* bandBuffer;
+	size_t bandBufferSize;
+
+	/* created with the first bitmap that is worth splitting */
+	UINT32 numWorkers;
+	PTP_POOL ThreadPool;
+	TP_CALLBACK_ENVIRON ThreadPoolEnv;
+	PTP_PARALLEL Parallel;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FREERDP_LOCAL void freerdp_planar_init_sse2(FREERDP_PLANAR_KERNELS* kernels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_LIB_CODEC_PLANAR_H */
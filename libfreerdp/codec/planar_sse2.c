@@ -0,0 +1,181 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RDP6 Planar Codec - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+
+#include "planar.h"
+
+#if defined(WITH_SSE2)
+
+#include <emmintrin.h>
+
+static void planar_delta_encode_sse2(BYTE* pDst, const BYTE* pSrc, const BYTE* pPrev,
+                                     UINT32 width)
+{
+	UINT32 x = 0;
+	const __m128i zero = _mm_setzero_si128();
+
+	/* (d << 1) ^ (d >> 7) on signed bytes */
+	for (; x + 16 <= width; x += 16)
+	{
+		const __m128i cur = _mm_loadu_si128((const __m128i*)&pSrc[x]);
+		const __m128i prev = _mm_loadu_si128((const __m128i*)&pPrev[x]);
+		const __m128i d = _mm_sub_epi8(cur, prev);
+		const __m128i sign = _mm_cmpgt_epi8(zero, d);
+		_mm_storeu_si128((__m128i*)&pDst[x], _mm_xor_si128(_mm_add_epi8(d, d), sign));
+	}
+
+	for (; x < width; x++)
+	{
+		const INT8 d = (INT8)(pSrc[x] - pPrev[x]);
+		pDst[x] = (BYTE)((d << 1) ^ (d >> 7));
+	}
+}
+
+static void planar_delta_decode_sse2(BYTE* pDst, const BYTE* pSrc, const BYTE* pPrev,
+                                     UINT32 width)
+{
+	UINT32 x = 0;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i low7 = _mm_set1_epi8(0x7F);
+
+	for (; x + 16 <= width; x += 16)
+	{
+		const __m128i v = _mm_loadu_si128((const __m128i*)&pSrc[x]);
+		const __m128i prev = _mm_loadu_si128((const __m128i*)&pPrev[x]);
+		const __m128i half = _mm_and_si128(_mm_srli_epi16(v, 1), low7);
+		const __m128i sign = _mm_sub_epi8(zero, _mm_and_si128(v, one));
+		const __m128i d = _mm_xor_si128(half, sign);
+		_mm_storeu_si128((__m128i*)&pDst[x], _mm_add_epi8(prev, d));
+	}
+
+	for (; x < width; x++)
+	{
+		const BYTE v = pSrc[x];
+		pDst[x] = (BYTE)(pPrev[x] + ((v >> 1) ^ (0 - (v & 1))));
+	}
+}
+
+static INLINE __m128i planar_gather_byte(__m128i v0, __m128i v1, __m128i v2, __m128i v3,
+                                         int shift)
+{
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	const __m128i a = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(v0, shift), mask),
+	                                  _mm_and_si128(_mm_srli_epi32(v1, shift), mask));
+	const __m128i b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(v2, shift), mask),
+	                                  _mm_and_si128(_mm_srli_epi32(v3, shift), mask));
+	return _mm_packus_epi16(a, b);
+}
+
+static void planar_split32_sse2(const BYTE* pSrc, BYTE* pDst[4], UINT32 width)
+{
+	UINT32 x = 0;
+	BYTE* p0 = pDst[0];
+	BYTE* p1 = pDst[1];
+	BYTE* p2 = pDst[2];
+	BYTE* p3 = pDst[3];
+
+	for (; x + 16 <= width; x += 16)
+	{
+		const __m128i v0 = _mm_loadu_si128((const __m128i*)&pSrc[x * 4]);
+		const __m128i v1 = _mm_loadu_si128((const __m128i*)&pSrc[x * 4 + 16]);
+		const __m128i v2 = _mm_loadu_si128((const __m128i*)&pSrc[x * 4 + 32]);
+		const __m128i v3 = _mm_loadu_si128((const __m128i*)&pSrc[x * 4 + 48]);
+
+		if (p0)
+			_mm_storeu_si128((__m128i*)&p0[x], planar_gather_byte(v0, v1, v2, v3, 0));
+
+		if (p1)
+			_mm_storeu_si128((__m128i*)&p1[x], planar_gather_byte(v0, v1, v2, v3, 8));
+
+		if (p2)
+			_mm_storeu_si128((__m128i*)&p2[x], planar_gather_byte(v0, v1, v2, v3, 16));
+
+		if (p3)
+			_mm_storeu_si128((__m128i*)&p3[x], planar_gather_byte(v0, v1, v2, v3, 24));
+	}
+
+	for (; x < width; x++)
+	{
+		const BYTE* pixel = &pSrc[x * 4];
+
+		if (p0)
+			p0[x] = pixel[0];
+
+		if (p1)
+			p1[x] = pixel[1];
+
+		if (p2)
+			p2[x] = pixel[2];
+
+		if (p3)
+			p3[x] = pixel[3];
+	}
+}
+
+static void planar_merge32_sse2(BYTE* pDst, const BYTE* pSrc[4], UINT32 width)
+{
+	UINT32 x = 0;
+	const __m128i opaque = _mm_set1_epi8((char)0xFF);
+	const BYTE* p0 = pSrc[0];
+	const BYTE* p1 = pSrc[1];
+	const BYTE* p2 = pSrc[2];
+	const BYTE* p3 = pSrc[3];
+
+	for (; x + 16 <= width; x += 16)
+	{
+		const __m128i b0 = p0 ? _mm_loadu_si128((const __m128i*)&p0[x]) : opaque;
+		const __m128i b1 = p1 ? _mm_loadu_si128((const __m128i*)&p1[x]) : opaque;
+		const __m128i b2 = p2 ? _mm_loadu_si128((const __m128i*)&p2[x]) : opaque;
+		const __m128i b3 = p3 ? _mm_loadu_si128((const __m128i*)&p3[x]) : opaque;
+		const __m128i lo01 = _mm_unpacklo_epi8(b0, b1);
+		const __m128i hi01 = _mm_unpackhi_epi8(b0, b1);
+		const __m128i lo23 = _mm_unpacklo_epi8(b2, b3);
+		const __m128i hi23 = _mm_unpackhi_epi8(b2, b3);
+		_mm_storeu_si128((__m128i*)&pDst[x * 4], _mm_unpacklo_epi16(lo01, lo23));
+		_mm_storeu_si128((__m128i*)&pDst[x * 4 + 16], _mm_unpackhi_epi16(lo01, lo23));
+		_mm_storeu_si128((__m128i*)&pDst[x * 4 + 32], _mm_unpacklo_epi16(hi01, hi23));
+		_mm_storeu_si128((__m128i*)&pDst[x * 4 + 48], _mm_unpackhi_epi16(hi01, hi23));
+	}
+
+	for (; x < width; x++)
+	{
+		BYTE* pixel = &pDst[x * 4];
+		pixel[0] = p0 ? p0[x] : 0xFF;
+		pixel[1] = p1 ? p1[x] : 0xFF;
+		pixel[2] = p2 ? p2[x] : 0xFF;
+		pixel[3] = p3 ? p3[x] : 0xFF;
+	}
+}
+
+void freerdp_planar_init_sse2(FREERDP_PLANAR_KERNELS* kernels)
+{
+	if (!IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	kernels->DeltaEncode = planar_delta_encode_sse2;
+	kernels->DeltaDecode = planar_delta_decode_sse2;
+	kernels->Split32 = planar_split32_sse2;
+	kernels->Merge32 = planar_merge32_sse2;
+}
+
+#endif /* WITH_SSE2 */
@@ -21,9 +21,13 @@
 #include "config.h"
 #endif
 
+#include <stddef.h>
+
 #include <winpr/crt.h>
 #include <winpr/print.h>
+#include <winpr/sysinfo.h>
 #include <winpr/bitstream.h>
+#include <winpr/interlocked.h>
 
 #include <freerdp/primitives.h>
 #include <freerdp/codec/color.h>
@@ -31,7 +35,9 @@
 #include <freerdp/codec/region.h>
 #include <freerdp/log.h>
 
+#include "rfx_bitstream.h"
 #include "rfx_differential.h"
+#include "rfx_encode.h"
 #include "rfx_quantization.h"
 #include "rfx_rlgr.h"
 #include "progressive.h"
@@ -693,14 +699,12 @@ static INLINE void progressive_rfx_decode_block(const primitives_t* prims,
 	prims->lShiftC_16s(buffer, shift, buffer, length);
 }
 
-static INLINE int progressive_rfx_decode_component(PROGRESSIVE_CONTEXT* progressive,
-        RFX_COMPONENT_CODEC_QUANT* shift,
+static INLINE int progressive_rfx_decode_component(RFX_COMPONENT_CODEC_QUANT* shift,
         const BYTE* data, int length,
         INT16* buffer, INT16* current,
-        INT16* sign, BOOL diff)
+        INT16* sign, INT16* temp, BOOL diff)
 {
 	int status;
-	INT16* temp;
 	const primitives_t* prims = primitives_get();
 	status = rfx_rlgr_decode(RLGR1, data, length, buffer, 4096);
 
@@ -719,17 +723,16 @@ static INLINE int progressive_rfx_decode_component(PROGRESSIVE_CONTEXT* progress
 	progressive_rfx_decode_block(prims, &buffer[3879], 72, shift->LH3); /* LH3 */
 	progressive_rfx_decode_block(prims, &buffer[3951], 64, shift->HH3); /* HH3 */
 	progressive_rfx_decode_block(prims, &buffer[4015], 81, shift->LL3); /* LL3 */
-	temp = (INT16*) BufferPool_Take(progressive->bufferPool, -1); /* DWT buffer */
 	progressive_rfx_dwt_2d_decode(buffer, temp, current, sign, diff);
-	BufferPool_Return(progressive->bufferPool, temp);
 	return 1;
 }
 
 static INLINE int progressive_decompress_tile_first(PROGRESSIVE_CONTEXT* progressive,
-        RFX_PROGRESSIVE_TILE* tile)
+        RFX_PROGRESSIVE_TILE* tile, BYTE* pScratch)
 {
 	BOOL diff;
 	BYTE* pBuffer;
+	INT16* pTemp;
 	INT16* pSign[3];
 	INT16* pSrcDst[3];
 	INT16* pCurrent[3];
@@ -836,21 +839,21 @@ static INLINE int progressive_decompress_tile_first(PROGRESSIVE_CONTEXT* progres
 	pCurrent[1] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 1) + 16])); /* Cb/G buffer */
 	pCurrent[2] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 2) + 16])); /* Cr/B buffer */
 
-	pBuffer = (BYTE*) BufferPool_Take(progressive->bufferPool, -1);
+	pBuffer = pScratch;
 	pSrcDst[0] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 0) + 16])); /* Y/R buffer */
 	pSrcDst[1] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 1) + 16])); /* Cb/G buffer */
 	pSrcDst[2] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 2) + 16])); /* Cr/B buffer */
+	pTemp = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 3) + 16])); /* DWT buffer */
 
-	progressive_rfx_decode_component(progressive, &shiftY, tile->yData, tile->yLen,
-	                                 pSrcDst[0], pCurrent[0], pSign[0], diff); /* Y */
-	progressive_rfx_decode_component(progressive, &shiftCb, tile->cbData, tile->cbLen,
-	                                 pSrcDst[1], pCurrent[1], pSign[1], diff); /* Cb */
-	progressive_rfx_decode_component(progressive, &shiftCr, tile->crData, tile->crLen,
-	                                 pSrcDst[2], pCurrent[2], pSign[2], diff); /* Cr */
+	progressive_rfx_decode_component(&shiftY, tile->yData, tile->yLen,
+	                                 pSrcDst[0], pCurrent[0], pSign[0], pTemp, diff); /* Y */
+	progressive_rfx_decode_component(&shiftCb, tile->cbData, tile->cbLen,
+	                                 pSrcDst[1], pCurrent[1], pSign[1], pTemp, diff); /* Cb */
+	progressive_rfx_decode_component(&shiftCr, tile->crData, tile->crLen,
+	                                 pSrcDst[2], pCurrent[2], pSign[2], pTemp, diff); /* Cr */
 
 	prims->yCbCrToRGB_16s8u_P3AC4R((const INT16**) pSrcDst, 64 * 2, tile->data, tile->stride,
 								tile->format, &roi_64x64);
-	BufferPool_Return(progressive->bufferPool, pBuffer);
 	return 1;
 }
 
@@ -1026,12 +1029,11 @@ static INLINE int progressive_rfx_upgrade_component(PROGRESSIVE_CONTEXT* progres
         RFX_COMPONENT_CODEC_QUANT* bitPos,
         RFX_COMPONENT_CODEC_QUANT* numBits,
         INT16* buffer,
-        INT16* current, INT16* sign,
+        INT16* current, INT16* sign, INT16* temp,
         const BYTE* srlData,
         UINT32 srlLen, const BYTE* rawData,
         UINT32 rawLen)
 {
-	INT16* temp;
 	UINT32 aRawLen;
 	UINT32 aSrlLen;
 	wBitStream s_srl;
@@ -1097,20 +1099,19 @@ static INLINE int progressive_rfx_upgrade_component(PROGRESSIVE_CONTEXT* progres
 		return -1;
 	}
 
-	temp = (INT16*) BufferPool_Take(progressive->bufferPool, -1); /* DWT buffer */
 	CopyMemory(buffer, current, 4096 * 2);
 	progressive_rfx_dwt_2d_decode_block(&buffer[3807], temp, 3);
 	progressive_rfx_dwt_2d_decode_block(&buffer[3007], temp, 2);
 	progressive_rfx_dwt_2d_decode_block(&buffer[0], temp, 1);
-	BufferPool_Return(progressive->bufferPool, temp);
 	return 1;
 }
 
 static INLINE int progressive_decompress_tile_upgrade(PROGRESSIVE_CONTEXT* progressive,
-        RFX_PROGRESSIVE_TILE* tile)
+        RFX_PROGRESSIVE_TILE* tile, BYTE* pScratch)
 {
 	int status;
 	BYTE* pBuffer;
+	INT16* pTemp;
 	INT16* pSign[3];
 	INT16* pSrcDst[3];
 	INT16* pCurrent[3];
@@ -1214,14 +1215,16 @@ static INLINE int progressive_decompress_tile_upgrade(PROGRESSIVE_CONTEXT* progr
 	pCurrent[1] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 1) + 16])); /* Cb/G buffer */
 	pCurrent[2] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 2) + 16])); /* Cr/B buffer */
 
-	pBuffer = (BYTE*) BufferPool_Take(progressive->bufferPool, -1);
+	pBuffer = pScratch;
 	pSrcDst[0] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 0) + 16])); /* Y/R buffer */
 	pSrcDst[1] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 1) + 16])); /* Cb/G buffer */
 	pSrcDst[2] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 2) + 16])); /* Cr/B buffer */
+	pTemp = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 3) + 16])); /* DWT buffer */
 
 	status = progressive_rfx_upgrade_component(progressive, &shiftY, quantProgY,
 	         &yNumBits,
-	         pSrcDst[0], pCurrent[0], pSign[0], tile->ySrlData, tile->ySrlLen,
+	         pSrcDst[0], pCurrent[0], pSign[0], pTemp,
+	         tile->ySrlData, tile->ySrlLen,
 	         tile->yRawData, tile->yRawLen); /* Y */
 
 	if (status < 0)
@@ -1229,7 +1232,8 @@ static INLINE int progressive_decompress_tile_upgrade(PROGRESSIVE_CONTEXT* progr
 
 	status = progressive_rfx_upgrade_component(progressive, &shiftCb, quantProgCb,
 	         &cbNumBits,
-	         pSrcDst[1], pCurrent[1], pSign[1], tile->cbSrlData, tile->cbSrlLen,
+	         pSrcDst[1], pCurrent[1], pSign[1], pTemp,
+	         tile->cbSrlData, tile->cbSrlLen,
 	         tile->cbRawData, tile->cbRawLen); /* Cb */
 
 	if (status < 0)
@@ -1237,7 +1241,8 @@ static INLINE int progressive_decompress_tile_upgrade(PROGRESSIVE_CONTEXT* progr
 
 	status = progressive_rfx_upgrade_component(progressive, &shiftCr, quantProgCr,
 	         &crNumBits,
-	         pSrcDst[2], pCurrent[2], pSign[2], tile->crSrlData, tile->crSrlLen,
+	         pSrcDst[2], pCurrent[2], pSign[2], pTemp,
+	         tile->crSrlData, tile->crSrlLen,
 	         tile->crRawData, tile->crRawLen); /* Cr */
 
 	if (status < 0)
@@ -1246,30 +1251,101 @@ static INLINE int progressive_decompress_tile_upgrade(PROGRESSIVE_CONTEXT* progr
 	prims->yCbCrToRGB_16s8u_P3AC4R((const INT16**) pSrcDst, 64 * 2,
 	                               tile->data, tile->stride, tile->format,
 	                               &roi_64x64);
-	BufferPool_Return(progressive->bufferPool, pBuffer);
 	return 1;
 }
 
+static INLINE int progressive_decompress_tile(PROGRESSIVE_CONTEXT* progressive,
+        RFX_PROGRESSIVE_TILE* tile, BYTE* pScratch)
+{
+	switch (tile->blockType)
+	{
+		case PROGRESSIVE_WBT_TILE_SIMPLE:
+		case PROGRESSIVE_WBT_TILE_FIRST:
+			return progressive_decompress_tile_first(progressive, tile, pScratch);
+
+		case PROGRESSIVE_WBT_TILE_UPGRADE:
+			return progressive_decompress_tile_upgrade(progressive, tile, pScratch);
+
+		default:
+			return -1;
+	}
+}
+
+/**
+ * Work item i of a region decodes the tiles i, i + n, i + 2n, ... where n is
+ * the number of work items, so every worker has a scratch buffer of its own.
+ */
+static void CALLBACK progressive_tile_work_callback(PVOID context, ULONG index)
+{
+	UINT32 tileIndex;
+	PROGRESSIVE_TILE_WORK_PARAM* param = (PROGRESSIVE_TILE_WORK_PARAM*) context;
+	BYTE* pScratch = &param->progressive->scratch[index * PROGRESSIVE_SCRATCH_SIZE];
+
+	for (tileIndex = index; tileIndex < param->count; tileIndex += param->workers)
+	{
+		if (param->status < 0)
+			return;
+
+		if (progressive_decompress_tile(param->progressive, param->tiles[tileIndex], pScratch) < 0)
+			InterlockedExchange(&param->status, -1);
+	}
+}
+
+static BOOL progressive_decompress_tiles(PROGRESSIVE_CONTEXT* progressive,
+        RFX_PROGRESSIVE_TILE** tiles, UINT32 count, BOOL duplicates)
+{
+	UINT32 index;
+	PROGRESSIVE_TILE_WORK_PARAM param;
+
+	/**
+	 * A tile sent twice in one region must be decoded in order, and both
+	 * decodes would use the same tile buffers. That does not happen with
+	 * sane servers, so such regions simply take the sequential path.
+	 */
+	if (!progressive->Parallel || duplicates || (count < 2))
+	{
+		for (index = 0; index < count; index++)
+		{
+			if (progressive_decompress_tile(progressive, tiles[index], progressive->scratch) < 0)
+				return FALSE;
+		}
+
+		return TRUE;
+	}
+
+	param.progressive = progressive;
+	param.tiles = tiles;
+	param.count = count;
+	param.workers = (count < progressive->numWorkers) ? count : progressive->numWorkers;
+	param.status = 0;
+
+	if (!ThreadpoolParallelFor(progressive->Parallel, param.workers,
+	                           progressive_tile_work_callback, &param))
+		return FALSE;
+
+	return param.status >= 0;
+}
+
 static INLINE int progressive_process_tiles(PROGRESSIVE_CONTEXT* progressive,
         const BYTE* blocks, UINT32 blocksLen,
         const PROGRESSIVE_SURFACE_CONTEXT* surface)
 {
-	int status = -1;
 	const BYTE* block;
 	UINT16 xIdx;
 	UINT16 yIdx;
 	UINT16 zIdx;
-	UINT16 index;
 	UINT32 boffset;
 	UINT16 blockType;
 	UINT32 blockLen;
 	UINT32 count = 0;
 	UINT32 offset = 0;
+	BOOL duplicates = FALSE;
 	RFX_PROGRESSIVE_TILE* tile;
 	RFX_PROGRESSIVE_TILE** tiles;
 	PROGRESSIVE_BLOCK_REGION* region;
 	region = &(progressive->region);
 	tiles = region->tiles;
+	progressive->regionIndex++;
 
 	while ((blocksLen - offset) >= 6)
 	{
@@ -1283,6 +1359,9 @@ static INLINE int progressive_process_tiles(PROGRESSIVE_CONTEXT* progressive,
 		if ((blocksLen - offset) < blockLen)
 			return -1003;
 
+		if (count >= progressive->cTiles)
+			return -1;
+
 		switch (blockType)
 		{
 			case PROGRESSIVE_WBT_TILE_SIMPLE:
@@ -1481,6 +1560,11 @@ static INLINE int progressive_process_tiles(PROGRESSIVE_CONTEXT* progressive,
 		if (boffset != blockLen)
 			return -1040;
 
+		if (tile->regionIndex == progressive->regionIndex)
+			duplicates = TRUE;
+
+		tile->regionIndex = progressive->regionIndex;
+
 		offset += blockLen;
 		count++;
 	}
@@ -1495,25 +1579,8 @@ static INLINE int progressive_process_tiles(PROGRESSIVE_CONTEXT* progressive,
 		           region->numTiles);
 	}
 
-	for (index = 0; index < region->numTiles; index++)
-	{
-		tile = tiles[index];
-
-		switch (tile->blockType)
-		{
-			case PROGRESSIVE_WBT_TILE_SIMPLE:
-			case PROGRESSIVE_WBT_TILE_FIRST:
-				status = progressive_decompress_tile_first(progressive, tile);
-				break;
-
-			case PROGRESSIVE_WBT_TILE_UPGRADE:
-				status = progressive_decompress_tile_upgrade(progressive, tile);
-				break;
-		}
-
-		if (status < 0)
-			return -1;
-	}
+	if (!progressive_decompress_tiles(progressive, tiles, count, duplicates))
+		return -1;
 
 	return (int) offset;
 }
@@ -1930,10 +1997,912 @@ INT32 progressive_decompress(PROGRESSIVE_CONTEXT* progressive,
 	return rc;
 }
 
+/*
+ * Encoder
+ *
+ * Tiles are transformed with the reduce-extrapolate DWT (the inverse of
+ * progressive_rfx_dwt_2d_decode_block) and quantized once at full precision.
+ * The quantized coefficients are kept in tile->current, so later quality
+ * upgrades only need the surface tile state and not the source bitmap.
+ *
+ * The first pass is sent at the coarsest quality of the table below and each
+ * call to progressive_compress_upgrade() refines all pending tiles by one
+ * step until full quality (0xFF) has been reached.
+ */
+
+#define PROGRESSIVE_ENCODE_MAX_COMPONENT_SIZE	8192
+
+struct _RFX_PROGRESSIVE_ENCODE_BAND
+{
+	UINT32 offset;
+	UINT32 length;
+	size_t quant;
+};
+typedef struct _RFX_PROGRESSIVE_ENCODE_BAND RFX_PROGRESSIVE_ENCODE_BAND;
+
+#define PROGRESSIVE_BAND_QUANT(_q, _band) (((const BYTE*) (_q))[(_band)->quant])
+
+/* upgrade block order, LL3 is always last */
+static const RFX_PROGRESSIVE_ENCODE_BAND progressive_encode_bands[10] =
+{
+	{ 0, 1023, offsetof(RFX_COMPONENT_CODEC_QUANT, HL1) },
+	{ 1023, 1023, offsetof(RFX_COMPONENT_CODEC_QUANT, LH1) },
+	{ 2046, 961, offsetof(RFX_COMPONENT_CODEC_QUANT, HH1) },
+	{ 3007, 272, offsetof(RFX_COMPONENT_CODEC_QUANT, HL2) },
+	{ 3279, 272, offsetof(RFX_COMPONENT_CODEC_QUANT, LH2) },
+	{ 3551, 256, offsetof(RFX_COMPONENT_CODEC_QUANT, HH2) },
+	{ 3807, 72, offsetof(RFX_COMPONENT_CODEC_QUANT, HL3) },
+	{ 3879, 72, offsetof(RFX_COMPONENT_CODEC_QUANT, LH3) },
+	{ 3951, 64, offsetof(RFX_COMPONENT_CODEC_QUANT, HH3) },
+	{ 4015, 81, offsetof(RFX_COMPONENT_CODEC_QUANT, LL3) }
+};
+
+/* same values as the RemoteFX default quantization, LL3 to HH1 */
+static const RFX_COMPONENT_CODEC_QUANT progressive_encode_quant =
+{
+	6, 6, 6, 6, 7, 7, 8, 8, 8, 9
+};
+
+#define PROGRESSIVE_ENCODE_QUALITY_COUNT	2
+
+static const RFX_PROGRESSIVE_CODEC_QUANT
+progressive_encode_quant_prog[PROGRESSIVE_ENCODE_QUALITY_COUNT] =
+{
+	{
+		25,
+		{ 2, 4, 4, 4, 4, 4, 4, 4, 4, 4 },
+		{ 2, 4, 4, 4, 4, 4, 4, 4, 4, 4 },
+		{ 2, 4, 4, 4, 4, 4, 4, 4, 4, 4 }
+	},
+	{
+		50,
+		{ 1, 2, 2, 2, 2, 2, 2, 2, 2, 2 },
+		{ 1, 2, 2, 2, 2, 2, 2, 2, 2, 2 },
+		{ 1, 2, 2, 2, 2, 2, 2, 2, 2, 2 }
+	}
+};
+
+struct _RFX_PROGRESSIVE_SRL_ENCODER
+{
+	RFX_BITSTREAM* bs;
+	int kp;
+	UINT32 nz;
+};
+typedef struct _RFX_PROGRESSIVE_SRL_ENCODER RFX_PROGRESSIVE_SRL_ENCODER;
+
+static INLINE INT16 progressive_rfx_dwt_clamp(INT32 value)
+{
+	if (value < INT16_MIN)
+		return INT16_MIN;
+
+	if (value > INT16_MAX)
+		return INT16_MAX;
+
+	return (INT16) value;
+}
+
+static INLINE void progressive_rfx_dwt_1d_encode(const INT16* pSrc, int nSrcStep,
+        INT16* pLow, int nLowStep, INT16* pHigh, int nHighStep,
+        int nLowCount, int nHighCount)
+{
+	int k;
+	INT32 L;
+	INT32 X[64];
+	INT32 H[32];
+	const int nSrcCount = nLowCount + nHighCount;
+
+	for (k = 0; k < nSrcCount; k++)
+		X[k] = pSrc[k * nSrcStep];
+
+	for (k = 0; k < nHighCount; k++)
+		H[k] = (X[2 * k + 1] - ((X[2 * k] + X[2 * k + 2]) / 2)) / 2;
+
+	for (k = 0; k < nHighCount; k++)
+	{
+		L = X[2 * k] + (((k ? H[k - 1] : H[0]) + H[k]) / 2);
+		pLow[k * nLowStep] = progressive_rfx_dwt_clamp(L);
+		pHigh[k * nHighStep] = progressive_rfx_dwt_clamp(H[k]);
+	}
+
+	if (nLowCount > (nHighCount + 1))
+	{
+		/* 64 samples: 33 low, 31 high, the last two samples are extrapolated */
+		L = X[2 * k] + (H[k - 1] / 2);
+		pLow[k * nLowStep] = progressive_rfx_dwt_clamp(L);
+		L = (2 * X[2 * k + 1]) - X[2 * k];
+		pLow[(k + 1) * nLowStep] = progressive_rfx_dwt_clamp(L);
+	}
+	else
+	{
+		L = X[2 * k] + H[k - 1];
+		pLow[k * nLowStep] = progressive_rfx_dwt_clamp(L);
+	}
+}
+
+static INLINE void progressive_rfx_dwt_2d_encode_block(INT16* buffer, INT16* temp,
+        int level)
+{
+	int i;
+	int nStep;
+	int nBandL;
+	int nBandH;
+	INT16* HL, *LH;
+	INT16* HH, *LL;
+	INT16* L, *H;
+	nBandL = progressive_rfx_get_band_l_count(level);
+	nBandH = progressive_rfx_get_band_h_count(level);
+	nStep = nBandL + nBandH;
+	HL = &buffer[0];
+	LH = &HL[nBandH * nBandL];
+	HH = &LH[nBandL * nBandH];
+	LL = &HH[nBandH * nBandH];
+	L = &temp[0];
+	H = &temp[nBandL * nStep];
+
+	/* vertical (X -> L + H) */
+	for (i = 0; i < nStep; i++)
+		progressive_rfx_dwt_1d_encode(&buffer[i], nStep, &L[i], nStep, &H[i], nStep,
+		                              nBandL, nBandH);
+
+	/* horizontal (L -> LL + HL) */
+	for (i = 0; i < nBandL; i++)
+		progressive_rfx_dwt_1d_encode(&L[i * nStep], 1, &LL[i * nBandL], 1,
+		                              &HL[i * nBandH], 1, nBandL, nBandH);
+
+	/* horizontal (H -> LH + HH) */
+	for (i = 0; i < nBandH; i++)
+		progressive_rfx_dwt_1d_encode(&H[i * nStep], 1, &LH[i * nBandL], 1,
+		                              &HH[i * nBandH], 1, nBandL, nBandH);
+}
+
+static INLINE void progressive_rfx_dwt_2d_encode(INT16* buffer, INT16* temp)
+{
+	progressive_rfx_dwt_2d_encode_block(&buffer[0], temp, 1);
+	progressive_rfx_dwt_2d_encode_block(&buffer[3007], temp, 2);
+	progressive_rfx_dwt_2d_encode_block(&buffer[3807], temp, 3);
+}
+
+static INLINE void progressive_rfx_quantize_component(const INT16* buffer,
+        const RFX_COMPONENT_CODEC_QUANT* quant, INT16* coeffs)
+{
+	UINT32 i;
+	UINT32 band;
+	UINT32 shift;
+	const RFX_PROGRESSIVE_ENCODE_BAND* pBand;
+
+	for (band = 0; band < 10; band++)
+	{
+		pBand = &progressive_encode_bands[band];
+		/* -6 + 5 = -1, the YCbCr samples are scaled by 32 */
+		shift = PROGRESSIVE_BAND_QUANT(quant, pBand) - 1;
+
+		for (i = pBand->offset; i < pBand->offset + pBand->length; i++)
+			coeffs[i] = (INT16)((buffer[i] + (1 << (shift - 1))) >> shift);
+	}
+}
+
+static INLINE INT16 progressive_rfx_quant_value(INT16 value, UINT32 shift, BOOL nonLL)
+{
+	/* LL3 is sent in two's complement, all other bands as sign and magnitude */
+	if (!nonLL || (value >= 0))
+		return (INT16)(value >> shift);
+
+	return (INT16)(-((-value) >> shift));
+}
+
+static int progressive_rfx_encode_component_first(const INT16* coeffs,
+        const RFX_COMPONENT_CODEC_QUANT* progQuant, INT16* temp,
+        BYTE* pDstData, UINT32 DstSize)
+{
+	int length;
+	UINT32 i;
+	UINT32 band;
+	UINT32 shift;
+	const RFX_PROGRESSIVE_ENCODE_BAND* pBand;
+
+	for (band = 0; band < 10; band++)
+	{
+		pBand = &progressive_encode_bands[band];
+		shift = PROGRESSIVE_BAND_QUANT(progQuant, pBand);
+
+		for (i = pBand->offset; i < pBand->offset + pBand->length; i++)
+			temp[i] = progressive_rfx_quant_value(coeffs[i], shift, band < 9);
+	}
+
+	rfx_differential_encode(&temp[4015], 81); /* LL3 */
+	length = rfx_rlgr_encode(RLGR1, temp, 4096, pDstData, DstSize);
+
+	if ((length < 0) || ((UINT32) length >= DstSize))
+		return -1;
+
+	return length;
+}
+
+static INLINE void progressive_rfx_srl_write(RFX_PROGRESSIVE_SRL_ENCODER* state,
+        INT16 value, UINT32 numBits)
+{
+	int k;
+	UINT32 mag;
+	UINT32 max;
+	UINT32 count;
+	RFX_BITSTREAM* bs = state->bs;
+
+	if (!value)
+	{
+		state->nz++;
+		return;
+	}
+
+	/* zero encoding: '0' for each full run of (1 << k), then '1' and the rest */
+	k = state->kp / 8;
+
+	while (state->nz >= (1U << k))
+	{
+		rfx_bitstream_put_bits(bs, 0, 1);
+		state->nz -= (1U << k);
+		state->kp += 4;
+
+		if (state->kp > 80)
+			state->kp = 80;
+
+		k = state->kp / 8;
+	}
+
+	rfx_bitstream_put_bits(bs, 1, 1);
+
+	if (k)
+		rfx_bitstream_put_bits(bs, state->nz, k);
+
+	state->nz = 0;
+	/* unary encoding */
+	rfx_bitstream_put_bits(bs, (value < 0) ? 1 : 0, 1);
+	state->kp -= 6;
+
+	if (state->kp < 0)
+		state->kp = 0;
+
+	if (numBits == 1)
+		return;
+
+	mag = (value < 0) ? -value : value;
+	max = (1 << numBits) - 1;
+
+	for (count = mag - 1; count > 0; count -= MIN(count, 16))
+		rfx_bitstream_put_bits(bs, 0, MIN(count, 16));
+
+	if (mag < max)
+		rfx_bitstream_put_bits(bs, 1, 1);
+}
+
+static INLINE void progressive_rfx_srl_flush(RFX_PROGRESSIVE_SRL_ENCODER* state)
+{
+	int k;
+	RFX_BITSTREAM* bs = state->bs;
+
+	/* trailing zeros, the decoder ignores the excess of the last run */
+	while (state->nz)
+	{
+		k = state->kp / 8;
+		rfx_bitstream_put_bits(bs, 0, 1);
+		state->nz -= MIN(state->nz, (1U << k));
+		state->kp += 4;
+
+		if (state->kp > 80)
+			state->kp = 80;
+	}
+}
+
+static int progressive_rfx_encode_component_upgrade(const INT16* coeffs,
+        const RFX_COMPONENT_CODEC_QUANT* oldProgQuant,
+        const RFX_COMPONENT_CODEC_QUANT* newProgQuant,
+        BYTE* pSrlData, UINT32* pSrlLen, BYTE* pRawData, UINT32* pRawLen, UINT32 DstSize)
+{
+	UINT32 i;
+	UINT32 band;
+	UINT32 mag;
+	UINT32 mask;
+	UINT32 oldShift;
+	UINT32 newShift;
+	UINT32 numBits;
+	RFX_BITSTREAM s_srl;
+	RFX_BITSTREAM s_raw;
+	RFX_BITSTREAM* srl = &s_srl;
+	RFX_BITSTREAM* raw = &s_raw;
+	RFX_PROGRESSIVE_SRL_ENCODER state;
+	const RFX_PROGRESSIVE_ENCODE_BAND* pBand;
+	ZeroMemory(pSrlData, DstSize);
+	ZeroMemory(pRawData, DstSize);
+	rfx_bitstream_attach(srl, pSrlData, DstSize);
+	rfx_bitstream_attach(raw, pRawData, DstSize);
+	state.bs = srl;
+	state.kp = 8;
+	state.nz = 0;
+
+	for (band = 0; band < 10; band++)
+	{
+		pBand = &progressive_encode_bands[band];
+		oldShift = PROGRESSIVE_BAND_QUANT(oldProgQuant, pBand);
+		newShift = PROGRESSIVE_BAND_QUANT(newProgQuant, pBand);
+
+		if (newShift > oldShift)
+			return -1;
+
+		numBits = oldShift - newShift;
+
+		if (!numBits)
+			continue;
+
+		mask = (1 << numBits) - 1;
+
+		for (i = pBand->offset; i < pBand->offset + pBand->length; i++)
+		{
+			if (band == 9)
+			{
+				/* LL3: always raw */
+				rfx_bitstream_put_bits(raw, (coeffs[i] >> newShift) & mask, numBits);
+				continue;
+			}
+
+			mag = (coeffs[i] < 0) ? -coeffs[i] : coeffs[i];
+
+			if (mag >> oldShift)
+			{
+				/* sign already known to the decoder, send the magnitude bits */
+				rfx_bitstream_put_bits(raw, (mag >> newShift) & mask, numBits);
+			}
+			else
+			{
+				progressive_rfx_srl_write(&state,
+				                          progressive_rfx_quant_value(coeffs[i], newShift, TRUE), numBits);
+			}
+		}
+	}
+
+	progressive_rfx_srl_flush(&state);
+
+	if (rfx_bitstream_eos(srl) || rfx_bitstream_eos(raw))
+		return -1;
+
+	*pSrlLen = rfx_bitstream_get_processed_bytes(srl);
+	*pRawLen = rfx_bitstream_get_processed_bytes(raw);
+	return 1;
+}
+
+static INLINE void progressive_tile_get_buffers(BYTE* pBuffer, INT16* pPlanes[3])
+{
+	pPlanes[0] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 0) + 16])); /* Y/R buffer */
+	pPlanes[1] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 1) + 16])); /* Cb/G buffer */
+	pPlanes[2] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 2) + 16])); /* Cr/B buffer */
+}
+
+static int progressive_rfx_encode_tile(PROGRESSIVE_CONTEXT* progressive,
+                                       RFX_PROGRESSIVE_TILE* tile, const BYTE* pSrcData,
+                                       UINT32 SrcFormat, UINT32 nSrcStep)
+{
+	int index;
+	INT16* temp;
+	BYTE* pBuffer;
+	const BYTE* pSrcTile;
+	INT16* pSrcDst[3];
+	INT16* pCurrent[3];
+	static const prim_size_t roi_64x64 = { 64, 64 };
+	const primitives_t* prims = primitives_get();
+
+	if (!tile->current)
+	{
+		tile->current = (BYTE*) _aligned_malloc((8192 + 32) * 3, 16);
+
+		if (!tile->current)
+			return -1;
+	}
+
+	progressive_tile_get_buffers(tile->current, pCurrent);
+	pBuffer = (BYTE*) BufferPool_Take(progressive->bufferPool, -1);
+	temp = (INT16*) BufferPool_Take(progressive->bufferPool, -1); /* DWT buffer */
+
+	if (!pBuffer || !temp)
+	{
+		if (pBuffer)
+			BufferPool_Return(progressive->bufferPool, pBuffer);
+
+		if (temp)
+			BufferPool_Return(progressive->bufferPool, temp);
+
+		return -1;
+	}
+
+	progressive_tile_get_buffers(pBuffer, pSrcDst);
+	pSrcTile = &pSrcData[(tile->y * nSrcStep) + (tile->x * GetBytesPerPixel(SrcFormat))];
+	rfx_encode_format_rgb(pSrcTile, tile->width, tile->height, nSrcStep, SrcFormat, NULL,
+	                      pSrcDst[0], pSrcDst[1], pSrcDst[2]);
+	prims->RGBToYCbCr_16s16s_P3P3((const INT16**) pSrcDst, 64 * sizeof(INT16),
+	                              pSrcDst, 64 * sizeof(INT16), &roi_64x64);
+
+	for (index = 0; index < 3; index++)
+	{
+		progressive_rfx_dwt_2d_encode(pSrcDst[index], temp);
+		progressive_rfx_quantize_component(pSrcDst[index], &progressive_encode_quant,
+		                                   pCurrent[index]);
+	}
+
+	BufferPool_Return(progressive->bufferPool, temp);
+	BufferPool_Return(progressive->bufferPool, pBuffer);
+	return 1;
+}
+
+static INLINE const RFX_PROGRESSIVE_CODEC_QUANT* progressive_encode_get_quant_prog(
+    PROGRESSIVE_CONTEXT* progressive, BYTE quality)
+{
+	if (quality == 0xFF)
+		return &(progressive->quantProgValFull);
+
+	return &progressive_encode_quant_prog[quality];
+}
+
+static int progressive_write_tile_first(PROGRESSIVE_CONTEXT* progressive,
+                                        wStream* s, RFX_PROGRESSIVE_TILE* tile)
+{
+	int index;
+	int length;
+	INT16* temp;
+	size_t start;
+	size_t end;
+	INT16* pCurrent[3];
+	UINT16 len[3];
+	const RFX_PROGRESSIVE_CODEC_QUANT* quantProg;
+	const RFX_COMPONENT_CODEC_QUANT* progQuant[3];
+	tile->quality = 0;
+	quantProg = progressive_encode_get_quant_prog(progressive, tile->quality);
+	progQuant[0] = &(quantProg->yQuantValues);
+	progQuant[1] = &(quantProg->cbQuantValues);
+	progQuant[2] = &(quantProg->crQuantValues);
+
+	if (!Stream_EnsureRemainingCapacity(s, 23 + 3 * PROGRESSIVE_ENCODE_MAX_COMPONENT_SIZE))
+		return -1;
+
+	temp = (INT16*) BufferPool_Take(progressive->bufferPool, -1);
+
+	if (!temp)
+		return -1;
+
+	progressive_tile_get_buffers(tile->current, pCurrent);
+	start = Stream_GetPosition(s);
+	Stream_Seek(s, 23);
+
+	for (index = 0; index < 3; index++)
+	{
+		length = progressive_rfx_encode_component_first(pCurrent[index], progQuant[index], temp,
+		         Stream_Pointer(s), PROGRESSIVE_ENCODE_MAX_COMPONENT_SIZE);
+
+		if (length < 0)
+		{
+			BufferPool_Return(progressive->bufferPool, temp);
+			return -1;
+		}
+
+		len[index] = (UINT16) length;
+		Stream_Seek(s, length);
+	}
+
+	BufferPool_Return(progressive->bufferPool, temp);
+	end = Stream_GetPosition(s);
+	Stream_SetPosition(s, start);
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_TILE_FIRST); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, (UINT32)(end - start)); /* blockLen (4 bytes) */
+	Stream_Write_UINT8(s, 0); /* quantIdxY (1 byte) */
+	Stream_Write_UINT8(s, 0); /* quantIdxCb (1 byte) */
+	Stream_Write_UINT8(s, 0); /* quantIdxCr (1 byte) */
+	Stream_Write_UINT16(s, tile->xIdx); /* xIdx (2 bytes) */
+	Stream_Write_UINT16(s, tile->yIdx); /* yIdx (2 bytes) */
+	Stream_Write_UINT8(s, 0); /* flags (1 byte) */
+	Stream_Write_UINT8(s, tile->quality); /* quality (1 byte) */
+	Stream_Write_UINT16(s, len[0]); /* yLen (2 bytes) */
+	Stream_Write_UINT16(s, len[1]); /* cbLen (2 bytes) */
+	Stream_Write_UINT16(s, len[2]); /* crLen (2 bytes) */
+	Stream_Write_UINT16(s, 0); /* tailLen (2 bytes) */
+	Stream_SetPosition(s, end);
+	tile->pass = 1;
+	return 1;
+}
+
+static int progressive_write_tile_upgrade(PROGRESSIVE_CONTEXT* progressive,
+        wStream* s, RFX_PROGRESSIVE_TILE* tile)
+{
+	int index;
+	int status = -1;
+	BYTE quality;
+	BYTE* pSrlData;
+	BYTE* pRawData;
+	UINT32 srlLen[3];
+	UINT32 rawLen[3];
+	INT16* pCurrent[3];
+	const RFX_PROGRESSIVE_CODEC_QUANT* oldQuantProg;
+	const RFX_PROGRESSIVE_CODEC_QUANT* newQuantProg;
+	const RFX_COMPONENT_CODEC_QUANT* oldProgQuant[3];
+	const RFX_COMPONENT_CODEC_QUANT* newProgQuant[3];
+	quality = ((tile->quality + 1) < PROGRESSIVE_ENCODE_QUALITY_COUNT) ? (tile->quality + 1) : 0xFF;
+	oldQuantProg = progressive_encode_get_quant_prog(progressive, tile->quality);
+	newQuantProg = progressive_encode_get_quant_prog(progressive, quality);
+	oldProgQuant[0] = &(oldQuantProg->yQuantValues);
+	oldProgQuant[1] = &(oldQuantProg->cbQuantValues);
+	oldProgQuant[2] = &(oldQuantProg->crQuantValues);
+	newProgQuant[0] = &(newQuantProg->yQuantValues);
+	newProgQuant[1] = &(newQuantProg->cbQuantValues);
+	newProgQuant[2] = &(newQuantProg->crQuantValues);
+
+	if (!Stream_EnsureRemainingCapacity(s, 26 + 6 * PROGRESSIVE_ENCODE_MAX_COMPONENT_SIZE))
+		return -1;
+
+	progressive_tile_get_buffers(tile->current, pCurrent);
+	pSrlData = (BYTE*) BufferPool_Take(progressive->bufferPool, -1);
+	pRawData = (BYTE*) BufferPool_Take(progressive->bufferPool, -1);
+
+	if (!pSrlData || !pRawData)
+		goto fail;
+
+	for (index = 0; index < 3; index++)
+	{
+		if (progressive_rfx_encode_component_upgrade(pCurrent[index], oldProgQuant[index],
+		        newProgQuant[index], &pSrlData[index * PROGRESSIVE_ENCODE_MAX_COMPONENT_SIZE],
+		        &srlLen[index], &pRawData[index * PROGRESSIVE_ENCODE_MAX_COMPONENT_SIZE],
+		        &rawLen[index], PROGRESSIVE_ENCODE_MAX_COMPONENT_SIZE) < 0)
+			goto fail;
+	}
+
+	tile->quality = quality;
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_TILE_UPGRADE); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, 26 + srlLen[0] + rawLen[0] + srlLen[1] + rawLen[1] +
+	                    srlLen[2] + rawLen[2]); /* blockLen (4 bytes) */
+	Stream_Write_UINT8(s, 0); /* quantIdxY (1 byte) */
+	Stream_Write_UINT8(s, 0); /* quantIdxCb (1 byte) */
+	Stream_Write_UINT8(s, 0); /* quantIdxCr (1 byte) */
+	Stream_Write_UINT16(s, tile->xIdx); /* xIdx (2 bytes) */
+	Stream_Write_UINT16(s, tile->yIdx); /* yIdx (2 bytes) */
+	Stream_Write_UINT8(s, tile->quality); /* quality (1 byte) */
+
+	for (index = 0; index < 3; index++)
+	{
+		Stream_Write_UINT16(s, (UINT16) srlLen[index]); /* srlLen (2 bytes) */
+		Stream_Write_UINT16(s, (UINT16) rawLen[index]); /* rawLen (2 bytes) */
+	}
+
+	for (index = 0; index < 3; index++)
+	{
+		Stream_Write(s, &pSrlData[index * PROGRESSIVE_ENCODE_MAX_COMPONENT_SIZE], srlLen[index]);
+		Stream_Write(s, &pRawData[index * PROGRESSIVE_ENCODE_MAX_COMPONENT_SIZE], rawLen[index]);
+	}
+
+	tile->pass++;
+	status = 1;
+fail:
+
+	if (pSrlData)
+		BufferPool_Return(progressive->bufferPool, pSrlData);
+
+	if (pRawData)
+		BufferPool_Return(progressive->bufferPool, pRawData);
+
+	return status;
+}
+
+static INLINE void progressive_component_codec_quant_write(wStream* s,
+        const RFX_COMPONENT_CODEC_QUANT* quantVal)
+{
+	Stream_Write_UINT8(s, quantVal->LL3 | (quantVal->HL3 << 4));
+	Stream_Write_UINT8(s, quantVal->LH3 | (quantVal->HH3 << 4));
+	Stream_Write_UINT8(s, quantVal->HL2 | (quantVal->LH2 << 4));
+	Stream_Write_UINT8(s, quantVal->HH2 | (quantVal->HL1 << 4));
+	Stream_Write_UINT8(s, quantVal->LH1 | (quantVal->HH1 << 4));
+}
+
+static PROGRESSIVE_SURFACE_CONTEXT* progressive_get_encoder_surface(
+    PROGRESSIVE_CONTEXT* progressive, UINT16 surfaceId, UINT32 width, UINT32 height)
+{
+	PROGRESSIVE_SURFACE_CONTEXT* surface;
+	surface = (PROGRESSIVE_SURFACE_CONTEXT*) progressive_get_surface_data(progressive, surfaceId);
+
+	if (surface && ((surface->width != width) || (surface->height != height)))
+	{
+		progressive_delete_surface_context(progressive, surfaceId);
+		surface = NULL;
+	}
+
+	if (!surface)
+	{
+		if (progressive_create_surface_context(progressive, surfaceId, width, height) < 0)
+			return NULL;
+
+		surface = (PROGRESSIVE_SURFACE_CONTEXT*) progressive_get_surface_data(progressive, surfaceId);
+	}
+
+	return surface;
+}
+
+/**
+ * Writes a complete frame for all surface tiles that have a block type set:
+ * TILE_FIRST tiles are (re)encoded from pSrcData, TILE_UPGRADE tiles are
+ * refined from the coefficients kept in the surface context.
+ */
+static int progressive_write_frame(PROGRESSIVE_CONTEXT* progressive,
+                                   PROGRESSIVE_SURFACE_CONTEXT* surface,
+                                   const BYTE* pSrcData, UINT32 SrcFormat, UINT32 nSrcStep,
+                                   BYTE** ppDstData, UINT32* pDstSize)
+{
+	int status = -1;
+	int index;
+	UINT32 numRects = 0;
+	UINT32 numTiles = 0;
+	size_t regionStart;
+	size_t tilesStart;
+	size_t end;
+	RECTANGLE_16 rect;
+	REGION16 region;
+	const RECTANGLE_16* rects;
+	RFX_PROGRESSIVE_TILE* tile;
+	wStream* s = progressive->buffer;
+	region16_init(&region);
+
+	for (index = 0; index < (int) surface->gridSize; index++)
+	{
+		tile = &(surface->tiles[index]);
+
+		if (!tile->blockType)
+			continue;
+
+		rect.left = tile->x;
+		rect.top = tile->y;
+		rect.right = tile->x + tile->width;
+		rect.bottom = tile->y + tile->height;
+
+		if (!region16_union_rect(&region, &region, &rect))
+			goto fail;
+
+		numTiles++;
+	}
+
+	*ppDstData = NULL;
+	*pDstSize = 0;
+
+	if (!numTiles)
+	{
+		status = 1;
+		goto fail;
+	}
+
+	rects = region16_rects(&region, &numRects);
+
+	if ((numTiles > 0xFFFF) || (numRects > 0xFFFF))
+		goto fail;
+
+	Stream_SetPosition(s, 0);
+
+	if (!Stream_EnsureRemainingCapacity(s, 12 + 10 + 12 + 18 + (numRects * 8) + 5 +
+	                                    (PROGRESSIVE_ENCODE_QUALITY_COUNT * 16) + 6))
+		goto fail;
+
+	/* SYNC */
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_SYNC); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, 12); /* blockLen (4 bytes) */
+	Stream_Write_UINT32(s, 0xCACCACCA); /* magic (4 bytes) */
+	Stream_Write_UINT16(s, 0x0100); /* version (2 bytes) */
+	/* CONTEXT */
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_CONTEXT); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, 10); /* blockLen (4 bytes) */
+	Stream_Write_UINT8(s, 0); /* ctxId (1 byte) */
+	Stream_Write_UINT16(s, 64); /* tileSize (2 bytes) */
+	Stream_Write_UINT8(s, RFX_SUBBAND_DIFFING); /* flags (1 byte) */
+	/* FRAME_BEGIN */
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_FRAME_BEGIN); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, 12); /* blockLen (4 bytes) */
+	Stream_Write_UINT32(s, progressive->frameIndex++); /* frameIndex (4 bytes) */
+	Stream_Write_UINT16(s, 1); /* regionCount (2 bytes) */
+	/* REGION */
+	regionStart = Stream_GetPosition(s);
+	Stream_Seek(s, 18);
+
+	for (index = 0; index < (int) numRects; index++)
+	{
+		Stream_Write_UINT16(s, rects[index].left); /* x (2 bytes) */
+		Stream_Write_UINT16(s, rects[index].top); /* y (2 bytes) */
+		Stream_Write_UINT16(s, rects[index].right - rects[index].left); /* width (2 bytes) */
+		Stream_Write_UINT16(s, rects[index].bottom - rects[index].top); /* height (2 bytes) */
+	}
+
+	progressive_component_codec_quant_write(s, &progressive_encode_quant);
+
+	for (index = 0; index < PROGRESSIVE_ENCODE_QUALITY_COUNT; index++)
+	{
+		Stream_Write_UINT8(s, progressive_encode_quant_prog[index].quality);
+		progressive_component_codec_quant_write(s, &progressive_encode_quant_prog[index].yQuantValues);
+		progressive_component_codec_quant_write(s, &progressive_encode_quant_prog[index].cbQuantValues);
+		progressive_component_codec_quant_write(s, &progressive_encode_quant_prog[index].crQuantValues);
+	}
+
+	tilesStart = Stream_GetPosition(s);
+
+	for (index = 0; index < (int) surface->gridSize; index++)
+	{
+		tile = &(surface->tiles[index]);
+
+		if (tile->blockType == PROGRESSIVE_WBT_TILE_FIRST)
+		{
+			if (progressive_rfx_encode_tile(progressive, tile, pSrcData, SrcFormat, nSrcStep) < 0)
+				goto fail;
+
+			if (progressive_write_tile_first(progressive, s, tile) < 0)
+				goto fail;
+		}
+		else if (tile->blockType == PROGRESSIVE_WBT_TILE_UPGRADE)
+		{
+			if (progressive_write_tile_upgrade(progressive, s, tile) < 0)
+				goto fail;
+		}
+
+		tile->blockType = 0;
+	}
+
+	end = Stream_GetPosition(s);
+	Stream_SetPosition(s, regionStart);
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_REGION); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, (UINT32)(end - regionStart)); /* blockLen (4 bytes) */
+	Stream_Write_UINT8(s, 64); /* tileSize (1 byte) */
+	Stream_Write_UINT16(s, (UINT16) numRects); /* numRects (2 bytes) */
+	Stream_Write_UINT8(s, 1); /* numQuant (1 byte) */
+	Stream_Write_UINT8(s, PROGRESSIVE_ENCODE_QUALITY_COUNT); /* numProgQuant (1 byte) */
+	Stream_Write_UINT8(s, RFX_DWT_REDUCE_EXTRAPOLATE); /* flags (1 byte) */
+	Stream_Write_UINT16(s, (UINT16) numTiles); /* numTiles (2 bytes) */
+	Stream_Write_UINT32(s, (UINT32)(end - tilesStart)); /* tileDataSize (4 bytes) */
+	Stream_SetPosition(s, end);
+
+	if (!Stream_EnsureRemainingCapacity(s, 6))
+		goto fail;
+
+	/* FRAME_END */
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_FRAME_END); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, 6); /* blockLen (4 bytes) */
+	Stream_SealLength(s);
+	*ppDstData = Stream_Buffer(s);
+	*pDstSize = (UINT32) Stream_Length(s);
+	status = 1;
+fail:
+
+	if (status < 0)
+	{
+		/* drop the encoder state, the affected tiles have to be sent again */
+		for (index = 0; index < (int) surface->gridSize; index++)
+		{
+			surface->tiles[index].blockType = 0;
+			surface->tiles[index].pass = 0;
+		}
+	}
+
+	region16_uninit(&region);
+	return status;
+}
+
+/**
+ * Encodes the tiles of the surface that intersect invalidRegion as a first
+ * (coarse) progressive pass.
+ *
+ * The returned buffer is owned by the context and valid until the next call.
+ * Tiles that still need refinement can be upgraded with
+ * progressive_compress_upgrade().
+ */
 int progressive_compress(PROGRESSIVE_CONTEXT* progressive, const BYTE* pSrcData,
-                         UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize)
+                         UINT32 SrcSize, UINT32 SrcFormat, UINT32 Width, UINT32 Height,
+                         UINT32 ScanLine, const REGION16* invalidRegion, UINT16 surfaceId,
+                         BYTE** ppDstData, UINT32* pDstSize)
+{
+	UINT32 i;
+	UINT32 xIdx;
+	UINT32 yIdx;
+	UINT32 numRects = 0;
+	RECTANGLE_16 rect;
+	const RECTANGLE_16* rects;
+	RFX_PROGRESSIVE_TILE* tile;
+	PROGRESSIVE_SURFACE_CONTEXT* surface;
+
+	if (!progressive || !progressive->Compressor || !pSrcData || !ppDstData || !pDstSize)
+		return -1;
+
+	if ((Width == 0) || (Height == 0) || (Width > 0xFFFF) || (Height > 0xFFFF))
+		return -1;
+
+	if (GetBytesPerPixel(SrcFormat) < 2)
+		return -1;
+
+	if ((ScanLine < Width * GetBytesPerPixel(SrcFormat)) || ((SrcSize / ScanLine) < Height))
+		return -1;
+
+	surface = progressive_get_encoder_surface(progressive, surfaceId, Width, Height);
+
+	if (!surface)
+		return -1;
+
+	if (invalidRegion)
+		rects = region16_rects(invalidRegion, &numRects);
+	else
+		rects = NULL;
+
+	for (i = 0; i < numRects; i++)
+	{
+		rect = rects[i];
+		rect.right = MIN(rect.right, Width);
+		rect.bottom = MIN(rect.bottom, Height);
+
+		if ((rect.left >= rect.right) || (rect.top >= rect.bottom))
+			continue;
+
+		for (yIdx = rect.top / 64; yIdx <= (rect.bottom - 1U) / 64U; yIdx++)
+		{
+			for (xIdx = rect.left / 64; xIdx <= (rect.right - 1U) / 64U; xIdx++)
+			{
+				tile = &(surface->tiles[(yIdx * surface->gridWidth) + xIdx]);
+				tile->blockType = PROGRESSIVE_WBT_TILE_FIRST;
+				tile->xIdx = (UINT16) xIdx;
+				tile->yIdx = (UINT16) yIdx;
+				tile->x = xIdx * 64;
+				tile->y = yIdx * 64;
+				tile->width = MIN(64, Width - tile->x);
+				tile->height = MIN(64, Height - tile->y);
+			}
+		}
+	}
+
+	return progressive_write_frame(progressive, surface, pSrcData, SrcFormat, ScanLine,
+	                               ppDstData, pDstSize);
+}
+
+/**
+ * Sends the next quality pass for every tile of the surface that has not
+ * reached full quality yet. *pDstSize is 0 if there is nothing left to refine.
+ */
+int progressive_compress_upgrade(PROGRESSIVE_CONTEXT* progressive, UINT16 surfaceId,
+                                 BYTE** ppDstData, UINT32* pDstSize)
 {
-	return -1;
+	UINT32 index;
+	RFX_PROGRESSIVE_TILE* tile;
+	PROGRESSIVE_SURFACE_CONTEXT* surface;
+
+	if (!progressive || !progressive->Compressor || !ppDstData || !pDstSize)
+		return -1;
+
+	surface = (PROGRESSIVE_SURFACE_CONTEXT*) progressive_get_surface_data(progressive, surfaceId);
+
+	if (!surface)
+		return -1;
+
+	for (index = 0; index < surface->gridSize; index++)
+	{
+		tile = &(surface->tiles[index]);
+
+		if (tile->pass && (tile->quality != 0xFF))
+			tile->blockType = PROGRESSIVE_WBT_TILE_UPGRADE;
+	}
+
+	return progressive_write_frame(progressive, surface, NULL, 0, 0, ppDstData, pDstSize);
+}
+
+BOOL progressive_compress_pending(PROGRESSIVE_CONTEXT* progressive, UINT16 surfaceId)
+{
+	UINT32 index;
+	PROGRESSIVE_SURFACE_CONTEXT* surface;
+
+	if (!progressive || !progressive->Compressor)
+		return FALSE;
+
+	surface = (PROGRESSIVE_SURFACE_CONTEXT*) progressive_get_surface_data(progressive, surfaceId);
+
+	if (!surface)
+		return FALSE;
+
+	for (index = 0; index < surface->gridSize; index++)
+	{
+		if (surface->tiles[index].pass && (surface->tiles[index].quality != 0xFF))
+			return TRUE;
+	}
+
+	return FALSE;
 }
 
 BOOL progressive_context_reset(PROGRESSIVE_CONTEXT* progressive)
@@ -1984,6 +2953,49 @@ PROGRESSIVE_CONTEXT* progressive_context_new(BOOL Compressor)
 		           sizeof(RFX_PROGRESSIVE_CODEC_QUANT));
 		progressive->quantProgValFull.quality = 100;
 		progressive->SurfaceContexts = HashTable_New(TRUE);
+
+		if (Compressor)
+		{
+			progressive->buffer = Stream_New(NULL, 0x10000);
+
+			if (!progressive->buffer)
+				goto cleanup;
+
+			progressive->numWorkers = 1;
+		}
+		else
+		{
+			SYSTEM_INFO sysinfo;
+			GetNativeSystemInfo(&sysinfo);
+			progressive->numWorkers = sysinfo.dwNumberOfProcessors;
+
+			if (progressive->numWorkers < 1)
+				progressive->numWorkers = 1;
+		}
+
+		if (progressive->numWorkers > 1)
+		{
+			/* initialize the primitives before they are used from the pool threads */
+			primitives_get();
+
+			if (!(progressive->ThreadPool = CreateThreadpool(NULL)))
+				goto cleanup;
+
+			InitializeThreadpoolEnvironment(&progressive->ThreadPoolEnv);
+			SetThreadpoolCallbackPool(&progressive->ThreadPoolEnv, progressive->ThreadPool);
+			SetThreadpoolThreadMaximum(progressive->ThreadPool, progressive->numWorkers);
+
+			if (!(progressive->Parallel = CreateThreadpoolParallel(&progressive->ThreadPoolEnv,
+			                              progressive->numWorkers)))
+				goto cleanup;
+		}
+
+		progressive->scratch = (BYTE*) _aligned_malloc(
+		                           progressive->numWorkers * PROGRESSIVE_SCRATCH_SIZE, 16);
+
+		if (!progressive->scratch)
+			goto cleanup;
+
 		progressive_context_reset(progressive);
 		progressive->log = WLog_Get(TAG);
 	}
@@ -2004,11 +3016,19 @@ void progressive_context_free(PROGRESSIVE_CONTEXT* progressive)
 	if (!progressive)
 		return;
 
+	if (progressive->ThreadPool)
+	{
+		CloseThreadpoolParallel(progressive->Parallel);
+		CloseThreadpool(progressive->ThreadPool);
+	}
+
+	_aligned_free(progressive->scratch);
 	BufferPool_Free(progressive->bufferPool);
 	free(progressive->rects);
 	free(progressive->tiles);
 	free(progressive->quantVals);
 	free(progressive->quantProgVals);
+	Stream_Free(progressive->buffer, TRUE);
 
 	if (progressive->SurfaceContexts)
 	{
@@ -22,6 +22,7 @@
 #define INTERNAL_CODEC_PROGRESSIVE_H
 
 #include <winpr/wlog.h>
+#include <winpr/pool.h>
 #include <winpr/collections.h>
 
 #include <freerdp/codec/rfx.h>
@@ -32,6 +33,12 @@
 
 #define RFX_DWT_REDUCE_EXTRAPOLATE			0x01
 
+/**
+ * Decoder scratch space per worker: three 64x64 coefficient planes and a
+ * DWT buffer, which needs room for a 65x65 (extrapolated) band.
+ */
+#define PROGRESSIVE_SCRATCH_SIZE			((8192 + 32) * 5)
+
 #define PROGRESSIVE_WBT_SYNC				0xCCC0
 #define PROGRESSIVE_WBT_FRAME_BEGIN			0xCCC1
 #define PROGRESSIVE_WBT_FRAME_END			0xCCC2
@@ -150,6 +157,8 @@ struct _RFX_PROGRESSIVE_TILE
 	RFX_COMPONENT_CODEC_QUANT yProgQuant;
 	RFX_COMPONENT_CODEC_QUANT cbProgQuant;
 	RFX_COMPONENT_CODEC_QUANT crProgQuant;
+
+	UINT32 regionIndex;
 };
 typedef struct _RFX_PROGRESSIVE_TILE RFX_PROGRESSIVE_TILE;
 
@@ -227,7 +236,27 @@ struct _PROGRESSIVE_CONTEXT
 
 	wHashTable* SurfaceContexts;
 	wLog* log;
+
+	wStream* buffer;
+	UINT32 frameIndex;
+
+	UINT32 regionIndex;
+	UINT32 numWorkers;
+	BYTE* scratch;
+	PTP_POOL ThreadPool;
+	TP_CALLBACK_ENVIRON ThreadPoolEnv;
+	PTP_PARALLEL Parallel;
+};
+
+struct _PROGRESSIVE_TILE_WORK_PARAM
+{
+	PROGRESSIVE_CONTEXT* progressive;
+	RFX_PROGRESSIVE_TILE** tiles;
+	UINT32 count;
+	UINT32 workers;
+	LONG status;
 };
+typedef struct _PROGRESSIVE_TILE_WORK_PARAM PROGRESSIVE_TILE_WORK_PARAM;
 
 #endif /* INTERNAL_CODEC_PROGRESSIVE_H */
 
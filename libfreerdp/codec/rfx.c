@@ -320,6 +320,10 @@ RFX_CONTEXT* rfx_context_new(BOOL encoder)
 
 		if (priv->MaxThreadCount)
 			SetThreadpoolThreadMaximum(priv->ThreadPool, priv->MaxThreadCount);
+
+		if (!(priv->Parallel = CreateThreadpoolParallel(&priv->ThreadPoolEnv,
+		                       priv->MaxThreadCount)))
+			goto error_threadPool_minimum;
 	}
 
 	/* initialize the default pixel format */
@@ -370,10 +374,9 @@ void rfx_context_free(RFX_CONTEXT* context)
 
 	if (priv->UseThreads)
 	{
+		CloseThreadpoolParallel(priv->Parallel);
 		CloseThreadpool(context->priv->ThreadPool);
 		DestroyThreadpoolEnvironment(&context->priv->ThreadPoolEnv);
-		free(priv->workObjects);
-		free(priv->tileWorkParams);
 #ifdef WITH_PROFILER
 		WLog_VRB(TAG,
 		         "WARNING: Profiling results probably unusable with multithreaded RemoteFX codec!");
@@ -732,26 +735,25 @@ static BOOL rfx_process_message_region(RFX_CONTEXT* context,
 	return TRUE;
 }
 
-struct _RFX_TILE_PROCESS_WORK_PARAM
+struct _RFX_TILE_WORK_PARAM
 {
-	RFX_TILE* tile;
 	RFX_CONTEXT* context;
+	RFX_MESSAGE* message;
 };
-typedef struct _RFX_TILE_PROCESS_WORK_PARAM RFX_TILE_PROCESS_WORK_PARAM;
+typedef struct _RFX_TILE_WORK_PARAM RFX_TILE_WORK_PARAM;
 
-static void CALLBACK rfx_process_message_tile_work_callback(
-    PTP_CALLBACK_INSTANCE
-    instance, void* context, PTP_WORK work)
+static VOID rfx_process_message_tile_work_callback(PVOID context, ULONG index)
 {
-	RFX_TILE_PROCESS_WORK_PARAM* param = (RFX_TILE_PROCESS_WORK_PARAM*) context;
-	rfx_decode_rgb(param->context, param->tile, param->tile->data, 64 * 4);
+	RFX_TILE_WORK_PARAM* param = (RFX_TILE_WORK_PARAM*) context;
+	RFX_TILE* tile = param->message->tiles[index];
+	rfx_decode_rgb(param->context, tile, tile->data, 64 * 4);
 }
 
 static BOOL rfx_process_message_tileset(RFX_CONTEXT* context,
                                         RFX_MESSAGE* message, wStream* s, UINT16* pExpectedBlockType)
 {
 	BOOL rc;
-	int i, close_cnt;
+	int i;
 	size_t pos;
 	BYTE quant;
 	RFX_TILE* tile;
@@ -761,8 +763,7 @@ static BOOL rfx_process_message_tileset(RFX_CONTEXT* context,
 	UINT32 blockLen;
 	UINT32 blockType;
 	UINT32 tilesDataSize;
-	PTP_WORK* work_objects = NULL;
-	RFX_TILE_PROCESS_WORK_PARAM* params = NULL;
+	RFX_TILE_WORK_PARAM param;
 	void* pmem;
 
 	if (*pExpectedBlockType != WBT_EXTENSION)
@@ -858,28 +859,9 @@ static BOOL rfx_process_message_tileset(RFX_CONTEXT* context,
 
 	message->tiles = tmpTiles;
 	message->numTiles = numTiles;
-
-	if (context->priv->UseThreads)
-	{
-		work_objects = (PTP_WORK*) calloc(message->numTiles, sizeof(PTP_WORK));
-		params = (RFX_TILE_PROCESS_WORK_PARAM*) calloc(message->numTiles,
-		         sizeof(RFX_TILE_PROCESS_WORK_PARAM));
-
-		if (!work_objects)
-		{
-			free(params);
-			return FALSE;
-		}
-
-		if (!params)
-		{
-			free(work_objects);
-			return FALSE;
-		}
-	}
+	ZeroMemory(message->tiles, numTiles * sizeof(RFX_TILE*));
 
 	/* tiles */
-	close_cnt = 0;
 	rc = TRUE;
 
 	for (i = 0; i < message->numTiles; i++)
@@ -941,44 +923,26 @@ static BOOL rfx_process_message_tileset(RFX_CONTEXT* context,
 		tile->x = tile->xIdx * 64;
 		tile->y = tile->yIdx * 64;
 
-		if (context->priv->UseThreads)
-		{
-			assert(params);
-			params[i].context = context;
-			params[i].tile = message->tiles[i];
-
-			if (!(work_objects[i] = CreateThreadpoolWork(
-			                        rfx_process_message_tile_work_callback,
-			                        (void*) &params[i], &context->priv->ThreadPoolEnv)))
-			{
-				WLog_ERR(TAG, "CreateThreadpoolWork failed.");
-				rc = FALSE;
-				break;
-			}
-
-			SubmitThreadpoolWork(work_objects[i]);
-			close_cnt = i + 1;
-		}
-		else
-		{
+		/* with threads all tiles are decoded in one go once the tileset is parsed */
+		if (!context->priv->UseThreads)
 			rfx_decode_rgb(context, tile, tile->data, 64 * 4);
-		}
 
 		Stream_SetPosition(s, pos);
 	}
 
-	if (context->priv->UseThreads)
+	if (rc && context->priv->UseThreads)
 	{
-		for (i = 0; i < close_cnt; i++)
+		param.context = context;
+		param.message = message;
+
+		if (!ThreadpoolParallelFor(context->priv->Parallel, message->numTiles,
+		                           rfx_process_message_tile_work_callback, &param))
 		{
-			WaitForThreadpoolWorkCallbacks(work_objects[i], FALSE);
-			CloseThreadpoolWork(work_objects[i]);
+			WLog_ERR(TAG, "ThreadpoolParallelFor failed.");
+			rc = FALSE;
 		}
 	}
 
-	free(work_objects);
-	free(params);
-
 	for (i = 0; i < message->numTiles; i++)
 	{
 		if (!(tile = message->tiles[i]))
@@ -1348,17 +1312,10 @@ static BOOL rfx_write_tile(RFX_CONTEXT* context, wStream* s, RFX_TILE* tile)
 	return TRUE;
 }
 
-struct _RFX_TILE_COMPOSE_WORK_PARAM
-{
-	RFX_TILE* tile;
-	RFX_CONTEXT* context;
-};
-
-static void CALLBACK rfx_compose_message_tile_work_callback(PTP_CALLBACK_INSTANCE
-        instance, void* context, PTP_WORK work)
+static VOID rfx_compose_message_tile_work_callback(PVOID context, ULONG index)
 {
-	RFX_TILE_COMPOSE_WORK_PARAM* param = (RFX_TILE_COMPOSE_WORK_PARAM*) context;
-	rfx_encode_rgb(param->context, param->tile);
+	RFX_TILE_WORK_PARAM* param = (RFX_TILE_WORK_PARAM*) context;
+	rfx_encode_rgb(param->context, param->message->tiles[index]);
 }
 
 
@@ -1386,27 +1343,6 @@ static BOOL computeRegion(const RFX_RECT* rects, int numRects, REGION16* region,
 
 #define TILE_NO(v) ((v) / 64)
 
-BOOL setupWorkers(RFX_CONTEXT* context, int nbTiles)
-{
-	RFX_CONTEXT_PRIV* priv = context->priv;
-	void* pmem;
-
-	if (!context->priv->UseThreads)
-		return TRUE;
-
-	if (!(pmem = realloc((void*) priv->workObjects, sizeof(PTP_WORK) * nbTiles)))
-		return FALSE;
-
-	priv->workObjects = (PTP_WORK*) pmem;
-
-	if (!(pmem = realloc((void*) priv->tileWorkParams,
-	                     sizeof(RFX_TILE_COMPOSE_WORK_PARAM) * nbTiles)))
-		return FALSE;
-
-	priv->tileWorkParams = (RFX_TILE_COMPOSE_WORK_PARAM*) pmem;
-	return TRUE;
-}
-
 RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* context, const RFX_RECT* rects,
                                 int numRects,
                                 BYTE* data, int w, int h, int s)
@@ -1420,8 +1356,7 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* context, const RFX_RECT* rects,
 	RFX_TILE* tile;
 	RFX_RECT* rfxRect;
 	RFX_MESSAGE* message = NULL;
-	PTP_WORK* workObject = NULL;
-	RFX_TILE_COMPOSE_WORK_PARAM* workParam = NULL;
+	RFX_TILE_WORK_PARAM param;
 	BOOL success = FALSE;
 	REGION16 rectsRegion, tilesRegion;
 	RECTANGLE_16 currentTileRect;
@@ -1476,15 +1411,6 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* context, const RFX_RECT* rects,
 	if (!(message->tiles = calloc(maxNbTiles, sizeof(RFX_TILE*))))
 		goto skip_encoding_loop;
 
-	if (!setupWorkers(context, maxNbTiles))
-		goto skip_encoding_loop;
-
-	if (context->priv->UseThreads)
-	{
-		workObject = context->priv->workObjects;
-		workParam = context->priv->tileWorkParams;
-	}
-
 	regionRect = region16_rects(&rectsRegion, &regionNbRects);
 
 	if (!(message->rects = calloc(regionNbRects, sizeof(RFX_RECT))))
@@ -1564,27 +1490,9 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* context, const RFX_RECT* rects,
 				message->tiles[message->numTiles] = tile;
 				message->numTiles++;
 
-				if (context->priv->UseThreads)
-				{
-					workParam->context = context;
-					workParam->tile = tile;
-
-					if (!(*workObject = CreateThreadpoolWork(
-					                        rfx_compose_message_tile_work_callback,
-					                        (void*) workParam,
-					                        &context->priv->ThreadPoolEnv)))
-					{
-						goto skip_encoding_loop;
-					}
-
-					SubmitThreadpoolWork(*workObject);
-					workObject++;
-					workParam++;
-				}
-				else
-				{
+				/* with threads all tiles are encoded in one go below */
+				if (!context->priv->UseThreads)
 					rfx_encode_rgb(context, tile);
-				}
 
 				if (!region16_union_rect(&tilesRegion, &tilesRegion, &currentTileRect))
 					goto skip_encoding_loop;
@@ -1611,29 +1519,22 @@ skip_encoding_loop:
 			success = FALSE;
 	}
 
-	/* when using threads ensure all computations are done */
+	if (success && context->priv->UseThreads)
+	{
+		param.context = context;
+		param.message = message;
+
+		if (!ThreadpoolParallelFor(context->priv->Parallel, message->numTiles,
+		                           rfx_compose_message_tile_work_callback, &param))
+			success = FALSE;
+	}
+
 	if (success)
 	{
 		message->tilesDataSize = 0;
-		workObject = context->priv->workObjects;
 
 		for (i = 0; i < message->numTiles; i++)
-		{
-			tile = message->tiles[i];
-
-			if (context->priv->UseThreads)
-			{
-				if (*workObject)
-				{
-					WaitForThreadpoolWorkCallbacks(*workObject, FALSE);
-					CloseThreadpoolWork(*workObject);
-				}
-
-				workObject++;
-			}
-
-			message->tilesDataSize += rfx_tile_length(tile);
-		}
+			message->tilesDataSize += rfx_tile_length(message->tiles[i]);
 
 		region16_uninit(&tilesRegion);
 		region16_uninit(&rectsRegion);
@@ -41,10 +41,10 @@
 
 #define MINMAX(_v,_l,_h) ((_v) < (_l) ? (_l) : ((_v) > (_h) ? (_h) : (_v)))
 
-static void rfx_encode_format_rgb(const BYTE* rgb_data, int width, int height,
-                                  int rowstride,
-                                  UINT32 pixel_format, const BYTE* palette, INT16* r_buf, INT16* g_buf,
-                                  INT16* b_buf)
+void rfx_encode_format_rgb(const BYTE* rgb_data, int width, int height,
+                           int rowstride,
+                           UINT32 pixel_format, const BYTE* palette, INT16* r_buf, INT16* g_buf,
+                           INT16* b_buf)
 {
 	int x, y;
 	int x_exceed;
@@ -286,13 +286,6 @@ void rfx_encode_rgb(RFX_CONTEXT* context, RFX_TILE* tile)
 	prims->RGBToYCbCr_16s16s_P3P3((const INT16**) pSrcDst, 64 * sizeof(INT16),
 	                              pSrcDst, 64 * sizeof(INT16), &roi_64x64);
 	PROFILER_EXIT(context->priv->prof_rfx_rgb_to_ycbcr)
-	/**
-	 * We need to clear the buffers as the RLGR encoder expects it to be initialized to zero.
-	 * This allows simplifying and improving the performance of the encoding process.
-	 */
-	ZeroMemory(tile->YData, 4096);
-	ZeroMemory(tile->CbData, 4096);
-	ZeroMemory(tile->CrData, 4096);
 	rfx_encode_component(context, YQuant, pSrcDst[0], tile->YData, 4096, &YLen);
 	rfx_encode_component(context, CbQuant, pSrcDst[1], tile->CbData, 4096, &CbLen);
 	rfx_encode_component(context, CrQuant, pSrcDst[2], tile->CrData, 4096, &CrLen);
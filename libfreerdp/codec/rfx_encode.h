@@ -24,6 +24,9 @@
 #include <freerdp/api.h>
 
 FREERDP_LOCAL void rfx_encode_rgb(RFX_CONTEXT* context, RFX_TILE* tile);
+FREERDP_LOCAL void rfx_encode_format_rgb(const BYTE* rgb_data, int width, int height,
+        int rowstride, UINT32 pixel_format, const BYTE* palette,
+        INT16* r_buf, INT16* g_buf, INT16* b_buf);
 
 #endif /* FREERDP_LIB_CODEC_RFX_ENCODE_H */
 
@@ -33,11 +33,8 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
 #include <winpr/sysinfo.h>
-#include <winpr/bitstream.h>
 #include <winpr/intrin.h>
 
-#include "rfx_bitstream.h"
-
 #include "rfx_rlgr.h"
 
 /* Constants used in RLGR1/RLGR3 algorithm */
@@ -74,13 +71,50 @@
 	_k = (_param >> LSGR); \
 }
 
+/*
+ * Zero runs in RL mode add (1 << k) for every leading zero while kp grows
+ * by UP_GR per zero. kp saturates at KPMAX after RFX_RLGR_RUN_STEPS zeros,
+ * so the run length of the first steps is looked up and the rest of the
+ * run adds (1 << (KPMAX >> LSGR)) per zero.
+ */
+#define RFX_RLGR_RUN_STEPS ((KPMAX + UP_GR - 1) / UP_GR)
+
+static UINT32 g_RunLength[KPMAX + 1][RFX_RLGR_RUN_STEPS + 1];
+static BYTE g_RunParam[KPMAX + 1][RFX_RLGR_RUN_STEPS + 1];
+
+static const INT8 g_GRParamDelta[] =
+{
+	-2, 0, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31
+};
+
 static BOOL g_LZCNT = FALSE;
 
 static INIT_ONCE rfx_rlgr_init_once = INIT_ONCE_STATIC_INIT;
 
 static BOOL CALLBACK rfx_rlgr_init(PINIT_ONCE once, PVOID param, PVOID *context)
 {
+	INT32 kp;
+	UINT32 steps;
 	g_LZCNT = IsProcessorFeaturePresentEx(PF_EX_LZCNT);
+
+	for (kp = 0; kp <= KPMAX; kp++)
+	{
+		INT32 p = kp;
+		UINT32 run = 0;
+
+		for (steps = 0; steps <= RFX_RLGR_RUN_STEPS; steps++)
+		{
+			g_RunLength[kp][steps] = run;
+			g_RunParam[kp][steps] = (BYTE) p;
+			run += (1 << (p >> LSGR));
+			p += UP_GR;
+
+			if (p > KPMAX)
+				p = KPMAX;
+		}
+	}
+
 	return TRUE;
 }
 
@@ -104,191 +138,227 @@ static INLINE UINT32 lzcnt_s(UINT32 x)
 	return __lzcnt(x);
 }
 
-int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16* pDstData, UINT32 DstSize)
+/* x must not be 0 */
+static INLINE UINT32 lzcnt64_s(UINT64 x)
 {
-	int vk;
-	int run;
-	int cnt;
-	int size;
-	int nbits;
-	size_t offset;
-	INT16 mag;
-	UINT32 k;
-	INT32 kp;
-	UINT32 kr;
-	INT32 krp;
-	UINT16 code;
-	UINT32 sign;
-	UINT32 nIdx;
-	UINT32 val1;
-	UINT32 val2;
-	INT16* pOutput;
-	wBitStream* bs;
-	wBitStream s_bs;
+#if defined(__GNUC__)
+	return (UINT32) __builtin_clzll(x);
+#else
+	const UINT32 hi = (UINT32)(x >> 32);
 
-	InitOnceExecuteOnce(&rfx_rlgr_init_once, rfx_rlgr_init, NULL, NULL);
-
-	k = 1;
-	kp = k << LSGR;
-
-	kr = 1;
-	krp = kr << LSGR;
+	if (hi)
+		return lzcnt_s(hi);
 
-	if ((mode != RLGR1) && (mode != RLGR3))
-		mode = RLGR1;
-
-	if (!pSrcData || !SrcSize)
-		return -1;
-
-	if (!pDstData || !DstSize)
-		return -1;
-
-	pOutput = pDstData;
+	return 32 + lzcnt_s((UINT32) x);
+#endif
+}
 
-	bs = &s_bs;
+/*
+ * MSB first bit reader with a 64 bit buffer. The valid bits are left
+ * aligned in acc, all bits below them are zero. A refill leaves at least
+ * 56 valid bits unless the end of the input was reached.
+ */
+typedef struct
+{
+	UINT64 acc;
+	UINT32 avail;
+	const BYTE* src;
+	const BYTE* end;
+} RFX_RLGR_READER;
 
-	BitStream_Attach(bs, pSrcData, SrcSize);
-	BitStream_Fetch(bs);
+static INLINE void rfx_rlgr_refill(RFX_RLGR_READER* r)
+{
+	if (r->avail >= 56)
+		return;
 
-	while ((BitStream_GetRemainingLength(bs) > 0) && ((pOutput - pDstData) < DstSize))
+	if (r->end - r->src >= 8)
 	{
-		if (k)
-		{
-			/* Run-Length (RL) Mode */
+		const BYTE* p = r->src;
+		const UINT64 v = ((UINT64) p[0] << 56) | ((UINT64) p[1] << 48) | ((UINT64) p[2] << 40) |
+		                 ((UINT64) p[3] << 32) | ((UINT64) p[4] << 24) | ((UINT64) p[5] << 16) |
+		                 ((UINT64) p[6] << 8) | ((UINT64) p[7]);
+		r->acc |= v >> r->avail;
+		r->src += (63 - r->avail) >> 3;
+		r->avail |= 56;
+		/* drop the partially loaded byte, it is loaded again next time */
+		r->acc &= ~(~((UINT64) 0) >> r->avail);
+		return;
+	}
 
-			run = 0;
+	while ((r->avail <= 56) && (r->src < r->end))
+	{
+		r->acc |= ((UINT64) * r->src++) << (56 - r->avail);
+		r->avail += 8;
+	}
+}
 
-			/* count number of leading 0s */
+/* Reads up to 32 bits, the caller ensures they are available */
+static INLINE UINT32 rfx_rlgr_read(RFX_RLGR_READER* r, UINT32 nbits)
+{
+	UINT32 v;
 
-			cnt = lzcnt_s(bs->accumulator);
+	if (!nbits)
+		return 0;
 
-			nbits = BitStream_GetRemainingLength(bs);
+	v = (UINT32)(r->acc >> (64 - nbits));
+	r->acc <<= nbits;
+	r->avail -= nbits;
+	return v;
+}
 
-			if (cnt > nbits)
-				cnt = nbits;
+/*
+ * Counts and consumes a unary prefix of zeros (ones == FALSE) or ones
+ * (ones == TRUE) and its terminating bit. Returns FALSE if the input ends
+ * before the terminator.
+ */
+static INLINE BOOL rfx_rlgr_read_unary(RFX_RLGR_READER* r, BOOL ones, UINT32* count)
+{
+	UINT32 vk = 0;
 
-			vk = cnt;
+	for (;;)
+	{
+		UINT64 bits;
+		UINT32 cnt;
+		rfx_rlgr_refill(r);
 
-			while ((cnt == 32) && (BitStream_GetRemainingLength(bs) > 0))
-			{
-				BitStream_Shift32(bs);
+		if (!r->avail)
+			return FALSE;
 
-				cnt = lzcnt_s(bs->accumulator);
+		/* bits past the valid ones count as non terminating */
+		bits = ones ? ~r->acc : r->acc;
 
-				nbits = BitStream_GetRemainingLength(bs);
+		if (ones && (r->avail < 64))
+			bits &= ~(~((UINT64) 0) >> r->avail);
 
-				if (cnt > nbits)
-					cnt = nbits;
+		if (!bits)
+		{
+			vk += r->avail;
+			r->acc = 0;
+			r->avail = 0;
+			continue;
+		}
 
-				vk += cnt;
-			}
+		cnt = lzcnt64_s(bits);
+		vk += cnt;
+		/* cnt < avail <= 64, the shift by cnt + 1 is split to stay defined */
+		r->acc = (r->acc << cnt) << 1;
+		r->avail -= cnt + 1;
+		*count = vk;
+		return TRUE;
+	}
+}
 
-			BitStream_Shift(bs, (vk % 32));
+/* Converts (2 * magnitude - sign) back to the signed value */
+static INLINE INT16 rfx_rlgr_mag_sign(UINT32 code)
+{
+	return (INT16)((code >> 1) ^ (UINT32)(-(INT32)(code & 1)));
+}
 
-			if (BitStream_GetRemainingLength(bs) < 1)
-				break;
+/* Reads the GR code remainder and updates kr, krp */
+static INLINE BOOL rfx_rlgr_read_gr(RFX_RLGR_READER* r, UINT32* kr, INT32* krp, UINT32* code)
+{
+	UINT32 vk;
 
-			BitStream_Shift(bs, 1);
+	if (!rfx_rlgr_read_unary(r, TRUE, &vk))
+		return FALSE;
 
-			while (vk--)
-			{
-				run += (1 << k); /* add (1 << k) to run length */
+	rfx_rlgr_refill(r);
 
-				/* update k, kp params */
+	if (r->avail < *kr)
+		return FALSE;
 
-				kp += UP_GR;
+	/* the code is transmitted as 16 bit value */
+	*code = (UINT16)(rfx_rlgr_read(r, *kr) | (vk << *kr));
 
-				if (kp > KPMAX)
-					kp = KPMAX;
+	/* krp decreases by 2 for vk == 0, stays for vk == 1 and grows by vk otherwise */
+	if (vk < ARRAYSIZE(g_GRParamDelta))
+		*krp += g_GRParamDelta[vk];
+	else
+		*krp += (vk > KPMAX) ? KPMAX : (INT32) vk;
 
-				k = kp >> LSGR;
-			}
+	*krp = (*krp < 0) ? 0 : ((*krp > KPMAX) ? KPMAX : *krp);
+	*kr = *krp >> LSGR;
+	return TRUE;
+}
 
-			/* next k bits contain run length remainder */
+int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16* pDstData, UINT32 DstSize)
+{
+	UINT32 k;
+	INT32 kp;
+	UINT32 kr;
+	INT32 krp;
+	UINT32 code;
+	INT16* pOutput;
+	const INT16* pEnd;
+	RFX_RLGR_READER reader;
 
-			if (BitStream_GetRemainingLength(bs) < k)
-				break;
+	InitOnceExecuteOnce(&rfx_rlgr_init_once, rfx_rlgr_init, NULL, NULL);
 
-			bs->mask = ((1 << k) - 1);
-			run += ((bs->accumulator >> (32 - k)) & bs->mask);
-			BitStream_Shift(bs, k);
+	k = 1;
+	kp = k << LSGR;
 
-			/* read sign bit */
+	kr = 1;
+	krp = kr << LSGR;
 
-			if (BitStream_GetRemainingLength(bs) < 1)
-				break;
+	if ((mode != RLGR1) && (mode != RLGR3))
+		mode = RLGR1;
 
-			sign = (bs->accumulator & 0x80000000) ? 1 : 0;
-			BitStream_Shift(bs, 1);
+	if (!pSrcData || !SrcSize)
+		return -1;
 
-			/* count number of leading 1s */
+	if (!pDstData || !DstSize)
+		return -1;
 
-			cnt = lzcnt_s(~(bs->accumulator));
+	/* zero runs are skipped instead of written */
+	ZeroMemory(pDstData, DstSize * sizeof(INT16));
+	pOutput = pDstData;
+	pEnd = &pDstData[DstSize];
+	reader.acc = 0;
+	reader.avail = 0;
+	reader.src = pSrcData;
+	reader.end = &pSrcData[SrcSize];
 
-			nbits = BitStream_GetRemainingLength(bs);
+	while (pOutput < pEnd)
+	{
+		rfx_rlgr_refill(&reader);
 
-			if (cnt > nbits)
-				cnt = nbits;
+		if (!reader.avail)
+			break;
 
-			vk = cnt;
+		if (k)
+		{
+			/* Run-Length (RL) Mode */
+			UINT32 vk;
+			UINT32 steps;
+			UINT32 sign;
+			UINT64 run;
 
-			while ((cnt == 32) && (BitStream_GetRemainingLength(bs) > 0))
-			{
-				BitStream_Shift32(bs);
+			/* count number of leading 0s */
 
-				cnt = lzcnt_s(~(bs->accumulator));
+			if (!rfx_rlgr_read_unary(&reader, FALSE, &vk))
+				break;
 
-				nbits = BitStream_GetRemainingLength(bs);
+			/* add (1 << k) to run length and update k, kp params for every 0 */
 
-				if (cnt > nbits)
-					cnt = nbits;
+			steps = (vk < RFX_RLGR_RUN_STEPS) ? vk : RFX_RLGR_RUN_STEPS;
+			run = g_RunLength[kp][steps] + ((UINT64)(vk - steps) << (KPMAX >> LSGR));
+			kp = g_RunParam[kp][steps];
+			k = kp >> LSGR;
 
-				vk += cnt;
-			}
+			/* next k bits contain run length remainder, followed by the sign bit */
 
-			BitStream_Shift(bs, (vk % 32));
+			rfx_rlgr_refill(&reader);
 
-			if (BitStream_GetRemainingLength(bs) < 1)
+			if (reader.avail < k + 1)
 				break;
 
-			BitStream_Shift(bs, 1);
+			sign = rfx_rlgr_read(&reader, k + 1);
+			run += sign >> 1;
+			sign &= 1;
 
-			/* next kr bits contain code remainder */
-
-			if (BitStream_GetRemainingLength(bs) < kr)
+			if (!rfx_rlgr_read_gr(&reader, &kr, &krp, &code))
 				break;
 
-			bs->mask = ((1 << kr) - 1);
-			code = (UINT16) ((bs->accumulator >> (32 - kr)) & bs->mask);
-			BitStream_Shift(bs, kr);
-
-			/* add (vk << kr) to code */
-
-			code |= (vk << kr);
-
-			if (!vk)
-			{
-				/* update kr, krp params */
-
-				krp -= 2;
-
-				if (krp < 0)
-					krp = 0;
-
-				kr = krp >> LSGR;
-			}
-			else if (vk != 1)
-			{
-				/* update kr, krp params */
-
-				krp += vk;
-
-				if (krp > KPMAX)
-					krp = KPMAX;
-
-				kr = krp >> LSGR;
-			}
-
 			/* update k, kp params */
 
 			kp -= DN_GR;
@@ -298,165 +368,59 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16*
 
 			k = kp >> LSGR;
 
-			/* compute magnitude from code */
+			/* skip the run of zeros and write the magnitude to the output stream */
 
-			if (sign)
-				mag = ((INT16) (code + 1)) * -1;
-			else
-				mag = (INT16) (code + 1);
-
-			/* write to output stream */
-
-			offset = (pOutput - pDstData);
-			size = run;
+			if (run >= (UINT64)(pEnd - pOutput))
+				break;
 
-			if ((offset + size) > DstSize)
-				size = DstSize - offset;
+			pOutput += run;
 
-			if (size)
-			{
-				ZeroMemory(pOutput, size * sizeof(INT16));
-				pOutput += size;
-			}
-
-			if ((pOutput - pDstData) < DstSize)
-			{
-				*pOutput = mag;
-				pOutput++;
-			}
+			*pOutput++ = (INT16)(sign ? -(INT32)(code + 1) : (INT32)(code + 1));
 		}
 		else
 		{
 			/* Golomb-Rice (GR) Mode */
 
-			/* count number of leading 1s */
-
-			cnt = lzcnt_s(~(bs->accumulator));
-
-			nbits = BitStream_GetRemainingLength(bs);
-
-			if (cnt > nbits)
-				cnt = nbits;
-
-			vk = cnt;
-
-			while ((cnt == 32) && (BitStream_GetRemainingLength(bs) > 0))
-			{
-				BitStream_Shift32(bs);
-
-				cnt = lzcnt_s(~(bs->accumulator));
-
-				nbits = BitStream_GetRemainingLength(bs);
-
-				if (cnt > nbits)
-					cnt = nbits;
-
-				vk += cnt;
-			}
-
-			BitStream_Shift(bs, (vk % 32));
-
-			if (BitStream_GetRemainingLength(bs) < 1)
+			if (!rfx_rlgr_read_gr(&reader, &kr, &krp, &code))
 				break;
 
-			BitStream_Shift(bs, 1);
-
-			/* next kr bits contain code remainder */
-
-			if (BitStream_GetRemainingLength(bs) < kr)
-				break;
-
-			bs->mask = ((1 << kr) - 1);
-			code = (UINT16) ((bs->accumulator >> (32 - kr)) & bs->mask);
-			BitStream_Shift(bs, kr);
-
-			/* add (vk << kr) to code */
-
-			code |= (vk << kr);
-
-			if (!vk)
-			{
-				/* update kr, krp params */
-
-				krp -= 2;
-
-				if (krp < 0)
-					krp = 0;
-
-				kr = krp >> LSGR;
-			}
-			else if (vk != 1)
-			{
-				/* update kr, krp params */
-
-				krp += vk;
-
-				if (krp > KPMAX)
-					krp = KPMAX;
-
-				kr = krp >> LSGR;
-			}
-
 			if (mode == RLGR1) /* RLGR1 */
 			{
+				/* update k, kp params */
+
 				if (!code)
 				{
-					/* update k, kp params */
-
 					kp += UQ_GR;
 
 					if (kp > KPMAX)
 						kp = KPMAX;
-
-					k = kp >> LSGR;
-
-					mag = 0;
 				}
 				else
 				{
-					/* update k, kp params */
-
 					kp -= DQ_GR;
 
 					if (kp < 0)
 						kp = 0;
+				}
 
-					k = kp >> LSGR;
-
-					/*
-					 * code = 2 * mag - sign
-					 * sign + code = 2 * mag
-					 */
+				k = kp >> LSGR;
 
-					if (code & 1)
-						mag = ((INT16) ((code + 1) >> 1)) * -1;
-					else
-						mag = (INT16) (code >> 1);
-				}
+				/* code = 2 * mag - sign */
 
-				if ((pOutput - pDstData) < DstSize)
-				{
-					*pOutput = mag;
-					pOutput++;
-				}
+				*pOutput++ = rfx_rlgr_mag_sign(code);
 			}
 			else if (mode == RLGR3) /* RLGR3 */
 			{
-				nIdx = 0;
+				UINT32 val1;
+				UINT32 val2;
+				const UINT32 nIdx = 32 - lzcnt_s(code);
 
-				if (code)
-				{
-					mag = (UINT32) code;
-					nIdx = 32 - lzcnt_s(mag);
-				}
+				rfx_rlgr_refill(&reader);
 
-				if (BitStream_GetRemainingLength(bs) < nIdx)
+				if (reader.avail < nIdx)
 					break;
 
-				bs->mask = ((1 << nIdx) - 1);
-				val1 = ((bs->accumulator >> (32 - nIdx)) & bs->mask);
-				BitStream_Shift(bs, nIdx);
-
+				val1 = rfx_rlgr_read(&reader, nIdx);
 				val2 = code - val1;
 
 				if (val1 && val2)
@@ -482,45 +446,14 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16*
 					k = kp >> LSGR;
 				}
 
-				if (val1 & 1)
-					mag = ((INT16) ((val1 + 1) >> 1)) * -1;
-				else
-					mag = (INT16) (val1 >> 1);
-
-				if ((pOutput - pDstData) < DstSize)
-				{
-					*pOutput = mag;
-					pOutput++;
-				}
-
-				if (val2 & 1)
-					mag = ((INT16) ((val2 + 1) >> 1)) * -1;
-				else
-					mag = (INT16) (val2 >> 1);
+				*pOutput++ = rfx_rlgr_mag_sign(val1);
 
-				if ((pOutput - pDstData) < DstSize)
-				{
-					*pOutput = mag;
-					pOutput++;
-				}
+				if (pOutput < pEnd)
+					*pOutput++ = rfx_rlgr_mag_sign(val2);
 			}
 		}
 	}
 
-	offset = (pOutput - pDstData);
-
-	if (offset < DstSize)
-	{
-		size = DstSize - offset;
-		ZeroMemory(pOutput, size * 2);
-		pOutput += size;
-	}
-
-	offset = (pOutput - pDstData);
-
-	if (offset != DstSize)
-		return -1;
-
 	return 1;
 }
 
@@ -538,17 +471,85 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16*
 	} \
 }
 
+/*
+ * MSB first bit writer, collecting bits in a 64 bit buffer and storing
+ * them as 32 bit words. Output exceeding the buffer is dropped.
+ */
+typedef struct
+{
+	UINT64 acc;
+	UINT32 bits;
+	BYTE* dst;
+	BYTE* start;
+	BYTE* end;
+} RFX_RLGR_WRITER;
+
+static INLINE void rfx_rlgr_store(RFX_RLGR_WRITER* w, UINT32 word)
+{
+	if (w->end - w->dst >= 4)
+	{
+		w->dst[0] = (BYTE)(word >> 24);
+		w->dst[1] = (BYTE)(word >> 16);
+		w->dst[2] = (BYTE)(word >> 8);
+		w->dst[3] = (BYTE) word;
+		w->dst += 4;
+		return;
+	}
+
+	for (; w->dst < w->end; word <<= 8)
+		*w->dst++ = (BYTE)(word >> 24);
+}
+
+/* Emits the lower nbits (at most 32) of value */
+static INLINE void rfx_rlgr_put(RFX_RLGR_WRITER* w, UINT32 value, UINT32 nbits)
+{
+	if (!nbits)
+		return;
+
+	w->acc = (w->acc << nbits) | (value & (0xFFFFFFFF >> (32 - nbits)));
+	w->bits += nbits;
+
+	if (w->bits >= 32)
+	{
+		w->bits -= 32;
+		rfx_rlgr_store(w, (UINT32)(w->acc >> w->bits));
+	}
+}
+
+static INLINE void rfx_rlgr_put_repeat(RFX_RLGR_WRITER* w, UINT32 count, BOOL bit)
+{
+	const UINT32 pattern = bit ? 0xFFFFFFFF : 0;
+
+	for (; count > 32; count -= 32)
+		rfx_rlgr_put(w, pattern, 32);
+
+	rfx_rlgr_put(w, pattern, count);
+}
+
+/*
+ * Pads the last byte with zeros and returns the number of bytes written.
+ * The bit by bit encoder this replaced appended a zero byte if less than
+ * four bits of the last byte were free, keep the output identical.
+ */
+static int rfx_rlgr_flush(RFX_RLGR_WRITER* w)
+{
+	const UINT32 used = w->bits & 7;
+	rfx_rlgr_put(w, 0, ((8 - used) & 7) + ((used > 4) ? 8 : 0));
+
+	for (; w->bits > 0; w->bits -= 8)
+	{
+		if (w->dst < w->end)
+			*w->dst++ = (BYTE)(w->acc >> (w->bits - 8));
+	}
+
+	return (int)(w->dst - w->start);
+}
+
 /* Emit bitPattern to the output bitstream */
-#define OutputBits(numBits, bitPattern) rfx_bitstream_put_bits(bs, bitPattern, numBits)
+#define OutputBits(numBits, bitPattern) rfx_rlgr_put(bs, bitPattern, numBits)
 
 /* Emit a bit (0 or 1), count number of times, to the output bitstream */
-#define OutputBit(count, bit) \
-{	\
-	UINT16 _b = (bit ? 0xFFFF : 0); \
-	int _c = (count); \
-	for (; _c > 0; _c -= 16) \
-		rfx_bitstream_put_bits(bs, _b, (_c > 16 ? 16 : _c)); \
-}
+#define OutputBit(count, bit) rfx_rlgr_put_repeat(bs, count, bit)
 
 /* Converts the input value to (2 * abs(input) - sign(input)), where sign(input) = (input < 0 ? 1 : 0) and returns it */
 #define Get2MagSign(input) ((input) >= 0 ? 2 * (input) : -2 * (input) - 1)
@@ -556,7 +557,7 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* pSrcData, UINT32 SrcSize, INT16*
 /* Outputs the Golomb/Rice encoding of a non-negative integer */
 #define CodeGR(krp, val) rfx_rlgr_code_gr(bs, krp, val)
 
-static void rfx_rlgr_code_gr(RFX_BITSTREAM* bs, int* krp, UINT32 val)
+static INLINE void rfx_rlgr_code_gr(RFX_RLGR_WRITER* bs, int* krp, UINT32 val)
 {
 	int kr = *krp >> LSGR;
 
@@ -588,13 +589,18 @@ int rfx_rlgr_encode(RLGR_MODE mode, const INT16* data, UINT32 data_size, BYTE* b
 	int k;
 	int kp;
 	int krp;
-	RFX_BITSTREAM* bs;
-	int processed_size;
+	RFX_RLGR_WRITER writer;
+	RFX_RLGR_WRITER* bs = &writer;
 
-	if (!(bs = (RFX_BITSTREAM*) calloc(1, sizeof(RFX_BITSTREAM))))
+	if (!buffer)
 		return 0;
 
-	rfx_bitstream_attach(bs, buffer, buffer_size);
+	/* the output buffer does not need to be zeroed, whole bytes are written */
+	writer.acc = 0;
+	writer.bits = 0;
+	writer.dst = buffer;
+	writer.start = buffer;
+	writer.end = &buffer[buffer_size];
 
 	/* initialize the parameters */
 	k = 1;
@@ -701,7 +707,7 @@ int rfx_rlgr_encode(RLGR_MODE mode, const INT16* data, UINT32 data_size, BYTE* b
 
 				/* encode binary representation of the first input (twoMs1). */
 				GetMinBits(sum2Ms, nIdx);
-				OutputBits(nIdx, twoMs1);
+				OutputBits(nIdx, twoMs1 & 0xFFFF);
 
 				/* update k,kp for the two input values */
 
@@ -717,9 +723,5 @@ int rfx_rlgr_encode(RLGR_MODE mode, const INT16* data, UINT32 data_size, BYTE* b
 		}
 	}
 
-	rfx_bitstream_flush(bs);
-	processed_size = rfx_bitstream_get_processed_bytes(bs);
-	free(bs);
-
-	return processed_size;
+	return rfx_rlgr_flush(bs);
 }
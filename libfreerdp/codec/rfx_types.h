@@ -39,16 +39,13 @@
 #define DEBUG_RFX(...) do { } while (0)
 #endif
 
-typedef struct _RFX_TILE_COMPOSE_WORK_PARAM RFX_TILE_COMPOSE_WORK_PARAM;
-
 struct _RFX_CONTEXT_PRIV
 {
 	wLog* log;
 	wObjectPool* TilePool;
 
 	BOOL UseThreads;
-	PTP_WORK* workObjects;
-	RFX_TILE_COMPOSE_WORK_PARAM* tileWorkParams;
+	PTP_PARALLEL Parallel;
 
 	DWORD MinThreadCount;
 	DWORD MaxThreadCount;
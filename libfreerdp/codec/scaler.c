@@ -0,0 +1,587 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Image Scaling
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#include <freerdp/log.h>
+#include <freerdp/codec/color.h>
+
+#if defined(CAIRO_FOUND)
+#include <cairo.h>
+#endif
+
+#if defined(SWSCALE_FOUND)
+#include <libswscale/swscale.h>
+#endif
+
+#include "scaler.h"
+
+#define TAG FREERDP_TAG("codec.scaler")
+
+/* scalers kept around for freerdp_image_scale */
+#define SCALER_POOL_SIZE 4
+
+#define SCALER_NO_ROW 0xFFFFFFFF
+
+struct _FREERDP_IMAGE_SCALER
+{
+	UINT32 srcWidth;
+	UINT32 srcHeight;
+	UINT32 dstWidth;
+	UINT32 dstHeight;
+	DWORD srcFormat;
+	DWORD dstFormat;
+
+#if defined(SWSCALE_FOUND)
+	struct SwsContext* sws;
+#elif defined(CAIRO_FOUND)
+	const BYTE* cairoSrcData;
+	BYTE* cairoDstData;
+	UINT32 cairoSrcStep;
+	UINT32 cairoDstStep;
+	cairo_surface_t* cairoSrc;
+	cairo_surface_t* cairoDst;
+	cairo_t* cairo;
+#endif
+
+	/* built-in bilinear scaler */
+	BOOL tablesValid;
+	UINT32* xIndex0;
+	UINT32* xIndex1;
+	UINT16* xWeight;
+	UINT32* yIndex0;
+	UINT32* yIndex1;
+	UINT16* yWeight;
+	UINT16* rows[2];
+	UINT32 rowIndex[2];
+	BYTE* line;
+};
+
+static FREERDP_SCALER_KERNELS scaler_kernels;
+static INIT_ONCE scaler_init_once = INIT_ONCE_STATIC_INIT;
+
+static CRITICAL_SECTION scaler_pool_lock;
+static FREERDP_IMAGE_SCALER* scaler_pool[SCALER_POOL_SIZE];
+
+static void scaler_row_h_c(UINT16* pDst, const BYTE* pSrc, const UINT32* pIndex0,
+                           const UINT32* pIndex1, const UINT16* pWeight, UINT32 width)
+{
+	UINT32 x, c;
+
+	for (x = 0; x < width; x++)
+	{
+		const BYTE* p0 = &pSrc[pIndex0[x] * 4];
+		const BYTE* p1 = &pSrc[pIndex1[x] * 4];
+		const UINT16 w1 = pWeight[x];
+		const UINT16 w0 = FREERDP_SCALER_WEIGHT_ONE - w1;
+
+		for (c = 0; c < 4; c++)
+			*pDst++ = (UINT16)(p0[c] * w0 + p1[c] * w1);
+	}
+}
+
+static void scaler_row_v_c(BYTE* pDst, const UINT16* pRow0, const UINT16* pRow1,
+                           UINT16 weight, UINT32 count)
+{
+	UINT32 i;
+	const UINT32 w1 = weight;
+	const UINT32 w0 = FREERDP_SCALER_WEIGHT_ONE - weight;
+
+	/* rounded the same way as the SIMD versions, which blend with mulhi */
+	for (i = 0; i < count; i++)
+	{
+		const UINT32 v = ((pRow0[i] * w0) >> FREERDP_SCALER_WEIGHT_BITS) +
+		                 ((pRow1[i] * w1) >> FREERDP_SCALER_WEIGHT_BITS) +
+		                 (FREERDP_SCALER_WEIGHT_ONE / 2);
+		pDst[i] = (BYTE)(v >> FREERDP_SCALER_WEIGHT_BITS);
+	}
+}
+
+static BOOL CALLBACK scaler_init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	WINPR_UNUSED(once);
+	WINPR_UNUSED(param);
+	WINPR_UNUSED(context);
+	scaler_kernels.RowH = scaler_row_h_c;
+	scaler_kernels.RowV = scaler_row_v_c;
+#if defined(WITH_SSE2)
+	freerdp_image_scaler_init_sse2(&scaler_kernels);
+#endif
+	return InitializeCriticalSectionAndSpinCount(&scaler_pool_lock, 4000);
+}
+
+/**
+ * Maps destination pixels to the two nearest source pixels, sampling at the
+ * pixel centers so that both edges of the image are covered the same way.
+ */
+static void scaler_build_table(UINT32* pIndex0, UINT32* pIndex1, UINT16* pWeight,
+                               UINT32 nDst, UINT32 nSrc)
+{
+	UINT32 i;
+
+	for (i = 0; i < nDst; i++)
+	{
+		INT64 pos = (((INT64)(2 * i + 1) * nSrc) << FREERDP_SCALER_WEIGHT_BITS) /
+		            (2 * (INT64)nDst) - (FREERDP_SCALER_WEIGHT_ONE / 2);
+		UINT32 index;
+		UINT16 weight;
+
+		if (pos < 0)
+			pos = 0;
+
+		index = (UINT32)(pos >> FREERDP_SCALER_WEIGHT_BITS);
+		weight = (UINT16)(pos & (FREERDP_SCALER_WEIGHT_ONE - 1));
+
+		if (index >= nSrc - 1)
+		{
+			index = nSrc - 1;
+			weight = 0;
+		}
+
+		pIndex0[i] = index;
+		pIndex1[i] = (index < nSrc - 1) ? index + 1 : index;
+		pWeight[i] = weight;
+	}
+}
+
+static void scaler_free_tables(FREERDP_IMAGE_SCALER* scaler)
+{
+	free(scaler->xIndex0);
+	free(scaler->xIndex1);
+	free(scaler->xWeight);
+	free(scaler->yIndex0);
+	free(scaler->yIndex1);
+	free(scaler->yWeight);
+	_aligned_free(scaler->rows[0]);
+	_aligned_free(scaler->rows[1]);
+	_aligned_free(scaler->line);
+	scaler->xIndex0 = scaler->xIndex1 = scaler->yIndex0 = scaler->yIndex1 = NULL;
+	scaler->xWeight = scaler->yWeight = NULL;
+	scaler->rows[0] = scaler->rows[1] = NULL;
+	scaler->line = NULL;
+	scaler->tablesValid = FALSE;
+}
+
+static BOOL scaler_update_tables(FREERDP_IMAGE_SCALER* scaler)
+{
+	const UINT32 dw = scaler->dstWidth;
+	const UINT32 dh = scaler->dstHeight;
+
+	if (scaler->tablesValid)
+		return TRUE;
+
+	scaler_free_tables(scaler);
+	scaler->xIndex0 = (UINT32*) calloc(dw, sizeof(UINT32));
+	scaler->xIndex1 = (UINT32*) calloc(dw, sizeof(UINT32));
+	scaler->xWeight = (UINT16*) calloc(dw, sizeof(UINT16));
+	scaler->yIndex0 = (UINT32*) calloc(dh, sizeof(UINT32));
+	scaler->yIndex1 = (UINT32*) calloc(dh, sizeof(UINT32));
+	scaler->yWeight = (UINT16*) calloc(dh, sizeof(UINT16));
+	scaler->rows[0] = (UINT16*) _aligned_malloc(dw * 4 * sizeof(UINT16), 16);
+	scaler->rows[1] = (UINT16*) _aligned_malloc(dw * 4 * sizeof(UINT16), 16);
+	scaler->line = (BYTE*) _aligned_malloc(dw * 4, 16);
+
+	if (!scaler->xIndex0 || !scaler->xIndex1 || !scaler->xWeight ||
+	    !scaler->yIndex0 || !scaler->yIndex1 || !scaler->yWeight ||
+	    !scaler->rows[0] || !scaler->rows[1] || !scaler->line)
+	{
+		scaler_free_tables(scaler);
+		return FALSE;
+	}
+
+	scaler_build_table(scaler->xIndex0, scaler->xIndex1, scaler->xWeight, dw, scaler->srcWidth);
+	scaler_build_table(scaler->yIndex0, scaler->yIndex1, scaler->yWeight, dh, scaler->srcHeight);
+	scaler->tablesValid = TRUE;
+	return TRUE;
+}
+
+/**
+ * Returns source row y scaled horizontally. The two rows of the last
+ * destination row are kept, so upscaling computes every source row once.
+ */
+static const UINT16* scaler_get_row(FREERDP_IMAGE_SCALER* scaler, const BYTE* pSrc,
+                                    UINT32 nSrcStep, UINT32 y, UINT32 keep)
+{
+	int slot;
+
+	for (slot = 0; slot < 2; slot++)
+	{
+		if (scaler->rowIndex[slot] == y)
+			return scaler->rows[slot];
+	}
+
+	slot = (scaler->rowIndex[0] == keep) ? 1 : 0;
+	scaler_kernels.RowH(scaler->rows[slot], &pSrc[y * nSrcStep], scaler->xIndex0,
+	                    scaler->xIndex1, scaler->xWeight, scaler->dstWidth);
+	scaler->rowIndex[slot] = y;
+	return scaler->rows[slot];
+}
+
+static BOOL scaler_scale_bilinear(FREERDP_IMAGE_SCALER* scaler, BYTE* pDst, UINT32 nDstStep,
+                                  const BYTE* pSrc, UINT32 nSrcStep)
+{
+	UINT32 y;
+	const BOOL convert = (scaler->srcFormat != scaler->dstFormat);
+
+	if ((GetBytesPerPixel(scaler->srcFormat) != 4) || (GetBytesPerPixel(scaler->dstFormat) != 4))
+	{
+		WLog_WARN(TAG, "scaling from %s to %s is not supported",
+		          FreeRDPGetColorFormatName(scaler->srcFormat),
+		          FreeRDPGetColorFormatName(scaler->dstFormat));
+		return FALSE;
+	}
+
+	if (!scaler_update_tables(scaler))
+		return FALSE;
+
+	/* the source changes between calls, so rows can't be reused */
+	scaler->rowIndex[0] = scaler->rowIndex[1] = SCALER_NO_ROW;
+
+	for (y = 0; y < scaler->dstHeight; y++)
+	{
+		const UINT32 y0 = scaler->yIndex0[y];
+		const UINT32 y1 = scaler->yIndex1[y];
+		const UINT16* row0 = scaler_get_row(scaler, pSrc, nSrcStep, y0, y1);
+		const UINT16* row1 = scaler_get_row(scaler, pSrc, nSrcStep, y1, y0);
+		BYTE* pDstLine = &pDst[y * nDstStep];
+
+		/* the filter works on channels, so the format only matters for the result */
+		scaler_kernels.RowV(convert ? scaler->line : pDstLine, row0, row1, scaler->yWeight[y],
+		                    scaler->dstWidth * 4);
+
+		if (convert && !freerdp_image_copy(pDstLine, scaler->dstFormat, nDstStep, 0, 0,
+		                                   scaler->dstWidth, 1, scaler->line, scaler->srcFormat,
+		                                   scaler->dstWidth * 4, 0, 0, NULL, FREERDP_FLIP_NONE))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+#if defined(SWSCALE_FOUND)
+static int av_format_for_buffer(UINT32 format)
+{
+	switch (format)
+	{
+		case PIXEL_FORMAT_ARGB32:
+			return AV_PIX_FMT_BGRA;
+
+		case PIXEL_FORMAT_XRGB32:
+			return AV_PIX_FMT_BGR0;
+
+		case PIXEL_FORMAT_BGRA32:
+			return AV_PIX_FMT_RGBA;
+
+		case PIXEL_FORMAT_BGRX32:
+			return AV_PIX_FMT_RGB0;
+
+		default:
+			return AV_PIX_FMT_NONE;
+	}
+}
+
+static BOOL scaler_scale_swscale(FREERDP_IMAGE_SCALER* scaler, BYTE* pDst, UINT32 nDstStep,
+                                 const BYTE* pSrc, UINT32 nSrcStep, BOOL* handled)
+{
+	int res;
+	const int srcFormat = av_format_for_buffer(scaler->srcFormat);
+	const int dstFormat = av_format_for_buffer(scaler->dstFormat);
+	const int srcStep[1] = { (int)nSrcStep };
+	const int dstStep[1] = { (int)nDstStep };
+
+	if ((srcFormat == AV_PIX_FMT_NONE) || (dstFormat == AV_PIX_FMT_NONE))
+		return FALSE;
+
+	*handled = TRUE;
+	/* returns the same context as long as the parameters don't change */
+	scaler->sws = sws_getCachedContext(scaler->sws,
+	                                   (int)scaler->srcWidth, (int)scaler->srcHeight, srcFormat,
+	                                   (int)scaler->dstWidth, (int)scaler->dstHeight, dstFormat,
+	                                   SWS_BILINEAR, NULL, NULL, NULL);
+
+	if (!scaler->sws)
+		return FALSE;
+
+	res = sws_scale(scaler->sws, &pSrc, srcStep, 0, (int)scaler->srcHeight, &pDst, dstStep);
+	return (res == ((int)scaler->dstHeight));
+}
+#elif defined(CAIRO_FOUND)
+static void scaler_free_cairo(FREERDP_IMAGE_SCALER* scaler)
+{
+	if (scaler->cairo)
+		cairo_destroy(scaler->cairo);
+
+	if (scaler->cairoSrc)
+		cairo_surface_destroy(scaler->cairoSrc);
+
+	if (scaler->cairoDst)
+		cairo_surface_destroy(scaler->cairoDst);
+
+	scaler->cairo = NULL;
+	scaler->cairoSrc = NULL;
+	scaler->cairoDst = NULL;
+}
+
+static BOOL scaler_scale_cairo(FREERDP_IMAGE_SCALER* scaler, BYTE* pDst, UINT32 nDstStep,
+                               const BYTE* pSrc, UINT32 nSrcStep, BOOL* handled)
+{
+	const double sx = (double)scaler->dstWidth / (double)scaler->srcWidth;
+	const double sy = (double)scaler->dstHeight / (double)scaler->srcHeight;
+
+	if ((scaler->srcWidth > INT_MAX) || (scaler->srcHeight > INT_MAX) || (nSrcStep > INT_MAX))
+		return FALSE;
+
+	if ((scaler->dstWidth > INT_MAX) || (scaler->dstHeight > INT_MAX) || (nDstStep > INT_MAX))
+		return FALSE;
+
+	*handled = TRUE;
+
+	/* the surfaces wrap the buffers, keep them while the caller keeps its buffers */
+	if (!scaler->cairo || (scaler->cairoSrcData != pSrc) || (scaler->cairoDstData != pDst) ||
+	    (scaler->cairoSrcStep != nSrcStep) || (scaler->cairoDstStep != nDstStep))
+	{
+		scaler_free_cairo(scaler);
+		scaler->cairoSrc = cairo_image_surface_create_for_data((void*)pSrc,
+		                   CAIRO_FORMAT_ARGB32, (int)scaler->srcWidth, (int)scaler->srcHeight,
+		                   (int)nSrcStep);
+		scaler->cairoDst = cairo_image_surface_create_for_data(pDst,
+		                   CAIRO_FORMAT_ARGB32, (int)scaler->dstWidth, (int)scaler->dstHeight,
+		                   (int)nDstStep);
+
+		if (!scaler->cairoSrc || !scaler->cairoDst)
+			goto fail;
+
+		if (!(scaler->cairo = cairo_create(scaler->cairoDst)))
+			goto fail;
+
+		cairo_scale(scaler->cairo, sx, sy);
+		cairo_set_operator(scaler->cairo, CAIRO_OPERATOR_SOURCE);
+		cairo_set_source_surface(scaler->cairo, scaler->cairoSrc, 0, 0);
+		scaler->cairoSrcData = pSrc;
+		scaler->cairoDstData = pDst;
+		scaler->cairoSrcStep = nSrcStep;
+		scaler->cairoDstStep = nDstStep;
+	}
+	else
+	{
+		cairo_surface_mark_dirty(scaler->cairoSrc);
+		cairo_surface_mark_dirty(scaler->cairoDst);
+	}
+
+	cairo_paint(scaler->cairo);
+	cairo_surface_flush(scaler->cairoDst);
+	return TRUE;
+fail:
+	scaler_free_cairo(scaler);
+	return FALSE;
+}
+#endif
+
+FREERDP_IMAGE_SCALER* freerdp_image_scaler_new(void)
+{
+	FREERDP_IMAGE_SCALER* scaler;
+
+	if (!InitOnceExecuteOnce(&scaler_init_once, scaler_init, NULL, NULL))
+		return NULL;
+
+	scaler = (FREERDP_IMAGE_SCALER*) calloc(1, sizeof(FREERDP_IMAGE_SCALER));
+
+	if (!scaler)
+		return NULL;
+
+	scaler->rowIndex[0] = scaler->rowIndex[1] = SCALER_NO_ROW;
+	return scaler;
+}
+
+void freerdp_image_scaler_free(FREERDP_IMAGE_SCALER* scaler)
+{
+	if (!scaler)
+		return;
+
+#if defined(SWSCALE_FOUND)
+	sws_freeContext(scaler->sws);
+#elif defined(CAIRO_FOUND)
+	scaler_free_cairo(scaler);
+#endif
+	scaler_free_tables(scaler);
+	free(scaler);
+}
+
+BOOL freerdp_image_scaler_scale(FREERDP_IMAGE_SCALER* scaler,
+                                BYTE* pDstData, DWORD DstFormat, UINT32 nDstStep,
+                                UINT32 nXDst, UINT32 nYDst, UINT32 nDstWidth, UINT32 nDstHeight,
+                                const BYTE* pSrcData, DWORD SrcFormat, UINT32 nSrcStep,
+                                UINT32 nXSrc, UINT32 nYSrc, UINT32 nSrcWidth, UINT32 nSrcHeight)
+{
+	BOOL handled = FALSE;
+	BOOL rc = FALSE;
+	const BYTE* src;
+	BYTE* dst;
+
+	if (!scaler || !pDstData || !pSrcData)
+		return FALSE;
+
+	/* direct copy is much faster than scaling, so check if we can simply copy... */
+	if ((nDstWidth == nSrcWidth) && (nDstHeight == nSrcHeight))
+	{
+		return freerdp_image_copy(pDstData, DstFormat, nDstStep, nXDst, nYDst, nDstWidth, nDstHeight,
+		                          pSrcData, SrcFormat, nSrcStep, nXSrc, nYSrc,
+		                          NULL, FREERDP_FLIP_NONE);
+	}
+
+	if ((nDstWidth == 0) || (nDstHeight == 0) || (nSrcWidth == 0) || (nSrcHeight == 0))
+		return TRUE;
+
+	if (nSrcStep == 0)
+		nSrcStep = nSrcWidth * GetBytesPerPixel(SrcFormat);
+
+	if (nDstStep == 0)
+		nDstStep = nDstWidth * GetBytesPerPixel(DstFormat);
+
+	src = &pSrcData[nXSrc * GetBytesPerPixel(SrcFormat) + nYSrc * nSrcStep];
+	dst = &pDstData[nXDst * GetBytesPerPixel(DstFormat) + nYDst * nDstStep];
+
+	if ((scaler->srcWidth != nSrcWidth) || (scaler->srcHeight != nSrcHeight) ||
+	    (scaler->dstWidth != nDstWidth) || (scaler->dstHeight != nDstHeight) ||
+	    (scaler->srcFormat != SrcFormat) || (scaler->dstFormat != DstFormat))
+	{
+		scaler->srcWidth = nSrcWidth;
+		scaler->srcHeight = nSrcHeight;
+		scaler->dstWidth = nDstWidth;
+		scaler->dstHeight = nDstHeight;
+		scaler->srcFormat = SrcFormat;
+		scaler->dstFormat = DstFormat;
+		scaler->tablesValid = FALSE;
+#if defined(CAIRO_FOUND) && !defined(SWSCALE_FOUND)
+		scaler_free_cairo(scaler);
+#endif
+	}
+
+#if defined(SWSCALE_FOUND)
+	rc = scaler_scale_swscale(scaler, dst, nDstStep, src, nSrcStep, &handled);
+#elif defined(CAIRO_FOUND)
+	rc = scaler_scale_cairo(scaler, dst, nDstStep, src, nSrcStep, &handled);
+#endif
+
+	/* formats the libraries can't handle go through the built-in scaler */
+	if (!handled)
+		rc = scaler_scale_bilinear(scaler, dst, nDstStep, src, nSrcStep);
+
+	return rc;
+}
+
+/**
+ * Takes a scaler out of the pool, preferring one that was last used with
+ * the same geometry. Returns a new scaler if the pool is empty.
+ */
+static FREERDP_IMAGE_SCALER* scaler_pool_take(DWORD DstFormat, UINT32 nDstWidth,
+        UINT32 nDstHeight, DWORD SrcFormat, UINT32 nSrcWidth, UINT32 nSrcHeight)
+{
+	size_t index;
+	size_t found = SCALER_POOL_SIZE;
+	FREERDP_IMAGE_SCALER* scaler = NULL;
+
+	if (!InitOnceExecuteOnce(&scaler_init_once, scaler_init, NULL, NULL))
+		return NULL;
+
+	EnterCriticalSection(&scaler_pool_lock);
+
+	for (index = 0; index < SCALER_POOL_SIZE; index++)
+	{
+		FREERDP_IMAGE_SCALER* cur = scaler_pool[index];
+
+		if (!cur)
+			continue;
+
+		if (found == SCALER_POOL_SIZE)
+			found = index;
+
+		if ((cur->srcWidth == nSrcWidth) && (cur->srcHeight == nSrcHeight) &&
+		    (cur->dstWidth == nDstWidth) && (cur->dstHeight == nDstHeight) &&
+		    (cur->srcFormat == SrcFormat) && (cur->dstFormat == DstFormat))
+		{
+			found = index;
+			break;
+		}
+	}
+
+	if (found < SCALER_POOL_SIZE)
+	{
+		scaler = scaler_pool[found];
+		scaler_pool[found] = NULL;
+	}
+
+	LeaveCriticalSection(&scaler_pool_lock);
+
+	if (!scaler)
+		scaler = freerdp_image_scaler_new();
+
+	return scaler;
+}
+
+static void scaler_pool_return(FREERDP_IMAGE_SCALER* scaler)
+{
+	size_t index;
+
+	EnterCriticalSection(&scaler_pool_lock);
+
+	for (index = 0; index < SCALER_POOL_SIZE; index++)
+	{
+		if (!scaler_pool[index])
+		{
+			scaler_pool[index] = scaler;
+			scaler = NULL;
+			break;
+		}
+	}
+
+	LeaveCriticalSection(&scaler_pool_lock);
+	freerdp_image_scaler_free(scaler);
+}
+
+BOOL freerdp_image_scale(BYTE* pDstData, DWORD DstFormat, UINT32 nDstStep,
+                         UINT32 nXDst, UINT32 nYDst, UINT32 nDstWidth, UINT32 nDstHeight,
+                         const BYTE* pSrcData, DWORD SrcFormat, UINT32 nSrcStep,
+                         UINT32 nXSrc, UINT32 nYSrc, UINT32 nSrcWidth, UINT32 nSrcHeight)
+{
+	BOOL rc;
+	FREERDP_IMAGE_SCALER* scaler;
+
+	/* direct copy is much faster than scaling, so check if we can simply copy... */
+	if ((nDstWidth == nSrcWidth) && (nDstHeight == nSrcHeight))
+	{
+		return freerdp_image_copy(pDstData, DstFormat, nDstStep, nXDst, nYDst, nDstWidth, nDstHeight,
+		                          pSrcData, SrcFormat, nSrcStep, nXSrc, nYSrc,
+		                          NULL, FREERDP_FLIP_NONE);
+	}
+
+	scaler = scaler_pool_take(DstFormat, nDstWidth, nDstHeight, SrcFormat, nSrcWidth, nSrcHeight);
+
+	if (!scaler)
+		return FALSE;
+
+	rc = freerdp_image_scaler_scale(scaler, pDstData, DstFormat, nDstStep, nXDst, nYDst,
+	                                nDstWidth, nDstHeight, pSrcData, SrcFormat, nSrcStep,
+	                                nXSrc, nYSrc, nSrcWidth, nSrcHeight);
+	scaler_pool_return(scaler);
+	return rc;
+}
@@ -0,0 +1,56 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Image Scaling
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CODEC_SCALER_H
+#define FREERDP_LIB_CODEC_SCALER_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+
+/**
+ * The built-in bilinear scaler works on 32bpp pixels with 7 bit weights.
+ *
+ * The horizontal pass turns a source row into one UINT16 per channel,
+ * p0 * (128 - w) + p1 * w. The vertical pass blends two of those rows into
+ * a destination row. All implementations must give identical results.
+ */
+#define FREERDP_SCALER_WEIGHT_BITS 7
+#define FREERDP_SCALER_WEIGHT_ONE (1 << FREERDP_SCALER_WEIGHT_BITS)
+
+typedef void (*pfnScalerRowH)(UINT16* pDst, const BYTE* pSrc, const UINT32* pIndex0,
+                              const UINT32* pIndex1, const UINT16* pWeight, UINT32 width);
+typedef void (*pfnScalerRowV)(BYTE* pDst, const UINT16* pRow0, const UINT16* pRow1,
+                              UINT16 weight, UINT32 count);
+
+struct _FREERDP_SCALER_KERNELS
+{
+	pfnScalerRowH RowH;
+	pfnScalerRowV RowV;
+};
+typedef struct _FREERDP_SCALER_KERNELS FREERDP_SCALER_KERNELS;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FREERDP_LOCAL void freerdp_image_scaler_init_sse2(FREERDP_SCALER_KERNELS* kernels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_LIB_CODEC_SCALER_H */
@@ -0,0 +1,109 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Image Scaling - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+
+#include "scaler.h"
+
+#if defined(WITH_SSE2)
+
+#include <emmintrin.h>
+
+static void scaler_row_h_sse2(UINT16* pDst, const BYTE* pSrc, const UINT32* pIndex0,
+                              const UINT32* pIndex1, const UINT16* pWeight, UINT32 width)
+{
+	UINT32 x = 0;
+	const __m128i zero = _mm_setzero_si128();
+
+	/* two destination pixels (8 channels) per iteration */
+	for (; x + 2 <= width; x += 2)
+	{
+		const __m128i a0 = _mm_cvtsi32_si128(*(const int*)&pSrc[pIndex0[x] * 4]);
+		const __m128i a1 = _mm_cvtsi32_si128(*(const int*)&pSrc[pIndex1[x] * 4]);
+		const __m128i b0 = _mm_cvtsi32_si128(*(const int*)&pSrc[pIndex0[x + 1] * 4]);
+		const __m128i b1 = _mm_cvtsi32_si128(*(const int*)&pSrc[pIndex1[x + 1] * 4]);
+		const __m128i p0 = _mm_unpacklo_epi8(_mm_unpacklo_epi32(a0, b0), zero);
+		const __m128i p1 = _mm_unpacklo_epi8(_mm_unpacklo_epi32(a1, b1), zero);
+		const short wa = (short)pWeight[x];
+		const short wb = (short)pWeight[x + 1];
+		const __m128i w1 = _mm_set_epi16(wb, wb, wb, wb, wa, wa, wa, wa);
+		const __m128i w0 = _mm_sub_epi16(_mm_set1_epi16(FREERDP_SCALER_WEIGHT_ONE), w1);
+		const __m128i v = _mm_add_epi16(_mm_mullo_epi16(p0, w0), _mm_mullo_epi16(p1, w1));
+		_mm_storeu_si128((__m128i*)&pDst[x * 4], v);
+	}
+
+	for (; x < width; x++)
+	{
+		UINT32 c;
+		const BYTE* p0 = &pSrc[pIndex0[x] * 4];
+		const BYTE* p1 = &pSrc[pIndex1[x] * 4];
+		const UINT16 w1 = pWeight[x];
+		const UINT16 w0 = FREERDP_SCALER_WEIGHT_ONE - w1;
+
+		for (c = 0; c < 4; c++)
+			pDst[x * 4 + c] = (UINT16)(p0[c] * w0 + p1[c] * w1);
+	}
+}
+
+static void scaler_row_v_sse2(BYTE* pDst, const UINT16* pRow0, const UINT16* pRow1,
+                              UINT16 weight, UINT32 count)
+{
+	UINT32 i = 0;
+	const UINT32 w1 = weight;
+	const UINT32 w0 = FREERDP_SCALER_WEIGHT_ONE - weight;
+	/* (2 * r) * (w << 8) >> 16 == (r * w) >> 7, and both factors fit in 16 bits */
+	const __m128i mw0 = _mm_set1_epi16((short)(w0 << 8));
+	const __m128i mw1 = _mm_set1_epi16((short)(w1 << 8));
+	const __m128i round = _mm_set1_epi16(FREERDP_SCALER_WEIGHT_ONE / 2);
+
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i lo, hi;
+		const __m128i r0lo = _mm_slli_epi16(_mm_loadu_si128((const __m128i*)&pRow0[i]), 1);
+		const __m128i r1lo = _mm_slli_epi16(_mm_loadu_si128((const __m128i*)&pRow1[i]), 1);
+		const __m128i r0hi = _mm_slli_epi16(_mm_loadu_si128((const __m128i*)&pRow0[i + 8]), 1);
+		const __m128i r1hi = _mm_slli_epi16(_mm_loadu_si128((const __m128i*)&pRow1[i + 8]), 1);
+		lo = _mm_add_epi16(_mm_mulhi_epu16(r0lo, mw0), _mm_mulhi_epu16(r1lo, mw1));
+		hi = _mm_add_epi16(_mm_mulhi_epu16(r0hi, mw0), _mm_mulhi_epu16(r1hi, mw1));
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, round), FREERDP_SCALER_WEIGHT_BITS);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, round), FREERDP_SCALER_WEIGHT_BITS);
+		_mm_storeu_si128((__m128i*)&pDst[i], _mm_packus_epi16(lo, hi));
+	}
+
+	for (; i < count; i++)
+	{
+		const UINT32 v = ((pRow0[i] * w0) >> FREERDP_SCALER_WEIGHT_BITS) +
+		                 ((pRow1[i] * w1) >> FREERDP_SCALER_WEIGHT_BITS) +
+		                 (FREERDP_SCALER_WEIGHT_ONE / 2);
+		pDst[i] = (BYTE)(v >> FREERDP_SCALER_WEIGHT_BITS);
+	}
+}
+
+void freerdp_image_scaler_init_sse2(FREERDP_SCALER_KERNELS* kernels)
+{
+	if (!IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	kernels->RowH = scaler_row_h_sse2;
+	kernels->RowV = scaler_row_v_sse2;
+}
+
+#endif /* WITH_SSE2 */
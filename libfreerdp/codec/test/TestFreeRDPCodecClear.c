@@ -72,11 +72,159 @@ fail:
 	return rc;
 }
 
+static void test_ClearFillImage(BYTE* data, UINT32 width, UINT32 height, UINT32 type)
+{
+	UINT32 x, y;
+	UINT32 seed = 0x1234567;
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+		{
+			UINT32 color;
+			seed = seed * 1103515245 + 12345;
+
+			switch (type)
+			{
+				case 0: /* text on a flat background */
+					color = (((x % 9) < 2) && ((y % 13) > 3)) || (((y % 13) == 7) && ((x % 9) < 6)) ?
+					        0xFF202020 : 0xFFF0F0F0;
+
+					if (((x % 9) == 2) && ((y % 13) > 3))
+						color = 0xFF909090;
+
+					break;
+
+				case 1: /* large flat areas */
+					color = (x < width / 3) ? 0xFF3060A0 : ((y < height / 2) ? 0xFFFFFFFF : 0xFF000000);
+					break;
+
+				case 2: /* few colors, no structure */
+					color = 0xFF000000 | (((seed >> 16) % 10) * 0x151515);
+					break;
+
+				default: /* natural image */
+					color = 0xFF000000 | ((x * 2) << 16) | ((y * 3) << 8) | ((x + y + ((seed >> 16) & 7)) & 0xFF);
+					break;
+			}
+
+			WriteColor(&data[(y * width + x) * 4], PIXEL_FORMAT_BGRX32,
+			           FreeRDPConvertColor(color, PIXEL_FORMAT_ARGB32, PIXEL_FORMAT_BGRX32, NULL));
+		}
+	}
+}
+
+static BOOL test_ClearCompressImage(CLEAR_CONTEXT* encoder, CLEAR_CONTEXT* decoder,
+                                    UINT32 width, UINT32 height, UINT32 type, UINT32 maxError,
+                                    UINT32* pDstSize)
+{
+	UINT32 i, c;
+	int status;
+	BOOL rc = FALSE;
+	BYTE* pDstData = NULL;
+	UINT32 DstSize = 0;
+	BYTE* pSrcData = calloc(width * height, 4);
+	BYTE* pOutData = calloc(width * height, 4);
+
+	if (!pSrcData || !pOutData)
+		goto fail;
+
+	test_ClearFillImage(pSrcData, width, height, type);
+	status = clear_compress(encoder, pSrcData, PIXEL_FORMAT_BGRX32, width * 4, width, height,
+	                        &pDstData, &DstSize);
+
+	if (status < 0)
+		goto fail;
+
+	status = clear_decompress(decoder, pDstData, DstSize, width, height, pOutData,
+	                          PIXEL_FORMAT_BGRX32, width * 4, 0, 0, width, height, NULL);
+	printf("clear_compress %"PRIu32"x%"PRIu32" type %"PRIu32": %"PRIu32" bytes, status: %d\n",
+	       width, height, type, DstSize, status);
+
+	if (status != 0)
+		goto fail;
+
+	for (i = 0; i < width * height * 4; i++)
+	{
+		/* the alpha channel is not transmitted */
+		if ((i % 4) == 3)
+			continue;
+
+		c = (pSrcData[i] > pOutData[i]) ? pSrcData[i] - pOutData[i] : pOutData[i] - pSrcData[i];
+
+		if (c > maxError)
+		{
+			printf("pixel %"PRIu32" differs by %"PRIu32"\n", i / 4, c);
+			goto fail;
+		}
+	}
+
+	if (pDstSize)
+		*pDstSize = DstSize;
+
+	rc = TRUE;
+fail:
+	free(pSrcData);
+	free(pOutData);
+	return rc;
+}
+
+static BOOL test_ClearCompress(void)
+{
+	BOOL rc = FALSE;
+	UINT32 size = 0;
+	UINT32 first = 0;
+	CLEAR_CONTEXT* encoder = clear_context_new(TRUE);
+	CLEAR_CONTEXT* decoder = clear_context_new(FALSE);
+
+	if (!encoder || !decoder)
+		goto fail;
+
+	if (!test_ClearCompressImage(encoder, decoder, 200, 60, 0, 0, &first))
+		goto fail;
+
+	/* repeated columns are sent as vBar cache hits */
+	if (!test_ClearCompressImage(encoder, decoder, 200, 60, 0, 0, &size) || (size >= first * 3 / 4))
+		goto fail;
+
+	if (!test_ClearCompressImage(encoder, decoder, 300, 100, 1, 0, &size) || (size > 512))
+		goto fail;
+
+	if (!test_ClearCompressImage(encoder, decoder, 120, 40, 2, 0, &size))
+		goto fail;
+
+	if (!test_ClearCompressImage(encoder, decoder, 16, 16, 2, 0, &first))
+		goto fail;
+
+	/* the second identical glyph is a glyph cache hit without payload */
+	if (!test_ClearCompressImage(encoder, decoder, 16, 16, 2, 0, &size) || (size != 4))
+		goto fail;
+
+	if (!test_ClearCompressImage(encoder, decoder, 128, 64, 3, 16, &size))
+		goto fail;
+
+	/* a reset encoder starts over with a cache reset the decoder follows */
+	if (!clear_context_reset(encoder) || !clear_context_reset(decoder))
+		goto fail;
+
+	if (!test_ClearCompressImage(encoder, decoder, 16, 16, 2, 0, &size) || (size == 4))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	clear_context_free(encoder);
+	clear_context_free(decoder);
+	return rc;
+}
+
 int TestFreeRDPCodecClear(int argc, char* argv[])
 {
 	WINPR_UNUSED(argc);
 	WINPR_UNUSED(argv);
 
+	if (!test_ClearCompress())
+		return -1;
+
 	/* Example 1 needs a filled glyph cache
 	if (!test_ClearDecompressExample(1, 8, 9, TEST_CLEAR_EXAMPLE_1,
 	                                 sizeof(TEST_CLEAR_EXAMPLE_1)))
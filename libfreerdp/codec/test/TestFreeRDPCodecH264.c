@@ -0,0 +1,129 @@
+
+#include <winpr/crt.h>
+
+#include <freerdp/codec/h264.h>
+
+#define TEST_WIDTH 1920
+#define TEST_HEIGHT 1080
+
+/* Encoded size of a frame at the given QP, the content is twice as
+ * expensive as the controller's model assumes */
+static UINT32 test_frame_size(const H264_CONTEXT* h264)
+{
+	double bits = TEST_WIDTH * TEST_HEIGHT * 0.2;
+	INT32 qp = (INT32) h264->QP;
+
+	if (h264->RateControlMode == H264_RATECONTROL_VBR)
+		return (UINT32)(h264->BitRate / h264->FrameRate / 8);
+
+	for (; qp >= 32; qp -= 6)
+		bits /= 2.0;
+
+	for (; qp < 26; qp += 6)
+		bits *= 2.0;
+
+	return (UINT32)(bits / 8 * (1.0 - (qp - 26) * 0.1));
+}
+
+/* Runs the controller for the given number of seconds, returns the bit rate sent */
+static double test_run(H264_CONTEXT* h264, UINT32 seconds, UINT32 queueDepth)
+{
+	double elapsed = 0;
+	double sent = 0;
+
+	while (elapsed < seconds)
+	{
+		const UINT32 size = test_frame_size(h264);
+		elapsed += 1.0 / h264->FrameRate;
+		sent += size * 8.0;
+		h264_context_update_queue_depth(h264, queueDepth);
+
+		if (!h264_context_rate_control(h264, size))
+			return -1;
+	}
+
+	return sent / elapsed;
+}
+
+static BOOL test_rate_control(H264_RATECONTROL_MODE mode)
+{
+	double rate;
+	H264_CONTEXT h264;
+	const char* name = (mode == H264_RATECONTROL_CQP) ? "CQP" : "VBR";
+	ZeroMemory(&h264, sizeof(h264));
+	h264.Compressor = TRUE;
+	h264.width = TEST_WIDTH;
+	h264.height = TEST_HEIGHT;
+	h264.RateControlMode = mode;
+	h264.BitRate = 10000000;
+	h264.FrameRate = 30;
+	h264.QP = 22;
+
+	if (!h264_context_enable_rate_control(&h264, TRUE))
+		return FALSE;
+
+	/* a fast link, limited by the configured maximum */
+	h264_context_update_network(&h264, 50000, 20);
+	rate = test_run(&h264, 10, 1);
+	printf("%s: fast link: %.0f bit/s, %.0f fps, QP %"PRIu32"\n", name, rate, h264.FrameRate,
+	       h264.QP);
+
+	if ((h264.BitRate != 10000000) || (h264.FrameRate != 30) || (rate > 10000000 * 1.1))
+		return FALSE;
+
+	/* the link drops to 2 Mbit/s */
+	h264_context_update_network(&h264, 2000, 20);
+	test_run(&h264, 5, 1);
+	rate = test_run(&h264, 10, 1);
+	printf("%s: slow link: %.0f bit/s, %.0f fps, QP %"PRIu32"\n", name, rate, h264.FrameRate,
+	       h264.QP);
+
+	if ((h264.BitRate > 1600000) || (rate > 1600000 * 1.25) || (rate < 1600000 * 0.5))
+		return FALSE;
+
+	if (h264.FrameRate >= 30)
+		return FALSE;
+
+	/* the client falls behind: less than before */
+	test_run(&h264, 2, 12);
+
+	if (h264.BitRate >= 1600000)
+		return FALSE;
+
+	/* recovery */
+	h264_context_update_network(&h264, 8000, 20);
+	rate = test_run(&h264, 10, 1);
+	printf("%s: recovered: %.0f bit/s, %.0f fps, QP %"PRIu32"\n", name, rate, h264.FrameRate,
+	       h264.QP);
+
+	if ((h264.BitRate != 6400000) || (h264.QP < h264.RateControl.MinQP) ||
+	    (h264.QP > h264.RateControl.MaxQP))
+		return FALSE;
+
+	if ((mode == H264_RATECONTROL_CQP) && ((rate > 6400000 * 1.25) || (rate < 6400000 * 0.5)))
+		return FALSE;
+
+	/* disabled, nothing changes anymore */
+	h264_context_enable_rate_control(&h264, FALSE);
+	h264_context_update_network(&h264, 100, 20);
+	test_run(&h264, 1, 1);
+	return h264.BitRate == 6400000;
+}
+
+int TestFreeRDPCodecH264(int argc, char* argv[])
+{
+	H264_CONTEXT h264;
+	ZeroMemory(&h264, sizeof(h264));
+
+	/* decoders have no rate control */
+	if (h264_context_enable_rate_control(&h264, TRUE))
+		return -1;
+
+	if (!test_rate_control(H264_RATECONTROL_VBR))
+		return -1;
+
+	if (!test_rate_control(H264_RATECONTROL_CQP))
+		return -1;
+
+	return 0;
+}
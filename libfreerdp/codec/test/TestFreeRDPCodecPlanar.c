@@ -3,6 +3,7 @@
 
 #include <winpr/crt.h>
 #include <winpr/print.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/freerdp.h>
 #include <freerdp/codec/color.h>
@@ -3010,6 +3011,95 @@ fail:
 	return rc;
 }
 
+/**
+ * Tiles the experimental bitmaps to a full screen, large enough to be
+ * processed in bands, and reports the time of a round trip.
+ */
+static BOOL RunTestPlanarLarge(const UINT32 dstFormat, BOOL vFlip)
+{
+	UINT32 x, y;
+	UINT64 encodeTime, decodeTime;
+	BOOL rc = FALSE;
+	UINT32 compressedSize = 0;
+	const UINT32 width = 1920;
+	const UINT32 height = 1080;
+	const UINT32 srcStep = width * 4;
+	const UINT32 dstStep = width * GetBytesPerPixel(dstFormat);
+	const BYTE* tiles[] = { TEST_RLE_BITMAP_EXPERIMENTAL_01, TEST_RLE_BITMAP_EXPERIMENTAL_02,
+	                        TEST_RLE_BITMAP_EXPERIMENTAL_03
+	                      };
+	const DWORD planarFlags = PLANAR_FORMAT_HEADER_NA | PLANAR_FORMAT_HEADER_RLE;
+	BITMAP_PLANAR_CONTEXT* encoder = freerdp_bitmap_planar_context_new(planarFlags, width, height);
+	/* smaller than the bitmap, the decoder has to grow its planes */
+	BITMAP_PLANAR_CONTEXT* decoder = freerdp_bitmap_planar_context_new(planarFlags, 64, 64);
+	BYTE* bmp = malloc(srcStep * height);
+	BYTE* compressedBitmap = NULL;
+	BYTE* decompressedBitmap = malloc(dstStep * height);
+	printf("%s: [%s]%s: ", __FUNCTION__, FreeRDPGetColorFormatName(dstFormat),
+	       vFlip ? " flipped" : "");
+	fflush(stdout);
+
+	if (!encoder || !decoder || !bmp || !decompressedBitmap)
+		goto fail;
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x += 64)
+		{
+			const BYTE* src = &tiles[((y / 64) + (x / 64)) % ARRAYSIZE(tiles)][(y % 64) * 64 * 4];
+			CopyMemory(&bmp[y * srcStep + x * 4], src, MIN(64, width - x) * 4);
+		}
+	}
+
+	encodeTime = GetTickCount64();
+	compressedBitmap = freerdp_bitmap_compress_planar(encoder, bmp, PIXEL_FORMAT_RGBX32, width,
+	                   height, srcStep, NULL, &compressedSize);
+	encodeTime = GetTickCount64() - encodeTime;
+
+	if (!compressedBitmap)
+		goto fail;
+
+	decodeTime = GetTickCount64();
+
+	if (!planar_decompress(decoder, compressedBitmap, compressedSize, width, height,
+	                       decompressedBitmap, dstFormat, dstStep, 0, 0, width, height, vFlip))
+		goto fail;
+
+	decodeTime = GetTickCount64() - decodeTime;
+
+	/* the encoder stores the scanlines bottom up, as bitmap updates do */
+	if (!vFlip)
+	{
+		for (y = 0; y < height; y++)
+		{
+			if (!CompareBitmap(&decompressedBitmap[(height - 1 - y) * dstStep], dstFormat,
+			                   &bmp[y * srcStep], PIXEL_FORMAT_RGBX32, width, 1))
+				goto fail;
+		}
+	}
+	else if (!CompareBitmap(decompressedBitmap, dstFormat, bmp, PIXEL_FORMAT_RGBX32, width,
+	                        height))
+		goto fail;
+
+	printf("%"PRIu32" bytes, encode %"PRIu64" ms, decode %"PRIu64" ms ", compressedSize,
+	       encodeTime, decodeTime);
+	printf("SUCCESS");
+	rc = TRUE;
+fail:
+
+	if (!rc)
+		printf("FAIL");
+
+	printf("\n");
+	fflush(stdout);
+	free(bmp);
+	free(compressedBitmap);
+	free(decompressedBitmap);
+	freerdp_bitmap_planar_context_free(encoder);
+	freerdp_bitmap_planar_context_free(decoder);
+	return rc;
+}
+
 static BOOL TestPlanar(const UINT32 format)
 {
 	UINT32 x;
@@ -3061,5 +3151,11 @@ int TestFreeRDPCodecPlanar(int argc, char* argv[])
 			return -1;
 	}
 
+	if (!RunTestPlanarLarge(PIXEL_FORMAT_BGRX32, TRUE))
+		return -1;
+
+	if (!RunTestPlanarLarge(PIXEL_FORMAT_RGBX32, FALSE))
+		return -1;
+
 	return 0;
 }
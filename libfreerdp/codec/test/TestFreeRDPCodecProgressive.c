@@ -921,6 +921,315 @@ static int test_progressive_ms_sample(char* ms_sample_path)
 	return 0;
 }
 
+static void test_progressive_fill_image(BYTE* data, UINT32 width, UINT32 height, UINT32 step,
+                                        UINT32 seed)
+{
+	UINT32 x, y;
+	BYTE* pixel;
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+		{
+			pixel = &data[(y * step) + (x * 4)];
+			pixel[0] = (BYTE)((x * 255) / width); /* B */
+			pixel[1] = (BYTE)((y * 255) / height); /* G */
+			pixel[2] = (BYTE)(((x + y + seed) * 3) & 0xFF); /* R */
+			pixel[3] = 0xFF;
+
+			/* sharp edges of a text like pattern */
+			if (((x / 5) + (y / 7) + seed) % 11 == 0)
+			{
+				pixel[0] = pixel[1] = pixel[2] = 0;
+			}
+		}
+	}
+}
+
+static double test_progressive_mean_error(const BYTE* src, const BYTE* dst, UINT32 width,
+        UINT32 height, UINT32 step)
+{
+	UINT32 x, y, c;
+	UINT64 error = 0;
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+		{
+			for (c = 0; c < 3; c++)
+			{
+				const BYTE a = src[(y * step) + (x * 4) + c];
+				const BYTE b = dst[(y * step) + (x * 4) + c];
+				error += (a > b) ? (a - b) : (b - a);
+			}
+		}
+	}
+
+	return ((double) error) / (width * height * 3);
+}
+
+static int test_progressive_encode_decode(PROGRESSIVE_CONTEXT* encoder,
+        PROGRESSIVE_CONTEXT* decoder, const BYTE* pSrcData, BYTE* pDstData, UINT32 width,
+        UINT32 height, UINT32 step, const RECTANGLE_16* rect, UINT32* pDstSize)
+{
+	int status;
+	BYTE* pData = NULL;
+	UINT32 size = 0;
+	REGION16 invalidRegion;
+	REGION16 updateRegion;
+	region16_init(&invalidRegion);
+	region16_init(&updateRegion);
+
+	if (rect)
+	{
+		region16_union_rect(&invalidRegion, &invalidRegion, rect);
+		status = progressive_compress(encoder, pSrcData, step * height, PIXEL_FORMAT_BGRX32,
+		                              width, height, step, &invalidRegion, 0, &pData, &size);
+	}
+	else
+		status = progressive_compress_upgrade(encoder, 0, &pData, &size);
+
+	if ((status >= 0) && (size > 0))
+	{
+		status = progressive_decompress(decoder, pData, size, pDstData, PIXEL_FORMAT_BGRX32,
+		                                step, 0, 0, &updateRegion, 0);
+	}
+
+	*pDstSize = size;
+	region16_uninit(&invalidRegion);
+	region16_uninit(&updateRegion);
+	return status;
+}
+
+static int test_progressive_encode_roundtrip(void)
+{
+	int rc = -1;
+	int pass;
+	double error;
+	double lastError;
+	UINT32 size;
+	const UINT32 width = 200;
+	const UINT32 height = 150;
+	const UINT32 step = width * 4;
+	RECTANGLE_16 rect = { 0, 0, 200, 150 };
+	BYTE* pSrcData = NULL;
+	BYTE* pDstData = NULL;
+	PROGRESSIVE_CONTEXT* encoder = NULL;
+	PROGRESSIVE_CONTEXT* decoder = NULL;
+	encoder = progressive_context_new(TRUE);
+	decoder = progressive_context_new(FALSE);
+	pSrcData = (BYTE*) calloc(height, step);
+	pDstData = (BYTE*) calloc(height, step);
+
+	if (!encoder || !decoder || !pSrcData || !pDstData)
+		goto fail;
+
+	if (progressive_create_surface_context(decoder, 0, width, height) < 0)
+		goto fail;
+
+	test_progressive_fill_image(pSrcData, width, height, step, 0);
+
+	/* coarse first pass */
+	if (test_progressive_encode_decode(encoder, decoder, pSrcData, pDstData, width, height,
+	                                   step, &rect, &size) < 0)
+		goto fail;
+
+	lastError = test_progressive_mean_error(pSrcData, pDstData, width, height, step);
+	printf("progressive first pass: %"PRIu32" bytes, mean error %f\n", size, lastError);
+
+	if ((size == 0) || (lastError > 24.0))
+		goto fail;
+
+	/* quality upgrades until full quality has been reached */
+	for (pass = 0; progressive_compress_pending(encoder, 0); pass++)
+	{
+		if ((pass > 8) || test_progressive_encode_decode(encoder, decoder, pSrcData, pDstData,
+		        width, height, step, NULL, &size) < 0)
+			goto fail;
+
+		error = test_progressive_mean_error(pSrcData, pDstData, width, height, step);
+		printf("progressive upgrade %d: %"PRIu32" bytes, mean error %f\n", pass, size, error);
+
+		if ((size == 0) || (error > lastError))
+			goto fail;
+
+		lastError = error;
+	}
+
+	if ((pass == 0) || (lastError > 3.0))
+		goto fail;
+
+	if (test_progressive_encode_decode(encoder, decoder, pSrcData, pDstData, width, height,
+	                                   step, NULL, &size) < 0 || (size != 0))
+		goto fail;
+
+	/* partial update, only the tiles touching the rectangle are sent */
+	test_progressive_fill_image(pSrcData, width, height, step, 5);
+	rect.left = 70;
+	rect.top = 10;
+	rect.right = 130;
+	rect.bottom = 60;
+
+	if (test_progressive_encode_decode(encoder, decoder, pSrcData, pDstData, width, height,
+	                                   step, &rect, &size) < 0)
+		goto fail;
+
+	while (progressive_compress_pending(encoder, 0))
+	{
+		if (test_progressive_encode_decode(encoder, decoder, pSrcData, pDstData, width, height,
+		                                   step, NULL, &size) < 0)
+			goto fail;
+	}
+
+	/* tiles (1,0) and (2,0) cover x 64 - 191 and y 0 - 63 */
+	error = test_progressive_mean_error(&pSrcData[64 * 4], &pDstData[64 * 4], 128, 64, step);
+	printf("progressive partial update: mean error %f\n", error);
+
+	if (error > 3.0)
+		goto fail;
+
+	rc = 0;
+fail:
+	progressive_context_free(encoder);
+	progressive_context_free(decoder);
+	free(pSrcData);
+	free(pDstData);
+	return rc;
+}
+
+static int test_progressive_decode_run(PROGRESSIVE_CONTEXT* decoder, wStream** passes,
+                                       UINT32 count, BYTE* pDstData, UINT32 width,
+                                       UINT32 height, UINT32 step)
+{
+	UINT32 index;
+	REGION16 updateRegion;
+
+	if (progressive_delete_surface_context(decoder, 0) < 0)
+		return -1;
+
+	if (progressive_create_surface_context(decoder, 0, width, height) < 0)
+		return -1;
+
+	for (index = 0; index < count; index++)
+	{
+		int status;
+		region16_init(&updateRegion);
+		status = progressive_decompress(decoder, Stream_Buffer(passes[index]),
+		                                (UINT32) Stream_Length(passes[index]), pDstData,
+		                                PIXEL_FORMAT_BGRX32, step, 0, 0, &updateRegion, 0);
+		region16_uninit(&updateRegion);
+
+		if (status < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Decodes all passes of a full HD frame with the tiles of each region
+ * decoded sequentially and on the decoder worker pool. Both must give the
+ * same image.
+ */
+static int test_progressive_decode_benchmark(void)
+{
+	int rc = -1;
+	int run;
+	UINT32 index;
+	UINT32 count = 0;
+	UINT64 start;
+	UINT64 sequential = 0;
+	UINT64 parallel = 0;
+	const UINT32 width = 1920;
+	const UINT32 height = 1080;
+	const UINT32 step = width * 4;
+	RECTANGLE_16 rect = { 0, 0, 1920, 1080 };
+	wStream* passes[16] = { 0 };
+	BYTE* pSrcData = NULL;
+	BYTE* pSeqData = NULL;
+	BYTE* pParData = NULL;
+	PTP_PARALLEL pool = NULL;
+	PROGRESSIVE_CONTEXT* encoder = progressive_context_new(TRUE);
+	PROGRESSIVE_CONTEXT* decoder = progressive_context_new(FALSE);
+	REGION16 invalidRegion;
+	region16_init(&invalidRegion);
+	pSrcData = (BYTE*) calloc(height, step);
+	pSeqData = (BYTE*) calloc(height, step);
+	pParData = (BYTE*) calloc(height, step);
+
+	if (!encoder || !decoder || !pSrcData || !pSeqData || !pParData)
+		goto fail;
+
+	pool = decoder->Parallel;
+	test_progressive_fill_image(pSrcData, width, height, step, 3);
+	region16_union_rect(&invalidRegion, &invalidRegion, &rect);
+
+	for (count = 0; count < ARRAYSIZE(passes); count++)
+	{
+		int status;
+		BYTE* pData = NULL;
+		UINT32 size = 0;
+
+		if (count == 0)
+			status = progressive_compress(encoder, pSrcData, step * height, PIXEL_FORMAT_BGRX32,
+			                              width, height, step, &invalidRegion, 0, &pData, &size);
+		else if (progressive_compress_pending(encoder, 0))
+			status = progressive_compress_upgrade(encoder, 0, &pData, &size);
+		else
+			break;
+
+		if ((status < 0) || (size == 0) || !(passes[count] = Stream_New(NULL, size)))
+			goto fail;
+
+		Stream_Write(passes[count], pData, size);
+		Stream_SealLength(passes[count]);
+	}
+
+	for (run = 0; run < 3; run++)
+	{
+		decoder->Parallel = NULL;
+		start = GetTickCount64();
+
+		if (test_progressive_decode_run(decoder, passes, count, pSeqData, width, height, step) < 0)
+			goto fail;
+
+		sequential += GetTickCount64() - start;
+		decoder->Parallel = pool;
+		start = GetTickCount64();
+
+		if (test_progressive_decode_run(decoder, passes, count, pParData, width, height, step) < 0)
+			goto fail;
+
+		parallel += GetTickCount64() - start;
+	}
+
+	printf("progressive decode of %"PRIu32" passes (%"PRIu32" workers): sequential %"PRIu64" ms, "
+	       "parallel %"PRIu64" ms\n", count, decoder->numWorkers, sequential / 3, parallel / 3);
+
+	if (memcmp(pSeqData, pParData, step * height) != 0)
+		goto fail;
+
+	if (test_progressive_mean_error(pSrcData, pParData, width, height, step) > 3.0)
+		goto fail;
+
+	rc = 0;
+fail:
+
+	if (decoder)
+		decoder->Parallel = pool;
+
+	for (index = 0; index < ARRAYSIZE(passes); index++)
+		Stream_Free(passes[index], TRUE);
+
+	region16_uninit(&invalidRegion);
+	progressive_context_free(encoder);
+	progressive_context_free(decoder);
+	free(pSrcData);
+	free(pSeqData);
+	free(pParData);
+	return rc;
+}
+
 int TestFreeRDPCodecProgressive(int argc, char* argv[])
 {
 	char* ms_sample_path;
@@ -928,6 +1237,13 @@ int TestFreeRDPCodecProgressive(int argc, char* argv[])
 	SYSTEMTIME systemTime;
 	WINPR_UNUSED(argc);
 	WINPR_UNUSED(argv);
+
+	if (test_progressive_encode_roundtrip() < 0)
+		return -1;
+
+	if (test_progressive_decode_benchmark() < 0)
+		return -1;
+
 	GetSystemTime(&systemTime);
 	sprintf_s(name, sizeof(name),
 	          "EGFX_PROGRESSIVE_MS_SAMPLE-%04"PRIu16"%02"PRIu16"%02"PRIu16"%02"PRIu16"%02"PRIu16"%02"PRIu16"%04"PRIu16,
@@ -1,5 +1,6 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/freerdp.h>
 #include <freerdp/codec/rfx.h>
@@ -769,6 +770,106 @@ static BOOL fuzzyCompareImage(const UINT32 *refImage, const BYTE *img, size_t np
 	return TRUE;
 }
 
+#define RLGR_TILE_SIZE 4096
+#define RLGR_ITERATIONS 2000
+
+/* Coefficients shaped like a quantized tile: sparse high bands, dense LL3 band at the end */
+static void fillRlgrTile(INT16* coeffs)
+{
+	UINT32 i;
+	UINT32 seed = 0x2545F491;
+
+	for (i = 0; i < RLGR_TILE_SIZE; i++)
+	{
+		UINT32 zeroPercent, range;
+		seed = seed * 1103515245 + 12345;
+
+		if (i < 3072)
+		{
+			zeroPercent = 85;
+			range = 3;
+		}
+		else if (i < 3840)
+		{
+			zeroPercent = 60;
+			range = 8;
+		}
+		else if (i < 4032)
+		{
+			zeroPercent = 30;
+			range = 64;
+		}
+		else
+		{
+			zeroPercent = 0;
+			range = 400;
+		}
+
+		if (((seed >> 16) % 100) < zeroPercent)
+			coeffs[i] = 0;
+		else
+			coeffs[i] = (INT16)((seed >> 8) % (2 * range + 1)) - (INT16) range;
+	}
+
+	/* a trailing zero is not reproduced in run-length mode */
+	if (!coeffs[RLGR_TILE_SIZE - 1])
+		coeffs[RLGR_TILE_SIZE - 1] = 1;
+}
+
+static BOOL testRlgr(RFX_CONTEXT* context, RLGR_MODE mode)
+{
+	int length;
+	UINT32 i;
+	UINT64 start, encodeTime, decodeTime;
+	BOOL rc = FALSE;
+	INT16* coeffs = calloc(RLGR_TILE_SIZE, sizeof(INT16));
+	INT16* decoded = calloc(RLGR_TILE_SIZE, sizeof(INT16));
+	BYTE* encoded = calloc(RLGR_TILE_SIZE, 2);
+
+	if (!coeffs || !decoded || !encoded)
+		goto fail;
+
+	fillRlgrTile(coeffs);
+	start = GetTickCount64();
+
+	for (i = 0; i < RLGR_ITERATIONS; i++)
+		length = context->rlgr_encode(mode, coeffs, RLGR_TILE_SIZE, encoded, RLGR_TILE_SIZE * 2);
+
+	encodeTime = GetTickCount64() - start;
+
+	if ((length <= 0) || (length >= RLGR_TILE_SIZE * 2))
+		goto fail;
+
+	start = GetTickCount64();
+
+	for (i = 0; i < RLGR_ITERATIONS; i++)
+	{
+		if (context->rlgr_decode(mode, encoded, length, decoded, RLGR_TILE_SIZE) < 0)
+			goto fail;
+	}
+
+	decodeTime = GetTickCount64() - start;
+
+	if (memcmp(coeffs, decoded, RLGR_TILE_SIZE * sizeof(INT16)) != 0)
+	{
+		printf("RLGR%d: decoded coefficients differ\n", (mode == RLGR1) ? 1 : 3);
+		goto fail;
+	}
+
+	/* a truncated stream decodes to a zero filled tail */
+	if (context->rlgr_decode(mode, encoded, length / 2, decoded, RLGR_TILE_SIZE) < 0)
+		goto fail;
+
+	printf("RLGR%d: %d bytes per tile, %d tiles encoded in %"PRIu64" ms, decoded in %"PRIu64" ms\n",
+	       (mode == RLGR1) ? 1 : 3, length, RLGR_ITERATIONS, encodeTime, decodeTime);
+	rc = TRUE;
+fail:
+	free(coeffs);
+	free(decoded);
+	free(encoded);
+	return rc;
+}
+
 int TestFreeRDPCodecRemoteFX(int argc, char* argv[])
 {
 	int rc = -1;
@@ -805,6 +906,9 @@ int TestFreeRDPCodecRemoteFX(int argc, char* argv[])
 	if (!fuzzyCompareImage(refImage, dest, IMG_WIDTH * IMG_HEIGHT))
 		goto fail;
 
+	if (!testRlgr(context, RLGR1) || !testRlgr(context, RLGR3))
+		goto fail;
+
 	rc = 0;
 fail:
 	region16_uninit(&region);
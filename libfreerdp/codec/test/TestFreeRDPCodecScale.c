@@ -0,0 +1,141 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/codec/color.h>
+
+/* source image: red rises to the right, green rises downwards, blue is constant */
+static BYTE* create_gradient(UINT32 format, UINT32 width, UINT32 height, UINT32 step)
+{
+	UINT32 x, y;
+	BYTE* data = calloc(height, step);
+
+	if (!data)
+		return NULL;
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+		{
+			const BYTE r = (BYTE)((width > 1) ? (x * 255) / (width - 1) : 0);
+			const BYTE g = (BYTE)((height > 1) ? (y * 255) / (height - 1) : 0);
+			const UINT32 color = FreeRDPGetColor(format, r, g, 0x80, 0xFF);
+			WriteColor(&data[y * step + x * GetBytesPerPixel(format)], format, color);
+		}
+	}
+
+	return data;
+}
+
+static BOOL check_gradient(const BYTE* data, UINT32 format, UINT32 width, UINT32 height,
+                           UINT32 step)
+{
+	UINT32 x, y;
+
+	for (y = 0; y < height; y++)
+	{
+		BYTE lastR = 0;
+
+		for (x = 0; x < width; x++)
+		{
+			BYTE r, g, b, a;
+			BYTE lastG = 0;
+			const UINT32 color = ReadColor(&data[y * step + x * GetBytesPerPixel(format)], format);
+			SplitColor(color, format, &r, &g, &b, &a, NULL);
+
+			if (y > 0)
+			{
+				const UINT32 above = ReadColor(&data[(y - 1) * step + x * GetBytesPerPixel(format)],
+				                               format);
+				SplitColor(above, format, NULL, &lastG, NULL, NULL, NULL);
+			}
+
+			if ((r < lastR) || (g < lastG) || (abs(b - 0x80) > 1))
+			{
+				fprintf(stderr, "%"PRIu32"x%"PRIu32": pixel %"PRIu32",%"PRIu32" is %02"PRIX8
+				        "%02"PRIX8"%02"PRIX8"\n", width, height, x, y, r, g, b);
+				return FALSE;
+			}
+
+			lastR = r;
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL test_scale(FREERDP_IMAGE_SCALER* scaler, UINT32 srcFormat, UINT32 dstFormat,
+                       UINT32 srcWidth, UINT32 srcHeight, UINT32 dstWidth, UINT32 dstHeight)
+{
+	BOOL rc = FALSE;
+	const UINT32 srcStep = srcWidth * GetBytesPerPixel(srcFormat) + 12;
+	const UINT32 dstStep = dstWidth * GetBytesPerPixel(dstFormat) + 4;
+	BYTE* src = create_gradient(srcFormat, srcWidth, srcHeight, srcStep);
+	BYTE* dst = calloc(dstHeight, dstStep);
+
+	if (!src || !dst)
+		goto fail;
+
+	if (scaler)
+		rc = freerdp_image_scaler_scale(scaler, dst, dstFormat, dstStep, 0, 0, dstWidth, dstHeight,
+		                                src, srcFormat, srcStep, 0, 0, srcWidth, srcHeight);
+	else
+		rc = freerdp_image_scale(dst, dstFormat, dstStep, 0, 0, dstWidth, dstHeight,
+		                         src, srcFormat, srcStep, 0, 0, srcWidth, srcHeight);
+
+	if (!rc)
+	{
+		fprintf(stderr, "scaling %"PRIu32"x%"PRIu32" to %"PRIu32"x%"PRIu32" failed\n",
+		        srcWidth, srcHeight, dstWidth, dstHeight);
+		goto fail;
+	}
+
+	rc = check_gradient(dst, dstFormat, dstWidth, dstHeight, dstStep);
+fail:
+	free(src);
+	free(dst);
+	return rc;
+}
+
+int TestFreeRDPCodecScale(int argc, char* argv[])
+{
+	int rc = -1;
+	UINT32 i;
+	FREERDP_IMAGE_SCALER* scaler;
+	const UINT32 formats[] = { PIXEL_FORMAT_BGRX32, PIXEL_FORMAT_BGRA32, PIXEL_FORMAT_XRGB32 };
+
+	if (!(scaler = freerdp_image_scaler_new()))
+		return -1;
+
+	/* the same scaler is used for changing sizes, the same size twice in a row */
+	for (i = 0; i < ARRAYSIZE(formats); i++)
+	{
+		const UINT32 format = formats[i];
+
+		if (!test_scale(scaler, format, format, 64, 64, 127, 93) ||
+		    !test_scale(scaler, format, format, 64, 64, 127, 93) ||
+		    !test_scale(scaler, format, format, 800, 600, 333, 250) ||
+		    !test_scale(scaler, format, format, 3, 2, 17, 1) ||
+		    !test_scale(scaler, format, format, 1, 1, 9, 7))
+			goto fail;
+	}
+
+	/* conversion between formats while scaling */
+	if (!test_scale(scaler, PIXEL_FORMAT_BGRX32, PIXEL_FORMAT_XRGB32, 64, 48, 100, 75) ||
+	    !test_scale(scaler, PIXEL_FORMAT_XRGB32, PIXEL_FORMAT_BGRA32, 100, 75, 64, 48))
+		goto fail;
+
+	/* the shared scalers of freerdp_image_scale */
+	if (!test_scale(NULL, PIXEL_FORMAT_BGRX32, PIXEL_FORMAT_BGRX32, 640, 480, 1024, 768) ||
+	    !test_scale(NULL, PIXEL_FORMAT_BGRX32, PIXEL_FORMAT_BGRX32, 640, 480, 1024, 768) ||
+	    !test_scale(NULL, PIXEL_FORMAT_BGRX32, PIXEL_FORMAT_BGRX32, 64, 64, 64, 64))
+		goto fail;
+
+	rc = 0;
+fail:
+	freerdp_image_scaler_free(scaler);
+	return rc;
+}
@@ -249,8 +249,102 @@ fail:
 	return rc;
 }
 
+static void test_ZGfxFillBuffer(BYTE* buffer, UINT32 size, UINT32 round, UINT32* seed)
+{
+	UINT32 x;
+
+	for (x = 0; x < size; x++)
+	{
+		*seed = *seed * 1103515245 + 12345;
+
+		switch ((x / 4096 + round) % 4)
+		{
+			case 0: /* repetitive text */
+				buffer[x] = TEST_FOX_DATA[x % (sizeof(TEST_FOX_DATA) - 1)];
+				break;
+
+			case 1: /* solid fill */
+				buffer[x] = 0;
+				break;
+
+			case 2: /* noise */
+				buffer[x] = (BYTE)(*seed >> 16);
+				break;
+
+			default: /* gradient with sparse noise */
+				buffer[x] = (BYTE)((x / 3) + ((*seed >> 28) == 0 ? (*seed >> 20) : 0));
+				break;
+		}
+	}
+}
+
+static int test_ZGfxCompressRoundtrip(DWORD level)
+{
+	int rc = -1;
+	UINT32 round;
+	UINT32 seed = 42;
+	UINT64 totalSrc = 0;
+	UINT64 totalDst = 0;
+	/* 40 rounds of 80000 bytes: multipart PDUs that wrap the history ring */
+	const UINT32 SrcSize = 80000;
+	BYTE* pSrcData = malloc(SrcSize);
+	ZGFX_CONTEXT* compressor = zgfx_context_new(TRUE);
+	ZGFX_CONTEXT* decompressor = zgfx_context_new(FALSE);
+
+	if (!pSrcData || !compressor || !decompressor)
+		goto fail;
+
+	zgfx_set_compression_level(compressor, level);
+
+	for (round = 0; round < 40; round++)
+	{
+		int status;
+		UINT32 Flags = 0;
+		UINT32 DstSize = 0;
+		UINT32 OutSize = 0;
+		BYTE* pDstData = NULL;
+		BYTE* pOutData = NULL;
+		test_ZGfxFillBuffer(pSrcData, SrcSize, round, &seed);
+		status = zgfx_compress(compressor, pSrcData, SrcSize, &pDstData, &DstSize, &Flags);
+
+		if (status >= 0)
+			status = zgfx_decompress(decompressor, pDstData, DstSize, &pOutData, &OutSize, 0);
+
+		if ((status >= 0) && ((OutSize != SrcSize) || (memcmp(pOutData, pSrcData, SrcSize) != 0)))
+		{
+			printf("test_ZGfxCompressRoundtrip: level %"PRIu32" round %"PRIu32" mismatch\n",
+			       level, round);
+			status = -1;
+		}
+
+		free(pDstData);
+		free(pOutData);
+
+		if (status < 0)
+			goto fail;
+
+		totalSrc += SrcSize;
+		totalDst += DstSize;
+	}
+
+	printf("Roundtrip: level %"PRIu32" %"PRIu64" -> %"PRIu64" bytes\n", level, totalSrc,
+	       totalDst);
+
+	/* Raw segments add a few bytes of header, anything else must shrink */
+	if ((level > 0) && (totalDst >= totalSrc / 2))
+		goto fail;
+
+	rc = 0;
+fail:
+	free(pSrcData);
+	zgfx_context_free(compressor);
+	zgfx_context_free(decompressor);
+	return rc;
+}
+
 int TestFreeRDPCodecZGfx(int argc, char* argv[])
 {
+	DWORD level;
 	WINPR_UNUSED(argc);
 	WINPR_UNUSED(argv);
 
@@ -266,6 +360,12 @@ int TestFreeRDPCodecZGfx(int argc, char* argv[])
 	if (test_ZGfxCompressConsistent() < 0)
 		return -1;
 
+	for (level = 0; level <= 3; level++)
+	{
+		if (test_ZGfxCompressRoundtrip(level) < 0)
+			return -1;
+	}
+
 	return 0;
 }
 
@@ -1,5 +1,6 @@
 #include <winpr/sysinfo.h>
 #include <winpr/pool.h>
+#include <winpr/interlocked.h>
 
 #include <freerdp/primitives.h>
 #include <freerdp/log.h>
@@ -16,6 +17,7 @@ struct _YUV_CONTEXT
 
 	PTP_POOL threadPool;
 	TP_CALLBACK_ENVIRON ThreadPoolEnv;
+	PTP_PARALLEL parallel;
 };
 
 
@@ -27,24 +29,33 @@ struct _YUV_PROCESS_WORK_PARAM
 	DWORD DstFormat;
 	BYTE *dest;
 	UINT32 nDstStep;
-	UINT32 y;
-	UINT32 height;
+	LONG status;
 };
 typedef struct _YUV_PROCESS_WORK_PARAM YUV_PROCESS_WORK_PARAM;
 
-static void CALLBACK yuv_process_work_callback(PTP_CALLBACK_INSTANCE instance, void* context,
-		PTP_WORK work)
+static VOID yuv_process_work_callback(PVOID context, ULONG index)
 {
 	prim_size_t roi;
+	const BYTE* pYUVData[3];
 	YUV_PROCESS_WORK_PARAM* param = (YUV_PROCESS_WORK_PARAM*)context;
 	primitives_t* prims = primitives_get();
+	const UINT32 y = index * param->context->heightStep;
+
+	pYUVData[0] = param->pYUVData[0] + (y * param->iStride[0]);
+	pYUVData[1] = param->pYUVData[1] + ((y / 2) * param->iStride[1]);
+	pYUVData[2] = param->pYUVData[2] + ((y / 2) * param->iStride[2]);
 
 	roi.width = param->context->width;
-	roi.height = param->height;
-	if( prims->YUV420ToRGB_8u_P3AC4R(param->pYUVData, param->iStride, param->dest, param->nDstStep,
-				        param->DstFormat, &roi) != PRIMITIVES_SUCCESS)
+	if (y + param->context->heightStep <= param->context->height)
+		roi.height = param->context->heightStep;
+	else
+		roi.height = param->context->height % param->context->heightStep;
+
+	if( prims->YUV420ToRGB_8u_P3AC4R(pYUVData, param->iStride, param->dest + (param->nDstStep * y),
+				        param->nDstStep, param->DstFormat, &roi) != PRIMITIVES_SUCCESS)
 	{
 		WLog_ERR(TAG, "error when decoding lines");
+		InterlockedExchange(&param->status, FALSE);
 	}
 }
 
@@ -80,6 +91,11 @@ YUV_CONTEXT* yuv_context_new(BOOL encoder)
 
 		InitializeThreadpoolEnvironment(&ret->ThreadPoolEnv);
 		SetThreadpoolCallbackPool(&ret->ThreadPoolEnv, ret->threadPool);
+		ret->parallel = CreateThreadpoolParallel(&ret->ThreadPoolEnv, ret->nthreads);
+		if (!ret->parallel)
+		{
+			goto error_parallel;
+		}
 	}
 	else
 	{
@@ -88,6 +104,9 @@ YUV_CONTEXT* yuv_context_new(BOOL encoder)
 
 	return ret;
 
+error_parallel:
+	CloseThreadpool(ret->threadPool);
+	DestroyThreadpoolEnvironment(&ret->ThreadPoolEnv);
 error_threadpool:
 	free(ret);
 	return NULL;
@@ -98,6 +117,7 @@ void yuv_context_free(YUV_CONTEXT* context)
 {
 	if (context->useThreads)
 	{
+		CloseThreadpoolParallel(context->parallel);
 		CloseThreadpool(context->threadPool);
 		DestroyThreadpoolEnvironment(&context->ThreadPoolEnv);
 	}
@@ -108,11 +128,8 @@ void yuv_context_free(YUV_CONTEXT* context)
 BOOL yuv_context_decode(YUV_CONTEXT* context, const BYTE* pYUVData[3], UINT32 iStride[3],
 						DWORD DstFormat, BYTE *dest, UINT32 nDstStep)
 {
-	UINT32 y, nobjects, i;
-	PTP_WORK *work_objects = NULL;
-	YUV_PROCESS_WORK_PARAM *params;
-	UINT32 waitCount = 0;
-	BOOL ret = TRUE;
+	UINT32 nobjects;
+	YUV_PROCESS_WORK_PARAM param;
 
 	if (!context->useThreads)
 	{
@@ -126,57 +143,21 @@ BOOL yuv_context_decode(YUV_CONTEXT* context, const BYTE* pYUVData[3], UINT32 iS
 
 	/* case where we use threads */
 	nobjects = (context->height + context->heightStep - 1) / context->heightStep;
-	work_objects = (PTP_WORK *)calloc(nobjects, sizeof(PTP_WORK));
-	if (!work_objects)
-	{
-		return FALSE;
-	}
 
-	params = (YUV_PROCESS_WORK_PARAM *)calloc(nobjects, sizeof(*params));
-	if (!params)
-	{
-		free(work_objects);
+	param.context = context;
+	param.DstFormat = DstFormat;
+	param.pYUVData[0] = pYUVData[0];
+	param.pYUVData[1] = pYUVData[1];
+	param.pYUVData[2] = pYUVData[2];
+	param.iStride[0] = iStride[0];
+	param.iStride[1] = iStride[1];
+	param.iStride[2] = iStride[2];
+	param.dest = dest;
+	param.nDstStep = nDstStep;
+	param.status = TRUE;
+
+	if (!ThreadpoolParallelFor(context->parallel, nobjects, yuv_process_work_callback, &param))
 		return FALSE;
-	}
 
-	for (i = 0, y = 0; i < nobjects; i++, y += context->heightStep, waitCount++)
-	{
-		params[i].context = context;
-		params[i].DstFormat = DstFormat;
-		params[i].pYUVData[0] = pYUVData[0] + (y * iStride[0]);
-		params[i].pYUVData[1] = pYUVData[1] + ((y / 2) * iStride[1]);
-		params[i].pYUVData[2] = pYUVData[2] + ((y / 2) * iStride[2]);
-
-		params[i].iStride[0] = iStride[0];
-		params[i].iStride[1] = iStride[1];
-		params[i].iStride[2] = iStride[2];
-
-		params[i].nDstStep = nDstStep;
-		params[i].dest = dest + (nDstStep * y);
-		params[i].y = y;
-		if (y + context->heightStep <= context->height)
-			params[i].height = context->heightStep;
-		else
-			params[i].height = context->height % context->heightStep;
-
-		work_objects[i] = CreateThreadpoolWork(yuv_process_work_callback,
-					                        (void*) &params[i], &context->ThreadPoolEnv);
-		if (!work_objects[i])
-		{
-			ret = FALSE;
-			break;
-		}
-		SubmitThreadpoolWork(work_objects[i]);
-	}
-
-	for (i = 0; i < waitCount; i++)
-	{
-		WaitForThreadpoolWorkCallbacks(work_objects[i], FALSE);
-		CloseThreadpoolWork(work_objects[i]);
-	}
-
-	free(work_objects);
-	free(params);
-
-	return ret;
+	return param.status;
 }
@@ -40,8 +40,23 @@
  * Maximum number of segments: 65535
  * Maximum expansion of a segment (when compressed size exceeds uncompressed): 1000 bytes
  * Minimum match length: 3 bytes
+ *
+ * The compressor is a hash chain based LZ77 matcher over the same history ring
+ * the decompressor uses. Every input byte (compressed or not) is appended to the
+ * ring, so both sides always hold identical history. A segment is sent raw
+ * whenever the encoded form would not be smaller.
  */
 
+#define ZGFX_HASH_BITS 15
+#define ZGFX_HASH_SIZE (1 << ZGFX_HASH_BITS)
+#define ZGFX_HASH_NONE 0xFFFFFFFF
+
+#define ZGFX_MIN_MATCH_LENGTH 3
+#define ZGFX_MAX_UNENCODED_LENGTH 0x7FFF
+#define ZGFX_MIN_UNENCODED_LENGTH 16
+#define ZGFX_MAX_COMPRESSION_LEVEL 3
+#define ZGFX_DEFAULT_COMPRESSION_LEVEL 2
+
 struct _ZGFX_TOKEN
 {
 	UINT32 prefixLength;
@@ -70,6 +85,21 @@ struct _ZGFX_CONTEXT
 	BYTE HistoryBuffer[2500000];
 	UINT32 HistoryIndex;
 	UINT32 HistoryBufferSize;
+
+	BYTE* pbOutputCurrent;
+	BYTE* pbOutputEnd;
+	UINT64 BitsOutput;
+	UINT32 cBitsOutput;
+
+	UINT32 CompressionLevel;
+	UINT32 MaxChainLength;
+	UINT32 NiceMatchLength;
+	BOOL LazyMatching;
+	UINT32 HistoryValid;
+	UINT32* HashHead;
+	UINT32* HashChain;
+	UINT32 LiteralCode[256];
+	UINT32 LiteralBits[256];
 };
 
 static const ZGFX_TOKEN ZGFX_TOKEN_TABLE[] =
@@ -451,10 +481,309 @@ fail:
 	return status;
 }
 
+static INLINE BOOL zgfx_PutBits(ZGFX_CONTEXT* zgfx, UINT32 bits, UINT32 nbits)
+{
+	zgfx->BitsOutput = (zgfx->BitsOutput << nbits) | bits;
+	zgfx->cBitsOutput += nbits;
+
+	while (zgfx->cBitsOutput >= 8)
+	{
+		if (zgfx->pbOutputCurrent >= zgfx->pbOutputEnd)
+			return FALSE;
+
+		zgfx->cBitsOutput -= 8;
+		*(zgfx->pbOutputCurrent)++ = (BYTE)(zgfx->BitsOutput >> zgfx->cBitsOutput);
+	}
+
+	return TRUE;
+}
+
+static INLINE BOOL zgfx_PutLiteral(ZGFX_CONTEXT* zgfx, BYTE c)
+{
+	return zgfx_PutBits(zgfx, zgfx->LiteralCode[c], zgfx->LiteralBits[c]);
+}
+
+static BOOL zgfx_PutDistance(ZGFX_CONTEXT* zgfx, UINT32 distance)
+{
+	int opIndex;
+
+	for (opIndex = 0; ZGFX_TOKEN_TABLE[opIndex].prefixLength != 0; opIndex++)
+	{
+		const ZGFX_TOKEN* token = &ZGFX_TOKEN_TABLE[opIndex];
+
+		if (token->tokenType == 0)
+			continue;
+
+		if ((distance >= token->valueBase) &&
+		    ((distance - token->valueBase) < (1UL << token->valueBits)))
+		{
+			if (!zgfx_PutBits(zgfx, token->prefixCode, token->prefixLength))
+				return FALSE;
+
+			return zgfx_PutBits(zgfx, distance - token->valueBase, token->valueBits);
+		}
+	}
+
+	return FALSE;
+}
+
+static BOOL zgfx_PutMatch(ZGFX_CONTEXT* zgfx, UINT32 distance, UINT32 count)
+{
+	UINT32 extra = 2;
+
+	if (!zgfx_PutDistance(zgfx, distance))
+		return FALSE;
+
+	if (count == 3)
+		return zgfx_PutBits(zgfx, 0, 1);
+
+	/* '1', (extra - 2) times '1', '0', then extra bits of count - 2^extra */
+	while ((count >> (extra + 1)) != 0)
+		extra++;
+
+	if (!zgfx_PutBits(zgfx, ((1 << (extra - 1)) - 1) << 1, extra))
+		return FALSE;
+
+	return zgfx_PutBits(zgfx, count - (1 << extra), extra);
+}
+
+static BOOL zgfx_PutUnencoded(ZGFX_CONTEXT* zgfx, const BYTE* src, UINT32 count)
+{
+	/* distance 0 followed by a 15 bit count, then the raw bytes on a byte boundary */
+	if (!zgfx_PutDistance(zgfx, 0) || !zgfx_PutBits(zgfx, count, 15))
+		return FALSE;
+
+	if (zgfx->cBitsOutput > 0)
+	{
+		if (!zgfx_PutBits(zgfx, 0, 8 - zgfx->cBitsOutput))
+			return FALSE;
+	}
+
+	if ((size_t)(zgfx->pbOutputEnd - zgfx->pbOutputCurrent) < count)
+		return FALSE;
+
+	CopyMemory(zgfx->pbOutputCurrent, src, count);
+	zgfx->pbOutputCurrent += count;
+	return TRUE;
+}
+
+static BOOL zgfx_PutLiterals(ZGFX_CONTEXT* zgfx, const BYTE* src, UINT32 count)
+{
+	UINT32 index;
+	size_t literalBits = 0;
+
+	if (count >= ZGFX_MIN_UNENCODED_LENGTH)
+	{
+		for (index = 0; index < count; index++)
+			literalBits += zgfx->LiteralBits[src[index]];
+
+		/* token (10 bits), count (15 bits) and at most 7 bits of padding */
+		if (literalBits > (8ULL * count) + 32)
+		{
+			while (count > 0)
+			{
+				const UINT32 chunk = MIN(count, ZGFX_MAX_UNENCODED_LENGTH);
+
+				if (!zgfx_PutUnencoded(zgfx, src, chunk))
+					return FALSE;
+
+				src += chunk;
+				count -= chunk;
+			}
+
+			return TRUE;
+		}
+	}
+
+	for (index = 0; index < count; index++)
+	{
+		if (!zgfx_PutLiteral(zgfx, src[index]))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static INLINE UINT32 zgfx_hash(const BYTE* src)
+{
+	const UINT32 value = ((UINT32)src[0] << 16) | ((UINT32)src[1] << 8) | src[2];
+	return (value * 2654435761U) >> (32 - ZGFX_HASH_BITS);
+}
+
+static INLINE void zgfx_hash_insert(ZGFX_CONTEXT* zgfx, const BYTE* src, UINT32 index)
+{
+	const UINT32 hash = zgfx_hash(src);
+	zgfx->HashChain[index] = zgfx->HashHead[hash];
+	zgfx->HashHead[hash] = index;
+}
+
+static UINT32 zgfx_match_length(const ZGFX_CONTEXT* zgfx, UINT32 index, const BYTE* src,
+                                UINT32 maxLength)
+{
+	UINT32 length = 0;
+
+	while (length < maxLength)
+	{
+		UINT32 x;
+		const UINT32 run = MIN(maxLength - length, zgfx->HistoryBufferSize - index);
+		const BYTE* ptr = &(zgfx->HistoryBuffer[index]);
+
+		for (x = 0; x < run; x++)
+		{
+			if (ptr[x] != src[length + x])
+				return length + x;
+		}
+
+		length += run;
+		index = 0;
+	}
+
+	return length;
+}
+
+/**
+ * Walk the hash chain for the 3 bytes at src (ring position index) and return
+ * the longest match no further away than maxDistance.
+ */
+static UINT32 zgfx_find_match(const ZGFX_CONTEXT* zgfx, const BYTE* src, UINT32 index,
+                              UINT32 maxLength, UINT32 maxDistance, UINT32* pDistance)
+{
+	UINT32 chainLength = zgfx->MaxChainLength;
+	UINT32 previousDistance = 0;
+	UINT32 bestLength = 0;
+	UINT32 candidate = zgfx->HashHead[zgfx_hash(src)];
+
+	while ((candidate != ZGFX_HASH_NONE) && (chainLength-- > 0))
+	{
+		UINT32 length;
+		const UINT32 distance = (index + zgfx->HistoryBufferSize - candidate) %
+		                        zgfx->HistoryBufferSize;
+
+		/* Stale entries from a previous pass over the ring break monotonicity */
+		if ((distance <= previousDistance) || (distance > maxDistance))
+			break;
+
+		previousDistance = distance;
+
+		if ((zgfx->HistoryBuffer[(candidate + bestLength) % zgfx->HistoryBufferSize] ==
+		     src[bestLength]) && (zgfx->HistoryBuffer[candidate] == src[0]))
+		{
+			length = zgfx_match_length(zgfx, candidate, src, maxLength);
+
+			if (length > bestLength)
+			{
+				bestLength = length;
+				*pDistance = distance;
+
+				if (length >= MIN(zgfx->NiceMatchLength, maxLength))
+					break;
+			}
+		}
+
+		candidate = zgfx->HashChain[candidate];
+	}
+
+	return bestLength;
+}
+
+static BOOL zgfx_encode_segment(ZGFX_CONTEXT* zgfx, BYTE* pDstData, const BYTE* pSrcData,
+                                UINT32 SrcSize, UINT32 segmentIndex, UINT32 window,
+                                UINT32* pDstSize)
+{
+	UINT32 i = 0;
+	UINT32 literalStart = 0;
+	UINT32 prevLength = 0;
+	UINT32 prevDistance = 0;
+	const UINT32 size = zgfx->HistoryBufferSize;
+	zgfx->pbOutputCurrent = pDstData;
+	zgfx->pbOutputEnd = &pDstData[SrcSize - 1];
+	zgfx->BitsOutput = 0;
+	zgfx->cBitsOutput = 0;
+
+	while (i < SrcSize)
+	{
+		UINT32 curLength = 0;
+		UINT32 curDistance = 0;
+		const UINT32 index = (segmentIndex + i) % size;
+
+		if (i + ZGFX_MIN_MATCH_LENGTH <= SrcSize)
+		{
+			if (!zgfx->LazyMatching || (prevLength < zgfx->NiceMatchLength))
+				curLength = zgfx_find_match(zgfx, &pSrcData[i], index, SrcSize - i, window + i,
+				                            &curDistance);
+
+			zgfx_hash_insert(zgfx, &pSrcData[i], index);
+		}
+
+		if (curLength < ZGFX_MIN_MATCH_LENGTH)
+			curLength = 0;
+
+		if (!zgfx->LazyMatching)
+		{
+			prevLength = curLength;
+			prevDistance = curDistance;
+			i++;
+		}
+		else if ((prevLength == 0) || (curLength > prevLength))
+		{
+			/* Defer the decision: the next position may yield a longer match */
+			prevLength = curLength;
+			prevDistance = curDistance;
+			i++;
+			continue;
+		}
+
+		if (prevLength == 0)
+			continue;
+
+		{
+			/* Emit the match starting at position i - 1 */
+			const UINT32 start = i - 1;
+			UINT32 next;
+
+			if (!zgfx_PutLiterals(zgfx, &pSrcData[literalStart], start - literalStart))
+				return FALSE;
+
+			if (!zgfx_PutMatch(zgfx, prevDistance, prevLength))
+				return FALSE;
+
+			/* In lazy mode position i has already been inserted */
+			for (next = zgfx->LazyMatching ? i + 1 : i; next < start + prevLength; next++)
+			{
+				if (next + ZGFX_MIN_MATCH_LENGTH <= SrcSize)
+					zgfx_hash_insert(zgfx, &pSrcData[next], (segmentIndex + next) % size);
+			}
+
+			i = literalStart = start + prevLength;
+			prevLength = 0;
+		}
+	}
+
+	if (!zgfx_PutLiterals(zgfx, &pSrcData[literalStart], SrcSize - literalStart))
+		return FALSE;
+
+	/* Pad the last byte, the trailing byte holds the number of unused bits */
+	if (zgfx->cBitsOutput > 0)
+	{
+		const UINT32 unused = 8 - zgfx->cBitsOutput;
+
+		if (!zgfx_PutBits(zgfx, 0, unused) || !zgfx_PutBits(zgfx, unused, 8))
+			return FALSE;
+	}
+	else if (!zgfx_PutBits(zgfx, 0, 8))
+		return FALSE;
+
+	*pDstSize = (UINT32)(zgfx->pbOutputCurrent - pDstData);
+	return TRUE;
+}
+
 static BOOL zgfx_compress_segment(ZGFX_CONTEXT* zgfx, wStream* s, const BYTE* pSrcData,
                                   UINT32 SrcSize, UINT32* pFlags)
 {
-	/* FIXME: Currently compression not implemented. Just copy the raw source */
+	UINT32 window;
+	UINT32 DstSize;
+	const UINT32 segmentIndex = zgfx->HistoryIndex;
+
 	if (!Stream_EnsureRemainingCapacity(s, SrcSize + 1))
 	{
 		WLog_ERR(TAG, "Stream_EnsureRemainingCapacity failed!");
@@ -462,6 +791,26 @@ static BOOL zgfx_compress_segment(ZGFX_CONTEXT* zgfx, wStream* s, const BYTE* pS
 	}
 
 	(*pFlags) |= ZGFX_PACKET_COMPR_TYPE_RDP8; /* RDP 8.0 compression format */
+	/**
+	 * The segment is added to the history up front so matches may overlap the
+	 * current position. Only distances that are still intact in the ring once
+	 * the whole segment has been written are allowed.
+	 */
+	window = MIN(zgfx->HistoryValid, zgfx->HistoryBufferSize - SrcSize);
+	zgfx_history_buffer_ring_write(zgfx, pSrcData, SrcSize);
+	zgfx->HistoryValid = MIN(zgfx->HistoryValid + SrcSize, zgfx->HistoryBufferSize);
+
+	if ((zgfx->CompressionLevel > 0) && zgfx->HashHead && (SrcSize > ZGFX_MIN_MATCH_LENGTH))
+	{
+		if (zgfx_encode_segment(zgfx, Stream_Pointer(s) + 1, pSrcData, SrcSize, segmentIndex,
+		                        window, &DstSize))
+		{
+			Stream_Write_UINT8(s, (*pFlags) | PACKET_COMPRESSED); /* header (1 byte) */
+			Stream_Seek(s, DstSize);
+			return TRUE;
+		}
+	}
+
 	Stream_Write_UINT8(s, (*pFlags)); /* header (1 byte) */
 	Stream_Write(s, pSrcData, SrcSize);
 	return TRUE;
@@ -562,9 +911,58 @@ int zgfx_compress(ZGFX_CONTEXT* zgfx, const BYTE* pSrcData, UINT32 SrcSize, BYTE
 }
 
 
+void zgfx_set_compression_level(ZGFX_CONTEXT* zgfx, DWORD CompressionLevel)
+{
+	/* Level 0 disables compression, higher levels search deeper hash chains */
+	static const UINT32 chainLength[] = { 0, 4, 32, 256 };
+	static const UINT32 niceLength[] = { 0, 32, 258, ZGFX_SEGMENTED_MAXSIZE };
+
+	if (!zgfx)
+		return;
+
+	if (CompressionLevel > ZGFX_MAX_COMPRESSION_LEVEL)
+		CompressionLevel = ZGFX_MAX_COMPRESSION_LEVEL;
+
+	zgfx->CompressionLevel = CompressionLevel;
+	zgfx->MaxChainLength = chainLength[CompressionLevel];
+	zgfx->NiceMatchLength = niceLength[CompressionLevel];
+	zgfx->LazyMatching = (CompressionLevel > 1);
+}
+
 void zgfx_context_reset(ZGFX_CONTEXT* zgfx, BOOL flush)
 {
 	zgfx->HistoryIndex = 0;
+	zgfx->HistoryValid = 0;
+
+	if (zgfx->HashHead)
+		FillMemory(zgfx->HashHead, ZGFX_HASH_SIZE * sizeof(UINT32), 0xFF);
+}
+
+static void zgfx_init_literal_codes(ZGFX_CONTEXT* zgfx)
+{
+	int opIndex;
+	UINT32 c;
+
+	/* Default: prefix '0' followed by the 8 bit literal */
+	for (c = 0; c < 256; c++)
+	{
+		zgfx->LiteralCode[c] = c;
+		zgfx->LiteralBits[c] = 9;
+	}
+
+	for (opIndex = 0; ZGFX_TOKEN_TABLE[opIndex].prefixLength != 0; opIndex++)
+	{
+		const ZGFX_TOKEN* token = &ZGFX_TOKEN_TABLE[opIndex];
+
+		if ((token->tokenType != 0) || (token->valueBits != 0))
+			continue;
+
+		if (token->prefixLength < zgfx->LiteralBits[token->valueBase])
+		{
+			zgfx->LiteralCode[token->valueBase] = token->prefixCode;
+			zgfx->LiteralBits[token->valueBase] = token->prefixLength;
+		}
+	}
 }
 
 ZGFX_CONTEXT* zgfx_context_new(BOOL Compressor)
@@ -576,6 +974,22 @@ ZGFX_CONTEXT* zgfx_context_new(BOOL Compressor)
 	{
 		zgfx->Compressor = Compressor;
 		zgfx->HistoryBufferSize = sizeof(zgfx->HistoryBuffer);
+
+		if (Compressor)
+		{
+			zgfx->HashHead = (UINT32*) calloc(ZGFX_HASH_SIZE, sizeof(UINT32));
+			zgfx->HashChain = (UINT32*) calloc(zgfx->HistoryBufferSize, sizeof(UINT32));
+
+			if (!zgfx->HashHead || !zgfx->HashChain)
+			{
+				zgfx_context_free(zgfx);
+				return NULL;
+			}
+
+			zgfx_init_literal_codes(zgfx);
+			zgfx_set_compression_level(zgfx, ZGFX_DEFAULT_COMPRESSION_LEVEL);
+		}
+
 		zgfx_context_reset(zgfx, FALSE);
 	}
 
@@ -584,6 +998,12 @@ ZGFX_CONTEXT* zgfx_context_new(BOOL Compressor)
 
 void zgfx_context_free(ZGFX_CONTEXT* zgfx)
 {
+	if (zgfx)
+	{
+		free(zgfx->HashHead);
+		free(zgfx->HashChain);
+	}
+
 	free(zgfx);
 }
 
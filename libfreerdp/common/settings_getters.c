@@ -2291,6 +2291,9 @@ const char* freerdp_settings_get_string(rdpSettings* settings, size_t id)
 		case FreeRDP_RemoteApplicationWorkingDir:
 			return settings->RemoteApplicationWorkingDir;
 
+		case FreeRDP_BitmapCachePersistFile:
+			return settings->BitmapCachePersistFile;
+
 		case FreeRDP_ImeFileName:
 			return settings->ImeFileName;
 
@@ -2623,6 +2626,11 @@ BOOL freerdp_settings_set_string(rdpSettings* settings, size_t id, const char* v
 			settings->RemoteApplicationWorkingDir = _strdup(val);
 			return settings->RemoteApplicationWorkingDir != NULL;
 
+		case FreeRDP_BitmapCachePersistFile:
+			free(settings->BitmapCachePersistFile);
+			settings->BitmapCachePersistFile = _strdup(val);
+			return settings->BitmapCachePersistFile != NULL;
+
 		case FreeRDP_ImeFileName:
 			free(settings->ImeFileName);
 			settings->ImeFileName = _strdup(val);
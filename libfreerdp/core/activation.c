@@ -21,9 +21,13 @@
 #include "config.h"
 #endif
 
+#include <freerdp/cache/cache.h>
+
 #include "activation.h"
 #include "display.h"
 
+#include "../cache/bitmap.h"
+
 /*
 static const char* const CTRLACTION_STRINGS[] =
 {
@@ -152,36 +156,141 @@ BOOL rdp_send_client_control_pdu(rdpRdp* rdp, UINT16 action)
 	return rdp_send_data_pdu(rdp, s, DATA_PDU_TYPE_CONTROL, rdp->mcs->userId);
 }
 
-void rdp_write_persistent_list_entry(wStream* s, UINT32 key1, UINT32 key2)
+#define PERSIST_MAX_PDU_ENTRIES		169
+
+static void rdp_write_persistent_list_entry(wStream* s, UINT64 key64)
 {
-	Stream_Write_UINT32(s, key1); /* key1 (4 bytes) */
-	Stream_Write_UINT32(s, key2); /* key2 (4 bytes) */
+	Stream_Write_UINT32(s, (UINT32)(key64 & 0xFFFFFFFF)); /* key1 (4 bytes) */
+	Stream_Write_UINT32(s, (UINT32)(key64 >> 32)); /* key2 (4 bytes) */
 }
 
-void rdp_write_client_persistent_key_list_pdu(wStream* s, rdpSettings* settings)
+static void rdp_write_client_persistent_key_list_pdu(wStream* s, const UINT16* numEntries,
+        const UINT16* totalEntries, BYTE flags)
 {
-	Stream_Write_UINT16(s, 0); /* numEntriesCache0 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* numEntriesCache1 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* numEntriesCache2 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* numEntriesCache3 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* numEntriesCache4 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* totalEntriesCache0 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* totalEntriesCache1 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* totalEntriesCache2 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* totalEntriesCache3 (2 bytes) */
-	Stream_Write_UINT16(s, 0); /* totalEntriesCache4 (2 bytes) */
-	Stream_Write_UINT8(s, PERSIST_FIRST_PDU | PERSIST_LAST_PDU); /* bBitMask (1 byte) */
+	size_t i;
+
+	for (i = 0; i < PERSIST_MAX_CACHES; i++)
+		Stream_Write_UINT16(s, numEntries[i]); /* numEntriesCacheX (2 bytes) */
+
+	for (i = 0; i < PERSIST_MAX_CACHES; i++)
+		Stream_Write_UINT16(s, totalEntries[i]); /* totalEntriesCacheX (2 bytes) */
+
+	Stream_Write_UINT8(s, flags); /* bBitMask (1 byte) */
 	Stream_Write_UINT8(s, 0); /* pad1 (1 byte) */
 	Stream_Write_UINT16(s, 0); /* pad3 (2 bytes) */
-	/* entries */
 }
 
+/**
+ * Send the keys of the persistent bitmap cache, spread over as many PDUs as
+ * needed. The entries of all caches follow each other in cache order, the
+ * server assigns them to consecutive cache indices.
+ * On the first connection the keys are read from the cache file and kept until
+ * the bitmap cache loads the bitmaps, on a reconnect the bitmap cache exists.
+ * @msdn{cc240495}
+ */
+
 BOOL rdp_send_client_persistent_key_list_pdu(rdpRdp* rdp)
 {
-	wStream* s;
-	s = rdp_data_pdu_init(rdp);
-	rdp_write_client_persistent_key_list_pdu(s, rdp->settings);
-	return rdp_send_data_pdu(rdp, s, DATA_PDU_TYPE_BITMAP_CACHE_PERSISTENT_LIST, rdp->mcs->userId);
+	size_t i;
+	UINT32 sent = 0;
+	UINT32 total = 0;
+	UINT32 cacheId = 0;
+	UINT32 cacheIndex = 0;
+	UINT16 totalEntries[PERSIST_MAX_CACHES] = { 0 };
+	const UINT64* keys[PERSIST_MAX_CACHES] = { 0 };
+	rdpCache* cache = rdp->context->cache;
+
+	if (cache && cache->bitmap && cache->bitmap->persistent)
+	{
+		for (i = 0; i < PERSIST_MAX_CACHES; i++)
+		{
+			const UINT32 count = bitmap_cache_persist_get_keys(cache->bitmap, (UINT32) i, &keys[i]);
+			totalEntries[i] = (UINT16) MIN(count, UINT16_MAX);
+		}
+	}
+	else
+	{
+		for (i = 0; i < PERSIST_MAX_CACHES; i++)
+			free(rdp->persistentKeys[i]);
+
+		/* an empty list is sent if the cache file can not be read */
+		bitmap_cache_persist_read_keys(rdp->settings, rdp->persistentKeys,
+		                               rdp->persistentKeyCount, PERSIST_MAX_CACHES);
+
+		for (i = 0; i < PERSIST_MAX_CACHES; i++)
+		{
+			keys[i] = rdp->persistentKeys[i];
+			totalEntries[i] = (UINT16) MIN(rdp->persistentKeyCount[i], UINT16_MAX);
+		}
+	}
+
+	for (i = 0; i < PERSIST_MAX_CACHES; i++)
+		total += totalEntries[i];
+
+	do
+	{
+		wStream* s;
+		BYTE flags = 0;
+		UINT16 numEntries[PERSIST_MAX_CACHES] = { 0 };
+		const UINT32 count = MIN(total - sent, PERSIST_MAX_PDU_ENTRIES);
+		UINT32 remaining = count;
+		UINT32 id = cacheId;
+		UINT32 index = cacheIndex;
+
+		if (sent == 0)
+			flags |= PERSIST_FIRST_PDU;
+
+		if (sent + count == total)
+			flags |= PERSIST_LAST_PDU;
+
+		/* entries per cache in this PDU */
+		while (remaining > 0)
+		{
+			const UINT32 n = MIN(remaining, totalEntries[id] - index);
+			numEntries[id] = (UINT16) n;
+			remaining -= n;
+			index += n;
+
+			if (index == totalEntries[id])
+			{
+				id++;
+				index = 0;
+			}
+		}
+
+		s = rdp_data_pdu_init(rdp);
+
+		if (!s)
+			return FALSE;
+
+		if (!Stream_EnsureRemainingCapacity(s, 24 + count * 8ULL))
+		{
+			Stream_Release(s);
+			return FALSE;
+		}
+
+		rdp_write_client_persistent_key_list_pdu(s, numEntries, totalEntries, flags);
+
+		for (i = 0; i < count; i++)
+		{
+			while (cacheIndex >= totalEntries[cacheId])
+			{
+				cacheId++;
+				cacheIndex = 0;
+			}
+
+			rdp_write_persistent_list_entry(s, keys[cacheId][cacheIndex++]);
+		}
+
+		if (!rdp_send_data_pdu(rdp, s, DATA_PDU_TYPE_BITMAP_CACHE_PERSISTENT_LIST,
+		                       rdp->mcs->userId))
+			return FALSE;
+
+		sent += count;
+	}
+	while (sent < total);
+
+	return TRUE;
 }
 
 BOOL rdp_recv_client_font_list_pdu(wStream* s)
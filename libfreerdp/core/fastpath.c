@@ -1188,6 +1188,26 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 		Stream_SetPosition(fs, 0);
 		fastpath_write_update_pdu_header(fs, &fpUpdatePduHeader, rdp);
 		fastpath_write_update_header(fs, &fpUpdateHeader);
+
+		/* unencrypted fragments are sent from the update buffer directly */
+		if (!(rdp->sec_flags & SEC_ENCRYPT))
+		{
+			DataChunk chunks[2];
+			chunks[0].data = Stream_Buffer(fs);
+			chunks[0].size = Stream_GetPosition(fs);
+			chunks[1].data = pDstData;
+			chunks[1].size = DstSize;
+
+			if (transport_write_vector(rdp->transport, chunks, 2) < 0)
+			{
+				status = FALSE;
+				break;
+			}
+
+			Stream_Seek(s, SrcSize);
+			continue;
+		}
+
 		Stream_Write(fs, pDstData, DstSize);
 
 		if (pad)
@@ -45,6 +45,221 @@
 
 #define TAG FREERDP_TAG("core.message")
 
+/**
+ * Update Arena
+ *
+ * Orders queued for the update thread are bump-allocated from reference
+ * counted blocks instead of one heap allocation per structure. Every queued
+ * message holds a reference on its block, the decoding thread holds one on
+ * the current block until EndPaint retires it, so the orders of a frame are
+ * released together and the block is recycled once the last one was drawn.
+ */
+
+#define UPDATE_ARENA_BLOCK_SIZE		(64 * 1024)
+#define UPDATE_ARENA_ALIGNMENT		16
+#define UPDATE_ARENA_MAX_FREE_BLOCKS	8
+
+#define UPDATE_ARENA_ALIGN(_size) \
+	(((_size) + UPDATE_ARENA_ALIGNMENT - 1) & ~((size_t) UPDATE_ARENA_ALIGNMENT - 1))
+
+typedef struct rdp_update_arena_block rdpUpdateArenaBlock;
+
+struct rdp_update_arena_block
+{
+	rdpUpdateArena* arena;
+	rdpUpdateArenaBlock* next;
+	volatile LONG refs;
+	size_t size;
+	size_t used;
+};
+
+struct rdp_update_arena
+{
+	CRITICAL_SECTION lock;
+	rdpUpdateArenaBlock* current;
+	rdpUpdateArenaBlock* freeBlocks;
+	size_t freeCount;
+};
+
+#define UPDATE_ARENA_HEADER_SIZE UPDATE_ARENA_ALIGN(sizeof(rdpUpdateArenaBlock))
+
+/* blocks allocated by all arenas, cached ones included */
+static volatile LONG update_arena_blocks = 0;
+
+static void update_arena_block_free(rdpUpdateArenaBlock* block)
+{
+	if (!block)
+		return;
+
+	InterlockedDecrement(&update_arena_blocks);
+	_aligned_free(block);
+}
+
+static void update_arena_release(rdpUpdateArenaBlock* block)
+{
+	rdpUpdateArena* arena;
+
+	if (!block)
+		return;
+
+	if (InterlockedDecrement(&block->refs) > 0)
+		return;
+
+	arena = block->arena;
+	EnterCriticalSection(&arena->lock);
+
+	if ((block->size == UPDATE_ARENA_BLOCK_SIZE) &&
+	    (arena->freeCount < UPDATE_ARENA_MAX_FREE_BLOCKS))
+	{
+		block->next = arena->freeBlocks;
+		arena->freeBlocks = block;
+		arena->freeCount++;
+		block = NULL;
+	}
+
+	LeaveCriticalSection(&arena->lock);
+	update_arena_block_free(block);
+}
+
+static rdpUpdateArenaBlock* update_arena_block_new(rdpUpdateArena* arena, size_t size)
+{
+	rdpUpdateArenaBlock* block = NULL;
+
+	if (size <= UPDATE_ARENA_BLOCK_SIZE)
+	{
+		size = UPDATE_ARENA_BLOCK_SIZE;
+		EnterCriticalSection(&arena->lock);
+
+		if ((block = arena->freeBlocks))
+		{
+			arena->freeBlocks = block->next;
+			arena->freeCount--;
+		}
+
+		LeaveCriticalSection(&arena->lock);
+	}
+
+	if (!block)
+	{
+		block = (rdpUpdateArenaBlock*) _aligned_malloc(UPDATE_ARENA_HEADER_SIZE + size,
+		        UPDATE_ARENA_ALIGNMENT);
+
+		if (!block)
+			return NULL;
+
+		InterlockedIncrement(&update_arena_blocks);
+		block->arena = arena;
+		block->size = size;
+	}
+
+	block->next = NULL;
+	block->used = 0;
+	block->refs = 1;
+	return block;
+}
+
+/**
+ * Drops the decoding thread's reference on the current block, called at the
+ * end of every frame and when the block is exhausted.
+ */
+static void update_arena_retire(rdpUpdateArena* arena)
+{
+	rdpUpdateArenaBlock* block = arena->current;
+	arena->current = NULL;
+	update_arena_release(block);
+}
+
+/**
+ * Allocates size bytes for one queued message from the decoding thread.
+ * *pblock receives the block the message holds a reference on, to be passed
+ * as lParam and released with update_arena_release once the message is freed.
+ */
+static void* update_arena_alloc(rdpContext* context, size_t size, rdpUpdateArenaBlock** pblock)
+{
+	BYTE* ptr;
+	rdpUpdateArenaBlock* block;
+	rdpUpdateArena* arena;
+
+	if (!context->update->proxy)
+		return NULL;
+
+	arena = context->update->proxy->arena;
+	size = UPDATE_ARENA_ALIGN(size);
+
+	if (size > UPDATE_ARENA_BLOCK_SIZE)
+	{
+		/* oversized payloads get a block of their own, owned by the message */
+		if (!(block = update_arena_block_new(arena, size)))
+			return NULL;
+
+		*pblock = block;
+		return ((BYTE*) block) + UPDATE_ARENA_HEADER_SIZE;
+	}
+
+	block = arena->current;
+
+	if (!block || ((block->size - block->used) < size))
+	{
+		update_arena_retire(arena);
+
+		if (!(block = update_arena_block_new(arena, size)))
+			return NULL;
+
+		arena->current = block;
+	}
+
+	ptr = ((BYTE*) block) + UPDATE_ARENA_HEADER_SIZE + block->used;
+	block->used += size;
+	InterlockedIncrement(&block->refs);
+	*pblock = block;
+	return ptr;
+}
+
+static BOOL update_message_post_arena(rdpContext* context, DWORD id, void* wParam,
+                                      rdpUpdateArenaBlock* block)
+{
+	if (MessageQueue_Post(context->update->queue, (void*) context, id, wParam, (void*) block))
+		return TRUE;
+
+	update_arena_release(block);
+	return FALSE;
+}
+
+static rdpUpdateArena* update_arena_new(void)
+{
+	rdpUpdateArena* arena = (rdpUpdateArena*) calloc(1, sizeof(rdpUpdateArena));
+
+	if (!arena)
+		return NULL;
+
+	if (!InitializeCriticalSectionAndSpinCount(&arena->lock, 4000))
+	{
+		free(arena);
+		return NULL;
+	}
+
+	return arena;
+}
+
+static void update_arena_free(rdpUpdateArena* arena)
+{
+	rdpUpdateArenaBlock* block;
+
+	if (!arena)
+		return;
+
+	update_arena_retire(arena);
+
+	while ((block = arena->freeBlocks))
+	{
+		arena->freeBlocks = block->next;
+		update_arena_block_free(block);
+	}
+
+	DeleteCriticalSection(&arena->lock);
+	free(arena);
+}
+
 /* Update */
 
 static BOOL update_message_BeginPaint(rdpContext* context)
@@ -61,6 +276,9 @@ static BOOL update_message_EndPaint(rdpContext* context)
 	if (!context || !context->update)
 		return FALSE;
 
+	if (context->update->proxy)
+		update_arena_retire(context->update->proxy->arena);
+
 	return MessageQueue_Post(context->update->queue, (void*) context,
 	                         MakeMessageId(Update, EndPaint), NULL, NULL);
 }
@@ -69,13 +287,14 @@ static BOOL update_message_SetBounds(rdpContext* context,
                                      const rdpBounds* bounds)
 {
 	rdpBounds* wParam = NULL;
+	rdpUpdateArenaBlock* block = NULL;
 
 	if (!context || !context->update)
 		return FALSE;
 
 	if (bounds)
 	{
-		wParam = (rdpBounds*) malloc(sizeof(rdpBounds));
+		wParam = (rdpBounds*) update_arena_alloc(context, sizeof(rdpBounds), &block);
 
 		if (!wParam)
 			return FALSE;
@@ -83,8 +302,7 @@ static BOOL update_message_SetBounds(rdpContext* context,
 		CopyMemory(wParam, bounds, sizeof(rdpBounds));
 	}
 
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(Update, SetBounds), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(Update, SetBounds), wParam, block);
 }
 
 static BOOL update_message_Synchronize(rdpContext* context)
@@ -108,18 +326,49 @@ static BOOL update_message_DesktopResize(rdpContext* context)
 static BOOL update_message_BitmapUpdate(rdpContext* context,
                                         const BITMAP_UPDATE* bitmap)
 {
+	UINT32 index;
+	BYTE* data;
 	BITMAP_UPDATE* wParam;
+	rdpUpdateArenaBlock* block;
+	size_t size;
 
 	if (!context || !context->update || !bitmap)
 		return FALSE;
 
-	wParam = copy_bitmap_update(context, bitmap);
+	/* the update, its rectangles and their bitmap data are laid out in one allocation */
+	size = UPDATE_ARENA_ALIGN(sizeof(BITMAP_UPDATE)) +
+	       UPDATE_ARENA_ALIGN(sizeof(BITMAP_DATA) * bitmap->number);
+
+	for (index = 0; index < bitmap->number; index++)
+		size += UPDATE_ARENA_ALIGN(bitmap->rectangles[index].bitmapLength);
+
+	wParam = (BITMAP_UPDATE*) update_arena_alloc(context, size, &block);
 
 	if (!wParam)
 		return FALSE;
 
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(Update, BitmapUpdate), (void*) wParam, NULL);
+	CopyMemory(wParam, bitmap, sizeof(BITMAP_UPDATE));
+	wParam->count = bitmap->number;
+	wParam->rectangles = (BITMAP_DATA*)(((BYTE*) wParam) + UPDATE_ARENA_ALIGN(sizeof(BITMAP_UPDATE)));
+	data = ((BYTE*) wParam->rectangles) + UPDATE_ARENA_ALIGN(sizeof(BITMAP_DATA) * bitmap->number);
+
+	for (index = 0; index < bitmap->number; index++)
+	{
+		const BITMAP_DATA* src = &bitmap->rectangles[index];
+		BITMAP_DATA* dst = &wParam->rectangles[index];
+		CopyMemory(dst, src, sizeof(BITMAP_DATA));
+
+		if (src->bitmapLength > 0)
+		{
+			dst->bitmapDataStream = data;
+			CopyMemory(dst->bitmapDataStream, src->bitmapDataStream, src->bitmapLength);
+			data += UPDATE_ARENA_ALIGN(src->bitmapLength);
+		}
+		else
+			dst->bitmapDataStream = NULL;
+	}
+
+	return update_message_post_arena(context, MakeMessageId(Update, BitmapUpdate), wParam, block);
 }
 
 static BOOL update_message_Palette(rdpContext* context,
@@ -284,54 +533,54 @@ static BOOL update_message_SurfaceFrameAcknowledge(rdpContext* context, UINT32 f
 static BOOL update_message_DstBlt(rdpContext* context, const DSTBLT_ORDER* dstBlt)
 {
 	DSTBLT_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !dstBlt)
 		return FALSE;
 
-	wParam = (DSTBLT_ORDER*) malloc(sizeof(DSTBLT_ORDER));
+	wParam = (DSTBLT_ORDER*) update_arena_alloc(context, sizeof(DSTBLT_ORDER), &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, dstBlt, sizeof(DSTBLT_ORDER));
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, DstBlt), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, DstBlt), wParam, block);
 }
 
 static BOOL update_message_PatBlt(rdpContext* context, PATBLT_ORDER* patBlt)
 {
 	PATBLT_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !patBlt)
 		return FALSE;
 
-	wParam = (PATBLT_ORDER*) malloc(sizeof(PATBLT_ORDER));
+	wParam = (PATBLT_ORDER*) update_arena_alloc(context, sizeof(PATBLT_ORDER), &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, patBlt, sizeof(PATBLT_ORDER));
 	wParam->brush.data = (BYTE*) wParam->brush.p8x8;
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, PatBlt), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, PatBlt), wParam, block);
 }
 
 static BOOL update_message_ScrBlt(rdpContext* context,
                                   const SCRBLT_ORDER* scrBlt)
 {
 	SCRBLT_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !scrBlt)
 		return FALSE;
 
-	wParam = (SCRBLT_ORDER*) malloc(sizeof(SCRBLT_ORDER));
+	wParam = (SCRBLT_ORDER*) update_arena_alloc(context, sizeof(SCRBLT_ORDER), &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, scrBlt, sizeof(SCRBLT_ORDER));
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, ScrBlt), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, ScrBlt), wParam, block);
 }
 
 static BOOL update_message_OpaqueRect(
@@ -339,18 +588,18 @@ static BOOL update_message_OpaqueRect(
     const OPAQUE_RECT_ORDER* opaqueRect)
 {
 	OPAQUE_RECT_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !opaqueRect)
 		return FALSE;
 
-	wParam = (OPAQUE_RECT_ORDER*) malloc(sizeof(OPAQUE_RECT_ORDER));
+	wParam = (OPAQUE_RECT_ORDER*) update_arena_alloc(context, sizeof(OPAQUE_RECT_ORDER), &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, opaqueRect, sizeof(OPAQUE_RECT_ORDER));
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, OpaqueRect), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, OpaqueRect), wParam, block);
 }
 
 static BOOL update_message_DrawNineGrid(
@@ -358,73 +607,73 @@ static BOOL update_message_DrawNineGrid(
     const DRAW_NINE_GRID_ORDER* drawNineGrid)
 {
 	DRAW_NINE_GRID_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !drawNineGrid)
 		return FALSE;
 
-	wParam = (DRAW_NINE_GRID_ORDER*) malloc(sizeof(DRAW_NINE_GRID_ORDER));
+	wParam = (DRAW_NINE_GRID_ORDER*) update_arena_alloc(context, sizeof(DRAW_NINE_GRID_ORDER), &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, drawNineGrid, sizeof(DRAW_NINE_GRID_ORDER));
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, DrawNineGrid), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, DrawNineGrid), wParam, block);
 }
 
 static BOOL update_message_MultiDstBlt(rdpContext* context,
                                        const MULTI_DSTBLT_ORDER* multiDstBlt)
 {
 	MULTI_DSTBLT_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !multiDstBlt)
 		return FALSE;
 
-	wParam = (MULTI_DSTBLT_ORDER*) malloc(sizeof(MULTI_DSTBLT_ORDER));
+	wParam = (MULTI_DSTBLT_ORDER*) update_arena_alloc(context, sizeof(MULTI_DSTBLT_ORDER), &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, multiDstBlt, sizeof(MULTI_DSTBLT_ORDER));
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, MultiDstBlt), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, MultiDstBlt), wParam, block);
 }
 
 static BOOL update_message_MultiPatBlt(rdpContext* context,
                                        const MULTI_PATBLT_ORDER* multiPatBlt)
 {
 	MULTI_PATBLT_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !multiPatBlt)
 		return FALSE;
 
-	wParam = (MULTI_PATBLT_ORDER*) malloc(sizeof(MULTI_PATBLT_ORDER));
+	wParam = (MULTI_PATBLT_ORDER*) update_arena_alloc(context, sizeof(MULTI_PATBLT_ORDER), &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, multiPatBlt, sizeof(MULTI_PATBLT_ORDER));
 	wParam->brush.data = (BYTE*) wParam->brush.p8x8;
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, MultiPatBlt), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, MultiPatBlt), wParam, block);
 }
 
 static BOOL update_message_MultiScrBlt(rdpContext* context,
                                        const MULTI_SCRBLT_ORDER* multiScrBlt)
 {
 	MULTI_SCRBLT_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !multiScrBlt)
 		return FALSE;
 
-	wParam = (MULTI_SCRBLT_ORDER*) malloc(sizeof(MULTI_SCRBLT_ORDER));
+	wParam = (MULTI_SCRBLT_ORDER*) update_arena_alloc(context, sizeof(MULTI_SCRBLT_ORDER), &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, multiScrBlt, sizeof(MULTI_SCRBLT_ORDER));
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, MultiScrBlt), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, MultiScrBlt), wParam, block);
 }
 
 static BOOL update_message_MultiOpaqueRect(
@@ -432,183 +681,184 @@ static BOOL update_message_MultiOpaqueRect(
     const MULTI_OPAQUE_RECT_ORDER* multiOpaqueRect)
 {
 	MULTI_OPAQUE_RECT_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !multiOpaqueRect)
 		return FALSE;
 
-	wParam = (MULTI_OPAQUE_RECT_ORDER*) malloc(sizeof(MULTI_OPAQUE_RECT_ORDER));
+	wParam = (MULTI_OPAQUE_RECT_ORDER*) update_arena_alloc(context, sizeof(MULTI_OPAQUE_RECT_ORDER), &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, multiOpaqueRect, sizeof(MULTI_OPAQUE_RECT_ORDER));
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, MultiOpaqueRect), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, MultiOpaqueRect), wParam, block);
 }
 
 static BOOL update_message_MultiDrawNineGrid(rdpContext* context,
         const MULTI_DRAW_NINE_GRID_ORDER* multiDrawNineGrid)
 {
 	MULTI_DRAW_NINE_GRID_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !multiDrawNineGrid)
 		return FALSE;
 
-	wParam = (MULTI_DRAW_NINE_GRID_ORDER*) malloc(sizeof(MULTI_DRAW_NINE_GRID_ORDER));
+	wParam = (MULTI_DRAW_NINE_GRID_ORDER*) update_arena_alloc(context, sizeof(MULTI_DRAW_NINE_GRID_ORDER), &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, multiDrawNineGrid, sizeof(MULTI_DRAW_NINE_GRID_ORDER));
 	/* TODO: complete copy */
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, MultiDrawNineGrid), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, MultiDrawNineGrid), wParam, block);
 }
 
 static BOOL update_message_LineTo(rdpContext* context,
                                   const LINE_TO_ORDER* lineTo)
 {
 	LINE_TO_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !lineTo)
 		return FALSE;
 
-	wParam = (LINE_TO_ORDER*) malloc(sizeof(LINE_TO_ORDER));
+	wParam = (LINE_TO_ORDER*) update_arena_alloc(context, sizeof(LINE_TO_ORDER), &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, lineTo, sizeof(LINE_TO_ORDER));
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, LineTo), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, LineTo), wParam, block);
 }
 
 static BOOL update_message_Polyline(rdpContext* context,
                                     const POLYLINE_ORDER* polyline)
 {
 	POLYLINE_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !polyline)
 		return FALSE;
 
-	wParam = (POLYLINE_ORDER*) malloc(sizeof(POLYLINE_ORDER));
+	wParam = (POLYLINE_ORDER*) update_arena_alloc(context,
+	         UPDATE_ARENA_ALIGN(sizeof(POLYLINE_ORDER)) +
+	         sizeof(DELTA_POINT) * polyline->numDeltaEntries, &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, polyline, sizeof(POLYLINE_ORDER));
-	wParam->points = (DELTA_POINT*) calloc(wParam->numDeltaEntries, sizeof(DELTA_POINT));
-
-	if (!wParam->points)
-	{
-		free(wParam);
-		return FALSE;
-	}
-
+	wParam->points = (DELTA_POINT*)(((BYTE*) wParam) + UPDATE_ARENA_ALIGN(sizeof(POLYLINE_ORDER)));
 	CopyMemory(wParam->points, polyline->points, sizeof(DELTA_POINT) * wParam->numDeltaEntries);
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, Polyline), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, Polyline), wParam, block);
 }
 
 static BOOL update_message_MemBlt(rdpContext* context, MEMBLT_ORDER* memBlt)
 {
 	MEMBLT_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !memBlt)
 		return FALSE;
 
-	wParam = (MEMBLT_ORDER*) malloc(sizeof(MEMBLT_ORDER));
+	wParam = (MEMBLT_ORDER*) update_arena_alloc(context, sizeof(MEMBLT_ORDER), &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, memBlt, sizeof(MEMBLT_ORDER));
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, MemBlt), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, MemBlt), wParam, block);
 }
 
 static BOOL update_message_Mem3Blt(rdpContext* context, MEM3BLT_ORDER* mem3Blt)
 {
 	MEM3BLT_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !mem3Blt)
 		return FALSE;
 
-	wParam = (MEM3BLT_ORDER*) malloc(sizeof(MEM3BLT_ORDER));
+	wParam = (MEM3BLT_ORDER*) update_arena_alloc(context, sizeof(MEM3BLT_ORDER), &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, mem3Blt, sizeof(MEM3BLT_ORDER));
 	wParam->brush.data = (BYTE*) wParam->brush.p8x8;
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, Mem3Blt), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, Mem3Blt), wParam, block);
 }
 
 static BOOL update_message_SaveBitmap(rdpContext* context,
                                       const SAVE_BITMAP_ORDER* saveBitmap)
 {
 	SAVE_BITMAP_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !saveBitmap)
 		return FALSE;
 
-	wParam = (SAVE_BITMAP_ORDER*) malloc(sizeof(SAVE_BITMAP_ORDER));
+	wParam = (SAVE_BITMAP_ORDER*) update_arena_alloc(context, sizeof(SAVE_BITMAP_ORDER), &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, saveBitmap, sizeof(SAVE_BITMAP_ORDER));
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, SaveBitmap), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, SaveBitmap), wParam, block);
 }
 
 static BOOL update_message_GlyphIndex(rdpContext* context,
                                       GLYPH_INDEX_ORDER* glyphIndex)
 {
 	GLYPH_INDEX_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !glyphIndex)
 		return FALSE;
 
-	wParam = (GLYPH_INDEX_ORDER*) malloc(sizeof(GLYPH_INDEX_ORDER));
+	wParam = (GLYPH_INDEX_ORDER*) update_arena_alloc(context, sizeof(GLYPH_INDEX_ORDER), &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, glyphIndex, sizeof(GLYPH_INDEX_ORDER));
 	wParam->brush.data = (BYTE*) wParam->brush.p8x8;
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, GlyphIndex), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, GlyphIndex), wParam, block);
 }
 
 static BOOL update_message_FastIndex(rdpContext* context,
                                      const FAST_INDEX_ORDER* fastIndex)
 {
 	FAST_INDEX_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !fastIndex)
 		return FALSE;
 
-	wParam = (FAST_INDEX_ORDER*) malloc(sizeof(FAST_INDEX_ORDER));
+	wParam = (FAST_INDEX_ORDER*) update_arena_alloc(context, sizeof(FAST_INDEX_ORDER), &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, fastIndex, sizeof(FAST_INDEX_ORDER));
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, FastIndex), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, FastIndex), wParam, block);
 }
 
 static BOOL update_message_FastGlyph(rdpContext* context,
                                      const FAST_GLYPH_ORDER* fastGlyph)
 {
 	FAST_GLYPH_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
+	size_t cb = 0;
 
 	if (!context || !context->update || !fastGlyph)
 		return FALSE;
 
-	wParam = (FAST_GLYPH_ORDER*) malloc(sizeof(FAST_GLYPH_ORDER));
+	if (fastGlyph->cbData > 1)
+		cb = fastGlyph->glyphData.cb;
+
+	wParam = (FAST_GLYPH_ORDER*) update_arena_alloc(context,
+	         UPDATE_ARENA_ALIGN(sizeof(FAST_GLYPH_ORDER)) + cb, &block);
 
 	if (!wParam)
 		return FALSE;
@@ -617,114 +867,96 @@ static BOOL update_message_FastGlyph(rdpContext* context,
 
 	if (wParam->cbData > 1)
 	{
-		wParam->glyphData.aj = (BYTE*) malloc(fastGlyph->glyphData.cb);
-
-		if (!wParam->glyphData.aj)
-		{
-			free(wParam);
-			return FALSE;
-		}
-
-		CopyMemory(wParam->glyphData.aj, fastGlyph->glyphData.aj, fastGlyph->glyphData.cb);
+		wParam->glyphData.aj = ((BYTE*) wParam) + UPDATE_ARENA_ALIGN(sizeof(FAST_GLYPH_ORDER));
+		CopyMemory(wParam->glyphData.aj, fastGlyph->glyphData.aj, cb);
 	}
 	else
 	{
 		wParam->glyphData.aj = NULL;
 	}
 
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, FastGlyph), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, FastGlyph), wParam, block);
 }
 
 static BOOL update_message_PolygonSC(rdpContext* context,
                                      const POLYGON_SC_ORDER* polygonSC)
 {
 	POLYGON_SC_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !polygonSC)
 		return FALSE;
 
-	wParam = (POLYGON_SC_ORDER*) malloc(sizeof(POLYGON_SC_ORDER));
+	wParam = (POLYGON_SC_ORDER*) update_arena_alloc(context,
+	         UPDATE_ARENA_ALIGN(sizeof(POLYGON_SC_ORDER)) +
+	         sizeof(DELTA_POINT) * polygonSC->numPoints, &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, polygonSC, sizeof(POLYGON_SC_ORDER));
-	wParam->points = (DELTA_POINT*) calloc(wParam->numPoints, sizeof(DELTA_POINT));
-
-	if (!wParam->points)
-	{
-		free(wParam);
-		return FALSE;
-	}
-
-	CopyMemory(wParam->points, polygonSC, sizeof(DELTA_POINT) * wParam->numPoints);
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, PolygonSC), (void*) wParam, NULL);
+	wParam->points = (DELTA_POINT*)(((BYTE*) wParam) + UPDATE_ARENA_ALIGN(sizeof(POLYGON_SC_ORDER)));
+	CopyMemory(wParam->points, polygonSC->points, sizeof(DELTA_POINT) * wParam->numPoints);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, PolygonSC), wParam, block);
 }
 
 static BOOL update_message_PolygonCB(rdpContext* context, POLYGON_CB_ORDER* polygonCB)
 {
 	POLYGON_CB_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !polygonCB)
 		return FALSE;
 
-	wParam = (POLYGON_CB_ORDER*) malloc(sizeof(POLYGON_CB_ORDER));
+	wParam = (POLYGON_CB_ORDER*) update_arena_alloc(context,
+	         UPDATE_ARENA_ALIGN(sizeof(POLYGON_CB_ORDER)) +
+	         sizeof(DELTA_POINT) * polygonCB->numPoints, &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, polygonCB, sizeof(POLYGON_CB_ORDER));
-	wParam->points = (DELTA_POINT*) calloc(wParam->numPoints, sizeof(DELTA_POINT));
-
-	if (!wParam->points)
-	{
-		free(wParam);
-		return FALSE;
-	}
-
-	CopyMemory(wParam->points, polygonCB, sizeof(DELTA_POINT) * wParam->numPoints);
+	wParam->points = (DELTA_POINT*)(((BYTE*) wParam) + UPDATE_ARENA_ALIGN(sizeof(POLYGON_CB_ORDER)));
+	CopyMemory(wParam->points, polygonCB->points, sizeof(DELTA_POINT) * wParam->numPoints);
 	wParam->brush.data = (BYTE*) wParam->brush.p8x8;
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, PolygonCB), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, PolygonCB), wParam, block);
 }
 
 static BOOL update_message_EllipseSC(rdpContext* context,
                                      const ELLIPSE_SC_ORDER* ellipseSC)
 {
 	ELLIPSE_SC_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !ellipseSC)
 		return FALSE;
 
-	wParam = (ELLIPSE_SC_ORDER*) malloc(sizeof(ELLIPSE_SC_ORDER));
+	wParam = (ELLIPSE_SC_ORDER*) update_arena_alloc(context, sizeof(ELLIPSE_SC_ORDER), &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, ellipseSC, sizeof(ELLIPSE_SC_ORDER));
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, EllipseSC), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, EllipseSC), wParam, block);
 }
 
 static BOOL update_message_EllipseCB(rdpContext* context,
                                      const ELLIPSE_CB_ORDER* ellipseCB)
 {
 	ELLIPSE_CB_ORDER* wParam;
+	rdpUpdateArenaBlock* block;
 
 	if (!context || !context->update || !ellipseCB)
 		return FALSE;
 
-	wParam = (ELLIPSE_CB_ORDER*) malloc(sizeof(ELLIPSE_CB_ORDER));
+	wParam = (ELLIPSE_CB_ORDER*) update_arena_alloc(context, sizeof(ELLIPSE_CB_ORDER), &block);
 
 	if (!wParam)
 		return FALSE;
 
 	CopyMemory(wParam, ellipseCB, sizeof(ELLIPSE_CB_ORDER));
 	wParam->brush.data = (BYTE*) wParam->brush.p8x8;
-	return MessageQueue_Post(context->update->queue, (void*) context,
-	                         MakeMessageId(PrimaryUpdate, EllipseCB), (void*) wParam, NULL);
+	return update_message_post_arena(context, MakeMessageId(PrimaryUpdate, EllipseCB), wParam, block);
 }
 
 /* Secondary Update */
@@ -1516,7 +1748,7 @@ static BOOL update_message_free_update_class(wMessage* msg, int type)
 			break;
 
 		case Update_SetBounds:
-			free(msg->wParam);
+			update_arena_release((rdpUpdateArenaBlock*) msg->lParam);
 			break;
 
 		case Update_Synchronize:
@@ -1526,10 +1758,7 @@ static BOOL update_message_free_update_class(wMessage* msg, int type)
 			break;
 
 		case Update_BitmapUpdate:
-			{
-				BITMAP_UPDATE* wParam = (BITMAP_UPDATE*) msg->wParam;
-				free_bitmap_update(context, wParam);
-			}
+			update_arena_release((rdpUpdateArenaBlock*) msg->lParam);
 			break;
 
 		case Update_Palette:
@@ -1676,120 +1905,14 @@ static BOOL update_message_free_primary_update_class(wMessage* msg, int type)
 	if (!msg)
 		return FALSE;
 
-	switch (type)
-	{
-		case PrimaryUpdate_DstBlt:
-			free(msg->wParam);
-			break;
-
-		case PrimaryUpdate_PatBlt:
-			free(msg->wParam);
-			break;
-
-		case PrimaryUpdate_ScrBlt:
-			free(msg->wParam);
-			break;
-
-		case PrimaryUpdate_OpaqueRect:
-			free(msg->wParam);
-			break;
-
-		case PrimaryUpdate_DrawNineGrid:
-			free(msg->wParam);
-			break;
-
-		case PrimaryUpdate_MultiDstBlt:
-			free(msg->wParam);
-			break;
-
-		case PrimaryUpdate_MultiPatBlt:
-			free(msg->wParam);
-			break;
-
-		case PrimaryUpdate_MultiScrBlt:
-			free(msg->wParam);
-			break;
-
-		case PrimaryUpdate_MultiOpaqueRect:
-			free(msg->wParam);
-			break;
-
-		case PrimaryUpdate_MultiDrawNineGrid:
-			free(msg->wParam);
-			break;
-
-		case PrimaryUpdate_LineTo:
-			free(msg->wParam);
-			break;
-
-		case PrimaryUpdate_Polyline:
-			{
-				POLYLINE_ORDER* wParam = (POLYLINE_ORDER*) msg->wParam;
-				free(wParam->points);
-				free(wParam);
-			}
-			break;
-
-		case PrimaryUpdate_MemBlt:
-			free(msg->wParam);
-			break;
-
-		case PrimaryUpdate_Mem3Blt:
-			free(msg->wParam);
-			break;
-
-		case PrimaryUpdate_SaveBitmap:
-			free(msg->wParam);
-			break;
-
-		case PrimaryUpdate_GlyphIndex:
-			free(msg->wParam);
-			break;
-
-		case PrimaryUpdate_FastIndex:
-			free(msg->wParam);
-			break;
-
-		case PrimaryUpdate_FastGlyph:
-			{
-				FAST_GLYPH_ORDER* wParam = (FAST_GLYPH_ORDER*) msg->wParam;
-				free(wParam->glyphData.aj);
-				free(wParam);
-			}
-			break;
-
-		case PrimaryUpdate_PolygonSC:
-			{
-				POLYGON_SC_ORDER* wParam = (POLYGON_SC_ORDER*) msg->wParam;
-				free(wParam->points);
-				free(wParam);
-			}
-			break;
-
-		case PrimaryUpdate_PolygonCB:
-			{
-				POLYGON_CB_ORDER* wParam = (POLYGON_CB_ORDER*) msg->wParam;
-				free(wParam->points);
-				free(wParam);
-			}
-			break;
-
-		case PrimaryUpdate_EllipseSC:
-			free(msg->wParam);
-			break;
-
-		case PrimaryUpdate_EllipseCB:
-			free(msg->wParam);
-			break;
-
-		default:
-			return FALSE;
-	}
+	if ((type < PrimaryUpdate_DstBlt) || (type > PrimaryUpdate_EllipseCB))
+		return FALSE;
 
+	/* the order and its points or glyph data share one arena allocation */
+	update_arena_release((rdpUpdateArenaBlock*) msg->lParam);
 	return TRUE;
 }
 
-
 static BOOL update_message_process_primary_update_class(rdpUpdateProxy* proxy, wMessage* msg,
         int type)
 {
@@ -2675,6 +2798,15 @@ static DWORD WINAPI update_message_proxy_thread(LPVOID arg)
 	return 0;
 }
 
+/**
+ * Returns the number of update arena blocks currently allocated in the
+ * process, including the ones cached for reuse. Meant for leak checks.
+ */
+LONG update_message_arena_blocks(void)
+{
+	return InterlockedCompareExchange(&update_arena_blocks, 0, 0);
+}
+
 rdpUpdateProxy* update_message_proxy_new(rdpUpdate* update)
 {
 	rdpUpdateProxy* message;
@@ -2686,12 +2818,20 @@ rdpUpdateProxy* update_message_proxy_new(rdpUpdate* update)
 		return NULL;
 
 	message->update = update;
+
+	if (!(message->arena = update_arena_new()))
+	{
+		free(message);
+		return NULL;
+	}
+
 	update_message_register_interface(message, update);
 
 	if (!(message->thread = CreateThread(NULL, 0, update_message_proxy_thread,
 	                                     update, 0, NULL)))
 	{
 		WLog_ERR(TAG, "Failed to create proxy thread");
+		update_arena_free(message->arena);
 		free(message);
 		return NULL;
 	}
@@ -2706,7 +2846,10 @@ void update_message_proxy_free(rdpUpdateProxy* message)
 		if (MessageQueue_PostQuit(message->update->queue, 0))
 			WaitForSingleObject(message->thread, INFINITE);
 
+		/* pending orders reference the arena, drop them before it goes away */
+		MessageQueue_Clear(message->update->queue);
 		CloseHandle(message->thread);
+		update_arena_free(message->arena);
 		free(message);
 	}
 }
@@ -30,9 +30,12 @@
 
 /* Update Proxy Interface */
 
+typedef struct rdp_update_arena rdpUpdateArena;
+
 struct rdp_update_proxy
 {
 	rdpUpdate* update;
+	rdpUpdateArena* arena;
 
 	/* Update */
 
@@ -136,6 +139,7 @@ FREERDP_LOCAL int update_message_queue_process_pending_messages(
 
 FREERDP_LOCAL rdpUpdateProxy* update_message_proxy_new(rdpUpdate* update);
 FREERDP_LOCAL void update_message_proxy_free(rdpUpdateProxy* message);
+FREERDP_LOCAL LONG update_message_arena_blocks(void);
 
 /**
  * Input Message Queue
@@ -21,14 +21,66 @@
 #include "config.h"
 #endif
 
+#include <winpr/crt.h>
+#include <winpr/thread.h>
+#include <winpr/crypto.h>
+#include <winpr/sysinfo.h>
+
+#include <openssl/pem.h>
+#include <openssl/err.h>
+
+#include <freerdp/log.h>
+#include <freerdp/crypto/crypto.h>
+#include <freerdp/crypto/tls.h>
+
 #include "multitransport.h"
+#include "transport.h"
+#include "../crypto/opensslcompat.h"
+
+#define TAG FREERDP_TAG("core.multitransport")
+
+#define BIO_TYPE_MULTITRANSPORT		(67 | BIO_TYPE_SOURCE_SINK)
+
+/* a tunnel PDU must fit a single DTLS record, which must fit a single datagram */
+#define MULTITRANSPORT_MAX_LOSSY_DATA	1000
+#define MULTITRANSPORT_MAX_DATA		16000
+#define MULTITRANSPORT_POLL_INTERVAL	50
+
+static BOOL rdp_send_multitransport_response(rdpRdp* rdp, UINT32 requestId, UINT32 hrResponse)
+{
+	wStream* s = rdp_message_channel_pdu_init(rdp);
+
+	if (!s)
+		return FALSE;
+
+	Stream_Write_UINT32(s, requestId); /* requestId (4 bytes) */
+	Stream_Write_UINT32(s, hrResponse); /* hrResponse (4 bytes) */
+	return rdp_send_message_channel_pdu(rdp, s, SEC_TRANSPORT_RSP);
+}
+
+static BOOL rdp_send_multitransport_request(rdpRdp* rdp, UINT32 requestId,
+        UINT16 requestedProtocol, const BYTE* securityCookie)
+{
+	wStream* s = rdp_message_channel_pdu_init(rdp);
+
+	if (!s)
+		return FALSE;
+
+	Stream_Write_UINT32(s, requestId); /* requestId (4 bytes) */
+	Stream_Write_UINT16(s, requestedProtocol); /* requestedProtocol (2 bytes) */
+	Stream_Write_UINT16(s, 0); /* reserved (2 bytes) */
+	Stream_Write(s, securityCookie, 16); /* securityCookie (16 bytes) */
+	return rdp_send_message_channel_pdu(rdp, s, SEC_TRANSPORT_REQ);
+}
 
 int rdp_recv_multitransport_packet(rdpRdp* rdp, wStream* s)
 {
 	UINT32 requestId;
 	UINT16 requestedProtocol;
 	UINT16 reserved;
+	UINT32 transportType;
 	BYTE securityCookie[16];
+	rdpSettings* settings = rdp->settings;
 
 	if (Stream_GetRemainingLength(s) < 24)
 		return -1;
@@ -37,16 +89,886 @@ int rdp_recv_multitransport_packet(rdpRdp* rdp, wStream* s)
 	Stream_Read_UINT16(s, requestedProtocol); /* requestedProtocol (2 bytes) */
 	Stream_Read_UINT16(s, reserved); /* reserved (2 bytes) */
 	Stream_Read(s, securityCookie, 16); /* securityCookie (16 bytes) */
+	transportType = (requestedProtocol == INITITATE_REQUEST_PROTOCOL_UDPFECL) ?
+	                TRANSPORT_TYPE_UDP_FECL : TRANSPORT_TYPE_UDP_FECR;
+
+	/**
+	 * Without a consumer for RDP_TUNNEL_DATA the server could move dynamic
+	 * channel traffic onto a tunnel that drops it, so keep everything on TCP.
+	 */
+	if (!settings->SupportMultitransport || !(settings->MultitransportFlags & transportType) ||
+	    !rdp->multitransport->TunnelData)
+	{
+		WLog_DBG(TAG, "declining multitransport request 0x%08"PRIX32"", requestId);
+		return rdp_send_multitransport_response(rdp, requestId,
+		                                        MULTITRANSPORT_HR_E_ABORT) ? 0 : -1;
+	}
+
+	/* the tunnel is set up in the background, failures are reported from there */
+	rdp->multitransport->sendResponse = TRUE;
+
+	if (!multitransport_connect(rdp->multitransport, requestId, requestedProtocol, securityCookie))
+		return rdp_send_multitransport_response(rdp, requestId,
+		                                        MULTITRANSPORT_HR_E_ABORT) ? 0 : -1;
+
+	return 0;
+}
+
+int rdp_recv_multitransport_response_packet(rdpRdp* rdp, wStream* s)
+{
+	UINT32 requestId;
+	UINT32 hrResponse;
+	rdpMultitransport* multitransport = rdp->multitransport;
+
+	if (Stream_GetRemainingLength(s) < 8)
+		return -1;
+
+	Stream_Read_UINT32(s, requestId); /* requestId (4 bytes) */
+	Stream_Read_UINT32(s, hrResponse); /* hrResponse (4 bytes) */
+
+	if ((requestId == multitransport->requestId) && (hrResponse != MULTITRANSPORT_HR_S_OK))
+	{
+		WLog_INFO(TAG, "client declined multitransport request 0x%08"PRIX32": 0x%08"PRIX32"",
+		          requestId, hrResponse);
+		multitransport_close(multitransport);
+	}
+
+	return 0;
+}
+
+static int bio_multitransport_write(BIO* bio, const char* buf, int size)
+{
+	rdpMultitransport* multitransport = (rdpMultitransport*) BIO_get_data(bio);
+	BIO_clear_flags(bio, BIO_FLAGS_WRITE | BIO_FLAGS_SHOULD_RETRY);
+
+	if (!buf || (size <= 0))
+		return 0;
+
+	if (!rdpudp_write(multitransport->udp, (const BYTE*) buf, (size_t) size))
+		return -1;
+
+	return size;
+}
+
+static int bio_multitransport_read(BIO* bio, char* buf, int size)
+{
+	size_t length;
+	rdpMultitransport* multitransport = (rdpMultitransport*) BIO_get_data(bio);
+	BIO_clear_flags(bio, BIO_FLAGS_READ | BIO_FLAGS_SHOULD_RETRY);
+
+	if (!buf || (size <= 0))
+		return 0;
+
+	if (!multitransport->pending)
+		multitransport->pending = (wStream*) Queue_Dequeue(multitransport->receiveQueue);
+
+	if (!multitransport->pending)
+	{
+		BIO_set_flags(bio, BIO_FLAGS_READ | BIO_FLAGS_SHOULD_RETRY);
+		return -1;
+	}
+
+	length = MIN(Stream_GetRemainingLength(multitransport->pending), (size_t) size);
+	Stream_Read(multitransport->pending, buf, length);
+
+	/* DTLS reads whole datagrams, a truncated one is gone */
+	if (multitransport->lossy || (Stream_GetRemainingLength(multitransport->pending) == 0))
+	{
+		Stream_Free(multitransport->pending, TRUE);
+		multitransport->pending = NULL;
+	}
+
+	return (int) length;
+}
+
+static long bio_multitransport_ctrl(BIO* bio, int cmd, long arg1, void* arg2)
+{
+	WINPR_UNUSED(bio);
+	WINPR_UNUSED(arg1);
+	WINPR_UNUSED(arg2);
+
+	switch (cmd)
+	{
+		case BIO_CTRL_FLUSH:
+			return 1;
+#if !defined(OPENSSL_NO_DGRAM)
+
+		case BIO_CTRL_DGRAM_QUERY_MTU:
+		case BIO_CTRL_DGRAM_GET_FALLBACK_MTU:
+			return RDPUDP_MAX_PAYLOAD;
+#endif
+
+		default:
+			return 0;
+	}
+}
+
+static BIO_METHOD* BIO_s_multitransport(void)
+{
+	static BIO_METHOD* bio_methods = NULL;
+
+	if (bio_methods == NULL)
+	{
+		if (!(bio_methods = BIO_meth_new(BIO_TYPE_MULTITRANSPORT, "Multitransport")))
+			return NULL;
+
+		BIO_meth_set_write(bio_methods, bio_multitransport_write);
+		BIO_meth_set_read(bio_methods, bio_multitransport_read);
+		BIO_meth_set_ctrl(bio_methods, bio_multitransport_ctrl);
+	}
+
+	return bio_methods;
+}
+
+static BOOL multitransport_udp_receive(void* context, const BYTE* data, size_t length)
+{
+	rdpMultitransport* multitransport = (rdpMultitransport*) context;
+	wStream* s = Stream_New(NULL, length ? length : 1);
+
+	if (!s)
+		return FALSE;
+
+	Stream_Write(s, data, length);
+	Stream_SealLength(s);
+	Stream_SetPosition(s, 0);
+
+	if (!Queue_Enqueue(multitransport->receiveQueue, s))
+	{
+		Stream_Free(s, TRUE);
+		return FALSE;
+	}
+
+	return SetEvent(multitransport->readEvent);
+}
+
+static BOOL multitransport_load_identity(rdpMultitransport* multitransport)
+{
+	BIO* bio;
+	X509* x509;
+	EVP_PKEY* key;
+	BOOL rc = FALSE;
+	rdpSettings* settings = multitransport->rdp->settings;
+
+	if (settings->PrivateKeyFile)
+		bio = BIO_new_file(settings->PrivateKeyFile, "rb");
+	else if (settings->PrivateKeyContent)
+		bio = BIO_new_mem_buf(settings->PrivateKeyContent, strlen(settings->PrivateKeyContent));
+	else
+		bio = NULL;
+
+	if (!bio)
+	{
+		WLog_ERR(TAG, "no private key defined");
+		return FALSE;
+	}
+
+	key = PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL);
+	BIO_free_all(bio);
+
+	if (settings->CertificateFile)
+		bio = BIO_new_file(settings->CertificateFile, "rb");
+	else if (settings->CertificateContent)
+		bio = BIO_new_mem_buf(settings->CertificateContent, strlen(settings->CertificateContent));
+	else
+		bio = NULL;
+
+	x509 = bio ? PEM_read_bio_X509(bio, NULL, NULL, 0) : NULL;
+	BIO_free_all(bio);
+
+	if (!key || !x509)
+		WLog_ERR(TAG, "invalid private key or certificate");
+	else if ((SSL_CTX_use_certificate(multitransport->ctx, x509) <= 0) ||
+	         (SSL_CTX_use_PrivateKey(multitransport->ctx, key) <= 0))
+		WLog_ERR(TAG, "unable to use the server certificate for the tunnel");
+	else
+		rc = TRUE;
+
+	X509_free(x509);
+	EVP_PKEY_free(key);
+	return rc;
+}
+
+/**
+ * The reliable transport is secured with TLS, the lossy one with DTLS. Both
+ * run on top of RDP-UDP through a custom BIO.
+ */
+static BOOL multitransport_ssl_new(rdpMultitransport* multitransport)
+{
+	BIO* bio;
+	const SSL_METHOD* method;
+	long options = SSL_OP_DONT_INSERT_EMPTY_FRAGMENTS;
+
+	if (multitransport->lossy)
+	{
+		method = multitransport->server ? DTLS_server_method() : DTLS_client_method();
+		options |= SSL_OP_NO_QUERY_MTU;
+	}
+	else
+		method = multitransport->server ? SSLv23_server_method() : SSLv23_client_method();
+
+	if (!(multitransport->ctx = SSL_CTX_new(method)))
+		return FALSE;
+
+	SSL_CTX_set_options(multitransport->ctx, options);
+
+	/* the client checks the tunnel is bound to the main connection instead */
+	SSL_CTX_set_verify(multitransport->ctx, SSL_VERIFY_NONE, NULL);
+
+	if (multitransport->server && !multitransport_load_identity(multitransport))
+		return FALSE;
+
+	if (!(multitransport->ssl = SSL_new(multitransport->ctx)))
+		return FALSE;
+
+	if (!(bio = BIO_new(BIO_s_multitransport())))
+		return FALSE;
+
+	BIO_set_data(bio, multitransport);
+	BIO_set_init(bio, 1);
+	SSL_set_bio(multitransport->ssl, bio, bio);
+
+	if (multitransport->lossy)
+		SSL_set_mtu(multitransport->ssl, RDPUDP_MAX_PAYLOAD);
+
+	if (multitransport->server)
+		SSL_set_accept_state(multitransport->ssl);
+	else
+		SSL_set_connect_state(multitransport->ssl);
+
+	return TRUE;
+}
+
+/**
+ * Waits for more ciphertext, returns FALSE once the tunnel should go away.
+ */
+static BOOL multitransport_wait_read(rdpMultitransport* multitransport)
+{
+	DWORD status;
+	HANDLE events[2];
+	events[0] = multitransport->stopEvent;
+	events[1] = multitransport->readEvent;
+	status = WaitForMultipleObjects(ARRAYSIZE(events), events, FALSE,
+	                                MULTITRANSPORT_POLL_INTERVAL);
+
+	if (status == WAIT_OBJECT_0)
+		return FALSE;
+
+	/* the caller drains everything queued before waiting again */
+	ResetEvent(multitransport->readEvent);
+
+	if (!rdpudp_is_connected(multitransport->udp))
+		return FALSE;
+
+	if ((status == WAIT_TIMEOUT) && multitransport->lossy)
+	{
+		EnterCriticalSection(&multitransport->lock);
+		DTLSv1_handle_timeout(multitransport->ssl);
+		LeaveCriticalSection(&multitransport->lock);
+	}
+
+	return TRUE;
+}
+
+static BOOL multitransport_handshake(rdpMultitransport* multitransport)
+{
+	const UINT64 end = GetTickCount64() + MULTITRANSPORT_TIMEOUT;
+
+	while (GetTickCount64() < end)
+	{
+		int status;
+		int error;
+		EnterCriticalSection(&multitransport->lock);
+		status = SSL_do_handshake(multitransport->ssl);
+		error = SSL_get_error(multitransport->ssl, status);
+		LeaveCriticalSection(&multitransport->lock);
+
+		if (status == 1)
+			return TRUE;
+
+		if ((error != SSL_ERROR_WANT_READ) && (error != SSL_ERROR_WANT_WRITE))
+		{
+			WLog_ERR(TAG, "%s handshake failed: %s", multitransport->lossy ? "DTLS" : "TLS",
+			         ERR_error_string(ERR_get_error(), NULL));
+			return FALSE;
+		}
+
+		if (!multitransport_wait_read(multitransport))
+			return FALSE;
+	}
+
+	WLog_ERR(TAG, "tunnel handshake timed out");
+	return FALSE;
+}
+
+/**
+ * The tunnel must terminate at the same server as the main connection
+ * ([MS-RDPEMT] 5.1), compare the public keys of both certificates.
+ */
+static BOOL multitransport_check_binding(rdpMultitransport* multitransport)
+{
+	BOOL rc = FALSE;
+	BYTE* PublicKey = NULL;
+	DWORD PublicKeyLength = 0;
+	struct crypto_cert_struct cert = { 0 };
+	rdpTransport* transport = multitransport->rdp->transport;
+	rdpTls* tls = transport ? transport->tls : NULL;
+
+	if (!tls || !tls->PublicKey)
+	{
+		WLog_ERR(TAG, "main connection is not secured by TLS, refusing the tunnel");
+		return FALSE;
+	}
+
+	EnterCriticalSection(&multitransport->lock);
+	cert.px509 = SSL_get_peer_certificate(multitransport->ssl);
+	LeaveCriticalSection(&multitransport->lock);
+
+	if (!cert.px509)
+		return FALSE;
+
+	if (crypto_cert_get_public_key(&cert, &PublicKey, &PublicKeyLength))
+		rc = (PublicKeyLength == tls->PublicKeyLength) &&
+		     (memcmp(PublicKey, tls->PublicKey, PublicKeyLength) == 0);
+
+	X509_free(cert.px509);
+	free(PublicKey);
+
+	if (!rc)
+		WLog_ERR(TAG, "tunnel certificate does not match the main connection");
+
+	return rc;
+}
+
+static BOOL multitransport_send_pdu(rdpMultitransport* multitransport, BYTE action,
+                                    const BYTE* data, size_t length)
+{
+	int status;
+	wStream* s = Stream_New(NULL, RDPTUNNEL_HEADER_LENGTH + length);
+
+	if (!s)
+		return FALSE;
+
+	Stream_Write_UINT8(s, action); /* Action (4 bits), Flags (4 bits) */
+	Stream_Write_UINT16(s, (UINT16) length); /* PayloadLength (2 bytes) */
+	Stream_Write_UINT8(s, RDPTUNNEL_HEADER_LENGTH); /* HeaderLength (1 byte) */
+	Stream_Write(s, data, length);
+	EnterCriticalSection(&multitransport->lock);
+	status = SSL_write(multitransport->ssl, Stream_Buffer(s), (int) Stream_GetPosition(s));
+	LeaveCriticalSection(&multitransport->lock);
+	Stream_Free(s, TRUE);
+	return status == (int)(RDPTUNNEL_HEADER_LENGTH + length);
+}
+
+static BOOL multitransport_send_create_request(rdpMultitransport* multitransport)
+{
+	BYTE buffer[24];
+	wStream sbuffer;
+	wStream* s = &sbuffer;
+	Stream_StaticInit(s, buffer, sizeof(buffer));
+	Stream_Write_UINT32(s, multitransport->requestId); /* RequestID (4 bytes) */
+	Stream_Write_UINT32(s, 0); /* Reserved (4 bytes) */
+	Stream_Write(s, multitransport->securityCookie, 16); /* SecurityCookie (16 bytes) */
+	return multitransport_send_pdu(multitransport, RDPTUNNEL_ACTION_CREATEREQUEST, buffer,
+	                               sizeof(buffer));
+}
+
+static BOOL multitransport_send_create_response(rdpMultitransport* multitransport,
+        UINT32 hrResponse)
+{
+	BYTE buffer[4];
+	wStream sbuffer;
+	wStream* s = &sbuffer;
+	Stream_StaticInit(s, buffer, sizeof(buffer));
+	Stream_Write_UINT32(s, hrResponse); /* HrResponse (4 bytes) */
+	return multitransport_send_pdu(multitransport, RDPTUNNEL_ACTION_CREATERESPONSE, buffer,
+	                               sizeof(buffer));
+}
+
+static void multitransport_established(rdpMultitransport* multitransport)
+{
+	WLog_INFO(TAG, "%s tunnel 0x%08"PRIX32" established",
+	          multitransport->lossy ? "lossy" : "reliable", multitransport->requestId);
+	multitransport->established = TRUE;
+	SetEvent(multitransport->tunnelEvent);
+}
+
+static BOOL multitransport_recv_action(rdpMultitransport* multitransport, BYTE action,
+                                       wStream* s)
+{
+	switch (action)
+	{
+		case RDPTUNNEL_ACTION_CREATEREQUEST:
+			{
+				UINT32 requestId;
+				BYTE securityCookie[16];
+
+				if (!multitransport->server || (Stream_GetRemainingLength(s) < 24))
+					return FALSE;
+
+				Stream_Read_UINT32(s, requestId); /* RequestID (4 bytes) */
+				Stream_Seek_UINT32(s); /* Reserved (4 bytes) */
+				Stream_Read(s, securityCookie, 16); /* SecurityCookie (16 bytes) */
+
+				if ((requestId != multitransport->requestId) ||
+				    (memcmp(securityCookie, multitransport->securityCookie, 16) != 0))
+				{
+					WLog_ERR(TAG, "tunnel create request with invalid cookie");
+					multitransport_send_create_response(multitransport, MULTITRANSPORT_HR_E_ABORT);
+					return FALSE;
+				}
+
+				if (!multitransport_send_create_response(multitransport, MULTITRANSPORT_HR_S_OK))
+					return FALSE;
+
+				multitransport_established(multitransport);
+				return TRUE;
+			}
+
+		case RDPTUNNEL_ACTION_CREATERESPONSE:
+			{
+				UINT32 hrResponse;
+
+				if (multitransport->server || (Stream_GetRemainingLength(s) < 4))
+					return FALSE;
+
+				Stream_Read_UINT32(s, hrResponse); /* HrResponse (4 bytes) */
+
+				if (hrResponse != MULTITRANSPORT_HR_S_OK)
+				{
+					WLog_ERR(TAG, "server refused the tunnel: 0x%08"PRIX32"", hrResponse);
+					return FALSE;
+				}
+
+				multitransport_established(multitransport);
+				return TRUE;
+			}
+
+		case RDPTUNNEL_ACTION_DATA:
+			if (!multitransport->established)
+				return FALSE;
+
+			if (!multitransport->TunnelData)
+			{
+				WLog_DBG(TAG, "ignoring %"PRIuz" bytes of tunnel data", Stream_GetRemainingLength(s));
+				return TRUE;
+			}
+
+			return multitransport->TunnelData(multitransport, Stream_Pointer(s),
+			                                  Stream_GetRemainingLength(s), multitransport->custom);
+
+		default:
+			WLog_WARN(TAG, "unknown tunnel action %"PRIu8"", action);
+			return TRUE;
+	}
+}
+
+static BOOL multitransport_recv_pdus(rdpMultitransport* multitransport, wStream* s)
+{
+	while (Stream_GetRemainingLength(s) >= RDPTUNNEL_HEADER_LENGTH)
+	{
+		BYTE actionFlags;
+		UINT16 payloadLength;
+		BYTE headerLength;
+		wStream sbuffer;
+		wStream* payload;
+		const size_t start = Stream_GetPosition(s);
+		Stream_Read_UINT8(s, actionFlags); /* Action (4 bits), Flags (4 bits) */
+		Stream_Read_UINT16(s, payloadLength); /* PayloadLength (2 bytes) */
+		Stream_Read_UINT8(s, headerLength); /* HeaderLength (1 byte) */
+
+		if (headerLength < RDPTUNNEL_HEADER_LENGTH)
+			return FALSE;
+
+		if (Stream_GetRemainingLength(s) < (size_t)(headerLength - RDPTUNNEL_HEADER_LENGTH) +
+		    payloadLength)
+		{
+			Stream_SetPosition(s, start);
+			break;
+		}
+
+		/* RDP_TUNNEL_SUBHEADERs carry nothing needed here */
+		Stream_Seek(s, headerLength - RDPTUNNEL_HEADER_LENGTH);
+		payload = &sbuffer;
+		Stream_StaticInit(payload, Stream_Pointer(s), payloadLength);
+		Stream_Seek(s, payloadLength);
+
+		if (!multitransport_recv_action(multitransport, actionFlags & 0x0F, payload))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL multitransport_recv(rdpMultitransport* multitransport, BYTE* data, size_t length)
+{
+	size_t remaining;
+	wStream* s = multitransport->buffer;
+
+	/* every DTLS record holds a complete tunnel PDU */
+	if (multitransport->lossy)
+	{
+		wStream sbuffer;
+		Stream_StaticInit(&sbuffer, data, length);
+		return multitransport_recv_pdus(multitransport, &sbuffer);
+	}
+
+	if (!Stream_EnsureRemainingCapacity(s, length))
+		return FALSE;
+
+	Stream_Write(s, data, length);
+	Stream_SealLength(s);
+	Stream_SetPosition(s, 0);
+
+	if (!multitransport_recv_pdus(multitransport, s))
+		return FALSE;
+
+	remaining = Stream_GetRemainingLength(s);
+	MoveMemory(Stream_Buffer(s), Stream_Pointer(s), remaining);
+	Stream_SetPosition(s, remaining);
+	return TRUE;
+}
+
+static BOOL multitransport_read_loop(rdpMultitransport* multitransport)
+{
+	BYTE buffer[16384];
+	const UINT64 end = GetTickCount64() + MULTITRANSPORT_TIMEOUT;
+
+	while (TRUE)
+	{
+		int status;
+		int error;
+		EnterCriticalSection(&multitransport->lock);
+		status = SSL_read(multitransport->ssl, buffer, sizeof(buffer));
+		error = SSL_get_error(multitransport->ssl, status);
+		LeaveCriticalSection(&multitransport->lock);
+
+		if (status > 0)
+		{
+			if (!multitransport_recv(multitransport, buffer, (size_t) status))
+				return FALSE;
+
+			continue;
+		}
+
+		if (error == SSL_ERROR_ZERO_RETURN)
+			return TRUE;
+
+		if ((error != SSL_ERROR_WANT_READ) && (error != SSL_ERROR_WANT_WRITE))
+			return FALSE;
+
+		if (!multitransport->established && (GetTickCount64() >= end))
+		{
+			WLog_ERR(TAG, "tunnel creation timed out");
+			return FALSE;
+		}
+
+		if (!multitransport_wait_read(multitransport))
+			return TRUE;
+	}
+}
 
+static DWORD WINAPI multitransport_thread(LPVOID arg)
+{
+	rdpMultitransport* multitransport = (rdpMultitransport*) arg;
+	rdpSettings* settings = multitransport->rdp->settings;
+
+	if (multitransport->server)
+	{
+		if (!rdpudp_accept(multitransport->udp, MULTITRANSPORT_TIMEOUT))
+			goto out;
+	}
+	else if (!rdpudp_connect(multitransport->udp, settings->ServerHostname,
+	                         (UINT16) settings->ServerPort, MULTITRANSPORT_TIMEOUT))
+		goto out;
+
+	if (!multitransport_handshake(multitransport))
+		goto out;
+
+	if (!multitransport->server)
+	{
+		if (!multitransport_check_binding(multitransport) ||
+		    !multitransport_send_create_request(multitransport))
+			goto out;
+	}
+
+	multitransport_read_loop(multitransport);
+out:
+
+	if (!multitransport->established)
+	{
+		WLog_WARN(TAG, "unable to create the %s tunnel",
+		          multitransport->lossy ? "lossy" : "reliable");
+
+		if (multitransport->sendResponse)
+			rdp_send_multitransport_response(multitransport->rdp, multitransport->requestId,
+			                                 MULTITRANSPORT_HR_E_ABORT);
+	}
+
+	multitransport->established = FALSE;
+	SetEvent(multitransport->tunnelEvent);
+	ExitThread(0);
 	return 0;
 }
 
-rdpMultitransport* multitransport_new(void)
+static BOOL multitransport_prepare(rdpMultitransport* multitransport, BOOL server,
+                                   UINT16 requestedProtocol)
 {
-	return (rdpMultitransport*)calloc(1, sizeof(rdpMultitransport));
+	multitransport_close(multitransport);
+	multitransport->server = server;
+	multitransport->requestedProtocol = requestedProtocol;
+	multitransport->lossy = (requestedProtocol == INITITATE_REQUEST_PROTOCOL_UDPFECL);
+	multitransport->udp = rdpudp_new(multitransport->lossy, multitransport_udp_receive,
+	                                 multitransport);
+
+	if (!multitransport->udp)
+		return FALSE;
+
+	return multitransport_ssl_new(multitransport);
+}
+
+/**
+ * Both ends put a digest of the request id and security cookie in the
+ * correlation id of the SYN, the server listener uses it to find the
+ * connection this tunnel belongs to without exposing the cookie itself.
+ */
+static BOOL multitransport_set_correlation_id(rdpMultitransport* multitransport)
+{
+	BYTE input[20];
+	BYTE digest[WINPR_SHA256_DIGEST_LENGTH];
+	wStream sbuffer;
+	wStream* s = &sbuffer;
+	Stream_StaticInit(s, input, sizeof(input));
+	Stream_Write_UINT32(s, multitransport->requestId);
+	Stream_Write(s, multitransport->securityCookie, sizeof(multitransport->securityCookie));
+
+	if (!winpr_Digest(WINPR_MD_SHA256, input, sizeof(input), digest, sizeof(digest)))
+		return FALSE;
+
+	rdpudp_set_correlation_id(multitransport->udp, digest);
+	return TRUE;
+}
+
+static BOOL multitransport_start(rdpMultitransport* multitransport)
+{
+	multitransport->thread = CreateThread(NULL, 0, multitransport_thread, multitransport, 0,
+	                                      NULL);
+	return multitransport->thread != NULL;
+}
+
+/**
+ * Client side: sets up the tunnel requested by the Initiate Multitransport
+ * Request PDU in the background, see multitransport_wait.
+ */
+BOOL multitransport_connect(rdpMultitransport* multitransport, UINT32 requestId,
+                            UINT16 requestedProtocol, const BYTE* securityCookie)
+{
+	if (!multitransport || !securityCookie)
+		return FALSE;
+
+	if (!multitransport_prepare(multitransport, FALSE, requestedProtocol))
+		return FALSE;
+
+	multitransport->requestId = requestId;
+	CopyMemory(multitransport->securityCookie, securityCookie, 16);
+
+	if (!multitransport_set_correlation_id(multitransport))
+		return FALSE;
+
+	return multitransport_start(multitransport);
+}
+
+/**
+ * Server side: waits for a single client tunnel with a fresh request id and
+ * security cookie. Connections on the same address and port share one socket.
+ */
+BOOL multitransport_listen(rdpMultitransport* multitransport, UINT16 requestedProtocol,
+                           const char* address, UINT16 port)
+{
+	if (!multitransport)
+		return FALSE;
+
+	if (!multitransport_prepare(multitransport, TRUE, requestedProtocol))
+		return FALSE;
+
+	winpr_RAND((BYTE*) &multitransport->requestId, sizeof(multitransport->requestId));
+	winpr_RAND(multitransport->securityCookie, sizeof(multitransport->securityCookie));
+
+	if (!multitransport_set_correlation_id(multitransport))
+		return FALSE;
+
+	if (!rdpudp_listen(multitransport->udp, address, port))
+		return FALSE;
+
+	return multitransport_start(multitransport);
+}
+
+BOOL multitransport_server_request(rdpMultitransport* multitransport, UINT16 requestedProtocol)
+{
+	rdpSettings* settings;
+
+	if (!multitransport)
+		return FALSE;
+
+	settings = multitransport->rdp->settings;
+
+	if (!multitransport_listen(multitransport, requestedProtocol, NULL,
+	                           (UINT16) settings->ServerPort))
+		return FALSE;
+
+	return rdp_send_multitransport_request(multitransport->rdp, multitransport->requestId,
+	                                       requestedProtocol, multitransport->securityCookie);
+}
+
+BOOL multitransport_wait(rdpMultitransport* multitransport, DWORD timeout)
+{
+	if (!multitransport || !multitransport->thread)
+		return FALSE;
+
+	if (WaitForSingleObject(multitransport->tunnelEvent, timeout) != WAIT_OBJECT_0)
+		return FALSE;
+
+	return multitransport->established;
+}
+
+/**
+ * Sends data through the tunnel, in lossy mode every call is one datagram.
+ */
+BOOL multitransport_write(rdpMultitransport* multitransport, const BYTE* data, size_t length)
+{
+	size_t offset = 0;
+	size_t limit;
+
+	if (!multitransport || !multitransport->established || (!data && length))
+		return FALSE;
+
+	limit = multitransport->lossy ? MULTITRANSPORT_MAX_LOSSY_DATA : MULTITRANSPORT_MAX_DATA;
+
+	if (multitransport->lossy && (length > limit))
+		return FALSE;
+
+	do
+	{
+		const size_t chunk = MIN(length - offset, limit);
+
+		if (!multitransport_send_pdu(multitransport, RDPTUNNEL_ACTION_DATA, &data[offset], chunk))
+			return FALSE;
+
+		offset += chunk;
+	}
+	while (offset < length);
+
+	return TRUE;
+}
+
+void multitransport_set_tunnel_data_callback(rdpMultitransport* multitransport,
+        pMultitransportTunnelData callback, void* custom)
+{
+	if (!multitransport)
+		return;
+
+	multitransport->TunnelData = callback;
+	multitransport->custom = custom;
+}
+
+void multitransport_close(rdpMultitransport* multitransport)
+{
+	wStream* s;
+
+	if (!multitransport)
+		return;
+
+	/* closing the transport first unblocks a writer waiting for the window */
+	if (multitransport->udp)
+		rdpudp_close(multitransport->udp);
+
+	if (multitransport->thread)
+	{
+		SetEvent(multitransport->stopEvent);
+		WaitForSingleObject(multitransport->thread, INFINITE);
+		CloseHandle(multitransport->thread);
+		multitransport->thread = NULL;
+	}
+
+	rdpudp_free(multitransport->udp);
+	multitransport->udp = NULL;
+	SSL_free(multitransport->ssl);
+	multitransport->ssl = NULL;
+	SSL_CTX_free(multitransport->ctx);
+	multitransport->ctx = NULL;
+	Stream_Free(multitransport->pending, TRUE);
+	multitransport->pending = NULL;
+
+	while (multitransport->receiveQueue &&
+	       (s = (wStream*) Queue_Dequeue(multitransport->receiveQueue)))
+		Stream_Free(s, TRUE);
+
+	if (multitransport->buffer)
+		Stream_SetPosition(multitransport->buffer, 0);
+	multitransport->established = FALSE;
+	ResetEvent(multitransport->stopEvent);
+	ResetEvent(multitransport->readEvent);
+	ResetEvent(multitransport->tunnelEvent);
+}
+
+rdpMultitransport* multitransport_new(rdpRdp* rdp)
+{
+	rdpMultitransport* multitransport;
+
+	if (!rdp)
+		return NULL;
+
+	multitransport = (rdpMultitransport*) calloc(1, sizeof(rdpMultitransport));
+
+	if (!multitransport)
+		return NULL;
+
+	multitransport->rdp = rdp;
+
+	if (!InitializeCriticalSectionAndSpinCount(&multitransport->lock, 4000))
+	{
+		free(multitransport);
+		return NULL;
+	}
+
+	if (!(multitransport->stopEvent = CreateEventA(NULL, TRUE, FALSE, NULL)))
+		goto fail;
+
+	if (!(multitransport->readEvent = CreateEventA(NULL, TRUE, FALSE, NULL)))
+		goto fail;
+
+	if (!(multitransport->tunnelEvent = CreateEventA(NULL, TRUE, FALSE, NULL)))
+		goto fail;
+
+	if (!(multitransport->receiveQueue = Queue_New(TRUE, -1, -1)))
+		goto fail;
+
+	if (!(multitransport->buffer = Stream_New(NULL, 4096)))
+		goto fail;
+
+	return multitransport;
+fail:
+	multitransport_free(multitransport);
+	return NULL;
 }
 
 void multitransport_free(rdpMultitransport* multitransport)
 {
+	if (!multitransport)
+		return;
+
+	multitransport_close(multitransport);
+	Queue_Free(multitransport->receiveQueue);
+	Stream_Free(multitransport->buffer, TRUE);
+
+	if (multitransport->stopEvent)
+		CloseHandle(multitransport->stopEvent);
+
+	if (multitransport->readEvent)
+		CloseHandle(multitransport->readEvent);
+
+	if (multitransport->tunnelEvent)
+		CloseHandle(multitransport->tunnelEvent);
+
+	DeleteCriticalSection(&multitransport->lock);
 	free(multitransport);
 }
@@ -23,20 +23,84 @@
 typedef struct rdp_multitransport rdpMultitransport;
 
 #include "rdp.h"
+#include "rdpudp.h"
+
+#include <openssl/ssl.h>
 
 #include <freerdp/freerdp.h>
 #include <freerdp/api.h>
 
+#include <winpr/synch.h>
 #include <winpr/stream.h>
+#include <winpr/collections.h>
+
+/* Initiate Multitransport Request requestedProtocol */
+#define INITITATE_REQUEST_PROTOCOL_UDPFECR	0x01
+#define INITITATE_REQUEST_PROTOCOL_UDPFECL	0x02
+
+/* RDP_TUNNEL_HEADER Action */
+#define RDPTUNNEL_ACTION_CREATEREQUEST		0x0
+#define RDPTUNNEL_ACTION_CREATERESPONSE		0x1
+#define RDPTUNNEL_ACTION_DATA			0x2
+
+#define RDPTUNNEL_HEADER_LENGTH			4
+
+#define MULTITRANSPORT_HR_S_OK			0x00000000
+#define MULTITRANSPORT_HR_E_ABORT		0x80004004
+
+#define MULTITRANSPORT_TIMEOUT			10000
+
+/* Called from the tunnel thread for the payload of every RDP_TUNNEL_DATA PDU. */
+typedef BOOL (*pMultitransportTunnelData)(rdpMultitransport* multitransport, const BYTE* data,
+        size_t length, void* context);
 
 struct rdp_multitransport
 {
-	UINT32 placeholder;
+	rdpRdp* rdp;
+	BOOL server;
+	BOOL lossy;
+	BOOL established;
+	BOOL sendResponse;
+
+	UINT32 requestId;
+	UINT16 requestedProtocol;
+	BYTE securityCookie[16];
+
+	rdpUdp* udp;
+	SSL_CTX* ctx;
+	SSL* ssl;
+	CRITICAL_SECTION lock;
+	wQueue* receiveQueue;
+	wStream* pending;
+	wStream* buffer;
+
+	HANDLE thread;
+	HANDLE stopEvent;
+	HANDLE readEvent;
+	HANDLE tunnelEvent;
+
+	pMultitransportTunnelData TunnelData;
+	void* custom;
 };
 
 FREERDP_LOCAL int rdp_recv_multitransport_packet(rdpRdp* rdp, wStream* s);
+FREERDP_LOCAL int rdp_recv_multitransport_response_packet(rdpRdp* rdp, wStream* s);
+
+FREERDP_LOCAL BOOL multitransport_connect(rdpMultitransport* multitransport, UINT32 requestId,
+        UINT16 requestedProtocol, const BYTE* securityCookie);
+FREERDP_LOCAL BOOL multitransport_listen(rdpMultitransport* multitransport,
+        UINT16 requestedProtocol, const char* address, UINT16 port);
+FREERDP_LOCAL BOOL multitransport_server_request(rdpMultitransport* multitransport,
+        UINT16 requestedProtocol);
+FREERDP_LOCAL BOOL multitransport_wait(rdpMultitransport* multitransport, DWORD timeout);
+FREERDP_LOCAL void multitransport_close(rdpMultitransport* multitransport);
+
+FREERDP_LOCAL BOOL multitransport_write(rdpMultitransport* multitransport, const BYTE* data,
+                                        size_t length);
+FREERDP_LOCAL void multitransport_set_tunnel_data_callback(rdpMultitransport* multitransport,
+        pMultitransportTunnelData callback, void* custom);
 
-FREERDP_LOCAL rdpMultitransport* multitransport_new(void);
+FREERDP_LOCAL rdpMultitransport* multitransport_new(rdpRdp* rdp);
 FREERDP_LOCAL void multitransport_free(rdpMultitransport* multitransport);
 
 #endif /* FREERDP_LIB_CORE_MULTITRANSPORT_H */
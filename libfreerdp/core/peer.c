@@ -725,6 +725,28 @@ static BOOL freerdp_peer_has_more_to_read(freerdp_peer* peer)
 	return peer->context->rdp->transport->haveMoreBytesToRead;
 }
 
+/**
+ * Asks the client to open a UDP side channel ([MS-RDPEMT]), the server
+ * listens on the UDP port matching the main connection.
+ */
+BOOL freerdp_peer_initiate_multitransport(freerdp_peer* client, BOOL lossy)
+{
+	rdpRdp* rdp;
+	UINT32 transportType = lossy ? TRANSPORT_TYPE_UDP_FECL : TRANSPORT_TYPE_UDP_FECR;
+
+	if (!client || !client->context)
+		return FALSE;
+
+	rdp = client->context->rdp;
+
+	if (!(rdp->settings->MultitransportFlags & transportType))
+		return FALSE;
+
+	return multitransport_server_request(rdp->multitransport,
+	                                     lossy ? INITITATE_REQUEST_PROTOCOL_UDPFECL :
+	                                     INITITATE_REQUEST_PROTOCOL_UDPFECR);
+}
+
 static LicenseCallbackResult freerdp_peer_nolicense(freerdp_peer* peer, wStream* s)
 {
 	rdpRdp* rdp = peer->context->rdp;
@@ -1033,6 +1033,12 @@ int rdp_recv_message_channel_pdu(rdpRdp* rdp, wStream* s, UINT16 securityFlags)
 		return rdp_recv_multitransport_packet(rdp, s);
 	}
 
+	if (securityFlags & SEC_TRANSPORT_RSP)
+	{
+		/* Initiate Multitransport Response PDU */
+		return rdp_recv_multitransport_response_packet(rdp, s);
+	}
+
 	return -1;
 }
 
@@ -1680,7 +1686,7 @@ rdpRdp* rdp_new(rdpContext* context)
 	if (!rdp->heartbeat)
 		goto out_free_autodetect;
 
-	rdp->multitransport = multitransport_new();
+	rdp->multitransport = multitransport_new(rdp);
 
 	if (!rdp->multitransport)
 		goto out_free_heartbeat;
@@ -1795,6 +1801,8 @@ void rdp_reset(rdpRdp* rdp)
 
 void rdp_free(rdpRdp* rdp)
 {
+	size_t i;
+
 	if (rdp)
 	{
 		winpr_RC4_Free(rdp->rc4_decrypt_key);
@@ -1815,6 +1823,10 @@ void rdp_free(rdpRdp* rdp)
 		heartbeat_free(rdp->heartbeat);
 		multitransport_free(rdp->multitransport);
 		bulk_free(rdp->bulk);
+
+		for (i = 0; i < PERSIST_MAX_CACHES; i++)
+			free(rdp->persistentKeys[i]);
+
 		free(rdp);
 	}
 }
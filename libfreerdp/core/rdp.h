@@ -124,6 +124,9 @@
 #define DATA_PDU_TYPE_MONITOR_LAYOUT				0x37
 #define DATA_PDU_TYPE_FRAME_ACKNOWLEDGE				0x38
 
+/* Persistent Key List PDU */
+#define PERSIST_MAX_CACHES					5
+
 /* Stream Identifiers */
 #define STREAM_UNDEFINED					0x00
 #define STREAM_LOW						0x01
@@ -175,6 +178,8 @@ struct rdp_rdp
 	BOOL resendFocus;
 	BOOL deactivation_reactivation;
 	BOOL AwaitCapabilities;
+	UINT64* persistentKeys[PERSIST_MAX_CACHES];
+	UINT32 persistentKeyCount[PERSIST_MAX_CACHES];
 };
 
 FREERDP_LOCAL BOOL rdp_read_security_header(wStream* s, UINT16* flags, UINT16* length);
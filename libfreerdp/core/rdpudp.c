@@ -0,0 +1,1823 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * UDP Transport Extension [MS-RDPEUDP]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/stream.h>
+#include <winpr/crypto.h>
+#include <winpr/sysinfo.h>
+#include <winpr/winsock.h>
+#include <winpr/collections.h>
+
+#if !defined(_WIN32)
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#define closesocket(_fd) close(_fd)
+#endif
+
+#include <freerdp/log.h>
+
+#include "rdpudp.h"
+
+#define TAG FREERDP_TAG("core.rdpudp")
+
+/* source packets in flight, also the size of the receive buffer */
+#define RDPUDP_WINDOW			128
+
+/* coded sequence numbers remembered for building and evaluating ack vectors */
+#define RDPUDP_CODED_HISTORY		512
+
+#define RDPUDP_ACK_VECTOR_MAX		64
+#define RDPUDP_FEC_RANGE		4
+#define RDPUDP_FEC_SLOTS		16
+#define RDPUDP_FEC_FLUSH_DELAY		20
+#define RDPUDP_SEND_QUEUE_LIMIT		1024
+#define RDPUDP_LOSS_THRESHOLD		3
+#define RDPUDP_INITIAL_CWND		4
+#define RDPUDP_RTO_INITIAL		300
+#define RDPUDP_RTO_MIN			100
+#define RDPUDP_RTO_MAX			3000
+#define RDPUDP_SYN_RETRIES		10
+#define RDPUDP_POLL_INTERVAL		10
+
+#define RDPUDP_FEC_HEADER_LENGTH	8
+#define RDPUDP_SOURCE_HEADER_LENGTH	8
+#define RDPUDP_SYNDATA_LENGTH		8
+#define RDPUDP_CORRELATION_ID_LENGTH	32
+
+enum rdpudp_state
+{
+	RDPUDP_STATE_CLOSED,
+	RDPUDP_STATE_LISTEN,
+	RDPUDP_STATE_SYN_SENT,
+	RDPUDP_STATE_SYN_RECEIVED,
+	RDPUDP_STATE_ESTABLISHED
+};
+
+struct rdpudp_coded
+{
+	BOOL valid;
+	BOOL source;
+	UINT32 snCoded;
+	UINT32 snSource;
+};
+
+struct rdpudp_packet
+{
+	BOOL used;
+	BOOL retransmitted;
+	BOOL delivered;
+	UINT32 snSource;
+	UINT32 snCoded;
+	UINT64 sent;
+	UINT16 length;
+	BYTE data[RDPUDP_MAX_PAYLOAD];
+};
+
+struct rdpudp_fec
+{
+	BOOL used;
+	UINT32 snSourceStart;
+	BYTE uRange;
+	UINT16 length;
+	BYTE data[RDPUDP_MAX_PAYLOAD + 2];
+};
+
+typedef struct rdp_udp_listener rdpUdpListener;
+
+/**
+ * A bound UDP port shared by every server side connection listening on it,
+ * datagrams are routed to their connection by source address.
+ */
+struct rdp_udp_listener
+{
+	rdpUdpListener* next;
+	char* address;
+	UINT16 port;
+	LONG refs;
+
+	SOCKET sockfd;
+	HANDLE thread;
+	HANDLE stopEvent;
+	wArrayList* peers;
+};
+
+static INIT_ONCE listeners_once = INIT_ONCE_STATIC_INIT;
+static CRITICAL_SECTION listeners_lock;
+static rdpUdpListener* listeners = NULL;
+
+struct rdp_udp
+{
+	BOOL lossy;
+	pRdpUdpReceive receive;
+	void* context;
+
+	SOCKET sockfd;
+	rdpUdpListener* listener;
+	struct sockaddr_storage peerAddr;
+	socklen_t peerAddrLen;
+	wQueue* inbound;
+	BOOL correlation;
+	BYTE correlationId[16];
+	HANDLE thread;
+	HANDLE stopEvent;
+	HANDLE connectedEvent;
+	HANDLE writableEvent;
+	CRITICAL_SECTION lock;
+	int state;
+	UINT64 lastSyn;
+	UINT32 synRetries;
+
+	/* sender */
+	UINT32 snInitial;
+	UINT32 sndNextSource;
+	UINT32 sndUna;
+	UINT32 sndNextCoded;
+	UINT32 inFlight;
+	UINT32 peerWindow;
+	UINT64 lastSource;
+	struct rdpudp_coded coded[RDPUDP_CODED_HISTORY];
+	struct rdpudp_packet outgoing[RDPUDP_WINDOW];
+	wQueue* sendQueue;
+
+	BYTE fec[RDPUDP_MAX_PAYLOAD + 2];
+	UINT16 fecLength;
+	UINT32 fecStart;
+	BYTE fecCount;
+
+	UINT32 cwnd;
+	UINT32 cwndCount;
+	UINT32 ssthresh;
+	UINT32 recoveryCoded;
+	UINT32 srtt;
+	UINT32 rttvar;
+	UINT32 rto;
+
+	/* receiver */
+	UINT32 peerInitial;
+	UINT32 rcvHighestCoded;
+	BYTE rcvCoded[RDPUDP_CODED_HISTORY];
+	UINT32 rcvNextSource;
+	UINT32 rcvHighestSource;
+	BOOL ackPending;
+	struct rdpudp_packet incoming[RDPUDP_WINDOW];
+	struct rdpudp_fec fecSlots[RDPUDP_FEC_SLOTS];
+	size_t fecNext;
+	wQueue* deliverQueue;
+
+	UINT32 lossRate;
+	UINT32 lossState;
+	RDPUDP_STATS stats;
+};
+
+static INLINE BOOL rdpudp_seq_before(UINT32 a, UINT32 b)
+{
+	return (INT32)(a - b) < 0;
+}
+
+static INLINE UINT32 rdpudp_min(UINT32 a, UINT32 b)
+{
+	return (a < b) ? a : b;
+}
+
+static BOOL rdpudp_inject_loss(rdpUdp* udp)
+{
+	if (udp->lossRate == 0)
+		return FALSE;
+
+	/* xorshift32, deterministic for a given seed */
+	udp->lossState ^= udp->lossState << 13;
+	udp->lossState ^= udp->lossState >> 17;
+	udp->lossState ^= udp->lossState << 5;
+	return (udp->lossState % 1000) < udp->lossRate;
+}
+
+static BOOL rdpudp_send(rdpUdp* udp, wStream* s)
+{
+	const size_t length = Stream_GetPosition(s);
+	udp->stats.sent++;
+
+	if (rdpudp_inject_loss(udp))
+	{
+		udp->stats.dropped++;
+		return TRUE;
+	}
+
+	if (udp->listener)
+	{
+		if (sendto(udp->listener->sockfd, (const char*) Stream_Buffer(s), (int) length, 0,
+		           (const struct sockaddr*) &udp->peerAddr, udp->peerAddrLen) != (int) length)
+		{
+			WLog_DBG(TAG, "sendto failed");
+			return FALSE;
+		}
+	}
+	else if (send(udp->sockfd, (const char*) Stream_Buffer(s), (int) length, 0) != (int) length)
+	{
+		WLog_DBG(TAG, "send failed");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static UINT16 rdpudp_receive_window(rdpUdp* udp)
+{
+	/* delivery is immediate, the whole reorder buffer is always available */
+	WINPR_UNUSED(udp);
+	return RDPUDP_WINDOW;
+}
+
+static void rdpudp_write_fec_header(rdpUdp* udp, wStream* s, UINT16 uFlags)
+{
+	Stream_Write_UINT32_BE(s, udp->rcvHighestCoded); /* snSourceAck */
+	Stream_Write_UINT16_BE(s, rdpudp_receive_window(udp)); /* uReceiveWindowSize */
+	Stream_Write_UINT16_BE(s, uFlags); /* uFlags */
+}
+
+/**
+ * Writes the RDPUDP_ACK_VECTOR_HEADER for the coded sequence numbers up to
+ * snSourceAck, run length encoded and ordered from the oldest to the newest.
+ */
+static void rdpudp_write_ack_vector(rdpUdp* udp, wStream* s)
+{
+	BYTE runs[RDPUDP_ACK_VECTOR_MAX];
+	size_t count = 0;
+	size_t index;
+	UINT32 sn = udp->rcvHighestCoded;
+	UINT32 tracked = udp->rcvHighestCoded - udp->peerInitial;
+
+	if (tracked > RDPUDP_CODED_HISTORY)
+		tracked = RDPUDP_CODED_HISTORY;
+
+	while ((tracked > 0) && (count < RDPUDP_ACK_VECTOR_MAX))
+	{
+		const BYTE state = udp->rcvCoded[sn % RDPUDP_CODED_HISTORY] ? DATAGRAM_RECEIVED :
+		                   DATAGRAM_NOT_YET_RECEIVED;
+		BYTE length = 0;
+
+		while ((tracked > 1) && (length < 63))
+		{
+			const UINT32 prev = sn - 1;
+			const BYTE prevState = udp->rcvCoded[prev % RDPUDP_CODED_HISTORY] ? DATAGRAM_RECEIVED :
+			                       DATAGRAM_NOT_YET_RECEIVED;
+
+			if (prevState != state)
+				break;
+
+			sn = prev;
+			tracked--;
+			length++;
+		}
+
+		runs[count++] = (BYTE)((state << 6) | length);
+		sn--;
+		tracked--;
+	}
+
+	Stream_Write_UINT16_BE(s, (UINT16) count); /* uAckVectorSize */
+
+	for (index = count; index > 0; index--)
+		Stream_Write_UINT8(s, runs[index - 1]);
+
+	Stream_Zero(s, (4 - ((2 + count) % 4)) % 4);
+}
+
+static BOOL rdpudp_send_syn(rdpUdp* udp, UINT16 uFlags, UINT32 snSourceAck)
+{
+	BYTE buffer[RDPUDP_MTU];
+	wStream sbuffer;
+	wStream* s = &sbuffer;
+	Stream_StaticInit(s, buffer, sizeof(buffer));
+
+	if (udp->lossy)
+		uFlags |= RDPUDP_FLAG_SYNLOSSY;
+
+	/* the correlation id lets a shared listener pick the connection for this peer */
+	if (!(uFlags & RDPUDP_FLAG_ACK) && udp->correlation)
+		uFlags |= RDPUDP_FLAG_CORRELATION_ID;
+
+	Stream_Write_UINT32_BE(s, snSourceAck); /* snSourceAck */
+	Stream_Write_UINT16_BE(s, rdpudp_receive_window(udp)); /* uReceiveWindowSize */
+	Stream_Write_UINT16_BE(s, uFlags | RDPUDP_FLAG_SYNEX); /* uFlags */
+	Stream_Write_UINT32_BE(s, udp->snInitial); /* snInitialSequenceNumber */
+	Stream_Write_UINT16_BE(s, RDPUDP_MTU); /* uUpStreamMtu */
+	Stream_Write_UINT16_BE(s, RDPUDP_MTU); /* uDownStreamMtu */
+
+	if (uFlags & RDPUDP_FLAG_CORRELATION_ID)
+	{
+		Stream_Write(s, udp->correlationId, sizeof(udp->correlationId)); /* uCorrelationId */
+		Stream_Zero(s, 16); /* uReserved */
+	}
+
+	Stream_Write_UINT16_BE(s, RDPUDP_VERSION_INFO_VALID); /* uSynExFlags */
+	Stream_Write_UINT16_BE(s, RDPUDP_PROTOCOL_VERSION_1); /* uUdpVer */
+	Stream_Zero(s, Stream_GetRemainingCapacity(s));
+	udp->lastSyn = GetTickCount64();
+	return rdpudp_send(udp, s);
+}
+
+static BOOL rdpudp_send_ack(rdpUdp* udp)
+{
+	BYTE buffer[RDPUDP_MTU];
+	wStream sbuffer;
+	wStream* s = &sbuffer;
+	Stream_StaticInit(s, buffer, sizeof(buffer));
+	rdpudp_write_fec_header(udp, s, RDPUDP_FLAG_ACK);
+	rdpudp_write_ack_vector(udp, s);
+	udp->ackPending = FALSE;
+	return rdpudp_send(udp, s);
+}
+
+static UINT32 rdpudp_next_coded(rdpUdp* udp, BOOL source, UINT32 snSource)
+{
+	const UINT32 snCoded = udp->sndNextCoded++;
+	struct rdpudp_coded* coded = &udp->coded[snCoded % RDPUDP_CODED_HISTORY];
+	coded->valid = TRUE;
+	coded->source = source;
+	coded->snCoded = snCoded;
+	coded->snSource = snSource;
+	return snCoded;
+}
+
+static BOOL rdpudp_send_source(rdpUdp* udp, struct rdpudp_packet* packet)
+{
+	BYTE buffer[RDPUDP_MTU];
+	wStream sbuffer;
+	wStream* s = &sbuffer;
+	Stream_StaticInit(s, buffer, sizeof(buffer));
+	packet->snCoded = rdpudp_next_coded(udp, TRUE, packet->snSource);
+	packet->sent = GetTickCount64();
+	rdpudp_write_fec_header(udp, s, RDPUDP_FLAG_DATA | RDPUDP_FLAG_ACK);
+	rdpudp_write_ack_vector(udp, s);
+	Stream_Write_UINT32_BE(s, packet->snCoded); /* snCoded */
+	Stream_Write_UINT32_BE(s, packet->snSource); /* snSourceStart */
+	Stream_Write(s, packet->data, packet->length);
+	udp->ackPending = FALSE;
+	return rdpudp_send(udp, s);
+}
+
+static BOOL rdpudp_send_fec(rdpUdp* udp)
+{
+	BYTE buffer[RDPUDP_MTU];
+	wStream sbuffer;
+	wStream* s = &sbuffer;
+	UINT32 snCoded;
+	Stream_StaticInit(s, buffer, sizeof(buffer));
+	snCoded = rdpudp_next_coded(udp, FALSE, udp->fecStart);
+	rdpudp_write_fec_header(udp, s, RDPUDP_FLAG_DATA | RDPUDP_FLAG_ACK | RDPUDP_FLAG_FEC);
+	rdpudp_write_ack_vector(udp, s);
+	Stream_Write_UINT32_BE(s, snCoded); /* snCoded */
+	Stream_Write_UINT32_BE(s, udp->fecStart); /* snSourceStart */
+	Stream_Write_UINT8(s, udp->fecCount); /* uRange */
+	Stream_Write_UINT8(s, 0); /* uFecIndex */
+	Stream_Write_UINT16_BE(s, 0); /* uPadding */
+	Stream_Write(s, udp->fec, udp->fecLength);
+	udp->fecCount = 0;
+	udp->ackPending = FALSE;
+	return rdpudp_send(udp, s);
+}
+
+/**
+ * Every RDPUDP_FEC_RANGE source packets are followed by an FEC packet holding
+ * the XOR of their length prefixed payloads, which recovers any single loss.
+ */
+static BOOL rdpudp_fec_add(rdpUdp* udp, const struct rdpudp_packet* packet)
+{
+	size_t index;
+	BYTE prefix[2];
+
+	if (udp->fecCount == 0)
+	{
+		udp->fecStart = packet->snSource;
+		udp->fecLength = 0;
+		ZeroMemory(udp->fec, sizeof(udp->fec));
+	}
+
+	prefix[0] = (BYTE)(packet->length >> 8);
+	prefix[1] = (BYTE)(packet->length & 0xFF);
+	udp->fec[0] ^= prefix[0];
+	udp->fec[1] ^= prefix[1];
+
+	for (index = 0; index < packet->length; index++)
+		udp->fec[index + 2] ^= packet->data[index];
+
+	if (packet->length + 2 > udp->fecLength)
+		udp->fecLength = packet->length + 2;
+
+	udp->fecCount++;
+
+	if (udp->fecCount < RDPUDP_FEC_RANGE)
+		return TRUE;
+
+	return rdpudp_send_fec(udp);
+}
+
+static BOOL rdpudp_can_send(rdpUdp* udp)
+{
+	const UINT32 window = rdpudp_min(RDPUDP_WINDOW, udp->peerWindow);
+	return (udp->inFlight < udp->cwnd) && ((udp->sndNextSource - udp->sndUna) < window);
+}
+
+static BOOL rdpudp_flush_queue(rdpUdp* udp)
+{
+	BOOL rc = TRUE;
+
+	while ((Queue_Count(udp->sendQueue) > 0) && rdpudp_can_send(udp))
+	{
+		wStream* s = (wStream*) Queue_Dequeue(udp->sendQueue);
+		struct rdpudp_packet* packet = &udp->outgoing[udp->sndNextSource % RDPUDP_WINDOW];
+		packet->used = TRUE;
+		packet->retransmitted = FALSE;
+		packet->snSource = udp->sndNextSource++;
+		packet->length = (UINT16) Stream_Length(s);
+		CopyMemory(packet->data, Stream_Buffer(s), packet->length);
+		Stream_Free(s, TRUE);
+		udp->inFlight++;
+		udp->lastSource = GetTickCount64();
+
+		if (!rdpudp_send_source(udp, packet) || !rdpudp_fec_add(udp, packet))
+			rc = FALSE;
+	}
+
+	if (Queue_Count(udp->sendQueue) < RDPUDP_SEND_QUEUE_LIMIT)
+		SetEvent(udp->writableEvent);
+
+	return rc;
+}
+
+static void rdpudp_advance_una(rdpUdp* udp)
+{
+	while ((udp->sndUna != udp->sndNextSource) &&
+	       !udp->outgoing[udp->sndUna % RDPUDP_WINDOW].used)
+		udp->sndUna++;
+}
+
+static void rdpudp_update_rtt(rdpUdp* udp, UINT32 rtt)
+{
+	/* RFC 6298 */
+	if (udp->srtt == 0)
+	{
+		udp->srtt = rtt;
+		udp->rttvar = rtt / 2;
+	}
+	else
+	{
+		const UINT32 delta = (udp->srtt > rtt) ? udp->srtt - rtt : rtt - udp->srtt;
+		udp->rttvar = (3 * udp->rttvar + delta) / 4;
+		udp->srtt = (7 * udp->srtt + rtt) / 8;
+	}
+
+	udp->rto = udp->srtt + 4 * udp->rttvar;
+
+	if (udp->rto < RDPUDP_RTO_MIN)
+		udp->rto = RDPUDP_RTO_MIN;
+
+	if (udp->rto > RDPUDP_RTO_MAX)
+		udp->rto = RDPUDP_RTO_MAX;
+
+	udp->stats.rtt = udp->srtt;
+}
+
+static void rdpudp_congestion_event(rdpUdp* udp, UINT32 snCoded)
+{
+	/* one reduction per window of data */
+	if (rdpudp_seq_before(snCoded, udp->recoveryCoded))
+		return;
+
+	udp->ssthresh = MAX(udp->cwnd / 2, 2);
+	udp->cwnd = udp->ssthresh;
+	udp->cwndCount = 0;
+	udp->recoveryCoded = udp->sndNextCoded;
+	udp->stats.cwnd = udp->cwnd;
+}
+
+static void rdpudp_packet_acked(rdpUdp* udp, struct rdpudp_packet* packet)
+{
+	if (!packet->retransmitted)
+		rdpudp_update_rtt(udp, (UINT32)(GetTickCount64() - packet->sent));
+
+	packet->used = FALSE;
+	udp->inFlight--;
+
+	if (udp->cwnd < udp->ssthresh)
+		udp->cwnd++;
+	else if (++udp->cwndCount >= udp->cwnd)
+	{
+		udp->cwnd++;
+		udp->cwndCount = 0;
+	}
+
+	if (udp->cwnd > RDPUDP_WINDOW)
+		udp->cwnd = RDPUDP_WINDOW;
+
+	udp->stats.cwnd = udp->cwnd;
+}
+
+static BOOL rdpudp_packet_lost(rdpUdp* udp, struct rdpudp_packet* packet)
+{
+	udp->stats.lost++;
+
+	/* lossy mode never retransmits, the upper layer copes with the gap */
+	if (udp->lossy)
+	{
+		packet->used = FALSE;
+		udp->inFlight--;
+		return TRUE;
+	}
+
+	packet->retransmitted = TRUE;
+	udp->stats.retransmitted++;
+	return rdpudp_send_source(udp, packet);
+}
+
+static struct rdpudp_packet* rdpudp_find_outgoing(rdpUdp* udp, UINT32 snCoded)
+{
+	struct rdpudp_packet* packet;
+	struct rdpudp_coded* coded = &udp->coded[snCoded % RDPUDP_CODED_HISTORY];
+
+	if (!coded->valid || (coded->snCoded != snCoded))
+		return NULL;
+
+	coded->valid = FALSE;
+
+	if (!coded->source)
+		return NULL;
+
+	packet = &udp->outgoing[coded->snSource % RDPUDP_WINDOW];
+
+	/* a retransmission was sent with a newer coded sequence number */
+	if (!packet->used || (packet->snSource != coded->snSource) || (packet->snCoded != snCoded))
+		return NULL;
+
+	return packet;
+}
+
+static BOOL rdpudp_recv_ack_vector(rdpUdp* udp, wStream* s, UINT32 snSourceAck)
+{
+	size_t index;
+	UINT16 uAckVectorSize;
+	UINT32 total = 0;
+	UINT32 sn;
+	const BYTE* elements;
+
+	if (Stream_GetRemainingLength(s) < 2)
+		return FALSE;
+
+	Stream_Read_UINT16_BE(s, uAckVectorSize);
+
+	if (Stream_GetRemainingLength(s) < uAckVectorSize)
+		return FALSE;
+
+	elements = Stream_Pointer(s);
+	Stream_Seek(s, uAckVectorSize);
+	Stream_Seek(s, MIN((4 - ((2 + uAckVectorSize) % 4)) % 4, Stream_GetRemainingLength(s)));
+
+	for (index = 0; index < uAckVectorSize; index++)
+		total += (elements[index] & 0x3F) + 1;
+
+	sn = snSourceAck - total + 1;
+
+	for (index = 0; index < uAckVectorSize; index++)
+	{
+		UINT32 run;
+		const BYTE state = elements[index] >> 6;
+		const UINT32 length = (elements[index] & 0x3F) + 1;
+
+		for (run = 0; run < length; run++, sn++)
+		{
+			struct rdpudp_packet* packet;
+
+			/* a hole is only a loss once later datagrams made it */
+			if ((state != DATAGRAM_RECEIVED) &&
+			    !rdpudp_seq_before(sn + RDPUDP_LOSS_THRESHOLD - 1, snSourceAck))
+				continue;
+
+			if (!(packet = rdpudp_find_outgoing(udp, sn)))
+				continue;
+
+			if (state == DATAGRAM_RECEIVED)
+				rdpudp_packet_acked(udp, packet);
+			else
+			{
+				rdpudp_congestion_event(udp, sn);
+
+				if (!rdpudp_packet_lost(udp, packet))
+					return FALSE;
+			}
+		}
+	}
+
+	rdpudp_advance_una(udp);
+	return TRUE;
+}
+
+static BOOL rdpudp_have_source(rdpUdp* udp, UINT32 snSource)
+{
+	const struct rdpudp_packet* slot = &udp->incoming[snSource % RDPUDP_WINDOW];
+
+	if (slot->used && (slot->snSource == snSource))
+		return TRUE;
+
+	/* reliable mode delivered everything before rcvNextSource */
+	return !udp->lossy && rdpudp_seq_before(snSource, udp->rcvNextSource);
+}
+
+static BOOL rdpudp_deliver(rdpUdp* udp, struct rdpudp_packet* slot)
+{
+	wStream* s = Stream_New(NULL, slot->length ? slot->length : 1);
+
+	if (!s)
+		return FALSE;
+
+	Stream_Write(s, slot->data, slot->length);
+	Stream_SealLength(s);
+	slot->delivered = TRUE;
+	udp->stats.received++;
+	return Queue_Enqueue(udp->deliverQueue, s);
+}
+
+static BOOL rdpudp_recv_source(rdpUdp* udp, UINT32 snSource, const BYTE* data, size_t length);
+
+static BOOL rdpudp_fec_recover(rdpUdp* udp, struct rdpudp_fec* fec)
+{
+	size_t index;
+	UINT32 sn;
+	UINT32 missing = 0;
+	UINT32 snMissing = 0;
+	UINT16 length;
+	BYTE buffer[RDPUDP_MAX_PAYLOAD + 2];
+
+	for (sn = fec->snSourceStart; sn != fec->snSourceStart + fec->uRange; sn++)
+	{
+		if (!rdpudp_have_source(udp, sn))
+		{
+			missing++;
+			snMissing = sn;
+		}
+	}
+
+	if (missing == 0)
+		fec->used = FALSE;
+
+	if (missing != 1)
+		return TRUE;
+
+	CopyMemory(buffer, fec->data, fec->length);
+	ZeroMemory(&buffer[fec->length], sizeof(buffer) - fec->length);
+
+	for (sn = fec->snSourceStart; sn != fec->snSourceStart + fec->uRange; sn++)
+	{
+		const struct rdpudp_packet* slot = &udp->incoming[sn % RDPUDP_WINDOW];
+
+		if (sn == snMissing)
+			continue;
+
+		/* the payload was already released, give up on this group */
+		if (!slot->used || (slot->snSource != sn))
+		{
+			fec->used = FALSE;
+			return TRUE;
+		}
+
+		buffer[0] ^= (BYTE)(slot->length >> 8);
+		buffer[1] ^= (BYTE)(slot->length & 0xFF);
+
+		for (index = 0; index < slot->length; index++)
+			buffer[index + 2] ^= slot->data[index];
+	}
+
+	fec->used = FALSE;
+	length = (UINT16)((buffer[0] << 8) | buffer[1]);
+
+	if (length + 2 > fec->length)
+		return TRUE;
+
+	udp->stats.recovered++;
+	return rdpudp_recv_source(udp, snMissing, &buffer[2], length);
+}
+
+static BOOL rdpudp_fec_check(rdpUdp* udp, UINT32 snSource)
+{
+	size_t index;
+
+	for (index = 0; index < RDPUDP_FEC_SLOTS; index++)
+	{
+		struct rdpudp_fec* fec = &udp->fecSlots[index];
+
+		if (!fec->used || rdpudp_seq_before(snSource, fec->snSourceStart) ||
+		    !rdpudp_seq_before(snSource, fec->snSourceStart + fec->uRange))
+			continue;
+
+		if (!rdpudp_fec_recover(udp, fec))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL rdpudp_recv_source(rdpUdp* udp, UINT32 snSource, const BYTE* data, size_t length)
+{
+	struct rdpudp_packet* slot = &udp->incoming[snSource % RDPUDP_WINDOW];
+
+	if (length > RDPUDP_MAX_PAYLOAD)
+		return FALSE;
+
+	if (rdpudp_have_source(udp, snSource))
+		return TRUE;
+
+	if (udp->lossy)
+	{
+		if (!rdpudp_seq_before(udp->rcvHighestSource - RDPUDP_WINDOW, snSource))
+			return TRUE;
+
+		if (rdpudp_seq_before(udp->rcvHighestSource, snSource))
+			udp->rcvHighestSource = snSource;
+	}
+	else if (!rdpudp_seq_before(snSource, udp->rcvNextSource + RDPUDP_WINDOW))
+		return TRUE;
+
+	slot->used = TRUE;
+	slot->delivered = FALSE;
+	slot->snSource = snSource;
+	slot->length = (UINT16) length;
+	CopyMemory(slot->data, data, length);
+
+	if (udp->lossy)
+	{
+		if (!rdpudp_deliver(udp, slot))
+			return FALSE;
+	}
+	else
+	{
+		while (TRUE)
+		{
+			struct rdpudp_packet* next = &udp->incoming[udp->rcvNextSource % RDPUDP_WINDOW];
+
+			if (!next->used || (next->snSource != udp->rcvNextSource) || next->delivered)
+				break;
+
+			if (!rdpudp_deliver(udp, next))
+				return FALSE;
+
+			udp->rcvNextSource++;
+		}
+	}
+
+	return rdpudp_fec_check(udp, snSource);
+}
+
+static BOOL rdpudp_recv_fec(rdpUdp* udp, UINT32 snSourceStart, BYTE uRange, const BYTE* data,
+                            size_t length)
+{
+	struct rdpudp_fec* fec;
+
+	if ((uRange == 0) || (length < 2) || (length > RDPUDP_MAX_PAYLOAD + 2))
+		return TRUE;
+
+	fec = &udp->fecSlots[udp->fecNext++ % RDPUDP_FEC_SLOTS];
+	fec->used = TRUE;
+	fec->snSourceStart = snSourceStart;
+	fec->uRange = uRange;
+	fec->length = (UINT16) length;
+	CopyMemory(fec->data, data, length);
+	return rdpudp_fec_recover(udp, fec);
+}
+
+static void rdpudp_mark_coded(rdpUdp* udp, UINT32 snCoded)
+{
+	if (rdpudp_seq_before(udp->rcvHighestCoded, snCoded))
+	{
+		UINT32 sn;
+
+		for (sn = udp->rcvHighestCoded + 1; sn != snCoded; sn++)
+		{
+			udp->rcvCoded[sn % RDPUDP_CODED_HISTORY] = FALSE;
+
+			if (sn - udp->rcvHighestCoded > RDPUDP_CODED_HISTORY)
+				break;
+		}
+
+		udp->rcvHighestCoded = snCoded;
+	}
+	else if (udp->rcvHighestCoded - snCoded >= RDPUDP_CODED_HISTORY)
+		return;
+
+	udp->rcvCoded[snCoded % RDPUDP_CODED_HISTORY] = TRUE;
+}
+
+static void rdpudp_init_receiver(rdpUdp* udp, UINT32 peerInitial)
+{
+	udp->peerInitial = peerInitial;
+	udp->rcvHighestCoded = peerInitial;
+	udp->rcvNextSource = peerInitial + 1;
+	udp->rcvHighestSource = peerInitial;
+	ZeroMemory(udp->rcvCoded, sizeof(udp->rcvCoded));
+}
+
+static void rdpudp_established(rdpUdp* udp)
+{
+	udp->state = RDPUDP_STATE_ESTABLISHED;
+	SetEvent(udp->connectedEvent);
+}
+
+static BOOL rdpudp_recv_syn(rdpUdp* udp, wStream* s, UINT32 snSourceAck, UINT16 uFlags)
+{
+	UINT32 snInitialSequenceNumber;
+	const BOOL lossy = (uFlags & RDPUDP_FLAG_SYNLOSSY) ? TRUE : FALSE;
+
+	if (Stream_GetRemainingLength(s) < RDPUDP_SYNDATA_LENGTH)
+		return FALSE;
+
+	Stream_Read_UINT32_BE(s, snInitialSequenceNumber); /* snInitialSequenceNumber */
+	Stream_Seek_UINT16(s); /* uUpStreamMtu */
+	Stream_Seek_UINT16(s); /* uDownStreamMtu */
+
+	/* already matched by the listener, see rdpudp_listener_match */
+	if (uFlags & RDPUDP_FLAG_CORRELATION_ID)
+	{
+		if (Stream_GetRemainingLength(s) < RDPUDP_CORRELATION_ID_LENGTH)
+			return FALSE;
+
+		Stream_Seek(s, RDPUDP_CORRELATION_ID_LENGTH);
+	}
+
+	/* both sides must agree on the transport type requested on the main connection */
+	if (lossy != udp->lossy)
+	{
+		WLog_WARN(TAG, "ignoring SYN for the %s transport", lossy ? "lossy" : "reliable");
+		return TRUE;
+	}
+
+	if (!(uFlags & RDPUDP_FLAG_ACK))
+	{
+		if ((udp->state != RDPUDP_STATE_LISTEN) && (udp->state != RDPUDP_STATE_SYN_RECEIVED))
+			return TRUE;
+
+		rdpudp_init_receiver(udp, snInitialSequenceNumber);
+		udp->state = RDPUDP_STATE_SYN_RECEIVED;
+		return rdpudp_send_syn(udp, RDPUDP_FLAG_SYN | RDPUDP_FLAG_ACK, snInitialSequenceNumber);
+	}
+
+	if (udp->state == RDPUDP_STATE_ESTABLISHED)
+		return rdpudp_send_ack(udp);
+
+	if ((udp->state != RDPUDP_STATE_SYN_SENT) || (snSourceAck != udp->snInitial))
+		return TRUE;
+
+	rdpudp_init_receiver(udp, snInitialSequenceNumber);
+	rdpudp_established(udp);
+	return rdpudp_send_ack(udp);
+}
+
+static BOOL rdpudp_recv_datagram(rdpUdp* udp, wStream* s)
+{
+	UINT32 snSourceAck;
+	UINT16 uReceiveWindowSize;
+	UINT16 uFlags;
+
+	if (Stream_GetRemainingLength(s) < RDPUDP_FEC_HEADER_LENGTH)
+		return FALSE;
+
+	Stream_Read_UINT32_BE(s, snSourceAck); /* snSourceAck */
+	Stream_Read_UINT16_BE(s, uReceiveWindowSize); /* uReceiveWindowSize */
+	Stream_Read_UINT16_BE(s, uFlags); /* uFlags */
+
+	if (uFlags & RDPUDP_FLAG_SYN)
+		return rdpudp_recv_syn(udp, s, snSourceAck, uFlags);
+
+	if ((udp->state == RDPUDP_STATE_SYN_RECEIVED) &&
+	    (uFlags & (RDPUDP_FLAG_ACK | RDPUDP_FLAG_DATA)))
+		rdpudp_established(udp);
+
+	if (udp->state != RDPUDP_STATE_ESTABLISHED)
+		return TRUE;
+
+	udp->peerWindow = uReceiveWindowSize;
+
+	if (uFlags & RDPUDP_FLAG_FIN)
+	{
+		udp->state = RDPUDP_STATE_CLOSED;
+		return TRUE;
+	}
+
+	if (uFlags & RDPUDP_FLAG_ACK)
+	{
+		if (!rdpudp_recv_ack_vector(udp, s, snSourceAck))
+			return FALSE;
+	}
+
+	if (uFlags & RDPUDP_FLAG_DATA)
+	{
+		UINT32 snCoded;
+		UINT32 snSourceStart;
+
+		if (Stream_GetRemainingLength(s) < RDPUDP_SOURCE_HEADER_LENGTH)
+			return FALSE;
+
+		Stream_Read_UINT32_BE(s, snCoded); /* snCoded */
+		Stream_Read_UINT32_BE(s, snSourceStart); /* snSourceStart */
+		rdpudp_mark_coded(udp, snCoded);
+		udp->ackPending = TRUE;
+
+		if (uFlags & RDPUDP_FLAG_FEC)
+		{
+			BYTE uRange;
+
+			if (Stream_GetRemainingLength(s) < 4)
+				return FALSE;
+
+			Stream_Read_UINT8(s, uRange); /* uRange */
+			Stream_Seek_UINT8(s); /* uFecIndex */
+			Stream_Seek_UINT16(s); /* uPadding */
+			return rdpudp_recv_fec(udp, snSourceStart, uRange, Stream_Pointer(s),
+			                       Stream_GetRemainingLength(s));
+		}
+
+		return rdpudp_recv_source(udp, snSourceStart, Stream_Pointer(s),
+		                          Stream_GetRemainingLength(s));
+	}
+
+	return TRUE;
+}
+
+static BOOL rdpudp_tick(rdpUdp* udp)
+{
+	size_t index;
+	BOOL timeout = FALSE;
+	const UINT64 now = GetTickCount64();
+
+	if (udp->state == RDPUDP_STATE_SYN_SENT)
+	{
+		if ((now - udp->lastSyn >= RDPUDP_RTO_INITIAL) && (udp->synRetries < RDPUDP_SYN_RETRIES))
+		{
+			udp->synRetries++;
+			return rdpudp_send_syn(udp, RDPUDP_FLAG_SYN, 0xFFFFFFFF);
+		}
+
+		return TRUE;
+	}
+
+	/* the ACK completing the handshake got lost, the peer answers the SYN+ACK again */
+	if (udp->state == RDPUDP_STATE_SYN_RECEIVED)
+	{
+		if (now - udp->lastSyn >= RDPUDP_RTO_INITIAL)
+			return rdpudp_send_syn(udp, RDPUDP_FLAG_SYN | RDPUDP_FLAG_ACK, udp->peerInitial);
+
+		return TRUE;
+	}
+
+	if (udp->state != RDPUDP_STATE_ESTABLISHED)
+		return TRUE;
+
+	for (index = 0; index < RDPUDP_WINDOW; index++)
+	{
+		struct rdpudp_packet* packet = &udp->outgoing[index];
+
+		if (!packet->used || (now - packet->sent < udp->rto))
+			continue;
+
+		timeout = TRUE;
+
+		if (!rdpudp_packet_lost(udp, packet))
+			return FALSE;
+	}
+
+	if (timeout)
+	{
+		udp->ssthresh = MAX(udp->cwnd / 2, 2);
+		udp->cwnd = 2;
+		udp->cwndCount = 0;
+		udp->recoveryCoded = udp->sndNextCoded;
+		udp->rto = rdpudp_min(udp->rto * 2, RDPUDP_RTO_MAX);
+		udp->stats.cwnd = udp->cwnd;
+		rdpudp_advance_una(udp);
+	}
+
+	if (!rdpudp_flush_queue(udp))
+		return FALSE;
+
+	/* protect the tail of a burst as well */
+	if ((udp->fecCount > 0) && (Queue_Count(udp->sendQueue) == 0) &&
+	    (now - udp->lastSource >= RDPUDP_FEC_FLUSH_DELAY))
+	{
+		if (!rdpudp_send_fec(udp))
+			return FALSE;
+	}
+
+	if (udp->ackPending)
+		return rdpudp_send_ack(udp);
+
+	return TRUE;
+}
+
+static void rdpudp_dispatch(rdpUdp* udp)
+{
+	wStream* s;
+
+	while ((s = (wStream*) Queue_Dequeue(udp->deliverQueue)))
+	{
+		if (udp->receive)
+			udp->receive(udp->context, Stream_Buffer(s), Stream_Length(s));
+
+		Stream_Free(s, TRUE);
+	}
+}
+
+static BOOL rdpudp_socket_readable(SOCKET sockfd, DWORD timeout)
+{
+	int status;
+	fd_set rset;
+	struct timeval tv;
+	FD_ZERO(&rset);
+	FD_SET(sockfd, &rset);
+	tv.tv_sec = timeout / 1000;
+	tv.tv_usec = (timeout % 1000) * 1000;
+	status = select((int) sockfd + 1, &rset, NULL, NULL, &tv);
+	return status > 0;
+}
+
+static void rdpudp_recv_socket(rdpUdp* udp)
+{
+	int status;
+	BYTE buffer[RDPUDP_MTU + 1];
+	wStream sbuffer;
+	wStream* s;
+	status = recv(udp->sockfd, (char*) buffer, sizeof(buffer), 0);
+
+	if ((status <= 0) || (status > RDPUDP_MTU))
+		return;
+
+	s = &sbuffer;
+	Stream_StaticInit(s, buffer, (size_t) status);
+
+	if (!rdpudp_recv_datagram(udp, s))
+		WLog_DBG(TAG, "dropping malformed datagram");
+}
+
+/**
+ * Processes one datagram, read from the own socket or routed by the listener.
+ */
+static BOOL rdpudp_poll(rdpUdp* udp, DWORD timeout)
+{
+	wStream* s;
+
+	if (!udp->listener)
+	{
+		if (!rdpudp_socket_readable(udp->sockfd, timeout))
+			return FALSE;
+
+		EnterCriticalSection(&udp->lock);
+		rdpudp_recv_socket(udp);
+		LeaveCriticalSection(&udp->lock);
+		return TRUE;
+	}
+
+	if (WaitForSingleObject(Queue_Event(udp->inbound), timeout) != WAIT_OBJECT_0)
+		return FALSE;
+
+	if (!(s = (wStream*) Queue_Dequeue(udp->inbound)))
+		return FALSE;
+
+	EnterCriticalSection(&udp->lock);
+
+	if (!rdpudp_recv_datagram(udp, s))
+		WLog_DBG(TAG, "dropping malformed datagram");
+
+	LeaveCriticalSection(&udp->lock);
+	Stream_Free(s, TRUE);
+	return TRUE;
+}
+
+static DWORD WINAPI rdpudp_thread(LPVOID arg)
+{
+	rdpUdp* udp = (rdpUdp*) arg;
+
+	while (WaitForSingleObject(udp->stopEvent, 0) != WAIT_OBJECT_0)
+	{
+		size_t count;
+		DWORD timeout = RDPUDP_POLL_INTERVAL;
+
+		for (count = 0; count < 64; count++)
+		{
+			if (!rdpudp_poll(udp, timeout))
+				break;
+
+			timeout = 0;
+		}
+
+		EnterCriticalSection(&udp->lock);
+
+		if (!rdpudp_tick(udp))
+			WLog_DBG(TAG, "transport tick failed");
+
+		LeaveCriticalSection(&udp->lock);
+		rdpudp_dispatch(udp);
+	}
+
+	ExitThread(0);
+	return 0;
+}
+
+static BOOL rdpudp_start(rdpUdp* udp)
+{
+	udp->thread = CreateThread(NULL, 0, rdpudp_thread, udp, 0, NULL);
+	return udp->thread != NULL;
+}
+
+static SOCKET rdpudp_socket(const char* hostname, UINT16 port, BOOL server)
+{
+	char service[16];
+	struct addrinfo hints = { 0 };
+	struct addrinfo* result = NULL;
+	struct addrinfo* addr;
+	SOCKET sockfd = INVALID_SOCKET;
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = server ? AI_PASSIVE : 0;
+	sprintf_s(service, sizeof(service), "%"PRIu16"", port);
+
+	if (getaddrinfo(hostname, service, &hints, &result) != 0)
+		return INVALID_SOCKET;
+
+	for (addr = result; addr; addr = addr->ai_next)
+	{
+		int status;
+		sockfd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+
+		if (sockfd == INVALID_SOCKET)
+			continue;
+
+		if (server)
+			status = bind(sockfd, addr->ai_addr, (int) addr->ai_addrlen);
+		else
+			status = connect(sockfd, addr->ai_addr, (int) addr->ai_addrlen);
+
+		if (status == 0)
+			break;
+
+		closesocket(sockfd);
+		sockfd = INVALID_SOCKET;
+	}
+
+	freeaddrinfo(result);
+	return sockfd;
+}
+
+static UINT16 rdpudp_socket_port(SOCKET sockfd)
+{
+	struct sockaddr_storage addr = { 0 };
+	socklen_t addrlen = sizeof(addr);
+
+	if ((sockfd == INVALID_SOCKET) ||
+	    (getsockname(sockfd, (struct sockaddr*) &addr, &addrlen) != 0))
+		return 0;
+
+	if (addr.ss_family == AF_INET6)
+		return ntohs(((struct sockaddr_in6*) &addr)->sin6_port);
+
+	return ntohs(((struct sockaddr_in*) &addr)->sin_port);
+}
+
+/**
+ * Picks the connection for a datagram: known sources keep their connection,
+ * a SYN from a new source goes to the pending connection with a matching
+ * correlation id. A SYN without one is only accepted while a single
+ * connection of that type is pending, the tunnel create request verifies it.
+ */
+static rdpUdp* rdpudp_listener_match(rdpUdpListener* listener,
+                                     const struct sockaddr_storage* addr, socklen_t addrlen,
+                                     const BYTE* data, size_t length)
+{
+	int index;
+	UINT16 uFlags;
+	BOOL lossy;
+	size_t pendingCount = 0;
+	rdpUdp* pending = NULL;
+	rdpUdp* match = NULL;
+	const int count = ArrayList_Count(listener->peers);
+
+	for (index = 0; index < count; index++)
+	{
+		rdpUdp* udp = (rdpUdp*) ArrayList_GetItem(listener->peers, index);
+
+		if ((udp->peerAddrLen == addrlen) && (memcmp(&udp->peerAddr, addr, addrlen) == 0))
+			return udp;
+	}
+
+	if (length < RDPUDP_FEC_HEADER_LENGTH + RDPUDP_SYNDATA_LENGTH)
+		return NULL;
+
+	uFlags = (UINT16)((data[6] << 8) | data[7]);
+
+	if (!(uFlags & RDPUDP_FLAG_SYN) || (uFlags & RDPUDP_FLAG_ACK))
+		return NULL;
+
+	if ((uFlags & RDPUDP_FLAG_CORRELATION_ID) &&
+	    (length < RDPUDP_FEC_HEADER_LENGTH + RDPUDP_SYNDATA_LENGTH + RDPUDP_CORRELATION_ID_LENGTH))
+		return NULL;
+
+	lossy = (uFlags & RDPUDP_FLAG_SYNLOSSY) ? TRUE : FALSE;
+
+	for (index = 0; index < count; index++)
+	{
+		rdpUdp* udp = (rdpUdp*) ArrayList_GetItem(listener->peers, index);
+
+		if ((udp->peerAddrLen != 0) || (udp->lossy != lossy))
+			continue;
+
+		if (!(uFlags & RDPUDP_FLAG_CORRELATION_ID))
+		{
+			pending = udp;
+			pendingCount++;
+		}
+		else if (udp->correlation &&
+		         (memcmp(udp->correlationId,
+		                 &data[RDPUDP_FEC_HEADER_LENGTH + RDPUDP_SYNDATA_LENGTH], 16) == 0))
+		{
+			match = udp;
+			break;
+		}
+	}
+
+	if (pendingCount == 1)
+		match = pending;
+
+	if (match)
+	{
+		EnterCriticalSection(&match->lock);
+		CopyMemory(&match->peerAddr, addr, addrlen);
+		match->peerAddrLen = addrlen;
+		LeaveCriticalSection(&match->lock);
+	}
+
+	return match;
+}
+
+static DWORD WINAPI rdpudp_listener_thread(LPVOID arg)
+{
+	rdpUdpListener* listener = (rdpUdpListener*) arg;
+
+	while (WaitForSingleObject(listener->stopEvent, 0) != WAIT_OBJECT_0)
+	{
+		int status;
+		rdpUdp* udp;
+		wStream* s;
+		BYTE buffer[RDPUDP_MTU + 1];
+		struct sockaddr_storage addr = { 0 };
+		socklen_t addrlen = sizeof(addr);
+
+		if (!rdpudp_socket_readable(listener->sockfd, RDPUDP_POLL_INTERVAL))
+			continue;
+
+		status = recvfrom(listener->sockfd, (char*) buffer, sizeof(buffer), 0,
+		                  (struct sockaddr*) &addr, &addrlen);
+
+		if ((status <= 0) || (status > RDPUDP_MTU))
+			continue;
+
+		ArrayList_Lock(listener->peers);
+		udp = rdpudp_listener_match(listener, &addr, addrlen, buffer, (size_t) status);
+
+		if (udp && (s = Stream_New(NULL, (size_t) status)))
+		{
+			Stream_Write(s, buffer, (size_t) status);
+			Stream_SealLength(s);
+			Stream_SetPosition(s, 0);
+
+			if (!Queue_Enqueue(udp->inbound, s))
+				Stream_Free(s, TRUE);
+		}
+
+		ArrayList_Unlock(listener->peers);
+	}
+
+	ExitThread(0);
+	return 0;
+}
+
+static void rdpudp_listener_free(rdpUdpListener* listener)
+{
+	if (!listener)
+		return;
+
+	if (listener->thread)
+	{
+		SetEvent(listener->stopEvent);
+		WaitForSingleObject(listener->thread, INFINITE);
+		CloseHandle(listener->thread);
+	}
+
+	if (listener->stopEvent)
+		CloseHandle(listener->stopEvent);
+
+	if (listener->sockfd != INVALID_SOCKET)
+		closesocket(listener->sockfd);
+
+	ArrayList_Free(listener->peers);
+	free(listener->address);
+	free(listener);
+}
+
+static rdpUdpListener* rdpudp_listener_new(const char* address, UINT16 port)
+{
+	rdpUdpListener* listener = (rdpUdpListener*) calloc(1, sizeof(rdpUdpListener));
+
+	if (!listener)
+		return NULL;
+
+	listener->refs = 1;
+	listener->sockfd = rdpudp_socket(address, port, TRUE);
+
+	if (listener->sockfd == INVALID_SOCKET)
+		goto fail;
+
+	/* an ephemeral port can be shared under the number it was given */
+	if (!(listener->port = rdpudp_socket_port(listener->sockfd)))
+		goto fail;
+
+	if (address && !(listener->address = _strdup(address)))
+		goto fail;
+
+	if (!(listener->peers = ArrayList_New(TRUE)))
+		goto fail;
+
+	if (!(listener->stopEvent = CreateEventA(NULL, TRUE, FALSE, NULL)))
+		goto fail;
+
+	if (!(listener->thread = CreateThread(NULL, 0, rdpudp_listener_thread, listener, 0, NULL)))
+		goto fail;
+
+	return listener;
+fail:
+	rdpudp_listener_free(listener);
+	return NULL;
+}
+
+static BOOL CALLBACK rdpudp_listeners_init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	WINPR_UNUSED(once);
+	WINPR_UNUSED(param);
+	WINPR_UNUSED(context);
+	return InitializeCriticalSectionAndSpinCount(&listeners_lock, 4000);
+}
+
+/**
+ * Returns the listener bound to address and port, a port of 0 binds a new
+ * one on an ephemeral port.
+ */
+static rdpUdpListener* rdpudp_listener_acquire(const char* address, UINT16 port)
+{
+	rdpUdpListener* listener;
+
+	if (!InitOnceExecuteOnce(&listeners_once, rdpudp_listeners_init, NULL, NULL))
+		return NULL;
+
+	EnterCriticalSection(&listeners_lock);
+
+	for (listener = listeners; listener && (port != 0); listener = listener->next)
+	{
+		if (listener->port != port)
+			continue;
+
+		if ((!address && !listener->address) ||
+		    (address && listener->address && (strcmp(address, listener->address) == 0)))
+		{
+			listener->refs++;
+			break;
+		}
+	}
+
+	if (!listener || (port == 0))
+	{
+		if ((listener = rdpudp_listener_new(address, port)))
+		{
+			listener->next = listeners;
+			listeners = listener;
+		}
+	}
+
+	LeaveCriticalSection(&listeners_lock);
+	return listener;
+}
+
+static void rdpudp_listener_release(rdpUdpListener* listener)
+{
+	rdpUdpListener** prev;
+
+	EnterCriticalSection(&listeners_lock);
+
+	if (--listener->refs > 0)
+	{
+		LeaveCriticalSection(&listeners_lock);
+		return;
+	}
+
+	for (prev = &listeners; *prev; prev = &(*prev)->next)
+	{
+		if (*prev == listener)
+		{
+			*prev = listener->next;
+			break;
+		}
+	}
+
+	LeaveCriticalSection(&listeners_lock);
+	rdpudp_listener_free(listener);
+}
+
+/**
+ * Connects to a listening peer, sends the SYN and waits for the SYN+ACK.
+ */
+BOOL rdpudp_connect(rdpUdp* udp, const char* hostname, UINT16 port, DWORD timeout)
+{
+	BOOL rc;
+
+	if (!udp || !hostname || (udp->sockfd != INVALID_SOCKET))
+		return FALSE;
+
+	udp->sockfd = rdpudp_socket(hostname, port, FALSE);
+
+	if (udp->sockfd == INVALID_SOCKET)
+	{
+		WLog_ERR(TAG, "unable to connect to %s:%"PRIu16"", hostname, port);
+		return FALSE;
+	}
+
+	EnterCriticalSection(&udp->lock);
+	udp->state = RDPUDP_STATE_SYN_SENT;
+	rc = rdpudp_send_syn(udp, RDPUDP_FLAG_SYN, 0xFFFFFFFF);
+	LeaveCriticalSection(&udp->lock);
+
+	if (!rc || !rdpudp_start(udp))
+		return FALSE;
+
+	return rdpudp_accept(udp, timeout);
+}
+
+/**
+ * Waits for a peer on the listener of address and port, shared with every
+ * other connection listening there. A port of 0 binds an ephemeral one
+ * (see rdpudp_get_port).
+ */
+BOOL rdpudp_listen(rdpUdp* udp, const char* address, UINT16 port)
+{
+	if (!udp || udp->listener || (udp->sockfd != INVALID_SOCKET))
+		return FALSE;
+
+	if (!(udp->listener = rdpudp_listener_acquire(address, port)))
+	{
+		WLog_ERR(TAG, "unable to bind to %s:%"PRIu16"", address ? address : "*", port);
+		return FALSE;
+	}
+
+	udp->state = RDPUDP_STATE_LISTEN;
+
+	if (ArrayList_Add(udp->listener->peers, udp) < 0)
+	{
+		rdpudp_listener_release(udp->listener);
+		udp->listener = NULL;
+		return FALSE;
+	}
+
+	return rdpudp_start(udp);
+}
+
+BOOL rdpudp_accept(rdpUdp* udp, DWORD timeout)
+{
+	HANDLE events[2];
+
+	if (!udp || !udp->thread)
+		return FALSE;
+
+	events[0] = udp->connectedEvent;
+	events[1] = udp->stopEvent;
+	return WaitForMultipleObjects(ARRAYSIZE(events), events, FALSE, timeout) == WAIT_OBJECT_0;
+}
+
+void rdpudp_set_correlation_id(rdpUdp* udp, const BYTE* correlationId)
+{
+	if (!udp)
+		return;
+
+	EnterCriticalSection(&udp->lock);
+	udp->correlation = (correlationId != NULL);
+
+	if (correlationId)
+		CopyMemory(udp->correlationId, correlationId, sizeof(udp->correlationId));
+
+	LeaveCriticalSection(&udp->lock);
+}
+
+UINT16 rdpudp_get_port(rdpUdp* udp)
+{
+	if (!udp)
+		return 0;
+
+	return rdpudp_socket_port(udp->listener ? udp->listener->sockfd : udp->sockfd);
+}
+
+BOOL rdpudp_is_lossy(rdpUdp* udp)
+{
+	return udp && udp->lossy;
+}
+
+BOOL rdpudp_is_connected(rdpUdp* udp)
+{
+	BOOL connected;
+
+	if (!udp)
+		return FALSE;
+
+	EnterCriticalSection(&udp->lock);
+	connected = (udp->state == RDPUDP_STATE_ESTABLISHED);
+	LeaveCriticalSection(&udp->lock);
+	return connected;
+}
+
+static BOOL rdpudp_queue(rdpUdp* udp, const BYTE* data, size_t length)
+{
+	wStream* s;
+
+	while (TRUE)
+	{
+		HANDLE events[2];
+
+		if (udp->state != RDPUDP_STATE_ESTABLISHED)
+			return FALSE;
+
+		if (Queue_Count(udp->sendQueue) < RDPUDP_SEND_QUEUE_LIMIT)
+			break;
+
+		/* lossy data is not worth waiting for */
+		if (udp->lossy)
+		{
+			udp->stats.lost++;
+			return TRUE;
+		}
+
+		ResetEvent(udp->writableEvent);
+		LeaveCriticalSection(&udp->lock);
+		events[0] = udp->writableEvent;
+		events[1] = udp->stopEvent;
+		WaitForMultipleObjects(ARRAYSIZE(events), events, FALSE, 100);
+		EnterCriticalSection(&udp->lock);
+	}
+
+	if (!(s = Stream_New(NULL, length ? length : 1)))
+		return FALSE;
+
+	Stream_Write(s, data, length);
+	Stream_SealLength(s);
+
+	if (!Queue_Enqueue(udp->sendQueue, s))
+	{
+		Stream_Free(s, TRUE);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * In reliable mode data is a byte stream split into datagrams, blocking while
+ * the send queue is full. In lossy mode every call is one datagram of at most
+ * RDPUDP_MAX_PAYLOAD bytes.
+ */
+BOOL rdpudp_write(rdpUdp* udp, const BYTE* data, size_t length)
+{
+	BOOL rc = TRUE;
+	size_t offset = 0;
+
+	if (!udp || (!data && length))
+		return FALSE;
+
+	if (udp->lossy && (length > RDPUDP_MAX_PAYLOAD))
+		return FALSE;
+
+	EnterCriticalSection(&udp->lock);
+
+	do
+	{
+		const size_t chunk = MIN(length - offset, RDPUDP_MAX_PAYLOAD);
+
+		if (!rdpudp_queue(udp, &data[offset], chunk))
+		{
+			rc = FALSE;
+			break;
+		}
+
+		offset += chunk;
+	}
+	while (offset < length);
+
+	if (!rdpudp_flush_queue(udp))
+		rc = FALSE;
+
+	LeaveCriticalSection(&udp->lock);
+	return rc;
+}
+
+/**
+ * Waits until everything written was acknowledged (or given up in lossy mode).
+ */
+BOOL rdpudp_flush(rdpUdp* udp, DWORD timeout)
+{
+	const UINT64 end = GetTickCount64() + timeout;
+
+	if (!udp)
+		return FALSE;
+
+	while (GetTickCount64() < end)
+	{
+		BOOL done;
+		EnterCriticalSection(&udp->lock);
+		done = (Queue_Count(udp->sendQueue) == 0) && (udp->inFlight == 0);
+		LeaveCriticalSection(&udp->lock);
+
+		if (done)
+			return TRUE;
+
+		Sleep(RDPUDP_POLL_INTERVAL);
+	}
+
+	return FALSE;
+}
+
+/**
+ * Drops the given share of outgoing datagrams, used to test loss recovery.
+ */
+void rdpudp_set_loss(rdpUdp* udp, UINT32 permille, UINT32 seed)
+{
+	if (!udp)
+		return;
+
+	EnterCriticalSection(&udp->lock);
+	udp->lossRate = permille;
+	udp->lossState = seed ? seed : 1;
+	LeaveCriticalSection(&udp->lock);
+}
+
+void rdpudp_get_stats(rdpUdp* udp, RDPUDP_STATS* stats)
+{
+	if (!udp || !stats)
+		return;
+
+	EnterCriticalSection(&udp->lock);
+	*stats = udp->stats;
+	LeaveCriticalSection(&udp->lock);
+}
+
+void rdpudp_close(rdpUdp* udp)
+{
+	if (!udp)
+		return;
+
+	EnterCriticalSection(&udp->lock);
+
+	if (udp->state == RDPUDP_STATE_ESTABLISHED)
+	{
+		BYTE buffer[RDPUDP_FEC_HEADER_LENGTH];
+		wStream sbuffer;
+		wStream* s = &sbuffer;
+		Stream_StaticInit(s, buffer, sizeof(buffer));
+		rdpudp_write_fec_header(udp, s, RDPUDP_FLAG_FIN);
+		rdpudp_send(udp, s);
+	}
+
+	udp->state = RDPUDP_STATE_CLOSED;
+	LeaveCriticalSection(&udp->lock);
+
+	if (udp->thread)
+	{
+		SetEvent(udp->stopEvent);
+		WaitForSingleObject(udp->thread, INFINITE);
+		CloseHandle(udp->thread);
+		udp->thread = NULL;
+	}
+
+	if (udp->listener)
+	{
+		ArrayList_Remove(udp->listener->peers, udp);
+		rdpudp_listener_release(udp->listener);
+		udp->listener = NULL;
+		udp->peerAddrLen = 0;
+	}
+
+	if (udp->sockfd != INVALID_SOCKET)
+	{
+		closesocket(udp->sockfd);
+		udp->sockfd = INVALID_SOCKET;
+	}
+
+	if (udp->inbound)
+		Queue_Clear(udp->inbound);
+}
+
+static void rdpudp_stream_free(void* obj)
+{
+	Stream_Free((wStream*) obj, TRUE);
+}
+
+rdpUdp* rdpudp_new(BOOL lossy, pRdpUdpReceive receive, void* context)
+{
+	rdpUdp* udp = (rdpUdp*) calloc(1, sizeof(rdpUdp));
+
+	if (!udp)
+		return NULL;
+
+	udp->lossy = lossy;
+	udp->receive = receive;
+	udp->context = context;
+	udp->sockfd = INVALID_SOCKET;
+	udp->cwnd = RDPUDP_INITIAL_CWND;
+	udp->ssthresh = RDPUDP_WINDOW;
+	udp->rto = RDPUDP_RTO_INITIAL;
+	udp->peerWindow = RDPUDP_WINDOW;
+	udp->stats.cwnd = udp->cwnd;
+	winpr_RAND((BYTE*) &udp->snInitial, sizeof(udp->snInitial));
+	udp->sndNextSource = udp->snInitial + 1;
+	udp->sndUna = udp->sndNextSource;
+	udp->sndNextCoded = udp->snInitial + 1;
+	udp->recoveryCoded = udp->sndNextCoded;
+
+	if (!InitializeCriticalSectionAndSpinCount(&udp->lock, 4000))
+	{
+		free(udp);
+		return NULL;
+	}
+
+	if (!(udp->stopEvent = CreateEventA(NULL, TRUE, FALSE, NULL)))
+		goto fail;
+
+	if (!(udp->connectedEvent = CreateEventA(NULL, TRUE, FALSE, NULL)))
+		goto fail;
+
+	if (!(udp->writableEvent = CreateEventA(NULL, TRUE, TRUE, NULL)))
+		goto fail;
+
+	if (!(udp->sendQueue = Queue_New(FALSE, -1, -1)))
+		goto fail;
+
+	udp->sendQueue->object.fnObjectFree = rdpudp_stream_free;
+
+	if (!(udp->deliverQueue = Queue_New(TRUE, -1, -1)))
+		goto fail;
+
+	udp->deliverQueue->object.fnObjectFree = rdpudp_stream_free;
+
+	if (!(udp->inbound = Queue_New(TRUE, -1, -1)))
+		goto fail;
+
+	udp->inbound->object.fnObjectFree = rdpudp_stream_free;
+	return udp;
+fail:
+	rdpudp_free(udp);
+	return NULL;
+}
+
+void rdpudp_free(rdpUdp* udp)
+{
+	if (!udp)
+		return;
+
+	rdpudp_close(udp);
+	Queue_Free(udp->sendQueue);
+	Queue_Free(udp->deliverQueue);
+	Queue_Free(udp->inbound);
+
+	if (udp->stopEvent)
+		CloseHandle(udp->stopEvent);
+
+	if (udp->connectedEvent)
+		CloseHandle(udp->connectedEvent);
+
+	if (udp->writableEvent)
+		CloseHandle(udp->writableEvent);
+
+	DeleteCriticalSection(&udp->lock);
+	free(udp);
+}
@@ -0,0 +1,105 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * UDP Transport Extension [MS-RDPEUDP]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CORE_RDPUDP_H
+#define FREERDP_LIB_CORE_RDPUDP_H
+
+typedef struct rdp_udp rdpUdp;
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+
+#include <winpr/wtypes.h>
+
+/* RDPUDP_FEC_HEADER uFlags */
+#define RDPUDP_FLAG_SYN				0x0001
+#define RDPUDP_FLAG_FIN				0x0002
+#define RDPUDP_FLAG_ACK				0x0004
+#define RDPUDP_FLAG_DATA			0x0008
+#define RDPUDP_FLAG_FEC				0x0010
+#define RDPUDP_FLAG_CN				0x0020
+#define RDPUDP_FLAG_CWR				0x0040
+#define RDPUDP_FLAG_SACK_OPTION			0x0080
+#define RDPUDP_FLAG_ACK_OF_ACKS			0x0100
+#define RDPUDP_FLAG_SYNLOSSY			0x0200
+#define RDPUDP_FLAG_ACKDELAYED			0x0400
+#define RDPUDP_FLAG_CORRELATION_ID		0x0800
+#define RDPUDP_FLAG_SYNEX			0x1000
+
+/* RDPUDP_SYNDATAEX_PAYLOAD */
+#define RDPUDP_VERSION_INFO_VALID		0x0001
+#define RDPUDP_PROTOCOL_VERSION_1		0x0001
+
+/* AckVectorElement states */
+#define DATAGRAM_RECEIVED			0
+#define DATAGRAM_NOT_YET_RECEIVED		3
+
+/* every SYN and SYN+ACK datagram is padded to the MTU */
+#define RDPUDP_MTU				1232
+
+/* largest payload of a single datagram, leaves room for all headers and the FEC length */
+#define RDPUDP_MAX_PAYLOAD			1142
+
+struct rdp_udp_stats
+{
+	UINT32 sent;
+	UINT32 received;
+	UINT32 retransmitted;
+	UINT32 lost;
+	UINT32 recovered;
+	UINT32 dropped;
+	UINT32 rtt;
+	UINT32 cwnd;
+};
+typedef struct rdp_udp_stats RDPUDP_STATS;
+
+/**
+ * Called from the transport thread for each payload, in order in reliable
+ * mode and as soon as it arrived (or was recovered) in lossy mode.
+ */
+typedef BOOL (*pRdpUdpReceive)(void* context, const BYTE* data, size_t length);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FREERDP_LOCAL rdpUdp* rdpudp_new(BOOL lossy, pRdpUdpReceive receive, void* context);
+FREERDP_LOCAL void rdpudp_free(rdpUdp* udp);
+
+FREERDP_LOCAL BOOL rdpudp_connect(rdpUdp* udp, const char* hostname, UINT16 port,
+                                  DWORD timeout);
+FREERDP_LOCAL BOOL rdpudp_listen(rdpUdp* udp, const char* address, UINT16 port);
+FREERDP_LOCAL BOOL rdpudp_accept(rdpUdp* udp, DWORD timeout);
+FREERDP_LOCAL void rdpudp_close(rdpUdp* udp);
+
+FREERDP_LOCAL void rdpudp_set_correlation_id(rdpUdp* udp, const BYTE* correlationId);
+
+FREERDP_LOCAL UINT16 rdpudp_get_port(rdpUdp* udp);
+FREERDP_LOCAL BOOL rdpudp_is_lossy(rdpUdp* udp);
+FREERDP_LOCAL BOOL rdpudp_is_connected(rdpUdp* udp);
+
+FREERDP_LOCAL BOOL rdpudp_write(rdpUdp* udp, const BYTE* data, size_t length);
+FREERDP_LOCAL BOOL rdpudp_flush(rdpUdp* udp, DWORD timeout);
+
+FREERDP_LOCAL void rdpudp_set_loss(rdpUdp* udp, UINT32 permille, UINT32 seed);
+FREERDP_LOCAL void rdpudp_get_stats(rdpUdp* udp, RDPUDP_STATS* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_LIB_CORE_RDPUDP_H */
@@ -306,10 +306,10 @@ BOOL freerdp_settings_set_default_order_support(rdpSettings* settings)
 	settings->OrderSupport[NEG_GLYPH_INDEX_INDEX] = settings->GlyphSupportLevel != GLYPH_SUPPORT_NONE;
 	settings->OrderSupport[NEG_FAST_INDEX_INDEX] = settings->GlyphSupportLevel != GLYPH_SUPPORT_NONE;
 	settings->OrderSupport[NEG_FAST_GLYPH_INDEX] = settings->GlyphSupportLevel != GLYPH_SUPPORT_NONE;
-	settings->OrderSupport[NEG_POLYGON_SC_INDEX] = FALSE;
-	settings->OrderSupport[NEG_POLYGON_CB_INDEX] = FALSE;
-	settings->OrderSupport[NEG_ELLIPSE_SC_INDEX] = FALSE;
-	settings->OrderSupport[NEG_ELLIPSE_CB_INDEX] = FALSE;
+	settings->OrderSupport[NEG_POLYGON_SC_INDEX] = TRUE;
+	settings->OrderSupport[NEG_POLYGON_CB_INDEX] = TRUE;
+	settings->OrderSupport[NEG_ELLIPSE_SC_INDEX] = TRUE;
+	settings->OrderSupport[NEG_ELLIPSE_CB_INDEX] = TRUE;
 	return TRUE;
 }
 
@@ -737,6 +737,7 @@ static void freerdp_settings_free_internal(rdpSettings* settings)
 	free(settings->RemoteApplicationFile);
 	free(settings->RemoteApplicationGuid);
 	free(settings->RemoteApplicationCmdLine);
+	free(settings->BitmapCachePersistFile);
 	free(settings->ImeFileName);
 	free(settings->DrivesToRedirect);
 	free(settings->WindowTitle);
@@ -822,6 +823,7 @@ BOOL freerdp_settings_copy(rdpSettings* _settings, const rdpSettings* settings)
 	CHECKED_STRDUP(RemoteApplicationFile); /* 2116 */
 	CHECKED_STRDUP(RemoteApplicationGuid); /* 2117 */
 	CHECKED_STRDUP(RemoteApplicationCmdLine); /* 2118 */
+	CHECKED_STRDUP(BitmapCachePersistFile); /* 2503 */
 	CHECKED_STRDUP(ImeFileName); /* 2628 */
 	CHECKED_STRDUP(DrivesToRedirect); /* 4290 */
 	CHECKED_STRDUP(ActionScript);
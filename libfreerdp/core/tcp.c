@@ -36,6 +36,7 @@
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <net/if.h>
@@ -136,6 +137,72 @@ static int transport_bio_simple_write(BIO* bio, const char* buf, int size)
 	return status;
 }
 
+static long transport_bio_simple_write_vector(BIO* bio, const DataChunk* chunks, long count)
+{
+	long index;
+	long status;
+	WINPR_BIO_SIMPLE_SOCKET* ptr = (WINPR_BIO_SIMPLE_SOCKET*) BIO_get_data(bio);
+#ifdef _WIN32
+	DWORD sent = 0;
+	WSABUF buffers[BIO_WRITE_VECTOR_MAX];
+#else
+	int flags = 0;
+	struct msghdr msg;
+	struct iovec iov[BIO_WRITE_VECTOR_MAX];
+#endif
+
+	if (!chunks || (count < 1))
+		return 0;
+
+	if (count > BIO_WRITE_VECTOR_MAX)
+		count = BIO_WRITE_VECTOR_MAX;
+
+	BIO_clear_flags(bio, BIO_FLAGS_WRITE);
+#ifdef _WIN32
+
+	for (index = 0; index < count; index++)
+	{
+		buffers[index].buf = (CHAR*) chunks[index].data;
+		buffers[index].len = (ULONG) chunks[index].size;
+	}
+
+	status = (WSASend(ptr->socket, buffers, (DWORD) count, &sent, 0, NULL, NULL) == 0) ?
+	         (long) sent : -1;
+#else
+
+	for (index = 0; index < count; index++)
+	{
+		iov[index].iov_base = (void*) chunks[index].data;
+		iov[index].iov_len = chunks[index].size;
+	}
+
+	ZeroMemory(&msg, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = (size_t) count;
+#ifdef MSG_NOSIGNAL
+	flags |= MSG_NOSIGNAL;
+#endif
+	status = (long) sendmsg((int) ptr->socket, &msg, flags);
+#endif
+
+	if (status < 0)
+	{
+		int error = WSAGetLastError();
+
+		if ((error == WSAEWOULDBLOCK) || (error == WSAEINTR) ||
+		    (error == WSAEINPROGRESS) || (error == WSAEALREADY))
+		{
+			BIO_set_flags(bio, (BIO_FLAGS_WRITE | BIO_FLAGS_SHOULD_RETRY));
+		}
+		else
+		{
+			BIO_clear_flags(bio, BIO_FLAGS_SHOULD_RETRY);
+		}
+	}
+
+	return status;
+}
+
 static int transport_bio_simple_read(BIO* bio, char* buf, int size)
 {
 	int error;
@@ -204,6 +271,13 @@ static long transport_bio_simple_ctrl(BIO* bio, int cmd, long arg1, void* arg2)
 		*((SOCKET*) arg2) = ptr->socket;
 		return 1;
 	}
+	else if (cmd == BIO_C_WRITE_VECTOR)
+	{
+		if (!BIO_get_init(bio))
+			return -1;
+
+		return transport_bio_simple_write_vector(bio, (const DataChunk*) arg2, arg1);
+	}
 	else if (cmd == BIO_C_GET_EVENT)
 	{
 		if (!BIO_get_init(bio) || !arg2)
@@ -469,28 +543,16 @@ long transport_bio_buffered_callback(BIO* bio, int mode, const char* argp, int a
 	return 1;
 }
 
-static int transport_bio_buffered_write(BIO* bio, const char* buf, int num)
+/* Sends as much of the xmit buffer as the next BIO takes */
+static int transport_bio_buffered_drain(BIO* bio)
 {
-	int i, ret;
+	int i, ret = 0;
 	int status;
 	int nchunks;
 	int committedBytes;
 	DataChunk chunks[2];
 	WINPR_BIO_BUFFERED_SOCKET* ptr = (WINPR_BIO_BUFFERED_SOCKET*) BIO_get_data(bio);
 	BIO* next_bio = NULL;
-	ret = num;
-	ptr->writeBlocked = FALSE;
-	BIO_clear_flags(bio, BIO_FLAGS_WRITE);
-
-	/* we directly append extra bytes in the xmit buffer, this could be prevented
-	 * but for now it makes the code more simple.
-	 */
-	if (buf && num && !ringbuffer_write(&ptr->xmitBuffer, (const BYTE*) buf, num))
-	{
-		WLog_ERR(TAG, "an error occurred when writing (num: %d)", num);
-		return -1;
-	}
-
 	committedBytes = 0;
 	nchunks = ringbuffer_peek(&ptr->xmitBuffer, chunks, ringbuffer_used(&ptr->xmitBuffer));
 	next_bio = BIO_next(bio);
@@ -529,6 +591,100 @@ out:
 	return ret;
 }
 
+/**
+ * Data is sent straight from the caller buffers whenever nothing is queued,
+ * only the part the socket does not take right away is copied to the xmit
+ * buffer. Like BIO_write on this BIO, all bytes are always consumed.
+ */
+static long transport_bio_buffered_write_vector(BIO* bio, const DataChunk* chunks, long count)
+{
+	long index;
+	long status;
+	size_t sent = 0;
+	size_t total = 0;
+	WINPR_BIO_BUFFERED_SOCKET* ptr = (WINPR_BIO_BUFFERED_SOCKET*) BIO_get_data(bio);
+	BIO* next_bio = BIO_next(bio);
+
+	if (!chunks && (count > 0))
+		return -1;
+
+	for (index = 0; index < count; index++)
+		total += chunks[index].size;
+
+	if (total > INT32_MAX)
+		return -1;
+
+	ptr->writeBlocked = FALSE;
+	BIO_clear_flags(bio, BIO_FLAGS_WRITE);
+
+	/* older data goes out first */
+	if (ringbuffer_used(&ptr->xmitBuffer) && (transport_bio_buffered_drain(bio) < 0))
+		return -1;
+
+	if ((total > 0) && !ringbuffer_used(&ptr->xmitBuffer) &&
+	    (BIO_method_type(next_bio) == BIO_TYPE_SIMPLE))
+	{
+		status = BIO_write_vector(next_bio, chunks,
+		                          (count > BIO_WRITE_VECTOR_MAX) ? BIO_WRITE_VECTOR_MAX : count);
+
+		if (status < 0)
+		{
+			if (!BIO_should_retry(next_bio))
+			{
+				BIO_clear_flags(bio, BIO_FLAGS_SHOULD_RETRY);
+				return -1;
+			}
+
+			status = 0;
+		}
+
+		sent = (size_t) status;
+	}
+
+	if (sent < total)
+	{
+		for (index = 0; index < count; index++)
+		{
+			const BYTE* data = chunks[index].data;
+			size_t size = chunks[index].size;
+
+			if (sent >= size)
+			{
+				sent -= size;
+				continue;
+			}
+
+			data += sent;
+			size -= sent;
+			sent = 0;
+
+			if (!ringbuffer_write(&ptr->xmitBuffer, data, size))
+			{
+				WLog_ERR(TAG, "an error occurred when writing (num: %"PRIuz")", size);
+				return -1;
+			}
+		}
+
+		/* anything left over means the socket is full, try to send it anyway */
+		if (!ptr->writeBlocked && (transport_bio_buffered_drain(bio) < 0))
+			return -1;
+	}
+
+	return (long) total;
+}
+
+static int transport_bio_buffered_write(BIO* bio, const char* buf, int num)
+{
+	DataChunk chunk;
+
+	if (num < 0)
+		return -1;
+
+	chunk.data = (const BYTE*) buf;
+	chunk.size = (size_t) num;
+	return (int) transport_bio_buffered_write_vector(bio, &chunk, (buf && num) ? 1 : 0);
+}
+
 static int transport_bio_buffered_read(BIO* bio, char* buf, int size)
 {
 	int status;
@@ -601,6 +757,10 @@ static long transport_bio_buffered_ctrl(BIO* bio, int cmd, long arg1, void* arg2
 			status = (int) ptr->writeBlocked;
 			break;
 
+		case BIO_C_WRITE_VECTOR:
+			status = (int) transport_bio_buffered_write_vector(bio, (const DataChunk*) arg2, arg1);
+			break;
+
 		default:
 			status = BIO_ctrl(BIO_next(bio), cmd, arg1, arg2);
 			break;
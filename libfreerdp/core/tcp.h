@@ -50,6 +50,7 @@
 #define BIO_C_WRITE_BLOCKED		1106
 #define BIO_C_WAIT_READ			1107
 #define BIO_C_WAIT_WRITE		1108
+#define BIO_C_WRITE_VECTOR		1109
 
 #define BIO_set_socket(b, s, c)		BIO_ctrl(b, BIO_C_SET_SOCKET, c, s);
 #define BIO_get_socket(b, c)		BIO_ctrl(b, BIO_C_GET_SOCKET, 0, (char*) c)
@@ -60,6 +61,14 @@
 #define BIO_wait_read(b, c)		BIO_ctrl(b, BIO_C_WAIT_READ, c, NULL)
 #define BIO_wait_write(b, c)		BIO_ctrl(b, BIO_C_WAIT_WRITE, c, NULL)
 
+/**
+ * Writes the c DataChunks of v with a single gather call. Only the simple and
+ * buffered socket BIOs implement it, the return value is the number of bytes
+ * consumed or -1 with the retry flags set like BIO_write does.
+ */
+#define BIO_write_vector(b, v, c)	BIO_ctrl(b, BIO_C_WRITE_VECTOR, c, (void*) v)
+#define BIO_WRITE_VECTOR_MAX		64
+
 FREERDP_LOCAL BIO_METHOD* BIO_s_simple_socket(void);
 FREERDP_LOCAL BIO_METHOD* BIO_s_buffered_socket(void);
 
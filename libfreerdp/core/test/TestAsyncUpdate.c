@@ -0,0 +1,345 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/freerdp.h>
+
+#include "../update.h"
+#include "../message.h"
+
+#define TEST_ORDERS 600
+#define TEST_MAX_POINTS 32
+#define TEST_BITMAP_LARGE (256 * 1024)
+#define TEST_BITMAP_SMALL 7
+#define TEST_TIMEOUT 10000
+/* at most this many blocks are kept for reuse by an arena */
+#define TEST_MAX_FREE_BLOCKS 8
+
+struct test_state
+{
+	HANDLE gate;
+	HANDLE done;
+	UINT32 orders;
+	UINT32 bounds;
+	UINT32 bitmaps;
+	BOOL valid;
+};
+typedef struct test_state TEST_STATE;
+
+static TEST_STATE state;
+
+static BYTE test_data_byte(UINT32 rect, size_t offset)
+{
+	return (BYTE)((rect * 13) + offset + (offset >> 8));
+}
+
+static void test_fill_multi_opaque_rect(MULTI_OPAQUE_RECT_ORDER* order, UINT32 i)
+{
+	UINT32 k;
+	ZeroMemory(order, sizeof(MULTI_OPAQUE_RECT_ORDER));
+	order->nLeftRect = (INT32) i;
+	order->color = 0xC0000000 | i;
+	order->numRectangles = 1 + (i % ARRAYSIZE(order->rectangles));
+
+	for (k = 0; k < order->numRectangles; k++)
+	{
+		order->rectangles[k].left = (INT32)(i * 100 + k);
+		order->rectangles[k].height = (INT32) k;
+	}
+}
+
+static void test_fill_polyline(POLYLINE_ORDER* order, DELTA_POINT* points, UINT32 i)
+{
+	UINT32 k;
+	ZeroMemory(order, sizeof(POLYLINE_ORDER));
+	order->xStart = (INT32) i;
+	order->penColor = 0xA0000000 | i;
+	order->numDeltaEntries = 1 + (i % TEST_MAX_POINTS);
+	order->points = points;
+
+	for (k = 0; k < order->numDeltaEntries; k++)
+	{
+		points[k].x = (INT32)(i + k);
+		points[k].y = -(INT32)(i + k);
+	}
+}
+
+static BOOL test_BeginPaint(rdpContext* context)
+{
+	WINPR_UNUSED(context);
+	return WaitForSingleObject(state.gate, TEST_TIMEOUT) == WAIT_OBJECT_0;
+}
+
+static BOOL test_EndPaint(rdpContext* context)
+{
+	WINPR_UNUSED(context);
+	return SetEvent(state.done);
+}
+
+static BOOL test_SetBounds(rdpContext* context, const rdpBounds* bounds)
+{
+	WINPR_UNUSED(context);
+
+	if (!bounds || (bounds->left != (INT32) state.orders) || (bounds->bottom != 1000))
+		state.valid = FALSE;
+
+	state.bounds++;
+	return TRUE;
+}
+
+static BOOL test_MultiOpaqueRect(rdpContext* context, const MULTI_OPAQUE_RECT_ORDER* order)
+{
+	MULTI_OPAQUE_RECT_ORDER expected;
+	WINPR_UNUSED(context);
+	test_fill_multi_opaque_rect(&expected, state.orders);
+
+	if (memcmp(order, &expected, sizeof(MULTI_OPAQUE_RECT_ORDER)) != 0)
+		state.valid = FALSE;
+
+	state.orders++;
+	return TRUE;
+}
+
+static BOOL test_Polyline(rdpContext* context, const POLYLINE_ORDER* order)
+{
+	POLYLINE_ORDER expected;
+	DELTA_POINT points[TEST_MAX_POINTS];
+	WINPR_UNUSED(context);
+	test_fill_polyline(&expected, points, state.orders);
+
+	if ((order->xStart != expected.xStart) || (order->penColor != expected.penColor) ||
+	    (order->numDeltaEntries != expected.numDeltaEntries) || !order->points ||
+	    (memcmp(order->points, points, sizeof(DELTA_POINT) * expected.numDeltaEntries) != 0))
+		state.valid = FALSE;
+
+	state.orders++;
+	return TRUE;
+}
+
+static BOOL test_BitmapUpdate(rdpContext* context, const BITMAP_UPDATE* bitmap)
+{
+	size_t k;
+	const UINT32 lengths[] = { TEST_BITMAP_LARGE, TEST_BITMAP_SMALL, 0 };
+	WINPR_UNUSED(context);
+
+	if (!bitmap || (bitmap->number != ARRAYSIZE(lengths)) || !bitmap->rectangles)
+	{
+		state.valid = FALSE;
+		return TRUE;
+	}
+
+	for (k = 0; k < ARRAYSIZE(lengths); k++)
+	{
+		size_t j;
+		const BITMAP_DATA* rect = &bitmap->rectangles[k];
+
+		if ((rect->destLeft != k) || (rect->bitmapLength != lengths[k]) ||
+		    ((rect->bitmapDataStream == NULL) != (lengths[k] == 0)))
+		{
+			state.valid = FALSE;
+			continue;
+		}
+
+		for (j = 0; j < rect->bitmapLength; j++)
+		{
+			if (rect->bitmapDataStream[j] != test_data_byte((UINT32) k, j))
+			{
+				state.valid = FALSE;
+				break;
+			}
+		}
+	}
+
+	state.bitmaps++;
+	return TRUE;
+}
+
+/* Queues TEST_ORDERS orders and an oversized bitmap update, without paint brackets */
+static BOOL test_send_frame(rdpUpdate* update, UINT32 first)
+{
+	UINT32 i;
+	BOOL rc = FALSE;
+	BITMAP_UPDATE bitmap = { 0 };
+	BITMAP_DATA rects[3] = { 0 };
+	DELTA_POINT points[TEST_MAX_POINTS];
+	rdpContext* context = update->context;
+
+	for (i = first; i < first + TEST_ORDERS; i++)
+	{
+		if ((i % 2) == 0)
+		{
+			rdpBounds bounds = { 0 };
+			MULTI_OPAQUE_RECT_ORDER order;
+			bounds.left = (INT32) i;
+			bounds.bottom = 1000;
+			test_fill_multi_opaque_rect(&order, i);
+
+			if (!update->SetBounds(context, &bounds) ||
+			    !update->primary->MultiOpaqueRect(context, &order))
+				return FALSE;
+		}
+		else
+		{
+			POLYLINE_ORDER order;
+			test_fill_polyline(&order, points, i);
+
+			if (!update->primary->Polyline(context, &order))
+				return FALSE;
+		}
+	}
+
+	bitmap.number = ARRAYSIZE(rects);
+	bitmap.rectangles = rects;
+
+	for (i = 0; i < ARRAYSIZE(rects); i++)
+	{
+		size_t k;
+		rects[i].destLeft = i;
+		rects[i].bitmapLength = (i == 0) ? TEST_BITMAP_LARGE : (i == 1) ? TEST_BITMAP_SMALL : 0;
+
+		if (rects[i].bitmapLength == 0)
+			continue;
+
+		if (!(rects[i].bitmapDataStream = (BYTE*) malloc(rects[i].bitmapLength)))
+			goto fail;
+
+		for (k = 0; k < rects[i].bitmapLength; k++)
+			rects[i].bitmapDataStream[k] = test_data_byte(i, k);
+	}
+
+	rc = update->BitmapUpdate(context, &bitmap);
+fail:
+
+	for (i = 0; i < ARRAYSIZE(rects); i++)
+		free(rects[i].bitmapDataStream);
+
+	return rc;
+}
+
+static void test_register_callbacks(rdpUpdate* update)
+{
+	update->BeginPaint = test_BeginPaint;
+	update->EndPaint = test_EndPaint;
+	update->SetBounds = test_SetBounds;
+	update->BitmapUpdate = test_BitmapUpdate;
+	update->primary->MultiOpaqueRect = test_MultiOpaqueRect;
+	update->primary->Polyline = test_Polyline;
+}
+
+int TestAsyncUpdate(int argc, char* argv[])
+{
+	int rc = -1;
+	LONG blocks;
+	LONG baseline;
+	rdpUpdate* update;
+	rdpContext* context;
+	freerdp* instance = NULL;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+	ZeroMemory(&state, sizeof(state));
+	state.valid = TRUE;
+	state.gate = CreateEvent(NULL, TRUE, FALSE, NULL);
+	state.done = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (!state.gate || !state.done)
+		goto fail;
+
+	if (!(instance = freerdp_new()) || !freerdp_context_new(instance))
+		goto fail;
+
+	context = instance->context;
+	update = context->update;
+	/* the proxy forwards to whatever is registered when it is created */
+	test_register_callbacks(update);
+	baseline = update_message_arena_blocks();
+
+	if (!(update->proxy = update_message_proxy_new(update)))
+		goto fail;
+
+	/* a frame spanning several blocks, queued while the update thread waits */
+	if (!update->BeginPaint(context) || !test_send_frame(update, 0) || !update->EndPaint(context))
+		goto fail;
+
+	blocks = update_message_arena_blocks() - baseline;
+
+	if (blocks < 4)
+	{
+		fprintf(stderr, "frame used %"PRId32" arena blocks, expected at least 4\n", blocks);
+		goto fail;
+	}
+
+	SetEvent(state.gate);
+
+	if (WaitForSingleObject(state.done, TEST_TIMEOUT) != WAIT_OBJECT_0)
+	{
+		fprintf(stderr, "frame was not drawn\n");
+		goto fail;
+	}
+
+	if (!state.valid || (state.orders != TEST_ORDERS) || (state.bounds != TEST_ORDERS / 2) ||
+	    (state.bitmaps != 1))
+	{
+		fprintf(stderr, "drawn %"PRIu32" orders, %"PRIu32" bounds, %"PRIu32" bitmaps, %s\n",
+		        state.orders, state.bounds, state.bitmaps, state.valid ? "valid" : "corrupted");
+		goto fail;
+	}
+
+	/* everything is drawn, only recycled blocks may be left */
+	blocks = update_message_arena_blocks() - baseline;
+
+	if (blocks > TEST_MAX_FREE_BLOCKS)
+	{
+		fprintf(stderr, "%"PRId32" arena blocks left after the frame\n", blocks);
+		goto fail;
+	}
+
+	/*
+	 * Stop the update thread early, the next frame stays queued and must be
+	 * released by update_message_proxy_free.
+	 */
+	if (!MessageQueue_PostQuit(update->queue, 0) || !update->BeginPaint(context) ||
+	    !test_send_frame(update, TEST_ORDERS) || !update->EndPaint(context))
+		goto fail;
+
+	update_message_proxy_free(update->proxy);
+	update->proxy = NULL;
+	blocks = update_message_arena_blocks() - baseline;
+
+	if (blocks != 0)
+	{
+		fprintf(stderr, "%"PRId32" arena blocks leaked\n", blocks);
+		goto fail;
+	}
+
+	if (state.orders != TEST_ORDERS)
+	{
+		fprintf(stderr, "queued orders were drawn after quit\n");
+		goto fail;
+	}
+
+	rc = 0;
+fail:
+
+	if (instance)
+	{
+		if (instance->context && instance->context->update->proxy)
+		{
+			SetEvent(state.gate);
+			update_message_proxy_free(instance->context->update->proxy);
+			instance->context->update->proxy = NULL;
+		}
+
+		freerdp_context_free(instance);
+		freerdp_free(instance);
+	}
+
+	if (state.gate)
+		CloseHandle(state.gate);
+
+	if (state.done)
+		CloseHandle(state.done);
+
+	return rc;
+}
@@ -0,0 +1,542 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/path.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+
+#include <openssl/pem.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/crypto/crypto.h>
+#include <freerdp/crypto/tls.h>
+
+#include "../rdp.h"
+#include "../transport.h"
+#include "../rdpudp.h"
+#include "../multitransport.h"
+
+#define TEST_STREAM_SIZE (512 * 1024)
+#define TEST_DATAGRAM_COUNT 1000
+#define TEST_DATAGRAM_SIZE 1000
+#define TEST_LOSS 100
+#define TEST_TIMEOUT 30000
+#define TEST_REJECT_TIMEOUT 2000
+
+struct test_receiver
+{
+	CRITICAL_SECTION lock;
+	BYTE* data;
+	size_t length;
+	size_t capacity;
+	BYTE seen[TEST_DATAGRAM_COUNT];
+	UINT32 datagrams;
+	BOOL valid;
+};
+
+static BYTE test_stream_byte(size_t offset)
+{
+	return (BYTE)((offset * 31) ^ (offset >> 9));
+}
+
+static BOOL test_stream_receive(void* context, const BYTE* data, size_t length)
+{
+	struct test_receiver* receiver = (struct test_receiver*) context;
+	EnterCriticalSection(&receiver->lock);
+
+	if (receiver->length + length > receiver->capacity)
+		receiver->valid = FALSE;
+	else
+	{
+		CopyMemory(&receiver->data[receiver->length], data, length);
+		receiver->length += length;
+	}
+
+	LeaveCriticalSection(&receiver->lock);
+	return TRUE;
+}
+
+static BOOL test_datagram_receive(void* context, const BYTE* data, size_t length)
+{
+	size_t i;
+	UINT32 index;
+	struct test_receiver* receiver = (struct test_receiver*) context;
+
+	if (length != TEST_DATAGRAM_SIZE)
+	{
+		receiver->valid = FALSE;
+		return TRUE;
+	}
+
+	index = data[0] | (data[1] << 8);
+
+	for (i = 2; i < length; i++)
+	{
+		if (data[i] != (BYTE)(index + i))
+			receiver->valid = FALSE;
+	}
+
+	EnterCriticalSection(&receiver->lock);
+
+	if ((index >= TEST_DATAGRAM_COUNT) || receiver->seen[index])
+		receiver->valid = FALSE;
+	else
+	{
+		receiver->seen[index] = 1;
+		receiver->datagrams++;
+	}
+
+	LeaveCriticalSection(&receiver->lock);
+	return TRUE;
+}
+
+static BOOL test_tunnel_receive(rdpMultitransport* multitransport, const BYTE* data,
+                                size_t length, void* custom)
+{
+	WINPR_UNUSED(multitransport);
+	return test_stream_receive(custom, data, length);
+}
+
+static size_t test_received(struct test_receiver* receiver)
+{
+	size_t length;
+	EnterCriticalSection(&receiver->lock);
+	length = receiver->length;
+	LeaveCriticalSection(&receiver->lock);
+	return length;
+}
+
+static BOOL test_wait_received(struct test_receiver* receiver, size_t length)
+{
+	const UINT64 end = GetTickCount64() + TEST_TIMEOUT;
+
+	while ((test_received(receiver) < length) && (GetTickCount64() < end))
+		Sleep(10);
+
+	return test_received(receiver) == length;
+}
+
+static void test_print_stats(const char* name, rdpUdp* udp)
+{
+	RDPUDP_STATS stats;
+	rdpudp_get_stats(udp, &stats);
+	printf("%s: sent %"PRIu32" received %"PRIu32" retransmitted %"PRIu32" lost %"PRIu32
+	       " recovered %"PRIu32" dropped %"PRIu32" rtt %"PRIu32" cwnd %"PRIu32"\n", name,
+	       stats.sent, stats.received, stats.retransmitted, stats.lost, stats.recovered,
+	       stats.dropped, stats.rtt, stats.cwnd);
+}
+
+static BOOL test_udp_pair(BOOL lossy, struct test_receiver* receiver, rdpUdp** pserver,
+                          rdpUdp** pclient)
+{
+	rdpUdp* server = rdpudp_new(lossy, lossy ? test_datagram_receive : test_stream_receive,
+	                            receiver);
+	rdpUdp* client = rdpudp_new(lossy, NULL, NULL);
+	*pserver = server;
+	*pclient = client;
+
+	if (!server || !client)
+		return FALSE;
+
+	if (!rdpudp_listen(server, "127.0.0.1", 0))
+		return FALSE;
+
+	if (!rdpudp_connect(client, "127.0.0.1", rdpudp_get_port(server), 5000) ||
+	    !rdpudp_accept(server, 5000))
+	{
+		printf("handshake failed\n");
+		return FALSE;
+	}
+
+	/* loss in both directions, acks get lost as well */
+	rdpudp_set_loss(server, TEST_LOSS, 0x1234);
+	rdpudp_set_loss(client, TEST_LOSS, 0x5678);
+	return TRUE;
+}
+
+static BOOL test_reliable(void)
+{
+	size_t i;
+	size_t offset = 0;
+	BOOL rc = FALSE;
+	RDPUDP_STATS stats;
+	rdpUdp* server = NULL;
+	rdpUdp* client = NULL;
+	BYTE* data = malloc(TEST_STREAM_SIZE);
+	struct test_receiver receiver = { 0 };
+	InitializeCriticalSection(&receiver.lock);
+	receiver.valid = TRUE;
+	receiver.capacity = TEST_STREAM_SIZE;
+	receiver.data = malloc(TEST_STREAM_SIZE);
+
+	if (!data || !receiver.data || !test_udp_pair(FALSE, &receiver, &server, &client))
+		goto fail;
+
+	for (i = 0; i < TEST_STREAM_SIZE; i++)
+		data[i] = test_stream_byte(i);
+
+	/* write sizes not aligned to the datagram payload */
+	while (offset < TEST_STREAM_SIZE)
+	{
+		const size_t length = MIN(TEST_STREAM_SIZE - offset, 700 + (offset % 5000));
+
+		if (!rdpudp_write(client, &data[offset], length))
+			goto fail;
+
+		offset += length;
+	}
+
+	if (!test_wait_received(&receiver, TEST_STREAM_SIZE) || !receiver.valid)
+	{
+		printf("reliable: received %"PRIuz" of %d bytes\n", test_received(&receiver),
+		       TEST_STREAM_SIZE);
+		goto fail;
+	}
+
+	if (memcmp(receiver.data, data, TEST_STREAM_SIZE) != 0)
+	{
+		printf("reliable: stream corrupted\n");
+		goto fail;
+	}
+
+	test_print_stats("reliable", client);
+	rdpudp_get_stats(client, &stats);
+
+	if ((stats.retransmitted == 0) || (stats.dropped == 0))
+	{
+		printf("reliable: loss was not exercised\n");
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	rdpudp_free(client);
+	rdpudp_free(server);
+	free(data);
+	free(receiver.data);
+	DeleteCriticalSection(&receiver.lock);
+	return rc;
+}
+
+static BOOL test_lossy(void)
+{
+	size_t i;
+	UINT32 index;
+	BOOL rc = FALSE;
+	RDPUDP_STATS stats;
+	rdpUdp* server = NULL;
+	rdpUdp* client = NULL;
+	BYTE datagram[TEST_DATAGRAM_SIZE];
+	struct test_receiver receiver = { 0 };
+	InitializeCriticalSection(&receiver.lock);
+	receiver.valid = TRUE;
+
+	if (!test_udp_pair(TRUE, &receiver, &server, &client))
+		goto fail;
+
+	for (index = 0; index < TEST_DATAGRAM_COUNT; index++)
+	{
+		datagram[0] = (BYTE)(index & 0xFF);
+		datagram[1] = (BYTE)(index >> 8);
+
+		for (i = 2; i < sizeof(datagram); i++)
+			datagram[i] = (BYTE)(index + i);
+
+		if (!rdpudp_write(client, datagram, sizeof(datagram)))
+			goto fail;
+	}
+
+	rdpudp_flush(client, TEST_TIMEOUT);
+	Sleep(200);
+	test_print_stats("lossy", client);
+	test_print_stats("lossy receiver", server);
+	rdpudp_get_stats(server, &stats);
+	printf("lossy: %"PRIu32" of %d datagrams delivered\n", receiver.datagrams,
+	       TEST_DATAGRAM_COUNT);
+
+	if (!receiver.valid)
+	{
+		printf("lossy: duplicate or corrupted datagram\n");
+		goto fail;
+	}
+
+	/* 10% loss, FEC recovers most single losses per group */
+	if ((receiver.datagrams < TEST_DATAGRAM_COUNT * 93 / 100) || (stats.recovered == 0))
+	{
+		printf("lossy: FEC did not recover enough datagrams\n");
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	rdpudp_free(client);
+	rdpudp_free(server);
+	DeleteCriticalSection(&receiver.lock);
+	return rc;
+}
+
+static BOOL test_set_public_key(rdpRdp* rdp, const char* certificate)
+{
+	BOOL rc = FALSE;
+	struct crypto_cert_struct cert = { 0 };
+	BIO* bio = BIO_new_file(certificate, "rb");
+
+	if (!bio)
+		return FALSE;
+
+	if (!(cert.px509 = PEM_read_bio_X509(bio, NULL, NULL, 0)))
+		goto fail;
+
+	if (!(rdp->transport->tls = tls_new(rdp->settings)))
+		goto fail;
+
+	rc = crypto_cert_get_public_key(&cert, &rdp->transport->tls->PublicKey,
+	                                &rdp->transport->tls->PublicKeyLength);
+fail:
+	X509_free(cert.px509);
+	BIO_free_all(bio);
+	return rc;
+}
+
+static BOOL test_tunnel(rdpRdp* rdp, UINT16 requestedProtocol)
+{
+	size_t i;
+	BOOL rc = FALSE;
+	BYTE message[900];
+	BYTE cookie[16];
+	const char* name = (requestedProtocol == INITITATE_REQUEST_PROTOCOL_UDPFECL) ? "DTLS" : "TLS";
+	rdpMultitransport* server = multitransport_new(rdp);
+	rdpMultitransport* client = multitransport_new(rdp);
+	struct test_receiver receiver = { 0 };
+	InitializeCriticalSection(&receiver.lock);
+	receiver.valid = TRUE;
+	receiver.capacity = sizeof(message);
+
+	if (!server || !client || !(receiver.data = malloc(sizeof(message))))
+		goto fail;
+
+	for (i = 0; i < sizeof(message); i++)
+		message[i] = test_stream_byte(i);
+
+	multitransport_set_tunnel_data_callback(server, test_tunnel_receive, &receiver);
+
+	/* a wrong security cookie must not open the tunnel */
+	if (!multitransport_listen(server, requestedProtocol, "127.0.0.1", 0))
+		goto fail;
+
+	rdp->settings->ServerPort = rdpudp_get_port(server->udp);
+	CopyMemory(cookie, server->securityCookie, sizeof(cookie));
+	cookie[0] ^= 0xFF;
+
+	if (!multitransport_connect(client, server->requestId, requestedProtocol, cookie))
+		goto fail;
+
+	if (multitransport_wait(client, TEST_REJECT_TIMEOUT) ||
+	    multitransport_wait(server, TEST_REJECT_TIMEOUT))
+	{
+		printf("%s: tunnel created with an invalid cookie\n", name);
+		goto fail;
+	}
+
+	if (!multitransport_listen(server, requestedProtocol, "127.0.0.1", 0))
+		goto fail;
+
+	rdp->settings->ServerPort = rdpudp_get_port(server->udp);
+
+	if (!multitransport_connect(client, server->requestId, requestedProtocol,
+	                            server->securityCookie))
+		goto fail;
+
+	if (!multitransport_wait(client, TEST_TIMEOUT) || !multitransport_wait(server, TEST_TIMEOUT))
+	{
+		printf("%s: tunnel creation failed\n", name);
+		goto fail;
+	}
+
+	if (requestedProtocol == INITITATE_REQUEST_PROTOCOL_UDPFECR)
+	{
+		rdpudp_set_loss(client->udp, TEST_LOSS, 0x9abc);
+		rdpudp_set_loss(server->udp, TEST_LOSS, 0xdef0);
+	}
+
+	if (!multitransport_write(client, message, sizeof(message)))
+		goto fail;
+
+	if (!test_wait_received(&receiver, sizeof(message)) ||
+	    (memcmp(receiver.data, message, sizeof(message)) != 0))
+	{
+		printf("%s: tunnel data corrupted\n", name);
+		goto fail;
+	}
+
+	printf("%s: tunnel ok\n", name);
+	rc = TRUE;
+fail:
+	multitransport_free(client);
+	multitransport_free(server);
+	free(receiver.data);
+	DeleteCriticalSection(&receiver.lock);
+	return rc;
+}
+
+/**
+ * Two server connections listen on the same port at once, each client tunnel
+ * must end up at the connection that issued its request.
+ */
+static BOOL test_shared_port(rdpRdp* rdp)
+{
+	size_t i;
+	BOOL rc = FALSE;
+	UINT16 port;
+	BYTE message[2][600];
+	rdpMultitransport* server[2] = { NULL, NULL };
+	rdpMultitransport* client[2] = { NULL, NULL };
+	struct test_receiver receiver[2];
+	rdpUdp* stray = rdpudp_new(FALSE, NULL, NULL);
+	ZeroMemory(receiver, sizeof(receiver));
+
+	for (i = 0; i < 2; i++)
+	{
+		size_t j;
+		InitializeCriticalSection(&receiver[i].lock);
+		receiver[i].valid = TRUE;
+		receiver[i].capacity = sizeof(message[i]);
+
+		for (j = 0; j < sizeof(message[i]); j++)
+			message[i][j] = (BYTE)(test_stream_byte(j) ^ (i + 1));
+	}
+
+	for (i = 0; i < 2; i++)
+	{
+		if (!(server[i] = multitransport_new(rdp)) || !(client[i] = multitransport_new(rdp)) ||
+		    !(receiver[i].data = malloc(sizeof(message[i]))))
+			goto fail;
+
+		multitransport_set_tunnel_data_callback(server[i], test_tunnel_receive, &receiver[i]);
+	}
+
+	if (!stray || !multitransport_listen(server[0], INITITATE_REQUEST_PROTOCOL_UDPFECR,
+	                                     "127.0.0.1", 0))
+		goto fail;
+
+	port = rdpudp_get_port(server[0]->udp);
+
+	if (!multitransport_listen(server[1], INITITATE_REQUEST_PROTOCOL_UDPFECR, "127.0.0.1", port))
+	{
+		printf("shared port: second listener failed\n");
+		goto fail;
+	}
+
+	/* a SYN without correlation id cannot tell the pending connections apart */
+	if (rdpudp_connect(stray, "127.0.0.1", port, TEST_REJECT_TIMEOUT))
+	{
+		printf("shared port: stray peer took over a pending connection\n");
+		goto fail;
+	}
+
+	rdp->settings->ServerPort = port;
+
+	/* connect in reverse order, matching must not depend on the listen order */
+	for (i = 2; i > 0; i--)
+	{
+		if (!multitransport_connect(client[i - 1], server[i - 1]->requestId,
+		                            INITITATE_REQUEST_PROTOCOL_UDPFECR,
+		                            server[i - 1]->securityCookie))
+			goto fail;
+	}
+
+	for (i = 0; i < 2; i++)
+	{
+		if (!multitransport_wait(client[i], TEST_TIMEOUT) ||
+		    !multitransport_wait(server[i], TEST_TIMEOUT))
+		{
+			printf("shared port: tunnel %"PRIuz" creation failed\n", i);
+			goto fail;
+		}
+	}
+
+	for (i = 0; i < 2; i++)
+	{
+		if (!multitransport_write(client[i], message[i], sizeof(message[i])))
+			goto fail;
+	}
+
+	for (i = 0; i < 2; i++)
+	{
+		if (!test_wait_received(&receiver[i], sizeof(message[i])) ||
+		    (memcmp(receiver[i].data, message[i], sizeof(message[i])) != 0))
+		{
+			printf("shared port: tunnel %"PRIuz" data misrouted\n", i);
+			goto fail;
+		}
+	}
+
+	printf("shared port: ok\n");
+	rc = TRUE;
+fail:
+	rdpudp_free(stray);
+
+	for (i = 0; i < 2; i++)
+	{
+		multitransport_free(client[i]);
+		multitransport_free(server[i]);
+		free(receiver[i].data);
+		DeleteCriticalSection(&receiver[i].lock);
+	}
+
+	return rc;
+}
+
+int TestMultitransport(int argc, char* argv[])
+{
+	int rc = -1;
+	char* certificate = NULL;
+	char* key = NULL;
+	freerdp* instance = NULL;
+	rdpRdp* rdp;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_reliable() || !test_lossy())
+		return -1;
+
+	certificate = GetCombinedPath(TESTING_SRC_DIRECTORY, "server/Sample/server.crt");
+	key = GetCombinedPath(TESTING_SRC_DIRECTORY, "server/Sample/server.key");
+
+	if (!certificate || !key)
+		goto fail;
+
+	if (!(instance = freerdp_new()) || !freerdp_context_new(instance))
+		goto fail;
+
+	/* one context plays both ends of the tunnel */
+	rdp = instance->context->rdp;
+
+	if (!freerdp_settings_set_string(rdp->settings, FreeRDP_CertificateFile, certificate) ||
+	    !freerdp_settings_set_string(rdp->settings, FreeRDP_PrivateKeyFile, key) ||
+	    !freerdp_settings_set_string(rdp->settings, FreeRDP_ServerHostname, "127.0.0.1"))
+		goto fail;
+
+	if (!test_set_public_key(rdp, certificate))
+	{
+		printf("failed to read %s\n", certificate);
+		goto fail;
+	}
+
+	if (!test_tunnel(rdp, INITITATE_REQUEST_PROTOCOL_UDPFECR) ||
+	    !test_tunnel(rdp, INITITATE_REQUEST_PROTOCOL_UDPFECL) || !test_shared_port(rdp))
+		goto fail;
+
+	rc = 0;
+fail:
+
+	if (instance)
+	{
+		freerdp_context_free(instance);
+		freerdp_free(instance);
+	}
+
+	free(certificate);
+	free(key);
+	return rc;
+}
@@ -0,0 +1,598 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/path.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/cache/cache.h>
+#include <freerdp/cache/persistent.h>
+
+#include "../rdp.h"
+#include "../activation.h"
+#include "../../cache/bitmap.h"
+
+#define TEST_SLOTS 300
+#define TEST_BITMAP_SIZE 8
+#define TEST_MAX_PDU_ENTRIES 169
+
+/* cell 1 is not persistent and has no slots in the file */
+#define TEST_CELL0_ENTRIES 120
+#define TEST_CELL1_ENTRIES 64
+#define TEST_CELL2_ENTRIES 200
+
+static char* test_cache_file(const char* name)
+{
+	char* file;
+	char* path = GetKnownPath(KNOWN_PATH_TEMP);
+	char buffer[64];
+
+	if (!path)
+		return NULL;
+
+	sprintf_s(buffer, sizeof(buffer), "%s_%"PRIu32".bmc", name, GetCurrentProcessId());
+	file = GetCombinedPath(path, buffer);
+	free(path);
+
+	if (file)
+		DeleteFileA(file);
+
+	return file;
+}
+
+static UINT64 test_key(UINT32 id, UINT32 index)
+{
+	return ((UINT64)(0xA0 + id) << 32) | (0x1000 + index);
+}
+
+static BOOL test_write(rdpPersistentCache* persistent, UINT32 slot, UINT64 key64,
+                       UINT16 width, UINT16 height)
+{
+	size_t i;
+	BOOL rc;
+	PERSISTENT_CACHE_ENTRY entry = { 0 };
+	entry.key64 = key64;
+	entry.width = width;
+	entry.height = height;
+	entry.size = width * height * 4U;
+	entry.data = (BYTE*) malloc(entry.size ? entry.size : 1);
+
+	if (!entry.data)
+		return FALSE;
+
+	for (i = 0; i < entry.size; i++)
+		entry.data[i] = (BYTE)(key64 + i);
+
+	rc = persistent_cache_write_entry(persistent, slot, &entry);
+	free(entry.data);
+	return rc;
+}
+
+static BOOL test_read(rdpPersistentCache* persistent, UINT32 slot, UINT64 key64,
+                      UINT16 width, UINT16 height)
+{
+	size_t i;
+	PERSISTENT_CACHE_ENTRY entry;
+
+	if (!persistent_cache_read_entry(persistent, slot, &entry))
+	{
+		fprintf(stderr, "failed to read slot %"PRIu32"\n", slot);
+		return FALSE;
+	}
+
+	if ((entry.key64 != key64) || (entry.width != width) || (entry.height != height))
+	{
+		fprintf(stderr, "slot %"PRIu32": key %"PRIx64" %"PRIu16"x%"PRIu16", expected %"PRIx64
+		        " %"PRIu16"x%"PRIu16"\n", slot, entry.key64, entry.width, entry.height, key64,
+		        width, height);
+		return FALSE;
+	}
+
+	if (key64 == 0)
+		return TRUE;
+
+	if (!entry.data || (entry.size != width * height * 4U))
+		return FALSE;
+
+	for (i = 0; i < entry.size; i++)
+	{
+		if (entry.data[i] != (BYTE)(key64 + i))
+		{
+			fprintf(stderr, "slot %"PRIu32": data mismatch at %"PRIuz"\n", slot, i);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL test_slot_expected(UINT32 slot, UINT64* key64, UINT16* width, UINT16* height)
+{
+	/* every third slot stays empty, sizes vary up to the maximum */
+	if ((slot % 3) == 1)
+	{
+		*key64 = 0;
+		*width = *height = 0;
+		return FALSE;
+	}
+
+	*key64 = test_key(9, slot);
+	*width = (UINT16)(1 + (slot % PERSIST_CACHE_ENTRY_MAX_WIDTH));
+	*height = (UINT16)(PERSIST_CACHE_ENTRY_MAX_HEIGHT - (slot % PERSIST_CACHE_ENTRY_MAX_HEIGHT));
+	return TRUE;
+}
+
+static BOOL test_round_trip(void)
+{
+	UINT32 slot;
+	BOOL rc = FALSE;
+	UINT64 key64;
+	UINT16 width, height;
+	char* file = test_cache_file("TestPersistentCache");
+	rdpPersistentCache* persistent = persistent_cache_new();
+
+	if (!file || !persistent || !persistent_cache_open(persistent, file, TEST_SLOTS))
+		goto fail;
+
+	for (slot = 0; slot < TEST_SLOTS; slot++)
+	{
+		if (test_slot_expected(slot, &key64, &width, &height) &&
+		    !test_write(persistent, slot, key64, width, height))
+			goto fail;
+	}
+
+	/* overwritten and cleared slots */
+	if (!test_write(persistent, 0, test_key(9, 0), 64, 64) ||
+	    !persistent_cache_clear_entry(persistent, TEST_SLOTS - 1))
+		goto fail;
+
+	/* invalid entries and slots are rejected */
+	if (test_write(persistent, 2, test_key(9, 2), PERSIST_CACHE_ENTRY_MAX_WIDTH + 1, 1) ||
+	    test_write(persistent, TEST_SLOTS, test_key(9, 2), 1, 1))
+		goto fail;
+
+	/* written data is visible before it was flushed */
+	if (!test_read(persistent, 3, test_key(9, 3), 4, 61))
+		goto fail;
+
+	persistent_cache_close(persistent);
+
+	if (!persistent_cache_open(persistent, file, TEST_SLOTS))
+		goto fail;
+
+	for (slot = 0; slot < TEST_SLOTS; slot++)
+	{
+		test_slot_expected(slot, &key64, &width, &height);
+
+		if (slot == 0)
+			width = height = 64;
+		else if (slot == TEST_SLOTS - 1)
+		{
+			key64 = 0;
+			width = height = 0;
+		}
+
+		if (!test_read(persistent, slot, key64, width, height))
+			goto fail;
+	}
+
+	rc = TRUE;
+fail:
+
+	if (!rc)
+		fprintf(stderr, "persistent cache round trip failed\n");
+
+	persistent_cache_free(persistent);
+
+	if (file)
+		DeleteFileA(file);
+
+	free(file);
+	return rc;
+}
+
+static BOOL test_cell_keyed(UINT32 id, UINT32 index)
+{
+	if (id == 0)
+		return (index % 5) != 2;
+
+	return (index % 50) != 0;
+}
+
+static UINT32 test_cell_count(UINT32 id, UINT32 number)
+{
+	UINT32 index;
+	UINT32 count = 0;
+
+	for (index = 0; index < number; index++)
+	{
+		if (test_cell_keyed(id, index))
+			count++;
+	}
+
+	return count;
+}
+
+/* cells 0 and 2 are persistent, their slots follow each other in the file */
+static BOOL test_prepare_keys(const char* file)
+{
+	UINT32 index;
+	BOOL rc = FALSE;
+	rdpPersistentCache* persistent = persistent_cache_new();
+
+	if (!persistent ||
+	    !persistent_cache_open(persistent, file, TEST_CELL0_ENTRIES + TEST_CELL2_ENTRIES))
+		goto fail;
+
+	for (index = 0; index < TEST_CELL0_ENTRIES; index++)
+	{
+		if (test_cell_keyed(0, index) &&
+		    !test_write(persistent, index, test_key(0, index), TEST_BITMAP_SIZE, TEST_BITMAP_SIZE))
+			goto fail;
+	}
+
+	for (index = 0; index < TEST_CELL2_ENTRIES; index++)
+	{
+		if (test_cell_keyed(2, index) &&
+		    !test_write(persistent, TEST_CELL0_ENTRIES + index, test_key(2, index),
+		                TEST_BITMAP_SIZE, TEST_BITMAP_SIZE))
+			goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	persistent_cache_free(persistent);
+	return rc;
+}
+
+static BOOL test_next_key(UINT32* id, UINT32* index, UINT64* key64)
+{
+	const UINT32 numbers[] = { TEST_CELL0_ENTRIES, TEST_CELL1_ENTRIES, TEST_CELL2_ENTRIES };
+
+	for (; *id < ARRAYSIZE(numbers); (*id)++, *index = 0)
+	{
+		if (*id == 1)
+			continue;
+
+		for (; *index < numbers[*id]; (*index)++)
+		{
+			if (test_cell_keyed(*id, *index))
+			{
+				*key64 = test_key(*id, (*index)++);
+				return TRUE;
+			}
+		}
+	}
+
+	return FALSE;
+}
+
+static BOOL test_parse_key_lists(rdpRdp* rdp, BIO* bio, UINT32* pdus)
+{
+	UINT32 i;
+	long size;
+	char* data = NULL;
+	UINT32 id = 0;
+	UINT32 index = 0;
+	UINT32 sent = 0;
+	wStream sbuffer;
+	wStream* s = &sbuffer;
+	const UINT16 totals[5] = { test_cell_count(0, TEST_CELL0_ENTRIES), 0,
+	                           test_cell_count(2, TEST_CELL2_ENTRIES), 0, 0
+	                         };
+	const UINT32 total = totals[0] + totals[2];
+	size = BIO_get_mem_data(bio, &data);
+
+	if ((size <= 0) || !data)
+		return FALSE;
+
+	Stream_StaticInit(s, (BYTE*) data, (size_t) size);
+	*pdus = 0;
+
+	while (Stream_GetRemainingLength(s) > 0)
+	{
+		BYTE type;
+		BYTE flags;
+		BYTE ctype;
+		UINT16 length, channelId, pduLength, pduType, source, clen;
+		UINT16 numEntries[5], totalEntries[5];
+		UINT32 shareId;
+		UINT32 count = 0;
+		size_t end = Stream_GetPosition(s);
+
+		/* the client writes send data requests */
+		if (!rdp_read_header(rdp, s, &length, &channelId))
+		{
+			fprintf(stderr, "PDU %"PRIu32" has no valid header\n", *pdus);
+			return FALSE;
+		}
+
+		/* length is that of the MCS user data now */
+		end = Stream_GetPosition(s) + length;
+
+		if (!rdp_read_share_control_header(s, &pduLength, &pduType, &source) ||
+		    (pduType != PDU_TYPE_DATA) ||
+		    !rdp_read_share_data_header(s, &pduLength, &type, &shareId, &ctype, &clen) ||
+		    (type != DATA_PDU_TYPE_BITMAP_CACHE_PERSISTENT_LIST) ||
+		    (Stream_GetRemainingLength(s) < 24))
+		{
+			fprintf(stderr, "PDU %"PRIu32" is no persistent key list\n", *pdus);
+			return FALSE;
+		}
+
+		for (i = 0; i < 5; i++)
+		{
+			Stream_Read_UINT16(s, numEntries[i]);
+			count += numEntries[i];
+		}
+
+		for (i = 0; i < 5; i++)
+			Stream_Read_UINT16(s, totalEntries[i]);
+
+		Stream_Read_UINT8(s, flags);
+		Stream_Seek(s, 3); /* pad1 (1 byte), pad3 (2 bytes) */
+
+		if (memcmp(totalEntries, totals, sizeof(totals)) != 0)
+		{
+			fprintf(stderr, "PDU %"PRIu32": wrong total entries\n", *pdus);
+			return FALSE;
+		}
+
+		if ((count > TEST_MAX_PDU_ENTRIES) || ((sent + count < total) &&
+		                                       (count != TEST_MAX_PDU_ENTRIES)))
+		{
+			fprintf(stderr, "PDU %"PRIu32": %"PRIu32" entries\n", *pdus, count);
+			return FALSE;
+		}
+
+		if (((flags & PERSIST_FIRST_PDU) != 0) != (sent == 0) ||
+		    ((flags & PERSIST_LAST_PDU) != 0) != (sent + count == total))
+		{
+			fprintf(stderr, "PDU %"PRIu32": flags 0x%02"PRIx8"\n", *pdus, flags);
+			return FALSE;
+		}
+
+		if (Stream_GetRemainingLength(s) < count * 8ULL)
+			return FALSE;
+
+		/* the keys of all caches follow each other, packed to the front */
+		for (i = 0; i < 5; i++)
+		{
+			UINT32 k;
+
+			for (k = 0; k < numEntries[i]; k++)
+			{
+				UINT32 key1, key2;
+				UINT64 expected = 0;
+
+				if (!test_next_key(&id, &index, &expected) || (id != i))
+				{
+					fprintf(stderr, "PDU %"PRIu32": unexpected entry for cache %"PRIu32"\n",
+					        *pdus, i);
+					return FALSE;
+				}
+
+				Stream_Read_UINT32(s, key1);
+				Stream_Read_UINT32(s, key2);
+
+				if ((((UINT64) key2 << 32) | key1) != expected)
+				{
+					fprintf(stderr, "PDU %"PRIu32": key %"PRIu32" mismatch\n", *pdus, sent + k);
+					return FALSE;
+				}
+			}
+		}
+
+		if (Stream_GetPosition(s) != end)
+		{
+			fprintf(stderr, "PDU %"PRIu32": %"PRIuz" trailing bytes\n", *pdus,
+			        end - Stream_GetPosition(s));
+			return FALSE;
+		}
+
+		sent += count;
+		(*pdus)++;
+	}
+
+	if (sent != total)
+	{
+		fprintf(stderr, "sent %"PRIu32" of %"PRIu32" keys\n", sent, total);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* after the load the keyed bitmaps of each cell are at the front of the file */
+static BOOL test_check_compacted(const char* file)
+{
+	UINT32 id, index;
+	BOOL rc = FALSE;
+	UINT32 slot = 0;
+	const UINT32 cells[] = { 0, 2 };
+	const UINT32 numbers[] = { TEST_CELL0_ENTRIES, TEST_CELL2_ENTRIES };
+	rdpPersistentCache* persistent = persistent_cache_new();
+
+	if (!persistent ||
+	    !persistent_cache_open(persistent, file, TEST_CELL0_ENTRIES + TEST_CELL2_ENTRIES))
+		goto fail;
+
+	for (id = 0; id < ARRAYSIZE(cells); id++)
+	{
+		UINT32 packed = 0;
+
+		for (index = 0; index < numbers[id]; index++)
+		{
+			if (test_cell_keyed(cells[id], index) &&
+			    !test_read(persistent, slot + packed++, test_key(cells[id], index),
+			               TEST_BITMAP_SIZE, TEST_BITMAP_SIZE))
+				goto fail;
+		}
+
+		for (; packed < numbers[id]; packed++)
+		{
+			if (!test_read(persistent, slot + packed, 0, 0, 0))
+				goto fail;
+		}
+
+		slot += numbers[id];
+	}
+
+	rc = TRUE;
+fail:
+	persistent_cache_free(persistent);
+	return rc;
+}
+
+/* the bitmap cache loads the advertised bitmaps on first use, at the indices sent */
+static BOOL test_check_loaded(rdpContext* context)
+{
+	UINT32 id, index;
+	const UINT32 cells[] = { 0, 2 };
+	const UINT32 numbers[] = { TEST_CELL0_ENTRIES, TEST_CELL2_ENTRIES };
+	rdpBitmapCache* bitmapCache = context->cache->bitmap;
+
+	if (bitmapCache->persistentLoaded || !bitmap_cache_persist_load(bitmapCache))
+	{
+		fprintf(stderr, "persistent bitmaps must be loaded on first use\n");
+		return FALSE;
+	}
+
+	if (bitmapCache->cells[1].keys)
+		return FALSE;
+
+	for (id = 0; id < ARRAYSIZE(cells); id++)
+	{
+		UINT32 packed = 0;
+		const BITMAP_V2_CELL* cell = &bitmapCache->cells[cells[id]];
+
+		for (index = 0; index < numbers[id]; index++)
+		{
+			const rdpBitmap* bitmap;
+
+			if (!test_cell_keyed(cells[id], index))
+				continue;
+
+			bitmap = cell->entries[packed];
+
+			if ((cell->keys[packed] != test_key(cells[id], index)) || !bitmap ||
+			    (bitmap->width != TEST_BITMAP_SIZE) || (bitmap->height != TEST_BITMAP_SIZE))
+			{
+				fprintf(stderr, "cell %"PRIu32": bitmap %"PRIu32" not loaded\n", cells[id], packed);
+				return FALSE;
+			}
+
+			packed++;
+		}
+
+		for (; packed < numbers[id]; packed++)
+		{
+			if (cell->entries[packed] || cell->keys[packed])
+			{
+				fprintf(stderr, "cell %"PRIu32": unexpected bitmap %"PRIu32"\n", cells[id], packed);
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL test_key_list(void)
+{
+	BOOL rc = FALSE;
+	BIO* bio = NULL;
+	UINT32 pdus = 0;
+	rdpRdp* rdp;
+	rdpSettings* settings;
+	freerdp* instance = NULL;
+	char* file = test_cache_file("TestPersistentKeyList");
+
+	if (!file || !test_prepare_keys(file))
+		goto fail;
+
+	if (!(instance = freerdp_new()) || !freerdp_context_new(instance))
+		goto fail;
+
+	rdp = instance->context->rdp;
+	settings = instance->settings;
+	settings->BitmapCacheV2NumCells = 3;
+	settings->BitmapCacheV2CellInfo[0].numEntries = TEST_CELL0_ENTRIES;
+	settings->BitmapCacheV2CellInfo[0].persistent = TRUE;
+	settings->BitmapCacheV2CellInfo[1].numEntries = TEST_CELL1_ENTRIES;
+	settings->BitmapCacheV2CellInfo[1].persistent = FALSE;
+	settings->BitmapCacheV2CellInfo[2].numEntries = TEST_CELL2_ENTRIES;
+	settings->BitmapCacheV2CellInfo[2].persistent = TRUE;
+
+	if (!freerdp_settings_set_bool(settings, FreeRDP_BitmapCachePersistEnabled, TRUE) ||
+	    !freerdp_settings_set_string(settings, FreeRDP_BitmapCachePersistFile, file))
+		goto fail;
+
+	if (!(bio = BIO_new(BIO_s_mem())))
+		goto fail;
+
+	rdp->transport->frontBio = bio;
+	/* as assigned by the MCS attach user confirm */
+	rdp->mcs->userId = MCS_BASE_CHANNEL_ID + 6;
+
+	/* sent while connecting, before the client creates the caches in gdi_init */
+	if (!rdp_send_client_persistent_key_list_pdu(rdp))
+		goto fail;
+
+	/* rdp_read_header expects what the server receives */
+	settings->ServerMode = TRUE;
+	rc = test_parse_key_lists(rdp, bio, &pdus);
+	settings->ServerMode = FALSE;
+
+	if (rc && (pdus != 2))
+	{
+		fprintf(stderr, "%"PRIu32" key list PDUs, expected 2\n", pdus);
+		rc = FALSE;
+	}
+
+	if (rc && (!gdi_init(instance, PIXEL_FORMAT_BGRX32) || !test_check_loaded(instance->context)))
+		rc = FALSE;
+
+	/* closes the cache file */
+	gdi_free(instance);
+
+	if (rc && !test_check_compacted(file))
+		rc = FALSE;
+
+fail:
+
+	if (!rc)
+		fprintf(stderr, "persistent key list failed\n");
+
+	if (instance)
+	{
+		if (instance->context)
+			instance->context->rdp->transport->frontBio = NULL;
+
+		freerdp_context_free(instance);
+		freerdp_free(instance);
+	}
+
+	BIO_free(bio);
+
+	if (file)
+		DeleteFileA(file);
+
+	free(file);
+	return rc;
+}
+
+int TestPersistentCache(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_round_trip())
+		return -1;
+
+	if (!test_key_list())
+		return -1;
+
+	return 0;
+}
@@ -0,0 +1,216 @@
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+
+#include "../tcp.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/socket.h>
+#endif
+
+#define TEST_HEADER_SIZE 7
+#define TEST_PAYLOAD_SIZE 16384
+#define TEST_MESSAGE_COUNT 4096
+#define TEST_MESSAGE_SIZE (TEST_HEADER_SIZE + TEST_PAYLOAD_SIZE)
+
+#ifndef _WIN32
+
+struct test_reader
+{
+	int fd;
+	UINT64 received;
+	BOOL valid;
+};
+typedef struct test_reader TEST_READER;
+
+static BYTE test_message_byte(UINT64 offset)
+{
+	const UINT64 message = offset / TEST_MESSAGE_SIZE;
+	const UINT64 index = offset % TEST_MESSAGE_SIZE;
+
+	if (index < TEST_HEADER_SIZE)
+		return (BYTE)(0xF0 | index);
+
+	return (BYTE)((message + index) & 0xFF);
+}
+
+static DWORD WINAPI test_reader_thread(LPVOID arg)
+{
+	TEST_READER* reader = (TEST_READER*) arg;
+	BYTE buffer[65536];
+	const UINT64 expected = (UINT64) TEST_MESSAGE_COUNT * TEST_MESSAGE_SIZE;
+	reader->valid = TRUE;
+
+	while (reader->received < expected)
+	{
+		ssize_t index;
+		const ssize_t status = read(reader->fd, buffer, sizeof(buffer));
+
+		if (status <= 0)
+			break;
+
+		for (index = 0; index < status; index++)
+		{
+			if (buffer[index] != test_message_byte(reader->received + index))
+				reader->valid = FALSE;
+		}
+
+		reader->received += status;
+	}
+
+	return 0;
+}
+
+static BOOL test_flush(BIO* bio)
+{
+	while (BIO_write_blocked(bio))
+	{
+		if (BIO_wait_write(bio, 100) < 0)
+			return FALSE;
+
+		if (BIO_flush(bio) < 1)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static int test_transport_run(BOOL vector, UINT64* elapsed)
+{
+	int rc = -1;
+	int fds[2];
+	int writer = -1;
+	UINT32 message;
+	UINT64 start;
+	BYTE header[TEST_HEADER_SIZE];
+	BYTE* payload = NULL;
+	BYTE* coalesced = NULL;
+	BIO* socketBio = NULL;
+	BIO* bufferedBio = NULL;
+	HANDLE thread = NULL;
+	TEST_READER reader;
+	ZeroMemory(&reader, sizeof(reader));
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		return -1;
+
+	reader.fd = fds[1];
+	payload = malloc(TEST_PAYLOAD_SIZE);
+	coalesced = malloc(TEST_MESSAGE_SIZE);
+	socketBio = BIO_new(BIO_s_simple_socket());
+	bufferedBio = BIO_new(BIO_s_buffered_socket());
+
+	if (!payload || !coalesced || !socketBio || !bufferedBio)
+		goto fail;
+
+	/* the socket BIO owns the writing end from now on */
+	BIO_set_fd(socketBio, fds[0], BIO_CLOSE);
+	writer = fds[0];
+	fds[0] = -1;
+	BIO_set_nonblock(socketBio, TRUE);
+	bufferedBio = BIO_push(bufferedBio, socketBio);
+	socketBio = NULL;
+
+	for (message = 0; message < TEST_HEADER_SIZE; message++)
+		header[message] = (BYTE)(0xF0 | message);
+
+	if (!(thread = CreateThread(NULL, 0, test_reader_thread, &reader, 0, NULL)))
+		goto fail;
+
+	start = GetTickCount64();
+
+	for (message = 0; message < TEST_MESSAGE_COUNT; message++)
+	{
+		UINT32 index;
+		long status;
+
+		for (index = 0; index < TEST_PAYLOAD_SIZE; index++)
+			payload[index] = (BYTE)((message + TEST_HEADER_SIZE + index) & 0xFF);
+
+		if (vector)
+		{
+			DataChunk chunks[2];
+			chunks[0].data = header;
+			chunks[0].size = TEST_HEADER_SIZE;
+			chunks[1].data = payload;
+			chunks[1].size = TEST_PAYLOAD_SIZE;
+			status = BIO_write_vector(bufferedBio, chunks, 2);
+		}
+		else
+		{
+			/* what callers had to do before: copy header and payload together */
+			CopyMemory(coalesced, header, TEST_HEADER_SIZE);
+			CopyMemory(&coalesced[TEST_HEADER_SIZE], payload, TEST_PAYLOAD_SIZE);
+			status = BIO_write(bufferedBio, coalesced, TEST_MESSAGE_SIZE);
+		}
+
+		if (status != TEST_MESSAGE_SIZE)
+		{
+			printf("write of message %"PRIu32" returned %ld\n", message, status);
+			goto fail;
+		}
+
+		if (!test_flush(bufferedBio))
+			goto fail;
+	}
+
+	WaitForSingleObject(thread, INFINITE);
+	*elapsed = GetTickCount64() - start;
+
+	if (!reader.valid || (reader.received != (UINT64) TEST_MESSAGE_COUNT * TEST_MESSAGE_SIZE))
+	{
+		printf("%s: received %"PRIu64" bytes, %s\n", vector ? "vector" : "copy", reader.received,
+		       reader.valid ? "valid" : "corrupted");
+		goto fail;
+	}
+
+	rc = 0;
+fail:
+
+	if ((rc < 0) && (writer >= 0))
+		shutdown(writer, SHUT_RDWR);
+
+	if (thread)
+	{
+		WaitForSingleObject(thread, INFINITE);
+		CloseHandle(thread);
+	}
+
+	if (bufferedBio)
+		BIO_free_all(bufferedBio);
+
+	if (socketBio)
+		BIO_free(socketBio);
+
+	if (fds[0] >= 0)
+		close(fds[0]);
+
+	close(fds[1]);
+	free(payload);
+	free(coalesced);
+	return rc;
+}
+
+#endif
+
+int TestTransportWriteVector(int argc, char* argv[])
+{
+#ifndef _WIN32
+	UINT64 copyTime = 0;
+	UINT64 vectorTime = 0;
+	const double megabytes = (double) TEST_MESSAGE_COUNT * TEST_MESSAGE_SIZE / (1024.0 * 1024.0);
+
+	if (test_transport_run(FALSE, &copyTime) < 0)
+		return -1;
+
+	if (test_transport_run(TRUE, &vectorTime) < 0)
+		return -1;
+
+	printf("copy: %.0f MiB in %"PRIu64" ms, vector: %.0f MiB in %"PRIu64" ms\n",
+	       megabytes, copyTime, megabytes, vectorTime);
+#endif
+	return 0;
+}
@@ -363,6 +363,7 @@ static const size_t string_list_indices[] =
 	FreeRDP_RemoteApplicationGuid,
 	FreeRDP_RemoteApplicationCmdLine,
 	FreeRDP_RemoteApplicationWorkingDir,
+	FreeRDP_BitmapCachePersistFile,
 	FreeRDP_ImeFileName,
 	FreeRDP_DrivesToRedirect,
 	FreeRDP_RDP2TCPArgs,
@@ -786,38 +786,60 @@ int transport_read_pdu(rdpTransport* transport, wStream* s)
 	return Stream_Length(s);
 }
 
-int transport_write(rdpTransport* transport, wStream* s)
+static int transport_write_chunks(rdpTransport* transport, DataChunk* chunks, size_t count)
 {
-	size_t length;
+	size_t index;
+	size_t first = 0;
+	size_t length = 0;
 	int status = -1;
-	int writtenlength = 0;
+	BOOL vector;
 
-	if (!s)
+	for (index = 0; index < count; index++)
+	{
+		if (chunks[index].size > 0)
+		{
+			WLog_Packet(transport->log, WLOG_TRACE, (BYTE*) chunks[index].data,
+			            chunks[index].size, WLOG_PACKET_OUTBOUND);
+		}
+
+		length += chunks[index].size;
+	}
+
+	if (length > INT32_MAX)
 		return -1;
 
-	if (!transport)
-		goto fail;
+	/* gather writes go straight to the socket, anything else (TLS, gateways)
+	 * gets a single contiguous buffer so that the batch ends up in one record. */
+	vector = (BIO_method_type(transport->frontBio) == BIO_TYPE_BUFFERED);
 
-	if (!transport->frontBio)
+	if (!vector && (count > 1))
 	{
-		transport->layer = TRANSPORT_LAYER_CLOSED;
-		goto fail;
-	}
+		if (!transport->WriteBuffer && !(transport->WriteBuffer = Stream_New(NULL, length)))
+			return -1;
 
-	EnterCriticalSection(&(transport->WriteLock));
-	length = Stream_GetPosition(s);
-	writtenlength = length;
-	Stream_SetPosition(s, 0);
+		Stream_SetPosition(transport->WriteBuffer, 0);
 
-	if (length > 0)
-	{
-		WLog_Packet(transport->log, WLOG_TRACE, Stream_Buffer(s), length,
-		            WLOG_PACKET_OUTBOUND);
+		if (!Stream_EnsureCapacity(transport->WriteBuffer, length))
+			return -1;
+
+		for (index = 0; index < count; index++)
+			Stream_Write(transport->WriteBuffer, chunks[index].data, chunks[index].size);
+
+		chunks[0].data = Stream_Buffer(transport->WriteBuffer);
+		chunks[0].size = length;
+		count = 1;
 	}
 
+	status = 0;
+
 	while (length > 0)
 	{
-		status = BIO_write(transport->frontBio, Stream_Pointer(s), length);
+		size_t written;
+
+		if (vector)
+			status = BIO_write_vector(transport->frontBio, &chunks[first], count - first);
+		else
+			status = BIO_write(transport->frontBio, chunks[first].data, chunks[first].size);
 
 		if (status <= 0)
 		{
@@ -828,21 +850,20 @@ int transport_write(rdpTransport* transport, wStream* s)
 			if (!BIO_should_retry(transport->frontBio))
 			{
 				WLog_ERR_BIO(transport, "BIO_should_retry", transport->frontBio);
-				goto out_cleanup;
+				return -1;
 			}
 
 			/* non-blocking can live with blocked IOs */
 			if (!transport->blocking)
 			{
 				WLog_ERR_BIO(transport, "BIO_write", transport->frontBio);
-				goto out_cleanup;
+				return -1;
 			}
 
 			if (BIO_wait_write(transport->frontBio, 100) < 0)
 			{
 				WLog_ERR_BIO(transport, "BIO_wait_write", transport->frontBio);
-				status = -1;
-				goto out_cleanup;
+				return -1;
 			}
 
 			continue;
@@ -855,35 +876,88 @@ int transport_write(rdpTransport* transport, wStream* s)
 				if (BIO_wait_write(transport->frontBio, 100) < 0)
 				{
 					WLog_Print(transport->log, WLOG_ERROR, "error when selecting for write");
-					status = -1;
-					goto out_cleanup;
+					return -1;
 				}
 
 				if (BIO_flush(transport->frontBio) < 1)
 				{
 					WLog_Print(transport->log, WLOG_ERROR, "error when flushing outputBuffer");
-					status = -1;
-					goto out_cleanup;
+					return -1;
 				}
 			}
 		}
 
-		length -= status;
-		Stream_Seek(s, status);
+		length -= (size_t) status;
+		written = (size_t) status;
+
+		while ((first < count) && (written >= chunks[first].size))
+			written -= chunks[first++].size;
+
+		if (written > 0)
+		{
+			chunks[first].data += written;
+			chunks[first].size -= written;
+		}
+	}
+
+	return status;
+}
+
+int transport_write(rdpTransport* transport, wStream* s)
+{
+	DataChunk chunk;
+	int status = -1;
+
+	if (!s)
+		return -1;
+
+	if (!transport)
+		goto fail;
+
+	chunk.data = Stream_Buffer(s);
+	chunk.size = Stream_GetPosition(s);
+	Stream_SetPosition(s, 0);
+	status = transport_write_vector(transport, &chunk, 1);
+	Stream_Seek(s, chunk.size);
+fail:
+	Stream_Release(s);
+	return status;
+}
+
+int transport_write_vector(rdpTransport* transport, const DataChunk* chunks, size_t count)
+{
+	size_t index;
+	size_t length = 0;
+	int status = -1;
+	DataChunk vector[BIO_WRITE_VECTOR_MAX];
+
+	if (!transport || !chunks || (count < 1) || (count > BIO_WRITE_VECTOR_MAX))
+		return -1;
+
+	if (!transport->frontBio)
+	{
+		transport->layer = TRANSPORT_LAYER_CLOSED;
+		return -1;
+	}
+
+	for (index = 0; index < count; index++)
+	{
+		vector[index] = chunks[index];
+		length += chunks[index].size;
 	}
 
-	transport->written += writtenlength;
-out_cleanup:
+	EnterCriticalSection(&(transport->WriteLock));
+	status = transport_write_chunks(transport, vector, count);
 
 	if (status < 0)
 	{
 		/* A write error indicates that the peer has dropped the connection */
 		transport->layer = TRANSPORT_LAYER_CLOSED;
 	}
+	else
+		transport->written += length;
 
 	LeaveCriticalSection(&(transport->WriteLock));
-fail:
-	Stream_Release(s);
 	return status;
 }
 
@@ -1197,6 +1271,7 @@ void transport_free(rdpTransport* transport)
 	if (transport->ReceiveBuffer)
 		Stream_Release(transport->ReceiveBuffer);
 
+	Stream_Free(transport->WriteBuffer, TRUE);
 	StreamPool_Free(transport->ReceivePool);
 	CloseHandle(transport->connectedEvent);
 	CloseHandle(transport->rereadEvent);
@@ -75,6 +75,7 @@ struct rdp_transport
 	BOOL GatewayEnabled;
 	CRITICAL_SECTION ReadLock;
 	CRITICAL_SECTION WriteLock;
+	wStream* WriteBuffer;
 	ULONG written;
 	HANDLE rereadEvent;
 	BOOL haveMoreBytesToRead;
@@ -96,6 +97,8 @@ FREERDP_LOCAL BOOL transport_accept_nla(rdpTransport* transport);
 
 FREERDP_LOCAL int transport_read_pdu(rdpTransport* transport, wStream* s);
 FREERDP_LOCAL int transport_write(rdpTransport* transport, wStream* s);
+FREERDP_LOCAL int transport_write_vector(rdpTransport* transport, const DataChunk* chunks,
+        size_t count);
 
 FREERDP_LOCAL void transport_get_fds(rdpTransport* transport, void** rfds,
                                      int* rcount);
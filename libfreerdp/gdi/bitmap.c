@@ -39,6 +39,7 @@
 
 #include "brush.h"
 #include "clipping.h"
+#include "rop3.h"
 #include "../gdi/gdi.h"
 
 #define TAG FREERDP_TAG("gdi.bitmap")
@@ -166,180 +167,6 @@ HGDI_BITMAP gdi_CreateCompatibleBitmap(HGDI_DC hdc, UINT32 nWidth,
 	return hBitmap;
 }
 
-static BOOL op_not(UINT32* stack, UINT32* stackp)
-{
-	if (!stack || !stackp)
-		return FALSE;
-
-	if (*stackp < 1)
-		return FALSE;
-
-	stack[(*stackp) - 1] = ~stack[(*stackp) - 1];
-	return TRUE;
-}
-
-static BOOL op_and(UINT32* stack, UINT32* stackp)
-{
-	if (!stack || !stackp)
-		return FALSE;
-
-	if (*stackp < 2)
-		return FALSE;
-
-	(*stackp)--;
-	stack[(*stackp) - 1] &= stack[(*stackp)];
-	return TRUE;
-}
-
-static BOOL op_or(UINT32* stack, UINT32* stackp)
-{
-	if (!stack || !stackp)
-		return FALSE;
-
-	if (*stackp < 2)
-		return FALSE;
-
-	(*stackp)--;
-	stack[(*stackp) - 1] |= stack[(*stackp)];
-	return TRUE;
-}
-
-static BOOL op_xor(UINT32* stack, UINT32* stackp)
-{
-	if (!stack || !stackp)
-		return FALSE;
-
-	if (*stackp < 2)
-		return FALSE;
-
-	(*stackp)--;
-	stack[(*stackp) - 1] ^= stack[(*stackp)];
-	return TRUE;
-}
-
-static UINT32 process_rop(UINT32 src, UINT32 dst, UINT32 pat, const char* rop,
-                          UINT32 format)
-{
-	DWORD stack[10] = { 0 };
-	DWORD stackp = 0;
-
-	while (*rop != '\0')
-	{
-		char op = *rop++;
-
-		switch (op)
-		{
-			case '0':
-				stack[stackp++] = FreeRDPGetColor(format, 0, 0, 0, 0xFF);
-				break;
-
-			case '1':
-				stack[stackp++] = FreeRDPGetColor(format, 0xFF, 0xFF, 0xFF, 0xFF);
-				break;
-
-			case 'D':
-				stack[stackp++] = dst;
-				break;
-
-			case 'S':
-				stack[stackp++] = src;
-				break;
-
-			case 'P':
-				stack[stackp++] = pat;
-				break;
-
-			case 'x':
-				op_xor(stack, &stackp);
-				break;
-
-			case 'a':
-				op_and(stack, &stackp);
-				break;
-
-			case 'o':
-				op_or(stack, &stackp);
-				break;
-
-			case 'n':
-				op_not(stack, &stackp);
-				break;
-
-			default:
-				break;
-		}
-	}
-
-	return stack[0];
-}
-
-static INLINE BOOL BitBlt_write(HGDI_DC hdcDest, HGDI_DC hdcSrc, INT32 nXDest,
-                                INT32 nYDest, INT32 nXSrc, INT32 nYSrc, INT32 x, INT32 y,
-                                BOOL useSrc, BOOL usePat, UINT32 style,
-                                const char* rop, const gdiPalette* palette)
-{
-	UINT32 dstColor;
-	UINT32 colorA;
-	UINT32 colorB = 0;
-	UINT32 colorC = 0;
-	const INT32 dstX = nXDest + x;
-	const INT32 dstY = nYDest + y;
-	BYTE* dstp = gdi_get_bitmap_pointer(hdcDest, dstX, dstY);
-
-	if (!dstp)
-	{
-		WLog_ERR(TAG, "dstp=%p", (void*) dstp);
-		return FALSE;
-	}
-
-	colorA = ReadColor(dstp, hdcDest->format);
-
-	if (useSrc)
-	{
-		const BYTE* srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc + x, nYSrc + y);
-
-		if (!srcp)
-		{
-			WLog_ERR(TAG, "srcp=%p", (void*) srcp);
-			return FALSE;
-		}
-
-		colorC = ReadColor(srcp, hdcSrc->format);
-		colorC = FreeRDPConvertColor(colorC, hdcSrc->format, hdcDest->format, palette);
-	}
-
-	if (usePat)
-	{
-		switch (style)
-		{
-			case GDI_BS_SOLID:
-				colorB = hdcDest->brush->color;
-				break;
-
-			case GDI_BS_HATCHED:
-			case GDI_BS_PATTERN:
-				{
-					const BYTE* patp = gdi_get_brush_pointer(hdcDest, nXDest + x, nYDest + y);
-
-					if (!patp)
-					{
-						WLog_ERR(TAG, "patp=%p", (void*) patp);
-						return FALSE;
-					}
-
-					colorB = ReadColor(patp, hdcDest->format);
-				}
-				break;
-
-			default:
-				break;
-		}
-	}
-
-	dstColor = process_rop(colorC, colorA, colorB, rop, hdcDest->format);
-	return WriteColor(dstp, hdcDest->format, dstColor);
-}
-
 static BOOL adjust_src_coordinates(HGDI_DC hdcSrc, INT32 nWidth, INT32 nHeight,
                                    INT32* px, INT32* py)
 {
@@ -445,35 +272,180 @@ static BOOL adjust_src_dst_coordinates(HGDI_DC hdcDest, INT32* pnXSrc, INT32* pn
 	return TRUE;
 }
 
+static INLINE UINT32 BitBlt_color_operand(UINT32 color, UINT32 format, BOOL raw)
+{
+	BYTE data[4] = { 0 };
+	UINT32 value;
+
+	if (!raw)
+		return color;
+
+	WriteColor(data, format, color);
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+/**
+ * Checks if converting a 32bpp source to the destination format only keeps or
+ * sets bits of the in-memory pixel, which is true for identical channel
+ * layouts. The conversion is then (pixel & keep) | set.
+ */
+static BOOL BitBlt_raw_conversion(UINT32 SrcFormat, UINT32 DstFormat,
+                                  const gdiPalette* palette, UINT32* pKeep, UINT32* pSet)
+{
+	size_t i;
+	UINT32 keep, set;
+	const UINT32 probe[] = { 0x00000000, 0xFFFFFFFF, 0x12345678, 0xA5C3F00F };
+	UINT32 converted[ARRAYSIZE(probe)];
+
+	if ((GetBytesPerPixel(SrcFormat) != 4) || (GetBytesPerPixel(DstFormat) != 4))
+		return FALSE;
+
+	for (i = 0; i < ARRAYSIZE(probe); i++)
+	{
+		BYTE data[4];
+		UINT32 color;
+		memcpy(data, &probe[i], sizeof(data));
+		color = FreeRDPConvertColor(ReadColor(data, SrcFormat), SrcFormat, DstFormat, palette);
+		converted[i] = BitBlt_color_operand(color, DstFormat, TRUE);
+	}
+
+	set = converted[0];
+	keep = ~converted[0] & converted[1];
+
+	/* every bit must either be passed through or be constant */
+	if ((converted[0] | keep) != converted[1])
+		return FALSE;
+
+	for (i = 2; i < ARRAYSIZE(probe); i++)
+	{
+		if (((probe[i] & keep) | set) != converted[i])
+			return FALSE;
+	}
+
+	*pKeep = keep;
+	*pSet = set;
+	return TRUE;
+}
+
+/**
+ * Build the pattern operand rows of a blit from the expanded brush.
+ * Scanlines y and y + pattern height share a row, so only one row per
+ * pattern scanline is built; scanline y uses row y % *pRows.
+ */
+static UINT32* BitBlt_pattern_rows(HGDI_DC hdcDest, INT32 nXDest, INT32 nYDest, INT32 nWidth,
+                                   INT32 nHeight, BOOL raw, INT32* pRows)
+{
+	INT32 x, y;
+	BYTE* period = NULL;
+	UINT32* pPat = NULL;
+	const HGDI_BRUSH brush = hdcDest->brush;
+	const UINT32 bpp = GetBytesPerPixel(hdcDest->format);
+	const INT32 rows = MIN(nHeight, (INT32) brush->pattern->height);
+	const INT32 periodWidth = MIN(nWidth, (INT32) brush->pattern->width);
+	const BYTE* expanded = gdi_brush_expand(hdcDest, brush, hdcDest->format);
+
+	if (!expanded || (rows <= 0))
+		return NULL;
+
+	pPat = (UINT32*) calloc((size_t) rows * (size_t) nWidth, sizeof(UINT32));
+
+	if (!pPat)
+		return NULL;
+
+	if (!raw)
+	{
+		period = (BYTE*) calloc((size_t) periodWidth, bpp);
+
+		if (!period)
+		{
+			free(pPat);
+			return NULL;
+		}
+	}
+
+	for (y = 0; y < rows; y++)
+	{
+		UINT32* row = &pPat[(size_t) y * nWidth];
+
+		if (raw)
+		{
+			gdi_brush_fill_row(brush, expanded, bpp, nXDest, nYDest + y, (BYTE*) row, nWidth);
+			continue;
+		}
+
+		gdi_brush_fill_row(brush, expanded, bpp, nXDest, nYDest + y, period, periodWidth);
+
+		for (x = 0; x < periodWidth; x++)
+			row[x] = ReadColor(&period[x * bpp], hdcDest->format);
+
+		gdi_brush_replicate((BYTE*) row, periodWidth * sizeof(UINT32),
+		                    (size_t) nWidth * sizeof(UINT32));
+	}
+
+	free(period);
+	*pRows = rows;
+	return pPat;
+}
+
 static BOOL BitBlt_process(HGDI_DC hdcDest, INT32 nXDest, INT32 nYDest,
                            INT32 nWidth, INT32 nHeight, HGDI_DC hdcSrc,
-                           INT32 nXSrc, INT32 nYSrc, const char* rop, const gdiPalette* palette)
+                           INT32 nXSrc, INT32 nYSrc, DWORD rop, const gdiPalette* palette)
 {
-	INT32 x, y;
-	UINT32 style = 0;
-	BOOL useSrc = FALSE;
-	BOOL usePat = FALSE;
-	const char* iter = rop;
+	INT32 x, y, i;
+	BOOL rc = FALSE;
+	BOOL raw;
+	UINT32 dstBpp, srcBpp = 0;
+	UINT32 keep = 0xFFFFFFFF;
+	UINT32 set = 0;
+	UINT32 color = 0;
+	UINT32 style = GDI_BS_SOLID;
+	UINT32* buffer = NULL;
+	UINT32* pSrc = NULL;
+	UINT32* pPat = NULL;
+	UINT32* patRows = NULL;
+	INT32 nPatRows = 0;
+	gdiRop3Kernel kernel;
+	BYTE rop3 = gdi_rop3_index(rop);
+	BOOL useSrc = GDI_ROP3_USES_SRC(rop3);
+	BOOL usePat = GDI_ROP3_USES_PAT(rop3);
 
-	while (*iter != '\0')
+	if (!hdcDest)
+		return FALSE;
+
+	/* BLACKNESS and WHITENESS depend on the pixel format, draw them as a constant pattern */
+	if ((rop3 == 0x00) || (rop3 == 0xFF))
 	{
-		switch (*iter++)
+		const BYTE c = (rop3 == 0x00) ? 0x00 : 0xFF;
+		color = FreeRDPGetColor(hdcDest->format, c, c, c, 0xFF);
+		rop3 = GDI_ROP3_PAT;
+		usePat = TRUE;
+	}
+	else if (usePat)
+	{
+		style = gdi_GetBrushStyle(hdcDest);
+
+		switch (style)
 		{
-			case 'P':
-				usePat = TRUE;
+			case GDI_BS_SOLID:
+				color = hdcDest->brush->color;
 				break;
 
-			case 'S':
-				useSrc = TRUE;
+			case GDI_BS_HATCHED:
+			case GDI_BS_PATTERN:
+				if (!hdcDest->brush->pattern || (hdcDest->brush->pattern->width == 0))
+					return FALSE;
+
 				break;
 
 			default:
-				break;
+				WLog_ERR(TAG, "Invalid brush!!");
+				return FALSE;
 		}
 	}
 
-	if (!hdcDest)
-		return FALSE;
+	/* select the row kernel once, the loops below only feed it */
+	kernel = gdi_rop3_get_kernel(rop3);
 
 	if (!adjust_src_dst_coordinates(hdcDest, &nXSrc, &nYSrc, &nXDest, &nYDest, &nWidth, &nHeight))
 		return FALSE;
@@ -485,79 +457,119 @@ static BOOL BitBlt_process(HGDI_DC hdcDest, INT32 nXDest, INT32 nYDest,
 	{
 		if (!adjust_src_coordinates(hdcSrc, nWidth, nHeight, &nXSrc, &nYSrc))
 			return FALSE;
+
+		srcBpp = GetBytesPerPixel(hdcSrc->format);
 	}
 
+	if ((nWidth <= 0) || (nHeight <= 0))
+		return TRUE;
+
+	/* 32bpp destinations are processed in place, bitwise operations do not care about
+	 * the channel order. Other formats go through a row of color values. */
+	dstBpp = GetBytesPerPixel(hdcDest->format);
+	raw = (dstBpp == 4) &&
+	      (!useSrc || BitBlt_raw_conversion(hdcSrc->format, hdcDest->format, palette, &keep, &set));
+	buffer = (UINT32*) calloc(3ULL * (size_t) nWidth, sizeof(UINT32));
+
+	if (!buffer)
+		return FALSE;
+
+	if (useSrc)
+		pSrc = &buffer[nWidth];
+
 	if (usePat)
 	{
-		style = gdi_GetBrushStyle(hdcDest);
+		pPat = &buffer[2 * nWidth];
 
-		switch (style)
+		if (style == GDI_BS_SOLID)
 		{
-			case GDI_BS_SOLID:
-			case GDI_BS_HATCHED:
-			case GDI_BS_PATTERN:
-				break;
+			const UINT32 value = BitBlt_color_operand(color, hdcDest->format, raw);
 
-			default:
-				WLog_ERR(TAG, "Invalid brush!!");
-				return FALSE;
+			for (x = 0; x < nWidth; x++)
+				pPat[x] = value;
+		}
+		else if ((style == GDI_BS_HATCHED) || (style == GDI_BS_PATTERN))
+		{
+			patRows = BitBlt_pattern_rows(hdcDest, nXDest, nYDest, nWidth, nHeight, raw, &nPatRows);
+
+			if (!patRows)
+				goto fail;
 		}
 	}
 
-	if ((nXDest > nXSrc) && (nYDest > nYSrc))
+	for (i = 0; i < nHeight; i++)
 	{
-		for (y = nHeight - 1; y >= 0; y--)
+		BYTE* dstp;
+		UINT32* pDst;
+		const BYTE* srcp = NULL;
+		/* bottom-up when source and destination might overlap downwards */
+		y = (nYDest > nYSrc) ? (nHeight - 1 - i) : i;
+		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+
+		if (!dstp)
 		{
-			for (x = nWidth - 1; x >= 0; x--)
-			{
-				if (!BitBlt_write(hdcDest, hdcSrc, nXDest, nYDest,
-				                  nXSrc, nYSrc, x, y, useSrc,
-				                  usePat, style, rop, palette))
-					return FALSE;
-			}
+			WLog_ERR(TAG, "dstp=%p", (void*) dstp);
+			goto fail;
 		}
-	}
-	else if (nXDest > nXSrc)
-	{
-		for (y = 0; y < nHeight; y++)
+
+		if (useSrc)
 		{
-			for (x = nWidth - 1; x >= 0; x--)
+			srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
+
+			if (!srcp)
 			{
-				if (!BitBlt_write(hdcDest, hdcSrc, nXDest, nYDest,
-				                  nXSrc, nYSrc, x, y, useSrc,
-				                  usePat, style, rop, palette))
-					return FALSE;
+				WLog_ERR(TAG, "srcp=%p", (void*) srcp);
+				goto fail;
 			}
 		}
-	}
-	else if (nYDest > nYSrc)
-	{
-		for (y = nHeight - 1; y >= 0; y--)
+
+		if (patRows)
+			pPat = &patRows[(size_t)(y % nPatRows) * nWidth];
+
+		if (raw)
 		{
-			for (x = 0; x < nWidth; x++)
+			pDst = (UINT32*) dstp;
+
+			/* copying the source row also takes care of overlapping rectangles */
+			if (useSrc)
 			{
-				if (!BitBlt_write(hdcDest, hdcSrc, nXDest, nYDest,
-				                  nXSrc, nYSrc, x, y, useSrc,
-				                  usePat, style, rop, palette))
-					return FALSE;
+				for (x = 0; x < nWidth; x++)
+				{
+					UINT32 value;
+					memcpy(&value, &srcp[x * 4], sizeof(value));
+					pSrc[x] = (value & keep) | set;
+				}
 			}
+
+			kernel(pDst, pSrc, pPat, nWidth);
+			continue;
 		}
-	}
-	else
-	{
-		for (y = 0; y < nHeight; y++)
+
+		pDst = buffer;
+
+		for (x = 0; x < nWidth; x++)
+			pDst[x] = ReadColor(&dstp[x * dstBpp], hdcDest->format);
+
+		if (useSrc)
 		{
 			for (x = 0; x < nWidth; x++)
 			{
-				if (!BitBlt_write(hdcDest, hdcSrc, nXDest, nYDest,
-				                  nXSrc, nYSrc, x, y, useSrc,
-				                  usePat, style, rop, palette))
-					return FALSE;
+				const UINT32 value = ReadColor(&srcp[x * srcBpp], hdcSrc->format);
+				pSrc[x] = FreeRDPConvertColor(value, hdcSrc->format, hdcDest->format, palette);
 			}
 		}
+
+		kernel(pDst, pSrc, pPat, nWidth);
+
+		for (x = 0; x < nWidth; x++)
+			WriteColor(&dstp[x * dstBpp], hdcDest->format, pDst[x]);
 	}
 
-	return TRUE;
+	rc = TRUE;
+fail:
+	free(patRows);
+	free(buffer);
+	return rc;
 }
 
 /**
@@ -641,7 +653,7 @@ BOOL gdi_BitBlt(HGDI_DC hdcDest, INT32 nXDest, INT32 nYDest,
 		default:
 			if (!BitBlt_process(hdcDest, nXDest, nYDest,
 			                    nWidth, nHeight, hdcSrc,
-			                    nXSrc, nYSrc, gdi_rop_to_string(rop), palette))
+			                    nXSrc, nYSrc, rop, palette))
 				return FALSE;
 
 			break;
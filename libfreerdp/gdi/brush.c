@@ -27,6 +27,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <freerdp/freerdp.h>
 #include <freerdp/gdi/gdi.h>
@@ -867,3 +868,151 @@ HGDI_BRUSH gdi_CreateHatchBrush(HGDI_BITMAP hbmp)
 	return hBrush;
 }
 
+
+/**
+ * Expand a monochrome bitmap with two colors, set bits become the
+ * background color like with freerdp_image_copy_from_monochrome.
+ * Both colors are converted to the destination format once, every pixel
+ * is then a plain copy.
+ */
+BOOL gdi_brush_expand_mono(BYTE* pDstData, UINT32 DstFormat, UINT32 nDstStep,
+                           UINT32 nWidth, UINT32 nHeight, const BYTE* pSrcData,
+                           UINT32 backColor, UINT32 foreColor)
+{
+	UINT32 x, y;
+	BYTE colors[2][4];
+	const UINT32 bpp = GetBytesPerPixel(DstFormat);
+	const UINT32 monoStep = (nWidth + 7) / 8;
+
+	if (!pDstData || !pSrcData || (bpp == 0) || (bpp > 4))
+		return FALSE;
+
+	if (nDstStep == 0)
+		nDstStep = nWidth * bpp;
+
+	WriteColor(colors[0], DstFormat, foreColor);
+	WriteColor(colors[1], DstFormat, backColor);
+
+	for (y = 0; y < nHeight; y++)
+	{
+		const BYTE* monoBits = &pSrcData[monoStep * y];
+		BYTE* pDstPixel = &pDstData[y * nDstStep];
+
+		for (x = 0; x < nWidth; x++, pDstPixel += bpp)
+		{
+			const BYTE bit = (monoBits[x / 8] >> (7 - (x % 8))) & 1;
+			memcpy(pDstPixel, colors[bit], bpp);
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * Get the pattern of a brush converted to the given pixel format.
+ * The result is cached in the brush and reused as long as the pattern
+ * bitmap and format (and for monochrome patterns the text and background
+ * colors of the device context) stay the same.
+ * @return width * height pixels of the pattern bitmap without padding,
+ *         NULL on failure
+ */
+const BYTE* gdi_brush_expand(HGDI_DC hdc, HGDI_BRUSH brush, UINT32 format)
+{
+	BYTE* expanded;
+	HGDI_BITMAP pattern;
+	UINT32 bkColor = 0;
+	UINT32 textColor = 0;
+	const UINT32 bpp = GetBytesPerPixel(format);
+
+	if (!hdc || !brush || (bpp == 0))
+		return NULL;
+
+	pattern = brush->pattern;
+
+	if (!pattern || !pattern->data || (pattern->width <= 0) || (pattern->height <= 0))
+		return NULL;
+
+	if (pattern->format == PIXEL_FORMAT_MONO)
+	{
+		bkColor = FreeRDPConvertColor(hdc->bkColor, hdc->format, format, NULL);
+		textColor = FreeRDPConvertColor(hdc->textColor, hdc->format, format, NULL);
+	}
+
+	if (brush->expanded && (brush->expandedPattern == pattern) &&
+	    (brush->expandedFormat == format) && (brush->expandedBkColor == bkColor) &&
+	    (brush->expandedTextColor == textColor))
+		return brush->expanded;
+
+	expanded = (BYTE*) calloc((size_t) pattern->width * pattern->height, bpp);
+
+	if (!expanded)
+		return NULL;
+
+	if (pattern->format == PIXEL_FORMAT_MONO)
+	{
+		if (!gdi_brush_expand_mono(expanded, format, 0, pattern->width, pattern->height,
+		                           pattern->data, bkColor, textColor))
+			goto fail;
+	}
+	else if (!freerdp_image_copy(expanded, format, pattern->width * bpp, 0, 0,
+	                             pattern->width, pattern->height, pattern->data,
+	                             pattern->format, pattern->scanline, 0, 0, NULL,
+	                             FREERDP_FLIP_NONE))
+		goto fail;
+
+	free(brush->expanded);
+	brush->expanded = expanded;
+	brush->expandedPattern = pattern;
+	brush->expandedFormat = format;
+	brush->expandedBkColor = bkColor;
+	brush->expandedTextColor = textColor;
+	return expanded;
+fail:
+	free(expanded);
+	return NULL;
+}
+
+static INLINE UINT32 gdi_brush_offset(INT32 value, INT32 origin, UINT32 size)
+{
+	const INT64 offset = ((INT64) value - origin) % (INT64) size;
+	return (UINT32)((offset < 0) ? offset + size : offset);
+}
+
+/**
+ * Repeat the first period bytes of a buffer until size bytes are filled.
+ * The copied block doubles with every step, long rows are filled with a
+ * few large copies.
+ */
+void gdi_brush_replicate(BYTE* pDst, size_t period, size_t size)
+{
+	size_t done = period;
+
+	if (period == 0)
+		return;
+
+	while (done < size)
+	{
+		const size_t chunk = MIN(done, size - done);
+		memcpy(&pDst[done], pDst, chunk);
+		done += chunk;
+	}
+}
+
+/**
+ * Fill nWidth pixels of the scanline y starting at x with an expanded
+ * brush pattern, aligned to the brush origin.
+ */
+void gdi_brush_fill_row(const GDI_BRUSH* brush, const BYTE* expanded, UINT32 bpp,
+                        INT32 x, INT32 y, BYTE* pDst, UINT32 nWidth)
+{
+	const UINT32 width = brush->pattern->width;
+	const UINT32 height = brush->pattern->height;
+	const UINT32 px = gdi_brush_offset(x, brush->nXOrg, width);
+	const UINT32 py = gdi_brush_offset(y, brush->nYOrg, height);
+	const BYTE* row = &expanded[(size_t) py * width * bpp];
+	const UINT32 period = MIN(nWidth, width);
+	const UINT32 first = MIN(period, width - px);
+	memcpy(pDst, &row[px * bpp], (size_t) first * bpp);
+	memcpy(&pDst[first * bpp], row, (size_t)(period - first) * bpp);
+	gdi_brush_replicate(pDst, (size_t) period * bpp, (size_t) nWidth * bpp);
+}
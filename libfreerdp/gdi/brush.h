@@ -35,6 +35,14 @@ FREERDP_LOCAL HGDI_BRUSH gdi_CreateSolidBrush(UINT32 crColor);
 FREERDP_LOCAL HGDI_BRUSH gdi_CreatePatternBrush(HGDI_BITMAP hbmp);
 FREERDP_LOCAL HGDI_BRUSH gdi_CreateHatchBrush(HGDI_BITMAP hbmp);
 
+FREERDP_LOCAL BOOL gdi_brush_expand_mono(BYTE* pDstData, UINT32 DstFormat, UINT32 nDstStep,
+        UINT32 nWidth, UINT32 nHeight, const BYTE* pSrcData,
+        UINT32 backColor, UINT32 foreColor);
+FREERDP_LOCAL const BYTE* gdi_brush_expand(HGDI_DC hdc, HGDI_BRUSH brush, UINT32 format);
+FREERDP_LOCAL void gdi_brush_fill_row(const GDI_BRUSH* brush, const BYTE* expanded,
+                                      UINT32 bpp, INT32 x, INT32 y, BYTE* pDst, UINT32 nWidth);
+FREERDP_LOCAL void gdi_brush_replicate(BYTE* pDst, size_t period, size_t size);
+
 static INLINE UINT32 gdi_GetBrushStyle(HGDI_DC hdc)
 {
 	if (!hdc || !hdc->brush)
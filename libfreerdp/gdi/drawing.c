@@ -139,3 +139,35 @@ UINT32 gdi_SetTextColor(HGDI_DC hdc, UINT32 crColor)
 	hdc->textColor = crColor;
 	return previousTextColor;
 }
+
+/**
+ * Get the current polygon fill mode.\n
+ * @msdn{dd144886}
+ * @param hdc device context
+ * @return polygon fill mode
+ */
+
+INT32 gdi_GetPolyFillMode(HGDI_DC hdc)
+{
+	return hdc->polyFillMode;
+}
+
+/**
+ * Set the current polygon fill mode.\n
+ * @msdn{dd145012}
+ * @param hdc device context
+ * @param iPolyFillMode polygon fill mode
+ * @return previous polygon fill mode on success, 0 on failure
+ */
+
+INT32 gdi_SetPolyFillMode(HGDI_DC hdc, INT32 iPolyFillMode)
+{
+	if (iPolyFillMode == GDI_FILL_ALTERNATE || iPolyFillMode == GDI_FILL_WINDING)
+	{
+		INT32 previousPolyFillMode = hdc->polyFillMode;
+		hdc->polyFillMode = iPolyFillMode;
+		return previousPolyFillMode;
+	}
+
+	return 0;
+}
@@ -36,6 +36,8 @@ FREERDP_LOCAL UINT32 gdi_SetBkColor(HGDI_DC hdc, UINT32 crColor);
 FREERDP_LOCAL UINT32 gdi_GetBkMode(HGDI_DC hdc);
 FREERDP_LOCAL INT32 gdi_SetBkMode(HGDI_DC hdc, INT32 iBkMode);
 FREERDP_LOCAL UINT32 gdi_SetTextColor(HGDI_DC hdc, UINT32 crColor);
+FREERDP_LOCAL INT32 gdi_GetPolyFillMode(HGDI_DC hdc);
+FREERDP_LOCAL INT32 gdi_SetPolyFillMode(HGDI_DC hdc, INT32 iPolyFillMode);
 
 #ifdef __cplusplus
 }
@@ -574,29 +574,18 @@ static BOOL gdi_dstblt(rdpContext* context, const DSTBLT_ORDER* dstblt)
 	                  gdi_rop3_code(dstblt->bRop), &gdi->palette);
 }
 
-static BOOL gdi_patblt(rdpContext* context, PATBLT_ORDER* patblt)
+/**
+ * Create a GDI brush for a brush of a primary drawing order.
+ * Pattern and hatched brushes are expanded to an 8x8 bitmap in the drawing
+ * format, returned in phBmp; it has to be deleted along with the brush.
+ */
+static HGDI_BRUSH gdi_create_order_brush(rdpGdi* gdi, const rdpBrush* brush,
+        UINT32 foreColor, UINT32 backColor, HGDI_BITMAP* phBmp)
 {
-	const rdpBrush* brush = &patblt->brush;
-	UINT32 foreColor;
-	UINT32 backColor;
-	UINT32 originalColor;
-	HGDI_BRUSH originalBrush, hbrush = NULL;
-	rdpGdi* gdi = context->gdi;
-	BOOL ret = FALSE;
-	const DWORD rop = gdi_rop3_code(patblt->bRop);
-	INT32 nXSrc = 0;
-	INT32 nYSrc = 0;
+	HGDI_BRUSH hbrush = NULL;
 	BYTE data[8 * 8 * 4];
 	HGDI_BITMAP hBmp = NULL;
-
-	if (!gdi_decode_color(gdi, patblt->foreColor, &foreColor, NULL))
-		return FALSE;
-
-	if (!gdi_decode_color(gdi, patblt->backColor, &backColor, NULL))
-		return FALSE;
-
-	originalColor = gdi_SetTextColor(gdi->drawing->hdc, foreColor);
-	originalBrush = gdi->drawing->hdc->brush;
+	*phBmp = NULL;
 
 	switch (brush->style)
 	{
@@ -609,15 +598,14 @@ static BOOL gdi_patblt(rdpContext* context, PATBLT_ORDER* patblt)
 				const BYTE* hatched;
 				hatched = GDI_BS_HATCHED_PATTERNS + (8 * brush->hatch);
 
-				if (!freerdp_image_copy_from_monochrome(data, gdi->drawing->hdc->format, 0, 0,
-				                                        0, 8, 8,
-				                                        hatched, backColor, foreColor, &gdi->palette))
-					goto out_error;
+				if (!gdi_brush_expand_mono(data, gdi->drawing->hdc->format, 0, 8, 8, hatched,
+				                           backColor, foreColor))
+					return NULL;
 
 				hBmp = gdi_CreateBitmapEx(8, 8, gdi->drawing->hdc->format, 0, data, NULL);
 
 				if (!hBmp)
-					goto out_error;
+					return NULL;
 
 				hbrush = gdi_CreateHatchBrush(hBmp);
 			}
@@ -631,7 +619,7 @@ static BOOL gdi_patblt(rdpContext* context, PATBLT_ORDER* patblt)
 				{
 					UINT32 bpp = brush->bpp;
 
-					if ((bpp == 16) && (context->settings->ColorDepth == 15))
+					if ((bpp == 16) && (gdi->context->settings->ColorDepth == 15))
 						bpp = 15;
 
 					brushFormat = gdi_get_pixel_format(bpp);
@@ -639,20 +627,19 @@ static BOOL gdi_patblt(rdpContext* context, PATBLT_ORDER* patblt)
 					if (!freerdp_image_copy(data, gdi->drawing->hdc->format, 0, 0, 0,
 					                        8, 8, brush->data, brushFormat, 0, 0, 0,
 					                        &gdi->palette, FREERDP_FLIP_NONE))
-						goto out_error;
+						return NULL;
 				}
 				else
 				{
-					if (!freerdp_image_copy_from_monochrome(data, gdi->drawing->hdc->format, 0, 0,
-					                                        0, 8, 8,
-					                                        brush->data, backColor, foreColor, &gdi->palette))
-						goto out_error;
+					if (!gdi_brush_expand_mono(data, gdi->drawing->hdc->format, 0, 8, 8, brush->data,
+					                           backColor, foreColor))
+						return NULL;
 				}
 
 				hBmp = gdi_CreateBitmapEx(8, 8, gdi->drawing->hdc->format, 0, data, NULL);
 
 				if (!hBmp)
-					goto out_error;
+					return NULL;
 
 				hbrush = gdi_CreatePatternBrush(hBmp);
 			}
@@ -663,17 +650,50 @@ static BOOL gdi_patblt(rdpContext* context, PATBLT_ORDER* patblt)
 			break;
 	}
 
+	if (!hbrush)
+	{
+		gdi_DeleteObject((HGDIOBJECT) hBmp);
+		return NULL;
+	}
+
+	hbrush->nXOrg = brush->x;
+	hbrush->nYOrg = brush->y;
+	*phBmp = hBmp;
+	return hbrush;
+}
+
+static BOOL gdi_patblt(rdpContext* context, PATBLT_ORDER* patblt)
+{
+	const rdpBrush* brush = &patblt->brush;
+	UINT32 foreColor;
+	UINT32 backColor;
+	UINT32 originalColor;
+	HGDI_BRUSH originalBrush, hbrush = NULL;
+	rdpGdi* gdi = context->gdi;
+	BOOL ret = FALSE;
+	const DWORD rop = gdi_rop3_code(patblt->bRop);
+	INT32 nXSrc = 0;
+	INT32 nYSrc = 0;
+	HGDI_BITMAP hBmp = NULL;
+
+	if (!gdi_decode_color(gdi, patblt->foreColor, &foreColor, NULL))
+		return FALSE;
+
+	if (!gdi_decode_color(gdi, patblt->backColor, &backColor, NULL))
+		return FALSE;
+
+	originalColor = gdi_SetTextColor(gdi->drawing->hdc, foreColor);
+	originalBrush = gdi->drawing->hdc->brush;
+	hbrush = gdi_create_order_brush(gdi, brush, foreColor, backColor, &hBmp);
+
 	if (hbrush)
 	{
-		hbrush->nXOrg = brush->x;
-		hbrush->nYOrg = brush->y;
 		gdi->drawing->hdc->brush = hbrush;
 		ret = gdi_BitBlt(gdi->drawing->hdc, patblt->nLeftRect, patblt->nTopRect,
 		                 patblt->nWidth, patblt->nHeight,
 		                 gdi->primary->hdc, nXSrc, nYSrc, rop, &gdi->palette);
 	}
 
-out_error:
 	gdi_DeleteObject((HGDIOBJECT) hBmp);
 	gdi_DeleteObject((HGDIOBJECT) hbrush);
 	gdi->drawing->hdc->brush = originalBrush;
@@ -915,10 +935,8 @@ static BOOL gdi_mem3blt(rdpContext* context, MEM3BLT_ORDER* mem3blt)
 				}
 				else
 				{
-					if (!freerdp_image_copy_from_monochrome(data, gdi->drawing->hdc->format, 0, 0,
-					                                        0, 8, 8,
-					                                        brush->data, backColor, foreColor,
-					                                        &gdi->palette))
+					if (!gdi_brush_expand_mono(data, gdi->drawing->hdc->format, 0, 8, 8, brush->data,
+					                           backColor, foreColor))
 					{
 						ret = FALSE;
 						_aligned_free(data);
@@ -966,31 +984,231 @@ out_fail:
 	return ret;
 }
 
+/**
+ * Convert the delta encoded points of a polygon order to absolute
+ * coordinates, starting with the order origin.
+ */
+static GDI_POINT* gdi_polygon_points(INT32 xStart, INT32 yStart, const DELTA_POINT* deltas,
+                                     UINT32 numPoints)
+{
+	UINT32 i;
+	GDI_POINT* points;
+
+	if (!deltas || (numPoints == 0))
+		return NULL;
+
+	points = (GDI_POINT*) calloc(numPoints + 1, sizeof(GDI_POINT));
+
+	if (!points)
+		return NULL;
+
+	points[0].x = xStart;
+	points[0].y = yStart;
+
+	for (i = 0; i < numPoints; i++)
+	{
+		points[i + 1].x = points[i].x + deltas[i].x;
+		points[i + 1].y = points[i].y + deltas[i].y;
+	}
+
+	return points;
+}
+
+/**
+ * Fill a shape with the brush currently selected into the drawing context,
+ * using the given raster and polygon fill mode and no outline.
+ */
+static BOOL gdi_fill_polygon(rdpGdi* gdi, INT32 xStart, INT32 yStart,
+                             const DELTA_POINT* deltas, UINT32 numPoints,
+                             UINT32 bRop2, UINT32 fillMode)
+{
+	BOOL ret;
+	INT32 originalFillMode;
+	HGDI_PEN originalPen;
+	HGDI_DC hdc = gdi->drawing->hdc;
+	GDI_POINT* points = gdi_polygon_points(xStart, yStart, deltas, numPoints);
+
+	if (!points)
+		return FALSE;
+
+	gdi_SetROP2(hdc, bRop2);
+	originalFillMode = gdi_SetPolyFillMode(hdc, fillMode);
+	originalPen = hdc->pen;
+	hdc->pen = NULL;
+	ret = gdi_Polygon(hdc, points, numPoints + 1);
+	hdc->pen = originalPen;
+
+	if (originalFillMode)
+		gdi_SetPolyFillMode(hdc, originalFillMode);
+
+	free(points);
+	return ret;
+}
+
 static BOOL gdi_polygon_sc(rdpContext* context,
                            const POLYGON_SC_ORDER* polygon_sc)
 {
-	WLog_WARN(TAG, "%s: not implemented", __FUNCTION__);
-	return FALSE;
+	UINT32 color;
+	BOOL ret = FALSE;
+	HGDI_BRUSH originalBrush;
+	HGDI_BRUSH hbrush;
+	rdpGdi* gdi = context->gdi;
+
+	if (!gdi_decode_color(gdi, polygon_sc->brushColor, &color, NULL))
+		return FALSE;
+
+	if (!(hbrush = gdi_CreateSolidBrush(color)))
+		return FALSE;
+
+	originalBrush = gdi->drawing->hdc->brush;
+	gdi->drawing->hdc->brush = hbrush;
+	ret = gdi_fill_polygon(gdi, polygon_sc->xStart, polygon_sc->yStart,
+	                       polygon_sc->points, polygon_sc->numPoints,
+	                       polygon_sc->bRop2, polygon_sc->fillMode);
+	gdi->drawing->hdc->brush = originalBrush;
+	gdi_DeleteObject((HGDIOBJECT) hbrush);
+	return ret;
 }
 
 static BOOL gdi_polygon_cb(rdpContext* context, POLYGON_CB_ORDER* polygon_cb)
 {
-	WLog_WARN(TAG, "%s: not implemented", __FUNCTION__);
-	return FALSE;
+	UINT32 foreColor;
+	UINT32 backColor;
+	UINT32 originalColor;
+	UINT32 originalBkColor;
+	INT32 originalBkMode;
+	BOOL ret = FALSE;
+	HGDI_BRUSH originalBrush;
+	HGDI_BRUSH hbrush;
+	HGDI_BITMAP hBmp = NULL;
+	rdpGdi* gdi = context->gdi;
+	HGDI_DC hdc = gdi->drawing->hdc;
+
+	if (!gdi_decode_color(gdi, polygon_cb->foreColor, &foreColor, NULL))
+		return FALSE;
+
+	if (!gdi_decode_color(gdi, polygon_cb->backColor, &backColor, NULL))
+		return FALSE;
+
+	if (!(hbrush = gdi_create_order_brush(gdi, &polygon_cb->brush, foreColor, backColor,
+	                                      &hBmp)))
+		return FALSE;
+
+	originalColor = gdi_SetTextColor(hdc, foreColor);
+	originalBkColor = gdi_SetBkColor(hdc, backColor);
+	originalBkMode = hdc->bkMode;
+	gdi_SetBkMode(hdc, (polygon_cb->backMode == BACKMODE_TRANSPARENT) ? GDI_TRANSPARENT :
+	              GDI_OPAQUE);
+	originalBrush = hdc->brush;
+	hdc->brush = hbrush;
+	ret = gdi_fill_polygon(gdi, polygon_cb->xStart, polygon_cb->yStart,
+	                       polygon_cb->points, polygon_cb->numPoints,
+	                       polygon_cb->bRop2, polygon_cb->fillMode);
+	hdc->brush = originalBrush;
+	hdc->bkMode = originalBkMode;
+	gdi_SetBkColor(hdc, originalBkColor);
+	gdi_SetTextColor(hdc, originalColor);
+	gdi_DeleteObject((HGDIOBJECT) hbrush);
+	gdi_DeleteObject((HGDIOBJECT) hBmp);
+	return ret;
+}
+
+/**
+ * Draw an ellipse order, filled with the selected brush if fillMode is set,
+ * otherwise outlined with a pen of the given color.
+ */
+static BOOL gdi_draw_ellipse(rdpGdi* gdi, INT32 left, INT32 top, INT32 right, INT32 bottom,
+                             UINT32 bRop2, UINT32 fillMode, UINT32 color)
+{
+	BOOL ret;
+	HGDI_PEN hPen = NULL;
+	HGDI_PEN originalPen;
+	HGDI_BRUSH originalBrush;
+	HGDI_DC hdc = gdi->drawing->hdc;
+	originalPen = hdc->pen;
+	originalBrush = hdc->brush;
+
+	if (fillMode)
+		hdc->pen = NULL;
+	else
+	{
+		if (!(hPen = gdi_CreatePen(GDI_PS_SOLID, 1, color, hdc->format, &gdi->palette)))
+			return FALSE;
+
+		hdc->pen = hPen;
+		hdc->brush = NULL;
+	}
+
+	gdi_SetROP2(hdc, bRop2);
+	ret = gdi_Ellipse(hdc, left, top, right, bottom);
+	hdc->pen = originalPen;
+	hdc->brush = originalBrush;
+	gdi_DeleteObject((HGDIOBJECT) hPen);
+	return ret;
 }
 
 static BOOL gdi_ellipse_sc(rdpContext* context,
                            const ELLIPSE_SC_ORDER* ellipse_sc)
 {
-	WLog_WARN(TAG, "%s: not implemented", __FUNCTION__);
-	return FALSE;
+	UINT32 color;
+	BOOL ret;
+	HGDI_BRUSH originalBrush;
+	HGDI_BRUSH hbrush;
+	rdpGdi* gdi = context->gdi;
+
+	if (!gdi_decode_color(gdi, ellipse_sc->color, &color, NULL))
+		return FALSE;
+
+	if (!(hbrush = gdi_CreateSolidBrush(color)))
+		return FALSE;
+
+	originalBrush = gdi->drawing->hdc->brush;
+	gdi->drawing->hdc->brush = hbrush;
+	ret = gdi_draw_ellipse(gdi, ellipse_sc->leftRect, ellipse_sc->topRect,
+	                       ellipse_sc->rightRect, ellipse_sc->bottomRect,
+	                       ellipse_sc->bRop2, ellipse_sc->fillMode, color);
+	gdi->drawing->hdc->brush = originalBrush;
+	gdi_DeleteObject((HGDIOBJECT) hbrush);
+	return ret;
 }
 
 static BOOL gdi_ellipse_cb(rdpContext* context,
                            const ELLIPSE_CB_ORDER* ellipse_cb)
 {
-	WLog_WARN(TAG, "%s: not implemented", __FUNCTION__);
-	return FALSE;
+	UINT32 foreColor;
+	UINT32 backColor;
+	UINT32 originalColor;
+	UINT32 originalBkColor;
+	BOOL ret;
+	HGDI_BRUSH originalBrush;
+	HGDI_BRUSH hbrush;
+	HGDI_BITMAP hBmp = NULL;
+	rdpGdi* gdi = context->gdi;
+	HGDI_DC hdc = gdi->drawing->hdc;
+
+	if (!gdi_decode_color(gdi, ellipse_cb->foreColor, &foreColor, NULL))
+		return FALSE;
+
+	if (!gdi_decode_color(gdi, ellipse_cb->backColor, &backColor, NULL))
+		return FALSE;
+
+	if (!(hbrush = gdi_create_order_brush(gdi, &ellipse_cb->brush, foreColor, backColor,
+	                                      &hBmp)))
+		return FALSE;
+
+	originalColor = gdi_SetTextColor(hdc, foreColor);
+	originalBkColor = gdi_SetBkColor(hdc, backColor);
+	originalBrush = hdc->brush;
+	hdc->brush = hbrush;
+	ret = gdi_draw_ellipse(gdi, ellipse_cb->leftRect, ellipse_cb->topRect,
+	                       ellipse_cb->rightRect, ellipse_cb->bottomRect,
+	                       ellipse_cb->bRop2, ellipse_cb->fillMode, foreColor);
+	hdc->brush = originalBrush;
+	gdi_SetBkColor(hdc, originalBkColor);
+	gdi_SetTextColor(hdc, originalColor);
+	gdi_DeleteObject((HGDIOBJECT) hbrush);
+	gdi_DeleteObject((HGDIOBJECT) hBmp);
+	return ret;
 }
 
 static BOOL gdi_frame_marker(rdpContext* context,
@@ -38,14 +38,14 @@
 #include "line.h"
 
 /**
- * Draw a line from the current position to the given position.\n
- * @msdn{dd145029}
- * @param hdc device context
- * @param nXEnd ending x position
- * @param nYEnd ending y position
+ * Combine a pixel with a pen color according to a binary raster operation.
+ * @param rop binary raster operation (GDI_R2_*)
+ * @param pixelPtr pixel to update
+ * @param pen pen color in the pixel format
+ * @param format pixel format
  * @return nonzero if successful, 0 otherwise
  */
-static BOOL gdi_rop_color(UINT32 rop, BYTE* pixelPtr, UINT32 pen, UINT32 format)
+BOOL gdi_rop_color(UINT32 rop, BYTE* pixelPtr, UINT32 pen, UINT32 format)
 {
 	const UINT32 srcPixel = ReadColor(pixelPtr, format);
 	UINT32 dstPixel;
@@ -123,6 +123,14 @@ static BOOL gdi_rop_color(UINT32 rop, BYTE* pixelPtr, UINT32 pen, UINT32 format)
 	return WriteColor(pixelPtr, format, dstPixel);
 }
 
+/**
+ * Draw a line from the current position to the given position.\n
+ * @msdn{dd145029}
+ * @param hdc device context
+ * @param nXEnd ending x position
+ * @param nYEnd ending y position
+ * @return nonzero if successful, 0 otherwise
+ */
 BOOL gdi_LineTo(HGDI_DC hdc, UINT32 nXEnd, UINT32 nYEnd)
 {
 	INT32 x, y;
@@ -0,0 +1,357 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * GDI Ternary Raster Operation Kernels
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/synch.h>
+
+#include <freerdp/gdi/gdi.h>
+
+#include "rop3.h"
+
+/**
+ * One row kernel per ternary raster operation, generated from the postfix
+ * notation in gdi_rop_to_string(). BLACKNESS (0x00) and WHITENESS (0xFF)
+ * depend on the pixel format and are handled by the caller as PATCOPY with a
+ * constant pattern.
+ */
+#define D pDst[x]
+#define S pSrc[x]
+#define P pPat[x]
+
+#define GDI_ROP3_KERNEL(_code, _expr) \
+	static void gdi_rop3_kernel_##_code(UINT32* pDst, const UINT32* pSrc, const UINT32* pPat, \
+	                                    UINT32 count) \
+	{ \
+		UINT32 x; \
+		WINPR_UNUSED(pSrc); \
+		WINPR_UNUSED(pPat); \
+		\
+		for (x = 0; x < count; x++) \
+			pDst[x] = (_expr); \
+	}
+
+GDI_ROP3_KERNEL(00, 0)
+GDI_ROP3_KERNEL(01, ~(D | (P | S))) /* DPSoon */
+GDI_ROP3_KERNEL(02, D & ~(P | S)) /* DPSona */
+GDI_ROP3_KERNEL(03, ~(P | S)) /* PSon */
+GDI_ROP3_KERNEL(04, S & ~(D | P)) /* SDPona */
+GDI_ROP3_KERNEL(05, ~(D | P)) /* DPon */
+GDI_ROP3_KERNEL(06, ~(P | ~(D ^ S))) /* PDSxnon */
+GDI_ROP3_KERNEL(07, ~(P | (D & S))) /* PDSaon */
+GDI_ROP3_KERNEL(08, S & (D & ~P)) /* SDPnaa */
+GDI_ROP3_KERNEL(09, ~(P | (D ^ S))) /* PDSxon */
+GDI_ROP3_KERNEL(0A, D & ~P) /* DPna */
+GDI_ROP3_KERNEL(0B, ~(P | (S & ~D))) /* PSDnaon */
+GDI_ROP3_KERNEL(0C, S & ~P) /* SPna */
+GDI_ROP3_KERNEL(0D, ~(P | (D & ~S))) /* PDSnaon */
+GDI_ROP3_KERNEL(0E, ~(P | ~(D | S))) /* PDSonon */
+GDI_ROP3_KERNEL(0F, ~P) /* Pn */
+GDI_ROP3_KERNEL(10, P & ~(D | S)) /* PDSona */
+GDI_ROP3_KERNEL(11, ~(D | S)) /* DSon */
+GDI_ROP3_KERNEL(12, ~(S | ~(D ^ P))) /* SDPxnon */
+GDI_ROP3_KERNEL(13, ~(S | (D & P))) /* SDPaon */
+GDI_ROP3_KERNEL(14, ~(D | ~(P ^ S))) /* DPSxnon */
+GDI_ROP3_KERNEL(15, ~(D | (P & S))) /* DPSaon */
+GDI_ROP3_KERNEL(16, P ^ (S ^ (D & ~(P & S)))) /* PSDPSanaxx */
+GDI_ROP3_KERNEL(17, ~(S ^ ((S ^ P) & (D ^ S)))) /* SSPxDSxaxn */
+GDI_ROP3_KERNEL(18, (S ^ P) & (P ^ D)) /* SPxPDxa */
+GDI_ROP3_KERNEL(19, ~(S ^ (D & ~(P & S)))) /* SDPSanaxn */
+GDI_ROP3_KERNEL(1A, P ^ (D | (S & P))) /* PDSPaox */
+GDI_ROP3_KERNEL(1B, ~(S ^ (D & (P ^ S)))) /* SDPSxaxn */
+GDI_ROP3_KERNEL(1C, P ^ (S | (D & P))) /* PSDPaox */
+GDI_ROP3_KERNEL(1D, ~(D ^ (S & (P ^ D)))) /* DSPDxaxn */
+GDI_ROP3_KERNEL(1E, P ^ (D | S)) /* PDSox */
+GDI_ROP3_KERNEL(1F, ~(P & (D | S))) /* PDSoan */
+GDI_ROP3_KERNEL(20, D & (P & ~S)) /* DPSnaa */
+GDI_ROP3_KERNEL(21, ~(S | (D ^ P))) /* SDPxon */
+GDI_ROP3_KERNEL(22, D & ~S) /* DSna */
+GDI_ROP3_KERNEL(23, ~(S | (P & ~D))) /* SPDnaon */
+GDI_ROP3_KERNEL(24, (S ^ P) & (D ^ S)) /* SPxDSxa */
+GDI_ROP3_KERNEL(25, ~(P ^ (D & ~(S & P)))) /* PDSPanaxn */
+GDI_ROP3_KERNEL(26, S ^ (D | (P & S))) /* SDPSaox */
+GDI_ROP3_KERNEL(27, S ^ (D | ~(P ^ S))) /* SDPSxnox */
+GDI_ROP3_KERNEL(28, D & (P ^ S)) /* DPSxa */
+GDI_ROP3_KERNEL(29, ~(P ^ (S ^ (D | (P & S))))) /* PSDPSaoxxn */
+GDI_ROP3_KERNEL(2A, D & ~(P & S)) /* DPSana */
+GDI_ROP3_KERNEL(2B, ~(S ^ ((S ^ P) & (P ^ D)))) /* SSPxPDxaxn */
+GDI_ROP3_KERNEL(2C, S ^ (P & (D | S))) /* SPDSoax */
+GDI_ROP3_KERNEL(2D, P ^ (S | ~D)) /* PSDnox */
+GDI_ROP3_KERNEL(2E, P ^ (S | (D ^ P))) /* PSDPxox */
+GDI_ROP3_KERNEL(2F, ~(P & (S | ~D))) /* PSDnoan */
+GDI_ROP3_KERNEL(30, P & ~S) /* PSna */
+GDI_ROP3_KERNEL(31, ~(S | (D & ~P))) /* SDPnaon */
+GDI_ROP3_KERNEL(32, S ^ (D | (P | S))) /* SDPSoox */
+GDI_ROP3_KERNEL(33, ~S) /* Sn */
+GDI_ROP3_KERNEL(34, S ^ (P | (D & S))) /* SPDSaox */
+GDI_ROP3_KERNEL(35, S ^ (P | ~(D ^ S))) /* SPDSxnox */
+GDI_ROP3_KERNEL(36, S ^ (D | P)) /* SDPox */
+GDI_ROP3_KERNEL(37, ~(S & (D | P))) /* SDPoan */
+GDI_ROP3_KERNEL(38, P ^ (S & (D | P))) /* PSDPoax */
+GDI_ROP3_KERNEL(39, S ^ (P | ~D)) /* SPDnox */
+GDI_ROP3_KERNEL(3A, S ^ (P | (D ^ S))) /* SPDSxox */
+GDI_ROP3_KERNEL(3B, ~(S & (P | ~D))) /* SPDnoan */
+GDI_ROP3_KERNEL(3C, P ^ S) /* PSx */
+GDI_ROP3_KERNEL(3D, S ^ (P | ~(D | S))) /* SPDSonox */
+GDI_ROP3_KERNEL(3E, S ^ (P | (D & ~S))) /* SPDSnaox */
+GDI_ROP3_KERNEL(3F, ~(P & S)) /* PSan */
+GDI_ROP3_KERNEL(40, P & (S & ~D)) /* PSDnaa */
+GDI_ROP3_KERNEL(41, ~(D | (P ^ S))) /* DPSxon */
+GDI_ROP3_KERNEL(42, (S ^ D) & (P ^ D)) /* SDxPDxa */
+GDI_ROP3_KERNEL(43, ~(S ^ (P & ~(D & S)))) /* SPDSanaxn */
+GDI_ROP3_KERNEL(44, S & ~D) /* SDna */
+GDI_ROP3_KERNEL(45, ~(D | (P & ~S))) /* DPSnaon */
+GDI_ROP3_KERNEL(46, D ^ (S | (P & D))) /* DSPDaox */
+GDI_ROP3_KERNEL(47, ~(P ^ (S & (D ^ P)))) /* PSDPxaxn */
+GDI_ROP3_KERNEL(48, S & (D ^ P)) /* SDPxa */
+GDI_ROP3_KERNEL(49, ~(P ^ (D ^ (S | (P & D))))) /* PDSPDaoxxn */
+GDI_ROP3_KERNEL(4A, D ^ (P & (S | D))) /* DPSDoax */
+GDI_ROP3_KERNEL(4B, P ^ (D | ~S)) /* PDSnox */
+GDI_ROP3_KERNEL(4C, S & ~(D & P)) /* SDPana */
+GDI_ROP3_KERNEL(4D, ~(S ^ ((S ^ P) | (D ^ S)))) /* SSPxDSxoxn */
+GDI_ROP3_KERNEL(4E, P ^ (D | (S ^ P))) /* PDSPxox */
+GDI_ROP3_KERNEL(4F, ~(P & (D | ~S))) /* PDSnoan */
+GDI_ROP3_KERNEL(50, P & ~D) /* PDna */
+GDI_ROP3_KERNEL(51, ~(D | (S & ~P))) /* DSPnaon */
+GDI_ROP3_KERNEL(52, D ^ (P | (S & D))) /* DPSDaox */
+GDI_ROP3_KERNEL(53, ~(S ^ (P & (D ^ S)))) /* SPDSxaxn */
+GDI_ROP3_KERNEL(54, ~(D | ~(P | S))) /* DPSonon */
+GDI_ROP3_KERNEL(55, ~D) /* Dn */
+GDI_ROP3_KERNEL(56, D ^ (P | S)) /* DPSox */
+GDI_ROP3_KERNEL(57, ~(D & (P | S))) /* DPSoan */
+GDI_ROP3_KERNEL(58, P ^ (D & (S | P))) /* PDSPoax */
+GDI_ROP3_KERNEL(59, D ^ (P | ~S)) /* DPSnox */
+GDI_ROP3_KERNEL(5A, D ^ P) /* DPx */
+GDI_ROP3_KERNEL(5B, D ^ (P | ~(S | D))) /* DPSDonox */
+GDI_ROP3_KERNEL(5C, D ^ (P | (S ^ D))) /* DPSDxox */
+GDI_ROP3_KERNEL(5D, ~(D & (P | ~S))) /* DPSnoan */
+GDI_ROP3_KERNEL(5E, D ^ (P | (S & ~D))) /* DPSDnaox */
+GDI_ROP3_KERNEL(5F, ~(D & P)) /* DPan */
+GDI_ROP3_KERNEL(60, P & (D ^ S)) /* PDSxa */
+GDI_ROP3_KERNEL(61, ~(D ^ (S ^ (P | (D & S))))) /* DSPDSaoxxn */
+GDI_ROP3_KERNEL(62, D ^ (S & (P | D))) /* DSPDoax */
+GDI_ROP3_KERNEL(63, S ^ (D | ~P)) /* SDPnox */
+GDI_ROP3_KERNEL(64, S ^ (D & (P | S))) /* SDPSoax */
+GDI_ROP3_KERNEL(65, D ^ (S | ~P)) /* DSPnox */
+GDI_ROP3_KERNEL(66, D ^ S) /* DSx */
+GDI_ROP3_KERNEL(67, S ^ (D | ~(P | S))) /* SDPSonox */
+GDI_ROP3_KERNEL(68, ~(D ^ (S ^ (P | ~(D | S))))) /* DSPDSonoxxn */
+GDI_ROP3_KERNEL(69, ~(P ^ (D ^ S))) /* PDSxxn */
+GDI_ROP3_KERNEL(6A, D ^ (P & S)) /* DPSax */
+GDI_ROP3_KERNEL(6B, ~(P ^ (S ^ (D & (P | S))))) /* PSDPSoaxxn */
+GDI_ROP3_KERNEL(6C, S ^ (D & P)) /* SDPax */
+GDI_ROP3_KERNEL(6D, ~(P ^ (D ^ (S & (P | D))))) /* PDSPDoaxxn */
+GDI_ROP3_KERNEL(6E, S ^ (D & (P | ~S))) /* SDPSnoax */
+GDI_ROP3_KERNEL(6F, ~(P & ~(D ^ S))) /* PDSxnan */
+GDI_ROP3_KERNEL(70, P & ~(D & S)) /* PDSana */
+GDI_ROP3_KERNEL(71, ~(S ^ ((S ^ D) & (P ^ D)))) /* SSDxPDxaxn */
+GDI_ROP3_KERNEL(72, S ^ (D | (P ^ S))) /* SDPSxox */
+GDI_ROP3_KERNEL(73, ~(S & (D | ~P))) /* SDPnoan */
+GDI_ROP3_KERNEL(74, D ^ (S | (P ^ D))) /* DSPDxox */
+GDI_ROP3_KERNEL(75, ~(D & (S | ~P))) /* DSPnoan */
+GDI_ROP3_KERNEL(76, S ^ (D | (P & ~S))) /* SDPSnaox */
+GDI_ROP3_KERNEL(77, ~(D & S)) /* DSan */
+GDI_ROP3_KERNEL(78, P ^ (D & S)) /* PDSax */
+GDI_ROP3_KERNEL(79, ~(D ^ (S ^ (P & (D | S))))) /* DSPDSoaxxn */
+GDI_ROP3_KERNEL(7A, D ^ (P & (S | ~D))) /* DPSDnoax */
+GDI_ROP3_KERNEL(7B, ~(S & ~(D ^ P))) /* SDPxnan */
+GDI_ROP3_KERNEL(7C, S ^ (P & (D | ~S))) /* SPDSnoax */
+GDI_ROP3_KERNEL(7D, ~(D & ~(P ^ S))) /* DPSxnan */
+GDI_ROP3_KERNEL(7E, (S ^ P) | (D ^ S)) /* SPxDSxo */
+GDI_ROP3_KERNEL(7F, ~(D & (P & S))) /* DPSaan */
+GDI_ROP3_KERNEL(80, D & (P & S)) /* DPSaa */
+GDI_ROP3_KERNEL(81, ~((S ^ P) | (D ^ S))) /* SPxDSxon */
+GDI_ROP3_KERNEL(82, D & ~(P ^ S)) /* DPSxna */
+GDI_ROP3_KERNEL(83, ~(S ^ (P & (D | ~S)))) /* SPDSnoaxn */
+GDI_ROP3_KERNEL(84, S & ~(D ^ P)) /* SDPxna */
+GDI_ROP3_KERNEL(85, ~(P ^ (D & (S | ~P)))) /* PDSPnoaxn */
+GDI_ROP3_KERNEL(86, D ^ (S ^ (P & (D | S)))) /* DSPDSoaxx */
+GDI_ROP3_KERNEL(87, ~(P ^ (D & S))) /* PDSaxn */
+GDI_ROP3_KERNEL(88, D & S) /* DSa */
+GDI_ROP3_KERNEL(89, ~(S ^ (D | (P & ~S)))) /* SDPSnaoxn */
+GDI_ROP3_KERNEL(8A, D & (S | ~P)) /* DSPnoa */
+GDI_ROP3_KERNEL(8B, ~(D ^ (S | (P ^ D)))) /* DSPDxoxn */
+GDI_ROP3_KERNEL(8C, S & (D | ~P)) /* SDPnoa */
+GDI_ROP3_KERNEL(8D, ~(S ^ (D | (P ^ S)))) /* SDPSxoxn */
+GDI_ROP3_KERNEL(8E, S ^ ((S ^ D) & (P ^ D))) /* SSDxPDxax */
+GDI_ROP3_KERNEL(8F, ~(P & ~(D & S))) /* PDSanan */
+GDI_ROP3_KERNEL(90, P & ~(D ^ S)) /* PDSxna */
+GDI_ROP3_KERNEL(91, ~(S ^ (D & (P | ~S)))) /* SDPSnoaxn */
+GDI_ROP3_KERNEL(92, D ^ (P ^ (S & (D | P)))) /* DPSDPoaxx */
+GDI_ROP3_KERNEL(93, ~(S ^ (P & D))) /* SPDaxn */
+GDI_ROP3_KERNEL(94, P ^ (S ^ (D & (P | S)))) /* PSDPSoaxx */
+GDI_ROP3_KERNEL(95, ~(D ^ (P & S))) /* DPSaxn */
+GDI_ROP3_KERNEL(96, D ^ (P ^ S)) /* DPSxx */
+GDI_ROP3_KERNEL(97, P ^ (S ^ (D | ~(P | S)))) /* PSDPSonoxx */
+GDI_ROP3_KERNEL(98, ~(S ^ (D | ~(P | S)))) /* SDPSonoxn */
+GDI_ROP3_KERNEL(99, ~(D ^ S)) /* DSxn */
+GDI_ROP3_KERNEL(9A, D ^ (P & ~S)) /* DPSnax */
+GDI_ROP3_KERNEL(9B, ~(S ^ (D & (P | S)))) /* SDPSoaxn */
+GDI_ROP3_KERNEL(9C, S ^ (P & ~D)) /* SPDnax */
+GDI_ROP3_KERNEL(9D, ~(D ^ (S & (P | D)))) /* DSPDoaxn */
+GDI_ROP3_KERNEL(9E, D ^ (S ^ (P | (D & S)))) /* DSPDSaoxx */
+GDI_ROP3_KERNEL(9F, ~(P & (D ^ S))) /* PDSxan */
+GDI_ROP3_KERNEL(A0, D & P) /* DPa */
+GDI_ROP3_KERNEL(A1, ~(P ^ (D | (S & ~P)))) /* PDSPnaoxn */
+GDI_ROP3_KERNEL(A2, D & (P | ~S)) /* DPSnoa */
+GDI_ROP3_KERNEL(A3, ~(D ^ (P | (S ^ D)))) /* DPSDxoxn */
+GDI_ROP3_KERNEL(A4, ~(P ^ (D | ~(S | P)))) /* PDSPonoxn */
+GDI_ROP3_KERNEL(A5, ~(P ^ D)) /* PDxn */
+GDI_ROP3_KERNEL(A6, D ^ (S & ~P)) /* DSPnax */
+GDI_ROP3_KERNEL(A7, ~(P ^ (D & (S | P)))) /* PDSPoaxn */
+GDI_ROP3_KERNEL(A8, D & (P | S)) /* DPSoa */
+GDI_ROP3_KERNEL(A9, ~(D ^ (P | S))) /* DPSoxn */
+GDI_ROP3_KERNEL(AA, D) /* D */
+GDI_ROP3_KERNEL(AB, D | ~(P | S)) /* DPSono */
+GDI_ROP3_KERNEL(AC, S ^ (P & (D ^ S))) /* SPDSxax */
+GDI_ROP3_KERNEL(AD, ~(D ^ (P | (S & D)))) /* DPSDaoxn */
+GDI_ROP3_KERNEL(AE, D | (S & ~P)) /* DSPnao */
+GDI_ROP3_KERNEL(AF, D | ~P) /* DPno */
+GDI_ROP3_KERNEL(B0, P & (D | ~S)) /* PDSnoa */
+GDI_ROP3_KERNEL(B1, ~(P ^ (D | (S ^ P)))) /* PDSPxoxn */
+GDI_ROP3_KERNEL(B2, S ^ ((S ^ P) | (D ^ S))) /* SSPxDSxox */
+GDI_ROP3_KERNEL(B3, ~(S & ~(D & P))) /* SDPanan */
+GDI_ROP3_KERNEL(B4, P ^ (S & ~D)) /* PSDnax */
+GDI_ROP3_KERNEL(B5, ~(D ^ (P & (S | D)))) /* DPSDoaxn */
+GDI_ROP3_KERNEL(B6, D ^ (P ^ (S | (D & P)))) /* DPSDPaoxx */
+GDI_ROP3_KERNEL(B7, ~(S & (D ^ P))) /* SDPxan */
+GDI_ROP3_KERNEL(B8, P ^ (S & (D ^ P))) /* PSDPxax */
+GDI_ROP3_KERNEL(B9, ~(D ^ (S | (P & D)))) /* DSPDaoxn */
+GDI_ROP3_KERNEL(BA, D | (P & ~S)) /* DPSnao */
+GDI_ROP3_KERNEL(BB, D | ~S) /* DSno */
+GDI_ROP3_KERNEL(BC, S ^ (P & ~(D & S))) /* SPDSanax */
+GDI_ROP3_KERNEL(BD, ~((S ^ D) & (P ^ D))) /* SDxPDxan */
+GDI_ROP3_KERNEL(BE, D | (P ^ S)) /* DPSxo */
+GDI_ROP3_KERNEL(BF, D | ~(P & S)) /* DPSano */
+GDI_ROP3_KERNEL(C0, P & S) /* PSa */
+GDI_ROP3_KERNEL(C1, ~(S ^ (P | (D & ~S)))) /* SPDSnaoxn */
+GDI_ROP3_KERNEL(C2, ~(S ^ (P | ~(D | S)))) /* SPDSonoxn */
+GDI_ROP3_KERNEL(C3, ~(P ^ S)) /* PSxn */
+GDI_ROP3_KERNEL(C4, S & (P | ~D)) /* SPDnoa */
+GDI_ROP3_KERNEL(C5, ~(S ^ (P | (D ^ S)))) /* SPDSxoxn */
+GDI_ROP3_KERNEL(C6, S ^ (D & ~P)) /* SDPnax */
+GDI_ROP3_KERNEL(C7, ~(P ^ (S & (D | P)))) /* PSDPoaxn */
+GDI_ROP3_KERNEL(C8, S & (D | P)) /* SDPoa */
+GDI_ROP3_KERNEL(C9, ~(S ^ (P | D))) /* SPDoxn */
+GDI_ROP3_KERNEL(CA, D ^ (P & (S ^ D))) /* DPSDxax */
+GDI_ROP3_KERNEL(CB, ~(S ^ (P | (D & S)))) /* SPDSaoxn */
+GDI_ROP3_KERNEL(CC, S) /* S */
+GDI_ROP3_KERNEL(CD, S | ~(D | P)) /* SDPono */
+GDI_ROP3_KERNEL(CE, S | (D & ~P)) /* SDPnao */
+GDI_ROP3_KERNEL(CF, S | ~P) /* SPno */
+GDI_ROP3_KERNEL(D0, P & (S | ~D)) /* PSDnoa */
+GDI_ROP3_KERNEL(D1, ~(P ^ (S | (D ^ P)))) /* PSDPxoxn */
+GDI_ROP3_KERNEL(D2, P ^ (D & ~S)) /* PDSnax */
+GDI_ROP3_KERNEL(D3, ~(S ^ (P & (D | S)))) /* SPDSoaxn */
+GDI_ROP3_KERNEL(D4, S ^ ((S ^ P) & (P ^ D))) /* SSPxPDxax */
+GDI_ROP3_KERNEL(D5, ~(D & ~(P & S))) /* DPSanan */
+GDI_ROP3_KERNEL(D6, P ^ (S ^ (D | (P & S)))) /* PSDPSaoxx */
+GDI_ROP3_KERNEL(D7, ~(D & (P ^ S))) /* DPSxan */
+GDI_ROP3_KERNEL(D8, P ^ (D & (S ^ P))) /* PDSPxax */
+GDI_ROP3_KERNEL(D9, ~(S ^ (D | (P & S)))) /* SDPSaoxn */
+GDI_ROP3_KERNEL(DA, D ^ (P & ~(S & D))) /* DPSDanax */
+GDI_ROP3_KERNEL(DB, ~((S ^ P) & (D ^ S))) /* SPxDSxan */
+GDI_ROP3_KERNEL(DC, S | (P & ~D)) /* SPDnao */
+GDI_ROP3_KERNEL(DD, S | ~D) /* SDno */
+GDI_ROP3_KERNEL(DE, S | (D ^ P)) /* SDPxo */
+GDI_ROP3_KERNEL(DF, S | ~(D & P)) /* SDPano */
+GDI_ROP3_KERNEL(E0, P & (D | S)) /* PDSoa */
+GDI_ROP3_KERNEL(E1, ~(P ^ (D | S))) /* PDSoxn */
+GDI_ROP3_KERNEL(E2, D ^ (S & (P ^ D))) /* DSPDxax */
+GDI_ROP3_KERNEL(E3, ~(P ^ (S | (D & P)))) /* PSDPaoxn */
+GDI_ROP3_KERNEL(E4, S ^ (D & (P ^ S))) /* SDPSxax */
+GDI_ROP3_KERNEL(E5, ~(P ^ (D | (S & P)))) /* PDSPaoxn */
+GDI_ROP3_KERNEL(E6, S ^ (D & ~(P & S))) /* SDPSanax */
+GDI_ROP3_KERNEL(E7, ~((S ^ P) & (P ^ D))) /* SPxPDxan */
+GDI_ROP3_KERNEL(E8, S ^ ((S ^ P) & (D ^ S))) /* SSPxDSxax */
+GDI_ROP3_KERNEL(E9, ~(D ^ (S ^ (P & ~(D & S))))) /* DSPDSanaxxn */
+GDI_ROP3_KERNEL(EA, D | (P & S)) /* DPSao */
+GDI_ROP3_KERNEL(EB, D | ~(P ^ S)) /* DPSxno */
+GDI_ROP3_KERNEL(EC, S | (D & P)) /* SDPao */
+GDI_ROP3_KERNEL(ED, S | ~(D ^ P)) /* SDPxno */
+GDI_ROP3_KERNEL(EE, D | S) /* DSo */
+GDI_ROP3_KERNEL(EF, S | (D | ~P)) /* SDPnoo */
+GDI_ROP3_KERNEL(F0, P) /* P */
+GDI_ROP3_KERNEL(F1, P | ~(D | S)) /* PDSono */
+GDI_ROP3_KERNEL(F2, P | (D & ~S)) /* PDSnao */
+GDI_ROP3_KERNEL(F3, P | ~S) /* PSno */
+GDI_ROP3_KERNEL(F4, P | (S & ~D)) /* PSDnao */
+GDI_ROP3_KERNEL(F5, P | ~D) /* PDno */
+GDI_ROP3_KERNEL(F6, P | (D ^ S)) /* PDSxo */
+GDI_ROP3_KERNEL(F7, P | ~(D & S)) /* PDSano */
+GDI_ROP3_KERNEL(F8, P | (D & S)) /* PDSao */
+GDI_ROP3_KERNEL(F9, P | ~(D ^ S)) /* PDSxno */
+GDI_ROP3_KERNEL(FA, D | P) /* DPo */
+GDI_ROP3_KERNEL(FB, D | (P | ~S)) /* DPSnoo */
+GDI_ROP3_KERNEL(FC, P | S) /* PSo */
+GDI_ROP3_KERNEL(FD, P | (S | ~D)) /* PSDnoo */
+GDI_ROP3_KERNEL(FE, D | (P | S)) /* DPSoo */
+GDI_ROP3_KERNEL(FF, ~0)
+
+#undef D
+#undef S
+#undef P
+
+#define GDI_ROP3_ENTRY(_code) gdi_rop3_kernel_##_code
+#define GDI_ROP3_ROW(_hi) \
+	GDI_ROP3_ENTRY(_hi##0), GDI_ROP3_ENTRY(_hi##1), GDI_ROP3_ENTRY(_hi##2), GDI_ROP3_ENTRY(_hi##3), \
+	GDI_ROP3_ENTRY(_hi##4), GDI_ROP3_ENTRY(_hi##5), GDI_ROP3_ENTRY(_hi##6), GDI_ROP3_ENTRY(_hi##7), \
+	GDI_ROP3_ENTRY(_hi##8), GDI_ROP3_ENTRY(_hi##9), GDI_ROP3_ENTRY(_hi##A), GDI_ROP3_ENTRY(_hi##B), \
+	GDI_ROP3_ENTRY(_hi##C), GDI_ROP3_ENTRY(_hi##D), GDI_ROP3_ENTRY(_hi##E), GDI_ROP3_ENTRY(_hi##F)
+
+static gdiRop3Kernel gdi_rop3_kernels[256] =
+{
+	GDI_ROP3_ROW(0), GDI_ROP3_ROW(1), GDI_ROP3_ROW(2), GDI_ROP3_ROW(3),
+	GDI_ROP3_ROW(4), GDI_ROP3_ROW(5), GDI_ROP3_ROW(6), GDI_ROP3_ROW(7),
+	GDI_ROP3_ROW(8), GDI_ROP3_ROW(9), GDI_ROP3_ROW(A), GDI_ROP3_ROW(B),
+	GDI_ROP3_ROW(C), GDI_ROP3_ROW(D), GDI_ROP3_ROW(E), GDI_ROP3_ROW(F)
+};
+
+static INIT_ONCE gdi_rop3_init_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK gdi_rop3_init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	WINPR_UNUSED(once);
+	WINPR_UNUSED(param);
+	WINPR_UNUSED(context);
+#if defined(WITH_SSE2)
+	gdi_rop3_init_sse2(gdi_rop3_kernels);
+#elif defined(WITH_NEON)
+	gdi_rop3_init_neon(gdi_rop3_kernels);
+#endif
+	return TRUE;
+}
+
+/**
+ * Maps a raster operation code to its ROP3 truth table index.
+ */
+BYTE gdi_rop3_index(DWORD rop)
+{
+	/* glyphs are drawn with SPaDSnao, which is the truth table of DSPDxax */
+	if (rop == GDI_GLYPH_ORDER)
+		return 0xE2;
+
+	return (rop >> 16) & 0xFF;
+}
+
+gdiRop3Kernel gdi_rop3_get_kernel(BYTE rop3)
+{
+	InitOnceExecuteOnce(&gdi_rop3_init_once, gdi_rop3_init, NULL, NULL);
+	return gdi_rop3_kernels[rop3];
+}
@@ -0,0 +1,56 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * GDI Ternary Raster Operation Kernels
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_GDI_ROP3_H
+#define FREERDP_LIB_GDI_ROP3_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+
+/* ROP3 truth table operands: bit index = (P << 2) | (S << 1) | D */
+#define GDI_ROP3_PAT 0xF0
+#define GDI_ROP3_SRC 0xCC
+#define GDI_ROP3_DST 0xAA
+
+#define GDI_ROP3_USES_PAT(_rop3) ((((_rop3) >> 4) & 0x0F) != ((_rop3) & 0x0F))
+#define GDI_ROP3_USES_SRC(_rop3) ((((_rop3) >> 2) & 0x33) != ((_rop3) & 0x33))
+
+/**
+ * Applies a raster operation to a row of pixels.
+ *
+ * The operands are pixel values (or their in-memory representation) of the
+ * destination format. pSrc and pPat are only accessed if the raster
+ * operation uses them.
+ */
+typedef void (*gdiRop3Kernel)(UINT32* pDst, const UINT32* pSrc, const UINT32* pPat,
+                              UINT32 count);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FREERDP_LOCAL BYTE gdi_rop3_index(DWORD rop);
+FREERDP_LOCAL gdiRop3Kernel gdi_rop3_get_kernel(BYTE rop3);
+
+FREERDP_LOCAL void gdi_rop3_init_sse2(gdiRop3Kernel* kernels);
+FREERDP_LOCAL void gdi_rop3_init_neon(gdiRop3Kernel* kernels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_LIB_GDI_ROP3_H */
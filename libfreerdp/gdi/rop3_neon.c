@@ -0,0 +1,79 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * GDI Ternary Raster Operation Kernels - NEON Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+
+#include "rop3.h"
+
+#if defined(WITH_NEON)
+
+#include <arm_neon.h>
+
+#define GDI_ROP3_NEON_KERNEL(_name, _expr, _scalar) \
+	static void gdi_rop3_##_name##_neon(UINT32* pDst, const UINT32* pSrc, const UINT32* pPat, \
+	                                    UINT32 count) \
+	{ \
+		UINT32 x = 0; \
+		WINPR_UNUSED(pSrc); \
+		WINPR_UNUSED(pPat); \
+		\
+		for (; x + 4 <= count; x += 4) \
+		{ \
+			const uint32x4_t D = vld1q_u32(&pDst[x]); \
+			const uint32x4_t S = pSrc ? vld1q_u32(&pSrc[x]) : D; \
+			const uint32x4_t P = pPat ? vld1q_u32(&pPat[x]) : D; \
+			WINPR_UNUSED(D); \
+			WINPR_UNUSED(S); \
+			WINPR_UNUSED(P); \
+			vst1q_u32(&pDst[x], (_expr)); \
+		} \
+		\
+		for (; x < count; x++) \
+		{ \
+			const UINT32 D = pDst[x]; \
+			const UINT32 S = pSrc ? pSrc[x] : D; \
+			const UINT32 P = pPat ? pPat[x] : D; \
+			WINPR_UNUSED(D); \
+			WINPR_UNUSED(S); \
+			WINPR_UNUSED(P); \
+			pDst[x] = (_scalar); \
+		} \
+	}
+
+GDI_ROP3_NEON_KERNEL(SRCCOPY, S, S)
+GDI_ROP3_NEON_KERNEL(PATCOPY, P, P)
+GDI_ROP3_NEON_KERNEL(SRCINVERT, veorq_u32(D, S), D ^ S)
+GDI_ROP3_NEON_KERNEL(DSTINVERT, vmvnq_u32(D), ~D)
+GDI_ROP3_NEON_KERNEL(MERGECOPY, vandq_u32(P, S), P & S)
+
+void gdi_rop3_init_neon(gdiRop3Kernel* kernels)
+{
+	if (!IsProcessorFeaturePresent(PF_ARM_NEON_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	kernels[GDI_ROP3_SRC] = gdi_rop3_SRCCOPY_neon;
+	kernels[GDI_ROP3_PAT] = gdi_rop3_PATCOPY_neon;
+	kernels[GDI_ROP3_DST ^ GDI_ROP3_SRC] = gdi_rop3_SRCINVERT_neon;
+	kernels[GDI_ROP3_DST ^ 0xFF] = gdi_rop3_DSTINVERT_neon;
+	kernels[GDI_ROP3_PAT & GDI_ROP3_SRC] = gdi_rop3_MERGECOPY_neon;
+}
+
+#endif /* WITH_NEON */
@@ -0,0 +1,81 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * GDI Ternary Raster Operation Kernels - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+
+#include "rop3.h"
+
+#if defined(WITH_SSE2)
+
+#include <emmintrin.h>
+
+#define GDI_ROP3_SSE2_KERNEL(_name, _expr, _scalar) \
+	static void gdi_rop3_##_name##_sse2(UINT32* pDst, const UINT32* pSrc, const UINT32* pPat, \
+	                                    UINT32 count) \
+	{ \
+		UINT32 x = 0; \
+		const __m128i ones = _mm_set1_epi32(-1); \
+		WINPR_UNUSED(pSrc); \
+		WINPR_UNUSED(pPat); \
+		WINPR_UNUSED(ones); \
+		\
+		for (; x + 4 <= count; x += 4) \
+		{ \
+			const __m128i D = _mm_loadu_si128((const __m128i*) &pDst[x]); \
+			const __m128i S = pSrc ? _mm_loadu_si128((const __m128i*) &pSrc[x]) : D; \
+			const __m128i P = pPat ? _mm_loadu_si128((const __m128i*) &pPat[x]) : D; \
+			WINPR_UNUSED(D); \
+			WINPR_UNUSED(S); \
+			WINPR_UNUSED(P); \
+			_mm_storeu_si128((__m128i*) &pDst[x], (_expr)); \
+		} \
+		\
+		for (; x < count; x++) \
+		{ \
+			const UINT32 D = pDst[x]; \
+			const UINT32 S = pSrc ? pSrc[x] : D; \
+			const UINT32 P = pPat ? pPat[x] : D; \
+			WINPR_UNUSED(D); \
+			WINPR_UNUSED(S); \
+			WINPR_UNUSED(P); \
+			pDst[x] = (_scalar); \
+		} \
+	}
+
+GDI_ROP3_SSE2_KERNEL(SRCCOPY, S, S)
+GDI_ROP3_SSE2_KERNEL(PATCOPY, P, P)
+GDI_ROP3_SSE2_KERNEL(SRCINVERT, _mm_xor_si128(D, S), D ^ S)
+GDI_ROP3_SSE2_KERNEL(DSTINVERT, _mm_xor_si128(D, ones), ~D)
+GDI_ROP3_SSE2_KERNEL(MERGECOPY, _mm_and_si128(P, S), P & S)
+
+void gdi_rop3_init_sse2(gdiRop3Kernel* kernels)
+{
+	if (!IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	kernels[GDI_ROP3_SRC] = gdi_rop3_SRCCOPY_sse2;
+	kernels[GDI_ROP3_PAT] = gdi_rop3_PATCOPY_sse2;
+	kernels[GDI_ROP3_DST ^ GDI_ROP3_SRC] = gdi_rop3_SRCINVERT_sse2;
+	kernels[GDI_ROP3_DST ^ 0xFF] = gdi_rop3_DSTINVERT_sse2;
+	kernels[GDI_ROP3_PAT & GDI_ROP3_SRC] = gdi_rop3_MERGECOPY_sse2;
+}
+
+#endif /* WITH_SSE2 */
@@ -31,21 +31,420 @@
 #include <freerdp/gdi/gdi.h>
 
 #include <freerdp/gdi/bitmap.h>
+#include <freerdp/gdi/pen.h>
 #include <freerdp/gdi/region.h>
 #include <freerdp/gdi/shape.h>
 
 #include <freerdp/log.h>
 
+#include "brush.h"
 #include "clipping.h"
+#include "drawing.h"
+#include "line.h"
 #include "../gdi/gdi.h"
 
 #define TAG FREERDP_TAG("gdi.shape")
 
-static void Ellipse_Bresenham(HGDI_DC hdc, int x1, int y1, int x2, int y2)
+#define GDI_EDGE_SHIFT 16
+#define GDI_EDGE_ONE ((INT64)1 << GDI_EDGE_SHIFT)
+#define GDI_EDGE_HALF ((INT64)1 << (GDI_EDGE_SHIFT - 1))
+
+/* Ellipse bounds are squared twice, keep that within 64 bit */
+#define GDI_ELLIPSE_MAX_EXTENT 0xFFFF
+
+struct _GDI_EDGE
+{
+	INT32 yTop;    /* first scanline whose center is covered */
+	INT32 yBottom; /* first scanline whose center is no longer covered */
+	INT64 x;       /* x at the center of the current scanline, fixed point */
+	INT64 dx;      /* x increment per scanline, fixed point */
+	INT32 winding; /* +1 for downward, -1 for upward edges */
+};
+typedef struct _GDI_EDGE GDI_EDGE;
+
+struct _GDI_SPAN_FILLER
+{
+	HGDI_DC hdc;
+	HGDI_BITMAP bmp;
+	HGDI_BRUSH brush;
+	UINT32 bpp;
+	INT32 rop2;
+	BOOL transparent;
+
+	/* expanded brush pattern and a scanline of it for raster operations */
+	const BYTE* pattern;
+	BYTE* row;
+
+	/* clipping bounds, right and bottom exclusive */
+	INT32 left;
+	INT32 top;
+	INT32 right;
+	INT32 bottom;
+
+	/* bounds of the pixels touched, right and bottom exclusive */
+	INT32 x1;
+	INT32 y1;
+	INT32 x2;
+	INT32 y2;
+};
+typedef struct _GDI_SPAN_FILLER GDI_SPAN_FILLER;
+
+static BOOL gdi_span_filler_init(GDI_SPAN_FILLER* filler, HGDI_DC hdc, HGDI_BRUSH brush)
+{
+	HGDI_BITMAP bmp;
+
+	if (!filler || !hdc)
+		return FALSE;
+
+	bmp = (HGDI_BITMAP) hdc->selectedObject;
+
+	if (!bmp || !bmp->data)
+		return FALSE;
+
+	filler->hdc = hdc;
+	filler->bmp = bmp;
+	filler->brush = brush;
+	filler->bpp = GetBytesPerPixel(bmp->format);
+	filler->rop2 = gdi_GetROP2(hdc);
+	filler->transparent = brush && (brush->style == GDI_BS_HATCHED) &&
+	                      (hdc->bkMode == GDI_TRANSPARENT);
+	filler->pattern = NULL;
+	filler->row = NULL;
+
+	if (brush && ((brush->style == GDI_BS_PATTERN) || (brush->style == GDI_BS_HATCHED)))
+		filler->pattern = gdi_brush_expand(hdc, brush, bmp->format);
+
+	filler->left = 0;
+	filler->top = 0;
+	filler->right = bmp->width;
+	filler->bottom = bmp->height;
+
+	if (!hdc->clip->null)
+	{
+		filler->left = MAX(filler->left, hdc->clip->x);
+		filler->top = MAX(filler->top, hdc->clip->y);
+		filler->right = MIN(filler->right, hdc->clip->x + hdc->clip->w);
+		filler->bottom = MIN(filler->bottom, hdc->clip->y + hdc->clip->h);
+	}
+
+	filler->x1 = filler->right;
+	filler->y1 = filler->bottom;
+	filler->x2 = filler->left;
+	filler->y2 = filler->top;
+	return TRUE;
+}
+
+static BOOL gdi_span_filler_invalidate(const GDI_SPAN_FILLER* filler)
+{
+	if ((filler->x1 >= filler->x2) || (filler->y1 >= filler->y2))
+		return TRUE;
+
+	return gdi_InvalidateRegion(filler->hdc, filler->x1, filler->y1,
+	                            filler->x2 - filler->x1, filler->y2 - filler->y1);
+}
+
+static void gdi_span_filler_uninit(GDI_SPAN_FILLER* filler)
+{
+	free(filler->row);
+	filler->row = NULL;
+}
+
+/* Fill the pixels [x1, x2) of scanline y with the brush */
+static BOOL gdi_span_filler_fill(GDI_SPAN_FILLER* filler, INT32 y, INT32 x1, INT32 x2)
+{
+	INT32 x;
+	BYTE* dst;
+	size_t size;
+	const BYTE* src;
+	const HGDI_BITMAP bmp = filler->bmp;
+	const HGDI_BRUSH brush = filler->brush;
+
+	if ((y < filler->top) || (y >= filler->bottom))
+		return TRUE;
+
+	x1 = MAX(x1, filler->left);
+	x2 = MIN(x2, filler->right);
+
+	if (x1 >= x2)
+		return TRUE;
+
+	dst = &bmp->data[y * bmp->scanline + x1 * filler->bpp];
+	size = (size_t)(x2 - x1) * filler->bpp;
+
+	if (brush->style == GDI_BS_SOLID)
+	{
+		if (filler->rop2 == GDI_R2_COPYPEN)
+		{
+			WriteColor(dst, bmp->format, brush->color);
+			gdi_brush_replicate(dst, filler->bpp, size);
+		}
+		else
+		{
+			for (x = x1; x < x2; x++, dst += filler->bpp)
+				gdi_rop_color(filler->rop2, dst, brush->color, bmp->format);
+		}
+	}
+	else if ((filler->rop2 == GDI_R2_COPYPEN) && !filler->transparent)
+		gdi_brush_fill_row(brush, filler->pattern, filler->bpp, x1, y, dst, x2 - x1);
+	else
+	{
+		if (!filler->row)
+		{
+			filler->row = (BYTE*) calloc((size_t)(filler->right - filler->left), filler->bpp);
+
+			if (!filler->row)
+				return FALSE;
+		}
+
+		gdi_brush_fill_row(brush, filler->pattern, filler->bpp, x1, y, filler->row, x2 - x1);
+		src = filler->row;
+
+		for (x = x1; x < x2; x++, dst += filler->bpp, src += filler->bpp)
+		{
+			const UINT32 color = ReadColor(src, bmp->format);
+
+			if (!filler->transparent || (color != filler->hdc->bkColor))
+				gdi_rop_color(filler->rop2, dst, color, bmp->format);
+		}
+	}
+
+	filler->x1 = MIN(filler->x1, x1);
+	filler->x2 = MAX(filler->x2, x2);
+	filler->y1 = MIN(filler->y1, y);
+	filler->y2 = MAX(filler->y2, y + 1);
+	return TRUE;
+}
+
+static BOOL gdi_span_filler_enabled(const GDI_SPAN_FILLER* filler)
+{
+	const HGDI_BRUSH brush = filler->brush;
+
+	if (!brush || (brush->style == GDI_BS_NULL))
+		return FALSE;
+
+	if ((brush->style != GDI_BS_SOLID) && !filler->pattern)
+		return FALSE;
+
+	return (filler->left < filler->right) && (filler->top < filler->bottom);
+}
+
+static BOOL gdi_pen_enabled(HGDI_DC hdc)
+{
+	return hdc->pen && (hdc->pen->style != GDI_PS_NULL);
+}
+
+static int gdi_edge_compare(const void* a, const void* b)
+{
+	const GDI_EDGE* edgeA = (const GDI_EDGE*) a;
+	const GDI_EDGE* edgeB = (const GDI_EDGE*) b;
+	return (edgeA->yTop > edgeB->yTop) - (edgeA->yTop < edgeB->yTop);
+}
+
+static INT32 gdi_edge_build(GDI_EDGE* edges, const GDI_POINT* points, int nCount)
+{
+	int i;
+	INT32 count = 0;
+
+	for (i = 0; i < nCount; i++)
+	{
+		const GDI_POINT* p0 = &points[i];
+		const GDI_POINT* p1 = &points[(i + 1) % nCount];
+		const GDI_POINT* top = (p0->y < p1->y) ? p0 : p1;
+		const GDI_POINT* bottom = (p0->y < p1->y) ? p1 : p0;
+		GDI_EDGE* edge = &edges[count];
+
+		/* horizontal edges never cross a scanline center */
+		if (p0->y == p1->y)
+			continue;
+
+		edge->yTop = top->y;
+		edge->yBottom = bottom->y;
+		edge->winding = (p1->y > p0->y) ? 1 : -1;
+		edge->dx = (((INT64) bottom->x - top->x) * GDI_EDGE_ONE) / ((INT64) bottom->y - top->y);
+		edge->x = (INT64) top->x * GDI_EDGE_ONE + edge->dx / 2;
+		count++;
+	}
+
+	return count;
+}
+
+/* First pixel whose center lies at or right of the fixed point position */
+static INLINE INT32 gdi_edge_pixel(INT64 x)
+{
+	return (INT32)((x - GDI_EDGE_HALF + GDI_EDGE_ONE - 1) >> GDI_EDGE_SHIFT);
+}
+
+/**
+ * Scanline fill of a set of closed polygons.
+ * Edges are sorted by their first scanline and moved into an active list
+ * kept ordered by x, spans between crossings are filled according to the
+ * polygon fill mode of the device context.
+ */
+static BOOL gdi_fill_polygons(GDI_SPAN_FILLER* filler, const GDI_POINT* lpPoints,
+                              const int* lpPolyCounts, int nCount)
+{
+	int i;
+	INT32 y, yEnd;
+	INT32 nEdges = 0;
+	INT32 nActive = 0;
+	INT32 next = 0;
+	size_t total = 0;
+	BOOL rc = TRUE;
+	GDI_EDGE* edges;
+	GDI_EDGE** active;
+	const GDI_POINT* points = lpPoints;
+	const BOOL winding = (filler->hdc->polyFillMode == GDI_FILL_WINDING);
+
+	for (i = 0; i < nCount; i++)
+		total += lpPolyCounts[i];
+
+	if (total == 0)
+		return TRUE;
+
+	edges = (GDI_EDGE*) calloc(total, sizeof(GDI_EDGE));
+	active = (GDI_EDGE**) calloc(total, sizeof(GDI_EDGE*));
+
+	if (!edges || !active)
+	{
+		free(edges);
+		free(active);
+		return FALSE;
+	}
+
+	for (i = 0; i < nCount; i++)
+	{
+		if (lpPolyCounts[i] > 2)
+			nEdges += gdi_edge_build(&edges[nEdges], points, lpPolyCounts[i]);
+
+		points += lpPolyCounts[i];
+	}
+
+	qsort(edges, nEdges, sizeof(GDI_EDGE), gdi_edge_compare);
+	y = filler->top;
+	yEnd = filler->top;
+
+	for (i = 0; i < nEdges; i++)
+		yEnd = MAX(yEnd, edges[i].yBottom);
+
+	if (nEdges > 0)
+		y = MAX(y, edges[0].yTop);
+
+	yEnd = MIN(yEnd, filler->bottom);
+
+	for (; rc && (y < yEnd); y++)
+	{
+		INT32 j, k;
+
+		/* activate edges starting here, skipping the rows above the clip */
+		while ((next < nEdges) && (edges[next].yTop <= y))
+		{
+			GDI_EDGE* edge = &edges[next++];
+
+			if (edge->yBottom <= y)
+				continue;
+
+			edge->x += edge->dx * (y - edge->yTop);
+			active[nActive++] = edge;
+		}
+
+		for (j = 0, k = 0; j < nActive; j++)
+		{
+			if (active[j]->yBottom > y)
+				active[k++] = active[j];
+		}
+
+		nActive = k;
+
+		/* the order rarely changes between scanlines, insertion sort is cheap */
+		for (j = 1; j < nActive; j++)
+		{
+			GDI_EDGE* edge = active[j];
+
+			for (k = j; (k > 0) && (active[k - 1]->x > edge->x); k--)
+				active[k] = active[k - 1];
+
+			active[k] = edge;
+		}
+
+		if (winding)
+		{
+			INT32 start = 0;
+			INT32 count = 0;
+
+			for (j = 0; j < nActive; j++)
+			{
+				const INT32 previous = count;
+				count += active[j]->winding;
+
+				if ((previous == 0) && (count != 0))
+					start = j;
+				else if ((previous != 0) && (count == 0))
+					rc &= gdi_span_filler_fill(filler, y, gdi_edge_pixel(active[start]->x),
+					                           gdi_edge_pixel(active[j]->x));
+			}
+		}
+		else
+		{
+			for (j = 1; j < nActive; j += 2)
+				rc &= gdi_span_filler_fill(filler, y, gdi_edge_pixel(active[j - 1]->x),
+				                           gdi_edge_pixel(active[j]->x));
+		}
+
+		for (j = 0; j < nActive; j++)
+			active[j]->x += active[j]->dx;
+	}
+
+	free(edges);
+	free(active);
+	return rc;
+}
+
+static BOOL gdi_outline_polygons(HGDI_DC hdc, GDI_POINT* lpPoints, const int* lpPolyCounts,
+                                 int nCount)
+{
+	int i;
+	GDI_POINT* points = lpPoints;
+
+	for (i = 0; i < nCount; i++)
+	{
+		const int n = lpPolyCounts[i];
+
+		if (n > 0)
+		{
+			int j;
+
+			if (!gdi_MoveToEx(hdc, points[n - 1].x, points[n - 1].y, NULL))
+				return FALSE;
+
+			for (j = 0; j < n; j++)
+			{
+				if (!gdi_LineTo(hdc, points[j].x, points[j].y))
+					return FALSE;
+			}
+		}
+
+		points += n;
+	}
+
+	return TRUE;
+}
+
+static void gdi_ellipse_plot(HGDI_DC hdc, const GDI_SPAN_FILLER* clip, INT32 x, INT32 y,
+                             UINT32 pen)
+{
+	if ((x < clip->left) || (x >= clip->right) || (y < clip->top) || (y >= clip->bottom))
+		return;
+
+	gdi_rop_color(clip->rop2, gdi_GetPointer(clip->bmp, x, y), pen, clip->bmp->format);
+}
+
+static void Ellipse_Bresenham(HGDI_DC hdc, const GDI_SPAN_FILLER* clip, int x1, int y1,
+                              int x2, int y2)
 {
 	INT32 e, e2;
 	INT32 dx, dy;
 	INT32 a, b, c;
+	const UINT32 pen = gdi_GetPenColor(hdc->pen, clip->bmp->format);
 	a = (x1 < x2) ? x2 - x1 : x1 - x2;
 	b = (y1 < y2) ? y2 - y1 : y1 - y2;
 	c = b & 1;
@@ -69,10 +468,20 @@ static void Ellipse_Bresenham(HGDI_DC hdc, int x1, int y1, int x2, int y2)
 
 	do
 	{
-		gdi_SetPixel(hdc, x2, y1, 0);
-		gdi_SetPixel(hdc, x1, y1, 0);
-		gdi_SetPixel(hdc, x1, y2, 0);
-		gdi_SetPixel(hdc, x2, y2, 0);
+		/* plot each pixel once, raster operations like XOR are not idempotent */
+		gdi_ellipse_plot(hdc, clip, x2, y1, pen);
+
+		if (x1 != x2)
+			gdi_ellipse_plot(hdc, clip, x1, y1, pen);
+
+		if (y1 != y2)
+		{
+			gdi_ellipse_plot(hdc, clip, x2, y2, pen);
+
+			if (x1 != x2)
+				gdi_ellipse_plot(hdc, clip, x1, y2, pen);
+		}
+
 		e2 = 2 * e;
 
 		if (e2 >= dx)
@@ -93,9 +502,69 @@ static void Ellipse_Bresenham(HGDI_DC hdc, int x1, int y1, int x2, int y2)
 
 	while (y1 - y2 < b)
 	{
-		gdi_SetPixel(hdc, x1 - 1, ++y1, 0);
-		gdi_SetPixel(hdc, x1 - 1, --y2, 0);
+		gdi_ellipse_plot(hdc, clip, x1 - 1, ++y1, pen);
+		gdi_ellipse_plot(hdc, clip, x1 - 1, --y2, pen);
+	}
+}
+
+static UINT64 gdi_isqrt(UINT64 value)
+{
+	UINT64 root = 0;
+	UINT64 bit = (UINT64)1 << 62;
+
+	while (bit > value)
+		bit >>= 2;
+
+	while (bit != 0)
+	{
+		if (value >= root + bit)
+		{
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+			root >>= 1;
+
+		bit >>= 2;
+	}
+
+	return root;
+}
+
+static INLINE INT32 gdi_floor_half(INT64 value)
+{
+	return (INT32)((value >= 0) ? (value / 2) : -((1 - value) / 2));
+}
+
+/**
+ * Fill the inside of the ellipse inscribed in the inclusive rectangle.
+ * A pixel is filled when its center lies within the ellipse, the half
+ * width of each scanline is computed in integers, in doubled coordinates
+ * to keep the center of even sized rectangles exact.
+ */
+static BOOL gdi_fill_ellipse(GDI_SPAN_FILLER* filler, INT32 left, INT32 top, INT32 right,
+                             INT32 bottom)
+{
+	INT32 y;
+	const UINT64 w = (UINT64)(right - left) + 1;
+	const UINT64 h = (UINT64)(bottom - top) + 1;
+	const UINT64 w2 = w * w;
+	const UINT64 h2 = h * h;
+	const INT32 yStart = MAX(top, filler->top);
+	const INT32 yEnd = MIN(bottom + 1, filler->bottom);
+
+	for (y = yStart; y < yEnd; y++)
+	{
+		const INT64 dy = 2 * (INT64) y - top - bottom;
+		const UINT64 d = gdi_isqrt((w2 * (h2 - (UINT64)(dy * dy))) / h2);
+		const INT32 x1 = -gdi_floor_half(-((INT64) left + right - (INT64) d));
+		const INT32 x2 = gdi_floor_half((INT64) left + right + (INT64) d);
+
+		if (!gdi_span_filler_fill(filler, y, x1, x2 + 1))
+			return FALSE;
 	}
+
+	return TRUE;
 }
 
 /**
@@ -111,8 +580,35 @@ static void Ellipse_Bresenham(HGDI_DC hdc, int x1, int y1, int x2, int y2)
 BOOL gdi_Ellipse(HGDI_DC hdc, int nLeftRect, int nTopRect, int nRightRect,
                  int nBottomRect)
 {
-	Ellipse_Bresenham(hdc, nLeftRect, nTopRect, nRightRect, nBottomRect);
-	return TRUE;
+	BOOL rc = TRUE;
+	GDI_SPAN_FILLER filler;
+	const INT32 left = MIN(nLeftRect, nRightRect);
+	const INT32 right = MAX(nLeftRect, nRightRect);
+	const INT32 top = MIN(nTopRect, nBottomRect);
+	const INT32 bottom = MAX(nTopRect, nBottomRect);
+
+	if (((INT64) right - left >= GDI_ELLIPSE_MAX_EXTENT) ||
+	    ((INT64) bottom - top >= GDI_ELLIPSE_MAX_EXTENT))
+		return FALSE;
+
+	if (!gdi_span_filler_init(&filler, hdc, hdc ? hdc->brush : NULL))
+		return FALSE;
+
+	if (gdi_span_filler_enabled(&filler))
+		rc = gdi_fill_ellipse(&filler, left, top, right, bottom);
+
+	gdi_span_filler_uninit(&filler);
+
+	if (rc && gdi_pen_enabled(hdc))
+	{
+		Ellipse_Bresenham(hdc, &filler, left, top, right, bottom);
+		filler.x1 = MAX(filler.left, MIN(filler.x1, left));
+		filler.y1 = MAX(filler.top, MIN(filler.y1, top));
+		filler.x2 = MIN(filler.right, MAX(filler.x2, right + 1));
+		filler.y2 = MIN(filler.bottom, MAX(filler.y2, bottom + 1));
+	}
+
+	return rc && gdi_span_filler_invalidate(&filler);
 }
 
 /**
@@ -126,12 +622,12 @@ BOOL gdi_Ellipse(HGDI_DC hdc, int nLeftRect, int nTopRect, int nRightRect,
 
 BOOL gdi_FillRect(HGDI_DC hdc, const HGDI_RECT rect, HGDI_BRUSH hbr)
 {
-	INT32 x, y;
-	UINT32 color, dstColor;
-	BOOL monochrome = FALSE;
+	INT32 y;
 	INT32 nXDest, nYDest;
 	INT32 nWidth, nHeight;
+	INT32 period;
 	const BYTE* srcp;
+	const BYTE* expanded;
 	DWORD formatSize;
 	gdi_RectToCRgn(rect, &nXDest, &nYDest, &nWidth, &nHeight);
 
@@ -141,72 +637,58 @@ BOOL gdi_FillRect(HGDI_DC hdc, const HGDI_RECT rect, HGDI_BRUSH hbr)
 	if (!gdi_ClipCoords(hdc, &nXDest, &nYDest, &nWidth, &nHeight, NULL, NULL))
 		return TRUE;
 
+	formatSize = GetBytesPerPixel(hdc->format);
+
 	switch (hbr->style)
 	{
 		case GDI_BS_SOLID:
-			color = hbr->color;
-
-			for (x = 0; x < nWidth; x++)
 			{
-				BYTE* dstp = gdi_get_bitmap_pointer(hdc, nXDest + x,
-				                                    nYDest);
-
-				if (dstp)
-					WriteColor(dstp, hdc->format, color);
-			}
+				BYTE* dstp = gdi_get_bitmap_pointer(hdc, nXDest, nYDest);
 
-			srcp = gdi_get_bitmap_pointer(hdc, nXDest, nYDest);
-			formatSize = GetBytesPerPixel(hdc->format);
+				if (!dstp)
+					return FALSE;
 
-			for (y = 1; y < nHeight; y++)
-			{
-				BYTE* dstp = gdi_get_bitmap_pointer(hdc, nXDest, nYDest + y);
-				memcpy(dstp, srcp, nWidth * formatSize);
+				WriteColor(dstp, hdc->format, hbr->color);
+				gdi_brush_replicate(dstp, formatSize, (size_t) nWidth * formatSize);
+				period = 1;
 			}
-
 			break;
 
 		case GDI_BS_HATCHED:
 		case GDI_BS_PATTERN:
-			monochrome = (hbr->pattern->format == PIXEL_FORMAT_MONO);
-			formatSize = GetBytesPerPixel(hbr->pattern->format);
+			expanded = gdi_brush_expand(hdc, hbr, hdc->format);
 
-			for (y = 0; y < nHeight; y++)
+			if (!expanded)
+				return FALSE;
+
+			/* build one row per pattern row, the rest repeats them */
+			period = MIN(nHeight, hbr->pattern->height);
+
+			for (y = 0; y < period; y++)
 			{
-				for (x = 0; x < nWidth; x++)
-				{
-					const UINT32 yOffset = ((nYDest + y) * hbr->pattern->width %
-					                        hbr->pattern->height) * formatSize;
-					const UINT32 xOffset = ((nXDest + x) % hbr->pattern->width) * formatSize;
-					const BYTE* patp = &hbr->pattern->data[yOffset + xOffset];
-					BYTE* dstp = gdi_get_bitmap_pointer(hdc, nXDest + x,
-					                                    nYDest + y);
-
-					if (!patp)
-						return FALSE;
-
-					if (monochrome)
-					{
-						if (*patp == 0)
-							dstColor = hdc->bkColor;
-						else
-							dstColor = hdc->textColor;
-					}
-					else
-					{
-						dstColor = ReadColor(patp, hbr->pattern->format);
-						dstColor = FreeRDPConvertColor(dstColor, hbr->pattern->format, hdc->format, NULL);
-					}
-
-					if (dstp)
-						WriteColor(dstp, hdc->format, dstColor);
-				}
+				BYTE* dstp = gdi_get_bitmap_pointer(hdc, nXDest, nYDest + y);
+
+				if (!dstp)
+					return FALSE;
+
+				gdi_brush_fill_row(hbr, expanded, formatSize, nXDest, nYDest + y, dstp, nWidth);
 			}
 
 			break;
 
 		default:
-			break;
+			return TRUE;
+	}
+
+	for (y = period; y < nHeight; y++)
+	{
+		BYTE* dstp = gdi_get_bitmap_pointer(hdc, nXDest, nYDest + y);
+		srcp = gdi_get_bitmap_pointer(hdc, nXDest, nYDest + y - period);
+
+		if (!dstp || !srcp)
+			return FALSE;
+
+		memcpy(dstp, srcp, (size_t) nWidth * formatSize);
 	}
 
 	if (!gdi_InvalidateRegion(hdc, nXDest, nYDest, nWidth, nHeight))
@@ -226,8 +708,7 @@ BOOL gdi_FillRect(HGDI_DC hdc, const HGDI_RECT rect, HGDI_BRUSH hbr)
  */
 BOOL gdi_Polygon(HGDI_DC hdc, GDI_POINT* lpPoints, int nCount)
 {
-	WLog_ERR(TAG, "Not implemented!");
-	return FALSE;
+	return gdi_PolyPolygon(hdc, lpPoints, &nCount, 1);
 }
 
 /**
@@ -242,8 +723,34 @@ BOOL gdi_Polygon(HGDI_DC hdc, GDI_POINT* lpPoints, int nCount)
 BOOL gdi_PolyPolygon(HGDI_DC hdc, GDI_POINT* lpPoints, int* lpPolyCounts,
                      int nCount)
 {
-	WLog_ERR(TAG, "Not implemented!");
-	return FALSE;
+	int i;
+	GDI_SPAN_FILLER filler;
+
+	if (!hdc || !lpPoints || !lpPolyCounts || (nCount < 0))
+		return FALSE;
+
+	for (i = 0; i < nCount; i++)
+	{
+		if (lpPolyCounts[i] < 0)
+			return FALSE;
+	}
+
+	if (!gdi_span_filler_init(&filler, hdc, hdc->brush))
+		return FALSE;
+
+	if (gdi_span_filler_enabled(&filler))
+	{
+		const BOOL rc = gdi_fill_polygons(&filler, lpPoints, lpPolyCounts, nCount);
+		gdi_span_filler_uninit(&filler);
+
+		if (!rc || !gdi_span_filler_invalidate(&filler))
+			return FALSE;
+	}
+
+	if (gdi_pen_enabled(hdc))
+		return gdi_outline_polygons(hdc, lpPoints, lpPolyCounts, nCount);
+
+	return TRUE;
 }
 
 BOOL gdi_Rectangle(HGDI_DC hdc, INT32 nXDst, INT32 nYDst, INT32 nWidth,
@@ -0,0 +1,403 @@
+#include <freerdp/gdi/gdi.h>
+
+#include <freerdp/gdi/dc.h>
+#include <freerdp/gdi/bitmap.h>
+
+#include <winpr/crt.h>
+#include <winpr/crypto.h>
+#include <winpr/sysinfo.h>
+
+#include "gdi.h"
+#include "brush.h"
+
+#define TEST_WIDTH 67
+#define TEST_HEIGHT 19
+#define TEST_PATTERN_SIZE 8
+#define TEST_BENCH_WIDTH 1024
+#define TEST_BENCH_HEIGHT 256
+#define TEST_BENCH_RUNS 16
+
+/* all ternary raster operations known to gdi_rop_to_string */
+static const DWORD rop3_codes[] =
+{
+	GDI_BLACKNESS, GDI_DPSoon, GDI_DPSona, GDI_PSon,
+	GDI_SDPona, GDI_DPon, GDI_PDSxnon, GDI_PDSaon,
+	GDI_SDPnaa, GDI_PDSxon, GDI_DPna, GDI_PSDnaon,
+	GDI_SPna, GDI_PDSnaon, GDI_PDSonon, GDI_Pn,
+	GDI_PDSona, GDI_NOTSRCERASE, GDI_SDPxnon, GDI_SDPaon,
+	GDI_DPSxnon, GDI_DPSaon, GDI_PSDPSanaxx, GDI_SSPxDSxaxn,
+	GDI_SPxPDxa, GDI_SDPSanaxn, GDI_PDSPaox, GDI_SDPSxaxn,
+	GDI_PSDPaox, GDI_DSPDxaxn, GDI_PDSox, GDI_PDSoan,
+	GDI_DPSnaa, GDI_SDPxon, GDI_DSna, GDI_SPDnaon,
+	GDI_SPxDSxa, GDI_PDSPanaxn, GDI_SDPSaox, GDI_SDPSxnox,
+	GDI_DPSxa, GDI_PSDPSaoxxn, GDI_DPSana, GDI_SSPxPDxaxn,
+	GDI_SPDSoax, GDI_PSDnox, GDI_PSDPxox, GDI_PSDnoan,
+	GDI_PSna, GDI_SDPnaon, GDI_SDPSoox, GDI_NOTSRCCOPY,
+	GDI_SPDSaox, GDI_SPDSxnox, GDI_SDPox, GDI_SDPoan,
+	GDI_PSDPoax, GDI_SPDnox, GDI_SPDSxox, GDI_SPDnoan,
+	GDI_PSx, GDI_SPDSonox, GDI_SPDSnaox, GDI_PSan,
+	GDI_PSDnaa, GDI_DPSxon, GDI_SDxPDxa, GDI_SPDSanaxn,
+	GDI_SRCERASE, GDI_DPSnaon, GDI_DSPDaox, GDI_PSDPxaxn,
+	GDI_SDPxa, GDI_PDSPDaoxxn, GDI_DPSDoax, GDI_PDSnox,
+	GDI_SDPana, GDI_SSPxDSxoxn, GDI_PDSPxox, GDI_PDSnoan,
+	GDI_PDna, GDI_DSPnaon, GDI_DPSDaox, GDI_SPDSxaxn,
+	GDI_DPSonon, GDI_DSTINVERT, GDI_DPSox, GDI_DPSoan,
+	GDI_PDSPoax, GDI_DPSnox, GDI_PATINVERT, GDI_DPSDonox,
+	GDI_DPSDxox, GDI_DPSnoan, GDI_DPSDnaox, GDI_DPan,
+	GDI_PDSxa, GDI_DSPDSaoxxn, GDI_DSPDoax, GDI_SDPnox,
+	GDI_SDPSoax, GDI_DSPnox, GDI_SRCINVERT, GDI_SDPSonox,
+	GDI_DSPDSonoxxn, GDI_PDSxxn, GDI_DPSax, GDI_PSDPSoaxxn,
+	GDI_SDPax, GDI_PDSPDoaxxn, GDI_SDPSnoax, GDI_PDSxnan,
+	GDI_PDSana, GDI_SSDxPDxaxn, GDI_SDPSxox, GDI_SDPnoan,
+	GDI_DSPDxox, GDI_DSPnoan, GDI_SDPSnaox, GDI_DSan,
+	GDI_PDSax, GDI_DSPDSoaxxn, GDI_DPSDnoax, GDI_SDPxnan,
+	GDI_SPDSnoax, GDI_DPSxnan, GDI_SPxDSxo, GDI_DPSaan,
+	GDI_DPSaa, GDI_SPxDSxon, GDI_DPSxna, GDI_SPDSnoaxn,
+	GDI_SDPxna, GDI_PDSPnoaxn, GDI_DSPDSoaxx, GDI_PDSaxn,
+	GDI_SRCAND, GDI_SDPSnaoxn, GDI_DSPnoa, GDI_DSPDxoxn,
+	GDI_SDPnoa, GDI_SDPSxoxn, GDI_SSDxPDxax, GDI_PDSanan,
+	GDI_PDSxna, GDI_SDPSnoaxn, GDI_DPSDPoaxx, GDI_SPDaxn,
+	GDI_PSDPSoaxx, GDI_DPSaxn, GDI_DPSxx, GDI_PSDPSonoxx,
+	GDI_SDPSonoxn, GDI_DSxn, GDI_DPSnax, GDI_SDPSoaxn,
+	GDI_SPDnax, GDI_DSPDoaxn, GDI_DSPDSaoxx, GDI_PDSxan,
+	GDI_DPa, GDI_PDSPnaoxn, GDI_DPSnoa, GDI_DPSDxoxn,
+	GDI_PDSPonoxn, GDI_PDxn, GDI_DSPnax, GDI_PDSPoaxn,
+	GDI_DPSoa, GDI_DPSoxn, GDI_DSTCOPY, GDI_DPSono,
+	GDI_SPDSxax, GDI_DPSDaoxn, GDI_DSPnao, GDI_DPno,
+	GDI_PDSnoa, GDI_PDSPxoxn, GDI_SSPxDSxox, GDI_SDPanan,
+	GDI_PSDnax, GDI_DPSDoaxn, GDI_DPSDPaoxx, GDI_SDPxan,
+	GDI_PSDPxax, GDI_DSPDaoxn, GDI_DPSnao, GDI_MERGEPAINT,
+	GDI_SPDSanax, GDI_SDxPDxan, GDI_DPSxo, GDI_DPSano,
+	GDI_MERGECOPY, GDI_SPDSnaoxn, GDI_SPDSonoxn, GDI_PSxn,
+	GDI_SPDnoa, GDI_SPDSxoxn, GDI_SDPnax, GDI_PSDPoaxn,
+	GDI_SDPoa, GDI_SPDoxn, GDI_DPSDxax, GDI_SPDSaoxn,
+	GDI_SRCCOPY, GDI_SDPono, GDI_SDPnao, GDI_SPno,
+	GDI_PSDnoa, GDI_PSDPxoxn, GDI_PDSnax, GDI_SPDSoaxn,
+	GDI_SSPxPDxax, GDI_DPSanan, GDI_PSDPSaoxx, GDI_DPSxan,
+	GDI_PDSPxax, GDI_SDPSaoxn, GDI_DPSDanax, GDI_SPxDSxan,
+	GDI_SPDnao, GDI_SDno, GDI_SDPxo, GDI_SDPano,
+	GDI_PDSoa, GDI_PDSoxn, GDI_DSPDxax, GDI_PSDPaoxn,
+	GDI_SDPSxax, GDI_PDSPaoxn, GDI_SDPSanax, GDI_SPxPDxan,
+	GDI_SSPxDSxax, GDI_DSPDSanaxxn, GDI_DPSao, GDI_DPSxno,
+	GDI_SDPao, GDI_SDPxno, GDI_SRCPAINT, GDI_SDPnoo,
+	GDI_PATCOPY, GDI_PDSono, GDI_PDSnao, GDI_PSno,
+	GDI_PSDnao, GDI_PDno, GDI_PDSxo, GDI_PDSano,
+	GDI_PDSao, GDI_PDSxno, GDI_DPo, GDI_PATPAINT,
+	GDI_PSo, GDI_PSDnoo, GDI_DPSoo, GDI_WHITENESS,
+	GDI_GLYPH_ORDER
+};
+
+/* Per pixel evaluation of the ROP string, this is what gdi_BitBlt used to do */
+static UINT32 test_process_rop(UINT32 src, UINT32 dst, UINT32 pat, const char* rop,
+                               UINT32 format)
+{
+	UINT32 stack[10] = { 0 };
+	UINT32 stackp = 0;
+
+	while (*rop != '\0')
+	{
+		switch (*rop++)
+		{
+			case '0':
+				stack[stackp++] = FreeRDPGetColor(format, 0, 0, 0, 0xFF);
+				break;
+
+			case '1':
+				stack[stackp++] = FreeRDPGetColor(format, 0xFF, 0xFF, 0xFF, 0xFF);
+				break;
+
+			case 'D':
+				stack[stackp++] = dst;
+				break;
+
+			case 'S':
+				stack[stackp++] = src;
+				break;
+
+			case 'P':
+				stack[stackp++] = pat;
+				break;
+
+			case 'x':
+				stackp--;
+				stack[stackp - 1] ^= stack[stackp];
+				break;
+
+			case 'a':
+				stackp--;
+				stack[stackp - 1] &= stack[stackp];
+				break;
+
+			case 'o':
+				stackp--;
+				stack[stackp - 1] |= stack[stackp];
+				break;
+
+			case 'n':
+				stack[stackp - 1] = ~stack[stackp - 1];
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	return stack[0];
+}
+
+static BOOL test_reference_BitBlt(HGDI_DC hdcDst, INT32 nXDst, INT32 nYDst, INT32 nWidth,
+                                  INT32 nHeight, HGDI_DC hdcSrc, INT32 nXSrc, INT32 nYSrc,
+                                  DWORD rop, const gdiPalette* palette)
+{
+	INT32 x, y;
+	const char* str = gdi_rop_to_string(rop);
+	HGDI_BITMAP hDst = (HGDI_BITMAP) hdcDst->selectedObject;
+	HGDI_BITMAP hSrc = (HGDI_BITMAP) hdcSrc->selectedObject;
+	const BOOL hasSrc = strchr(str, 'S') != NULL;
+	const BOOL hasPat = strchr(str, 'P') != NULL;
+
+	if (!str)
+		return FALSE;
+
+	for (y = 0; y < nHeight; y++)
+	{
+		for (x = 0; x < nWidth; x++)
+		{
+			UINT32 src = 0;
+			UINT32 pat = 0;
+			BYTE* dstp = gdi_GetPointer(hDst, nXDst + x, nYDst + y);
+			const UINT32 dst = ReadColor(dstp, hdcDst->format);
+
+			if (hasSrc)
+			{
+				const BYTE* srcp = gdi_GetPointer(hSrc, nXSrc + x, nYSrc + y);
+				src = FreeRDPConvertColor(ReadColor(srcp, hdcSrc->format),
+				                          hdcSrc->format, hdcDst->format, palette);
+			}
+
+			if (hasPat)
+			{
+				if (gdi_GetBrushStyle(hdcDst) == GDI_BS_SOLID)
+					pat = hdcDst->brush->color;
+				else
+					pat = ReadColor(gdi_get_brush_pointer(hdcDst, nXDst + x, nYDst + y),
+					                hdcDst->format);
+			}
+
+			WriteColor(dstp, hdcDst->format,
+			           test_process_rop(src, dst, pat, str, hdcDst->format));
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL test_fill_random(HGDI_BITMAP hBmp)
+{
+	return winpr_RAND(hBmp->data, 1ULL * hBmp->scanline * hBmp->height) >= 0;
+}
+
+static BOOL test_rop3_all(UINT32 SrcFormat, UINT32 DstFormat, BOOL pattern)
+{
+	BOOL rc = FALSE;
+	UINT32 x;
+	HGDI_DC hdcSrc = NULL;
+	HGDI_DC hdcDst = NULL;
+	HGDI_BITMAP hBmpSrc = NULL;
+	HGDI_BITMAP hBmpDst = NULL;
+	HGDI_BITMAP hBmpRef = NULL;
+	HGDI_BITMAP hBmpOrig = NULL;
+	HGDI_BITMAP hBmpPat = NULL;
+	HGDI_BRUSH brush = NULL;
+	const size_t size = 1ULL * TEST_WIDTH * TEST_HEIGHT * GetBytesPerPixel(DstFormat);
+	gdiPalette g = { 0 };
+	g.format = DstFormat;
+
+	for (x = 0; x < 256; x++)
+		g.palette[x] = FreeRDPGetColor(DstFormat, x, x, x, 0xFF);
+
+	if (!(hdcSrc = gdi_GetDC()) || !(hdcDst = gdi_GetDC()))
+		goto fail;
+
+	hdcSrc->format = SrcFormat;
+	hdcDst->format = DstFormat;
+	hBmpSrc = gdi_CreateCompatibleBitmap(hdcSrc, TEST_WIDTH, TEST_HEIGHT);
+	hBmpDst = gdi_CreateCompatibleBitmap(hdcDst, TEST_WIDTH, TEST_HEIGHT);
+	hBmpRef = gdi_CreateCompatibleBitmap(hdcDst, TEST_WIDTH, TEST_HEIGHT);
+	hBmpOrig = gdi_CreateCompatibleBitmap(hdcDst, TEST_WIDTH, TEST_HEIGHT);
+
+	if (!hBmpSrc || !hBmpDst || !hBmpRef || !hBmpOrig)
+		goto fail;
+
+	if (!test_fill_random(hBmpSrc) || !test_fill_random(hBmpOrig))
+		goto fail;
+
+	if (pattern)
+	{
+		hBmpPat = gdi_CreateCompatibleBitmap(hdcDst, TEST_PATTERN_SIZE, TEST_PATTERN_SIZE);
+
+		if (!hBmpPat || !test_fill_random(hBmpPat))
+			goto fail;
+
+		brush = gdi_CreatePatternBrush(hBmpPat);
+
+		if (brush)
+		{
+			brush->nXOrg = 3;
+			brush->nYOrg = 5;
+		}
+	}
+	else
+		brush = gdi_CreateSolidBrush(FreeRDPGetColor(DstFormat, 0x12, 0x34, 0x56, 0xFF));
+
+	if (!brush)
+		goto fail;
+
+	gdi_SelectObject(hdcDst, (HGDIOBJECT) brush);
+	gdi_SelectObject(hdcSrc, (HGDIOBJECT) hBmpSrc);
+
+	for (x = 0; x < ARRAYSIZE(rop3_codes); x++)
+	{
+		const DWORD rop = rop3_codes[x];
+
+		/* GDI_DSTCOPY and GDI_SRCCOPY do not go through the ROP kernels */
+		if ((rop == GDI_DSTCOPY) || (rop == GDI_SRCCOPY))
+			continue;
+
+		memcpy(hBmpDst->data, hBmpOrig->data, size);
+		memcpy(hBmpRef->data, hBmpOrig->data, size);
+		gdi_SelectObject(hdcDst, (HGDIOBJECT) hBmpRef);
+
+		if (!test_reference_BitBlt(hdcDst, 2, 1, TEST_WIDTH - 4, TEST_HEIGHT - 3, hdcSrc, 1, 2,
+		                           rop, &g))
+			goto fail;
+
+		gdi_SelectObject(hdcDst, (HGDIOBJECT) hBmpDst);
+
+		if (!gdi_BitBlt(hdcDst, 2, 1, TEST_WIDTH - 4, TEST_HEIGHT - 3, hdcSrc, 1, 2, rop, &g))
+			goto fail;
+
+		if (memcmp(hBmpDst->data, hBmpRef->data, size) != 0)
+		{
+			fprintf(stderr, "ROP3 0x%08"PRIX32" [%s] mismatch (Src=%s, Dst=%s, %s brush)\n",
+			        rop, gdi_rop_to_string(rop), FreeRDPGetColorFormatName(SrcFormat),
+			        FreeRDPGetColorFormatName(DstFormat), pattern ? "pattern" : "solid");
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	gdi_DeleteObject((HGDIOBJECT) brush);
+	gdi_DeleteObject((HGDIOBJECT) hBmpPat);
+	gdi_DeleteObject((HGDIOBJECT) hBmpSrc);
+	gdi_DeleteObject((HGDIOBJECT) hBmpDst);
+	gdi_DeleteObject((HGDIOBJECT) hBmpRef);
+	gdi_DeleteObject((HGDIOBJECT) hBmpOrig);
+	gdi_DeleteDC(hdcSrc);
+	gdi_DeleteDC(hdcDst);
+	return rc;
+}
+
+/* Compares the time spent in the string interpreter with the compiled kernels */
+static BOOL test_rop3_benchmark(UINT32 format, DWORD rop)
+{
+	BOOL rc = FALSE;
+	UINT32 x;
+	UINT64 start, ref, kernel;
+	HGDI_DC hdcSrc = NULL;
+	HGDI_DC hdcDst = NULL;
+	HGDI_BITMAP hBmpSrc = NULL;
+	HGDI_BITMAP hBmpDst = NULL;
+	HGDI_BRUSH brush = NULL;
+
+	if (!(hdcSrc = gdi_GetDC()) || !(hdcDst = gdi_GetDC()))
+		goto fail;
+
+	hdcSrc->format = format;
+	hdcDst->format = format;
+	hBmpSrc = gdi_CreateCompatibleBitmap(hdcSrc, TEST_BENCH_WIDTH, TEST_BENCH_HEIGHT);
+	hBmpDst = gdi_CreateCompatibleBitmap(hdcDst, TEST_BENCH_WIDTH, TEST_BENCH_HEIGHT);
+	brush = gdi_CreateSolidBrush(FreeRDPGetColor(format, 0x12, 0x34, 0x56, 0xFF));
+
+	if (!hBmpSrc || !hBmpDst || !brush)
+		goto fail;
+
+	if (!test_fill_random(hBmpSrc) || !test_fill_random(hBmpDst))
+		goto fail;
+
+	gdi_SelectObject(hdcSrc, (HGDIOBJECT) hBmpSrc);
+	gdi_SelectObject(hdcDst, (HGDIOBJECT) hBmpDst);
+	gdi_SelectObject(hdcDst, (HGDIOBJECT) brush);
+	start = GetTickCount64();
+
+	for (x = 0; x < TEST_BENCH_RUNS; x++)
+	{
+		if (!test_reference_BitBlt(hdcDst, 0, 0, TEST_BENCH_WIDTH, TEST_BENCH_HEIGHT, hdcSrc, 0,
+		                           0, rop, NULL))
+			goto fail;
+	}
+
+	ref = GetTickCount64() - start;
+	start = GetTickCount64();
+
+	for (x = 0; x < TEST_BENCH_RUNS; x++)
+	{
+		if (!gdi_BitBlt(hdcDst, 0, 0, TEST_BENCH_WIDTH, TEST_BENCH_HEIGHT, hdcSrc, 0, 0, rop,
+		                NULL))
+			goto fail;
+	}
+
+	kernel = GetTickCount64() - start;
+	printf("%s [%s] %dx%d x%d: interpreter %"PRIu64" ms, kernel %"PRIu64" ms\n",
+	       FreeRDPGetColorFormatName(format), gdi_rop_to_string(rop), TEST_BENCH_WIDTH,
+	       TEST_BENCH_HEIGHT, TEST_BENCH_RUNS, ref, kernel);
+	rc = TRUE;
+fail:
+	gdi_DeleteObject((HGDIOBJECT) brush);
+	gdi_DeleteObject((HGDIOBJECT) hBmpSrc);
+	gdi_DeleteObject((HGDIOBJECT) hBmpDst);
+	gdi_DeleteDC(hdcSrc);
+	gdi_DeleteDC(hdcDst);
+	return rc;
+}
+
+int TestGdiBitBltRop3(int argc, char* argv[])
+{
+	UINT32 x, y;
+	const UINT32 formatList[] =
+	{
+		PIXEL_FORMAT_RGB16,
+		PIXEL_FORMAT_RGB24,
+		PIXEL_FORMAT_BGRA32,
+		PIXEL_FORMAT_BGRX32,
+		PIXEL_FORMAT_XRGB32
+	};
+	const DWORD benchList[] =
+	{
+		GDI_SRCINVERT,
+		GDI_PATCOPY,
+		GDI_MERGECOPY,
+		GDI_DSPDxax
+	};
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	for (x = 0; x < ARRAYSIZE(formatList); x++)
+	{
+		for (y = 0; y < ARRAYSIZE(formatList); y++)
+		{
+			if (!test_rop3_all(formatList[x], formatList[y], FALSE) ||
+			    !test_rop3_all(formatList[x], formatList[y], TRUE))
+				return -1;
+		}
+	}
+
+	for (x = 0; x < ARRAYSIZE(benchList); x++)
+	{
+		if (!test_rop3_benchmark(PIXEL_FORMAT_BGRX32, benchList[x]))
+			return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,355 @@
+
+#include <freerdp/gdi/gdi.h>
+
+#include <freerdp/gdi/dc.h>
+#include <freerdp/gdi/pen.h>
+#include <freerdp/gdi/shape.h>
+#include <freerdp/gdi/region.h>
+#include <freerdp/gdi/bitmap.h>
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#include "brush.h"
+#include "drawing.h"
+#include "clipping.h"
+
+#define TEST_WIDTH 64
+#define TEST_HEIGHT 64
+
+static UINT32 test_pixel(HGDI_BITMAP hBmp, UINT32 x, UINT32 y)
+{
+	return ReadColor(gdi_GetPointer(hBmp, x, y), hBmp->format);
+}
+
+static UINT32 test_count_pixels(HGDI_BITMAP hBmp, UINT32 color)
+{
+	UINT32 x, y;
+	UINT32 count = 0;
+
+	for (y = 0; y < hBmp->height; y++)
+	{
+		for (x = 0; x < hBmp->width; x++)
+		{
+			if (test_pixel(hBmp, x, y) == color)
+				count++;
+		}
+	}
+
+	return count;
+}
+
+static BOOL test_clear(HGDI_DC hdc, HGDI_BITMAP hBmp)
+{
+	return gdi_BitBlt(hdc, 0, 0, hBmp->width, hBmp->height, hdc, 0, 0, GDI_BLACKNESS, NULL);
+}
+
+static BOOL test_polygon_rectangle(HGDI_DC hdc, HGDI_BITMAP hBmp, UINT32 color)
+{
+	GDI_POINT points[] = { { 10, 10 }, { 30, 10 }, { 30, 20 }, { 10, 20 } };
+
+	if (!test_clear(hdc, hBmp) || !gdi_Polygon(hdc, points, 4))
+		return FALSE;
+
+	/* the right and bottom edges are excluded */
+	if (test_count_pixels(hBmp, color) != 20 * 10)
+	{
+		printf("rectangle: unexpected pixel count %"PRIu32"\n", test_count_pixels(hBmp, color));
+		return FALSE;
+	}
+
+	return (test_pixel(hBmp, 10, 10) == color) && (test_pixel(hBmp, 29, 19) == color) &&
+	       (test_pixel(hBmp, 30, 10) != color) && (test_pixel(hBmp, 10, 20) != color);
+}
+
+static BOOL test_polygon_fill_mode(HGDI_DC hdc, HGDI_BITMAP hBmp, UINT32 color)
+{
+	/* a pentagram, its center is inside twice */
+	GDI_POINT star[] = { { 32, 12 }, { 44, 48 }, { 13, 26 }, { 51, 26 }, { 20, 48 } };
+	UINT32 alternate, winding;
+
+	if (!test_clear(hdc, hBmp))
+		return FALSE;
+
+	gdi_SetPolyFillMode(hdc, GDI_FILL_ALTERNATE);
+
+	if (!gdi_Polygon(hdc, star, 5))
+		return FALSE;
+
+	alternate = test_count_pixels(hBmp, color);
+
+	if ((test_pixel(hBmp, 32, 32) == color) || (test_pixel(hBmp, 32, 16) != color))
+	{
+		printf("fill mode: alternate filled the wrong region\n");
+		return FALSE;
+	}
+
+	if (!test_clear(hdc, hBmp))
+		return FALSE;
+
+	gdi_SetPolyFillMode(hdc, GDI_FILL_WINDING);
+
+	if (!gdi_Polygon(hdc, star, 5))
+		return FALSE;
+
+	winding = test_count_pixels(hBmp, color);
+	gdi_SetPolyFillMode(hdc, GDI_FILL_ALTERNATE);
+
+	if ((test_pixel(hBmp, 32, 32) != color) || (winding <= alternate))
+	{
+		printf("fill mode: winding %"PRIu32" pixels, alternate %"PRIu32"\n", winding, alternate);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL test_polygon_rop2(HGDI_DC hdc, HGDI_BITMAP hBmp)
+{
+	BOOL rc = FALSE;
+	UINT32 x, y;
+	BYTE* reference = NULL;
+	const size_t size = hBmp->scanline * hBmp->height;
+	GDI_POINT points[] = { { -5, 3 }, { 60, 17 }, { 21, 70 }, { 40, 30 } };
+
+	for (y = 0; y < hBmp->height; y++)
+	{
+		for (x = 0; x < hBmp->width; x++)
+			WriteColor(gdi_GetPointer(hBmp, x, y), hBmp->format,
+			           FreeRDPGetColor(hBmp->format, x * 4, y * 4, x ^ y, 0xFF));
+	}
+
+	if (!(reference = malloc(size)))
+		return FALSE;
+
+	CopyMemory(reference, hBmp->data, size);
+	gdi_SetROP2(hdc, GDI_R2_XORPEN);
+
+	if (!gdi_Polygon(hdc, points, 4))
+		goto fail;
+
+	if (memcmp(reference, hBmp->data, size) == 0)
+	{
+		printf("rop2: XOR did not change the bitmap\n");
+		goto fail;
+	}
+
+	if (!gdi_Polygon(hdc, points, 4))
+		goto fail;
+
+	if (memcmp(reference, hBmp->data, size) != 0)
+	{
+		printf("rop2: XOR applied twice did not restore the bitmap\n");
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	gdi_SetROP2(hdc, GDI_R2_COPYPEN);
+	free(reference);
+	return rc;
+}
+
+static BOOL test_polygon_clip(HGDI_DC hdc, HGDI_BITMAP hBmp, UINT32 color)
+{
+	BOOL rc;
+	GDI_POINT points[] = { { -100, -100 }, { 1000, -100 }, { 1000, 1000 }, { -100, 1000 } };
+
+	if (!test_clear(hdc, hBmp))
+		return FALSE;
+
+	gdi_SetClipRgn(hdc, 8, 4, 16, 12);
+	rc = gdi_Polygon(hdc, points, 4);
+	gdi_SetNullClipRgn(hdc);
+
+	if (!rc)
+		return FALSE;
+
+	return (test_count_pixels(hBmp, color) == 16 * 12) && (test_pixel(hBmp, 8, 4) == color) &&
+	       (test_pixel(hBmp, 23, 15) == color) && (test_pixel(hBmp, 24, 15) != color);
+}
+
+static BOOL test_ellipse(HGDI_DC hdc, HGDI_BITMAP hBmp, UINT32 color)
+{
+	UINT32 x, y;
+	UINT32 area;
+	const UINT32 left = 8, top = 8, right = 55, bottom = 39;
+
+	if (!test_clear(hdc, hBmp) || !gdi_Ellipse(hdc, left, top, right, bottom))
+		return FALSE;
+
+	for (y = 0; y < hBmp->height; y++)
+	{
+		for (x = 0; x < hBmp->width; x++)
+		{
+			const BOOL set = test_pixel(hBmp, x, y) == color;
+
+			if (set && ((x < left) || (x > right) || (y < top) || (y > bottom)))
+			{
+				printf("ellipse: pixel %"PRIu32"x%"PRIu32" outside of the bounds\n", x, y);
+				return FALSE;
+			}
+
+			if ((x >= left) && (x <= right) && (y >= top) && (y <= bottom))
+			{
+				const BOOL mirrored = test_pixel(hBmp, left + right - x, top + bottom - y) == color;
+
+				if (set != mirrored)
+				{
+					printf("ellipse: not symmetric at %"PRIu32"x%"PRIu32"\n", x, y);
+					return FALSE;
+				}
+			}
+		}
+	}
+
+	/* pi * 24 * 16 = 1206 */
+	area = test_count_pixels(hBmp, color);
+
+	if ((area < 1170) || (area > 1245))
+	{
+		printf("ellipse: unexpected area %"PRIu32"\n", area);
+		return FALSE;
+	}
+
+	return (test_pixel(hBmp, left, top) != color) && (test_pixel(hBmp, 31, 23) == color) &&
+	       (test_pixel(hBmp, left, 23) == color) && (test_pixel(hBmp, 31, top) == color);
+}
+
+static BOOL test_polygon_speed(UINT32 format)
+{
+	BOOL rc = FALSE;
+	UINT32 i;
+	UINT64 start;
+	HGDI_DC hdc = NULL;
+	HGDI_BITMAP hBmp = NULL;
+	HGDI_BRUSH hBrush = NULL;
+	const UINT32 count = 2000;
+
+	if (!(hdc = gdi_GetDC()))
+		return FALSE;
+
+	hdc->format = format;
+	gdi_SetNullClipRgn(hdc);
+
+	if (!(hBmp = gdi_CreateCompatibleBitmap(hdc, 1024, 768)))
+		goto fail;
+
+	if (!(hBrush = gdi_CreateSolidBrush(FreeRDPGetColor(format, 0x20, 0x40, 0x80, 0xFF))))
+		goto fail;
+
+	gdi_SelectObject(hdc, (HGDIOBJECT) hBmp);
+	gdi_SelectObject(hdc, (HGDIOBJECT) hBrush);
+	gdi_SetROP2(hdc, GDI_R2_COPYPEN);
+	start = GetTickCount64();
+
+	for (i = 0; i < count; i++)
+	{
+		const INT32 x = (i * 97) % 900;
+		const INT32 y = (i * 53) % 650;
+		GDI_POINT points[] = { { x, y }, { x + 120, y + 30 }, { x + 40, y + 110 } };
+
+		if (!gdi_Polygon(hdc, points, 3))
+			goto fail;
+
+		if (!gdi_Ellipse(hdc, x, y, x + 100, y + 80))
+			goto fail;
+	}
+
+	printf("%"PRIu32" polygons and ellipses in %"PRIu64" ms\n", count, GetTickCount64() - start);
+	rc = TRUE;
+fail:
+	gdi_DeleteObject((HGDIOBJECT) hBrush);
+	gdi_DeleteObject((HGDIOBJECT) hBmp);
+	gdi_DeleteDC(hdc);
+	return rc;
+}
+
+int TestGdiPolygon(int argc, char* argv[])
+{
+	int rc = -1;
+	UINT32 i;
+	const UINT32 colorFormats[] =
+	{
+		PIXEL_FORMAT_RGB16,
+		PIXEL_FORMAT_RGB24,
+		PIXEL_FORMAT_XRGB32,
+		PIXEL_FORMAT_BGRA32
+	};
+	const UINT32 number_formats = sizeof(colorFormats) / sizeof(colorFormats[0]);
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	for (i = 0; i < number_formats; i++)
+	{
+		HGDI_DC hdc = NULL;
+		HGDI_BITMAP hBmp = NULL;
+		HGDI_BRUSH hBrush = NULL;
+		const UINT32 format = colorFormats[i];
+		const UINT32 color = FreeRDPGetColor(format, 0xFF, 0x80, 0x10, 0xFF);
+		rc = -1;
+
+		if (!(hdc = gdi_GetDC()))
+		{
+			printf("failed to get gdi device context\n");
+			goto fail;
+		}
+
+		hdc->format = format;
+		gdi_SetNullClipRgn(hdc);
+
+		if (!(hBmp = gdi_CreateCompatibleBitmap(hdc, TEST_WIDTH, TEST_HEIGHT)))
+			goto fail;
+
+		if (!(hBrush = gdi_CreateSolidBrush(color)))
+			goto fail;
+
+		gdi_SelectObject(hdc, (HGDIOBJECT) hBmp);
+		gdi_SelectObject(hdc, (HGDIOBJECT) hBrush);
+		gdi_SetROP2(hdc, GDI_R2_COPYPEN);
+
+		if (!test_polygon_rectangle(hdc, hBmp, color))
+		{
+			printf("polygon rectangle failed for %s\n", FreeRDPGetColorFormatName(format));
+			goto fail;
+		}
+
+		if (!test_polygon_fill_mode(hdc, hBmp, color))
+		{
+			printf("polygon fill mode failed for %s\n", FreeRDPGetColorFormatName(format));
+			goto fail;
+		}
+
+		if (!test_polygon_rop2(hdc, hBmp))
+		{
+			printf("polygon rop2 failed for %s\n", FreeRDPGetColorFormatName(format));
+			goto fail;
+		}
+
+		if (!test_polygon_clip(hdc, hBmp, color))
+		{
+			printf("polygon clip failed for %s\n", FreeRDPGetColorFormatName(format));
+			goto fail;
+		}
+
+		if (!test_ellipse(hdc, hBmp, color))
+		{
+			printf("ellipse failed for %s\n", FreeRDPGetColorFormatName(format));
+			goto fail;
+		}
+
+		rc = 0;
+	fail:
+		gdi_DeleteObject((HGDIOBJECT) hBrush);
+		gdi_DeleteObject((HGDIOBJECT) hBmp);
+		gdi_DeleteDC(hdc);
+
+		if (rc != 0)
+			return rc;
+	}
+
+	if (!test_polygon_speed(PIXEL_FORMAT_XRGB32))
+		return -1;
+
+	return 0;
+}
@@ -13,6 +13,7 @@
 #include "line.h"
 #include "brush.h"
 #include "clipping.h"
+#include "../gdi.h"
 
 static int test_gdi_PtInRect(void)
 {
@@ -153,8 +154,115 @@ fail:
 	return rc;
 }
 
+static int test_gdi_FillRect_pattern(UINT32 format)
+{
+	int rc = -1;
+	HGDI_DC hdc = NULL;
+	HGDI_RECT hRect = NULL;
+	HGDI_BRUSH hBrush = NULL;
+	HGDI_BITMAP hBitmap = NULL;
+	HGDI_BITMAP hPattern = NULL;
+	UINT32 x, y;
+	const UINT32 width = 120;
+	const UINT32 height = 90;
+
+	if (!(hdc = gdi_GetDC()))
+	{
+		printf("failed to get gdi device context\n");
+		goto fail;
+	}
+
+	hdc->format = format;
+	gdi_SetNullClipRgn(hdc);
+
+	if (!(hRect = gdi_CreateRect(5, 7, 100, 70)))
+		goto fail;
+
+	hBitmap = gdi_CreateCompatibleBitmap(hdc, width, height);
+	hPattern = gdi_CreateCompatibleBitmap(hdc, 8, 8);
+
+	if (!hBitmap || !hPattern)
+		goto fail;
+
+	ZeroMemory(hBitmap->data, hBitmap->scanline * height);
+
+	for (y = 0; y < 8; y++)
+	{
+		for (x = 0; x < 8; x++)
+			WriteColor(gdi_GetPointer(hPattern, x, y), format,
+			           FreeRDPGetColor(format, 0x20 * x, 0x20 * y, 0x80, 0xFF));
+	}
+
+	if (!(hBrush = gdi_CreatePatternBrush(hPattern)))
+		goto fail;
+
+	hBrush->nXOrg = 3;
+	hBrush->nYOrg = 5;
+	gdi_SelectObject(hdc, (HGDIOBJECT) hBitmap);
+	gdi_SelectObject(hdc, (HGDIOBJECT) hBrush);
+
+	if (!gdi_FillRect(hdc, hRect, hBrush))
+		goto fail;
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+		{
+			UINT32 expected = 0;
+			const UINT32 actual = ReadColor(gdi_GetPointer(hBitmap, x, y), format);
+
+			if (gdi_PtInRect(hRect, x, y))
+				expected = ReadColor(gdi_get_brush_pointer(hdc, x, y), format);
+
+			if (actual != expected)
+			{
+				printf("pattern %s: pixel %"PRIu32"x%"PRIu32" actual:%08"PRIX32" expected:%08"PRIX32"\n",
+				       FreeRDPGetColorFormatName(format), x, y, actual, expected);
+				goto fail;
+			}
+		}
+	}
+
+	rc = 0;
+fail:
+	gdi_DeleteObject((HGDIOBJECT) hBrush);
+	gdi_DeleteObject((HGDIOBJECT) hPattern);
+	gdi_DeleteObject((HGDIOBJECT) hBitmap);
+	gdi_DeleteObject((HGDIOBJECT)hRect);
+	gdi_DeleteDC(hdc);
+	return rc;
+}
+
+static int test_gdi_brush_expand_mono(UINT32 format)
+{
+	BYTE expected[8 * 8 * 4];
+	BYTE actual[8 * 8 * 4];
+	gdiPalette palette = { 0 };
+	const BYTE bits[8] = { 0x81, 0x42, 0x24, 0x18, 0xF0, 0x0F, 0xAA, 0x55 };
+	const UINT32 backColor = FreeRDPGetColor(format, 0x10, 0x20, 0x30, 0xFF);
+	const UINT32 foreColor = FreeRDPGetColor(format, 0xC0, 0xB0, 0xA0, 0xFF);
+	const size_t size = 8 * 8 * GetBytesPerPixel(format);
+
+	if (!freerdp_image_copy_from_monochrome(expected, format, 0, 0, 0, 8, 8, bits,
+	                                        backColor, foreColor, &palette))
+		return -1;
+
+	if (!gdi_brush_expand_mono(actual, format, 0, 8, 8, bits, backColor, foreColor))
+		return -1;
+
+	if (memcmp(expected, actual, size) != 0)
+	{
+		printf("mono expansion %s differs\n", FreeRDPGetColorFormatName(format));
+		return -1;
+	}
+
+	return 0;
+}
+
 int TestGdiRect(int argc, char* argv[])
 {
+	size_t i;
+	const UINT32 formats[] = { PIXEL_FORMAT_XRGB32, PIXEL_FORMAT_BGR24, PIXEL_FORMAT_RGB16 };
 	WINPR_UNUSED(argc);
 	WINPR_UNUSED(argv);
 
@@ -164,6 +272,14 @@ int TestGdiRect(int argc, char* argv[])
 	if (test_gdi_FillRect() < 0)
 		return -1;
 
+	for (i = 0; i < ARRAYSIZE(formats); i++)
+	{
+		if (test_gdi_FillRect_pattern(formats[i]) < 0)
+			return -1;
+
+		if (test_gdi_brush_expand_mono(formats[i]) < 0)
+			return -1;
+	}
+
 	return 0;
 }
-
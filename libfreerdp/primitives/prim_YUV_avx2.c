@@ -0,0 +1,180 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * AVX2 YUV to RGB conversion operations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+
+#include "prim_internal.h"
+
+#include <immintrin.h>
+
+#if !defined(WITH_AVX2)
+#error "This file needs WITH_AVX2 enabled!"
+#endif
+
+static primitives_t* generic = NULL;
+
+/**
+ * The generic conversion computes e.g. R = CLIP((256 * Y + 403 * E) >> 8).
+ * Splitting the factors into 256 + k gives R = Y + E + ((147 * E) >> 8),
+ * where all intermediates fit into 16 bit. This converts 16 pixels per
+ * iteration and stays bit exact with the generic version.
+ */
+static INLINE void avx2_YUVToRGBX16(BYTE* pDst, __m256i Y, __m256i U, __m256i V, BOOL bgrx)
+{
+	const __m256i c128 = _mm256_set1_epi16(128);
+	const __m256i D = _mm256_sub_epi16(U, c128);
+	const __m256i E = _mm256_sub_epi16(V, c128);
+	const __m256i R = _mm256_add_epi16(_mm256_add_epi16(Y, E),
+	                                   _mm256_srai_epi16(_mm256_mullo_epi16(E, _mm256_set1_epi16(147)), 8));
+	const __m256i G = _mm256_add_epi16(Y, _mm256_srai_epi16(_mm256_sub_epi16(
+	                                       _mm256_mullo_epi16(D, _mm256_set1_epi16(-48)),
+	                                       _mm256_mullo_epi16(E, _mm256_set1_epi16(120))), 8));
+	const __m256i B = _mm256_add_epi16(_mm256_add_epi16(Y, D),
+	                                   _mm256_srai_epi16(_mm256_mullo_epi16(D, _mm256_set1_epi16(219)), 8));
+	/* per 128 bit lane: first/third channel of 8 pixels, then second/alpha */
+	const __m256i c02 = bgrx ? _mm256_packus_epi16(B, R) : _mm256_packus_epi16(R, B);
+	const __m256i c13 = _mm256_packus_epi16(G, _mm256_set1_epi16(0xFF));
+	const __m256i c01 = _mm256_unpacklo_epi8(c02, c13);
+	const __m256i c23 = _mm256_unpackhi_epi8(c02, c13);
+	const __m256i lo = _mm256_unpacklo_epi16(c01, c23);
+	const __m256i hi = _mm256_unpackhi_epi16(c01, c23);
+	_mm256_storeu_si256((__m256i*) pDst, _mm256_permute2x128_si256(lo, hi, 0x20));
+	_mm256_storeu_si256((__m256i*) (pDst + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+static INLINE BYTE* avx2_writePixel(BYTE* pRGB, BYTE Y, BYTE U, BYTE V, BOOL bgrx)
+{
+	const BYTE r = YUV2R(Y, U, V);
+	const BYTE g = YUV2G(Y, U, V);
+	const BYTE b = YUV2B(Y, U, V);
+
+	if (bgrx)
+		return writePixelBGRX(pRGB, 4, PIXEL_FORMAT_BGRX32, r, g, b, 0xFF);
+
+	return writePixelRGBX(pRGB, 4, PIXEL_FORMAT_RGBX32, r, g, b, 0xFF);
+}
+
+static BOOL avx2_YUV_format(UINT32 DstFormat, BOOL* bgrx)
+{
+	switch (DstFormat)
+	{
+		case PIXEL_FORMAT_BGRA32:
+		case PIXEL_FORMAT_BGRX32:
+			*bgrx = TRUE;
+			return TRUE;
+
+		case PIXEL_FORMAT_RGBA32:
+		case PIXEL_FORMAT_RGBX32:
+			*bgrx = FALSE;
+			return TRUE;
+
+		default:
+			return FALSE;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+static pstatus_t avx2_YUV420ToRGB_8u_P3AC4R(
+    const BYTE* pSrc[3], const UINT32 srcStep[3],
+    BYTE* pDst, UINT32 dstStep, UINT32 DstFormat,
+    const prim_size_t* roi)
+{
+	UINT32 y;
+	BOOL bgrx;
+
+	if (!avx2_YUV_format(DstFormat, &bgrx))
+		return generic->YUV420ToRGB_8u_P3AC4R(pSrc, srcStep, pDst, dstStep, DstFormat, roi);
+
+	for (y = 0; y < roi->height; y++)
+	{
+		const BYTE* pY = pSrc[0] + y * srcStep[0];
+		const BYTE* pU = pSrc[1] + (y / 2) * srcStep[1];
+		const BYTE* pV = pSrc[2] + (y / 2) * srcStep[2];
+		BYTE* pRGB = pDst + y * dstStep;
+		UINT32 x = 0;
+
+		for (; x + 16 <= roi->width; x += 16)
+		{
+			const __m128i u = _mm_loadl_epi64((const __m128i*) &pU[x / 2]);
+			const __m128i v = _mm_loadl_epi64((const __m128i*) &pV[x / 2]);
+			const __m256i Y = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) &pY[x]));
+			const __m256i U = _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(u, u));
+			const __m256i V = _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(v, v));
+			avx2_YUVToRGBX16(pRGB, Y, U, V, bgrx);
+			pRGB += 64;
+		}
+
+		for (; x < roi->width; x++)
+			pRGB = avx2_writePixel(pRGB, pY[x], pU[x / 2], pV[x / 2], bgrx);
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+static pstatus_t avx2_YUV444ToRGB_8u_P3AC4R(
+    const BYTE* pSrc[3], const UINT32 srcStep[3],
+    BYTE* pDst, UINT32 dstStep, UINT32 DstFormat,
+    const prim_size_t* roi)
+{
+	UINT32 y;
+	BOOL bgrx;
+
+	if (!avx2_YUV_format(DstFormat, &bgrx))
+		return generic->YUV444ToRGB_8u_P3AC4R(pSrc, srcStep, pDst, dstStep, DstFormat, roi);
+
+	for (y = 0; y < roi->height; y++)
+	{
+		const BYTE* pY = pSrc[0] + y * srcStep[0];
+		const BYTE* pU = pSrc[1] + y * srcStep[1];
+		const BYTE* pV = pSrc[2] + y * srcStep[2];
+		BYTE* pRGB = pDst + y * dstStep;
+		UINT32 x = 0;
+
+		for (; x + 16 <= roi->width; x += 16)
+		{
+			const __m256i Y = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) &pY[x]));
+			const __m256i U = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) &pU[x]));
+			const __m256i V = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) &pV[x]));
+			avx2_YUVToRGBX16(pRGB, Y, U, V, bgrx);
+			pRGB += 64;
+		}
+
+		for (; x < roi->width; x++)
+			pRGB = avx2_writePixel(pRGB, pY[x], pU[x], pV[x], bgrx);
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_YUV_avx2(primitives_t* prims)
+{
+	generic = primitives_get_generic();
+
+	if (!IsProcessorFeaturePresentEx(PF_EX_AVX2))
+		return;
+
+	prims->YUV420ToRGB_8u_P3AC4R = avx2_YUV420ToRGB_8u_P3AC4R;
+	prims->YUV444ToRGB_8u_P3AC4R = avx2_YUV444ToRGB_8u_P3AC4R;
+}
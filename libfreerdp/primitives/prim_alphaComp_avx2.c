@@ -0,0 +1,99 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * AVX2 alpha blending routines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+
+#include "prim_internal.h"
+
+#include <immintrin.h>
+
+#if !defined(WITH_AVX2)
+#error "This file needs WITH_AVX2 enabled!"
+#endif
+
+static primitives_t* generic = NULL;
+
+/* ------------------------------------------------------------------------- */
+/* Eight pixels at a time, bit exact with general_alphaComp_argb. */
+static pstatus_t avx2_alphaComp_argb(
+    const BYTE* pSrc1,  UINT32 src1Step,
+    const BYTE* pSrc2,  UINT32 src2Step,
+    BYTE* pDst,  UINT32 dstStep,
+    UINT32 width,  UINT32 height)
+{
+	UINT32 y;
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i full = _mm256_set1_epi32(256);
+	const __m256i mask = _mm256_set1_epi32(0x00FF00FF);
+
+	if (width < 8)
+		return generic->alphaComp_argb(pSrc1, src1Step, pSrc2, src2Step,
+		                               pDst, dstStep, width, height);
+
+	for (y = 0; y < height; y++)
+	{
+		const UINT32* sptr1 = (const UINT32*) (pSrc1 + y * src1Step);
+		const UINT32* sptr2 = (const UINT32*) (pSrc2 + y * src2Step);
+		UINT32* dptr = (UINT32*) (pDst + y * dstStep);
+		UINT32 x = 0;
+
+		for (; x + 8 <= width; x += 8)
+		{
+			const __m256i src1 = _mm256_loadu_si256((const __m256i*) &sptr1[x]);
+			const __m256i src2 = _mm256_loadu_si256((const __m256i*) &sptr2[x]);
+			const __m256i alpha = _mm256_add_epi32(_mm256_srli_epi32(src1, 24), one);
+			const __m256i s1rb = _mm256_and_si256(src1, mask);
+			const __m256i s1ag = _mm256_and_si256(_mm256_srli_epi32(src1, 8), mask);
+			const __m256i s2rb = _mm256_and_si256(src2, mask);
+			const __m256i s2ag = _mm256_and_si256(_mm256_srli_epi32(src2, 8), mask);
+			const __m256i drb = _mm256_mullo_epi32(_mm256_sub_epi32(s1rb, s2rb), alpha);
+			const __m256i dag = _mm256_mullo_epi32(_mm256_sub_epi32(s1ag, s2ag), alpha);
+			const __m256i rb = _mm256_and_si256(
+			                       _mm256_add_epi32(_mm256_srli_epi32(drb, 8), s2rb), mask);
+			const __m256i ag = _mm256_slli_epi32(_mm256_and_si256(
+			        _mm256_add_epi32(_mm256_srli_epi32(dag, 8), s2ag), mask), 8);
+			__m256i blend = _mm256_or_si256(rb, ag);
+			/* opaque source pixels are copied, transparent ones keep src2 */
+			blend = _mm256_blendv_epi8(blend, src1, _mm256_cmpeq_epi32(alpha, full));
+			blend = _mm256_blendv_epi8(blend, src2, _mm256_cmpeq_epi32(alpha, one));
+			_mm256_storeu_si256((__m256i*) &dptr[x], blend);
+		}
+
+		if (x < width)
+		{
+			generic->alphaComp_argb((const BYTE*) &sptr1[x], 0, (const BYTE*) &sptr2[x], 0,
+			                        (BYTE*) &dptr[x], 0, width - x, 1);
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_alphaComp_avx2(primitives_t* prims)
+{
+	generic = primitives_get_generic();
+
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+		prims->alphaComp_argb = avx2_alphaComp_argb;
+}
@@ -0,0 +1,129 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * AVX2 color conversion operations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+
+#include "prim_internal.h"
+
+#include <immintrin.h>
+
+#if !defined(WITH_AVX2)
+#error "This file needs WITH_AVX2 enabled!"
+#endif
+
+static primitives_t* generic = NULL;
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Eight pixels at a time in 32 bit lanes, which keeps the exact fixed point
+ * arithmetic (including the INT16 truncation) of the generic version.
+ */
+static INLINE __m256i avx2_yCbCrToChannel(__m256i v)
+{
+	v = _mm256_srai_epi32(v, 16);
+	v = _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16);
+	v = _mm256_srai_epi32(v, 5);
+	return _mm256_min_epi32(_mm256_max_epi32(v, _mm256_setzero_si256()), _mm256_set1_epi32(255));
+}
+
+static pstatus_t avx2_yCbCrToRGB_16s8u_P3AC4R(
+    const INT16* pSrc[3], UINT32 srcStep,
+    BYTE* pDst, UINT32 dstStep, UINT32 DstFormat,
+    const prim_size_t* roi)
+{
+	UINT32 y;
+	UINT32 shiftR, shiftB;
+	const INT32 divisor = 16;
+	const __m256i cCrR = _mm256_set1_epi32((INT32)(1.402525f * (1 << divisor)));
+	const __m256i cCrG = _mm256_set1_epi32((INT32)(0.714401f * (1 << divisor)));
+	const __m256i cCbG = _mm256_set1_epi32((INT32)(0.343730f * (1 << divisor)));
+	const __m256i cCbB = _mm256_set1_epi32((INT32)(1.769905f * (1 << divisor)));
+	const __m256i offset = _mm256_set1_epi32(4096);
+	const __m256i alpha = _mm256_set1_epi32((int) 0xFF000000);
+
+	switch (DstFormat)
+	{
+		case PIXEL_FORMAT_BGRA32:
+		case PIXEL_FORMAT_BGRX32:
+			shiftR = 16;
+			shiftB = 0;
+			break;
+
+		case PIXEL_FORMAT_RGBA32:
+		case PIXEL_FORMAT_RGBX32:
+			shiftR = 0;
+			shiftB = 16;
+			break;
+
+		default:
+			return generic->yCbCrToRGB_16s8u_P3AC4R(pSrc, srcStep, pDst, dstStep, DstFormat, roi);
+	}
+
+	for (y = 0; y < roi->height; y++)
+	{
+		const INT16* pY = (const INT16*) ((const BYTE*) pSrc[0] + y * srcStep);
+		const INT16* pCb = (const INT16*) ((const BYTE*) pSrc[1] + y * srcStep);
+		const INT16* pCr = (const INT16*) ((const BYTE*) pSrc[2] + y * srcStep);
+		BYTE* pRGB = pDst + y * dstStep;
+		UINT32 x = 0;
+
+		for (; x + 8 <= roi->width; x += 8)
+		{
+			const __m256i Yv = _mm256_slli_epi32(_mm256_add_epi32(
+			        _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) &pY[x])), offset), divisor);
+			const __m256i Cb = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) &pCb[x]));
+			const __m256i Cr = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) &pCr[x]));
+			const __m256i R = avx2_yCbCrToChannel(_mm256_add_epi32(_mm256_mullo_epi32(Cr, cCrR), Yv));
+			const __m256i G = avx2_yCbCrToChannel(_mm256_sub_epi32(_mm256_sub_epi32(Yv,
+			                                      _mm256_mullo_epi32(Cb, cCbG)), _mm256_mullo_epi32(Cr, cCrG)));
+			const __m256i B = avx2_yCbCrToChannel(_mm256_add_epi32(_mm256_mullo_epi32(Cb, cCbB), Yv));
+			__m256i pixels = _mm256_or_si256(_mm256_slli_epi32(G, 8), alpha);
+			pixels = _mm256_or_si256(pixels, _mm256_sll_epi32(R, _mm_cvtsi32_si128((int) shiftR)));
+			pixels = _mm256_or_si256(pixels, _mm256_sll_epi32(B, _mm_cvtsi32_si128((int) shiftB)));
+			_mm256_storeu_si256((__m256i*) &pRGB[x * 4], pixels);
+		}
+
+		if (x < roi->width)
+		{
+			const INT16* pRest[3];
+			prim_size_t rest;
+			pRest[0] = &pY[x];
+			pRest[1] = &pCb[x];
+			pRest[2] = &pCr[x];
+			rest.width = roi->width - x;
+			rest.height = 1;
+			generic->yCbCrToRGB_16s8u_P3AC4R(pRest, srcStep, &pRGB[x * 4], dstStep, DstFormat, &rest);
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_colors_avx2(primitives_t* prims)
+{
+	generic = primitives_get_generic();
+
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+		prims->yCbCrToRGB_16s8u_P3AC4R = avx2_yCbCrToRGB_16s8u_P3AC4R;
+}
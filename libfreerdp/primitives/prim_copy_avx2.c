@@ -0,0 +1,85 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * AVX2 copy routines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+
+#include "prim_internal.h"
+
+#include <immintrin.h>
+
+#if !defined(WITH_AVX2)
+#error "This file needs WITH_AVX2 enabled!"
+#endif
+
+#include <string.h>
+
+static primitives_t* generic = NULL;
+
+/* ------------------------------------------------------------------------- */
+static pstatus_t avx2_copy_8u_AC4r(
+    const BYTE* pSrc,  INT32 srcStep,
+    BYTE* pDst,  INT32 dstStep,
+    INT32 width,  INT32 height)
+{
+	INT32 y;
+	const size_t rowbytes = (size_t) width * sizeof(UINT32);
+
+	if ((width <= 0) || (height <= 0))
+		return PRIMITIVES_SUCCESS;
+
+	/* overlapping rows need the memmove semantics of the generic version,
+	 * rows shorter than a vector are cheaper with memcpy */
+	if ((rowbytes < 64) || (srcStep < 0) || (dstStep < 0) ||
+	    ((pSrc < pDst + (size_t) dstStep * (height - 1) + rowbytes) &&
+	     (pDst < pSrc + (size_t) srcStep * (height - 1) + rowbytes)))
+		return generic->copy_8u_AC4r(pSrc, srcStep, pDst, dstStep, width, height);
+
+	for (y = 0; y < height; y++)
+	{
+		const BYTE* src = pSrc + (size_t) y * srcStep;
+		BYTE* dst = pDst + (size_t) y * dstStep;
+		size_t x = 0;
+
+		for (; x + 64 <= rowbytes; x += 64)
+		{
+			const __m256i a = _mm256_loadu_si256((const __m256i*) &src[x]);
+			const __m256i b = _mm256_loadu_si256((const __m256i*) &src[x + 32]);
+			_mm256_storeu_si256((__m256i*) &dst[x], a);
+			_mm256_storeu_si256((__m256i*) &dst[x + 32], b);
+		}
+
+		if (x < rowbytes)
+			memcpy(&dst[x], &src[x], rowbytes - x);
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_copy_avx2(primitives_t* prims)
+{
+	generic = primitives_get_generic();
+
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+		prims->copy_8u_AC4r = avx2_copy_8u_AC4r;
+}
@@ -205,4 +205,13 @@ FREERDP_LOCAL void primitives_init_YCoCg_opt(primitives_t* prims);
 FREERDP_LOCAL void primitives_init_YUV_opt(primitives_t* prims);
 #endif
 
+#if defined(WITH_AVX2)
+FREERDP_LOCAL void primitives_init_copy_avx2(primitives_t* prims);
+FREERDP_LOCAL void primitives_init_shift_avx2(primitives_t* prims);
+FREERDP_LOCAL void primitives_init_sign_avx2(primitives_t* prims);
+FREERDP_LOCAL void primitives_init_alphaComp_avx2(primitives_t* prims);
+FREERDP_LOCAL void primitives_init_colors_avx2(primitives_t* prims);
+FREERDP_LOCAL void primitives_init_YUV_avx2(primitives_t* prims);
+#endif
+
 #endif /* FREERDP_LIB_PRIM_INTERNAL_H */
@@ -0,0 +1,79 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * AVX2 shift operations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+
+#include "prim_internal.h"
+
+#include <immintrin.h>
+
+#if !defined(WITH_AVX2)
+#error "This file needs WITH_AVX2 enabled!"
+#endif
+
+/* The shift count is the same for all elements, like in the SSE versions
+ * a zero shift leaves the destination untouched. */
+#define AVX2_SHIFT_16(_name_, _type_, _op_, _scalar_) \
+	static pstatus_t _name_(const _type_* pSrc, UINT32 val, _type_* pDst, UINT32 len) \
+	{ \
+		if (val == 0) \
+			return PRIMITIVES_SUCCESS; \
+	\
+		if (val > 16) \
+			val = 16; \
+	\
+		for (; len >= 32; len -= 32) \
+		{ \
+			const __m256i a = _mm256_loadu_si256((const __m256i*) pSrc); \
+			const __m256i b = _mm256_loadu_si256((const __m256i*) (pSrc + 16)); \
+			_mm256_storeu_si256((__m256i*) pDst, _op_(a, (int) val)); \
+			_mm256_storeu_si256((__m256i*) (pDst + 16), _op_(b, (int) val)); \
+			pSrc += 32; \
+			pDst += 32; \
+		} \
+	\
+		while (len--) \
+		{ \
+			*pDst++ = (_type_) _scalar_; \
+			pSrc++; \
+		} \
+	\
+		return PRIMITIVES_SUCCESS; \
+	}
+
+AVX2_SHIFT_16(avx2_lShiftC_16s, INT16, _mm256_slli_epi16, (*pSrc << val))
+AVX2_SHIFT_16(avx2_rShiftC_16s, INT16, _mm256_srai_epi16, (*pSrc >> val))
+AVX2_SHIFT_16(avx2_lShiftC_16u, UINT16, _mm256_slli_epi16, (*pSrc << val))
+AVX2_SHIFT_16(avx2_rShiftC_16u, UINT16, _mm256_srli_epi16, (*pSrc >> val))
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_shift_avx2(primitives_t* prims)
+{
+	if (!IsProcessorFeaturePresentEx(PF_EX_AVX2))
+		return;
+
+	prims->lShiftC_16s = avx2_lShiftC_16s;
+	prims->rShiftC_16s = avx2_rShiftC_16s;
+	prims->lShiftC_16u = avx2_lShiftC_16u;
+	prims->rShiftC_16u = avx2_rShiftC_16u;
+}
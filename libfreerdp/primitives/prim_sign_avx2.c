@@ -0,0 +1,67 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * AVX2 sign operations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+
+#include "prim_internal.h"
+
+#include <immintrin.h>
+
+#if !defined(WITH_AVX2)
+#error "This file needs WITH_AVX2 enabled!"
+#endif
+
+/* ------------------------------------------------------------------------- */
+static pstatus_t avx2_sign_16s(
+    const INT16* pSrc,
+    INT16* pDst,
+    UINT32 len)
+{
+	const __m256i one = _mm256_set1_epi16(1);
+
+	/* 32 shorts per iteration, unaligned loads are as fast as aligned ones */
+	for (; len >= 32; len -= 32)
+	{
+		const __m256i a = _mm256_loadu_si256((const __m256i*) pSrc);
+		const __m256i b = _mm256_loadu_si256((const __m256i*) (pSrc + 16));
+		_mm256_storeu_si256((__m256i*) pDst, _mm256_sign_epi16(one, a));
+		_mm256_storeu_si256((__m256i*) (pDst + 16), _mm256_sign_epi16(one, b));
+		pSrc += 32;
+		pDst += 32;
+	}
+
+	while (len--)
+	{
+		INT16 src = *pSrc++;
+		*pDst++ = (src < 0) ? (-1) : ((src > 0) ? 1 : 0);
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_sign_avx2(primitives_t* prims)
+{
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+		prims->sign_16s = avx2_sign_16s;
+}
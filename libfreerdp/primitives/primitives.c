@@ -19,12 +19,19 @@
 #include "config.h"
 #endif
 
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 
 #include <winpr/synch.h>
+#include <winpr/interlocked.h>
+#include <winpr/environment.h>
 #include <freerdp/primitives.h>
 
+#ifndef _WIN32
+#include <time.h>
+#endif
+
 #include "prim_internal.h"
 
 /* Singleton pointer used throughout the program when requested. */
@@ -33,8 +40,45 @@ static INIT_ONCE generic_primitives_InitOnce = INIT_ONCE_STATIC_INIT;
 #if defined(HAVE_OPTIMIZED_PRIMITIVES)
 static primitives_t pPrimitives = { 0 };
 static INIT_ONCE primitives_InitOnce = INIT_ONCE_STATIC_INIT;
+static INIT_ONCE autotune_InitOnce = INIT_ONCE_STATIC_INIT;
+/* Unmodified tables of each implementation tier, the candidates of the autotuner */
+static primitives_t pPrimitivesOpt = { 0 };
+#if defined(WITH_AVX2)
+static primitives_t pPrimitivesAvx2 = { 0 };
+#endif
+static LONG autotune_running = 0;
 #endif
 
+/* Autotuner benchmark input, sized like a typical surface command tile row */
+#define BENCH_WIDTH 256
+#define BENCH_HEIGHT 64
+#define BENCH_TILE 64
+#define BENCH_RUNS 5
+#define BENCH_CALLS 8
+
+typedef struct
+{
+	BYTE* rgb[3];				/* source, second source and destination, 32bpp */
+	BYTE* yuv[3];				/* full resolution planes */
+	BYTE* aux[3];
+	INT16* tile[3];				/* 64x64 RemoteFX coefficient planes */
+	INT16* tileDst[3];
+	UINT32 rgbStep;
+	UINT32 yuvStep[3];
+	prim_size_t roi;
+	prim_size_t tileRoi;
+} primitives_bench_t;
+
+typedef void (*primitives_bench_fn_t)(const primitives_t* prims, primitives_bench_t* bench);
+typedef pstatus_t (*primitives_fn_t)(void);
+
+typedef struct
+{
+	const char* name;
+	size_t offset;
+	primitives_bench_fn_t run;
+} primitives_tunable_t;
+
 
 /* ------------------------------------------------------------------------- */
 static BOOL CALLBACK primitives_init_generic(PINIT_ONCE once, PVOID param, PVOID* context)
@@ -62,16 +106,362 @@ static BOOL CALLBACK primitives_init(PINIT_ONCE once, PVOID param, PVOID* contex
 	WINPR_UNUSED(param);
 	WINPR_UNUSED(context);
 	/* Now call each section's initialization routine. */
-	primitives_init_add_opt(&pPrimitives);
-	primitives_init_andor_opt(&pPrimitives);
-	primitives_init_alphaComp_opt(&pPrimitives);
-	primitives_init_copy_opt(&pPrimitives);
-	primitives_init_set_opt(&pPrimitives);
-	primitives_init_shift_opt(&pPrimitives);
-	primitives_init_sign_opt(&pPrimitives);
-	primitives_init_colors_opt(&pPrimitives);
-	primitives_init_YCoCg_opt(&pPrimitives);
-	primitives_init_YUV_opt(&pPrimitives);
+	primitives_init_add_opt(&pPrimitivesOpt);
+	primitives_init_andor_opt(&pPrimitivesOpt);
+	primitives_init_alphaComp_opt(&pPrimitivesOpt);
+	primitives_init_copy_opt(&pPrimitivesOpt);
+	primitives_init_set_opt(&pPrimitivesOpt);
+	primitives_init_shift_opt(&pPrimitivesOpt);
+	primitives_init_sign_opt(&pPrimitivesOpt);
+	primitives_init_colors_opt(&pPrimitivesOpt);
+	primitives_init_YCoCg_opt(&pPrimitivesOpt);
+	primitives_init_YUV_opt(&pPrimitivesOpt);
+	pPrimitives = pPrimitivesOpt;
+#if defined(WITH_AVX2)
+	/* The AVX2 tier overrides the optimized one where it has a kernel */
+	pPrimitivesAvx2 = pPrimitivesOpt;
+	primitives_init_copy_avx2(&pPrimitivesAvx2);
+	primitives_init_shift_avx2(&pPrimitivesAvx2);
+	primitives_init_sign_avx2(&pPrimitivesAvx2);
+	primitives_init_alphaComp_avx2(&pPrimitivesAvx2);
+	primitives_init_colors_avx2(&pPrimitivesAvx2);
+	primitives_init_YUV_avx2(&pPrimitivesAvx2);
+	pPrimitives = pPrimitivesAvx2;
+#endif
+	return TRUE;
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+static void bench_copy_8u_AC4r(const primitives_t* prims, primitives_bench_t* bench)
+{
+	prims->copy_8u_AC4r(bench->rgb[0], bench->rgbStep, bench->rgb[2], bench->rgbStep,
+	                    BENCH_WIDTH, BENCH_HEIGHT);
+}
+
+static void bench_alphaComp_argb(const primitives_t* prims, primitives_bench_t* bench)
+{
+	prims->alphaComp_argb(bench->rgb[0], bench->rgbStep, bench->rgb[1], bench->rgbStep,
+	                      bench->rgb[2], bench->rgbStep, BENCH_WIDTH, BENCH_HEIGHT);
+}
+
+static void bench_lShiftC_16s(const primitives_t* prims, primitives_bench_t* bench)
+{
+	prims->lShiftC_16s(bench->tile[0], 3, bench->tileDst[0], BENCH_TILE * BENCH_TILE);
+}
+
+static void bench_rShiftC_16s(const primitives_t* prims, primitives_bench_t* bench)
+{
+	prims->rShiftC_16s(bench->tile[0], 3, bench->tileDst[0], BENCH_TILE * BENCH_TILE);
+}
+
+static void bench_lShiftC_16u(const primitives_t* prims, primitives_bench_t* bench)
+{
+	prims->lShiftC_16u((const UINT16*) bench->tile[0], 3, (UINT16*) bench->tileDst[0],
+	                   BENCH_TILE * BENCH_TILE);
+}
+
+static void bench_rShiftC_16u(const primitives_t* prims, primitives_bench_t* bench)
+{
+	prims->rShiftC_16u((const UINT16*) bench->tile[0], 3, (UINT16*) bench->tileDst[0],
+	                   BENCH_TILE * BENCH_TILE);
+}
+
+static void bench_sign_16s(const primitives_t* prims, primitives_bench_t* bench)
+{
+	prims->sign_16s(bench->tile[0], bench->tileDst[0], BENCH_TILE * BENCH_TILE);
+}
+
+static void bench_yCbCrToRGB_16s8u_P3AC4R(const primitives_t* prims, primitives_bench_t* bench)
+{
+	prims->yCbCrToRGB_16s8u_P3AC4R((const INT16**) bench->tile, BENCH_TILE * sizeof(INT16),
+	                               bench->rgb[2], BENCH_TILE * 4, PIXEL_FORMAT_BGRX32,
+	                               &bench->tileRoi);
+}
+
+static void bench_RGBToYCbCr_16s16s_P3P3(const primitives_t* prims, primitives_bench_t* bench)
+{
+	prims->RGBToYCbCr_16s16s_P3P3((const INT16**) bench->tile, BENCH_TILE * sizeof(INT16),
+	                              bench->tileDst, BENCH_TILE * sizeof(INT16), &bench->tileRoi);
+}
+
+static void bench_YUV420ToRGB_8u_P3AC4R(const primitives_t* prims, primitives_bench_t* bench)
+{
+	prims->YUV420ToRGB_8u_P3AC4R((const BYTE**) bench->yuv, bench->yuvStep, bench->rgb[2],
+	                             bench->rgbStep, PIXEL_FORMAT_BGRX32, &bench->roi);
+}
+
+static void bench_YUV444ToRGB_8u_P3AC4R(const primitives_t* prims, primitives_bench_t* bench)
+{
+	prims->YUV444ToRGB_8u_P3AC4R((const BYTE**) bench->yuv, bench->yuvStep, bench->rgb[2],
+	                             bench->rgbStep, PIXEL_FORMAT_BGRX32, &bench->roi);
+}
+
+static void bench_RGBToYUV420_8u_P3AC4R(const primitives_t* prims, primitives_bench_t* bench)
+{
+	prims->RGBToYUV420_8u_P3AC4R(bench->rgb[0], PIXEL_FORMAT_BGRX32, bench->rgbStep,
+	                             bench->yuv, bench->yuvStep, &bench->roi);
+}
+
+static void bench_RGBToAVC444YUV(const primitives_t* prims, primitives_bench_t* bench)
+{
+	prims->RGBToAVC444YUV(bench->rgb[0], PIXEL_FORMAT_BGRX32, bench->rgbStep, bench->yuv,
+	                      bench->yuvStep, bench->aux, bench->yuvStep, &bench->roi);
+}
+
+static void bench_RGBToAVC444YUVv2(const primitives_t* prims, primitives_bench_t* bench)
+{
+	prims->RGBToAVC444YUVv2(bench->rgb[0], PIXEL_FORMAT_BGRX32, bench->rgbStep, bench->yuv,
+	                        bench->yuvStep, bench->aux, bench->yuvStep, &bench->roi);
+}
+
+#define TUNABLE(_name) { #_name, offsetof(primitives_t, _name), bench_##_name }
+
+static const primitives_tunable_t tunables[] =
+{
+	TUNABLE(copy_8u_AC4r),
+	TUNABLE(alphaComp_argb),
+	TUNABLE(lShiftC_16s),
+	TUNABLE(rShiftC_16s),
+	TUNABLE(lShiftC_16u),
+	TUNABLE(rShiftC_16u),
+	TUNABLE(sign_16s),
+	TUNABLE(yCbCrToRGB_16s8u_P3AC4R),
+	TUNABLE(RGBToYCbCr_16s16s_P3P3),
+	TUNABLE(YUV420ToRGB_8u_P3AC4R),
+	TUNABLE(YUV444ToRGB_8u_P3AC4R),
+	TUNABLE(RGBToYUV420_8u_P3AC4R),
+	TUNABLE(RGBToAVC444YUV),
+	TUNABLE(RGBToAVC444YUVv2)
+};
+
+#define TUNABLE_COUNT (sizeof(tunables) / sizeof(tunables[0]))
+
+static primitives_tuning_t tuning[TUNABLE_COUNT] = { { 0 } };
+
+static primitives_fn_t primitives_tunable_get(const primitives_t* prims, size_t offset)
+{
+	primitives_fn_t fn;
+	memcpy(&fn, ((const BYTE*) prims) + offset, sizeof(fn));
+	return fn;
+}
+
+static void primitives_tunable_set(primitives_t* prims, size_t offset, primitives_fn_t fn)
+{
+	memcpy(((BYTE*) prims) + offset, &fn, sizeof(fn));
+}
+
+/* Returns the table of each tier, NULL if the tier is not compiled in */
+static const primitives_t* primitives_tier(primitives_impl_t impl)
+{
+	switch (impl)
+	{
+		case PRIMITIVES_IMPL_GENERIC:
+			return &pPrimitivesGeneric;
+#if defined(HAVE_OPTIMIZED_PRIMITIVES)
+
+		case PRIMITIVES_IMPL_OPTIMIZED:
+			return &pPrimitivesOpt;
+#if defined(WITH_AVX2)
+
+		case PRIMITIVES_IMPL_AVX2:
+			return &pPrimitivesAvx2;
+#endif
+#endif
+
+		default:
+			return NULL;
+	}
+}
+
+/* The lowest tier providing the function, tiers that only inherit it are not candidates */
+static primitives_impl_t primitives_tunable_owner(size_t offset, primitives_fn_t fn)
+{
+	int impl;
+
+	for (impl = PRIMITIVES_IMPL_GENERIC; impl < PRIMITIVES_IMPL_COUNT; impl++)
+	{
+		const primitives_t* tier = primitives_tier((primitives_impl_t) impl);
+
+		if (tier && (primitives_tunable_get(tier, offset) == fn))
+			return (primitives_impl_t) impl;
+	}
+
+	return PRIMITIVES_IMPL_GENERIC;
+}
+
+static void primitives_update_tuning(const primitives_t* prims)
+{
+	size_t index;
+
+	for (index = 0; index < TUNABLE_COUNT; index++)
+	{
+		const primitives_fn_t fn = primitives_tunable_get(prims, tunables[index].offset);
+		tuning[index].name = tunables[index].name;
+		tuning[index].selected = primitives_tunable_owner(tunables[index].offset, fn);
+	}
+}
+
+#if defined(HAVE_OPTIMIZED_PRIMITIVES)
+static UINT64 primitives_bench_now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (UINT64)(counter.QuadPart * 1000000000.0 / frequency.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((UINT64) ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static void primitives_bench_free(primitives_bench_t* bench)
+{
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		_aligned_free(bench->rgb[i]);
+		_aligned_free(bench->yuv[i]);
+		_aligned_free(bench->aux[i]);
+		_aligned_free(bench->tile[i]);
+		_aligned_free(bench->tileDst[i]);
+	}
+}
+
+static BOOL primitives_bench_new(primitives_bench_t* bench)
+{
+	int i;
+	size_t x;
+	const size_t rgbSize = BENCH_WIDTH * BENCH_HEIGHT * 4;
+	const size_t yuvSize = BENCH_WIDTH * BENCH_HEIGHT;
+	const size_t tileSize = BENCH_TILE * BENCH_TILE;
+	UINT32 seed = 0x12345678;
+	ZeroMemory(bench, sizeof(primitives_bench_t));
+	bench->rgbStep = BENCH_WIDTH * 4;
+	bench->roi.width = BENCH_WIDTH;
+	bench->roi.height = BENCH_HEIGHT;
+	bench->tileRoi.width = BENCH_TILE;
+	bench->tileRoi.height = BENCH_TILE;
+
+	for (i = 0; i < 3; i++)
+	{
+		bench->yuvStep[i] = BENCH_WIDTH;
+		bench->rgb[i] = _aligned_malloc(rgbSize, 32);
+		bench->yuv[i] = _aligned_malloc(yuvSize, 32);
+		bench->aux[i] = _aligned_malloc(yuvSize, 32);
+		bench->tile[i] = _aligned_malloc(tileSize * sizeof(INT16), 32);
+		bench->tileDst[i] = _aligned_malloc(tileSize * sizeof(INT16), 32);
+
+		if (!bench->rgb[i] || !bench->yuv[i] || !bench->aux[i] || !bench->tile[i] ||
+		    !bench->tileDst[i])
+		{
+			primitives_bench_free(bench);
+			return FALSE;
+		}
+
+		/* content does not matter as long as all code paths are taken */
+		for (x = 0; x < rgbSize; x++)
+		{
+			seed = seed * 1103515245 + 12345;
+			bench->rgb[i][x] = (BYTE)(seed >> 16);
+		}
+
+		for (x = 0; x < yuvSize; x++)
+			bench->yuv[i][x] = bench->rgb[i][x];
+
+		for (x = 0; x < tileSize; x++)
+			bench->tile[i][x] = (INT16)((bench->rgb[i][2 * x] << 4) - 2048);
+	}
+
+	return TRUE;
+}
+
+static UINT64 primitives_bench_run(const primitives_tunable_t* tunable, const primitives_t* prims,
+                                   primitives_bench_t* bench)
+{
+	int run, call;
+	UINT64 best = 0;
+	/* warm up caches and lazily initialized state */
+	tunable->run(prims, bench);
+
+	for (run = 0; run < BENCH_RUNS; run++)
+	{
+		UINT64 elapsed;
+		const UINT64 start = primitives_bench_now();
+
+		for (call = 0; call < BENCH_CALLS; call++)
+			tunable->run(prims, bench);
+
+		elapsed = primitives_bench_now() - start;
+
+		if ((run == 0) || (elapsed < best))
+			best = elapsed;
+	}
+
+	return (best / BENCH_CALLS) + 1;
+}
+
+static BOOL primitives_run_autotune(void)
+{
+	size_t index;
+	primitives_bench_t bench;
+
+	if (InterlockedCompareExchange(&autotune_running, 1, 0) != 0)
+		return FALSE;
+
+	if (!primitives_bench_new(&bench))
+	{
+		InterlockedExchange(&autotune_running, 0);
+		return FALSE;
+	}
+
+	for (index = 0; index < TUNABLE_COUNT; index++)
+	{
+		int impl;
+		const primitives_tunable_t* tunable = &tunables[index];
+		primitives_tuning_t* result = &tuning[index];
+		primitives_impl_t best = PRIMITIVES_IMPL_GENERIC;
+
+		for (impl = PRIMITIVES_IMPL_GENERIC; impl < PRIMITIVES_IMPL_COUNT; impl++)
+		{
+			const primitives_t* tier = primitives_tier((primitives_impl_t) impl);
+			result->nanoseconds[impl] = 0;
+
+			if (!tier)
+				continue;
+
+			if (primitives_tunable_owner(tunable->offset,
+			                             primitives_tunable_get(tier, tunable->offset)) != impl)
+				continue;
+
+			result->nanoseconds[impl] = primitives_bench_run(tunable, tier, &bench);
+
+			if (result->nanoseconds[impl] < result->nanoseconds[best])
+				best = (primitives_impl_t) impl;
+		}
+
+		primitives_tunable_set(&pPrimitives, tunable->offset,
+		                       primitives_tunable_get(primitives_tier(best), tunable->offset));
+	}
+
+	primitives_bench_free(&bench);
+	primitives_update_tuning(&pPrimitives);
+	InterlockedExchange(&autotune_running, 0);
+	return TRUE;
+}
+
+static BOOL CALLBACK primitives_init_autotune(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	WINPR_UNUSED(once);
+	WINPR_UNUSED(param);
+	WINPR_UNUSED(context);
+
+	if (GetEnvironmentVariableA("FREERDP_PRIMITIVES_AUTOTUNE", NULL, 0) > 0)
+		primitives_run_autotune();
+
 	return TRUE;
 }
 #endif
@@ -82,6 +472,7 @@ primitives_t* primitives_get(void)
 	InitOnceExecuteOnce(&generic_primitives_InitOnce, primitives_init_generic, NULL, NULL);
 #if defined(HAVE_OPTIMIZED_PRIMITIVES)
 	InitOnceExecuteOnce(&primitives_InitOnce, primitives_init, NULL, NULL);
+	InitOnceExecuteOnce(&autotune_InitOnce, primitives_init_autotune, NULL, NULL);
 	return &pPrimitives;
 #else
 	return &pPrimitivesGeneric;
@@ -94,3 +485,49 @@ primitives_t* primitives_get_generic(void)
 	return &pPrimitivesGeneric;
 }
 
+
+BOOL primitives_autotune(void)
+{
+	primitives_get();
+#if defined(HAVE_OPTIMIZED_PRIMITIVES)
+	return primitives_run_autotune();
+#else
+	/* nothing to choose from */
+	return TRUE;
+#endif
+}
+
+const primitives_tuning_t* primitives_get_tuning(UINT32* count)
+{
+	const primitives_t* prims = primitives_get();
+#if defined(HAVE_OPTIMIZED_PRIMITIVES)
+
+	if (InterlockedCompareExchange(&autotune_running, 0, 0) != 0)
+		return NULL;
+
+#endif
+	primitives_update_tuning(prims);
+
+	if (count)
+		*count = TUNABLE_COUNT;
+
+	return tuning;
+}
+
+const char* primitives_impl_name(primitives_impl_t impl)
+{
+	switch (impl)
+	{
+		case PRIMITIVES_IMPL_GENERIC:
+			return "generic";
+
+		case PRIMITIVES_IMPL_OPTIMIZED:
+			return "optimized";
+
+		case PRIMITIVES_IMPL_AVX2:
+			return "avx2";
+
+		default:
+			return "unknown";
+	}
+}
@@ -0,0 +1,223 @@
+/* TestPrimitivesAutotune.c
+ * vi:ts=4 sw=4
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0.
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+#include "prim_test.h"
+
+#define TEST_MAX_WIDTH 83
+#define TEST_HEIGHT 5
+#define TEST_STEP (TEST_MAX_WIDTH * 4 + 12)
+
+/* Odd widths exercise the scalar tails of the vector kernels */
+static const UINT32 test_widths[] = { 1, 7, 8, 9, 15, 16, 17, 31, 33, 63, 65, 83 };
+
+struct test_autotune_data
+{
+	BYTE ALIGN(src1[TEST_STEP * TEST_HEIGHT]);
+	BYTE ALIGN(src2[TEST_STEP * TEST_HEIGHT]);
+	BYTE ALIGN(d1[TEST_STEP * TEST_HEIGHT]);
+	BYTE ALIGN(d2[TEST_STEP * TEST_HEIGHT]);
+	BYTE ALIGN(planes[3][TEST_STEP * TEST_HEIGHT]);
+	INT16 ALIGN(coeffs[3][TEST_MAX_WIDTH * TEST_HEIGHT]);
+};
+typedef struct test_autotune_data TEST_AUTOTUNE_DATA;
+
+static BOOL test_compare(const char* name, UINT32 width, const TEST_AUTOTUNE_DATA* data)
+{
+	UINT32 y;
+
+	for (y = 0; y < TEST_HEIGHT; y++)
+	{
+		const BYTE* a = &data->d1[y * TEST_STEP];
+		const BYTE* b = &data->d2[y * TEST_STEP];
+
+		if (memcmp(a, b, width * 4) != 0)
+		{
+			printf("%s: width %"PRIu32" row %"PRIu32" differs from generic\n", name, width, y);
+			return FALSE;
+		}
+
+		/* nothing beyond the row may be touched */
+		if (memcmp(&a[width * 4], &b[width * 4], TEST_STEP - width * 4) != 0)
+		{
+			printf("%s: width %"PRIu32" row %"PRIu32" writes past the row\n", name, width, y);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static void test_reset(TEST_AUTOTUNE_DATA* data)
+{
+	memset(data->d1, 0xA5, sizeof(data->d1));
+	memset(data->d2, 0xA5, sizeof(data->d2));
+}
+
+static BOOL test_autotune_exact(const primitives_t* prims, TEST_AUTOTUNE_DATA* data)
+{
+	size_t i;
+	const UINT32 formats[] = { PIXEL_FORMAT_BGRX32, PIXEL_FORMAT_RGBX32, PIXEL_FORMAT_XRGB32 };
+
+	for (i = 0; i < ARRAYSIZE(test_widths); i++)
+	{
+		size_t f;
+		const UINT32 width = test_widths[i];
+		prim_size_t roi;
+		roi.width = width;
+		roi.height = TEST_HEIGHT;
+		test_reset(data);
+		generic->copy_8u_AC4r(data->src1, TEST_STEP, data->d1, TEST_STEP, width, TEST_HEIGHT);
+		prims->copy_8u_AC4r(data->src1, TEST_STEP, data->d2, TEST_STEP, width, TEST_HEIGHT);
+
+		if (!test_compare("copy_8u_AC4r", width, data))
+			return FALSE;
+
+		test_reset(data);
+		generic->alphaComp_argb(data->src1, TEST_STEP, data->src2, TEST_STEP, data->d1, TEST_STEP,
+		                        width, TEST_HEIGHT);
+		prims->alphaComp_argb(data->src1, TEST_STEP, data->src2, TEST_STEP, data->d2, TEST_STEP,
+		                      width, TEST_HEIGHT);
+
+		if (!test_compare("alphaComp_argb", width, data))
+			return FALSE;
+
+		for (f = 0; f < ARRAYSIZE(formats); f++)
+		{
+			const INT16* coeffs[3];
+			coeffs[0] = data->coeffs[0];
+			coeffs[1] = data->coeffs[1];
+			coeffs[2] = data->coeffs[2];
+			test_reset(data);
+			generic->yCbCrToRGB_16s8u_P3AC4R(coeffs, width * sizeof(INT16), data->d1, TEST_STEP,
+			                                 formats[f], &roi);
+			prims->yCbCrToRGB_16s8u_P3AC4R(coeffs, width * sizeof(INT16), data->d2, TEST_STEP,
+			                               formats[f], &roi);
+
+			if (!test_compare(FreeRDPGetColorFormatName(formats[f]), width, data))
+				return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL test_autotune_yuv(const primitives_t* prims, TEST_AUTOTUNE_DATA* data)
+{
+	size_t i;
+	const BYTE* planes[3];
+	const UINT32 steps[3] = { TEST_STEP, TEST_STEP, TEST_STEP };
+	planes[0] = data->planes[0];
+	planes[1] = data->planes[1];
+	planes[2] = data->planes[2];
+
+	for (i = 0; i < ARRAYSIZE(test_widths); i++)
+	{
+		prim_size_t roi;
+		roi.width = test_widths[i];
+		roi.height = TEST_HEIGHT;
+		test_reset(data);
+		generic->YUV444ToRGB_8u_P3AC4R(planes, steps, data->d1, TEST_STEP, PIXEL_FORMAT_BGRX32,
+		                               &roi);
+		prims->YUV444ToRGB_8u_P3AC4R(planes, steps, data->d2, TEST_STEP, PIXEL_FORMAT_BGRX32,
+		                             &roi);
+
+		if (!test_compare("YUV444ToRGB_8u_P3AC4R", roi.width, data))
+			return FALSE;
+
+		test_reset(data);
+		generic->YUV420ToRGB_8u_P3AC4R(planes, steps, data->d1, TEST_STEP, PIXEL_FORMAT_RGBX32,
+		                               &roi);
+		prims->YUV420ToRGB_8u_P3AC4R(planes, steps, data->d2, TEST_STEP, PIXEL_FORMAT_RGBX32,
+		                             &roi);
+
+		if (!test_compare("YUV420ToRGB_8u_P3AC4R", roi.width, data))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+int TestPrimitivesAutotune(int argc, char* argv[])
+{
+	int rc = -1;
+	UINT32 index, count = 0;
+	const primitives_tuning_t* tuning;
+	TEST_AUTOTUNE_DATA* data;
+	primitives_t* prims;
+	prim_test_setup(FALSE);
+	prims = primitives_get();
+	data = (TEST_AUTOTUNE_DATA*) _aligned_malloc(sizeof(TEST_AUTOTUNE_DATA), 32);
+
+	if (!data)
+		return -1;
+
+	winpr_RAND((BYTE*) data, sizeof(TEST_AUTOTUNE_DATA));
+
+	for (index = 0; index < TEST_MAX_WIDTH * TEST_HEIGHT; index++)
+	{
+		/* RemoteFX coefficients are 11.5 fixed point */
+		data->coeffs[0][index] = (INT16)((data->coeffs[0][index] & 0x1FFF) - 0x1000);
+		data->coeffs[1][index] = (INT16)((data->coeffs[1][index] & 0x1FFF) - 0x1000);
+		data->coeffs[2][index] = (INT16)((data->coeffs[2][index] & 0x1FFF) - 0x1000);
+	}
+
+	printf("AVX2 %s\n", IsProcessorFeaturePresentEx(PF_EX_AVX2) ? "available" : "not available");
+
+	if (!test_autotune_exact(prims, data))
+		goto fail;
+
+	/* the AVX2 YUV kernels are exact, the SSSE3 ones are not */
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2) && !test_autotune_yuv(prims, data))
+		goto fail;
+
+	if (!primitives_autotune())
+		goto fail;
+
+	if (!(tuning = primitives_get_tuning(&count)) || (count == 0))
+		goto fail;
+
+	for (index = 0; index < count; index++)
+	{
+		int impl;
+		printf("%-24s %-10s", tuning[index].name, primitives_impl_name(tuning[index].selected));
+
+		for (impl = 0; impl < PRIMITIVES_IMPL_COUNT; impl++)
+		{
+			if (tuning[index].nanoseconds[impl] > 0)
+				printf(" %s: %"PRIu64" ns", primitives_impl_name((primitives_impl_t) impl),
+				       tuning[index].nanoseconds[impl]);
+		}
+
+		printf("\n");
+
+		if (tuning[index].nanoseconds[tuning[index].selected] == 0)
+		{
+			printf("%s: selected implementation was not measured\n", tuning[index].name);
+			goto fail;
+		}
+	}
+
+	/* whatever was selected still has to produce the generic results */
+	if (!test_autotune_exact(prims, data))
+		goto fail;
+
+	rc = 0;
+fail:
+	_aligned_free(data);
+	return rc;
+}
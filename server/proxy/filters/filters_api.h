@@ -35,6 +35,7 @@ typedef struct connection_info connectionInfo;
 typedef struct proxy_events proxyEvents;
 typedef struct proxy_keyboard_event_info proxyKeyboardEventInfo;
 typedef struct proxy_mouse_event_info proxyMouseEventInfo;
+typedef struct proxy_gfx_pdu_event_info proxyGfxPduEventInfo;
 typedef PF_FILTER_RESULT(*proxyEvent)(connectionInfo* info, void* param);
 
 struct connection_info {
@@ -46,6 +47,7 @@ struct connection_info {
 struct proxy_events {
     proxyEvent KeyboardEvent;
     proxyEvent MouseEvent;
+    proxyEvent GfxPduEvent;
 };
 
 #pragma pack(push, 1)
@@ -59,6 +61,13 @@ struct proxy_mouse_event_info {
     UINT16 x;
     UINT16 y;
 };
+
+/* RDPGFX header of a PDU forwarded in graphics passthrough mode */
+struct proxy_gfx_pdu_event_info {
+    UINT16 cmdId;
+    UINT16 flags;
+    UINT32 pduLength;
+};
 #pragma pack(pop)
 
 /* implement this method and register callbacks for proxy events
@@ -152,6 +152,7 @@ DWORD pf_server_load_config(const char* path, proxyConfig* config)
 	config->TargetPort = (UINT16)rc;
 	/* graphics */
 	config->GFX = IniFile_GetKeyValueInt(ini, "Graphics", "GFX");
+	config->GFXPassthrough = IniFile_GetKeyValueInt(ini, "Graphics", "GFXPassthrough");
 	config->BitmapUpdate = IniFile_GetKeyValueInt(ini, "Graphics", "BitmapUpdate");
 	/* input */
 	config->Keyboard = IniFile_GetKeyValueInt(ini, "Input", "Keyboard");
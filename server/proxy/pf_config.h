@@ -44,6 +44,7 @@ struct proxy_config
 
 	/* graphics */
 	BOOL GFX;
+	BOOL GFXPassthrough;
 	BOOL BitmapUpdate;
 
 	/* input */
@@ -29,6 +29,7 @@
 #include <freerdp/server/rdpgfx.h>
 #include <freerdp/client/disp.h>
 #include <freerdp/server/disp.h>
+#include <freerdp/codec/zgfx.h>
 
 #include "pf_config.h"
 #include "pf_server.h"
@@ -69,6 +70,9 @@ struct p_client_context
 	RdpgfxClientContext* gfx;
 	DispClientContext* disp;
 
+	/* Decompressor for GFX passthrough mode, only used when filters want to see the PDUs */
+	ZGFX_CONTEXT* zgfx;
+
 	/*
 	 * In a case when freerdp_connect fails,
 	 * Used for NLA fallback feature, to check if the server should close the connection.
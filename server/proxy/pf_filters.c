@@ -42,6 +42,7 @@ static const char* EVENT_TYPE_STRINGS[] =
 {
 	"KEYBOARD_EVENT",
 	"MOUSE_EVENT",
+	"GFX_PDU_EVENT",
 };
 
 static const char* pf_filters_get_filter_result_string(PF_FILTER_RESULT result)
@@ -54,7 +55,7 @@ static const char* pf_filters_get_filter_result_string(PF_FILTER_RESULT result)
 
 static const char* pf_filters_get_event_type_string(PF_FILTER_TYPE result)
 {
-	if (result >= FILTER_TYPE_KEYBOARD && result <= FILTER_TYPE_MOUSE)
+	if (result >= FILTER_TYPE_KEYBOARD && result <= FILTER_TYPE_GFX_PDU)
 		return EVENT_TYPE_STRINGS[result];
 	else
 		return "EVENT_UNKNOWN";
@@ -104,6 +105,10 @@ PF_FILTER_RESULT pf_filters_run_by_type(filters_list* list, PF_FILTER_TYPE type,
 			case FILTER_TYPE_MOUSE:
 				IFCALLRET(events->MouseEvent, result, info, param);
 				break;
+
+			case FILTER_TYPE_GFX_PDU:
+				IFCALLRET(events->GfxPduEvent, result, info, param);
+				break;
 		}
 
 		if (result != FILTER_PASS)
@@ -119,6 +124,41 @@ PF_FILTER_RESULT pf_filters_run_by_type(filters_list* list, PF_FILTER_TYPE type,
 	return FILTER_PASS;
 }
 
+BOOL pf_filters_has_event(filters_list* list, PF_FILTER_TYPE type)
+{
+	const size_t count = (size_t) ArrayList_Count(list);
+	size_t index;
+
+	for (index = 0; index < count; index++)
+	{
+		proxyFilter* filter = (proxyFilter*) ArrayList_GetItem(list, index);
+		proxyEvents* events = filter->events;
+
+		switch (type)
+		{
+			case FILTER_TYPE_KEYBOARD:
+				if (events->KeyboardEvent)
+					return TRUE;
+
+				break;
+
+			case FILTER_TYPE_MOUSE:
+				if (events->MouseEvent)
+					return TRUE;
+
+				break;
+
+			case FILTER_TYPE_GFX_PDU:
+				if (events->GfxPduEvent)
+					return TRUE;
+
+				break;
+		}
+	}
+
+	return FALSE;
+}
+
 static void pf_filters_filter_free(proxyFilter* filter)
 {
 	if (!filter)
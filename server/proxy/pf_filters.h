@@ -37,7 +37,8 @@ typedef enum _PF_FILTER_TYPE PF_FILTER_TYPE;
 enum _PF_FILTER_TYPE
 {
 	FILTER_TYPE_KEYBOARD,
-	FILTER_TYPE_MOUSE
+	FILTER_TYPE_MOUSE,
+	FILTER_TYPE_GFX_PDU
 };
 
 struct proxy_filter
@@ -55,6 +56,7 @@ BOOL pf_filters_register_new(filters_list* list, const char* module_path, const
 PF_FILTER_RESULT pf_filters_run_by_type(filters_list* list, PF_FILTER_TYPE type,
                                         connectionInfo* info,
                                         void* param);
+BOOL pf_filters_has_event(filters_list* list, PF_FILTER_TYPE type);
 void pf_filters_unregister_all(filters_list* list);
 
 #define RUN_FILTER(_filters,_type,_conn_info,_event_info,_ret,_cb,...) do { \
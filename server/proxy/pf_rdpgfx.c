@@ -242,6 +242,73 @@ static UINT pf_rdpgfx_caps_confirm(RdpgfxClientContext* context,
 	return server->CapsConfirm(server, capsConfirm);
 }
 
+/**
+ * Runs the GFX PDU filters on a passthrough message. The message is decompressed
+ * with a proxy owned context to keep its history in sync, only the headers are read.
+ */
+static UINT pf_rdpgfx_filter_pdus(proxyData* pdata, const BYTE* data, UINT32 length)
+{
+	int status;
+	wStream s;
+	UINT32 DstSize = 0;
+	BYTE* pDstData = NULL;
+	UINT error = CHANNEL_RC_OK;
+	status = zgfx_decompress(pdata->pc->zgfx, data, length, &pDstData, &DstSize, 0);
+
+	if (status < 0)
+	{
+		WLog_ERR(TAG, "zgfx_decompress failure! status: %d", status);
+		return ERROR_INTERNAL_ERROR;
+	}
+
+	Stream_StaticInit(&s, pDstData, DstSize);
+
+	while (Stream_GetRemainingLength(&s) >= RDPGFX_HEADER_SIZE)
+	{
+		proxyGfxPduEventInfo event;
+		const size_t beg = Stream_GetPosition(&s);
+		Stream_Read_UINT16(&s, event.cmdId); /* cmdId (2 bytes) */
+		Stream_Read_UINT16(&s, event.flags); /* flags (2 bytes) */
+		Stream_Read_UINT32(&s, event.pduLength); /* pduLength (4 bytes) */
+
+		if ((event.pduLength < RDPGFX_HEADER_SIZE) ||
+		    (event.pduLength - RDPGFX_HEADER_SIZE > Stream_GetRemainingLength(&s)))
+		{
+			WLog_ERR(TAG, "invalid pduLength %"PRIu32"", event.pduLength);
+			error = ERROR_INVALID_DATA;
+			break;
+		}
+
+		/* The compressed message can only be forwarded as a whole, FILTER_IGNORE
+		 * therefore has the same effect as FILTER_PASS. */
+		if (pf_filters_run_by_type(pdata->config->Filters, FILTER_TYPE_GFX_PDU, pdata->info,
+		                           &event) == FILTER_DROP)
+		{
+			error = ERROR_INTERNAL_ERROR;
+			break;
+		}
+
+		Stream_SetPosition(&s, beg + event.pduLength);
+	}
+
+	free(pDstData);
+	return error;
+}
+
+static UINT pf_rdpgfx_on_data_received(RdpgfxClientContext* context, wStream* s)
+{
+	UINT error;
+	proxyData* pdata = (proxyData*) context->custom;
+	RdpgfxServerContext* server = (RdpgfxServerContext*) pdata->ps->gfx;
+	const BYTE* data = Stream_Pointer(s);
+	const UINT32 length = (UINT32) Stream_GetRemainingLength(s);
+
+	if (pdata->pc->zgfx && ((error = pf_rdpgfx_filter_pdus(pdata, data, length))))
+		return error;
+
+	return server->SendData(server, data, length);
+}
+
 /* Proxy server side callbacks */
 static UINT pf_rdpgfx_caps_advertise(RdpgfxServerContext* context,
                                      const RDPGFX_CAPS_ADVERTISE_PDU* capsAdvertise)
@@ -332,6 +399,17 @@ void pf_rdpgfx_pipeline_init(RdpgfxClientContext* gfx, RdpgfxServerContext* serv
 	gfx->OnOpen = pf_rdpgfx_on_open;
 	gfx->OnClose = pf_rdpgfx_on_close;
 	gfx->CapsConfirm = pf_rdpgfx_caps_confirm;
+
+	if (pdata->config->GFXPassthrough)
+	{
+		/* Forward the target's messages without decompressing them. The
+		 * proxy only decompresses them itself if filters want to see the PDUs. */
+		gfx->OnDataReceived = pf_rdpgfx_on_data_received;
+
+		if (!pdata->pc->zgfx && pf_filters_has_event(pdata->config->Filters, FILTER_TYPE_GFX_PDU))
+			pdata->pc->zgfx = zgfx_context_new(FALSE);
+	}
+
 	/* Set server callbacks */
 	server->CapsAdvertise = pf_rdpgfx_caps_advertise;
 	server->FrameAcknowledge = pf_rdpgfx_frame_acknowledge;
@@ -761,18 +761,39 @@ static int x11_shadow_error_handler_for_capture(Display* display,
 	return 0;
 }
 
+/* The dirty tile bitmap is reused across frames and only grows on resize */
+static BYTE* x11_shadow_capture_tiles(x11ShadowSubsystem* subsystem, UINT32 width,
+                                      UINT32 height)
+{
+	BYTE* tiles;
+	const size_t size = SHADOW_CAPTURE_TILE_COUNT(width, height);
+
+	if (size <= subsystem->tilesSize)
+		return subsystem->tiles;
+
+	tiles = (BYTE*) realloc(subsystem->tiles, size);
+
+	if (!tiles)
+		return NULL;
+
+	subsystem->tiles = tiles;
+	subsystem->tilesSize = size;
+	return tiles;
+}
+
 static int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
 {
 	int count;
-	int status;
-	int x, y;
-	int width, height;
-	XImage* image;
+	UINT32 status;
+	UINT32 index;
+	UINT32 numRects;
+	XImage* image = NULL;
+	BYTE* tiles;
 	rdpShadowServer* server;
 	rdpShadowSurface* surface;
 	RECTANGLE_16 invalidRect;
 	RECTANGLE_16 surfaceRect;
-	const RECTANGLE_16* extents;
+	const RECTANGLE_16* rects;
 	server = subsystem->common.server;
 	surface = server->surface;
 	count = ArrayList_Count(server->clients);
@@ -784,6 +805,11 @@ static int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
 	surfaceRect.top = 0;
 	surfaceRect.right = surface->width;
 	surfaceRect.bottom = surface->height;
+	tiles = x11_shadow_capture_tiles(subsystem, surface->width, surface->height);
+
+	if (!tiles)
+		return 0;
+
 	XLockDisplay(subsystem->display);
 	/*
 	 * Ignore BadMatch error during image capture. The screen size may be
@@ -796,10 +822,10 @@ static int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
 		image = subsystem->fb_image;
 		XCopyArea(subsystem->display, subsystem->root_window, subsystem->fb_pixmap,
 		          subsystem->xshm_gc, 0, 0, subsystem->width, subsystem->height, 0, 0);
-		status = shadow_capture_compare(surface->data, surface->scanline,
-		                                surface->width, surface->height,
-		                                (BYTE*) & (image->data[surface->width * 4]), image->bytes_per_line,
-		                                &invalidRect);
+		status = shadow_capture_compare_tiles(surface->data, surface->scanline,
+		                                      surface->width, surface->height,
+		                                      (BYTE*) & (image->data[surface->width * 4]), image->bytes_per_line,
+		                                      tiles, &invalidRect);
 	}
 	else
 	{
@@ -815,9 +841,10 @@ static int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
 			goto fail_capture;
 		}
 
-		status = shadow_capture_compare(surface->data, surface->scanline,
-		                                surface->width, surface->height,
-		                                (BYTE*) image->data, image->bytes_per_line, &invalidRect);
+		status = shadow_capture_compare_tiles(surface->data, surface->scanline,
+		                                      surface->width, surface->height,
+		                                      (BYTE*) image->data, image->bytes_per_line,
+		                                      tiles, &invalidRect);
 	}
 
 	/* Restore the default error handler */
@@ -827,24 +854,30 @@ static int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
 
 	if (status)
 	{
-		region16_union_rect(&(surface->invalidRegion), &(surface->invalidRegion),
-		                    &invalidRect);
+		/* Only the dirty tiles are invalidated, not their bounding box */
+		if (!shadow_capture_tiles_to_region(tiles, surface->width, surface->height,
+		                                    &(surface->invalidRegion)))
+			goto fail_capture;
+
 		region16_intersect_rect(&(surface->invalidRegion), &(surface->invalidRegion),
 		                        &surfaceRect);
 
 		if (!region16_is_empty(&(surface->invalidRegion)))
 		{
-			extents = region16_extents(&(surface->invalidRegion));
-			x = extents->left;
-			y = extents->top;
-			width = extents->right - extents->left;
-			height = extents->bottom - extents->top;
-
-			if (!freerdp_image_copy(surface->data, surface->format,
-			                        surface->scanline, x, y, width, height,
-			                        (BYTE*) image->data, PIXEL_FORMAT_BGRX32,
-			                        image->bytes_per_line, x, y, NULL, FREERDP_FLIP_NONE))
-				goto fail_capture;
+			rects = region16_rects(&(surface->invalidRegion), &numRects);
+
+			for (index = 0; index < numRects; index++)
+			{
+				const RECTANGLE_16* rect = &rects[index];
+
+				if (!freerdp_image_copy(surface->data, surface->format,
+				                        surface->scanline, rect->left, rect->top,
+				                        rect->right - rect->left, rect->bottom - rect->top,
+				                        (BYTE*) image->data, PIXEL_FORMAT_BGRX32,
+				                        image->bytes_per_line, rect->left, rect->top, NULL,
+				                        FREERDP_FLIP_NONE))
+					goto fail_capture;
+			}
 
 			//x11_shadow_blend_cursor(subsystem);
 			count = ArrayList_Count(server->clients);
@@ -1387,6 +1420,9 @@ static int x11_shadow_subsystem_uninit(rdpShadowSubsystem* sub)
 		subsystem->cursorPixels = NULL;
 	}
 
+	free(subsystem->tiles);
+	subsystem->tiles = NULL;
+	subsystem->tilesSize = 0;
 	return 1;
 }
 
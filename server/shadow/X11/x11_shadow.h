@@ -80,6 +80,9 @@ struct x11_shadow_subsystem
 	Window root_window;
 	XShmSegmentInfo fb_shm_info;
 
+	BYTE* tiles;
+	size_t tilesSize;
+
 	UINT32 cursorHotX;
 	UINT32 cursorHotY;
 	UINT32 cursorWidth;
@@ -22,6 +22,8 @@
 
 #include <winpr/crt.h>
 #include <winpr/print.h>
+#include <winpr/pool.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/log.h>
 
@@ -79,143 +81,351 @@ int shadow_capture_align_clip_rect(RECTANGLE_16* rect, RECTANGLE_16* clip)
 	return 1;
 }
 
-int shadow_capture_compare(BYTE* pData1, UINT32 nStep1, UINT32 nWidth, UINT32 nHeight,
-                           BYTE* pData2, UINT32 nStep2, RECTANGLE_16* rect)
+static BOOL shadow_capture_tile_equal(const BYTE* pData1, UINT32 nStep1,
+                                      const BYTE* pData2, UINT32 nStep2, UINT32 nHeight)
 {
-	BOOL equal;
-	BOOL allEqual;
-	UINT32 tw, th;
-	UINT32 tx, ty, k;
-	UINT32 nrow, ncol;
-	UINT32 l, t, r, b;
-	BYTE* p1, *p2;
-	BOOL rows[1024];
-#ifdef WITH_DEBUG_SHADOW_CAPTURE
-	BOOL cols[1024];
-#endif
-	allEqual = TRUE;
-	ZeroMemory(rect, sizeof(RECTANGLE_16));
-	FillMemory(rows, sizeof(rows), 0xFF);
-#ifdef WITH_DEBUG_SHADOW_CAPTURE
-	FillMemory(cols, sizeof(cols), 0xFF);
+	UINT32 y;
+
+	for (y = 0; y < nHeight; y++)
+	{
+		if (memcmp(pData1, pData2, SHADOW_CAPTURE_TILE_SIZE * 4) != 0)
+			return FALSE;
+
+		pData1 += nStep1;
+		pData2 += nStep2;
+	}
+
+	return TRUE;
+}
+
+static pfnShadowCaptureTileEqual shadow_capture_tile_equal_fn = shadow_capture_tile_equal;
+static INIT_ONCE shadow_capture_init_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK shadow_capture_init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	WINPR_UNUSED(once);
+	WINPR_UNUSED(param);
+	WINPR_UNUSED(context);
+#if defined(WITH_SSE2)
+	shadow_capture_init_sse2(&shadow_capture_tile_equal_fn);
+#elif defined(WITH_NEON)
+	shadow_capture_init_neon(&shadow_capture_tile_equal_fn);
 #endif
-	nrow = (nHeight + 15) / 16;
-	ncol = (nWidth + 15) / 16;
-	l = ncol + 1;
-	r = 0;
-	t = nrow + 1;
-	b = 0;
+	return TRUE;
+}
 
-	for (ty = 0; ty < nrow; ty++)
+/* Tile rows per stripe below which splitting the frame is not worth it */
+#define SHADOW_CAPTURE_MIN_STRIPE_ROWS	8
+
+struct _SHADOW_CAPTURE_STRIPE
+{
+	const BYTE* pData1;
+	UINT32 nStep1;
+	const BYTE* pData2;
+	UINT32 nStep2;
+	UINT32 nWidth;
+	UINT32 nHeight;
+	UINT32 firstRow;
+	UINT32 lastRow;
+	BYTE* tiles;
+
+	UINT32 count;
+	UINT32 l, t, r, b;
+};
+typedef struct _SHADOW_CAPTURE_STRIPE SHADOW_CAPTURE_STRIPE;
+
+static void shadow_capture_compare_stripe(SHADOW_CAPTURE_STRIPE* stripe)
+{
+	UINT32 tx, ty;
+	const UINT32 nrow = (stripe->nHeight + SHADOW_CAPTURE_TILE_SIZE - 1) / SHADOW_CAPTURE_TILE_SIZE;
+	const UINT32 ncol = (stripe->nWidth + SHADOW_CAPTURE_TILE_SIZE - 1) / SHADOW_CAPTURE_TILE_SIZE;
+	/* the last column may be narrower than a tile, compare it bytewise */
+	const UINT32 fullCols = stripe->nWidth / SHADOW_CAPTURE_TILE_SIZE;
+	const UINT32 lastWidth = stripe->nWidth % SHADOW_CAPTURE_TILE_SIZE;
+	stripe->count = 0;
+	stripe->l = ncol;
+	stripe->t = nrow;
+	stripe->r = 0;
+	stripe->b = 0;
+
+	for (ty = stripe->firstRow; ty < stripe->lastRow; ty++)
 	{
-		th = ((ty + 1) == nrow) ? (nHeight % 16) : 16;
+		const BYTE* p1 = &stripe->pData1[ty * SHADOW_CAPTURE_TILE_SIZE * stripe->nStep1];
+		const BYTE* p2 = &stripe->pData2[ty * SHADOW_CAPTURE_TILE_SIZE * stripe->nStep2];
+		BYTE* tiles = &stripe->tiles[ty * ncol];
+		UINT32 th = stripe->nHeight - (ty * SHADOW_CAPTURE_TILE_SIZE);
 
-		if (!th)
-			th = 16;
+		if (th > SHADOW_CAPTURE_TILE_SIZE)
+			th = SHADOW_CAPTURE_TILE_SIZE;
 
 		for (tx = 0; tx < ncol; tx++)
 		{
-			equal = TRUE;
-			tw = ((tx + 1) == ncol) ? (nWidth % 16) : 16;
-
-			if (!tw)
-				tw = 16;
-
-			p1 = &pData1[(ty * 16 * nStep1) + (tx * 16 * 4)];
-			p2 = &pData2[(ty * 16 * nStep2) + (tx * 16 * 4)];
+			const UINT32 offset = tx * SHADOW_CAPTURE_TILE_SIZE * 4;
+			BOOL equal;
 
-			for (k = 0; k < th; k++)
+			if (tx < fullCols)
 			{
-				if (memcmp(p1, p2, tw * 4) != 0)
+				equal = shadow_capture_tile_equal_fn(&p1[offset], stripe->nStep1,
+				                                     &p2[offset], stripe->nStep2, th);
+			}
+			else
+			{
+				UINT32 k;
+				equal = TRUE;
+
+				for (k = 0; k < th; k++)
 				{
-					equal = FALSE;
-					break;
+					if (memcmp(&p1[offset + (k * stripe->nStep1)],
+					           &p2[offset + (k * stripe->nStep2)], lastWidth * 4) != 0)
+					{
+						equal = FALSE;
+						break;
+					}
 				}
-
-				p1 += nStep1;
-				p2 += nStep2;
 			}
 
-			if (!equal)
-			{
-				rows[ty] = FALSE;
-#ifdef WITH_DEBUG_SHADOW_CAPTURE
-				cols[tx] = FALSE;
-#endif
+			tiles[tx] = equal ? 0 : 1;
 
-				if (l > tx)
-					l = tx;
+			if (equal)
+				continue;
 
-				if (r < tx)
-					r = tx;
-			}
-		}
+			stripe->count++;
 
-		if (!rows[ty])
-		{
-			allEqual = FALSE;
+			if (stripe->l > tx)
+				stripe->l = tx;
+
+			if (stripe->r < tx)
+				stripe->r = tx;
 
-			if (t > ty)
-				t = ty;
+			if (stripe->t > ty)
+				stripe->t = ty;
 
-			if (b < ty)
-				b = ty;
+			stripe->b = ty;
 		}
 	}
+}
 
-	if (allEqual)
-		return 0;
+static void CALLBACK shadow_capture_compare_work_callback(PTP_CALLBACK_INSTANCE instance,
+        void* context, PTP_WORK work)
+{
+	WINPR_UNUSED(instance);
+	WINPR_UNUSED(work);
+	shadow_capture_compare_stripe((SHADOW_CAPTURE_STRIPE*) context);
+}
 
-	rect->left = l * 16;
-	rect->top = t * 16;
-	rect->right = (r + 1) * 16;
-	rect->bottom = (b + 1) * 16;
+static UINT32 shadow_capture_stripe_count(UINT32 nrow)
+{
+	SYSTEM_INFO sysInfo;
+	UINT32 count = nrow / SHADOW_CAPTURE_MIN_STRIPE_ROWS;
+	GetNativeSystemInfo(&sysInfo);
 
-	if (rect->right > nWidth)
-		rect->right = nWidth;
+	if (count > sysInfo.dwNumberOfProcessors)
+		count = sysInfo.dwNumberOfProcessors;
 
-	if (rect->bottom > nHeight)
-		rect->bottom = nHeight;
+	return (count > 0) ? count : 1;
+}
 
-#ifdef WITH_DEBUG_SHADOW_CAPTURE
-	size_t size = ncol + 1;
-	char* col_str = calloc(size, sizeof(char));
+/**
+ * Compares two frames on a grid of SHADOW_CAPTURE_TILE_SIZE tiles.
+ *
+ * tiles must hold SHADOW_CAPTURE_TILE_COUNT(nWidth, nHeight) bytes and is set
+ * to 1 for every tile that differs, row by row. Large frames are split into
+ * stripes of tile rows that are compared on the thread pool. rect receives
+ * the bounding box of all dirty tiles.
+ *
+ * @return the number of dirty tiles
+ */
+UINT32 shadow_capture_compare_tiles(const BYTE* pData1, UINT32 nStep1, UINT32 nWidth,
+                                    UINT32 nHeight, const BYTE* pData2, UINT32 nStep2,
+                                    BYTE* tiles, RECTANGLE_16* rect)
+{
+	UINT32 i;
+	UINT32 count = 0;
+	UINT32 nstripes;
+	UINT32 rowsPerStripe;
+	UINT32 l, t, r, b;
+	PTP_WORK* work = NULL;
+	SHADOW_CAPTURE_STRIPE* stripes;
+	SHADOW_CAPTURE_STRIPE stripe;
+	const UINT32 nrow = (nHeight + SHADOW_CAPTURE_TILE_SIZE - 1) / SHADOW_CAPTURE_TILE_SIZE;
+	const UINT32 ncol = (nWidth + SHADOW_CAPTURE_TILE_SIZE - 1) / SHADOW_CAPTURE_TILE_SIZE;
 
-	if (!col_str)
+	if (!pData1 || !pData2 || !tiles || !rect)
+		return 0;
+
+	InitOnceExecuteOnce(&shadow_capture_init_once, shadow_capture_init, NULL, NULL);
+	ZeroMemory(rect, sizeof(RECTANGLE_16));
+	stripe.pData1 = pData1;
+	stripe.nStep1 = nStep1;
+	stripe.pData2 = pData2;
+	stripe.nStep2 = nStep2;
+	stripe.nWidth = nWidth;
+	stripe.nHeight = nHeight;
+	stripe.tiles = tiles;
+	stripe.firstRow = 0;
+	stripe.lastRow = nrow;
+	nstripes = shadow_capture_stripe_count(nrow);
+	stripes = (nstripes > 1) ? (SHADOW_CAPTURE_STRIPE*) calloc(nstripes,
+	          sizeof(SHADOW_CAPTURE_STRIPE)) : NULL;
+
+	if (stripes)
+		work = (PTP_WORK*) calloc(nstripes, sizeof(PTP_WORK));
+
+	if (!work)
 	{
-		WLog_ERR(TAG, "calloc failed!");
-		return 1;
+		/* single threaded, also the fallback if we're out of memory */
+		free(stripes);
+		stripes = &stripe;
+		nstripes = 1;
+		shadow_capture_compare_stripe(&stripe);
 	}
+	else
+	{
+		rowsPerStripe = (nrow + nstripes - 1) / nstripes;
+
+		for (i = 0; i < nstripes; i++)
+		{
+			stripes[i] = stripe;
+			stripes[i].firstRow = MIN(i * rowsPerStripe, nrow);
+			stripes[i].lastRow = MIN((i + 1) * rowsPerStripe, nrow);
+			work[i] = CreateThreadpoolWork(shadow_capture_compare_work_callback,
+			                               (void*) &stripes[i], NULL);
+
+			if (work[i])
+				SubmitThreadpoolWork(work[i]);
+			else
+				shadow_capture_compare_stripe(&stripes[i]);
+		}
+
+		for (i = 0; i < nstripes; i++)
+		{
+			if (!work[i])
+				continue;
 
-	for (tx = 0; tx < ncol; tx++)
-		sprintf_s(&col_str[tx], size - tx, "-");
+			WaitForThreadpoolWorkCallbacks(work[i], FALSE);
+			CloseThreadpoolWork(work[i]);
+		}
 
-	WLog_INFO(TAG, "%s", col_str);
+		free(work);
+	}
 
-	for (tx = 0; tx < ncol; tx++)
-		sprintf_s(&col_str[tx], size - tx, "%c", cols[tx] ? 'O' : 'X');
+	l = ncol;
+	t = nrow;
+	r = 0;
+	b = 0;
 
-	WLog_INFO(TAG, "%s", col_str);
+	for (i = 0; i < nstripes; i++)
+	{
+		if (!stripes[i].count)
+			continue;
+
+		count += stripes[i].count;
+		l = MIN(l, stripes[i].l);
+		t = MIN(t, stripes[i].t);
+		r = MAX(r, stripes[i].r);
+		b = MAX(b, stripes[i].b);
+	}
 
-	for (tx = 0; tx < ncol; tx++)
-		sprintf_s(&col_str[tx], size - tx, "-");
+	if (stripes != &stripe)
+		free(stripes);
 
-	WLog_INFO(TAG, "%s", col_str);
+	if (!count)
+		return 0;
+
+	rect->left = l * SHADOW_CAPTURE_TILE_SIZE;
+	rect->top = t * SHADOW_CAPTURE_TILE_SIZE;
+	rect->right = MIN((r + 1) * SHADOW_CAPTURE_TILE_SIZE, nWidth);
+	rect->bottom = MIN((b + 1) * SHADOW_CAPTURE_TILE_SIZE, nHeight);
+	return count;
+}
+
+/**
+ * Adds the dirty tiles of a shadow_capture_compare_tiles bitmap to region,
+ * merging horizontally adjacent tiles.
+ */
+BOOL shadow_capture_tiles_to_region(const BYTE* tiles, UINT32 nWidth, UINT32 nHeight,
+                                    REGION16* region)
+{
+	UINT32 tx, ty;
+	RECTANGLE_16 rect;
+	const UINT32 nrow = (nHeight + SHADOW_CAPTURE_TILE_SIZE - 1) / SHADOW_CAPTURE_TILE_SIZE;
+	const UINT32 ncol = (nWidth + SHADOW_CAPTURE_TILE_SIZE - 1) / SHADOW_CAPTURE_TILE_SIZE;
+
+	if (!tiles || !region)
+		return FALSE;
 
 	for (ty = 0; ty < nrow; ty++)
 	{
+		const BYTE* row = &tiles[ty * ncol];
+		rect.top = ty * SHADOW_CAPTURE_TILE_SIZE;
+		rect.bottom = MIN(rect.top + SHADOW_CAPTURE_TILE_SIZE, nHeight);
+
 		for (tx = 0; tx < ncol; tx++)
-			sprintf_s(&col_str[tx], size - tx, "%c", cols[tx] ? 'O' : 'X');
+		{
+			UINT32 end;
+
+			if (!row[tx])
+				continue;
+
+			for (end = tx + 1; (end < ncol) && row[end]; end++);
+
+			rect.left = tx * SHADOW_CAPTURE_TILE_SIZE;
+			rect.right = MIN(end * SHADOW_CAPTURE_TILE_SIZE, nWidth);
+
+			if (!region16_union_rect(region, region, &rect))
+				return FALSE;
 
-		WLog_INFO(TAG, "%s", col_str);
-		WLog_INFO(TAG, "|%s|", rows[ty] ? "O" : "X");
+			tx = end;
+		}
+	}
+
+	return TRUE;
+}
+
+int shadow_capture_compare(BYTE* pData1, UINT32 nStep1, UINT32 nWidth, UINT32 nHeight,
+                           BYTE* pData2, UINT32 nStep2, RECTANGLE_16* rect)
+{
+	UINT32 count;
+	BYTE* tiles = (BYTE*) calloc(SHADOW_CAPTURE_TILE_COUNT(nWidth, nHeight) + 1, 1);
+
+	if (!tiles)
+	{
+		WLog_ERR(TAG, "calloc failed!");
+		return 0;
+	}
+
+	count = shadow_capture_compare_tiles(pData1, nStep1, nWidth, nHeight, pData2, nStep2,
+	                                     tiles, rect);
+#ifdef WITH_DEBUG_SHADOW_CAPTURE
+
+	if (count)
+	{
+		UINT32 tx, ty;
+		const UINT32 nrow = (nHeight + SHADOW_CAPTURE_TILE_SIZE - 1) / SHADOW_CAPTURE_TILE_SIZE;
+		const UINT32 ncol = (nWidth + SHADOW_CAPTURE_TILE_SIZE - 1) / SHADOW_CAPTURE_TILE_SIZE;
+		char* row_str = calloc(ncol + 1, sizeof(char));
+
+		if (row_str)
+		{
+			for (ty = 0; ty < nrow; ty++)
+			{
+				for (tx = 0; tx < ncol; tx++)
+					row_str[tx] = tiles[(ty * ncol) + tx] ? 'X' : 'O';
+
+				WLog_INFO(TAG, "|%s|", row_str);
+			}
+
+			free(row_str);
+		}
+
+		WLog_INFO(TAG, "left: %"PRIu16" top: %"PRIu16" right: %"PRIu16" bottom: %"PRIu16
+		          " ncol: %"PRIu32" nrow: %"PRIu32" dirty: %"PRIu32"",
+		          rect->left, rect->top, rect->right, rect->bottom, ncol, nrow, count);
 	}
 
-	WLog_INFO(TAG, "left: %d top: %d right: %d bottom: %d ncol: %d nrow: %d",
-	          l, t, r, b, ncol, nrow);
-	free(col_str);
 #endif
-	return 1;
+	free(tiles);
+	return count ? 1 : 0;
 }
 
 rdpShadowCapture* shadow_capture_new(rdpShadowServer* server)
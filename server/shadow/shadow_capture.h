@@ -34,10 +34,17 @@ struct rdp_shadow_capture
 	CRITICAL_SECTION lock;
 };
 
+/* Compares one full SHADOW_CAPTURE_TILE_SIZE pixels wide 32bpp tile column */
+typedef BOOL (*pfnShadowCaptureTileEqual)(const BYTE* pData1, UINT32 nStep1,
+        const BYTE* pData2, UINT32 nStep2, UINT32 nHeight);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+void shadow_capture_init_sse2(pfnShadowCaptureTileEqual* tileEqual);
+void shadow_capture_init_neon(pfnShadowCaptureTileEqual* tileEqual);
+
 rdpShadowCapture* shadow_capture_new(rdpShadowServer* server);
 void shadow_capture_free(rdpShadowCapture* capture);
 
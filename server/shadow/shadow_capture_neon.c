@@ -0,0 +1,63 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Shadow Server Tile Comparison - NEON Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+
+#include "shadow_capture.h"
+
+#if defined(WITH_NEON)
+
+#include <arm_neon.h>
+
+static BOOL shadow_capture_tile_equal_neon(const BYTE* pData1, UINT32 nStep1,
+        const BYTE* pData2, UINT32 nStep2, UINT32 nHeight)
+{
+	UINT32 y;
+
+	for (y = 0; y < nHeight; y++)
+	{
+		uint8x16_t diff;
+		uint32x2_t fold;
+		diff = veorq_u8(vld1q_u8(&pData1[0]), vld1q_u8(&pData2[0]));
+		diff = vorrq_u8(diff, veorq_u8(vld1q_u8(&pData1[16]), vld1q_u8(&pData2[16])));
+		diff = vorrq_u8(diff, veorq_u8(vld1q_u8(&pData1[32]), vld1q_u8(&pData2[32])));
+		diff = vorrq_u8(diff, veorq_u8(vld1q_u8(&pData1[48]), vld1q_u8(&pData2[48])));
+		fold = vreinterpret_u32_u8(vorr_u8(vget_low_u8(diff), vget_high_u8(diff)));
+
+		if ((vget_lane_u32(fold, 0) | vget_lane_u32(fold, 1)) != 0)
+			return FALSE;
+
+		pData1 += nStep1;
+		pData2 += nStep2;
+	}
+
+	return TRUE;
+}
+
+void shadow_capture_init_neon(pfnShadowCaptureTileEqual* tileEqual)
+{
+	if (!IsProcessorFeaturePresent(PF_ARM_NEON_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	*tileEqual = shadow_capture_tile_equal_neon;
+}
+
+#endif /* WITH_NEON */
@@ -0,0 +1,64 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Shadow Server Tile Comparison - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+
+#include "shadow_capture.h"
+
+#if defined(WITH_SSE2)
+
+#include <emmintrin.h>
+
+static BOOL shadow_capture_tile_equal_sse2(const BYTE* pData1, UINT32 nStep1,
+        const BYTE* pData2, UINT32 nStep2, UINT32 nHeight)
+{
+	UINT32 y;
+	const __m128i zero = _mm_setzero_si128();
+
+	for (y = 0; y < nHeight; y++)
+	{
+		const __m128i* p1 = (const __m128i*) pData1;
+		const __m128i* p2 = (const __m128i*) pData2;
+		__m128i diff;
+		diff = _mm_xor_si128(_mm_loadu_si128(&p1[0]), _mm_loadu_si128(&p2[0]));
+		diff = _mm_or_si128(diff, _mm_xor_si128(_mm_loadu_si128(&p1[1]), _mm_loadu_si128(&p2[1])));
+		diff = _mm_or_si128(diff, _mm_xor_si128(_mm_loadu_si128(&p1[2]), _mm_loadu_si128(&p2[2])));
+		diff = _mm_or_si128(diff, _mm_xor_si128(_mm_loadu_si128(&p1[3]), _mm_loadu_si128(&p2[3])));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, zero)) != 0xFFFF)
+			return FALSE;
+
+		pData1 += nStep1;
+		pData2 += nStep2;
+	}
+
+	return TRUE;
+}
+
+void shadow_capture_init_sse2(pfnShadowCaptureTileEqual* tileEqual)
+{
+	if (!IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	*tileEqual = shadow_capture_tile_equal_sse2;
+}
+
+#endif /* WITH_SSE2 */
@@ -144,6 +144,7 @@ static BOOL shadow_client_context_new(freerdp_peer* peer,
 	settings->SurfaceFrameMarkerEnabled = TRUE;
 	settings->SupportGraphicsPipeline = TRUE;
 	settings->GfxH264 = FALSE;
+	settings->GfxProgressive = TRUE;
 	settings->DrawAllowSkipAlpha = TRUE;
 	settings->DrawAllowColorSubsampling = TRUE;
 	settings->DrawAllowDynamicColorFidelity = TRUE;
@@ -794,6 +795,22 @@ static INLINE UINT32 rdpgfx_estimate_h264_avc420(
 	       + havc420->length;
 }
 
+/**
+ * Function description
+ * Feed the H264 rate control with the network state of the client
+ */
+static INLINE void shadow_client_h264_rate_control(rdpShadowClient* client)
+{
+	rdpContext* context = (rdpContext*) client;
+	rdpShadowEncoder* encoder = client->encoder;
+
+	if (context->autodetect)
+		h264_context_update_network(encoder->h264, context->autodetect->netCharBandwidth,
+		                            context->autodetect->netCharAverageRTT);
+
+	h264_context_update_queue_depth(encoder->h264, shadow_encoder_inflight_frames(encoder));
+}
+
 /**
  * Function description
  *
@@ -852,6 +869,8 @@ static BOOL shadow_client_send_surface_gfx(rdpShadowClient* client,
 			return FALSE;
 		}
 
+		shadow_client_h264_rate_control(client);
+
 		if (avc444_compress(encoder->h264, pSrcData, cmd.format, nSrcStep,
 		                    nWidth, nHeight, version, &avc444.LC, &avc444.bitstream[0].data,
 		                    &avc444.bitstream[0].length, &avc444.bitstream[1].data,
@@ -899,6 +918,8 @@ static BOOL shadow_client_send_surface_gfx(rdpShadowClient* client,
 			return FALSE;
 		}
 
+		shadow_client_h264_rate_control(client);
+
 		if (avc420_compress(encoder->h264, pSrcData, cmd.format, nSrcStep,
 		                    nWidth, nHeight, &avc420.data, &avc420.length) < 0)
 		{
@@ -932,6 +953,226 @@ static BOOL shadow_client_send_surface_gfx(rdpShadowClient* client,
 	return TRUE;
 }
 
+/**
+ * Function description
+ *
+ * Sends the first progressive pass for the tiles in invalidRegion or, if
+ * invalidRegion is NULL, the next quality upgrade of all pending tiles.
+ *
+ * @return TRUE on success
+ */
+static BOOL shadow_client_send_surface_progressive(rdpShadowClient* client,
+        const BYTE* pSrcData, int nSrcStep, int nXOffset, int nYOffset,
+        const REGION16* invalidRegion)
+{
+	int status;
+	UINT32 index;
+	UINT32 numRects = 0;
+	UINT32 length = 0;
+	BYTE* pData = NULL;
+	UINT error = CHANNEL_RC_OK;
+	rdpContext* context = (rdpContext*) client;
+	rdpSettings* settings;
+	rdpShadowEncoder* encoder;
+	RDPGFX_SURFACE_COMMAND cmd = { 0 };
+	RDPGFX_START_FRAME_PDU cmdstart;
+	RDPGFX_END_FRAME_PDU cmdend;
+	REGION16 region;
+	RECTANGLE_16 rect;
+	const RECTANGLE_16* rects;
+	SYSTEMTIME sTime;
+
+	if (!context)
+		return FALSE;
+
+	settings = context->settings;
+	encoder = client->encoder;
+
+	if (!settings || !encoder)
+		return FALSE;
+
+	if (shadow_encoder_prepare(encoder, FREERDP_CODEC_PROGRESSIVE) < 0)
+	{
+		WLog_ERR(TAG, "Failed to prepare encoder FREERDP_CODEC_PROGRESSIVE");
+		return FALSE;
+	}
+
+	if (invalidRegion)
+	{
+		if (!pSrcData)
+			return FALSE;
+
+		/* The gfx surface origin is the top left corner of the shared rect */
+		region16_init(&region);
+		rects = region16_rects(invalidRegion, &numRects);
+
+		for (index = 0; index < numRects; index++)
+		{
+			rect.left = rects[index].left - nXOffset;
+			rect.top = rects[index].top - nYOffset;
+			rect.right = rects[index].right - nXOffset;
+			rect.bottom = rects[index].bottom - nYOffset;
+			region16_union_rect(&region, &region, &rect);
+		}
+
+		status = progressive_compress(encoder->progressive, pSrcData,
+		                              nSrcStep * settings->DesktopHeight, PIXEL_FORMAT_BGRX32,
+		                              settings->DesktopWidth, settings->DesktopHeight, nSrcStep,
+		                              &region, 0, &pData, &length);
+		region16_uninit(&region);
+	}
+	else
+	{
+		status = progressive_compress_upgrade(encoder->progressive, 0, &pData, &length);
+	}
+
+	if (status < 0)
+	{
+		WLog_ERR(TAG, "progressive_compress failed");
+		return FALSE;
+	}
+
+	/* No tile needs to be sent */
+	if (length == 0)
+		return TRUE;
+
+	cmdstart.frameId = shadow_encoder_create_frame_id(encoder);
+	GetSystemTime(&sTime);
+	cmdstart.timestamp = sTime.wHour << 22 | sTime.wMinute << 16 |
+	                     sTime.wSecond << 10 | sTime.wMilliseconds;
+	cmdend.frameId = cmdstart.frameId;
+	cmd.surfaceId = 0;
+	cmd.codecId = RDPGFX_CODECID_CAPROGRESSIVE;
+	cmd.contextId = 0;
+	cmd.format = PIXEL_FORMAT_BGRX32;
+	cmd.left = 0;
+	cmd.top = 0;
+	cmd.right = settings->DesktopWidth;
+	cmd.bottom = settings->DesktopHeight;
+	cmd.width = settings->DesktopWidth;
+	cmd.height = settings->DesktopHeight;
+	cmd.length = length;
+	cmd.data = pData;
+	cmd.extra = NULL;
+	IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, &cmd,
+	          &cmdstart, &cmdend);
+
+	if (error)
+	{
+		WLog_ERR(TAG, "SurfaceFrameCommand failed with error %"PRIu32"", error);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Function description
+ *
+ * Refines the progressively encoded gfx surface while the client keeps up
+ * with the frames sent so far.
+ *
+ * @return TRUE on success
+ */
+static BOOL shadow_client_send_surface_upgrade(rdpShadowClient* client,
+        SHADOW_GFX_STATUS* pStatus)
+{
+	rdpContext* context = (rdpContext*) client;
+	rdpSettings* settings = context->settings;
+	rdpShadowEncoder* encoder = client->encoder;
+
+	if (!pStatus->gfxSurfaceCreated || settings->GfxH264 || !encoder->progressive)
+		return TRUE;
+
+	if (!client->activated || client->suppressOutput)
+		return TRUE;
+
+	/* Bandwidth pressure: keep the coarse passes until frames are acknowledged */
+	if (shadow_encoder_inflight_frames(encoder) > 1)
+		return TRUE;
+
+	if (!progressive_compress_pending(encoder->progressive, 0))
+		return TRUE;
+
+	return shadow_client_send_surface_progressive(client, NULL, 0, 0, 0, NULL);
+}
+
+static BOOL shadow_client_encode_rfx(rdpShadowClient* client, rdpShadowEncoded* encoded,
+                                     BYTE* pSrcData, int nSrcStep, int nXSrc, int nYSrc, int nWidth, int nHeight)
+{
+	int i;
+	BOOL ret = TRUE;
+	RFX_RECT rect;
+	int numMessages;
+	RFX_MESSAGE* messages;
+	RFX_RECT* messageRects = NULL;
+	rdpSettings* settings = ((rdpContext*) client)->settings;
+	rdpShadowEncoder* encoder = client->encoder;
+	rect.x = nXSrc;
+	rect.y = nYSrc;
+	rect.width = nWidth;
+	rect.height = nHeight;
+
+	if (!(messages = rfx_encode_messages(encoder->rfx, &rect, 1, pSrcData,
+	                                     settings->DesktopWidth, settings->DesktopHeight, nSrcStep, &numMessages,
+	                                     settings->MultifragMaxRequestSize)))
+	{
+		WLog_ERR(TAG, "rfx_encode_messages failed");
+		return FALSE;
+	}
+
+	if (numMessages > 0)
+		messageRects = messages[0].rects;
+
+	for (i = 0; i < numMessages; i++)
+	{
+		wStream* s = NULL;
+
+		if (ret)
+			s = shadow_encoded_add_block(encoded, 4096);
+
+		if (!s || !rfx_write_message(encoder->rfx, s, &messages[i]))
+		{
+			if (ret)
+				WLog_ERR(TAG, "rfx_write_message failed");
+
+			ret = FALSE;
+		}
+
+		rfx_message_free(encoder->rfx, &messages[i]);
+	}
+
+	free(messageRects);
+	free(messages);
+	return ret;
+}
+
+/**
+ * Returns the cache shared with the other clients, if there are any.
+ */
+static rdpShadowEncodeCache* shadow_client_encode_cache(rdpShadowClient* client)
+{
+	if (!client->subsystem || (ArrayList_Count(client->server->clients) < 2))
+		return NULL;
+
+	return client->subsystem->encodeCache;
+}
+
+static rdpShadowEncoded* shadow_client_acquire_encoded(rdpShadowClient* client, BOOL shared,
+        const SHADOW_ENCODE_KEY* key, BOOL* owner)
+{
+	rdpShadowEncoded* encoded = NULL;
+
+	if (shared)
+		encoded = shadow_encode_cache_acquire(shadow_client_encode_cache(client), key, owner);
+
+	/* Not shareable, or whoever encoded it for us failed: do it ourselves */
+	if (!encoded)
+		encoded = shadow_encode_cache_acquire(NULL, key, owner);
+
+	return encoded;
+}
+
 /**
  * Function description
  *
@@ -941,16 +1182,18 @@ static BOOL shadow_client_send_surface_bits(rdpShadowClient* client,
         BYTE* pSrcData, int nSrcStep, int nXSrc, int nYSrc, int nWidth, int nHeight)
 {
 	BOOL ret = TRUE;
-	int i;
-	BOOL first;
-	BOOL last;
+	BOOL owner;
+	BOOL shared;
+	UINT32 i;
+	UINT32 count;
 	wStream* s;
-	int numMessages;
 	UINT32 frameId = 0;
 	rdpUpdate* update;
 	rdpContext* context = (rdpContext*) client;
 	rdpSettings* settings;
 	rdpShadowEncoder* encoder;
+	rdpShadowEncoded* encoded;
+	SHADOW_ENCODE_KEY key = { 0 };
 	SURFACE_BITS_COMMAND cmd = { 0 };
 
 	if (!context || !pSrcData)
@@ -966,30 +1209,37 @@ static BOOL shadow_client_send_surface_bits(rdpShadowClient* client,
 	if (encoder->frameAck)
 		frameId = shadow_encoder_create_frame_id(encoder);
 
+	key.data = pSrcData;
+	key.step = nSrcStep;
+	key.x = nXSrc;
+	key.y = nYSrc;
+	key.width = nWidth;
+	key.height = nHeight;
+
 	if (settings->RemoteFxCodec)
 	{
-		RFX_RECT rect;
-		RFX_MESSAGE* messages;
-		RFX_RECT* messageRects = NULL;
-
 		if (shadow_encoder_prepare(encoder, FREERDP_CODEC_REMOTEFX) < 0)
 		{
 			WLog_ERR(TAG, "Failed to prepare encoder FREERDP_CODEC_REMOTEFX");
 			return FALSE;
 		}
 
-		s = encoder->bs;
-		rect.x = nXSrc;
-		rect.y = nYSrc;
-		rect.width = nWidth;
-		rect.height = nHeight;
+		key.codec = FREERDP_CODEC_REMOTEFX;
+		key.params[0] = settings->DesktopWidth;
+		key.params[1] = settings->DesktopHeight;
+		key.params[2] = settings->MultifragMaxRequestSize;
+		key.params[3] = encoder->rfx->mode;
+		/* The codec headers go out once per connection, only later frames can be shared */
+		shared = (encoder->rfx->state != RFX_STATE_SEND_HEADERS);
 
-		if (!(messages = rfx_encode_messages(encoder->rfx, &rect, 1, pSrcData,
-		                                     settings->DesktopWidth, settings->DesktopHeight, nSrcStep, &numMessages,
-		                                     settings->MultifragMaxRequestSize)))
-		{
-			WLog_ERR(TAG, "rfx_encode_messages failed");
+		if (!(encoded = shadow_client_acquire_encoded(client, shared, &key, &owner)))
 			return FALSE;
+
+		if (owner)
+		{
+			ret = shadow_client_encode_rfx(client, encoded, pSrcData, nSrcStep, nXSrc, nYSrc,
+			                               nWidth, nHeight);
+			shadow_encode_cache_publish(encoded, ret);
 		}
 
 		cmd.bmp.codecID = settings->RemoteFxCodecId;
@@ -1002,47 +1252,6 @@ static BOOL shadow_client_send_surface_bits(rdpShadowClient* client,
 		cmd.bmp.width = settings->DesktopWidth;
 		cmd.bmp.height = settings->DesktopHeight;
 		cmd.skipCompression = TRUE;
-
-		if (numMessages > 0)
-			messageRects = messages[0].rects;
-
-		for (i = 0; i < numMessages; i++)
-		{
-			Stream_SetPosition(s, 0);
-
-			if (!rfx_write_message(encoder->rfx, s, &messages[i]))
-			{
-				while (i < numMessages)
-				{
-					rfx_message_free(encoder->rfx, &messages[i++]);
-				}
-
-				WLog_ERR(TAG, "rfx_write_message failed");
-				ret = FALSE;
-				break;
-			}
-
-			rfx_message_free(encoder->rfx, &messages[i]);
-			cmd.bmp.bitmapDataLength = Stream_GetPosition(s);
-			cmd.bmp.bitmapData = Stream_Buffer(s);
-			first = (i == 0) ? TRUE : FALSE;
-			last = ((i + 1) == numMessages) ? TRUE : FALSE;
-
-			if (!encoder->frameAck)
-				IFCALLRET(update->SurfaceBits, ret, update->context, &cmd);
-			else
-				IFCALLRET(update->SurfaceFrameBits, ret, update->context, &cmd, first, last,
-				          frameId);
-
-			if (!ret)
-			{
-				WLog_ERR(TAG, "Send surface bits(RemoteFxCodec) failed");
-				break;
-			}
-		}
-
-		free(messageRects);
-		free(messages);
 	}
 	else if (settings->NSCodec)
 	{
@@ -1052,10 +1261,26 @@ static BOOL shadow_client_send_surface_bits(rdpShadowClient* client,
 			return FALSE;
 		}
 
-		s = encoder->bs;
-		Stream_SetPosition(s, 0);
-		pSrcData = &pSrcData[(nYSrc * nSrcStep) + (nXSrc * 4)];
-		nsc_compose_message(encoder->nsc, s, pSrcData, nWidth, nHeight, nSrcStep);
+		key.codec = FREERDP_CODEC_NSCODEC;
+		key.params[0] = encoder->nsc->ColorLossLevel;
+		key.params[1] = encoder->nsc->ChromaSubsamplingLevel;
+		key.params[2] = encoder->nsc->DynamicColorFidelity;
+
+		if (!(encoded = shadow_client_acquire_encoded(client, TRUE, &key, &owner)))
+			return FALSE;
+
+		if (owner)
+		{
+			pSrcData = &pSrcData[(nYSrc * nSrcStep) + (nXSrc * 4)];
+
+			if (!(s = shadow_encoded_add_block(encoded, Stream_Capacity(encoder->bs))))
+				ret = FALSE;
+			else
+				ret = nsc_compose_message(encoder->nsc, s, pSrcData, nWidth, nHeight, nSrcStep);
+
+			shadow_encode_cache_publish(encoded, ret);
+		}
+
 		cmd.bmp.bpp = 32;
 		cmd.bmp.codecID = settings->NSCodecId;
 		cmd.destLeft = nXSrc;
@@ -1064,26 +1289,59 @@ static BOOL shadow_client_send_surface_bits(rdpShadowClient* client,
 		cmd.destBottom = cmd.destTop + nHeight;
 		cmd.bmp.width = nWidth;
 		cmd.bmp.height = nHeight;
+	}
+	else
+		return TRUE;
+
+	count = ret ? shadow_encoded_get_count(encoded) : 0;
+
+	for (i = 0; i < count; i++)
+	{
+		s = shadow_encoded_get_block(encoded, i);
 		cmd.bmp.bitmapDataLength = Stream_GetPosition(s);
 		cmd.bmp.bitmapData = Stream_Buffer(s);
-		first = TRUE;
-		last = TRUE;
 
 		if (!encoder->frameAck)
 			IFCALLRET(update->SurfaceBits, ret, update->context, &cmd);
 		else
-			IFCALLRET(update->SurfaceFrameBits, ret, update->context, &cmd, first, last,
-			          frameId);
+			IFCALLRET(update->SurfaceFrameBits, ret, update->context, &cmd, (i == 0),
+			          ((i + 1) == count), frameId);
 
 		if (!ret)
 		{
-			WLog_ERR(TAG, "Send surface bits(NSCodec) failed");
+			WLog_ERR(TAG, "Send surface bits(%s) failed",
+			         settings->RemoteFxCodec ? "RemoteFxCodec" : "NSCodec");
+			break;
 		}
 	}
 
+	shadow_encoded_release(encoded);
 	return ret;
 }
 
+static BOOL shadow_client_share_bitmap(rdpShadowEncoded* encoded, BOOL owner, size_t index,
+                                       BITMAP_DATA* bitmap)
+{
+	wStream* s;
+
+	if (owner)
+	{
+		if (!bitmap->bitmapDataStream)
+			return FALSE;
+
+		if (!(s = shadow_encoded_add_block(encoded, bitmap->bitmapLength)))
+			return FALSE;
+
+		Stream_Write(s, bitmap->bitmapDataStream, bitmap->bitmapLength);
+	}
+	else if (!(s = shadow_encoded_get_block(encoded, index)))
+		return FALSE;
+
+	bitmap->bitmapDataStream = Stream_Buffer(s);
+	bitmap->bitmapLength = Stream_GetPosition(s);
+	return TRUE;
+}
+
 /**
  * Function description
  *
@@ -1110,6 +1368,9 @@ static BOOL shadow_client_send_bitmap_update(rdpShadowClient* client,
 	BITMAP_DATA* bitmapData;
 	BITMAP_UPDATE bitmapUpdate;
 	rdpShadowEncoder* encoder;
+	rdpShadowEncoded* encoded;
+	SHADOW_ENCODE_KEY key = { 0 };
+	BOOL owner;
 
 	if (!context || !pSrcData)
 		return FALSE;
@@ -1141,6 +1402,18 @@ static BOOL shadow_client_send_bitmap_update(rdpShadowClient* client,
 	}
 
 	SrcFormat = PIXEL_FORMAT_BGRX32;
+	key.data = pSrcData;
+	key.step = nSrcStep;
+	key.codec = (settings->ColorDepth < 32) ? FREERDP_CODEC_INTERLEAVED : FREERDP_CODEC_PLANAR;
+	key.x = nXSrc;
+	key.y = nYSrc;
+	key.width = nWidth;
+	key.height = nHeight;
+	key.params[0] = settings->ColorDepth;
+	key.params[1] = settings->DrawAllowSkipAlpha;
+
+	if (!(encoded = shadow_client_acquire_encoded(client, TRUE, &key, &owner)))
+		return FALSE;
 
 	if ((nXSrc % 4) != 0)
 	{
@@ -1161,7 +1434,13 @@ static BOOL shadow_client_send_bitmap_update(rdpShadowClient* client,
 	bitmapUpdate.count = bitmapUpdate.number = rows * cols;
 
 	if (!(bitmapData = (BITMAP_DATA*) calloc(bitmapUpdate.number, sizeof(BITMAP_DATA))))
+	{
+		if (owner)
+			shadow_encode_cache_publish(encoded, FALSE);
+
+		shadow_encoded_release(encoded);
 		return FALSE;
+	}
 
 	bitmapUpdate.rectangles = bitmapData;
 
@@ -1204,10 +1483,13 @@ static BOOL shadow_client_send_bitmap_update(rdpShadowClient* client,
 				int bytesPerPixel = (bitsPerPixel + 7) / 8;
 				DstSize = 64 * 64 * 4;
 				buffer = encoder->grid[k];
-				interleaved_compress(encoder->interleaved, buffer, &DstSize, bitmap->width,
-				                     bitmap->height,
-				                     pSrcData, SrcFormat, nSrcStep, bitmap->destLeft, bitmap->destTop, NULL,
-				                     bitsPerPixel);
+
+				if (owner)
+					interleaved_compress(encoder->interleaved, buffer, &DstSize, bitmap->width,
+					                     bitmap->height,
+					                     pSrcData, SrcFormat, nSrcStep, bitmap->destLeft, bitmap->destTop, NULL,
+					                     bitsPerPixel);
+
 				bitmap->bitmapDataStream = buffer;
 				bitmap->bitmapLength = DstSize;
 				bitmap->bitsPerPixel = bitsPerPixel;
@@ -1216,11 +1498,14 @@ static BOOL shadow_client_send_bitmap_update(rdpShadowClient* client,
 			}
 			else
 			{
-				UINT32 dstSize;
+				UINT32 dstSize = 0;
 				buffer = encoder->grid[k];
 				data = &pSrcData[(bitmap->destTop * nSrcStep) + (bitmap->destLeft * 4)];
-				buffer = freerdp_bitmap_compress_planar(encoder->planar, data, SrcFormat,
-				                                        bitmap->width, bitmap->height, nSrcStep, buffer, &dstSize);
+
+				if (owner)
+					buffer = freerdp_bitmap_compress_planar(encoder->planar, data, SrcFormat,
+					                                        bitmap->width, bitmap->height, nSrcStep, buffer, &dstSize);
+
 				bitmap->bitmapDataStream = buffer;
 				bitmap->bitmapLength = dstSize;
 				bitmap->bitsPerPixel = 32;
@@ -1228,6 +1513,16 @@ static BOOL shadow_client_send_bitmap_update(rdpShadowClient* client,
 				bitmap->cbUncompressedSize = bitmap->width * bitmap->height * 4;
 			}
 
+			/* The tile layout only depends on the key, so tile k is block k */
+			if (!shadow_client_share_bitmap(encoded, owner, k, bitmap))
+			{
+				if (owner)
+					shadow_encode_cache_publish(encoded, FALSE);
+
+				ret = FALSE;
+				goto out;
+			}
+
 			bitmap->cbCompFirstRowSize = 0;
 			bitmap->cbCompMainBodySize = bitmap->bitmapLength;
 			totalBitmapSize += bitmap->bitmapLength;
@@ -1235,6 +1530,9 @@ static BOOL shadow_client_send_bitmap_update(rdpShadowClient* client,
 		}
 	}
 
+	if (owner)
+		shadow_encode_cache_publish(encoded, TRUE);
+
 	bitmapUpdate.count = bitmapUpdate.number = k;
 	updateSizeEstimate = totalBitmapSize + (k * bitmapUpdate.count) + 16;
 
@@ -1299,6 +1597,7 @@ static BOOL shadow_client_send_bitmap_update(rdpShadowClient* client,
 
 out:
 	free(bitmapData);
+	shadow_encoded_release(encoded);
 	return ret;
 }
 
@@ -1322,6 +1621,8 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client,
 	const RECTANGLE_16* extents;
 	BYTE* pSrcData;
 	int nSrcStep;
+	int subX = 0;
+	int subY = 0;
 	UINT32 index;
 	UINT32 numRects = 0;
 	const RECTANGLE_16* rects;
@@ -1380,7 +1681,6 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client,
 	/* Move to new pSrcData / nXSrc / nYSrc according to sub rect */
 	if (server->shareSubRect)
 	{
-		int subX, subY;
 		subX = server->subRect.left;
 		subY = server->subRect.top;
 		nXSrc -= subX;
@@ -1392,17 +1692,13 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client,
 	//	nXSrc, nYSrc, nWidth, nHeight, nXSrc + nWidth, nYSrc + nHeight);
 
 	if (settings->SupportGraphicsPipeline &&
-	    settings->GfxH264 &&
+	    (settings->GfxH264 || settings->GfxProgressive) &&
 	    pStatus->gfxOpened)
 	{
-		/* GFX/h264 always full screen encoded */
-		nWidth = settings->DesktopWidth;
-		nHeight = settings->DesktopHeight;
-
 		/* Create primary surface if have not */
 		if (!pStatus->gfxSurfaceCreated)
 		{
-			/* Only init surface when we have h264 supported */
+			/* Only init surface when we have h264 or progressive supported */
 			if (!(ret = shadow_client_rdpgfx_reset_graphic(client)))
 				goto out;
 
@@ -1410,10 +1706,31 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client,
 				goto out;
 
 			pStatus->gfxSurfaceCreated = TRUE;
+
+			/* A new surface has no tiles, start progressive refinement over */
+			if (client->encoder->progressive)
+				progressive_delete_surface_context(client->encoder->progressive, 0);
+
+			surfaceRect.left = subX;
+			surfaceRect.top = subY;
+			surfaceRect.right = subX + settings->DesktopWidth;
+			surfaceRect.bottom = subY + settings->DesktopHeight;
+			region16_union_rect(&invalidRegion, &invalidRegion, &surfaceRect);
 		}
 
-		ret = shadow_client_send_surface_gfx(client, pSrcData, nSrcStep, 0, 0, nWidth,
-		                                     nHeight);
+		if (settings->GfxH264)
+		{
+			/* GFX/h264 always full screen encoded */
+			nWidth = settings->DesktopWidth;
+			nHeight = settings->DesktopHeight;
+			ret = shadow_client_send_surface_gfx(client, pSrcData, nSrcStep, 0, 0, nWidth,
+			                                     nHeight);
+		}
+		else
+		{
+			ret = shadow_client_send_surface_progressive(client, pSrcData, nSrcStep, subX, subY,
+			        &invalidRegion);
+		}
 	}
 	else if (settings->RemoteFxCodec || settings->NSCodec)
 	{
@@ -1628,6 +1945,8 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 	rdpShadowClient* client = (rdpShadowClient*)arg;
 	DWORD status;
 	DWORD nCount;
+	DWORD dwTimeout;
+	UINT64 lastUpgrade = 0;
 	wMessage message;
 	wMessage pointerPositionMsg;
 	wMessage pointerAlphaMsg;
@@ -1690,7 +2009,14 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 		}
 		events[nCount++] = ChannelEvent;
 		events[nCount++] = MessageQueue_Event(MsgQueue);
-		status = WaitForMultipleObjects(nCount, events, FALSE, INFINITE);
+		dwTimeout = INFINITE;
+
+		/* Wake up to refine progressive tiles even if the screen is idle */
+		if (gfxstatus.gfxSurfaceCreated && client->encoder->progressive &&
+		    progressive_compress_pending(client->encoder->progressive, 0))
+			dwTimeout = 1000 / shadow_encoder_preferred_fps(client->encoder);
+
+		status = WaitForMultipleObjects(nCount, events, FALSE, dwTimeout);
 
 		if (status == WAIT_FAILED)
 			goto fail;
@@ -1745,6 +2071,18 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 			(void)shadow_multiclient_consume(UpdateSubscriber);
 		}
 
+		if ((dwTimeout != INFINITE) &&
+		    (GetTickCount64() - lastUpgrade >= dwTimeout))
+		{
+			if (!shadow_client_send_surface_upgrade(client, &gfxstatus))
+			{
+				WLog_ERR(TAG, "Failed to send surface upgrade");
+				break;
+			}
+
+			lastUpgrade = GetTickCount64();
+		}
+
 		if (!peer->CheckFileDescriptor(peer))
 		{
 			WLog_ERR(TAG, "Failed to check FreeRDP file descriptor");
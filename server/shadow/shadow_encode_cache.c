@@ -0,0 +1,331 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/interlocked.h>
+#include <winpr/collections.h>
+
+#include <freerdp/log.h>
+
+#include "shadow.h"
+
+#define TAG SERVER_TAG("shadow.encode")
+
+/*
+ * How long a client waits for the owner of an entry. A stalled owner must
+ * not block the other clients, they fall back to encoding on their own.
+ */
+#define SHADOW_ENCODE_CACHE_WAIT_TIMEOUT	1000
+
+struct rdp_shadow_encoded
+{
+	SHADOW_ENCODE_KEY key;
+	LONG refCount;
+	HANDLE ready;
+	BOOL valid;
+
+	UINT32 count;
+	UINT32 capacity;
+	wStream** blocks;
+};
+
+struct rdp_shadow_encode_cache
+{
+	CRITICAL_SECTION lock;
+	wArrayList* entries;
+	UINT32 frame;
+	UINT32 hits;
+	UINT32 misses;
+};
+
+static BOOL shadow_encode_key_equal(const SHADOW_ENCODE_KEY* a, const SHADOW_ENCODE_KEY* b)
+{
+	size_t i;
+
+	if ((a->data != b->data) || (a->step != b->step) || (a->codec != b->codec))
+		return FALSE;
+
+	if ((a->x != b->x) || (a->y != b->y) ||
+	    (a->width != b->width) || (a->height != b->height))
+		return FALSE;
+
+	for (i = 0; i < ARRAYSIZE(a->params); i++)
+	{
+		if (a->params[i] != b->params[i])
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static rdpShadowEncoded* shadow_encoded_new(const SHADOW_ENCODE_KEY* key)
+{
+	rdpShadowEncoded* encoded = (rdpShadowEncoded*) calloc(1, sizeof(rdpShadowEncoded));
+
+	if (!encoded)
+		return NULL;
+
+	encoded->ready = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (!encoded->ready)
+	{
+		free(encoded);
+		return NULL;
+	}
+
+	if (key)
+		encoded->key = *key;
+
+	encoded->refCount = 1;
+	return encoded;
+}
+
+void shadow_encoded_release(rdpShadowEncoded* encoded)
+{
+	UINT32 index;
+
+	if (!encoded)
+		return;
+
+	if (InterlockedDecrement(&encoded->refCount) > 0)
+		return;
+
+	for (index = 0; index < encoded->count; index++)
+		Stream_Free(encoded->blocks[index], TRUE);
+
+	free(encoded->blocks);
+	CloseHandle(encoded->ready);
+	free(encoded);
+}
+
+/**
+ * Appends an empty block of (at least) size bytes. Only the owner of an
+ * entry may add blocks, and only before it is published.
+ */
+wStream* shadow_encoded_add_block(rdpShadowEncoded* encoded, size_t size)
+{
+	wStream* s;
+
+	if (!encoded)
+		return NULL;
+
+	if (encoded->count >= encoded->capacity)
+	{
+		UINT32 capacity = encoded->capacity ? encoded->capacity * 2 : 4;
+		wStream** blocks = (wStream**) realloc(encoded->blocks, capacity * sizeof(wStream*));
+
+		if (!blocks)
+			return NULL;
+
+		encoded->blocks = blocks;
+		encoded->capacity = capacity;
+	}
+
+	if (!(s = Stream_New(NULL, size ? size : 1)))
+		return NULL;
+
+	encoded->blocks[encoded->count++] = s;
+	return s;
+}
+
+UINT32 shadow_encoded_get_count(rdpShadowEncoded* encoded)
+{
+	return encoded ? encoded->count : 0;
+}
+
+wStream* shadow_encoded_get_block(rdpShadowEncoded* encoded, UINT32 index)
+{
+	if (!encoded || (index >= encoded->count))
+		return NULL;
+
+	return encoded->blocks[index];
+}
+
+/**
+ * Looks up the encoded output for key in the current frame.
+ *
+ * If nobody encoded it yet a new entry is returned with *owner set to TRUE;
+ * the caller must fill it and call shadow_encode_cache_publish. Otherwise
+ * this waits for the owner and returns the shared entry, or NULL if the
+ * owner failed or did not publish in time (the caller should encode on its
+ * own then). An entry that timed out is dropped from the cache, so the next
+ * client takes over instead of waiting for the same owner again.
+ *
+ * Without a cache a private entry is returned, so callers can use the same
+ * code path for updates that must not be shared.
+ */
+rdpShadowEncoded* shadow_encode_cache_acquire(rdpShadowEncodeCache* cache,
+        const SHADOW_ENCODE_KEY* key, BOOL* owner)
+{
+	int index;
+	int count;
+	DWORD status;
+	rdpShadowEncoded* encoded = NULL;
+
+	if (!owner)
+		return NULL;
+
+	*owner = TRUE;
+
+	if (!cache || !key)
+		return shadow_encoded_new(key);
+
+	EnterCriticalSection(&cache->lock);
+	count = ArrayList_Count(cache->entries);
+
+	for (index = 0; index < count; index++)
+	{
+		rdpShadowEncoded* cur = (rdpShadowEncoded*) ArrayList_GetItem(cache->entries, index);
+
+		if (shadow_encode_key_equal(&cur->key, key))
+		{
+			encoded = cur;
+			InterlockedIncrement(&encoded->refCount);
+			*owner = FALSE;
+			cache->hits++;
+			break;
+		}
+	}
+
+	if (!encoded)
+	{
+		encoded = shadow_encoded_new(key);
+
+		if (encoded)
+		{
+			/* one reference for the cache, one for the owner */
+			InterlockedIncrement(&encoded->refCount);
+
+			if (ArrayList_Add(cache->entries, encoded) < 0)
+			{
+				shadow_encoded_release(encoded);
+				shadow_encoded_release(encoded);
+				encoded = NULL;
+			}
+		}
+
+		cache->misses++;
+	}
+
+	LeaveCriticalSection(&cache->lock);
+
+	if (!encoded || *owner)
+		return encoded;
+
+	status = WaitForSingleObject(encoded->ready, SHADOW_ENCODE_CACHE_WAIT_TIMEOUT);
+
+	if (status == WAIT_TIMEOUT)
+	{
+		WLog_WARN(TAG, "owner did not publish within %d ms, encoding locally",
+		          SHADOW_ENCODE_CACHE_WAIT_TIMEOUT);
+		EnterCriticalSection(&cache->lock);
+		ArrayList_Remove(cache->entries, encoded);
+		LeaveCriticalSection(&cache->lock);
+	}
+
+	if ((status != WAIT_OBJECT_0) || !encoded->valid)
+	{
+		shadow_encoded_release(encoded);
+		return NULL;
+	}
+
+	return encoded;
+}
+
+/**
+ * Wakes up the clients waiting for an entry. Must be called by the owner
+ * exactly once, also on failure, before the encoded data is sent.
+ */
+void shadow_encode_cache_publish(rdpShadowEncoded* encoded, BOOL success)
+{
+	if (!encoded)
+		return;
+
+	encoded->valid = success;
+	SetEvent(encoded->ready);
+}
+
+void shadow_encode_cache_flush(rdpShadowEncodeCache* cache)
+{
+	if (!cache)
+		return;
+
+	EnterCriticalSection(&cache->lock);
+	ArrayList_Clear(cache->entries);
+	LeaveCriticalSection(&cache->lock);
+}
+
+/**
+ * Starts a new frame: the surface content changed, so nothing encoded so
+ * far can be reused. Entries still in use stay alive until released.
+ */
+void shadow_encode_cache_next_frame(rdpShadowEncodeCache* cache)
+{
+	if (!cache)
+		return;
+
+	EnterCriticalSection(&cache->lock);
+	ArrayList_Clear(cache->entries);
+	cache->frame++;
+
+	if ((cache->frame % 1000) == 0)
+	{
+		WLog_DBG(TAG, "frame %"PRIu32": %"PRIu32" shared, %"PRIu32" encoded",
+		         cache->frame, cache->hits, cache->misses);
+	}
+
+	LeaveCriticalSection(&cache->lock);
+}
+
+static void shadow_encode_cache_entry_free(void* obj)
+{
+	shadow_encoded_release((rdpShadowEncoded*) obj);
+}
+
+rdpShadowEncodeCache* shadow_encode_cache_new(void)
+{
+	rdpShadowEncodeCache* cache = (rdpShadowEncodeCache*) calloc(1, sizeof(rdpShadowEncodeCache));
+
+	if (!cache)
+		return NULL;
+
+	if (!InitializeCriticalSectionAndSpinCount(&cache->lock, 4000))
+		goto fail_lock;
+
+	if (!(cache->entries = ArrayList_New(FALSE)))
+		goto fail_entries;
+
+	ArrayList_Object(cache->entries)->fnObjectFree = shadow_encode_cache_entry_free;
+	return cache;
+fail_entries:
+	DeleteCriticalSection(&cache->lock);
+fail_lock:
+	free(cache);
+	return NULL;
+}
+
+void shadow_encode_cache_free(rdpShadowEncodeCache* cache)
+{
+	if (!cache)
+		return;
+
+	ArrayList_Free(cache->entries);
+	DeleteCriticalSection(&cache->lock);
+	free(cache);
+}
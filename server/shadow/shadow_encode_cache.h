@@ -0,0 +1,76 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_SERVER_SHADOW_ENCODE_CACHE_H
+#define FREERDP_SERVER_SHADOW_ENCODE_CACHE_H
+
+#include <freerdp/server/shadow.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/stream.h>
+
+/*
+ * Encoded surface updates shared between the clients of one frame.
+ *
+ * Every client thread handles the same UpdateEvent, so clients with the
+ * same codec configuration would encode the same dirty rectangle over and
+ * over. The first client to ask for a key becomes the owner and encodes it,
+ * everybody else waits for the owner and sends the same blocks. Entries are
+ * reference counted and dropped when the subsystem starts the next frame.
+ *
+ * Only stateless output can be shared: the key must describe everything
+ * that influences the encoded bytes.
+ */
+struct _SHADOW_ENCODE_KEY
+{
+	const BYTE* data;
+	UINT32 step;
+	UINT32 codec;
+	UINT32 x;
+	UINT32 y;
+	UINT32 width;
+	UINT32 height;
+	UINT32 params[4];
+};
+typedef struct _SHADOW_ENCODE_KEY SHADOW_ENCODE_KEY;
+
+typedef struct rdp_shadow_encoded rdpShadowEncoded;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+rdpShadowEncodeCache* shadow_encode_cache_new(void);
+void shadow_encode_cache_free(rdpShadowEncodeCache* cache);
+
+void shadow_encode_cache_next_frame(rdpShadowEncodeCache* cache);
+void shadow_encode_cache_flush(rdpShadowEncodeCache* cache);
+
+rdpShadowEncoded* shadow_encode_cache_acquire(rdpShadowEncodeCache* cache,
+        const SHADOW_ENCODE_KEY* key, BOOL* owner);
+void shadow_encode_cache_publish(rdpShadowEncoded* encoded, BOOL success);
+
+void shadow_encoded_release(rdpShadowEncoded* encoded);
+wStream* shadow_encoded_add_block(rdpShadowEncoded* encoded, size_t size);
+UINT32 shadow_encoded_get_count(rdpShadowEncoded* encoded);
+wStream* shadow_encoded_get_block(rdpShadowEncoded* encoded, UINT32 index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_SERVER_SHADOW_ENCODE_CACHE_H */
@@ -86,6 +86,9 @@ int shadow_subsystem_init(rdpShadowSubsystem* subsystem, rdpShadowServer* server
 	if (!(subsystem->updateEvent = shadow_multiclient_new()))
 		goto fail;
 
+	if (!(subsystem->encodeCache = shadow_encode_cache_new()))
+		goto fail;
+
 	if ((status = subsystem->ep.Init(subsystem)) >= 0)
 		return status;
 
@@ -102,6 +105,8 @@ fail:
 		subsystem->updateEvent = NULL;
 	}
 
+	shadow_encode_cache_free(subsystem->encodeCache);
+	subsystem->encodeCache = NULL;
 	return status;
 }
 
@@ -139,6 +144,9 @@ void shadow_subsystem_uninit(rdpShadowSubsystem* subsystem)
 		shadow_multiclient_free(subsystem->updateEvent);
 		subsystem->updateEvent = NULL;
 	}
+
+	shadow_encode_cache_free(subsystem->encodeCache);
+	subsystem->encodeCache = NULL;
 }
 
 int shadow_subsystem_start(rdpShadowSubsystem* subsystem)
@@ -269,5 +277,8 @@ int shadow_subsystem_pointer_convert_alpha_pointer_data(BYTE* pixels, BOOL premu
 
 void shadow_subsystem_frame_update(rdpShadowSubsystem* subsystem)
 {
+	shadow_encode_cache_next_frame(subsystem->encodeCache);
 	shadow_multiclient_publish_and_wait(subsystem->updateEvent);
+	/* All clients are done with this frame, don't keep its data around */
+	shadow_encode_cache_flush(subsystem->encodeCache);
 }
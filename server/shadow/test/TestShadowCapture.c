@@ -0,0 +1,344 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/codec/region.h>
+#include <freerdp/server/shadow.h>
+
+#define TEST_STRIPE_HEIGHT	(8 * SHADOW_CAPTURE_TILE_SIZE)
+
+struct test_frame
+{
+	UINT32 width;
+	UINT32 height;
+	UINT32 step1;
+	UINT32 step2;
+	BYTE* data1;
+	BYTE* data2;
+	BYTE* tiles;
+	BYTE* expected;
+};
+typedef struct test_frame TEST_FRAME;
+
+static void test_frame_free(TEST_FRAME* frame)
+{
+	free(frame->data1);
+	free(frame->data2);
+	free(frame->tiles);
+	free(frame->expected);
+}
+
+static BOOL test_frame_init(TEST_FRAME* frame, UINT32 width, UINT32 height)
+{
+	size_t x;
+	const size_t count = SHADOW_CAPTURE_TILE_COUNT(width, height);
+	ZeroMemory(frame, sizeof(TEST_FRAME));
+	frame->width = width;
+	frame->height = height;
+	/* distinct, unaligned scanlines so the kernels can't rely on either */
+	frame->step1 = width * 4 + 16;
+	frame->step2 = width * 4 + 12;
+	frame->data1 = (BYTE*) malloc(1ull * frame->step1 * height);
+	frame->data2 = (BYTE*) malloc(1ull * frame->step2 * height + 4);
+	frame->tiles = (BYTE*) malloc(count);
+	frame->expected = (BYTE*) malloc(count);
+
+	if (!frame->data1 || !frame->data2 || !frame->tiles || !frame->expected)
+	{
+		test_frame_free(frame);
+		return FALSE;
+	}
+
+	for (x = 0; x < 1ull * frame->step1 * height; x++)
+		frame->data1[x] = (BYTE) rand();
+
+	return TRUE;
+}
+
+static BYTE* test_frame_pixel2(TEST_FRAME* frame, UINT32 x, UINT32 y)
+{
+	/* offset by one pixel, like the XShm framebuffer in the x11 subsystem */
+	return &frame->data2[4 + (y * frame->step2) + (x * 4)];
+}
+
+static void test_frame_reset(TEST_FRAME* frame)
+{
+	UINT32 y;
+
+	for (y = 0; y < frame->height; y++)
+		memcpy(test_frame_pixel2(frame, 0, y), &frame->data1[y * frame->step1], frame->width * 4);
+}
+
+/* Plain per tile memcmp, the reference for the vectorized and striped path */
+static UINT32 test_reference_tiles(TEST_FRAME* frame, RECTANGLE_16* rect)
+{
+	UINT32 tx, ty, k;
+	UINT32 count = 0;
+	const UINT32 nrow = (frame->height + SHADOW_CAPTURE_TILE_SIZE - 1) / SHADOW_CAPTURE_TILE_SIZE;
+	const UINT32 ncol = (frame->width + SHADOW_CAPTURE_TILE_SIZE - 1) / SHADOW_CAPTURE_TILE_SIZE;
+	UINT32 l = ncol, t = nrow, r = 0, b = 0;
+	ZeroMemory(rect, sizeof(RECTANGLE_16));
+
+	for (ty = 0; ty < nrow; ty++)
+	{
+		for (tx = 0; tx < ncol; tx++)
+		{
+			const UINT32 x = tx * SHADOW_CAPTURE_TILE_SIZE;
+			const UINT32 y = ty * SHADOW_CAPTURE_TILE_SIZE;
+			const UINT32 tw = MIN(SHADOW_CAPTURE_TILE_SIZE, frame->width - x);
+			const UINT32 th = MIN(SHADOW_CAPTURE_TILE_SIZE, frame->height - y);
+			BYTE dirty = 0;
+
+			for (k = 0; k < th; k++)
+			{
+				if (memcmp(&frame->data1[((y + k) * frame->step1) + (x * 4)],
+				           test_frame_pixel2(frame, x, y + k), tw * 4) != 0)
+				{
+					dirty = 1;
+					break;
+				}
+			}
+
+			frame->expected[(ty * ncol) + tx] = dirty;
+
+			if (!dirty)
+				continue;
+
+			count++;
+			l = MIN(l, tx);
+			t = MIN(t, ty);
+			r = MAX(r, tx);
+			b = MAX(b, ty);
+		}
+	}
+
+	if (count)
+	{
+		rect->left = l * SHADOW_CAPTURE_TILE_SIZE;
+		rect->top = t * SHADOW_CAPTURE_TILE_SIZE;
+		rect->right = MIN((r + 1) * SHADOW_CAPTURE_TILE_SIZE, frame->width);
+		rect->bottom = MIN((b + 1) * SHADOW_CAPTURE_TILE_SIZE, frame->height);
+	}
+
+	return count;
+}
+
+static BOOL test_check_region(TEST_FRAME* frame)
+{
+	UINT32 tx, ty;
+	BOOL rc = FALSE;
+	REGION16 region;
+	RECTANGLE_16 tile;
+	const UINT32 nrow = (frame->height + SHADOW_CAPTURE_TILE_SIZE - 1) / SHADOW_CAPTURE_TILE_SIZE;
+	const UINT32 ncol = (frame->width + SHADOW_CAPTURE_TILE_SIZE - 1) / SHADOW_CAPTURE_TILE_SIZE;
+	region16_init(&region);
+
+	if (!shadow_capture_tiles_to_region(frame->tiles, frame->width, frame->height, &region))
+		goto fail;
+
+	for (ty = 0; ty < nrow; ty++)
+	{
+		for (tx = 0; tx < ncol; tx++)
+		{
+			tile.left = tx * SHADOW_CAPTURE_TILE_SIZE;
+			tile.top = ty * SHADOW_CAPTURE_TILE_SIZE;
+			tile.right = MIN(tile.left + SHADOW_CAPTURE_TILE_SIZE, frame->width);
+			tile.bottom = MIN(tile.top + SHADOW_CAPTURE_TILE_SIZE, frame->height);
+
+			if (region16_intersects_rect(&region, &tile) != (frame->expected[(ty * ncol) + tx] != 0))
+			{
+				fprintf(stderr, "%ux%u: region mismatch at tile %u,%u\n", frame->width,
+				        frame->height, tx, ty);
+				goto fail;
+			}
+		}
+	}
+
+	if (!region16_is_empty(&region))
+	{
+		const RECTANGLE_16* extents = region16_extents(&region);
+
+		if ((extents->right > frame->width) || (extents->bottom > frame->height))
+		{
+			fprintf(stderr, "%ux%u: region exceeds the frame\n", frame->width, frame->height);
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	region16_uninit(&region);
+	return rc;
+}
+
+static BOOL test_compare(TEST_FRAME* frame, const char* what)
+{
+	UINT32 count, expected;
+	RECTANGLE_16 rect, expectedRect;
+	const size_t ntiles = SHADOW_CAPTURE_TILE_COUNT(frame->width, frame->height);
+	/* every entry must be written, not only the dirty ones */
+	memset(frame->tiles, 0xAA, ntiles);
+	expected = test_reference_tiles(frame, &expectedRect);
+	count = shadow_capture_compare_tiles(frame->data1, frame->step1, frame->width, frame->height,
+	                                     test_frame_pixel2(frame, 0, 0), frame->step2,
+	                                     frame->tiles, &rect);
+
+	if (count != expected)
+	{
+		fprintf(stderr, "%ux%u %s: %u dirty tiles, expected %u\n", frame->width, frame->height,
+		        what, count, expected);
+		return FALSE;
+	}
+
+	if (memcmp(frame->tiles, frame->expected, ntiles) != 0)
+	{
+		fprintf(stderr, "%ux%u %s: tile bitmap mismatch\n", frame->width, frame->height, what);
+		return FALSE;
+	}
+
+	if (memcmp(&rect, &expectedRect, sizeof(RECTANGLE_16)) != 0)
+	{
+		fprintf(stderr, "%ux%u %s: bounds %u,%u-%u,%u, expected %u,%u-%u,%u\n", frame->width,
+		        frame->height, what, rect.left, rect.top, rect.right, rect.bottom,
+		        expectedRect.left, expectedRect.top, expectedRect.right, expectedRect.bottom);
+		return FALSE;
+	}
+
+	return test_check_region(frame);
+}
+
+static BOOL test_pixel(TEST_FRAME* frame, UINT32 x, UINT32 y, UINT32 channel, const char* what)
+{
+	BOOL rc;
+	BYTE* pixel = test_frame_pixel2(frame, x, y);
+	pixel[channel] ^= 0x01;
+	rc = test_compare(frame, what);
+	pixel[channel] ^= 0x01;
+
+	if (!rc)
+		fprintf(stderr, "  changed pixel %u,%u channel %u\n", x, y, channel);
+
+	return rc;
+}
+
+/*
+ * Small frames are checked tile by tile, larger ones only along the edges,
+ * the middle column and the tile rows next to a stripe boundary.
+ */
+static BOOL test_tile_selected(UINT32 tx, UINT32 ty, UINT32 ncol, UINT32 nrow)
+{
+	if ((ncol * nrow) <= 256)
+		return TRUE;
+
+	if ((tx != 0) && (tx != ncol / 2) && (tx != ncol - 1))
+		return FALSE;
+
+	return (ty == 0) || (ty == nrow - 1) || ((ty % 8) == 0) || ((ty % 8) == 7);
+}
+
+static BOOL test_capture_size(UINT32 width, UINT32 height)
+{
+	UINT32 tx, ty, i;
+	BOOL rc = FALSE;
+	TEST_FRAME frame;
+	const UINT32 nrow = (height + SHADOW_CAPTURE_TILE_SIZE - 1) / SHADOW_CAPTURE_TILE_SIZE;
+	const UINT32 ncol = (width + SHADOW_CAPTURE_TILE_SIZE - 1) / SHADOW_CAPTURE_TILE_SIZE;
+
+	if (!test_frame_init(&frame, width, height))
+		return FALSE;
+
+	test_frame_reset(&frame);
+
+	if (!test_compare(&frame, "identical"))
+		goto fail;
+
+	/* the last column and row of every tile, including the partial ones */
+	for (ty = 0; ty < nrow; ty++)
+	{
+		const UINT32 y = MIN((ty + 1) * SHADOW_CAPTURE_TILE_SIZE, height) - 1;
+
+		for (tx = 0; tx < ncol; tx++)
+		{
+			const UINT32 x = MIN((tx + 1) * SHADOW_CAPTURE_TILE_SIZE, width) - 1;
+
+			if (!test_tile_selected(tx, ty, ncol, nrow))
+				continue;
+
+			if (!test_pixel(&frame, x, ty * SHADOW_CAPTURE_TILE_SIZE, 3, "last column"))
+				goto fail;
+
+			if (!test_pixel(&frame, tx * SHADOW_CAPTURE_TILE_SIZE, y, 0, "last row"))
+				goto fail;
+
+			if (!test_pixel(&frame, x, y, 1, "last pixel"))
+				goto fail;
+		}
+	}
+
+	/* either side of every stripe boundary */
+	for (i = TEST_STRIPE_HEIGHT; i < height; i += TEST_STRIPE_HEIGHT)
+	{
+		if (!test_pixel(&frame, width - 1, i - 1, 2, "stripe end"))
+			goto fail;
+
+		if (!test_pixel(&frame, 0, i, 2, "stripe start"))
+			goto fail;
+	}
+
+	/* scattered changes */
+	for (i = 0; i < (nrow * ncol) / 4 + 1; i++)
+		test_frame_pixel2(&frame, rand() % width, rand() % height)[rand() % 4] ^= 0x80;
+
+	if (!test_compare(&frame, "scattered"))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	test_frame_free(&frame);
+	return rc;
+}
+
+int TestShadowCapture(int argc, char* argv[])
+{
+	size_t i;
+	const UINT32 sizes[][2] =
+	{
+		{ 1, 1 },
+		{ 15, 17 },
+		{ 16, 16 },
+		{ 33, 31 },
+		{ 255, TEST_STRIPE_HEIGHT - 1 },
+		{ 257, TEST_STRIPE_HEIGHT },
+		{ 127, TEST_STRIPE_HEIGHT + 1 },
+		{ 641, (4 * TEST_STRIPE_HEIGHT) - 3 },
+		{ 1023, 8 * TEST_STRIPE_HEIGHT },
+		{ 1279, (16 * TEST_STRIPE_HEIGHT) + SHADOW_CAPTURE_TILE_SIZE + 1 }
+	};
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+	srand(0x5EED);
+
+	for (i = 0; i < ARRAYSIZE(sizes); i++)
+	{
+		if (!test_capture_size(sizes[i][0], sizes[i][1]))
+			return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,254 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+
+#include "../shadow_encode_cache.h"
+
+#define TEST_WAITERS 8
+#define TEST_BLOCKS 5
+#define TEST_BLOCK_SIZE 1000
+/* owner delay, well below the wait timeout of the cache */
+#define TEST_ENCODE_DELAY 100
+/* the cache gives up on an owner after one second */
+#define TEST_STALL_MIN 900
+#define TEST_STALL_MAX 10000
+
+struct test_waiter
+{
+	rdpShadowEncodeCache* cache;
+	const SHADOW_ENCODE_KEY* key;
+	HANDLE start;
+	BOOL expectShared;
+	BOOL result;
+	DWORD elapsed;
+};
+typedef struct test_waiter TEST_WAITER;
+
+static BYTE test_block_byte(UINT32 block, size_t offset)
+{
+	return (BYTE)((block * 31) + offset);
+}
+
+static BOOL test_fill(rdpShadowEncoded* encoded)
+{
+	UINT32 i;
+	size_t k;
+
+	for (i = 0; i < TEST_BLOCKS; i++)
+	{
+		wStream* s = shadow_encoded_add_block(encoded, TEST_BLOCK_SIZE);
+
+		if (!s)
+			return FALSE;
+
+		for (k = 0; k < TEST_BLOCK_SIZE; k++)
+			Stream_Write_UINT8(s, test_block_byte(i, k));
+
+		Stream_SealLength(s);
+	}
+
+	return TRUE;
+}
+
+static BOOL test_check(rdpShadowEncoded* encoded)
+{
+	UINT32 i;
+	size_t k;
+
+	if (shadow_encoded_get_count(encoded) != TEST_BLOCKS)
+		return FALSE;
+
+	for (i = 0; i < TEST_BLOCKS; i++)
+	{
+		const BYTE* data;
+		wStream* s = shadow_encoded_get_block(encoded, i);
+
+		if (!s || (Stream_Length(s) != TEST_BLOCK_SIZE))
+			return FALSE;
+
+		data = Stream_Buffer(s);
+
+		for (k = 0; k < TEST_BLOCK_SIZE; k++)
+		{
+			if (data[k] != test_block_byte(i, k))
+				return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static DWORD WINAPI test_waiter_thread(LPVOID arg)
+{
+	BOOL owner;
+	DWORD start;
+	rdpShadowEncoded* encoded;
+	TEST_WAITER* waiter = (TEST_WAITER*) arg;
+	WaitForSingleObject(waiter->start, INFINITE);
+	start = GetTickCount();
+	encoded = shadow_encode_cache_acquire(waiter->cache, waiter->key, &owner);
+	waiter->elapsed = GetTickCount() - start;
+
+	if (waiter->expectShared)
+		waiter->result = encoded && !owner && test_check(encoded);
+	else
+		waiter->result = !encoded;
+
+	shadow_encoded_release(encoded);
+	return 0;
+}
+
+/*
+ * Runs TEST_WAITERS clients against an entry owned by the calling thread.
+ * publish is 1 for success, 0 for failure and -1 to never publish.
+ */
+static BOOL test_concurrent(rdpShadowEncodeCache* cache, const SHADOW_ENCODE_KEY* key,
+                            int publish)
+{
+	int i;
+	BOOL owner;
+	BOOL rc = FALSE;
+	HANDLE start;
+	HANDLE threads[TEST_WAITERS] = { 0 };
+	TEST_WAITER waiters[TEST_WAITERS] = { 0 };
+	rdpShadowEncoded* encoded = shadow_encode_cache_acquire(cache, key, &owner);
+
+	if (!encoded || !owner)
+	{
+		fprintf(stderr, "first acquire must own the entry\n");
+		shadow_encoded_release(encoded);
+		return FALSE;
+	}
+
+	if (!(start = CreateEvent(NULL, TRUE, FALSE, NULL)))
+		goto fail;
+
+	for (i = 0; i < TEST_WAITERS; i++)
+	{
+		waiters[i].cache = cache;
+		waiters[i].key = key;
+		waiters[i].start = start;
+		waiters[i].expectShared = (publish > 0);
+
+		if (!(threads[i] = CreateThread(NULL, 0, test_waiter_thread, &waiters[i], 0, NULL)))
+			goto fail;
+	}
+
+	SetEvent(start);
+
+	if (publish >= 0)
+	{
+		/* "encode" while the other clients are waiting */
+		Sleep(TEST_ENCODE_DELAY);
+
+		if ((publish > 0) && !test_fill(encoded))
+			goto fail;
+
+		shadow_encode_cache_publish(encoded, publish > 0);
+	}
+
+	rc = TRUE;
+fail:
+
+	for (i = 0; i < TEST_WAITERS; i++)
+	{
+		if (!threads[i])
+			continue;
+
+		WaitForSingleObject(threads[i], INFINITE);
+		CloseHandle(threads[i]);
+
+		if (!waiters[i].result)
+		{
+			fprintf(stderr, "waiter %d (publish %d) got the wrong result\n", i, publish);
+			rc = FALSE;
+		}
+
+		if ((publish < 0) &&
+		    ((waiters[i].elapsed < TEST_STALL_MIN) || (waiters[i].elapsed > TEST_STALL_MAX)))
+		{
+			fprintf(stderr, "waiter %d gave up after %"PRIu32" ms\n", i, waiters[i].elapsed);
+			rc = FALSE;
+		}
+	}
+
+	if (start)
+		CloseHandle(start);
+
+	/* a late publish by a stalled owner must be harmless */
+	if (publish < 0)
+		shadow_encode_cache_publish(encoded, FALSE);
+
+	shadow_encoded_release(encoded);
+	return rc;
+}
+
+static BOOL test_owner(rdpShadowEncodeCache* cache, const SHADOW_ENCODE_KEY* key,
+                       BOOL expectOwner)
+{
+	BOOL owner;
+	BOOL rc;
+	rdpShadowEncoded* encoded = shadow_encode_cache_acquire(cache, key, &owner);
+
+	if (!encoded)
+		return FALSE;
+
+	rc = (owner == expectOwner);
+
+	if (owner)
+		shadow_encode_cache_publish(encoded, FALSE);
+
+	shadow_encoded_release(encoded);
+	return rc;
+}
+
+int TestShadowEncodeCache(int argc, char* argv[])
+{
+	int rc = -1;
+	BYTE surface[4] = { 0 };
+	SHADOW_ENCODE_KEY key = { 0 };
+	rdpShadowEncodeCache* cache;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+	key.data = surface;
+	key.step = 64;
+	key.codec = 1;
+	key.width = 64;
+	key.height = 64;
+
+	if (!(cache = shadow_encode_cache_new()))
+		return -1;
+
+	if (!test_concurrent(cache, &key, 1))
+		goto fail;
+
+	/* published entries are shared until the next frame */
+	if (!test_owner(cache, &key, FALSE))
+		goto fail;
+
+	shadow_encode_cache_next_frame(cache);
+
+	if (!test_concurrent(cache, &key, 0))
+		goto fail;
+
+	shadow_encode_cache_next_frame(cache);
+
+	if (!test_concurrent(cache, &key, -1))
+		goto fail;
+
+	/* the stalled entry is gone, the next client takes over */
+	if (!test_owner(cache, &key, TRUE))
+		goto fail;
+
+	/* without a cache every client owns its own entry */
+	if (!test_owner(NULL, &key, TRUE))
+		goto fail;
+
+	rc = 0;
+fail:
+	shadow_encode_cache_free(cache);
+	return rc;
+}
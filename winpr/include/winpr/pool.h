@@ -267,6 +267,22 @@ WINPR_API VOID winpr_DisassociateCurrentThreadFromCallback(PTP_CALLBACK_INSTANCE
 
 #endif
 
+/* Parallel For (WinPR extension) */
+
+typedef struct _TP_PARALLEL TP_PARALLEL, *PTP_PARALLEL;
+
+typedef VOID (*PTP_PARALLEL_CALLBACK)(PVOID Context, ULONG Index);
+
+WINPR_API PTP_PARALLEL winpr_CreateThreadpoolParallel(PTP_CALLBACK_ENVIRON pcbe,
+        DWORD cthrdMost);
+WINPR_API VOID winpr_CloseThreadpoolParallel(PTP_PARALLEL ptpp);
+WINPR_API BOOL winpr_ThreadpoolParallelFor(PTP_PARALLEL ptpp, ULONG count,
+        PTP_PARALLEL_CALLBACK pfnpf, PVOID pv);
+
+#define CreateThreadpoolParallel winpr_CreateThreadpoolParallel
+#define CloseThreadpoolParallel winpr_CloseThreadpoolParallel
+#define ThreadpoolParallelFor winpr_ThreadpoolParallelFor
+
 #ifdef __cplusplus
 }
 #endif
@@ -33,6 +33,7 @@ extern "C" {
 #endif
 
 typedef struct _wStreamPool wStreamPool;
+typedef struct _wStreamPoolMagazine wStreamPoolMagazine;
 
 struct _wStream
 {
@@ -45,6 +46,11 @@ struct _wStream
 	wStreamPool* pool;
 	BOOL isAllocatedStream;
 	BOOL isOwner;
+
+	/* StreamPool links: free list, and all streams allocated by the pool */
+	struct _wStream* next;
+	struct _wStream* poolNext;
+	struct _wStream* poolPrev;
 };
 typedef struct _wStream wStream;
 
@@ -372,21 +378,51 @@ static INLINE BOOL Stream_Write_UTF16_String(wStream* s, const WCHAR* src, size_
 
 /* StreamPool */
 
+/**
+ * Cached streams are kept in power of two size classes, from 64 bytes up to
+ * 16 MiB. Class i holds the streams with a capacity of at least
+ * 2^(i + STREAMPOOL_MIN_SHIFT) bytes. Larger streams are not cached.
+ *
+ * Synchronized pools also keep up to STREAMPOOL_MAGAZINE_DEPTH streams of
+ * each class up to 64 KiB in a per-thread magazine, which is used without
+ * taking the pool lock.
+ */
+#define STREAMPOOL_MIN_SHIFT		6
+#define STREAMPOOL_MAX_SHIFT		24
+#define STREAMPOOL_CLASSES		(STREAMPOOL_MAX_SHIFT - STREAMPOOL_MIN_SHIFT + 1)
+#define STREAMPOOL_MAGAZINE_SHIFT	16
+#define STREAMPOOL_MAGAZINE_CLASSES	(STREAMPOOL_MAGAZINE_SHIFT - STREAMPOOL_MIN_SHIFT + 1)
+#define STREAMPOOL_MAGAZINE_DEPTH	4
+
 struct _wStreamPool
 {
-	int aSize;
-	int aCapacity;
-	wStream** aArray;
+	LONG aSize;
+	LONG uSize;
+
+	wStream* aClasses[STREAMPOOL_CLASSES];
+	wStream* streams;
 
-	int uSize;
-	int uCapacity;
-	wStream** uArray;
+	LONG maxMagazines;
+	LONG numMagazines;
+	wStreamPoolMagazine* magazines;
+
+	UINT64 hits;
+	UINT64 misses;
 
 	CRITICAL_SECTION lock;
 	BOOL synchronized;
 	size_t defaultSize;
 };
 
+struct _wStreamPoolStatistics
+{
+	UINT64 hits;
+	UINT64 misses;
+	UINT32 cached;
+	UINT32 used;
+};
+typedef struct _wStreamPoolStatistics wStreamPoolStatistics;
+
 WINPR_API wStream* StreamPool_Take(wStreamPool* pool, size_t size);
 WINPR_API void StreamPool_Return(wStreamPool* pool, wStream* s);
 
@@ -399,6 +435,8 @@ WINPR_API void StreamPool_Release(wStreamPool* pool, BYTE* ptr);
 
 WINPR_API void StreamPool_Clear(wStreamPool* pool);
 
+WINPR_API BOOL StreamPool_GetStatistics(wStreamPool* pool, wStreamPoolStatistics* stats);
+
 WINPR_API wStreamPool* StreamPool_New(BOOL synchronized, size_t defaultSize);
 WINPR_API void StreamPool_Free(wStreamPool* pool);
 
@@ -412,6 +412,30 @@ WINPR_API int SetEventFileDescriptor(HANDLE hEvent, int FileDescriptor, ULONG mo
 
 WINPR_API void* GetEventWaitObject(HANDLE hEvent);
 
+/**
+ * Wait sets: handles are registered once and a callback is dispatched for
+ * each signalled handle. There is no limit on the number of handles.
+ *
+ * A wait set belongs to the thread that dispatches it. Handles may be added
+ * and removed from callbacks, including the one being dispatched.
+ */
+
+#define WINPR_WAIT_SET_LEVEL	0x00000000 /* dispatch while the handle is signalled */
+#define WINPR_WAIT_SET_EDGE	0x00000001 /* dispatch when the handle becomes signalled */
+
+typedef struct _WINPR_WAIT_SET WINPR_WAIT_SET, *PWINPR_WAIT_SET;
+typedef VOID (*PWAIT_SET_CALLBACK)(PVOID Context, HANDLE hHandle);
+
+WINPR_API PWINPR_WAIT_SET CreateWaitSet(void);
+WINPR_API VOID CloseWaitSet(PWINPR_WAIT_SET pWaitSet);
+
+WINPR_API BOOL WaitSetAddHandle(PWINPR_WAIT_SET pWaitSet, HANDLE hHandle, DWORD dwFlags,
+                                PWAIT_SET_CALLBACK pfnCallback, PVOID pContext);
+WINPR_API BOOL WaitSetRemoveHandle(PWINPR_WAIT_SET pWaitSet, HANDLE hHandle);
+WINPR_API DWORD WaitSetGetCount(PWINPR_WAIT_SET pWaitSet);
+
+WINPR_API DWORD WaitSetDispatch(PWINPR_WAIT_SET pWaitSet, DWORD dwMilliseconds);
+
 #ifdef __cplusplus
 }
 #endif
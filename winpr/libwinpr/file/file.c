@@ -47,6 +47,7 @@
 #include "file.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -204,6 +205,87 @@ static BOOL FileSetFilePointerEx(HANDLE hFile, LARGE_INTEGER liDistanceToMove, P
 	return TRUE;
 }
 
+/**
+ * Files are never opened for overlapped I/O, so just like for synchronous
+ * handles on Windows an OVERLAPPED structure only carries the file offset.
+ * The transfer is done with pread/pwrite, which leaves the file pointer
+ * untouched and allows concurrent transfers on the same handle.
+ */
+static BOOL FileGetOverlappedOffset(WINPR_FILE* file, LPOVERLAPPED lpOverlapped, off_t* offset)
+{
+	const UINT64 position = ((UINT64) lpOverlapped->OffsetHigh << 32) | lpOverlapped->Offset;
+
+	if (position > INT64_MAX)
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+
+	/* positional I/O bypasses the stream buffer, write out what is pending */
+	if (fflush(file->fp) != 0)
+	{
+		SetLastError(map_posix_err(errno));
+		return FALSE;
+	}
+
+	*offset = (off_t) position;
+	return TRUE;
+}
+
+static BOOL FileReadAt(WINPR_FILE* file, LPVOID lpBuffer, DWORD nNumberOfBytesToRead,
+                       LPDWORD lpNumberOfBytesRead, LPOVERLAPPED lpOverlapped)
+{
+	off_t offset;
+	ssize_t io_status;
+
+	if (!FileGetOverlappedOffset(file, lpOverlapped, &offset))
+		return FALSE;
+
+	do
+	{
+		io_status = pread(fileno(file->fp), lpBuffer, nNumberOfBytesToRead, offset);
+	}
+	while ((io_status < 0) && (errno == EINTR));
+
+	if (io_status < 0)
+	{
+		SetLastError(map_posix_err(errno));
+		return FALSE;
+	}
+
+	if (lpNumberOfBytesRead)
+		*lpNumberOfBytesRead = (DWORD) io_status;
+
+	return TRUE;
+}
+
+static BOOL FileWriteAt(WINPR_FILE* file, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite,
+                        LPDWORD lpNumberOfBytesWritten, LPOVERLAPPED lpOverlapped)
+{
+	off_t offset;
+	ssize_t io_status;
+
+	if (!FileGetOverlappedOffset(file, lpOverlapped, &offset))
+		return FALSE;
+
+	do
+	{
+		io_status = pwrite(fileno(file->fp), lpBuffer, nNumberOfBytesToWrite, offset);
+	}
+	while ((io_status < 0) && (errno == EINTR));
+
+	if (io_status < 0)
+	{
+		SetLastError(map_posix_err(errno));
+		return FALSE;
+	}
+
+	if (lpNumberOfBytesWritten)
+		*lpNumberOfBytesWritten = (DWORD) io_status;
+
+	return TRUE;
+}
+
 static BOOL FileRead(PVOID Object, LPVOID lpBuffer, DWORD nNumberOfBytesToRead,
 					LPDWORD lpNumberOfBytesRead, LPOVERLAPPED lpOverlapped)
 {
@@ -211,17 +293,15 @@ static BOOL FileRead(PVOID Object, LPVOID lpBuffer, DWORD nNumberOfBytesToRead,
 	WINPR_FILE* file;
 	BOOL status = TRUE;
 
-	if (lpOverlapped)
-	{
-		WLog_ERR(TAG, "WinPR %s does not support the lpOverlapped parameter", __FUNCTION__);
-		SetLastError(ERROR_NOT_SUPPORTED);
-		return FALSE;
-	}
-
 	if (!Object)
 		return FALSE;
 
 	file = (WINPR_FILE *)Object;
+
+	if (lpOverlapped)
+		return FileReadAt(file, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead,
+		                  lpOverlapped);
+
 	clearerr(file->fp);
 	io_status = fread(lpBuffer, 1, nNumberOfBytesToRead, file->fp);
 
@@ -251,18 +331,15 @@ static BOOL FileWrite(PVOID Object, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrit
 	size_t io_status;
 	WINPR_FILE* file;
 
-	if (lpOverlapped)
-	{
-		WLog_ERR(TAG, "WinPR %s does not support the lpOverlapped parameter", __FUNCTION__);
-		SetLastError(ERROR_NOT_SUPPORTED);
-		return FALSE;
-	}
-
 	if (!Object)
 		return FALSE;
 
 	file = (WINPR_FILE *)Object;
 
+	if (lpOverlapped)
+		return FileWriteAt(file, lpBuffer, nNumberOfBytesToWrite, lpNumberOfBytesWritten,
+		                   lpOverlapped);
+
 	clearerr(file->fp);
 	io_status = fwrite(lpBuffer, 1, nNumberOfBytesToWrite, file->fp);
 	if (io_status == 0 && ferror(file->fp))
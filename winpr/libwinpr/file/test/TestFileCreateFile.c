@@ -77,6 +77,31 @@ int TestFileCreateFile(int argc, char* argv[])
 	if (memcmp(buffer, cmp, sizeof(buffer)))
 		rc = -1;
 
+	/* Positional transfers, the file pointer must stay where it is */
+	{
+		OVERLAPPED overlapped = { 0 };
+		overlapped.Offset = 5;
+
+		if (!WriteFile(handle, "XYZ", 3, &written, &overlapped) || (written != 3))
+			rc = -1;
+
+		overlapped.Offset = 4;
+
+		if (!ReadFile(handle, cmp, 5, &written, &overlapped) || (written != 5))
+			rc = -1;
+
+		if (memcmp(cmp, " XYZd", 5) != 0)
+			rc = -1;
+
+		overlapped.Offset = sizeof(buffer) - 2;
+
+		if (!ReadFile(handle, cmp, sizeof(cmp), &written, &overlapped) || (written != 2))
+			rc = -1;
+
+		if (SetFilePointer(handle, 0, NULL, FILE_CURRENT) != sizeof(buffer))
+			rc = -1;
+	}
+
 	if (!CloseHandle(handle))
 		rc = -1;
 
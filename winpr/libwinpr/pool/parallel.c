@@ -0,0 +1,188 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Thread Pool API (Parallel For)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/pool.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
+
+#include "pool.h"
+#include "../log.h"
+#define TAG WINPR_TAG("pool")
+
+/**
+ * A parallel loop runs a callback for every index of [0, count) on the
+ * calling thread and up to cthrdMost - 1 helper callbacks of one work
+ * object. Helpers and the caller claim indices from a shared counter, so a
+ * loop costs one submission per helper instead of one work object per item,
+ * and the caller waits for a single event at the end.
+ *
+ * A loop object runs one loop at a time. Do not start a loop from a
+ * callback of the pool it submits to: the helpers might never get a thread.
+ */
+struct _TP_PARALLEL
+{
+	PTP_WORK Work;
+	DWORD Helpers;
+#ifndef _WIN32
+	TP_CALLBACK_INSTANCE* Instances;
+#endif
+	HANDLE Done;
+
+	PTP_PARALLEL_CALLBACK Callback;
+	PVOID Context;
+	LONG Count;
+	LONG Next;
+	LONG Pending;
+};
+
+static void parallel_run(PTP_PARALLEL parallel)
+{
+	LONG index;
+
+	while ((index = InterlockedIncrement(&parallel->Next) - 1) < parallel->Count)
+		parallel->Callback(parallel->Context, (ULONG) index);
+}
+
+static VOID CALLBACK parallel_work_callback(PTP_CALLBACK_INSTANCE instance, PVOID context,
+        PTP_WORK work)
+{
+	PTP_PARALLEL parallel = (PTP_PARALLEL) context;
+	HANDLE done = parallel->Done;
+	parallel_run(parallel);
+
+	/* the loop may return as soon as Pending drops, don't touch parallel afterwards */
+	if (InterlockedDecrement(&parallel->Pending) == 0)
+		SetEvent(done);
+}
+
+/**
+ * Creates a loop object for the pool of pcbe (the default pool if NULL).
+ * cthrdMost limits the number of threads working on a loop, including the
+ * caller. 0 uses one thread per processor. The loop object owns its work
+ * object, so pcbe must not have a cleanup group.
+ */
+PTP_PARALLEL winpr_CreateThreadpoolParallel(PTP_CALLBACK_ENVIRON pcbe, DWORD cthrdMost)
+{
+	PTP_PARALLEL parallel;
+
+	if (cthrdMost == 0)
+	{
+		SYSTEM_INFO sysinfo;
+		GetNativeSystemInfo(&sysinfo);
+		cthrdMost = sysinfo.dwNumberOfProcessors;
+	}
+
+	if (!(parallel = (PTP_PARALLEL) calloc(1, sizeof(TP_PARALLEL))))
+		return NULL;
+
+	parallel->Helpers = (cthrdMost > 1) ? cthrdMost - 1 : 0;
+
+	if (!(parallel->Done = CreateEvent(NULL, TRUE, FALSE, NULL)))
+		goto fail;
+
+	if (parallel->Helpers > 0)
+	{
+		if (!(parallel->Work = CreateThreadpoolWork(parallel_work_callback, parallel, pcbe)))
+			goto fail;
+
+#ifndef _WIN32
+
+		if (!(parallel->Instances = (TP_CALLBACK_INSTANCE*) calloc(parallel->Helpers,
+		                            sizeof(TP_CALLBACK_INSTANCE))))
+			goto fail;
+
+#endif
+	}
+
+	return parallel;
+fail:
+	winpr_CloseThreadpoolParallel(parallel);
+	return NULL;
+}
+
+VOID winpr_CloseThreadpoolParallel(PTP_PARALLEL ptpp)
+{
+	if (!ptpp)
+		return;
+
+	if (ptpp->Work)
+		CloseThreadpoolWork(ptpp->Work);
+
+#ifndef _WIN32
+	free(ptpp->Instances);
+#endif
+
+	if (ptpp->Done)
+		CloseHandle(ptpp->Done);
+
+	free(ptpp);
+}
+
+/**
+ * Calls pfnpf(pv, index) for every index below count and returns when all
+ * calls have returned. The order of the calls is unspecified.
+ */
+BOOL winpr_ThreadpoolParallelFor(PTP_PARALLEL ptpp, ULONG count, PTP_PARALLEL_CALLBACK pfnpf,
+                                 PVOID pv)
+{
+	DWORD index;
+	DWORD helpers;
+
+	if (!ptpp || !pfnpf || (count > MAXLONG))
+		return FALSE;
+
+	if (count == 0)
+		return TRUE;
+
+	helpers = (ptpp->Helpers < count) ? ptpp->Helpers : count - 1;
+	ptpp->Callback = pfnpf;
+	ptpp->Context = pv;
+	ptpp->Count = (LONG) count;
+	ptpp->Next = 0;
+	ptpp->Pending = (LONG)(helpers + 1);
+
+	if (!ResetEvent(ptpp->Done))
+		return FALSE;
+
+	for (index = 0; index < helpers; index++)
+	{
+#ifdef _WIN32
+		SubmitThreadpoolWork(ptpp->Work);
+#else
+		SubmitThreadpoolWorkInstance(ptpp->Work, &ptpp->Instances[index]);
+#endif
+	}
+
+	parallel_run(ptpp);
+
+	if (InterlockedDecrement(&ptpp->Pending) == 0)
+		return TRUE;
+
+	if (WaitForSingleObject(ptpp->Done, INFINITE) != WAIT_OBJECT_0)
+	{
+		WLog_ERR(TAG, "error waiting on parallel loop completion");
+		return FALSE;
+	}
+
+	return TRUE;
+}
@@ -87,10 +87,14 @@ static DWORD WINAPI thread_pool_work_func(LPVOID arg)
 
 		if (callbackInstance)
 		{
+			/* an owned instance may be submitted again as soon as the callback returns */
+			const BOOL owned = callbackInstance->Owned;
 			work = callbackInstance->Work;
 			work->WorkCallback(callbackInstance, work->CallbackParameter, work);
 			CountdownEvent_Signal(pool->WorkComplete, 1);
-			free(callbackInstance);
+
+			if (!owned)
+				free(callbackInstance);
 		}
 	}
 
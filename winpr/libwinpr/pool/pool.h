@@ -28,6 +28,7 @@
 struct _TP_CALLBACK_INSTANCE
 {
 	PTP_WORK Work;
+	BOOL Owned; /* preallocated by the submitter, not freed by the pool */
 };
 
 struct _TP_POOL
@@ -74,5 +75,9 @@ struct _TP_CLEANUP_GROUP
 
 PTP_POOL GetDefaultThreadpool(void);
 
+#ifndef _WIN32
+VOID SubmitThreadpoolWorkInstance(PTP_WORK pwk, PTP_CALLBACK_INSTANCE pci);
+#endif
+
 #endif /* WINPR_POOL_PRIVATE_H */
 
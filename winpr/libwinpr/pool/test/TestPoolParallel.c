@@ -0,0 +1,208 @@
+
+#include <winpr/crt.h>
+#include <winpr/pool.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
+
+#define TEST_FRAMES 200
+#define TEST_TILES 64
+
+struct test_parallel_frame
+{
+	LONG hits[TEST_TILES];
+	LONG calls;
+};
+
+static void test_tile(struct test_parallel_frame* frame, ULONG index)
+{
+	InterlockedIncrement(&frame->hits[index]);
+	InterlockedIncrement(&frame->calls);
+}
+
+static VOID test_ParallelCallback(PVOID context, ULONG index)
+{
+	test_tile((struct test_parallel_frame*) context, index);
+}
+
+struct test_work_param
+{
+	struct test_parallel_frame* frame;
+	ULONG index;
+};
+
+static void CALLBACK test_WorkCallback(PTP_CALLBACK_INSTANCE instance, void* context,
+                                       PTP_WORK work)
+{
+	struct test_work_param* param = (struct test_work_param*) context;
+	test_tile(param->frame, param->index);
+}
+
+static BOOL test_frame_check(struct test_parallel_frame* frame, ULONG count)
+{
+	ULONG index;
+
+	if (frame->calls != (LONG) count)
+	{
+		printf("expected %"PRIu32" calls, got %"PRId32"\n", count, frame->calls);
+		return FALSE;
+	}
+
+	for (index = 0; index < count; index++)
+	{
+		if (frame->hits[index] != 1)
+		{
+			printf("index %"PRIu32" was run %"PRId32" times\n", index, frame->hits[index]);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL test_parallel(PTP_CALLBACK_ENVIRON environment, DWORD threads)
+{
+	BOOL rc = FALSE;
+	ULONG count;
+	PTP_PARALLEL parallel;
+	struct test_parallel_frame frame;
+
+	if (!(parallel = CreateThreadpoolParallel(environment, threads)))
+	{
+		printf("CreateThreadpoolParallel failure\n");
+		return FALSE;
+	}
+
+	if (ThreadpoolParallelFor(parallel, 1, NULL, &frame))
+	{
+		printf("ThreadpoolParallelFor accepted a NULL callback\n");
+		goto fail;
+	}
+
+	/* the same loop object is reused for every size, including empty loops */
+	for (count = 0; count <= TEST_TILES; count++)
+	{
+		ZeroMemory(&frame, sizeof(frame));
+
+		if (!ThreadpoolParallelFor(parallel, count, test_ParallelCallback, &frame))
+		{
+			printf("ThreadpoolParallelFor failure\n");
+			goto fail;
+		}
+
+		if (!test_frame_check(&frame, count))
+			goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	CloseThreadpoolParallel(parallel);
+	return rc;
+}
+
+/**
+ * Compares the per frame scheduling cost of a parallel loop with one work
+ * object per tile, the way the codecs used to do it. The timings are only
+ * printed, they depend too much on the machine to be checked.
+ */
+static BOOL test_benchmark(PTP_CALLBACK_ENVIRON environment)
+{
+	BOOL rc = FALSE;
+	ULONG index;
+	UINT32 frameIndex;
+	UINT64 start, workTime, parallelTime;
+	PTP_WORK work[TEST_TILES];
+	struct test_work_param params[TEST_TILES];
+	struct test_parallel_frame frame;
+	PTP_PARALLEL parallel;
+
+	if (!(parallel = CreateThreadpoolParallel(environment, 0)))
+		return FALSE;
+
+	start = GetTickCount64();
+
+	for (frameIndex = 0; frameIndex < TEST_FRAMES; frameIndex++)
+	{
+		ZeroMemory(&frame, sizeof(frame));
+
+		for (index = 0; index < TEST_TILES; index++)
+		{
+			params[index].frame = &frame;
+			params[index].index = index;
+
+			if (!(work[index] = CreateThreadpoolWork(test_WorkCallback, &params[index], environment)))
+				goto fail;
+
+			SubmitThreadpoolWork(work[index]);
+		}
+
+		for (index = 0; index < TEST_TILES; index++)
+		{
+			WaitForThreadpoolWorkCallbacks(work[index], FALSE);
+			CloseThreadpoolWork(work[index]);
+		}
+
+		if (!test_frame_check(&frame, TEST_TILES))
+			goto fail;
+	}
+
+	workTime = GetTickCount64() - start;
+	start = GetTickCount64();
+
+	for (frameIndex = 0; frameIndex < TEST_FRAMES; frameIndex++)
+	{
+		ZeroMemory(&frame, sizeof(frame));
+
+		if (!ThreadpoolParallelFor(parallel, TEST_TILES, test_ParallelCallback, &frame))
+			goto fail;
+
+		if (!test_frame_check(&frame, TEST_TILES))
+			goto fail;
+	}
+
+	parallelTime = GetTickCount64() - start;
+	printf("%d frames of %d tiles: work objects %"PRIu64" ms, parallel for %"PRIu64" ms\n",
+	       TEST_FRAMES, TEST_TILES, workTime, parallelTime);
+	rc = TRUE;
+fail:
+	CloseThreadpoolParallel(parallel);
+	return rc;
+}
+
+int TestPoolParallel(int argc, char* argv[])
+{
+	int rc = -1;
+	PTP_POOL pool;
+	TP_CALLBACK_ENVIRON environment;
+
+	/* default pool, caller only and with helpers */
+	if (!test_parallel(NULL, 1) || !test_parallel(NULL, 4))
+		return -1;
+
+	if (!(pool = CreateThreadpool(NULL)))
+	{
+		printf("CreateThreadpool failure\n");
+		return -1;
+	}
+
+	if (!SetThreadpoolThreadMinimum(pool, 4))
+	{
+		printf("SetThreadpoolThreadMinimum failure\n");
+		goto fail;
+	}
+
+	InitializeThreadpoolEnvironment(&environment);
+	SetThreadpoolCallbackPool(&environment, pool);
+
+	if (!test_parallel(&environment, 0) || !test_parallel(&environment, 8))
+		goto fail;
+
+	if (!test_benchmark(&environment))
+		goto fail;
+
+	rc = 0;
+fail:
+	DestroyThreadpoolEnvironment(&environment);
+	CloseThreadpool(pool);
+	return rc;
+}
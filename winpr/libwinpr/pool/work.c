@@ -149,6 +149,22 @@ VOID winpr_SubmitThreadpoolWork(PTP_WORK pwk)
 	}
 }
 
+#ifndef _WIN32
+/**
+ * Queues pwk with a callback instance owned by the caller, which saves the
+ * allocation for work that is submitted over and over again. The instance
+ * must not be submitted again before its callback returned.
+ */
+VOID SubmitThreadpoolWorkInstance(PTP_WORK pwk, PTP_CALLBACK_INSTANCE pci)
+{
+	PTP_POOL pool = pwk->CallbackEnvironment->Pool;
+	pci->Work = pwk;
+	pci->Owned = TRUE;
+	CountdownEvent_AddCount(pool->WorkComplete, 1);
+	Queue_Enqueue(pool->PendingQueue, pci);
+}
+#endif
+
 BOOL winpr_TrySubmitThreadpoolCallback(PTP_SIMPLE_CALLBACK pfns, PVOID pv,
                                        PTP_CALLBACK_ENVIRON pcbe)
 {
@@ -0,0 +1,215 @@
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#define TEST_EVENT_COUNT 200
+
+struct test_wait_set_context
+{
+	PWINPR_WAIT_SET set;
+	HANDLE events[TEST_EVENT_COUNT];
+	DWORD calls[TEST_EVENT_COUNT];
+	DWORD total;
+};
+typedef struct test_wait_set_context TEST_WAIT_SET_CONTEXT;
+
+static VOID test_wait_set_callback(PVOID Context, HANDLE hHandle)
+{
+	DWORD index;
+	TEST_WAIT_SET_CONTEXT* ctx = (TEST_WAIT_SET_CONTEXT*) Context;
+
+	for (index = 0; index < TEST_EVENT_COUNT; index++)
+	{
+		if (ctx->events[index] == hHandle)
+			ctx->calls[index]++;
+	}
+
+	ctx->total++;
+}
+
+/* removes the first two events, whichever of them is dispatched first */
+static VOID test_wait_set_remove_callback(PVOID Context, HANDLE hHandle)
+{
+	TEST_WAIT_SET_CONTEXT* ctx = (TEST_WAIT_SET_CONTEXT*) Context;
+	ctx->total++;
+	WaitSetRemoveHandle(ctx->set, ctx->events[0]);
+	WaitSetRemoveHandle(ctx->set, ctx->events[1]);
+}
+
+static int test_wait_set_level(TEST_WAIT_SET_CONTEXT* ctx)
+{
+	DWORD index;
+
+	/* more handles than WaitForMultipleObjects can take */
+	for (index = 0; index < TEST_EVENT_COUNT; index++)
+	{
+		if (!WaitSetAddHandle(ctx->set, ctx->events[index], WINPR_WAIT_SET_LEVEL,
+		                      test_wait_set_callback, ctx))
+		{
+			printf("WaitSetAddHandle %"PRIu32" failed\n", index);
+			return -1;
+		}
+	}
+
+	if (WaitSetAddHandle(ctx->set, ctx->events[0], WINPR_WAIT_SET_LEVEL,
+	                     test_wait_set_callback, ctx))
+	{
+		printf("WaitSetAddHandle accepted a handle twice\n");
+		return -1;
+	}
+
+	if (WaitSetGetCount(ctx->set) != TEST_EVENT_COUNT)
+		return -1;
+
+	if (WaitSetDispatch(ctx->set, 10) != WAIT_TIMEOUT || (ctx->total != 0))
+	{
+		printf("WaitSetDispatch without signalled handles failed\n");
+		return -1;
+	}
+
+	SetEvent(ctx->events[5]);
+	SetEvent(ctx->events[77]);
+	SetEvent(ctx->events[TEST_EVENT_COUNT - 1]);
+
+	/* level triggered handles are dispatched while they are signalled */
+	for (index = 0; index < 2; index++)
+	{
+		if (WaitSetDispatch(ctx->set, INFINITE) != WAIT_OBJECT_0)
+			return -1;
+	}
+
+	if ((ctx->total != 6) || (ctx->calls[5] != 2) || (ctx->calls[77] != 2) ||
+	    (ctx->calls[TEST_EVENT_COUNT - 1] != 2))
+	{
+		printf("unexpected level triggered dispatch: %"PRIu32" calls\n", ctx->total);
+		return -1;
+	}
+
+	ResetEvent(ctx->events[5]);
+	ResetEvent(ctx->events[77]);
+	ResetEvent(ctx->events[TEST_EVENT_COUNT - 1]);
+
+	for (index = 0; index < TEST_EVENT_COUNT; index += 2)
+	{
+		if (!WaitSetRemoveHandle(ctx->set, ctx->events[index]))
+			return -1;
+	}
+
+	if (WaitSetGetCount(ctx->set) != TEST_EVENT_COUNT / 2)
+		return -1;
+
+	/* removed handles are not dispatched anymore */
+	ctx->total = 0;
+	SetEvent(ctx->events[10]);
+	SetEvent(ctx->events[11]);
+
+	if ((WaitSetDispatch(ctx->set, INFINITE) != WAIT_OBJECT_0) || (ctx->total != 1) ||
+	    (ctx->calls[10] != 0) || (ctx->calls[11] != 1))
+	{
+		printf("unexpected dispatch after removal\n");
+		return -1;
+	}
+
+	ResetEvent(ctx->events[10]);
+	ResetEvent(ctx->events[11]);
+
+	for (index = 1; index < TEST_EVENT_COUNT; index += 2)
+		WaitSetRemoveHandle(ctx->set, ctx->events[index]);
+
+	return (WaitSetGetCount(ctx->set) == 0) ? 0 : -1;
+}
+
+static int test_wait_set_edge(TEST_WAIT_SET_CONTEXT* ctx)
+{
+	ctx->total = 0;
+
+	if (!WaitSetAddHandle(ctx->set, ctx->events[3], WINPR_WAIT_SET_EDGE,
+	                      test_wait_set_callback, ctx))
+		return -1;
+
+	SetEvent(ctx->events[3]);
+
+	if ((WaitSetDispatch(ctx->set, INFINITE) != WAIT_OBJECT_0) || (ctx->total != 1))
+		return -1;
+
+#ifdef __linux__
+
+	/* no new edge, the event is still signalled */
+	if (WaitSetDispatch(ctx->set, 10) != WAIT_TIMEOUT || (ctx->total != 1))
+	{
+		printf("edge triggered handle dispatched twice\n");
+		return -1;
+	}
+
+#endif
+	ResetEvent(ctx->events[3]);
+	WaitSetRemoveHandle(ctx->set, ctx->events[3]);
+	return 0;
+}
+
+static int test_wait_set_remove_in_callback(TEST_WAIT_SET_CONTEXT* ctx)
+{
+	ctx->total = 0;
+
+	if (!WaitSetAddHandle(ctx->set, ctx->events[0], WINPR_WAIT_SET_LEVEL,
+	                      test_wait_set_remove_callback, ctx) ||
+	    !WaitSetAddHandle(ctx->set, ctx->events[1], WINPR_WAIT_SET_LEVEL,
+	                      test_wait_set_remove_callback, ctx))
+		return -1;
+
+	SetEvent(ctx->events[0]);
+	SetEvent(ctx->events[1]);
+
+	if ((WaitSetDispatch(ctx->set, INFINITE) != WAIT_OBJECT_0) || (ctx->total != 1) ||
+	    (WaitSetGetCount(ctx->set) != 0))
+	{
+		printf("handle removed by a callback was dispatched\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+int TestSynchWaitSet(int argc, char* argv[])
+{
+	int rc = -1;
+	DWORD index;
+	TEST_WAIT_SET_CONTEXT ctx;
+	ZeroMemory(&ctx, sizeof(ctx));
+
+	if (!(ctx.set = CreateWaitSet()))
+	{
+		printf("CreateWaitSet failed\n");
+		return -1;
+	}
+
+	for (index = 0; index < TEST_EVENT_COUNT; index++)
+	{
+		if (!(ctx.events[index] = CreateEvent(NULL, TRUE, FALSE, NULL)))
+			goto fail;
+	}
+
+#ifdef _WIN32
+	/* WaitForMultipleObjects based sets are limited */
+	rc = 0;
+#else
+
+	if (test_wait_set_level(&ctx) < 0)
+		goto fail;
+
+	if (test_wait_set_edge(&ctx) < 0)
+		goto fail;
+
+	if (test_wait_set_remove_in_callback(&ctx) < 0)
+		goto fail;
+
+	rc = 0;
+#endif
+fail:
+	CloseWaitSet(ctx.set);
+
+	for (index = 0; index < TEST_EVENT_COUNT; index++)
+		CloseHandle(ctx.events[index]);
+
+	return rc;
+}
@@ -0,0 +1,490 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Synchronization Functions (Wait Sets)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/collections.h>
+
+#ifndef _WIN32
+#include "../handle/handle.h"
+#endif
+
+#if !defined(_WIN32) && defined(HAVE_SYS_EPOLL_H)
+#define WAIT_SET_EPOLL
+#include <unistd.h>
+#include <sys/epoll.h>
+#elif !defined(_WIN32) && defined(HAVE_POLL_H)
+#define WAIT_SET_POLL
+#include <poll.h>
+#endif
+
+#include "../log.h"
+#define TAG WINPR_TAG("sync.waitset")
+
+/**
+ * With epoll the kernel keeps the registered descriptors, so a dispatch
+ * costs O(signalled handles). The poll backend keeps a persistent pollfd
+ * array that is only changed by add and remove. Elsewhere the handles are
+ * waited for with WaitForMultipleObjects, which limits a set to
+ * MAXIMUM_WAIT_OBJECTS handles.
+ *
+ * Only epoll supports edge triggered handles, the other backends dispatch
+ * them like level triggered ones.
+ *
+ * Handles removed while dispatching are only unlinked; they are freed (and
+ * the arrays compacted) when the dispatch is done.
+ */
+
+#define WAIT_SET_MAX_EVENTS 64
+
+typedef struct _WAIT_SET_ENTRY WAIT_SET_ENTRY;
+
+struct _WAIT_SET_ENTRY
+{
+	HANDLE handle;
+	DWORD flags;
+	PWAIT_SET_CALLBACK callback;
+	PVOID context;
+	BOOL removed;
+#ifndef _WIN32
+	int fd;
+#endif
+#ifndef WAIT_SET_EPOLL
+	DWORD index;
+#endif
+	WAIT_SET_ENTRY* next;
+};
+
+struct _WINPR_WAIT_SET
+{
+	wHashTable* entries;
+	WAIT_SET_ENTRY* garbage;
+	BOOL dispatching;
+#if defined(WAIT_SET_EPOLL)
+	int epfd;
+	struct epoll_event events[WAIT_SET_MAX_EVENTS];
+#else
+	DWORD count;
+	DWORD capacity;
+	WAIT_SET_ENTRY** polled;
+#if defined(WAIT_SET_POLL)
+	struct pollfd* fds;
+#else
+	HANDLE* handles;
+#endif
+#endif
+};
+
+#ifndef WAIT_SET_EPOLL
+
+static BOOL wait_set_append(PWINPR_WAIT_SET set, WAIT_SET_ENTRY* entry)
+{
+	if (set->count >= set->capacity)
+	{
+		WAIT_SET_ENTRY** polled;
+		DWORD capacity = set->capacity ? set->capacity * 2 : 16;
+#if defined(WAIT_SET_POLL)
+		struct pollfd* fds;
+#else
+		HANDLE* handles;
+
+		if (set->count >= MAXIMUM_WAIT_OBJECTS)
+			return FALSE;
+
+#endif
+
+		if (!(polled = (WAIT_SET_ENTRY**) realloc(set->polled, capacity * sizeof(WAIT_SET_ENTRY*))))
+			return FALSE;
+
+		set->polled = polled;
+#if defined(WAIT_SET_POLL)
+
+		if (!(fds = (struct pollfd*) realloc(set->fds, capacity * sizeof(struct pollfd))))
+			return FALSE;
+
+		set->fds = fds;
+#else
+
+		if (!(handles = (HANDLE*) realloc(set->handles, capacity * sizeof(HANDLE))))
+			return FALSE;
+
+		set->handles = handles;
+#endif
+		set->capacity = capacity;
+	}
+
+	entry->index = set->count;
+	set->polled[set->count] = entry;
+#if defined(WAIT_SET_POLL)
+	set->fds[set->count].fd = entry->fd;
+	set->fds[set->count].events = 0;
+	set->fds[set->count].revents = 0;
+
+	if (((WINPR_HANDLE*) entry->handle)->Mode & WINPR_FD_READ)
+		set->fds[set->count].events |= POLLIN;
+
+	if (((WINPR_HANDLE*) entry->handle)->Mode & WINPR_FD_WRITE)
+		set->fds[set->count].events |= POLLOUT;
+
+#else
+	set->handles[set->count] = entry->handle;
+#endif
+	set->count++;
+	return TRUE;
+}
+
+/* moves the last entry into the slot of the removed one */
+static void wait_set_unlink(PWINPR_WAIT_SET set, WAIT_SET_ENTRY* entry)
+{
+	const DWORD index = entry->index;
+	const DWORD last = set->count - 1;
+
+	if (index != last)
+	{
+		set->polled[index] = set->polled[last];
+		set->polled[index]->index = index;
+#if defined(WAIT_SET_POLL)
+		set->fds[index] = set->fds[last];
+#else
+		set->handles[index] = set->handles[last];
+#endif
+	}
+
+	set->count--;
+}
+
+#endif
+
+static void wait_set_collect(PWINPR_WAIT_SET set)
+{
+	WAIT_SET_ENTRY* entry;
+
+	while ((entry = set->garbage))
+	{
+		set->garbage = entry->next;
+#ifndef WAIT_SET_EPOLL
+		wait_set_unlink(set, entry);
+#endif
+		free(entry);
+	}
+}
+
+PWINPR_WAIT_SET CreateWaitSet(void)
+{
+	PWINPR_WAIT_SET set = (PWINPR_WAIT_SET) calloc(1, sizeof(WINPR_WAIT_SET));
+
+	if (!set)
+		return NULL;
+
+	if (!(set->entries = HashTable_New(FALSE)))
+		goto fail;
+
+#if defined(WAIT_SET_EPOLL)
+	set->epfd = epoll_create1(EPOLL_CLOEXEC);
+
+	if (set->epfd < 0)
+	{
+		WLog_ERR(TAG, "epoll_create1 failed [%d] %s", errno, strerror(errno));
+		goto fail;
+	}
+
+#endif
+	return set;
+fail:
+	HashTable_Free(set->entries);
+	free(set);
+	return NULL;
+}
+
+VOID CloseWaitSet(PWINPR_WAIT_SET pWaitSet)
+{
+	int index;
+	int count;
+	ULONG_PTR* keys = NULL;
+
+	if (!pWaitSet)
+		return;
+
+	count = HashTable_GetKeys(pWaitSet->entries, &keys);
+
+	for (index = 0; index < count; index++)
+		free(HashTable_GetItemValue(pWaitSet->entries, (void*) keys[index]));
+
+	free(keys);
+	HashTable_Free(pWaitSet->entries);
+	wait_set_collect(pWaitSet);
+#if defined(WAIT_SET_EPOLL)
+	close(pWaitSet->epfd);
+#else
+	free(pWaitSet->polled);
+#if defined(WAIT_SET_POLL)
+	free(pWaitSet->fds);
+#else
+	free(pWaitSet->handles);
+#endif
+#endif
+	free(pWaitSet);
+}
+
+/**
+ * Registers hHandle, pfnCallback(pContext, hHandle) is called from
+ * WaitSetDispatch when the handle is signalled. A handle can only be in a
+ * set once and must be removed before it is closed.
+ */
+BOOL WaitSetAddHandle(PWINPR_WAIT_SET pWaitSet, HANDLE hHandle, DWORD dwFlags,
+                      PWAIT_SET_CALLBACK pfnCallback, PVOID pContext)
+{
+	WAIT_SET_ENTRY* entry;
+#ifndef _WIN32
+	int fd;
+#endif
+#if defined(WAIT_SET_EPOLL)
+	struct epoll_event event = { 0 };
+#endif
+
+	if (!pWaitSet || !hHandle || !pfnCallback)
+		return FALSE;
+
+	if (HashTable_Contains(pWaitSet->entries, hHandle))
+		return FALSE;
+
+#ifndef _WIN32
+
+	if ((fd = winpr_Handle_getFd(hHandle)) < 0)
+	{
+		WLog_ERR(TAG, "handle %p has no file descriptor", hHandle);
+		SetLastError(ERROR_INVALID_HANDLE);
+		return FALSE;
+	}
+
+#endif
+
+	if (!(entry = (WAIT_SET_ENTRY*) calloc(1, sizeof(WAIT_SET_ENTRY))))
+		return FALSE;
+
+	entry->handle = hHandle;
+	entry->flags = dwFlags;
+	entry->callback = pfnCallback;
+	entry->context = pContext;
+#ifndef _WIN32
+	entry->fd = fd;
+#endif
+#if defined(WAIT_SET_EPOLL)
+
+	if (((WINPR_HANDLE*) hHandle)->Mode & WINPR_FD_READ)
+		event.events |= EPOLLIN;
+
+	if (((WINPR_HANDLE*) hHandle)->Mode & WINPR_FD_WRITE)
+		event.events |= EPOLLOUT;
+
+	if (dwFlags & WINPR_WAIT_SET_EDGE)
+		event.events |= EPOLLET;
+
+	event.data.ptr = entry;
+
+	if (epoll_ctl(pWaitSet->epfd, EPOLL_CTL_ADD, fd, &event) < 0)
+	{
+		WLog_ERR(TAG, "epoll_ctl(ADD, %d) failed [%d] %s", fd, errno, strerror(errno));
+		free(entry);
+		return FALSE;
+	}
+
+#else
+
+	if (!wait_set_append(pWaitSet, entry))
+	{
+		free(entry);
+		return FALSE;
+	}
+
+#endif
+
+	if (HashTable_Add(pWaitSet->entries, hHandle, entry) < 0)
+	{
+#if defined(WAIT_SET_EPOLL)
+		epoll_ctl(pWaitSet->epfd, EPOLL_CTL_DEL, fd, &event);
+#else
+		wait_set_unlink(pWaitSet, entry);
+#endif
+		free(entry);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+BOOL WaitSetRemoveHandle(PWINPR_WAIT_SET pWaitSet, HANDLE hHandle)
+{
+	WAIT_SET_ENTRY* entry;
+
+	if (!pWaitSet)
+		return FALSE;
+
+	if (!(entry = (WAIT_SET_ENTRY*) HashTable_GetItemValue(pWaitSet->entries, hHandle)))
+		return FALSE;
+
+	HashTable_Remove(pWaitSet->entries, hHandle);
+#if defined(WAIT_SET_EPOLL)
+
+	if (epoll_ctl(pWaitSet->epfd, EPOLL_CTL_DEL, entry->fd, NULL) < 0)
+		WLog_WARN(TAG, "epoll_ctl(DEL, %d) failed [%d] %s", entry->fd, errno, strerror(errno));
+
+#endif
+	entry->removed = TRUE;
+	entry->next = pWaitSet->garbage;
+	pWaitSet->garbage = entry;
+
+	if (!pWaitSet->dispatching)
+		wait_set_collect(pWaitSet);
+
+	return TRUE;
+}
+
+DWORD WaitSetGetCount(PWINPR_WAIT_SET pWaitSet)
+{
+	if (!pWaitSet)
+		return 0;
+
+	return (DWORD) HashTable_Count(pWaitSet->entries);
+}
+
+static BOOL wait_set_dispatch_entry(WAIT_SET_ENTRY* entry)
+{
+	if (entry->removed)
+		return FALSE;
+
+#ifndef _WIN32
+
+	if (winpr_Handle_cleanup(entry->handle) != WAIT_OBJECT_0)
+	{
+		WLog_WARN(TAG, "cleanup of handle %p failed", entry->handle);
+		return FALSE;
+	}
+
+#endif
+	entry->callback(entry->context, entry->handle);
+	return TRUE;
+}
+
+/**
+ * Waits up to dwMilliseconds for any handle of the set and dispatches the
+ * callbacks of all signalled handles. Returns WAIT_OBJECT_0 if handles
+ * were signalled, WAIT_TIMEOUT or WAIT_FAILED.
+ */
+DWORD WaitSetDispatch(PWINPR_WAIT_SET pWaitSet, DWORD dwMilliseconds)
+{
+	int status;
+	DWORD index;
+	DWORD polled;
+#if defined(WAIT_SET_POLL)
+	int signalled;
+#endif
+
+	if (!pWaitSet || pWaitSet->dispatching)
+		return WAIT_FAILED;
+
+#if defined(WAIT_SET_EPOLL)
+
+	do
+	{
+		status = epoll_wait(pWaitSet->epfd, pWaitSet->events, WAIT_SET_MAX_EVENTS,
+		                    (dwMilliseconds == INFINITE) ? -1 : (int) dwMilliseconds);
+	}
+	while ((status < 0) && (errno == EINTR));
+
+	if (status < 0)
+	{
+		WLog_ERR(TAG, "epoll_wait failed [%d] %s", errno, strerror(errno));
+		return WAIT_FAILED;
+	}
+
+	polled = (DWORD) status;
+	pWaitSet->dispatching = TRUE;
+
+	for (index = 0; index < polled; index++)
+		wait_set_dispatch_entry((WAIT_SET_ENTRY*) pWaitSet->events[index].data.ptr);
+
+#elif defined(WAIT_SET_POLL)
+
+	do
+	{
+		status = poll(pWaitSet->fds, pWaitSet->count,
+		              (dwMilliseconds == INFINITE) ? -1 : (int) dwMilliseconds);
+	}
+	while ((status < 0) && (errno == EINTR));
+
+	if (status < 0)
+	{
+		WLog_ERR(TAG, "poll failed [%d] %s", errno, strerror(errno));
+		return WAIT_FAILED;
+	}
+
+	/* entries added by callbacks are beyond the polled range */
+	polled = pWaitSet->count;
+	pWaitSet->dispatching = TRUE;
+
+	for (index = 0, signalled = 0; (index < polled) && (signalled < status); index++)
+	{
+		if (pWaitSet->fds[index].revents & pWaitSet->fds[index].events)
+		{
+			signalled++;
+			wait_set_dispatch_entry(pWaitSet->polled[index]);
+		}
+	}
+
+#else
+
+	if (pWaitSet->count == 0)
+	{
+		if (dwMilliseconds == INFINITE)
+			return WAIT_FAILED;
+
+		Sleep(dwMilliseconds);
+		return WAIT_TIMEOUT;
+	}
+
+	index = WaitForMultipleObjects(pWaitSet->count, pWaitSet->handles, FALSE, dwMilliseconds);
+
+	if (index == WAIT_TIMEOUT)
+		return WAIT_TIMEOUT;
+
+	if (index >= WAIT_OBJECT_0 + pWaitSet->count)
+		return WAIT_FAILED;
+
+	polled = pWaitSet->count;
+	pWaitSet->dispatching = TRUE;
+	wait_set_dispatch_entry(pWaitSet->polled[index - WAIT_OBJECT_0]);
+
+	/* dispatch the other handles that are signalled as well */
+	for (index = index - WAIT_OBJECT_0 + 1; index < polled; index++)
+	{
+		if (WaitForSingleObject(pWaitSet->handles[index], 0) == WAIT_OBJECT_0)
+			wait_set_dispatch_entry(pWaitSet->polled[index]);
+	}
+
+	status = 1;
+#endif
+	pWaitSet->dispatching = FALSE;
+	wait_set_collect(pWaitSet);
+	return (status > 0) ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+}
@@ -0,0 +1,182 @@
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/interlocked.h>
+#include <winpr/sysinfo.h>
+
+#define TEST_THREAD_BATCH 250
+#define TEST_THREAD_ROUNDS 40
+
+struct test_thread_slot
+{
+	HANDLE handle;
+	HANDLE release;
+	LONG* running;
+	BOOL useExitThread;
+	BOOL matched;
+};
+typedef struct test_thread_slot TEST_THREAD_SLOT;
+
+static DWORD WINAPI test_thread_func(LPVOID arg)
+{
+	TEST_THREAD_SLOT* slot = (TEST_THREAD_SLOT*) arg;
+	const BOOL useExitThread = slot->useExitThread;
+	slot->matched = (_GetCurrentThread() == slot->handle);
+
+	if (slot->release)
+		WaitForSingleObject(slot->release, INFINITE);
+
+	/* the slot may be reused once the counter dropped */
+	InterlockedDecrement(slot->running);
+
+	if (useExitThread)
+		ExitThread(42);
+
+	return 42;
+}
+
+static BOOL test_thread_start(TEST_THREAD_SLOT* slot)
+{
+	/* the handle has to be known to the thread before it runs */
+	slot->handle = CreateThread(NULL, 0, test_thread_func, slot, CREATE_SUSPENDED, NULL);
+
+	if (!slot->handle)
+		return FALSE;
+
+	return ResumeThread(slot->handle) != (DWORD) - 1;
+}
+
+/* all threads of a batch are alive at the same time, then joined and closed */
+static int test_thread_joined_round(TEST_THREAD_SLOT* slots, HANDLE release, LONG* running)
+{
+	DWORD index;
+	int rc = 0;
+	ResetEvent(release);
+	*running = TEST_THREAD_BATCH;
+
+	for (index = 0; index < TEST_THREAD_BATCH; index++)
+	{
+		slots[index].release = release;
+		slots[index].running = running;
+		slots[index].useExitThread = (index % 2) ? TRUE : FALSE;
+		slots[index].matched = FALSE;
+
+		if (!test_thread_start(&slots[index]))
+		{
+			printf("failed to start thread %"PRIu32"\n", index);
+			return -1;
+		}
+	}
+
+	SetEvent(release);
+
+	for (index = 0; index < TEST_THREAD_BATCH; index++)
+	{
+		DWORD code = 0;
+
+		if (WaitForSingleObject(slots[index].handle, 10000) != WAIT_OBJECT_0)
+		{
+			printf("thread %"PRIu32" did not finish\n", index);
+			return -1;
+		}
+
+		if (!GetExitCodeThread(slots[index].handle, &code) || (code != 42) ||
+		    !slots[index].matched)
+		{
+			printf("thread %"PRIu32" exit code %"PRIu32", current handle %s\n", index, code,
+			       slots[index].matched ? "matched" : "mismatch");
+			rc = -1;
+		}
+
+		CloseHandle(slots[index].handle);
+	}
+
+	return rc;
+}
+
+/* handles are closed while the threads still run, the threads free them on exit */
+static int test_thread_detached_round(TEST_THREAD_SLOT* slots, HANDLE release, LONG* running)
+{
+	DWORD index;
+	ResetEvent(release);
+	*running = TEST_THREAD_BATCH;
+
+	for (index = 0; index < TEST_THREAD_BATCH; index++)
+	{
+		slots[index].release = release;
+		slots[index].running = running;
+		slots[index].useExitThread = (index % 2) ? FALSE : TRUE;
+
+		if (!test_thread_start(&slots[index]))
+		{
+			printf("failed to start thread %"PRIu32"\n", index);
+			return -1;
+		}
+
+		CloseHandle(slots[index].handle);
+	}
+
+	SetEvent(release);
+
+	for (index = 0; (index < 10000) && (*running > 0); index++)
+		Sleep(1);
+
+	if (*running > 0)
+	{
+		printf("%"PRId32" detached threads did not finish\n", *running);
+		return -1;
+	}
+
+	return 0;
+}
+
+int TestThreadRegistry(int argc, char* argv[])
+{
+	int rc = -1;
+	DWORD round;
+	UINT64 start;
+	LONG running = 0;
+	HANDLE release;
+	TEST_THREAD_SLOT* slots;
+
+	if (_GetCurrentThread() != NULL)
+	{
+		printf("main thread has a thread handle\n");
+		return -1;
+	}
+
+	slots = (TEST_THREAD_SLOT*) calloc(TEST_THREAD_BATCH, sizeof(TEST_THREAD_SLOT));
+	release = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (!slots || !release)
+		goto fail;
+
+	start = GetTickCount64();
+
+	for (round = 0; round < TEST_THREAD_ROUNDS; round++)
+	{
+		int status;
+
+		if (round % 4 == 3)
+			status = test_thread_detached_round(slots, release, &running);
+		else
+			status = test_thread_joined_round(slots, release, &running);
+
+		if (status < 0)
+		{
+			printf("round %"PRIu32" failed\n", round);
+			goto fail;
+		}
+	}
+
+	printf("started and stopped %d threads in %"PRIu64" ms\n",
+	       TEST_THREAD_BATCH * TEST_THREAD_ROUNDS, GetTickCount64() - start);
+	rc = 0;
+fail:
+	/* give detached threads the chance to release their handles */
+	Sleep(10);
+	CloseHandle(release);
+	free(slots);
+	return rc;
+}
@@ -86,15 +86,32 @@
 #include <errno.h>
 #include <fcntl.h>
 
-#include <winpr/collections.h>
-
 #include "thread.h"
 
 #include "../handle/handle.h"
 #include "../log.h"
 #define TAG WINPR_TAG("thread")
 
-static wListDictionary* thread_list = NULL;
+/**
+ * Every thread handle is registered in one of several independently locked
+ * shards, selected by a hash of the handle address. The shard lock serializes
+ * the exit and close paths of a thread, registration is an intrusive list
+ * operation and the current thread handle lives in a thread local slot, so
+ * none of these operations depend on the number of running threads.
+ */
+#define THREAD_REGISTRY_SHARDS 64
+
+struct winpr_thread_registry_shard
+{
+	pthread_mutex_t lock;
+	WINPR_THREAD* head;
+};
+typedef struct winpr_thread_registry_shard WINPR_THREAD_REGISTRY_SHARD;
+
+static pthread_once_t thread_registry_once = PTHREAD_ONCE_INIT;
+static BOOL thread_registry_initialized = FALSE;
+static pthread_key_t thread_current_key;
+static WINPR_THREAD_REGISTRY_SHARD thread_registry[THREAD_REGISTRY_SHARDS];
 
 static BOOL ThreadCloseHandle(HANDLE handle);
 static void cleanup_handle(void* obj);
@@ -285,12 +302,120 @@ static BOOL reset_event(WINPR_THREAD* thread)
 	return status;
 }
 
-static BOOL thread_compare(const void* a, const void* b)
+static void thread_registry_init(void)
 {
-	const pthread_t* p1 = a;
-	const pthread_t* p2 = b;
-	BOOL rc = pthread_equal(*p1, *p2);
-	return rc;
+	size_t index;
+
+	for (index = 0; index < THREAD_REGISTRY_SHARDS; index++)
+	{
+		if (pthread_mutex_init(&thread_registry[index].lock, NULL) != 0)
+			return;
+	}
+
+	if (pthread_key_create(&thread_current_key, NULL) != 0)
+		return;
+
+	thread_registry_initialized = TRUE;
+}
+
+static BOOL thread_registry_ensure(void)
+{
+	if (pthread_once(&thread_registry_once, thread_registry_init) != 0)
+		return FALSE;
+
+	return thread_registry_initialized;
+}
+
+static WINPR_THREAD_REGISTRY_SHARD* thread_registry_shard(WINPR_THREAD* thread)
+{
+	/* handles are heap allocated, drop the alignment bits before mixing */
+	UINT64 hash = ((UINT64)(ULONG_PTR) thread) >> 4;
+	hash *= 0x9E3779B97F4A7C15ULL;
+	return &thread_registry[(hash >> 32) % THREAD_REGISTRY_SHARDS];
+}
+
+static BOOL thread_registry_add(WINPR_THREAD* thread)
+{
+	WINPR_THREAD_REGISTRY_SHARD* shard;
+
+	if (!thread_registry_ensure())
+		return FALSE;
+
+	shard = thread_registry_shard(thread);
+
+	if (pthread_mutex_lock(&shard->lock))
+		return FALSE;
+
+	thread->registryPrev = NULL;
+	thread->registryNext = shard->head;
+
+	if (shard->head)
+		shard->head->registryPrev = thread;
+
+	shard->head = thread;
+	thread->registered = TRUE;
+	pthread_mutex_unlock(&shard->lock);
+	return TRUE;
+}
+
+static void thread_registry_remove(WINPR_THREAD* thread)
+{
+	WINPR_THREAD_REGISTRY_SHARD* shard;
+
+	if (!thread->registered)
+		return;
+
+	shard = thread_registry_shard(thread);
+
+	if (pthread_mutex_lock(&shard->lock))
+		return;
+
+	if (thread->registryPrev)
+		thread->registryPrev->registryNext = thread->registryNext;
+	else
+		shard->head = thread->registryNext;
+
+	if (thread->registryNext)
+		thread->registryNext->registryPrev = thread->registryPrev;
+
+	thread->registryPrev = NULL;
+	thread->registryNext = NULL;
+	thread->registered = FALSE;
+	pthread_mutex_unlock(&shard->lock);
+}
+
+static WINPR_THREAD* thread_registry_current(void)
+{
+	if (!thread_registry_ensure())
+		return NULL;
+
+	return (WINPR_THREAD*) pthread_getspecific(thread_current_key);
+}
+
+/* Marks the thread as finished. Returns TRUE if the calling thread has to
+ * free the handle, because it has been closed while still running. */
+static BOOL thread_set_exited(WINPR_THREAD* thread, BOOL exited, DWORD dwExitCode)
+{
+	BOOL cleanup;
+	WINPR_THREAD_REGISTRY_SHARD* shard = thread_registry_shard(thread);
+	pthread_mutex_lock(&shard->lock);
+
+	if (exited)
+	{
+		thread->exited = TRUE;
+		thread->dwExitCode = dwExitCode;
+#if defined(WITH_DEBUG_THREADS)
+		thread->exit_stack = winpr_backtrace(20);
+#endif
+	}
+	else if (!thread->exited)
+		thread->dwExitCode = dwExitCode;
+
+	set_event(thread);
+	cleanup = thread->detached || !thread->started;
+	pthread_mutex_unlock(&shard->lock);
+	pthread_setspecific(thread_current_key, NULL);
+	return cleanup;
 }
 
 /* Thread launcher function responsible for registering
@@ -314,10 +439,16 @@ static void* thread_launcher(void* arg)
 		goto exit;
 	}
 
+	if (pthread_setspecific(thread_current_key, thread) != 0)
+	{
+		WLog_ERR(TAG, "failed to set the current thread handle");
+		goto exit;
+	}
+
 	if (pthread_mutex_lock(&thread->threadIsReadyMutex))
 		goto exit;
 
-	if (!ListDictionary_Contains(thread_list, &thread->thread))
+	while (!thread->ready)
 	{
 		if (pthread_cond_wait(&thread->threadIsReady, &thread->threadIsReadyMutex) != 0)
 		{
@@ -330,18 +461,13 @@ static void* thread_launcher(void* arg)
 	if (pthread_mutex_unlock(&thread->threadIsReadyMutex))
 		goto exit;
 
-	assert(ListDictionary_Contains(thread_list, &thread->thread));
+	assert(thread->registered);
 	rc = fkt(thread->lpParameter);
 exit:
 
 	if (thread)
 	{
-		if (!thread->exited)
-			thread->dwExitCode = rc;
-
-		set_event(thread);
-
-		if (thread->detached || !thread->started)
+		if (thread_set_exited(thread, FALSE, rc))
 			cleanup_handle(thread);
 	}
 
@@ -366,12 +492,7 @@ static BOOL winpr_StartThread(WINPR_THREAD* thread)
 	if (pthread_mutex_lock(&thread->threadIsReadyMutex))
 		goto error;
 
-	if (!ListDictionary_Add(thread_list, &thread->thread, thread))
-	{
-		WLog_ERR(TAG, "failed to add the thread to the thread list");
-		pthread_mutex_unlock(&thread->threadIsReadyMutex);
-		goto error;
-	}
+	thread->ready = TRUE;
 
 	if (pthread_cond_signal(&thread->threadIsReady) != 0)
 	{
@@ -459,31 +580,26 @@ HANDLE CreateThread(LPSECURITY_ATTRIBUTES lpThreadAttributes,
 	WINPR_HANDLE_SET_TYPE_AND_MODE(thread, HANDLE_TYPE_THREAD, WINPR_FD_READ);
 	handle = (HANDLE) thread;
 
-	if (!thread_list)
+	if (!thread_registry_add(thread))
 	{
-		thread_list = ListDictionary_New(TRUE);
-
-		if (!thread_list)
-		{
-			WLog_ERR(TAG, "Couldn't create global thread list");
-			goto error_thread_list;
-		}
-
-		thread_list->objectKey.fnObjectEquals = thread_compare;
+		WLog_ERR(TAG, "Couldn't register the thread");
+		goto error_thread_list;
 	}
 
 	if (!(dwCreationFlags & CREATE_SUSPENDED))
 	{
 		if (!winpr_StartThread(thread))
-			goto error_thread_list;
+			goto error_thread_start;
 	}
 	else
 	{
 		if (!set_event(thread))
-			goto error_thread_list;
+			goto error_thread_start;
 	}
 
 	return handle;
+error_thread_start:
+	thread_registry_remove(thread);
 error_thread_list:
 	pthread_cond_destroy(&thread->threadIsReady);
 error_thread_ready:
@@ -507,6 +623,7 @@ void cleanup_handle(void* obj)
 {
 	int rc;
 	WINPR_THREAD* thread = (WINPR_THREAD*) obj;
+	thread_registry_remove(thread);
 	rc = pthread_cond_destroy(&thread->threadIsReady);
 
 	if (rc)
@@ -531,9 +648,6 @@ void cleanup_handle(void* obj)
 	if (thread->pipe_fd[1] >= 0)
 		close(thread->pipe_fd[1]);
 
-	if (thread_list && ListDictionary_Contains(thread_list, &thread->thread))
-		ListDictionary_Remove(thread_list, &thread->thread);
-
 #if defined(WITH_DEBUG_THREADS)
 
 	if (thread->create_stack)
@@ -548,43 +662,37 @@ void cleanup_handle(void* obj)
 
 BOOL ThreadCloseHandle(HANDLE handle)
 {
+	BOOL cleanup = TRUE;
+	WINPR_THREAD_REGISTRY_SHARD* shard;
 	WINPR_THREAD* thread = (WINPR_THREAD*) handle;
 
-	if (!thread_list)
-	{
-		WLog_ERR(TAG, "Thread list does not exist, check call!");
-		dump_thread(thread);
-	}
-	else if (!ListDictionary_Contains(thread_list, &thread->thread))
+	if (!thread->registered)
 	{
-		WLog_ERR(TAG, "Thread list does not contain this thread! check call!");
+		WLog_ERR(TAG, "Thread registry does not contain this thread! check call!");
 		dump_thread(thread);
+		return TRUE;
 	}
-	else
-	{
-		ListDictionary_Lock(thread_list);
-		dump_thread(thread);
 
-		if ((thread->started) && (WaitForSingleObject(thread, 0) != WAIT_OBJECT_0))
-		{
-			WLog_ERR(TAG, "Thread running, setting to detached state!");
-			thread->detached = TRUE;
-			pthread_detach(thread->thread);
-		}
-		else
-		{
-			cleanup_handle(thread);
-		}
+	shard = thread_registry_shard(thread);
 
-		ListDictionary_Unlock(thread_list);
+	if (pthread_mutex_lock(&shard->lock))
+		return FALSE;
 
-		if (ListDictionary_Count(thread_list) < 1)
-		{
-			ListDictionary_Free(thread_list);
-			thread_list = NULL;
-		}
+	dump_thread(thread);
+
+	if ((thread->started) && (WaitForSingleObject(thread, 0) != WAIT_OBJECT_0))
+	{
+		WLog_ERR(TAG, "Thread running, setting to detached state!");
+		thread->detached = TRUE;
+		pthread_detach(thread->thread);
+		cleanup = FALSE;
 	}
 
+	pthread_mutex_unlock(&shard->lock);
+
+	if (cleanup)
+		cleanup_handle(thread);
+
 	return TRUE;
 }
 
@@ -600,20 +708,11 @@ HANDLE CreateRemoteThread(HANDLE hProcess,
 
 VOID ExitThread(DWORD dwExitCode)
 {
-	DWORD rc;
-	pthread_t tid = pthread_self();
+	WINPR_THREAD* thread = thread_registry_current();
 
-	if (!thread_list)
-	{
-		WLog_ERR(TAG, "function called without existing thread list!");
-#if defined(WITH_DEBUG_THREADS)
-		DumpThreadHandles();
-#endif
-		pthread_exit(0);
-	}
-	else if (!ListDictionary_Contains(thread_list, &tid))
+	if (!thread)
 	{
-		WLog_ERR(TAG, "function called, but no matching entry in thread list!");
+		WLog_ERR(TAG, "function called, but the thread was not created by CreateThread!");
 #if defined(WITH_DEBUG_THREADS)
 		DumpThreadHandles();
 #endif
@@ -621,23 +720,10 @@ VOID ExitThread(DWORD dwExitCode)
 	}
 	else
 	{
-		WINPR_THREAD* thread;
-		ListDictionary_Lock(thread_list);
-		thread = ListDictionary_GetItemValue(thread_list, &tid);
-		assert(thread);
-		thread->exited = TRUE;
-		thread->dwExitCode = dwExitCode;
-#if defined(WITH_DEBUG_THREADS)
-		thread->exit_stack = winpr_backtrace(20);
-#endif
-		ListDictionary_Unlock(thread_list);
-		set_event(thread);
-		rc = thread->dwExitCode;
-
-		if (thread->detached || !thread->started)
+		if (thread_set_exited(thread, TRUE, dwExitCode))
 			cleanup_handle(thread);
 
-		pthread_exit((void*)(size_t) rc);
+		pthread_exit((void*)(size_t) dwExitCode);
 	}
 }
 
@@ -657,27 +743,15 @@ BOOL GetExitCodeThread(HANDLE hThread, LPDWORD lpExitCode)
 
 HANDLE _GetCurrentThread(VOID)
 {
-	HANDLE hdl = NULL;
-	pthread_t tid = pthread_self();
+	HANDLE hdl = (HANDLE) thread_registry_current();
 
-	if (!thread_list)
-	{
-		WLog_ERR(TAG, "function called without existing thread list!");
-#if defined(WITH_DEBUG_THREADS)
-		DumpThreadHandles();
-#endif
-	}
-	else if (!ListDictionary_Contains(thread_list, &tid))
+	if (!hdl)
 	{
-		WLog_ERR(TAG, "function called, but no matching entry in thread list!");
+		WLog_ERR(TAG, "function called, but the thread was not created by CreateThread!");
 #if defined(WITH_DEBUG_THREADS)
 		DumpThreadHandles();
 #endif
 	}
-	else
-	{
-		hdl = ListDictionary_GetItemValue(thread_list, &tid);
-	}
 
 	return hdl;
 }
@@ -788,49 +862,50 @@ VOID DumpThreadHandles(void)
 	winpr_backtrace_free(stack);
 	WLog_DBG(TAG, "---------------- Start Dumping thread handles -----------");
 
-	if (!thread_list)
-	{
-		WLog_DBG(TAG, "All threads properly shut down and disposed of.");
-	}
-	else
+	if (thread_registry_ensure())
 	{
-		ULONG_PTR* keys = NULL;
-		ListDictionary_Lock(thread_list);
-		int x, count = ListDictionary_GetKeys(thread_list, &keys);
-		WLog_DBG(TAG, "Dumping %d elements", count);
+		size_t index;
+		int x = 0;
 
-		for (x = 0; x < count; x++)
+		for (index = 0; index < THREAD_REGISTRY_SHARDS; index++)
 		{
-			WINPR_THREAD* thread = ListDictionary_GetItemValue(thread_list,
-			                       (void*) keys[x]);
-			WLog_DBG(TAG, "Thread [%d] handle created still not closed!", x);
-			msg = winpr_backtrace_symbols(thread->create_stack, &used);
-
-			for (i = 0; i < used; i++)
-			{
-				WLog_DBG(TAG, "[%"PRIdz"]: %s", i, msg[i]);
-			}
-
-			free(msg);
+			WINPR_THREAD* thread;
+			WINPR_THREAD_REGISTRY_SHARD* shard = &thread_registry[index];
+			pthread_mutex_lock(&shard->lock);
 
-			if (thread->started)
-			{
-				WLog_DBG(TAG, "Thread [%d] still running!",	x);
-			}
-			else
+			for (thread = shard->head; thread; thread = thread->registryNext, x++)
 			{
-				WLog_DBG(TAG, "Thread [%d] exited at:", x);
-				msg = winpr_backtrace_symbols(thread->exit_stack, &used);
+				WLog_DBG(TAG, "Thread [%d] handle created still not closed!", x);
+				msg = winpr_backtrace_symbols(thread->create_stack, &used);
 
 				for (i = 0; i < used; i++)
+				{
 					WLog_DBG(TAG, "[%"PRIdz"]: %s", i, msg[i]);
+				}
 
 				free(msg);
+
+				if (thread->started)
+				{
+					WLog_DBG(TAG, "Thread [%d] still running!",	x);
+				}
+				else
+				{
+					WLog_DBG(TAG, "Thread [%d] exited at:", x);
+					msg = winpr_backtrace_symbols(thread->exit_stack, &used);
+
+					for (i = 0; i < used; i++)
+						WLog_DBG(TAG, "[%"PRIdz"]: %s", i, msg[i]);
+
+					free(msg);
+				}
 			}
+
+			pthread_mutex_unlock(&shard->lock);
 		}
 
-		free(keys);
-		ListDictionary_Unlock(thread_list);
+		if (x == 0)
+			WLog_DBG(TAG, "All threads properly shut down and disposed of.");
 	}
 
 	WLog_DBG(TAG, "---------------- End Dumping thread handles -------------");
@@ -36,6 +36,8 @@ struct winpr_thread
 	WINPR_HANDLE_DEF();
 
 	BOOL started;
+	BOOL ready;
+	BOOL registered;
 	int pipe_fd[2];
 	BOOL mainProcess;
 	BOOL detached;
@@ -50,6 +52,8 @@ struct winpr_thread
 	pthread_cond_t threadIsReady;
 	LPTHREAD_START_ROUTINE lpStartAddress;
 	LPSECURITY_ATTRIBUTES lpThreadAttributes;
+	struct winpr_thread* registryPrev;
+	struct winpr_thread* registryNext;
 #if defined(WITH_DEBUG_THREADS)
 	void *create_stack;
 	void *exit_stack;
@@ -22,119 +22,322 @@
 #endif
 
 #include <winpr/crt.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
 
 #include <winpr/collections.h>
 
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+/**
+ * Per-thread cache of a synchronized pool. Only the owning thread touches
+ * the lists. The magazines of a thread are kept in one process-wide thread
+ * slot, when the thread exits its streams go back to the shared lists of
+ * the pool. A freed pool orphans its magazines, the owning thread frees them.
+ */
+struct _wStreamPoolMagazine
+{
+	wStreamPool* pool;
+	wStreamPoolMagazine* next;
+	wStreamPoolMagazine* threadNext;
+	wStream* streams[STREAMPOOL_MAGAZINE_CLASSES];
+	UINT32 counts[STREAMPOOL_MAGAZINE_CLASSES];
+	UINT64 hits;
+};
+
+static INIT_ONCE StreamPool_InitOnce = INIT_ONCE_STATIC_INIT;
+static BOOL StreamPool_ThreadSlotValid = FALSE;
+
+/* protects the magazine to pool links against thread exit and pool destruction */
+static CRITICAL_SECTION StreamPool_MagazineLock;
+
+#if defined(_WIN32)
+static DWORD StreamPool_ThreadSlot = FLS_OUT_OF_INDEXES;
+#else
+static pthread_key_t StreamPool_ThreadSlot;
+#endif
+
 /**
  * Methods
  */
 
-void StreamPool_ShiftUsed(wStreamPool* pool, int index, int count)
+static int StreamPool_Log2Floor(size_t size)
+{
+#if defined(__GNUC__)
+	return (int)(sizeof(unsigned long long) * 8 - 1) - __builtin_clzll((unsigned long long) size);
+#else
+	int shift = 0;
+
+	while (size >>= 1)
+		shift++;
+
+	return shift;
+#endif
+}
+
+/**
+ * Size class to take a stream of size bytes from, -1 if too large.
+ */
+
+static int StreamPool_TakeClass(size_t size)
+{
+	int shift;
+
+	if (size <= ((size_t) 1 << STREAMPOOL_MIN_SHIFT))
+		return 0;
+
+	shift = StreamPool_Log2Floor(size - 1) + 1;
+
+	if (shift > STREAMPOOL_MAX_SHIFT)
+		return -1;
+
+	return shift - STREAMPOOL_MIN_SHIFT;
+}
+
+/**
+ * Size class to return a stream of the given capacity to, -1 if it is not
+ * cached. The capacity may have grown since the stream was taken.
+ */
+
+static int StreamPool_ReturnClass(size_t capacity)
+{
+	int shift;
+
+	if (capacity < ((size_t) 1 << STREAMPOOL_MIN_SHIFT))
+		return -1;
+
+	shift = StreamPool_Log2Floor(capacity);
+
+	if (shift > STREAMPOOL_MAX_SHIFT)
+		return -1;
+
+	return shift - STREAMPOOL_MIN_SHIFT;
+}
+
+static void StreamPool_Link(wStreamPool* pool, wStream* s)
+{
+	s->poolPrev = NULL;
+	s->poolNext = pool->streams;
+
+	if (pool->streams)
+		pool->streams->poolPrev = s;
+
+	pool->streams = s;
+}
+
+static void StreamPool_Unlink(wStreamPool* pool, wStream* s)
+{
+	if (s->poolPrev)
+		s->poolPrev->poolNext = s->poolNext;
+	else
+		pool->streams = s->poolNext;
+
+	if (s->poolNext)
+		s->poolNext->poolPrev = s->poolPrev;
+
+	s->poolNext = s->poolPrev = NULL;
+}
+
+static void StreamPool_UnlinkMagazine(wStreamPool* pool, wStreamPoolMagazine* magazine)
 {
-	if (count > 0)
+	wStreamPoolMagazine** prev;
+
+	for (prev = &pool->magazines; *prev; prev = &(*prev)->next)
 	{
-		if (pool->uSize + count > pool->uCapacity)
+		if (*prev == magazine)
 		{
-			int new_cap;
-			wStream **new_arr;
-
-			new_cap = pool->uCapacity * 2;
-			new_arr = (wStream**) realloc(pool->uArray, sizeof(wStream*) * new_cap);
-			if (!new_arr)
-				return;
-			pool->uCapacity = new_cap;
-			pool->uArray = new_arr;
+			*prev = magazine->next;
+			pool->numMagazines--;
+			break;
 		}
-
-		MoveMemory(&pool->uArray[index + count], &pool->uArray[index], (pool->uSize - index) * sizeof(wStream*));
-		pool->uSize += count;
 	}
-	else if (count < 0)
+}
+
+/**
+ * Thread exit: returns the cached streams to their pools and frees the
+ * magazines of the thread.
+ */
+
+#if defined(_WIN32)
+static VOID WINAPI StreamPool_ThreadExit(PVOID value)
+#else
+static void StreamPool_ThreadExit(void* value)
+#endif
+{
+	int index;
+	wStreamPoolMagazine* magazine = (wStreamPoolMagazine*) value;
+	wStreamPoolMagazine* next;
+
+	EnterCriticalSection(&StreamPool_MagazineLock);
+
+	for (; magazine; magazine = next)
 	{
-		if (pool->uSize - index + count > 0)
+		wStreamPool* pool = magazine->pool;
+		next = magazine->threadNext;
+
+		if (pool)
 		{
-			MoveMemory(&pool->uArray[index], &pool->uArray[index - count],
-					(pool->uSize - index + count) * sizeof(wStream*));
+			EnterCriticalSection(&pool->lock);
+
+			for (index = 0; index < STREAMPOOL_MAGAZINE_CLASSES; index++)
+			{
+				wStream* s;
+
+				while ((s = magazine->streams[index]))
+				{
+					magazine->streams[index] = s->next;
+					s->next = pool->aClasses[index];
+					pool->aClasses[index] = s;
+				}
+			}
+
+			pool->hits += magazine->hits;
+			StreamPool_UnlinkMagazine(pool, magazine);
+			LeaveCriticalSection(&pool->lock);
 		}
 
-		pool->uSize += count;
+		free(magazine);
 	}
+
+	LeaveCriticalSection(&StreamPool_MagazineLock);
+}
+
+static BOOL CALLBACK StreamPool_Init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	WINPR_UNUSED(once);
+	WINPR_UNUSED(param);
+	WINPR_UNUSED(context);
+
+	if (!InitializeCriticalSectionAndSpinCount(&StreamPool_MagazineLock, 4000))
+		return FALSE;
+
+#if defined(_WIN32)
+	StreamPool_ThreadSlot = FlsAlloc(StreamPool_ThreadExit);
+	StreamPool_ThreadSlotValid = (StreamPool_ThreadSlot != FLS_OUT_OF_INDEXES);
+#else
+	StreamPool_ThreadSlotValid = (pthread_key_create(&StreamPool_ThreadSlot,
+	                              StreamPool_ThreadExit) == 0);
+#endif
+	return TRUE;
+}
+
+static wStreamPoolMagazine* StreamPool_GetThreadMagazines(void)
+{
+#if defined(_WIN32)
+	return (wStreamPoolMagazine*) FlsGetValue(StreamPool_ThreadSlot);
+#else
+	return (wStreamPoolMagazine*) pthread_getspecific(StreamPool_ThreadSlot);
+#endif
+}
+
+static BOOL StreamPool_SetThreadMagazines(wStreamPoolMagazine* magazines)
+{
+#if defined(_WIN32)
+	return FlsSetValue(StreamPool_ThreadSlot, magazines);
+#else
+	return pthread_setspecific(StreamPool_ThreadSlot, magazines) == 0;
+#endif
 }
 
 /**
- * Adds a used stream to the pool.
+ * Returns the magazine of the calling thread for the pool, NULL if it has none.
  */
 
-void StreamPool_AddUsed(wStreamPool* pool, wStream* s)
+static wStreamPoolMagazine* StreamPool_FindMagazine(wStreamPool* pool)
 {
-	if ((pool->uSize + 1) >= pool->uCapacity)
+	wStreamPoolMagazine* magazine;
+
+	if (!StreamPool_ThreadSlotValid)
+		return NULL;
+
+	for (magazine = StreamPool_GetThreadMagazines(); magazine; magazine = magazine->threadNext)
 	{
-		int new_cap;
-		wStream **new_arr;
-
-		new_cap = pool->uCapacity * 2;
-		new_arr = (wStream**) realloc(pool->uArray, sizeof(wStream*) * new_cap);
-		if (!new_arr)
-			return;
-		pool->uCapacity = new_cap;
-		pool->uArray = new_arr;
+		if (magazine->pool == pool)
+			return magazine;
 	}
 
-	pool->uArray[(pool->uSize)++] = s;
+	return NULL;
 }
 
 /**
- * Removes a used stream from the pool.
+ * Returns the magazine of the calling thread, creating it on first use.
+ * The number of magazines is limited, threads beyond that use the pool.
  */
 
-void StreamPool_RemoveUsed(wStreamPool* pool, wStream* s)
+static wStreamPoolMagazine* StreamPool_GetMagazine(wStreamPool* pool)
 {
-	int index;
-	BOOL found = FALSE;
+	wStreamPoolMagazine* head;
+	wStreamPoolMagazine* magazine;
+	wStreamPoolMagazine** prev;
+
+	if ((magazine = StreamPool_FindMagazine(pool)) || !StreamPool_ThreadSlotValid ||
+	    (pool->numMagazines >= pool->maxMagazines))
+		return magazine;
 
-	for (index = 0; index < pool->uSize; index++)
+	if (!(magazine = (wStreamPoolMagazine*) calloc(1, sizeof(wStreamPoolMagazine))))
+		return NULL;
+
+	magazine->pool = pool;
+	EnterCriticalSection(&StreamPool_MagazineLock);
+	head = StreamPool_GetThreadMagazines();
+
+	/* drop the magazines of pools freed meanwhile */
+	for (prev = &head; *prev;)
 	{
-		if (pool->uArray[index] == s)
+		wStreamPoolMagazine* orphan = *prev;
+
+		if (orphan->pool)
 		{
-			found = TRUE;
-			break;
+			prev = &orphan->threadNext;
+			continue;
 		}
+
+		*prev = orphan->threadNext;
+		free(orphan);
 	}
 
-	if (found)
-		StreamPool_ShiftUsed(pool, index, -1);
-}
+	EnterCriticalSection(&pool->lock);
 
-void StreamPool_ShiftAvailable(wStreamPool* pool, int index, int count)
-{
-	if (count > 0)
+	if (pool->numMagazines < pool->maxMagazines)
 	{
-		if (pool->aSize + count > pool->aCapacity)
-		{
-			int new_cap;
-			wStream **new_arr;
-
-			new_cap = pool->aCapacity * 2;
-			new_arr = (wStream**) realloc(pool->aArray, sizeof(wStream*) * new_cap);
-			if (!new_arr)
-				return;
-			pool->aCapacity = new_cap;
-			pool->aArray = new_arr;
-		}
-
-		MoveMemory(&pool->aArray[index + count], &pool->aArray[index], (pool->aSize - index) * sizeof(wStream*));
-		pool->aSize += count;
+		magazine->next = pool->magazines;
+		pool->magazines = magazine;
+		pool->numMagazines++;
+		magazine->threadNext = head;
+		head = magazine;
 	}
-	else if (count < 0)
+	else
 	{
-		if (pool->aSize - index + count > 0)
-		{
-			MoveMemory(&pool->aArray[index], &pool->aArray[index - count],
-					(pool->aSize - index + count) * sizeof(wStream*));
-		}
+		free(magazine);
+		magazine = NULL;
+	}
 
-		pool->aSize += count;
+	if (!StreamPool_SetThreadMagazines(head) && magazine)
+	{
+		StreamPool_UnlinkMagazine(pool, magazine);
+		free(magazine);
+		magazine = NULL;
 	}
+
+	LeaveCriticalSection(&pool->lock);
+	LeaveCriticalSection(&StreamPool_MagazineLock);
+	return magazine;
+}
+
+static void StreamPool_Discard(wStreamPool* pool, wStream* s)
+{
+	if (pool->synchronized)
+		EnterCriticalSection(&pool->lock);
+
+	StreamPool_Unlink(pool, s);
+
+	if (pool->synchronized)
+		LeaveCriticalSection(&pool->lock);
+
+	Stream_Free(s, TRUE);
 }
 
 /**
@@ -144,52 +347,79 @@ void StreamPool_ShiftAvailable(wStreamPool* pool, int index, int count)
 wStream* StreamPool_Take(wStreamPool* pool, size_t size)
 {
 	int index;
-	int foundIndex;
+	size_t capacity;
 	wStream* s = NULL;
-
-	if (pool->synchronized)
-		EnterCriticalSection(&pool->lock);
+	wStreamPoolMagazine* magazine = NULL;
 
 	if (size == 0)
 		size = pool->defaultSize;
 
-	foundIndex = -1;
+	index = StreamPool_TakeClass(size);
+
+	if ((index >= 0) && (index < STREAMPOOL_MAGAZINE_CLASSES) && pool->synchronized)
+		magazine = StreamPool_GetMagazine(pool);
 
-	for (index = 0; index < pool->aSize; index++)
+	if (magazine && magazine->streams[index])
+	{
+		s = magazine->streams[index];
+		magazine->streams[index] = s->next;
+		magazine->counts[index]--;
+		magazine->hits++;
+		InterlockedDecrement(&pool->aSize);
+	}
+	else if (index >= 0)
 	{
-		s = pool->aArray[index];
+		if (pool->synchronized)
+			EnterCriticalSection(&pool->lock);
 
-		if (Stream_Capacity(s) >= size)
+		if ((s = pool->aClasses[index]))
 		{
-			foundIndex = index;
-			break;
+			pool->aClasses[index] = s->next;
+			pool->hits++;
+			InterlockedDecrement(&pool->aSize);
 		}
-	}
+		else
+			pool->misses++;
 
-	if (foundIndex < 0)
-	{
-		s = Stream_New(NULL, size);
-		if (!s)
-			goto out_fail;
+		if (pool->synchronized)
+			LeaveCriticalSection(&pool->lock);
 	}
 	else
 	{
-		Stream_SetPosition(s, 0);
-		Stream_SetLength(s, Stream_Capacity(s));
-		StreamPool_ShiftAvailable(pool, foundIndex, -1);
+		if (pool->synchronized)
+			EnterCriticalSection(&pool->lock);
+
+		pool->misses++;
+
+		if (pool->synchronized)
+			LeaveCriticalSection(&pool->lock);
 	}
 
 	if (s)
 	{
-		s->pool = pool;
-		s->count = 1;
-		StreamPool_AddUsed(pool, s);
+		Stream_SetPosition(s, 0);
+		Stream_SetLength(s, Stream_Capacity(s));
 	}
+	else
+	{
+		capacity = (index >= 0) ? ((size_t) 1 << (index + STREAMPOOL_MIN_SHIFT)) : size;
 
-out_fail:
-	if (pool->synchronized)
-		LeaveCriticalSection(&pool->lock);
+		if (!(s = Stream_New(NULL, capacity)))
+			return NULL;
+
+		if (pool->synchronized)
+			EnterCriticalSection(&pool->lock);
+
+		StreamPool_Link(pool, s);
+
+		if (pool->synchronized)
+			LeaveCriticalSection(&pool->lock);
+	}
 
+	s->pool = pool;
+	s->count = 1;
+	s->next = NULL;
+	InterlockedIncrement(&pool->uSize);
 	return s;
 }
 
@@ -199,38 +429,40 @@ out_fail:
 
 void StreamPool_Return(wStreamPool* pool, wStream* s)
 {
-	if (pool->synchronized)
-		EnterCriticalSection(&pool->lock);
+	int index;
+	wStreamPoolMagazine* magazine = NULL;
+
+	if (!s)
+		return;
+
+	InterlockedDecrement(&pool->uSize);
+	index = StreamPool_ReturnClass(Stream_Capacity(s));
 
-	if ((pool->aSize + 1) >= pool->aCapacity)
+	if (index < 0)
 	{
-		int new_cap;
-		wStream **new_arr;
-
-		new_cap = pool->aCapacity * 2;
-		new_arr = (wStream**) realloc(pool->aArray, sizeof(wStream*) * new_cap);
-		if (!new_arr)
-			goto out_fail;
-		pool->aCapacity = new_cap;
-		pool->aArray = new_arr;
+		StreamPool_Discard(pool, s);
+		return;
 	}
-	else if ((pool->aSize + 1) * 3 < pool->aCapacity)
+
+	if ((index < STREAMPOOL_MAGAZINE_CLASSES) && pool->synchronized)
+		magazine = StreamPool_GetMagazine(pool);
+
+	InterlockedIncrement(&pool->aSize);
+
+	if (magazine && (magazine->counts[index] < STREAMPOOL_MAGAZINE_DEPTH))
 	{
-		int new_cap;
-		wStream **new_arr;
-
-		new_cap = pool->aCapacity / 2;
-		new_arr = (wStream**) realloc(pool->aArray, sizeof(wStream*) * new_cap);
-		if (!new_arr)
-			goto out_fail;
-		pool->aCapacity = new_cap;
-		pool->aArray = new_arr;
+		s->next = magazine->streams[index];
+		magazine->streams[index] = s;
+		magazine->counts[index]++;
+		return;
 	}
 
-	pool->aArray[(pool->aSize)++] = s;
-	StreamPool_RemoveUsed(pool, s);
+	if (pool->synchronized)
+		EnterCriticalSection(&pool->lock);
+
+	s->next = pool->aClasses[index];
+	pool->aClasses[index] = s;
 
-out_fail:
 	if (pool->synchronized)
 		LeaveCriticalSection(&pool->lock);
 }
@@ -260,11 +492,7 @@ void StreamPool_Unlock(wStreamPool* pool)
 void Stream_AddRef(wStream* s)
 {
 	if (s->pool)
-	{
-		StreamPool_Lock(s->pool);
-		s->count++;
-		StreamPool_Unlock(s->pool);
-	}
+		InterlockedIncrement((LONG*) &s->count);
 }
 
 /**
@@ -273,15 +501,9 @@ void Stream_AddRef(wStream* s)
 
 void Stream_Release(wStream* s)
 {
-	DWORD count;
-
 	if (s->pool)
 	{
-		StreamPool_Lock(s->pool);
-		count = --(s->count);
-		StreamPool_Unlock(s->pool);
-
-		if (count == 0)
+		if (InterlockedDecrement((LONG*) &s->count) == 0)
 			StreamPool_Return(s->pool, s);
 	}
 }
@@ -292,26 +514,20 @@ void Stream_Release(wStream* s)
 
 wStream* StreamPool_Find(wStreamPool* pool, BYTE* ptr)
 {
-	int index;
-	wStream* s = NULL;
-	BOOL found = FALSE;
+	wStream* s;
 
 	EnterCriticalSection(&pool->lock);
 
-	for (index = 0; index < pool->uSize; index++)
+	for (s = pool->streams; s; s = s->poolNext)
 	{
-		s = pool->uArray[index];
-
-		if ((ptr >= Stream_Buffer(s)) && (ptr < (Stream_Buffer(s) + Stream_Capacity(s))))
-		{
-			found = TRUE;
+		if ((s->count > 0) && (ptr >= Stream_Buffer(s)) &&
+		    (ptr < (Stream_Buffer(s) + Stream_Capacity(s))))
 			break;
-		}
 	}
 
 	LeaveCriticalSection(&pool->lock);
 
-	return (found) ? s : NULL;
+	return s;
 }
 
 /**
@@ -342,25 +558,80 @@ void StreamPool_Release(wStreamPool* pool, BYTE* ptr)
 		Stream_Release(s);
 }
 
+static void StreamPool_FreeList(wStreamPool* pool, wStream* s)
+{
+	wStream* next;
+
+	for (; s; s = next)
+	{
+		next = s->next;
+		StreamPool_Unlink(pool, s);
+		Stream_Free(s, TRUE);
+		InterlockedDecrement(&pool->aSize);
+	}
+}
+
 /**
- * Releases the streams currently cached in the pool.
+ * Releases the streams currently cached in the pool. Streams in the
+ * magazines of other threads are kept, they are freed with the pool.
  */
 
 void StreamPool_Clear(wStreamPool* pool)
 {
+	int index;
+	wStreamPoolMagazine* magazine = NULL;
+
+	if (pool->synchronized)
+		magazine = StreamPool_FindMagazine(pool);
+
 	if (pool->synchronized)
 		EnterCriticalSection(&pool->lock);
 
-	while (pool->aSize > 0)
+	for (index = 0; index < STREAMPOOL_CLASSES; index++)
+	{
+		StreamPool_FreeList(pool, pool->aClasses[index]);
+		pool->aClasses[index] = NULL;
+	}
+
+	if (magazine)
 	{
-		(pool->aSize)--;
-		Stream_Free(pool->aArray[pool->aSize], TRUE);
+		for (index = 0; index < STREAMPOOL_MAGAZINE_CLASSES; index++)
+		{
+			StreamPool_FreeList(pool, magazine->streams[index]);
+			magazine->streams[index] = NULL;
+			magazine->counts[index] = 0;
+		}
 	}
 
 	if (pool->synchronized)
 		LeaveCriticalSection(&pool->lock);
 }
 
+/**
+ * Gets the hit and miss counters of the pool and the number of cached and
+ * taken streams. The counters of other threads are read without locking.
+ */
+
+BOOL StreamPool_GetStatistics(wStreamPool* pool, wStreamPoolStatistics* stats)
+{
+	wStreamPoolMagazine* magazine;
+
+	if (!pool || !stats)
+		return FALSE;
+
+	EnterCriticalSection(&pool->lock);
+	stats->hits = pool->hits;
+	stats->misses = pool->misses;
+
+	for (magazine = pool->magazines; magazine; magazine = magazine->next)
+		stats->hits += magazine->hits;
+
+	stats->cached = (UINT32) pool->aSize;
+	stats->used = (UINT32) pool->uSize;
+	LeaveCriticalSection(&pool->lock);
+	return TRUE;
+}
+
 /**
  * Construction, Destruction
  */
@@ -376,28 +647,25 @@ wStreamPool* StreamPool_New(BOOL synchronized, size_t defaultSize)
 		pool->synchronized = synchronized;
 		pool->defaultSize = defaultSize;
 
-		pool->aSize = 0;
-		pool->aCapacity = 32;
-		pool->aArray = (wStream**) calloc(pool->aCapacity, sizeof(wStream*));
-
-		if (!pool->aArray)
+		if (synchronized)
 		{
-			free(pool);
-			return NULL;
-		}
+			SYSTEM_INFO sysinfo;
+			GetNativeSystemInfo(&sysinfo);
+			pool->maxMagazines = (LONG)(sysinfo.dwNumberOfProcessors * 2);
 
-		pool->uSize = 0;
-		pool->uCapacity = 32;
-		pool->uArray = (wStream**) calloc(pool->uCapacity, sizeof(wStream*));
+			if (pool->maxMagazines < 4)
+				pool->maxMagazines = 4;
 
-		if (!pool->uArray)
+			/* without a thread slot the pool works without magazines */
+			if (!InitOnceExecuteOnce(&StreamPool_InitOnce, StreamPool_Init, NULL, NULL))
+				pool->maxMagazines = 0;
+		}
+
+		if (!InitializeCriticalSectionAndSpinCount(&pool->lock, 4000))
 		{
-			free(pool->aArray);
 			free(pool);
 			return NULL;
 		}
-
-		InitializeCriticalSectionAndSpinCount(&pool->lock, 4000);
 	}
 
 	return pool;
@@ -407,12 +675,33 @@ void StreamPool_Free(wStreamPool* pool)
 {
 	if (pool)
 	{
+		int index;
+		wStreamPoolMagazine* magazine;
+
 		StreamPool_Clear(pool);
 
-		DeleteCriticalSection(&pool->lock);
+		if (pool->magazines)
+		{
+			EnterCriticalSection(&StreamPool_MagazineLock);
 
-		free(pool->aArray);
-		free(pool->uArray);
+			while ((magazine = pool->magazines))
+			{
+				pool->magazines = magazine->next;
+
+				for (index = 0; index < STREAMPOOL_MAGAZINE_CLASSES; index++)
+				{
+					StreamPool_FreeList(pool, magazine->streams[index]);
+					magazine->streams[index] = NULL;
+				}
+
+				/* the owning thread frees the magazine itself */
+				magazine->pool = NULL;
+			}
+
+			LeaveCriticalSection(&StreamPool_MagazineLock);
+		}
+
+		DeleteCriticalSection(&pool->lock);
 
 		free(pool);
 	}
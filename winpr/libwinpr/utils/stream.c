@@ -107,6 +107,7 @@ wStream* Stream_New(BYTE* buffer, size_t size)
 	s->count = 0;
 	s->isAllocatedStream = TRUE;
 	s->isOwner = TRUE;
+	s->next = s->poolNext = s->poolPrev = NULL;
 	return s;
 }
 
@@ -121,6 +122,7 @@ void Stream_StaticInit(wStream *s, BYTE *buffer, size_t size)
 	s->count = 0;
 	s->isAllocatedStream = FALSE;
 	s->isOwner = FALSE;
+	s->next = s->poolNext = s->poolPrev = NULL;
 }
 
 void Stream_Free(wStream* s, BOOL bFreeBuffer)
@@ -1,15 +1,255 @@
 
 #include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
 #include <winpr/stream.h>
 #include <winpr/collections.h>
 
 #define BUFFER_SIZE 16384
 
+static int test_stream_pool_classes(void)
+{
+	int rc = -1;
+	wStream* s;
+	wStream* t;
+	wStreamPoolStatistics stats;
+	wStreamPool* pool = StreamPool_New(TRUE, BUFFER_SIZE);
+
+	if (!pool)
+		return -1;
+
+	/* sizes are rounded up to the next power of two */
+	if (!(s = StreamPool_Take(pool, 1000)) || (Stream_Capacity(s) != 1024))
+		goto fail;
+
+	Stream_Release(s);
+
+	/* any size of the same class gets the cached stream back */
+	if (!(t = StreamPool_Take(pool, 600)) || (t != s))
+		goto fail;
+
+	/* a grown stream goes to the class of its new capacity */
+	if (!Stream_EnsureCapacity(t, 5000))
+		goto fail;
+
+	Stream_Release(t);
+
+	if (!(s = StreamPool_Take(pool, 8000)) || (s != t) || (Stream_Capacity(s) != 8192))
+		goto fail;
+
+	if (StreamPool_Find(pool, Stream_Buffer(s) + 100) != s)
+		goto fail;
+
+	Stream_Release(s);
+
+	if (StreamPool_Find(pool, Stream_Buffer(s) + 100) != NULL)
+		goto fail;
+
+	if (!StreamPool_GetStatistics(pool, &stats))
+		goto fail;
+
+	printf("StreamPool: hits: %"PRIu64" misses: %"PRIu64" cached: %"PRIu32" used: %"PRIu32"\n",
+	       stats.hits, stats.misses, stats.cached, stats.used);
+
+	if ((stats.hits != 2) || (stats.misses != 1) || (stats.cached != 1) || (stats.used != 0))
+		goto fail;
+
+	rc = 0;
+fail:
+	StreamPool_Free(pool);
+	return rc;
+}
+
+static DWORD WINAPI test_stream_pool_thread(LPVOID arg)
+{
+	int i;
+	wStream* s[8];
+	wStreamPool* pool = (wStreamPool*) arg;
+
+	for (i = 0; i < 20000; i++)
+	{
+		const int n = i % 8;
+
+		if (!(s[n] = StreamPool_Take(pool, (size_t)(64 << (i % 12)))))
+			return 1;
+
+		Stream_Write_UINT32(s[n], (UINT32) i);
+
+		if (n == 7)
+		{
+			int j;
+
+			for (j = 0; j < 8; j++)
+				Stream_Release(s[j]);
+		}
+	}
+
+	return 0;
+}
+
+static int test_stream_pool_threads(void)
+{
+	int i;
+	int rc = 0;
+	HANDLE threads[4];
+	DWORD exitCode;
+	wStreamPoolStatistics stats;
+	wStreamPool* pool = StreamPool_New(TRUE, BUFFER_SIZE);
+
+	if (!pool)
+		return -1;
+
+	for (i = 0; i < 4; i++)
+	{
+		if (!(threads[i] = CreateThread(NULL, 0, test_stream_pool_thread, pool, 0, NULL)))
+			return -1;
+	}
+
+	for (i = 0; i < 4; i++)
+	{
+		WaitForSingleObject(threads[i], INFINITE);
+
+		if (!GetExitCodeThread(threads[i], &exitCode) || (exitCode != 0))
+			rc = -1;
+
+		CloseHandle(threads[i]);
+	}
+
+	if (!StreamPool_GetStatistics(pool, &stats) || (stats.used != 0) ||
+	    (stats.hits + stats.misses != 4 * 20000))
+		rc = -1;
+
+	printf("StreamPool threads: hits: %"PRIu64" misses: %"PRIu64" cached: %"PRIu32"\n",
+	       stats.hits, stats.misses, stats.cached);
+	StreamPool_Free(pool);
+	return rc;
+}
+
+static DWORD WINAPI test_stream_pool_exit_thread(LPVOID arg)
+{
+	wStream* s;
+	wStreamPool* pool = (wStreamPool*) arg;
+
+	/* the stream cached by the previous thread is back in the shared list */
+	if (!(s = StreamPool_Take(pool, 100)) || (pool->aClasses[1] != NULL))
+		return 1;
+
+	Stream_Release(s);
+
+	/* and this thread got a magazine of its own to return it to */
+	if ((pool->numMagazines != 1) || (pool->aClasses[1] != NULL) || (pool->aSize != 1))
+		return 1;
+
+	return 0;
+}
+
+static int test_stream_pool_thread_exit(void)
+{
+	int i;
+	int j;
+	int rc = 0;
+	wStream* s;
+	wStreamPool* pool = StreamPool_New(TRUE, BUFFER_SIZE);
+
+	if (!pool || !(s = Stream_New(NULL, 128)))
+		return -1;
+
+	/* seed the shared list, the calling thread has no magazine for the pool */
+	pool->aClasses[1] = s;
+	pool->streams = s;
+	s->next = NULL;
+	s->pool = pool;
+	pool->aSize = 1;
+
+	/* more threads than magazines, one after the other */
+	for (i = 0; i < 3 * pool->maxMagazines; i++)
+	{
+		DWORD exitCode;
+		HANDLE thread = CreateThread(NULL, 0, test_stream_pool_exit_thread, pool, 0, NULL);
+
+		if (!thread)
+			return -1;
+
+		WaitForSingleObject(thread, INFINITE);
+
+		if (!GetExitCodeThread(thread, &exitCode) || (exitCode != 0))
+			rc = -1;
+
+		CloseHandle(thread);
+
+		/* the thread handle is signalled before the thread slot destructors ran */
+		for (j = 0; (j < 500) && (pool->numMagazines != 0); j++)
+			Sleep(10);
+
+		if ((pool->numMagazines != 0) || !pool->aClasses[1] || (pool->aSize != 1))
+			rc = -1;
+	}
+
+	if (rc < 0)
+		printf("StreamPool: magazine of an exited thread was not returned\n");
+
+	StreamPool_Free(pool);
+	return rc;
+}
+
+static int test_stream_pool_many(void)
+{
+	int i;
+	int rc = 0;
+	DWORD tlsIndex;
+	const int count = 2048;
+	wStreamPool** pools = (wStreamPool**) calloc(count, sizeof(wStreamPool*));
+
+	if (!pools)
+		return -1;
+
+	/* more pools than a process has thread local storage keys */
+	for (i = 0; i < count; i++)
+	{
+		wStream* s;
+
+		if (!(pools[i] = StreamPool_New(TRUE, BUFFER_SIZE)) ||
+		    !(s = StreamPool_Take(pools[i], 0)))
+		{
+			rc = -1;
+			break;
+		}
+
+		Stream_Release(s);
+
+		if (pools[i]->numMagazines != 1)
+			rc = -1;
+	}
+
+	if ((tlsIndex = TlsAlloc()) == TLS_OUT_OF_INDEXES)
+		rc = -1;
+	else
+		TlsFree(tlsIndex);
+
+	for (i = 0; i < count; i++)
+		StreamPool_Free(pools[i]);
+
+	free(pools);
+	return rc;
+}
+
 int TestStreamPool(int argc, char* argv[])
 {
 	wStream* s[5];
 	wStreamPool* pool;
 
+	if (test_stream_pool_classes() < 0)
+		return -1;
+
+	if (test_stream_pool_threads() < 0)
+		return -1;
+
+	if (test_stream_pool_thread_exit() < 0)
+		return -1;
+
+	if (test_stream_pool_many() < 0)
+		return -1;
+
 	pool = StreamPool_New(TRUE, BUFFER_SIZE);
 
 	s[0] = StreamPool_Take(pool, 0);